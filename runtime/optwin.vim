@@ -258,6 +258,8 @@ call append("$", "incsearch\tshow match for partly typed search command")
 call <SID>BinOptionG("is", &is)
 call append("$", "magic\tchange the way backslashes are used in search patterns")
 call <SID>BinOptionG("magic", &magic)
+call append("$", "regexpcache\tnumber of compiled patterns to remember")
+call <SID>OptionG("rxc", &rxc)
 call append("$", "regexpengine\tselect the default regexp engine used")
 call <SID>OptionG("re", &re)
 call append("$", "ignorecase\tignore case when using a search pattern")
@@ -395,6 +397,10 @@ if has("syntax")
   call append("$", "synmaxcol\tmaximum column to look for syntax items")
   call append("$", "\t(local to buffer)")
   call <SID>OptionL("smc")
+  if has("eval")
+    call append("$", "syntaxcache\tremember the items defined by syntax files")
+    call <SID>BinOptionG("sxc", &sxc)
+  endif
 endif
 call append("$", "highlight\twhich highlighting to use for various occasions")
 call <SID>OptionG("hl", &hl)
@@ -524,6 +530,8 @@ call append("$", "scrolljump\tminimal number of lines to scroll at a time")
 call append("$", " \tset sj=" . &sj)
 call append("$", "ttyscroll\tmaximum number of lines to use scrolling instead of redrawing")
 call append("$", " \tset tsl=" . &tsl)
+call append("$", "ttybufsize\tmaximum number of bytes to collect before writing to the terminal")
+call append("$", " \tset tbz=" . &tbz)
 if has("gui") || has("msdos") || has("win32")
   call append("$", "guicursor\tspecifies what the cursor looks like in different modes")
   call <SID>OptionG("gcr", &gcr)
@@ -1011,6 +1019,10 @@ call append("$", "maxmem\tmaximum amount of memory in Kbyte used for one buffer"
 call append("$", " \tset mm=" . &mm)
 call append("$", "maxmemtot\tmaximum amount of memory in Kbyte used for all buffers")
 call append("$", " \tset mmt=" . &mmt)
+if has("mmap")
+  call append("$", "mmapsize\tminimum size in Kbyte of a file to map it into memory")
+  call append("$", " \tset mms=" . &mms)
+endif
 
 
 call <SID>Header("command line editing")
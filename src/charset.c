@@ -21,8 +21,15 @@ static int win_nolbr_chartabsize __ARGS((win_T *wp, char_u *s, colnr_T col, int
 #endif
 
 static unsigned nr2hex __ARGS((unsigned c));
+static void vcol_cache_width __ARGS((win_T *wp, int *width1, int *width2));
+static vcolcache_T *vcol_cache_valid __ARGS((win_T *wp, linenr_T lnum));
+static char_u *vcol_cache_add __ARGS((win_T *wp, linenr_T lnum, char_u *line, char_u *ptr, colnr_T vcol));
 
 static int    chartab_initialized = FALSE;
+static int    chartab_tick = 0;		/* incremented when chartab[] changes */
+static int    vcol_cache_used = FALSE;	/* a window remembers virtual columns */
+
+#define VCOL_STEP	512	/* bytes between remembered virtual columns */
 
 /* b_chartab[] is an array of 32 bytes, each bit representing one of the
  * characters 0-255. */
@@ -76,6 +83,7 @@ buf_init_chartab(buf, global)
 
     if (global)
     {
+	++chartab_tick;
 	/*
 	 * Set the default size for printable characters:
 	 * From <Space> to '~' is 1 (printable), others are 2 (not printable).
@@ -1272,15 +1280,19 @@ getvcol(wp, pos, start, cursor, end)
     colnr_T	*end;
 {
     colnr_T	vcol;
+    char_u	*line;		/* start of the line */
     char_u	*ptr;		/* points to current char */
     char_u	*posptr;	/* points to char at pos->col */
+    char_u	*cp_next = NULL; /* where to remember the next vcol */
+    vcolcache_T	*vc;
+    vcolpoint_T	*vp;
     int		incr;
     int		head;
     int		ts = wp->w_buffer->b_p_ts;
     int		c;
 
     vcol = 0;
-    ptr = ml_get_buf(wp->w_buffer, pos->lnum, FALSE);
+    line = ptr = ml_get_buf(wp->w_buffer, pos->lnum, FALSE);
     if (pos->col == MAXCOL)
 	posptr = NULL;  /* continue until the NUL */
     else
@@ -1297,6 +1309,24 @@ getvcol(wp, pos, start, cursor, end)
 #endif
        )
     {
+	/* In a long line start at the closest remembered virtual column and
+	 * remember the virtual columns passed on the way. */
+	if (pos->col >= VCOL_STEP)
+	{
+	    vc = vcol_cache_valid(wp, pos->lnum);
+	    if (vc == NULL)
+		cp_next = line + VCOL_STEP;
+	    else
+	    {
+		vp = vc->vc_points + (pos->col / VCOL_STEP < vc->vc_count
+				? pos->col / VCOL_STEP : vc->vc_count - 1);
+		if (vp->vp_col > pos->col)
+		    --vp;
+		ptr = line + vp->vp_col;
+		vcol = vp->vp_vcol;
+		cp_next = line + vc->vc_count * VCOL_STEP;
+	    }
+	}
 #ifndef FEAT_MBYTE
 	head = 0;
 #endif
@@ -1305,6 +1335,8 @@ getvcol(wp, pos, start, cursor, end)
 #ifdef FEAT_MBYTE
 	    head = 0;
 #endif
+	    if (cp_next != NULL && ptr >= cp_next)
+		cp_next = vcol_cache_add(wp, pos->lnum, line, ptr, vcol);
 	    c = *ptr;
 	    /* make sure we don't go past the end of the line */
 	    if (c == NUL)
@@ -1404,6 +1436,269 @@ getvcol_nolist(posp)
     return vcol;
 }
 
+/*
+ * Get the text width of the first and further screen lines of window "wp",
+ * where a double-width character may be moved to the next screen line.  Zero
+ * when this doesn't happen.
+ */
+    static void
+vcol_cache_width(wp, width1, width2)
+    win_T	*wp;
+    int		*width1;
+    int		*width2;
+{
+#ifdef FEAT_MBYTE
+    if (has_mbyte && wp->w_p_wrap && W_WIDTH(wp) > 0)
+    {
+	*width1 = W_WIDTH(wp) - win_col_off(wp);
+	*width2 = *width1 + win_col_off2(wp);
+    }
+    else
+#endif
+    {
+	*width1 = 0;
+	*width2 = 0;
+    }
+}
+
+/*
+ * Return the virtual columns remembered for line "lnum" in window "wp", NULL
+ * when there are none or they were computed with other settings.
+ * Only valid when 'list', 'linebreak' and 'showbreak' don't change the
+ * width of characters, see getvcol().
+ */
+    static vcolcache_T *
+vcol_cache_valid(wp, lnum)
+    win_T	*wp;
+    linenr_T	lnum;
+{
+    vcolcache_T	*vc = &wp->w_vcol_cache;
+    int		width1;
+    int		width2;
+
+    if (vc->vc_fnum != wp->w_buffer->b_fnum || vc->vc_lnum != lnum
+	    || vc->vc_count == 0
+	    || vc->vc_ts != wp->w_buffer->b_p_ts
+	    || vc->vc_chartab_tick != chartab_tick
+#ifdef FEAT_MBYTE
+	    || vc->vc_ambw != *p_ambw
+#endif
+	    )
+	return NULL;
+    vcol_cache_width(wp, &width1, &width2);
+    if (vc->vc_width1 != width1 || vc->vc_width2 != width2)
+	return NULL;
+    return vc;
+}
+
+/*
+ * Remember that the character at "ptr" in "line", line "lnum" in window "wp",
+ * starts at virtual column "vcol".  Forgets what was remembered for another
+ * line or other settings.
+ * Returns where the next virtual column is to be remembered, NULL when out
+ * of memory.
+ */
+    static char_u *
+vcol_cache_add(wp, lnum, line, ptr, vcol)
+    win_T	*wp;
+    linenr_T	lnum;
+    char_u	*line;
+    char_u	*ptr;
+    colnr_T	vcol;
+{
+    vcolcache_T	*vc = &wp->w_vcol_cache;
+    vcolpoint_T	*points;
+    int		len;
+
+    if (vcol_cache_valid(wp, lnum) == NULL)
+    {
+	vc->vc_fnum = wp->w_buffer->b_fnum;
+	vc->vc_lnum = lnum;
+	vc->vc_ts = wp->w_buffer->b_p_ts;
+	vc->vc_chartab_tick = chartab_tick;
+#ifdef FEAT_MBYTE
+	vc->vc_ambw = *p_ambw;
+#endif
+	vcol_cache_width(wp, &vc->vc_width1, &vc->vc_width2);
+	vc->vc_count = 0;
+    }
+    if (vc->vc_count >= vc->vc_size)
+    {
+	len = vc->vc_size * 2 + 16;
+	points = (vcolpoint_T *)alloc((unsigned)(len * sizeof(vcolpoint_T)));
+	if (points == NULL)
+	    return NULL;
+	if (vc->vc_count > 0)
+	    mch_memmove(points, vc->vc_points,
+				      (size_t)vc->vc_count * sizeof(vcolpoint_T));
+	vim_free(vc->vc_points);
+	vc->vc_points = points;
+	vc->vc_size = len;
+    }
+    if (vc->vc_count == 0)
+    {
+	/* The start of the line is always the first point. */
+	vc->vc_points[0].vp_col = 0;
+	vc->vc_points[0].vp_vcol = 0;
+	vc->vc_count = 1;
+    }
+    if (ptr - line >= vc->vc_count * VCOL_STEP)
+    {
+	vc->vc_points[vc->vc_count].vp_col = (colnr_T)(ptr - line);
+	vc->vc_points[vc->vc_count].vp_vcol = vcol;
+	++vc->vc_count;
+    }
+    vcol_cache_used = TRUE;
+    return line + vc->vc_count * VCOL_STEP;
+}
+
+/*
+ * Find a character before virtual column "vcol" in line "lnum" of window
+ * "wp", to start counting virtual columns with win_lbr_chartabsize() instead
+ * of at the start of the line.
+ * Returns its byte index and sets "*startvcol", zero when nothing is known.
+ */
+    colnr_T
+vcol_cache_find(wp, lnum, vcol, startvcol)
+    win_T	*wp;
+    linenr_T	lnum;
+    colnr_T	vcol;
+    colnr_T	*startvcol;
+{
+    vcolcache_T	*vc;
+    int		lo, hi, mid;
+
+    *startvcol = 0;
+    if ((wp->w_p_list && lcs_tab1 == NUL)
+#ifdef FEAT_LINEBREAK
+	    || wp->w_p_lbr || *p_sbr != NUL
+#endif
+	    || (vc = vcol_cache_valid(wp, lnum)) == NULL)
+	return 0;
+
+    /* Binary search for the last point before "vcol". */
+    lo = 0;
+    hi = vc->vc_count - 1;
+    while (lo < hi)
+    {
+	mid = (lo + hi + 1) / 2;
+	if (vc->vc_points[mid].vp_vcol < vcol)
+	    lo = mid;
+	else
+	    hi = mid - 1;
+    }
+    *startvcol = vc->vc_points[lo].vp_vcol;
+    return vc->vc_points[lo].vp_col;
+}
+
+/*
+ * Called when lines "lnum" to "lnume - 1" in buffer "buf" were changed, the
+ * first one from byte "col" on.  Forget the virtual columns remembered after
+ * that.  When "lnum" is zero forget everything for "buf".
+ */
+    void
+vcol_cache_changed(buf, lnum, col, lnume)
+    buf_T	*buf;
+    linenr_T	lnum;
+    colnr_T	col;
+    linenr_T	lnume;
+{
+    win_T	*wp;
+#ifdef FEAT_WINDOWS
+    tabpage_T	*tp;
+#endif
+    vcolcache_T	*vc;
+
+    if (!vcol_cache_used)
+	return;
+    FOR_ALL_TAB_WINDOWS(tp, wp)
+    {
+	vc = &wp->w_vcol_cache;
+	if (vc->vc_fnum == buf->b_fnum && vc->vc_count > 0)
+	{
+	    if (lnum == 0 || (vc->vc_lnum > lnum && vc->vc_lnum < lnume))
+		vc->vc_count = 0;
+	    else if (vc->vc_lnum == lnum)
+		/* keep the points before "col", their text didn't change */
+		while (vc->vc_count > 0
+			   && vc->vc_points[vc->vc_count - 1].vp_col >= col)
+		    --vc->vc_count;
+	}
+    }
+}
+
+/*
+ * Called when lines were inserted or deleted in buffer "buf": lines from
+ * "lnum" on move down "xtra" lines.  When "xtra" is negative lines "lnum" to
+ * "lnum - xtra - 1" were deleted.
+ */
+    void
+vcol_cache_lines(buf, lnum, xtra)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	xtra;
+{
+    win_T	*wp;
+#ifdef FEAT_WINDOWS
+    tabpage_T	*tp;
+#endif
+    vcolcache_T	*vc;
+
+    if (!vcol_cache_used)
+	return;
+    FOR_ALL_TAB_WINDOWS(tp, wp)
+    {
+	vc = &wp->w_vcol_cache;
+	if (vc->vc_fnum == buf->b_fnum && vc->vc_count > 0
+							&& vc->vc_lnum >= lnum)
+	{
+	    if (xtra < 0 && vc->vc_lnum < lnum - xtra)
+		vc->vc_count = 0;
+	    else
+		vc->vc_lnum += xtra;
+	}
+    }
+}
+
+/*
+ * Called before line "lnum" in the current buffer is replaced with "newline".
+ * Finds where the text starts to differ to keep the virtual columns before
+ * it.
+ */
+    void
+vcol_cache_replace(lnum, newline)
+    linenr_T	lnum;
+    char_u	*newline;
+{
+    win_T	*wp;
+#ifdef FEAT_WINDOWS
+    tabpage_T	*tp;
+#endif
+    vcolcache_T	*vc;
+    colnr_T	maxcol = 0;
+    colnr_T	col;
+    char_u	*oldline;
+
+    if (!vcol_cache_used)
+	return;
+    FOR_ALL_TAB_WINDOWS(tp, wp)
+    {
+	vc = &wp->w_vcol_cache;
+	if (vc->vc_fnum == curbuf->b_fnum && vc->vc_lnum == lnum
+		&& vc->vc_count > 1
+		&& vc->vc_points[vc->vc_count - 1].vp_col > maxcol)
+	    maxcol = vc->vc_points[vc->vc_count - 1].vp_col;
+    }
+    if (maxcol == 0)
+	return;
+
+    oldline = ml_get(lnum);
+    for (col = 0; col < maxcol && oldline[col] == newline[col]
+						 && oldline[col] != NUL; ++col)
+	;
+    vcol_cache_changed(curbuf, lnum, col, lnum + 1);
+}
+
 #if defined(FEAT_VIRTUALEDIT) || defined(PROTO)
 /*
  * Get virtual column in virtual mode.
@@ -33,6 +33,9 @@
 
 #define DICT_MAXNEST 100	/* maximum nesting of lists and dicts */
 
+#define LIST_INDEX_MIN 64	/* minimal length of a list to make an array
+				   of its items for indexing */
+
 #define DO_NOT_FREE_CNT 99999	/* refcount for dict or list that should not
 				   be freed. */
 
@@ -163,6 +166,7 @@ static int echo_attr = 0;   /* attributes used for ":echo" */
  * Structure to hold info for a user function.
  */
 typedef struct ufunc ufunc_T;
+typedef struct funccode_S funccode_T;
 
 struct ufunc
 {
@@ -171,6 +175,8 @@ struct ufunc
     int		uf_calls;	/* nr of active calls */
     garray_T	uf_args;	/* arguments */
     garray_T	uf_lines;	/* function lines */
+    funccode_T	*uf_code;	/* compiled lines, NULL if not compiled */
+    int		uf_code_tried;	/* TRUE when compiling was attempted */
 #ifdef FEAT_PROFILE
     int		uf_profiling;	/* TRUE when func is being profiled */
     /* profiling the function as a whole */
@@ -213,6 +219,71 @@ static garray_T		ga_loaded = {0, 0, sizeof(char_u *), 4, NULL};
 static dict_T		*first_dict = NULL;	/* list of all dicts */
 static list_T		*first_list = NULL;	/* list of all lists */
 
+/*
+ * Evaluating expressions allocates and frees many list items, lists and
+ * dicts.  A number of freed ones are kept for reuse, linked with their first
+ * pointer, to avoid calling malloc() and free() each time.
+ */
+#define FREE_LISTITEM_MAX   500	/* max number of kept list items */
+#define FREE_LIST_MAX	    50	/* max number of kept lists */
+#define FREE_DICT_MAX	    50	/* max number of kept dicts */
+
+static listitem_T	*free_listitems = NULL;
+static int		free_listitem_cnt = 0;
+static list_T		*free_lists = NULL;
+static int		free_list_cnt = 0;
+static dict_T		*free_dicts = NULL;
+static int		free_dict_cnt = 0;
+
+/*
+ * garbage_collect_step() marks lists and dicts in steps.  The ones that were
+ * found but not gone through yet are on "gc_stack".
+ */
+typedef struct
+{
+    int		gs_copyID;	/* copyID to mark with */
+    list_T	*gs_list;	/* list to go through or NULL */
+    listitem_T	*gs_li;		/* next item of "gs_list" */
+    dict_T	*gs_dict;	/* dict to go through or NULL */
+    hashitem_T	*gs_hi;		/* next hashitem of "gs_dict" */
+    long	gs_todo;	/* number of items of "gs_dict" left */
+} gcentry_T;
+
+#define GC_STEP_ITEMS	2000	/* number of items marked in one step */
+
+static garray_T	gc_stack = {0, 0, sizeof(gcentry_T), 100, NULL};
+static int	gc_use_stack = FALSE;	/* put found lists and dicts on
+					   "gc_stack" */
+static int	gc_busy = FALSE;	/* inside garbage_collect_step() */
+static int	gc_copyID = 0;		/* copyID used by the steps, zero when
+					   not marking */
+static long_u	gc_tick;		/* "eval_tick" when marking started */
+
+/* Set when a list or dict was unreferenced but not freed: it may be in an
+ * unreferenced cycle that only garbage collection finds. */
+static int	gc_may_have_cycle = FALSE;
+
+/*
+ * State for decoding JSON.  The text is in "js_buf".  When reading from a
+ * file more text is read into "js_buf" when needed.
+ */
+typedef struct
+{
+    char_u	*js_buf;	/* text to decode, NUL terminated */
+    int		js_used;	/* number of bytes of "js_buf" used */
+    int		js_len;		/* number of bytes of text in "js_buf" */
+    FILE	*js_fd;		/* file to read more text from or NULL */
+#ifdef FEAT_MBYTE
+    vimconv_T	js_conv;	/* from UTF-8 to 'encoding' */
+#endif
+} jsread_T;
+
+#define JSON_BUFSIZE	4096	/* size of the buffer for reading a file */
+#define JSON_NUMLEN	64	/* bytes needed to decode a number */
+/* Largest value of a Number, a larger JSON number is not a Number. */
+#define JSON_NUMBER_MAX	((varnumber_T)(((long_u)1 \
+					 << (sizeof(varnumber_T) * 8 - 1)) - 1))
+
 /* From user function to hashitem and back. */
 static ufunc_T dumuf;
 #define UF2HIKEY(fp) ((fp)->uf_name)
@@ -226,6 +297,13 @@ static ufunc_T dumuf;
 #define VAR_SHORT_LEN	20	/* short variable name length */
 #define FIXVAR_CNT	12	/* number of fixed variables */
 
+/* variable with room for a short name */
+typedef struct
+{
+    dictitem_T	var;		/* variable (without room for name) */
+    char_u	room[VAR_SHORT_LEN];	/* room for the name */
+} fixvar_T;
+
 /* structure to hold info for a function that is currently being executed. */
 typedef struct funccall_S funccall_T;
 
@@ -234,11 +312,9 @@ struct funccall_S
     ufunc_T	*func;		/* function being called */
     int		linenr;		/* next line to be executed */
     int		returned;	/* ":return" used */
-    struct			/* fixed variables for arguments */
-    {
-	dictitem_T	var;		/* variable (without room for name) */
-	char_u	room[VAR_SHORT_LEN];	/* room for the name */
-    } fixvar[FIXVAR_CNT];
+    fixvar_T	fixvar[FIXVAR_CNT];	/* fixed variables for arguments */
+    fixvar_T	*l_room;	/* local variables of compiled code */
+    int		l_room_len;	/* nr of items in "l_room" */
     dict_T	l_vars;		/* l: local function variables */
     dictitem_T	l_vars_var;	/* variable for l: scope */
     dict_T	l_avars;	/* a: argument variables */
@@ -276,6 +352,22 @@ typedef struct
     dictitem_T	*fd_di;		/* Dictionary item used */
 } funcdict_T;
 
+/*
+ * types for expressions.
+ */
+typedef enum
+{
+    TYPE_UNKNOWN = 0
+    , TYPE_EQUAL	/* == */
+    , TYPE_NEQUAL	/* != */
+    , TYPE_GREATER	/* >  */
+    , TYPE_GEQUAL	/* >= */
+    , TYPE_SMALLER	/* <  */
+    , TYPE_SEQUAL	/* <= */
+    , TYPE_MATCH	/* =~ */
+    , TYPE_NOMATCH	/* !~ */
+} exptype_T;
+
 
 /*
  * Array to hold the value of v: variables.
@@ -414,11 +506,18 @@ static int eval1 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int eval2 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int eval3 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int eval4 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
+static int typval_compare __ARGS((typval_T *tv1, typval_T *tv2, exptype_T type, int type_is, int ic));
 static int eval5 __ARGS((char_u **arg, typval_T *rettv, int evaluate));
+static int eval_addsub_check __ARGS((typval_T *tv, int op));
+static int eval_addsub __ARGS((typval_T *tv1, typval_T *tv2, int op));
 static int eval6 __ARGS((char_u **arg, typval_T *rettv, int evaluate, int want_string));
+static int eval_muldiv_prep __ARGS((typval_T *tv));
+static int eval_muldiv __ARGS((typval_T *tv1, typval_T *tv2, int op));
 static int eval7 __ARGS((char_u **arg, typval_T *rettv, int evaluate, int want_string));
+static int eval7_leader __ARGS((typval_T *rettv, char_u *start_leader, char_u *end_leader));
 
 static int eval_index __ARGS((char_u **arg, typval_T *rettv, int evaluate, int verbose));
+static int eval_index_inner __ARGS((typval_T *rettv, int is_range, typval_T *var1, typval_T *var2, char_u *key, int keylen, int verbose));
 static int get_option_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int get_string_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int get_lit_string_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate));
@@ -430,6 +529,9 @@ static int dict_equal __ARGS((dict_T *d1, dict_T *d2, int ic, int recursive));
 static int tv_equal __ARGS((typval_T *tv1, typval_T *tv2, int ic, int recursive));
 static long list_find_nr __ARGS((list_T *l, long idx, int *errorp));
 static long list_idx_of_item __ARGS((list_T *l, listitem_T *item));
+static int list_index_build __ARGS((list_T *l));
+static void list_index_clear __ARGS((list_T *l));
+static void listitem_dispose __ARGS((listitem_T *item));
 static int list_append_number __ARGS((list_T *l, varnumber_T n));
 static int list_extend __ARGS((list_T	*l1, list_T *l2, listitem_T *bef));
 static int list_concat __ARGS((list_T *l1, list_T *l2, typval_T *tv));
@@ -437,7 +539,11 @@ static list_T *list_copy __ARGS((list_T *orig, int deep, int copyID));
 static char_u *list2string __ARGS((typval_T *tv, int copyID));
 static int list_join_inner __ARGS((garray_T *gap, list_T *l, char_u *sep, int echo_style, int copyID, garray_T *join_gap));
 static int list_join __ARGS((garray_T *gap, list_T *l, char_u *sep, int echo, int copyID));
+static void set_ref_in_roots __ARGS((int copyID));
+static int free_unref_funccal __ARGS((int copyID));
 static int free_unref_items __ARGS((int copyID));
+static int gc_push __ARGS((list_T *l, dict_T *d, int copyID));
+static void gc_mark_items __ARGS((long count));
 static int rettv_dict_alloc __ARGS((typval_T *rettv));
 static dictitem_T *dictitem_copy __ARGS((dictitem_T *org));
 static void dictitem_remove __ARGS((dict_T *dict, dictitem_T *item));
@@ -451,6 +557,14 @@ static char_u *string_quote __ARGS((char_u *str, int function));
 #ifdef FEAT_FLOAT
 static int string2float __ARGS((char_u *text, float_T *value));
 #endif
+static void json_encode_string __ARGS((garray_T *gap, char_u *str));
+static int json_encode_item __ARGS((garray_T *gap, typval_T *tv, int depth));
+static void json_fill __ARGS((jsread_T *reader, int need));
+static void json_skipwhite __ARGS((jsread_T *reader));
+static char_u *json_decode_string __ARGS((jsread_T *reader));
+static int json_decode_number __ARGS((jsread_T *reader, typval_T *res));
+static int json_decode_item __ARGS((jsread_T *reader, typval_T *res, int depth));
+static void json_decode __ARGS((jsread_T *reader, typval_T *rettv));
 static int get_env_tv __ARGS((char_u **arg, typval_T *rettv, int evaluate));
 static int find_internal_func __ARGS((char_u *name));
 static char_u *deref_func_name __ARGS((char_u *name, int *lenp, int no_autoload));
@@ -601,6 +715,9 @@ static void f_isdirectory __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_islocked __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_items __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_join __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_json_decode __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_json_decodefile __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_json_encode __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_keys __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_last_buffer_nr __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_len __ARGS((typval_T *argvars, typval_T *rettv));
@@ -795,11 +912,16 @@ static char_u *get_tv_string_buf_chk __ARGS((typval_T *varp, char_u *buf));
 static dictitem_T *find_var __ARGS((char_u *name, hashtab_T **htp, int no_autoload));
 static dictitem_T *find_var_in_ht __ARGS((hashtab_T *ht, int htname, char_u *varname, int no_autoload));
 static hashtab_T *find_var_ht __ARGS((char_u *name, char_u **varname));
+#ifdef FEAT_SYN_HL
+static void syn_cache_var_check __ARGS((hashtab_T *ht, char_u *varname));
+#endif
 static void vars_clear_ext __ARGS((hashtab_T *ht, int free_val));
 static void delete_var __ARGS((hashtab_T *ht, hashitem_T *hi));
 static void list_one_var __ARGS((dictitem_T *v, char_u *prefix, int *first));
 static void list_one_var_a __ARGS((char_u *prefix, char_u *name, int type, char_u *string, int *first));
 static void set_var __ARGS((char_u *name, typval_T *varp, int copy));
+static int var_check_set __ARGS((dictitem_T *v, char_u *name, typval_T *tv));
+static void set_var_value __ARGS((dictitem_T *v, typval_T *tv, int copy));
 static int var_check_ro __ARGS((int flags, char_u *name));
 static int var_check_fixed __ARGS((int flags, char_u *name));
 static int var_check_func_name __ARGS((char_u *name, int new_var));
@@ -833,6 +955,8 @@ static int script_autoload __ARGS((char_u *name, int reload));
 static char_u *autoload_name __ARGS((char_u *name));
 static void cat_func_name __ARGS((char_u *buf, ufunc_T *fp));
 static void func_free __ARGS((ufunc_T *fp));
+static void func_code_free __ARGS((ufunc_T *fp));
+static int func_code_room __ARGS((ufunc_T *fp));
 static void call_user_func __ARGS((ufunc_T *fp, int argcount, typval_T *argvars, typval_T *rettv, linenr_T firstline, linenr_T lastline, dict_T *selfdict));
 static int can_free_funccal __ARGS((funccall_T *fc, int copyID)) ;
 static void free_funccal __ARGS((funccall_T *fc, int free_val));
@@ -947,6 +1071,9 @@ eval_clear()
     /* functions */
     free_all_functions();
     hash_clear(&func_hashtab);
+
+    /* kept list items, lists and dicts */
+    (void)eval_free_cache();
 }
 #endif
 
@@ -3684,6 +3811,10 @@ do_unlet(name, forceit)
     ht = find_var_ht(name, &varname);
     if (ht != NULL && *varname != NUL)
     {
+#ifdef FEAT_SYN_HL
+	if (syn_cache_buf != NULL)
+	    syn_cache_var_check(ht, varname);
+#endif
 	hi = hash_find(ht, varname);
 	if (!HASHITEM_EMPTY(hi))
 	{
@@ -4020,22 +4151,6 @@ get_user_var_name(xp, idx)
 
 #endif /* FEAT_CMDL_COMPL */
 
-/*
- * types for expressions.
- */
-typedef enum
-{
-    TYPE_UNKNOWN = 0
-    , TYPE_EQUAL	/* == */
-    , TYPE_NEQUAL	/* != */
-    , TYPE_GREATER	/* >  */
-    , TYPE_GEQUAL	/* >= */
-    , TYPE_SMALLER	/* <  */
-    , TYPE_SEQUAL	/* <= */
-    , TYPE_MATCH	/* =~ */
-    , TYPE_NOMATCH	/* !~ */
-} exptype_T;
-
 /*
  * The "evaluate" argument: When FALSE, the argument is only parsed but not
  * executed.  The function may return OK, but the rettv will be of type
@@ -4059,6 +4174,7 @@ eval0(arg, rettv, nextcmd, evaluate)
     int		ret;
     char_u	*p;
 
+    ++eval_tick;
     p = skipwhite(arg);
     ret = eval1(&p, rettv, evaluate);
     if (ret == FAIL || !ends_excmd(*p))
@@ -4323,16 +4439,10 @@ eval4(arg, rettv, evaluate)
 {
     typval_T	var2;
     char_u	*p;
-    int		i;
     exptype_T	type = TYPE_UNKNOWN;
     int		type_is = FALSE;    /* TRUE for "is" and "isnot" */
     int		len = 2;
-    long	n1, n2;
-    char_u	*s1, *s2;
-    char_u	buf1[NUMBUFLEN], buf2[NUMBUFLEN];
-    regmatch_T	regmatch;
     int		ic;
-    char_u	*save_cpo;
 
     /*
      * Get the first variable.
@@ -4413,203 +4523,225 @@ eval4(arg, rettv, evaluate)
 	    return FAIL;
 	}
 
-	if (evaluate)
-	{
-	    if (type_is && rettv->v_type != var2.v_type)
-	    {
-		/* For "is" a different type always means FALSE, for "notis"
-		 * it means TRUE. */
-		n1 = (type == TYPE_NEQUAL);
-	    }
-	    else if (rettv->v_type == VAR_LIST || var2.v_type == VAR_LIST)
-	    {
-		if (type_is)
-		{
-		    n1 = (rettv->v_type == var2.v_type
-				   && rettv->vval.v_list == var2.vval.v_list);
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-		else if (rettv->v_type != var2.v_type
-			|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
-		{
-		    if (rettv->v_type != var2.v_type)
-			EMSG(_("E691: Can only compare List with List"));
-		    else
-			EMSG(_("E692: Invalid operation for List"));
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		else
-		{
-		    /* Compare two Lists for being equal or unequal. */
-		    n1 = list_equal(rettv->vval.v_list, var2.vval.v_list,
-								   ic, FALSE);
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-	    }
+	if (evaluate && typval_compare(rettv, &var2, type, type_is, ic) == FAIL)
+	    return FAIL;
+    }
 
-	    else if (rettv->v_type == VAR_DICT || var2.v_type == VAR_DICT)
-	    {
-		if (type_is)
-		{
-		    n1 = (rettv->v_type == var2.v_type
-				   && rettv->vval.v_dict == var2.vval.v_dict);
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-		else if (rettv->v_type != var2.v_type
-			|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
-		{
-		    if (rettv->v_type != var2.v_type)
-			EMSG(_("E735: Can only compare Dictionary with Dictionary"));
-		    else
-			EMSG(_("E736: Invalid operation for Dictionary"));
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		else
-		{
-		    /* Compare two Dictionaries for being equal or unequal. */
-		    n1 = dict_equal(rettv->vval.v_dict, var2.vval.v_dict,
-								   ic, FALSE);
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-	    }
+    return OK;
+}
 
-	    else if (rettv->v_type == VAR_FUNC || var2.v_type == VAR_FUNC)
-	    {
-		if (rettv->v_type != var2.v_type
-			|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
-		{
-		    if (rettv->v_type != var2.v_type)
-			EMSG(_("E693: Can only compare Funcref with Funcref"));
-		    else
-			EMSG(_("E694: Invalid operation for Funcrefs"));
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		else
-		{
-		    /* Compare two Funcrefs for being equal or unequal. */
-		    if (rettv->vval.v_string == NULL
-						|| var2.vval.v_string == NULL)
-			n1 = FALSE;
-		    else
-			n1 = STRCMP(rettv->vval.v_string,
-						     var2.vval.v_string) == 0;
-		    if (type == TYPE_NEQUAL)
-			n1 = !n1;
-		}
-	    }
+/*
+ * Compare "tv1" and "tv2" with operator "type", "type_is" is TRUE for "is"
+ * and "isnot", "ic" for ignoring case.  Put the result in "tv1" as a Number.
+ * "tv2" is cleared.  Return OK or FAIL, "tv1" is cleared for FAIL.
+ */
+    static int
+typval_compare(tv1, tv2, type, type_is, ic)
+    typval_T	*tv1;
+    typval_T	*tv2;
+    exptype_T	type;
+    int		type_is;
+    int		ic;
+{
+    int		i;
+    long	n1, n2;
+    char_u	*s1, *s2;
+    char_u	buf1[NUMBUFLEN], buf2[NUMBUFLEN];
+    regmatch_T	regmatch;
+    char_u	*save_cpo;
 
-#ifdef FEAT_FLOAT
-	    /*
-	     * If one of the two variables is a float, compare as a float.
-	     * When using "=~" or "!~", always compare as string.
-	     */
-	    else if ((rettv->v_type == VAR_FLOAT || var2.v_type == VAR_FLOAT)
-		    && type != TYPE_MATCH && type != TYPE_NOMATCH)
-	    {
-		float_T f1, f2;
+    if (type_is && tv1->v_type != tv2->v_type)
+    {
+	/* For "is" a different type always means FALSE, for "notis"
+	 * it means TRUE. */
+	n1 = (type == TYPE_NEQUAL);
+    }
+    else if (tv1->v_type == VAR_LIST || tv2->v_type == VAR_LIST)
+    {
+	if (type_is)
+	{
+	    n1 = (tv1->v_type == tv2->v_type
+			   && tv1->vval.v_list == tv2->vval.v_list);
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+	else if (tv1->v_type != tv2->v_type
+		|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
+	{
+	    if (tv1->v_type != tv2->v_type)
+		EMSG(_("E691: Can only compare List with List"));
+	    else
+		EMSG(_("E692: Invalid operation for List"));
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
+	}
+	else
+	{
+	    /* Compare two Lists for being equal or unequal. */
+	    n1 = list_equal(tv1->vval.v_list, tv2->vval.v_list,
+							   ic, FALSE);
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+    }
 
-		if (rettv->v_type == VAR_FLOAT)
-		    f1 = rettv->vval.v_float;
-		else
-		    f1 = get_tv_number(rettv);
-		if (var2.v_type == VAR_FLOAT)
-		    f2 = var2.vval.v_float;
-		else
-		    f2 = get_tv_number(&var2);
-		n1 = FALSE;
-		switch (type)
-		{
-		    case TYPE_EQUAL:    n1 = (f1 == f2); break;
-		    case TYPE_NEQUAL:   n1 = (f1 != f2); break;
-		    case TYPE_GREATER:  n1 = (f1 > f2); break;
-		    case TYPE_GEQUAL:   n1 = (f1 >= f2); break;
-		    case TYPE_SMALLER:  n1 = (f1 < f2); break;
-		    case TYPE_SEQUAL:   n1 = (f1 <= f2); break;
-		    case TYPE_UNKNOWN:
-		    case TYPE_MATCH:
-		    case TYPE_NOMATCH:  break;  /* avoid gcc warning */
-		}
-	    }
-#endif
+    else if (tv1->v_type == VAR_DICT || tv2->v_type == VAR_DICT)
+    {
+	if (type_is)
+	{
+	    n1 = (tv1->v_type == tv2->v_type
+			   && tv1->vval.v_dict == tv2->vval.v_dict);
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+	else if (tv1->v_type != tv2->v_type
+		|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
+	{
+	    if (tv1->v_type != tv2->v_type)
+		EMSG(_("E735: Can only compare Dictionary with Dictionary"));
+	    else
+		EMSG(_("E736: Invalid operation for Dictionary"));
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
+	}
+	else
+	{
+	    /* Compare two Dictionaries for being equal or unequal. */
+	    n1 = dict_equal(tv1->vval.v_dict, tv2->vval.v_dict,
+							   ic, FALSE);
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+    }
 
-	    /*
-	     * If one of the two variables is a number, compare as a number.
-	     * When using "=~" or "!~", always compare as string.
-	     */
-	    else if ((rettv->v_type == VAR_NUMBER || var2.v_type == VAR_NUMBER)
-		    && type != TYPE_MATCH && type != TYPE_NOMATCH)
-	    {
-		n1 = get_tv_number(rettv);
-		n2 = get_tv_number(&var2);
-		switch (type)
-		{
-		    case TYPE_EQUAL:    n1 = (n1 == n2); break;
-		    case TYPE_NEQUAL:   n1 = (n1 != n2); break;
-		    case TYPE_GREATER:  n1 = (n1 > n2); break;
-		    case TYPE_GEQUAL:   n1 = (n1 >= n2); break;
-		    case TYPE_SMALLER:  n1 = (n1 < n2); break;
-		    case TYPE_SEQUAL:   n1 = (n1 <= n2); break;
-		    case TYPE_UNKNOWN:
-		    case TYPE_MATCH:
-		    case TYPE_NOMATCH:  break;  /* avoid gcc warning */
-		}
-	    }
+    else if (tv1->v_type == VAR_FUNC || tv2->v_type == VAR_FUNC)
+    {
+	if (tv1->v_type != tv2->v_type
+		|| (type != TYPE_EQUAL && type != TYPE_NEQUAL))
+	{
+	    if (tv1->v_type != tv2->v_type)
+		EMSG(_("E693: Can only compare Funcref with Funcref"));
 	    else
-	    {
-		s1 = get_tv_string_buf(rettv, buf1);
-		s2 = get_tv_string_buf(&var2, buf2);
-		if (type != TYPE_MATCH && type != TYPE_NOMATCH)
-		    i = ic ? MB_STRICMP(s1, s2) : STRCMP(s1, s2);
-		else
-		    i = 0;
+		EMSG(_("E694: Invalid operation for Funcrefs"));
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
+	}
+	else
+	{
+	    /* Compare two Funcrefs for being equal or unequal. */
+	    if (tv1->vval.v_string == NULL
+					|| tv2->vval.v_string == NULL)
 		n1 = FALSE;
-		switch (type)
-		{
-		    case TYPE_EQUAL:    n1 = (i == 0); break;
-		    case TYPE_NEQUAL:   n1 = (i != 0); break;
-		    case TYPE_GREATER:  n1 = (i > 0); break;
-		    case TYPE_GEQUAL:   n1 = (i >= 0); break;
-		    case TYPE_SMALLER:  n1 = (i < 0); break;
-		    case TYPE_SEQUAL:   n1 = (i <= 0); break;
-
-		    case TYPE_MATCH:
-		    case TYPE_NOMATCH:
-			    /* avoid 'l' flag in 'cpoptions' */
-			    save_cpo = p_cpo;
-			    p_cpo = (char_u *)"";
-			    regmatch.regprog = vim_regcomp(s2,
-							RE_MAGIC + RE_STRING);
-			    regmatch.rm_ic = ic;
-			    if (regmatch.regprog != NULL)
-			    {
-				n1 = vim_regexec_nl(&regmatch, s1, (colnr_T)0);
-				vim_regfree(regmatch.regprog);
-				if (type == TYPE_NOMATCH)
-				    n1 = !n1;
-			    }
-			    p_cpo = save_cpo;
-			    break;
+	    else
+		n1 = STRCMP(tv1->vval.v_string,
+					     tv2->vval.v_string) == 0;
+	    if (type == TYPE_NEQUAL)
+		n1 = !n1;
+	}
+    }
 
-		    case TYPE_UNKNOWN:  break;  /* avoid gcc warning */
-		}
-	    }
-	    clear_tv(rettv);
-	    clear_tv(&var2);
-	    rettv->v_type = VAR_NUMBER;
-	    rettv->vval.v_number = n1;
+#ifdef FEAT_FLOAT
+    /*
+     * If one of the two variables is a float, compare as a float.
+     * When using "=~" or "!~", always compare as string.
+     */
+    else if ((tv1->v_type == VAR_FLOAT || tv2->v_type == VAR_FLOAT)
+	    && type != TYPE_MATCH && type != TYPE_NOMATCH)
+    {
+	float_T f1, f2;
+
+	if (tv1->v_type == VAR_FLOAT)
+	    f1 = tv1->vval.v_float;
+	else
+	    f1 = get_tv_number(tv1);
+	if (tv2->v_type == VAR_FLOAT)
+	    f2 = tv2->vval.v_float;
+	else
+	    f2 = get_tv_number(tv2);
+	n1 = FALSE;
+	switch (type)
+	{
+	    case TYPE_EQUAL:    n1 = (f1 == f2); break;
+	    case TYPE_NEQUAL:   n1 = (f1 != f2); break;
+	    case TYPE_GREATER:  n1 = (f1 > f2); break;
+	    case TYPE_GEQUAL:   n1 = (f1 >= f2); break;
+	    case TYPE_SMALLER:  n1 = (f1 < f2); break;
+	    case TYPE_SEQUAL:   n1 = (f1 <= f2); break;
+	    case TYPE_UNKNOWN:
+	    case TYPE_MATCH:
+	    case TYPE_NOMATCH:  break;  /* avoid gcc warning */
+	}
+    }
+#endif
+
+    /*
+     * If one of the two variables is a number, compare as a number.
+     * When using "=~" or "!~", always compare as string.
+     */
+    else if ((tv1->v_type == VAR_NUMBER || tv2->v_type == VAR_NUMBER)
+	    && type != TYPE_MATCH && type != TYPE_NOMATCH)
+    {
+	n1 = get_tv_number(tv1);
+	n2 = get_tv_number(tv2);
+	switch (type)
+	{
+	    case TYPE_EQUAL:    n1 = (n1 == n2); break;
+	    case TYPE_NEQUAL:   n1 = (n1 != n2); break;
+	    case TYPE_GREATER:  n1 = (n1 > n2); break;
+	    case TYPE_GEQUAL:   n1 = (n1 >= n2); break;
+	    case TYPE_SMALLER:  n1 = (n1 < n2); break;
+	    case TYPE_SEQUAL:   n1 = (n1 <= n2); break;
+	    case TYPE_UNKNOWN:
+	    case TYPE_MATCH:
+	    case TYPE_NOMATCH:  break;  /* avoid gcc warning */
 	}
     }
+    else
+    {
+	s1 = get_tv_string_buf(tv1, buf1);
+	s2 = get_tv_string_buf(tv2, buf2);
+	if (type != TYPE_MATCH && type != TYPE_NOMATCH)
+	    i = ic ? MB_STRICMP(s1, s2) : STRCMP(s1, s2);
+	else
+	    i = 0;
+	n1 = FALSE;
+	switch (type)
+	{
+	    case TYPE_EQUAL:    n1 = (i == 0); break;
+	    case TYPE_NEQUAL:   n1 = (i != 0); break;
+	    case TYPE_GREATER:  n1 = (i > 0); break;
+	    case TYPE_GEQUAL:   n1 = (i >= 0); break;
+	    case TYPE_SMALLER:  n1 = (i < 0); break;
+	    case TYPE_SEQUAL:   n1 = (i <= 0); break;
+
+	    case TYPE_MATCH:
+	    case TYPE_NOMATCH:
+		    /* avoid 'l' flag in 'cpoptions' */
+		    save_cpo = p_cpo;
+		    p_cpo = (char_u *)"";
+		    regmatch.regprog = vim_regcomp(s2,
+						RE_MAGIC + RE_STRING);
+		    regmatch.rm_ic = ic;
+		    if (regmatch.regprog != NULL)
+		    {
+			n1 = vim_regexec_nl(&regmatch, s1, (colnr_T)0);
+			vim_regfree(regmatch.regprog);
+			if (type == TYPE_NOMATCH)
+			    n1 = !n1;
+		    }
+		    p_cpo = save_cpo;
+		    break;
 
+	    case TYPE_UNKNOWN:  break;  /* avoid gcc warning */
+	}
+    }
+    clear_tv(tv1);
+    clear_tv(tv2);
+    tv1->v_type = VAR_NUMBER;
+    tv1->vval.v_number = n1;
     return OK;
 }
 
@@ -4631,15 +4763,7 @@ eval5(arg, rettv, evaluate)
     int		evaluate;
 {
     typval_T	var2;
-    typval_T	var3;
     int		op;
-    long	n1, n2;
-#ifdef FEAT_FLOAT
-    float_T	f1 = 0, f2 = 0;
-#endif
-    char_u	*s1, *s2;
-    char_u	buf1[NUMBUFLEN], buf2[NUMBUFLEN];
-    char_u	*p;
 
     /*
      * Get the first variable.
@@ -4656,25 +4780,8 @@ eval5(arg, rettv, evaluate)
 	if (op != '+' && op != '-' && op != '.')
 	    break;
 
-	if ((op != '+' || rettv->v_type != VAR_LIST)
-#ifdef FEAT_FLOAT
-		&& (op == '.' || rettv->v_type != VAR_FLOAT)
-#endif
-		)
-	{
-	    /* For "list + ...", an illegal use of the first operand as
-	     * a number cannot be determined before evaluating the 2nd
-	     * operand: if this is also a list, all is ok.
-	     * For "something . ...", "something - ..." or "non-list + ...",
-	     * we know that the first operand needs to be a string or number
-	     * without evaluating the 2nd operand.  So check before to avoid
-	     * side effects after an error. */
-	    if (evaluate && get_tv_string_chk(rettv) == NULL)
-	    {
-		clear_tv(rettv);
-		return FAIL;
-	    }
-	}
+	if (evaluate && eval_addsub_check(rettv, op) == FAIL)
+	    return FAIL;
 
 	/*
 	 * Get the second variable.
@@ -4686,115 +4793,161 @@ eval5(arg, rettv, evaluate)
 	    return FAIL;
 	}
 
-	if (evaluate)
-	{
-	    /*
-	     * Compute the result.
-	     */
-	    if (op == '.')
-	    {
-		s1 = get_tv_string_buf(rettv, buf1);	/* already checked */
-		s2 = get_tv_string_buf_chk(&var2, buf2);
-		if (s2 == NULL)		/* type error ? */
-		{
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		p = concat_str(s1, s2);
-		clear_tv(rettv);
-		rettv->v_type = VAR_STRING;
-		rettv->vval.v_string = p;
-	    }
-	    else if (op == '+' && rettv->v_type == VAR_LIST
-						   && var2.v_type == VAR_LIST)
-	    {
-		/* concatenate Lists */
-		if (list_concat(rettv->vval.v_list, var2.vval.v_list,
-							       &var3) == FAIL)
-		{
-		    clear_tv(rettv);
-		    clear_tv(&var2);
-		    return FAIL;
-		}
-		clear_tv(rettv);
-		*rettv = var3;
-	    }
-	    else
-	    {
-		int	    error = FALSE;
+	if (evaluate && eval_addsub(rettv, &var2, op) == FAIL)
+	    return FAIL;
+    }
+    return OK;
+}
 
-#ifdef FEAT_FLOAT
-		if (rettv->v_type == VAR_FLOAT)
-		{
-		    f1 = rettv->vval.v_float;
-		    n1 = 0;
-		}
-		else
+/*
+ * Check the first operand "tv" of "op" ('+', '-' or '.') before evaluating
+ * the second one.
+ * For "list + ...", an illegal use of the first operand as a number cannot be
+ * determined before evaluating the 2nd operand: if this is also a list, all
+ * is ok.
+ * For "something . ...", "something - ..." or "non-list + ...", we know that
+ * the first operand needs to be a string or number without evaluating the
+ * 2nd operand.  So check before to avoid side effects after an error.
+ * Return FAIL and clear "tv" for an error.
+ */
+    static int
+eval_addsub_check(tv, op)
+    typval_T	*tv;
+    int		op;
+{
+    if ((op != '+' || tv->v_type != VAR_LIST)
+#ifdef FEAT_FLOAT
+	    && (op == '.' || tv->v_type != VAR_FLOAT)
 #endif
-		{
-		    n1 = get_tv_number_chk(rettv, &error);
-		    if (error)
-		    {
-			/* This can only happen for "list + non-list".  For
-			 * "non-list + ..." or "something - ...", we returned
-			 * before evaluating the 2nd operand. */
-			clear_tv(rettv);
-			return FAIL;
-		    }
+	    && get_tv_string_chk(tv) == NULL)
+    {
+	clear_tv(tv);
+	return FAIL;
+    }
+    return OK;
+}
+
+/*
+ * Compute "tv1 op tv2" for "op" '+', '-' or '.' and put the result in "tv1".
+ * "tv1" must have been checked with eval_addsub_check().  "tv2" is cleared.
+ * Return OK or FAIL, "tv1" is cleared for FAIL.
+ */
+    static int
+eval_addsub(tv1, tv2, op)
+    typval_T	*tv1;
+    typval_T	*tv2;
+    int		op;
+{
+    typval_T	var3;
+    long	n1, n2;
 #ifdef FEAT_FLOAT
-		    if (var2.v_type == VAR_FLOAT)
-			f1 = n1;
+    float_T	f1 = 0, f2 = 0;
 #endif
-		}
+    char_u	*s1, *s2;
+    char_u	buf1[NUMBUFLEN], buf2[NUMBUFLEN];
+    char_u	*p;
+
+    if (op == '.')
+    {
+	s1 = get_tv_string_buf(tv1, buf1);	/* already checked */
+	s2 = get_tv_string_buf_chk(tv2, buf2);
+	if (s2 == NULL)		/* type error ? */
+	{
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
+	}
+	p = concat_str(s1, s2);
+	clear_tv(tv1);
+	tv1->v_type = VAR_STRING;
+	tv1->vval.v_string = p;
+    }
+    else if (op == '+' && tv1->v_type == VAR_LIST && tv2->v_type == VAR_LIST)
+    {
+	/* concatenate Lists */
+	if (list_concat(tv1->vval.v_list, tv2->vval.v_list, &var3) == FAIL)
+	{
+	    clear_tv(tv1);
+	    clear_tv(tv2);
+	    return FAIL;
+	}
+	clear_tv(tv1);
+	*tv1 = var3;
+    }
+    else
+    {
+	int	    error = FALSE;
+
 #ifdef FEAT_FLOAT
-		if (var2.v_type == VAR_FLOAT)
-		{
-		    f2 = var2.vval.v_float;
-		    n2 = 0;
-		}
-		else
+	if (tv1->v_type == VAR_FLOAT)
+	{
+	    f1 = tv1->vval.v_float;
+	    n1 = 0;
+	}
+	else
 #endif
-		{
-		    n2 = get_tv_number_chk(&var2, &error);
-		    if (error)
-		    {
-			clear_tv(rettv);
-			clear_tv(&var2);
-			return FAIL;
-		    }
+	{
+	    n1 = get_tv_number_chk(tv1, &error);
+	    if (error)
+	    {
+		/* This can only happen for "list + non-list".  For
+		 * "non-list + ..." or "something - ...", we returned
+		 * before evaluating the 2nd operand. */
+		clear_tv(tv1);
+		clear_tv(tv2);
+		return FAIL;
+	    }
 #ifdef FEAT_FLOAT
-		    if (rettv->v_type == VAR_FLOAT)
-			f2 = n2;
+	    if (tv2->v_type == VAR_FLOAT)
+		f1 = n1;
 #endif
-		}
-		clear_tv(rettv);
-
+	}
 #ifdef FEAT_FLOAT
-		/* If there is a float on either side the result is a float. */
-		if (rettv->v_type == VAR_FLOAT || var2.v_type == VAR_FLOAT)
-		{
-		    if (op == '+')
-			f1 = f1 + f2;
-		    else
-			f1 = f1 - f2;
-		    rettv->v_type = VAR_FLOAT;
-		    rettv->vval.v_float = f1;
-		}
-		else
+	if (tv2->v_type == VAR_FLOAT)
+	{
+	    f2 = tv2->vval.v_float;
+	    n2 = 0;
+	}
+	else
 #endif
-		{
-		    if (op == '+')
-			n1 = n1 + n2;
-		    else
-			n1 = n1 - n2;
-		    rettv->v_type = VAR_NUMBER;
-		    rettv->vval.v_number = n1;
-		}
+	{
+	    n2 = get_tv_number_chk(tv2, &error);
+	    if (error)
+	    {
+		clear_tv(tv1);
+		clear_tv(tv2);
+		return FAIL;
 	    }
-	    clear_tv(&var2);
+#ifdef FEAT_FLOAT
+	    if (tv1->v_type == VAR_FLOAT)
+		f2 = n2;
+#endif
+	}
+	clear_tv(tv1);
+
+#ifdef FEAT_FLOAT
+	/* If there is a float on either side the result is a float. */
+	if (tv1->v_type == VAR_FLOAT || tv2->v_type == VAR_FLOAT)
+	{
+	    if (op == '+')
+		f1 = f1 + f2;
+	    else
+		f1 = f1 - f2;
+	    tv1->v_type = VAR_FLOAT;
+	    tv1->vval.v_float = f1;
+	}
+	else
+#endif
+	{
+	    if (op == '+')
+		n1 = n1 + n2;
+	    else
+		n1 = n1 - n2;
+	    tv1->v_type = VAR_NUMBER;
+	    tv1->vval.v_number = n1;
 	}
     }
+    clear_tv(tv2);
     return OK;
 }
 
@@ -4818,12 +4971,6 @@ eval6(arg, rettv, evaluate, want_string)
 {
     typval_T	var2;
     int		op;
-    long	n1, n2;
-#ifdef FEAT_FLOAT
-    int		use_float = FALSE;
-    float_T	f1 = 0, f2;
-#endif
-    int		error = FALSE;
 
     /*
      * Get the first variable.
@@ -4840,24 +4987,8 @@ eval6(arg, rettv, evaluate, want_string)
 	if (op != '*' && op != '/' && op != '%')
 	    break;
 
-	if (evaluate)
-	{
-#ifdef FEAT_FLOAT
-	    if (rettv->v_type == VAR_FLOAT)
-	    {
-		f1 = rettv->vval.v_float;
-		use_float = TRUE;
-		n1 = 0;
-	    }
-	    else
-#endif
-		n1 = get_tv_number_chk(rettv, &error);
-	    clear_tv(rettv);
-	    if (error)
-		return FAIL;
-	}
-	else
-	    n1 = 0;
+	if (evaluate && eval_muldiv_prep(rettv) == FAIL)
+	    return FAIL;
 
 	/*
 	 * Get the second variable.
@@ -4866,102 +4997,158 @@ eval6(arg, rettv, evaluate, want_string)
 	if (eval7(arg, &var2, evaluate, FALSE) == FAIL)
 	    return FAIL;
 
-	if (evaluate)
-	{
+	if (evaluate && eval_muldiv(rettv, &var2, op) == FAIL)
+	    return FAIL;
+    }
+
+    return OK;
+}
+
+/*
+ * Turn the first operand "tv" of '*', '/' or '%' into a Number, unless it is
+ * a Float.  Done before evaluating the second operand.
+ * Return FAIL and clear "tv" for an error.
+ */
+    static int
+eval_muldiv_prep(tv)
+    typval_T	*tv;
+{
+    long	n;
+    int		error = FALSE;
+
 #ifdef FEAT_FLOAT
-	    if (var2.v_type == VAR_FLOAT)
-	    {
-		if (!use_float)
-		{
-		    f1 = n1;
-		    use_float = TRUE;
-		}
-		f2 = var2.vval.v_float;
-		n2 = 0;
-	    }
-	    else
+    if (tv->v_type == VAR_FLOAT)
+	return OK;
 #endif
-	    {
-		n2 = get_tv_number_chk(&var2, &error);
-		clear_tv(&var2);
-		if (error)
-		    return FAIL;
+    n = get_tv_number_chk(tv, &error);
+    clear_tv(tv);
+    if (error)
+	return FAIL;
+    tv->v_type = VAR_NUMBER;
+    tv->vval.v_number = n;
+    return OK;
+}
+
+/*
+ * Compute "tv1 op tv2" for "op" '*', '/' or '%' and put the result in "tv1".
+ * "tv1" must have been prepared with eval_muldiv_prep().  "tv2" is cleared.
+ * Return OK or FAIL.
+ */
+    static int
+eval_muldiv(tv1, tv2, op)
+    typval_T	*tv1;
+    typval_T	*tv2;
+    int		op;
+{
+    long	n1, n2;
+#ifdef FEAT_FLOAT
+    int		use_float = FALSE;
+    float_T	f1 = 0, f2;
+#endif
+    int		error = FALSE;
+
 #ifdef FEAT_FLOAT
-		if (use_float)
-		    f2 = n2;
+    if (tv1->v_type == VAR_FLOAT)
+    {
+	f1 = tv1->vval.v_float;
+	use_float = TRUE;
+	n1 = 0;
+    }
+    else
 #endif
-	    }
+	n1 = get_tv_number(tv1);
 
-	    /*
-	     * Compute the result.
-	     * When either side is a float the result is a float.
-	     */
 #ifdef FEAT_FLOAT
-	    if (use_float)
-	    {
-		if (op == '*')
-		    f1 = f1 * f2;
-		else if (op == '/')
-		{
+    if (tv2->v_type == VAR_FLOAT)
+    {
+	if (!use_float)
+	{
+	    f1 = n1;
+	    use_float = TRUE;
+	}
+	f2 = tv2->vval.v_float;
+	n2 = 0;
+    }
+    else
+#endif
+    {
+	n2 = get_tv_number_chk(tv2, &error);
+	clear_tv(tv2);
+	if (error)
+	    return FAIL;
+#ifdef FEAT_FLOAT
+	if (use_float)
+	    f2 = n2;
+#endif
+    }
+
+    /*
+     * Compute the result.
+     * When either side is a float the result is a float.
+     */
+#ifdef FEAT_FLOAT
+    if (use_float)
+    {
+	if (op == '*')
+	    f1 = f1 * f2;
+	else if (op == '/')
+	{
 # ifdef VMS
-		    /* VMS crashes on divide by zero, work around it */
-		    if (f2 == 0.0)
-		    {
-			if (f1 == 0)
-			    f1 = -1 * __F_FLT_MAX - 1L;   /* similar to NaN */
-			else if (f1 < 0)
-			    f1 = -1 * __F_FLT_MAX;
-			else
-			    f1 = __F_FLT_MAX;
-		    }
-		    else
-			f1 = f1 / f2;
-# else
-		    /* We rely on the floating point library to handle divide
-		     * by zero to result in "inf" and not a crash. */
-		    f1 = f1 / f2;
-# endif
-		}
+	    /* VMS crashes on divide by zero, work around it */
+	    if (f2 == 0.0)
+	    {
+		if (f1 == 0)
+		    f1 = -1 * __F_FLT_MAX - 1L;   /* similar to NaN */
+		else if (f1 < 0)
+		    f1 = -1 * __F_FLT_MAX;
 		else
-		{
-		    EMSG(_("E804: Cannot use '%' with Float"));
-		    return FAIL;
-		}
-		rettv->v_type = VAR_FLOAT;
-		rettv->vval.v_float = f1;
+		    f1 = __F_FLT_MAX;
 	    }
 	    else
+		f1 = f1 / f2;
+# else
+	    /* We rely on the floating point library to handle divide
+	     * by zero to result in "inf" and not a crash. */
+	    f1 = f1 / f2;
+# endif
+	}
+	else
+	{
+	    EMSG(_("E804: Cannot use '%' with Float"));
+	    return FAIL;
+	}
+	tv1->v_type = VAR_FLOAT;
+	tv1->vval.v_float = f1;
+    }
+    else
 #endif
+    {
+	if (op == '*')
+	    n1 = n1 * n2;
+	else if (op == '/')
+	{
+	    if (n2 == 0)	/* give an error message? */
 	    {
-		if (op == '*')
-		    n1 = n1 * n2;
-		else if (op == '/')
-		{
-		    if (n2 == 0)	/* give an error message? */
-		    {
-			if (n1 == 0)
-			    n1 = -0x7fffffffL - 1L;	/* similar to NaN */
-			else if (n1 < 0)
-			    n1 = -0x7fffffffL;
-			else
-			    n1 = 0x7fffffffL;
-		    }
-		    else
-			n1 = n1 / n2;
-		}
+		if (n1 == 0)
+		    n1 = -0x7fffffffL - 1L;	/* similar to NaN */
+		else if (n1 < 0)
+		    n1 = -0x7fffffffL;
 		else
-		{
-		    if (n2 == 0)	/* give an error message? */
-			n1 = 0;
-		    else
-			n1 = n1 % n2;
-		}
-		rettv->v_type = VAR_NUMBER;
-		rettv->vval.v_number = n1;
+		    n1 = 0x7fffffffL;
 	    }
+	    else
+		n1 = n1 / n2;
 	}
+	else
+	{
+	    if (n2 == 0)	/* give an error message? */
+		n1 = 0;
+	    else
+		n1 = n1 % n2;
+	}
+	tv1->v_type = VAR_NUMBER;
+	tv1->vval.v_number = n1;
     }
-
     return OK;
 }
 
@@ -5219,63 +5406,73 @@ eval7(arg, rettv, evaluate, want_string)
      * Apply logical NOT and unary '-', from right to left, ignore '+'.
      */
     if (ret == OK && evaluate && end_leader > start_leader)
-    {
-	int	    error = FALSE;
-	int	    val = 0;
+	ret = eval7_leader(rettv, start_leader, end_leader);
+
+    return ret;
+}
+
+/*
+ * Apply the '!', '-' and '+' characters between "start_leader" and
+ * "end_leader" to "rettv", from right to left.
+ * Return OK or FAIL, "rettv" is cleared for FAIL.
+ */
+    static int
+eval7_leader(rettv, start_leader, end_leader)
+    typval_T	*rettv;
+    char_u	*start_leader;
+    char_u	*end_leader;
+{
+    int		error = FALSE;
+    int		val = 0;
 #ifdef FEAT_FLOAT
-	float_T	    f = 0.0;
+    float_T	f = 0.0;
 
-	if (rettv->v_type == VAR_FLOAT)
-	    f = rettv->vval.v_float;
-	else
+    if (rettv->v_type == VAR_FLOAT)
+	f = rettv->vval.v_float;
+    else
 #endif
-	    val = get_tv_number_chk(rettv, &error);
-	if (error)
-	{
-	    clear_tv(rettv);
-	    ret = FAIL;
-	}
-	else
+	val = get_tv_number_chk(rettv, &error);
+    if (error)
+    {
+	clear_tv(rettv);
+	return FAIL;
+    }
+    while (end_leader > start_leader)
+    {
+	--end_leader;
+	if (*end_leader == '!')
 	{
-	    while (end_leader > start_leader)
-	    {
-		--end_leader;
-		if (*end_leader == '!')
-		{
-#ifdef FEAT_FLOAT
-		    if (rettv->v_type == VAR_FLOAT)
-			f = !f;
-		    else
-#endif
-			val = !val;
-		}
-		else if (*end_leader == '-')
-		{
 #ifdef FEAT_FLOAT
-		    if (rettv->v_type == VAR_FLOAT)
-			f = -f;
-		    else
+	    if (rettv->v_type == VAR_FLOAT)
+		f = !f;
+	    else
 #endif
-			val = -val;
-		}
-	    }
+		val = !val;
+	}
+	else if (*end_leader == '-')
+	{
 #ifdef FEAT_FLOAT
 	    if (rettv->v_type == VAR_FLOAT)
-	    {
-		clear_tv(rettv);
-		rettv->vval.v_float = f;
-	    }
+		f = -f;
 	    else
 #endif
-	    {
-		clear_tv(rettv);
-		rettv->v_type = VAR_NUMBER;
-		rettv->vval.v_number = val;
-	    }
+		val = -val;
 	}
     }
-
-    return ret;
+#ifdef FEAT_FLOAT
+    if (rettv->v_type == VAR_FLOAT)
+    {
+	clear_tv(rettv);
+	rettv->vval.v_float = f;
+    }
+    else
+#endif
+    {
+	clear_tv(rettv);
+	rettv->v_type = VAR_NUMBER;
+	rettv->vval.v_number = val;
+    }
+    return OK;
 }
 
 /*
@@ -5292,10 +5489,8 @@ eval_index(arg, rettv, evaluate, verbose)
 {
     int		empty1 = FALSE, empty2 = FALSE;
     typval_T	var1, var2;
-    long	n1, n2 = 0;
     long	len = -1;
     int		range = FALSE;
-    char_u	*s;
     char_u	*key = NULL;
 
     if (rettv->v_type == VAR_FUNC)
@@ -5383,158 +5578,189 @@ eval_index(arg, rettv, evaluate, verbose)
     }
 
     if (evaluate)
+	return eval_index_inner(rettv, range,
+		empty1 || key != NULL ? NULL : &var1,
+		range && !empty2 ? &var2 : NULL, key, (int)len, verbose);
+
+    return OK;
+}
+
+/*
+ * Apply an index or range to "rettv".  Used by eval_index() after evaluating
+ * the index expressions.
+ * "var1" is the (first) index, NULL when omitted or when "key" is used.
+ * "var2" is the second index of a range, NULL when omitted.
+ * "key" with length "keylen" is the name for "dict.key", NULL otherwise.
+ * "var1" and "var2" are cleared.
+ * Returns FAIL or OK.
+ */
+    static int
+eval_index_inner(rettv, is_range, var1, var2, key, keylen, verbose)
+    typval_T	*rettv;
+    int		is_range;
+    typval_T	*var1;
+    typval_T	*var2;
+    char_u	*key;
+    int		keylen;
+    int		verbose;	/* give error messages */
+{
+    long	n1 = 0, n2 = 0;
+    long	len;
+    char_u	*s;
+    typval_T	tv;
+    int		empty1 = (var1 == NULL);
+
+    if (!empty1 && rettv->v_type != VAR_DICT)
     {
-	n1 = 0;
-	if (!empty1 && rettv->v_type != VAR_DICT)
-	{
-	    n1 = get_tv_number(&var1);
-	    clear_tv(&var1);
-	}
-	if (range)
+	n1 = get_tv_number(var1);
+	clear_tv(var1);
+    }
+    if (is_range)
+    {
+	if (var2 == NULL)
+	    n2 = -1;
+	else
 	{
-	    if (empty2)
-		n2 = -1;
-	    else
-	    {
-		n2 = get_tv_number(&var2);
-		clear_tv(&var2);
-	    }
+	    n2 = get_tv_number(var2);
+	    clear_tv(var2);
 	}
+    }
 
-	switch (rettv->v_type)
-	{
-	    case VAR_NUMBER:
-	    case VAR_STRING:
-		s = get_tv_string(rettv);
-		len = (long)STRLEN(s);
-		if (range)
+    switch (rettv->v_type)
+    {
+	case VAR_NUMBER:
+	case VAR_STRING:
+	    s = get_tv_string(rettv);
+	    len = (long)STRLEN(s);
+	    if (is_range)
+	    {
+		/* The resulting variable is a substring.  If the indexes
+		 * are out of range the result is empty. */
+		if (n1 < 0)
 		{
-		    /* The resulting variable is a substring.  If the indexes
-		     * are out of range the result is empty. */
+		    n1 = len + n1;
 		    if (n1 < 0)
-		    {
-			n1 = len + n1;
-			if (n1 < 0)
-			    n1 = 0;
-		    }
-		    if (n2 < 0)
-			n2 = len + n2;
-		    else if (n2 >= len)
-			n2 = len;
-		    if (n1 >= len || n2 < 0 || n1 > n2)
-			s = NULL;
-		    else
-			s = vim_strnsave(s + n1, (int)(n2 - n1 + 1));
+			n1 = 0;
 		}
+		if (n2 < 0)
+		    n2 = len + n2;
+		else if (n2 >= len)
+		    n2 = len;
+		if (n1 >= len || n2 < 0 || n1 > n2)
+		    s = NULL;
+		else
+		    s = vim_strnsave(s + n1, (int)(n2 - n1 + 1));
+	    }
+	    else
+	    {
+		/* The resulting variable is a string of a single
+		 * character.  If the index is too big or negative the
+		 * result is empty. */
+		if (n1 >= len || n1 < 0)
+		    s = NULL;
 		else
+		    s = vim_strnsave(s + n1, 1);
+	    }
+	    clear_tv(rettv);
+	    rettv->v_type = VAR_STRING;
+	    rettv->vval.v_string = s;
+	    break;
+
+	case VAR_LIST:
+	    len = list_len(rettv->vval.v_list);
+	    if (n1 < 0)
+		n1 = len + n1;
+	    if (!empty1 && (n1 < 0 || n1 >= len))
+	    {
+		/* For a range we allow invalid values and return an empty
+		 * list.  A list index out of range is an error. */
+		if (!is_range)
 		{
-		    /* The resulting variable is a string of a single
-		     * character.  If the index is too big or negative the
-		     * result is empty. */
-		    if (n1 >= len || n1 < 0)
-			s = NULL;
-		    else
-			s = vim_strnsave(s + n1, 1);
+		    if (verbose)
+			EMSGN(_(e_listidx), n1);
+		    return FAIL;
 		}
-		clear_tv(rettv);
-		rettv->v_type = VAR_STRING;
-		rettv->vval.v_string = s;
-		break;
-
-	    case VAR_LIST:
-		len = list_len(rettv->vval.v_list);
-		if (n1 < 0)
-		    n1 = len + n1;
-		if (!empty1 && (n1 < 0 || n1 >= len))
+		n1 = len;
+	    }
+	    if (is_range)
+	    {
+		list_T		*l;
+		listitem_T	*item;
+
+		if (n2 < 0)
+		    n2 = len + n2;
+		else if (n2 >= len)
+		    n2 = len - 1;
+		if (var2 != NULL && (n2 < 0 || n2 + 1 < n1))
+		    n2 = -1;
+		l = list_alloc();
+		if (l == NULL)
+		    return FAIL;
+		for (item = list_find(rettv->vval.v_list, n1);
+							       n1 <= n2; ++n1)
 		{
-		    /* For a range we allow invalid values and return an empty
-		     * list.  A list index out of range is an error. */
-		    if (!range)
+		    if (list_append_tv(l, &item->li_tv) == FAIL)
 		    {
-			if (verbose)
-			    EMSGN(_(e_listidx), n1);
+			list_free(l, TRUE);
 			return FAIL;
 		    }
-		    n1 = len;
+		    item = item->li_next;
 		}
-		if (range)
+		clear_tv(rettv);
+		rettv->v_type = VAR_LIST;
+		rettv->vval.v_list = l;
+		++l->lv_refcount;
+	    }
+	    else
+	    {
+		copy_tv(&list_find(rettv->vval.v_list, n1)->li_tv, &tv);
+		clear_tv(rettv);
+		*rettv = tv;
+	    }
+	    break;
+
+	case VAR_DICT:
+	    if (is_range)
+	    {
+		if (verbose)
+		    EMSG(_(e_dictrange));
+		if (!empty1)
+		    clear_tv(var1);
+		return FAIL;
+	    }
+	    {
+		dictitem_T	*item;
+
+		if (key == NULL)
 		{
-		    list_T	*l;
-		    listitem_T	*item;
-
-		    if (n2 < 0)
-			n2 = len + n2;
-		    else if (n2 >= len)
-			n2 = len - 1;
-		    if (!empty2 && (n2 < 0 || n2 + 1 < n1))
-			n2 = -1;
-		    l = list_alloc();
-		    if (l == NULL)
+		    if (empty1)
 			return FAIL;
-		    for (item = list_find(rettv->vval.v_list, n1);
-							       n1 <= n2; ++n1)
+		    key = get_tv_string(var1);
+		    keylen = -1;
+		    if (*key == NUL)
 		    {
-			if (list_append_tv(l, &item->li_tv) == FAIL)
-			{
-			    list_free(l, TRUE);
-			    return FAIL;
-			}
-			item = item->li_next;
+			if (verbose)
+			    EMSG(_(e_emptykey));
+			clear_tv(var1);
+			return FAIL;
 		    }
-		    clear_tv(rettv);
-		    rettv->v_type = VAR_LIST;
-		    rettv->vval.v_list = l;
-		    ++l->lv_refcount;
-		}
-		else
-		{
-		    copy_tv(&list_find(rettv->vval.v_list, n1)->li_tv, &var1);
-		    clear_tv(rettv);
-		    *rettv = var1;
-		}
-		break;
-
-	    case VAR_DICT:
-		if (range)
-		{
-		    if (verbose)
-			EMSG(_(e_dictrange));
-		    if (len == -1)
-			clear_tv(&var1);
-		    return FAIL;
 		}
-		{
-		    dictitem_T	*item;
-
-		    if (len == -1)
-		    {
-			key = get_tv_string(&var1);
-			if (*key == NUL)
-			{
-			    if (verbose)
-				EMSG(_(e_emptykey));
-			    clear_tv(&var1);
-			    return FAIL;
-			}
-		    }
 
-		    item = dict_find(rettv->vval.v_dict, key, (int)len);
+		item = dict_find(rettv->vval.v_dict, key, keylen);
 
-		    if (item == NULL && verbose)
-			EMSG2(_(e_dictkey), key);
-		    if (len == -1)
-			clear_tv(&var1);
-		    if (item == NULL)
-			return FAIL;
+		if (item == NULL && verbose)
+		    EMSG2(_(e_dictkey), key);
+		if (!empty1)
+		    clear_tv(var1);
+		if (item == NULL)
+		    return FAIL;
 
-		    copy_tv(&item->di_tv, &var1);
-		    clear_tv(rettv);
-		    *rettv = var1;
-		}
-		break;
-	}
+		copy_tv(&item->di_tv, &tv);
+		clear_tv(rettv);
+		*rettv = tv;
+	    }
+	    break;
     }
-
     return OK;
 }
 
@@ -5589,6 +5815,12 @@ get_option_tv(arg, rettv, evaluate)
     }
     else if (rettv != NULL)
     {
+#ifdef FEAT_SYN_HL
+	/* A syntax file that uses an option can only be cached for its
+	 * current value. */
+	if (syn_cache_buf != NULL)
+	    syn_cache_option_used(*arg, opt_flags);
+#endif
 	if (opt_type == -2)		/* hidden string option */
 	{
 	    rettv->v_type = VAR_STRING;
@@ -5900,7 +6132,16 @@ list_alloc()
 {
     list_T  *l;
 
-    l = (list_T *)alloc_clear(sizeof(list_T));
+    ++eval_tick;
+    if (free_lists != NULL)
+    {
+	l = free_lists;
+	free_lists = l->lv_used_next;
+	--free_list_cnt;
+	vim_memset(l, 0, sizeof(list_T));
+    }
+    else
+	l = (list_T *)alloc_clear(sizeof(list_T));
     if (l != NULL)
     {
 	/* Prepend the list to the list of lists for garbage collection. */
@@ -5940,8 +6181,13 @@ rettv_list_alloc(rettv)
 list_unref(l)
     list_T *l;
 {
-    if (l != NULL && --l->lv_refcount <= 0)
-	list_free(l, TRUE);
+    if (l != NULL)
+    {
+	if (--l->lv_refcount <= 0)
+	    list_free(l, TRUE);
+	else
+	    gc_may_have_cycle = TRUE;
+    }
 }
 
 /*
@@ -5955,6 +6201,8 @@ list_free(l, recurse)
 {
     listitem_T *item;
 
+    ++eval_tick;
+
     /* Remove the list from the list of lists for garbage collection. */
     if (l->lv_used_prev == NULL)
 	first_list = l->lv_used_next;
@@ -5969,10 +6217,18 @@ list_free(l, recurse)
 	l->lv_first = item->li_next;
 	if (recurse || (item->li_tv.v_type != VAR_LIST
 					   && item->li_tv.v_type != VAR_DICT))
-	    clear_tv(&item->li_tv);
-	vim_free(item);
+	clear_tv(&item->li_tv);
+	listitem_dispose(item);
+    }
+    vim_free(l->lv_items);
+    if (free_list_cnt < FREE_LIST_MAX)
+    {
+	l->lv_used_next = free_lists;
+	free_lists = l;
+	++free_list_cnt;
     }
-    vim_free(l);
+    else
+	vim_free(l);
 }
 
 /*
@@ -5981,7 +6237,14 @@ list_free(l, recurse)
     listitem_T *
 listitem_alloc()
 {
-    return (listitem_T *)alloc(sizeof(listitem_T));
+    listitem_T	*item;
+
+    if (free_listitems == NULL)
+	return (listitem_T *)alloc(sizeof(listitem_T));
+    item = free_listitems;
+    free_listitems = item->li_next;
+    --free_listitem_cnt;
+    return item;
 }
 
 /*
@@ -5992,7 +6255,64 @@ listitem_free(item)
     listitem_T *item;
 {
     clear_tv(&item->li_tv);
-    vim_free(item);
+    listitem_dispose(item);
+}
+
+/*
+ * Free the memory of a list item, without clearing the value.  It is kept
+ * for reuse by listitem_alloc() when there are not many kept items yet.
+ */
+    static void
+listitem_dispose(item)
+    listitem_T *item;
+{
+    if (free_listitem_cnt < FREE_LISTITEM_MAX)
+    {
+	item->li_next = free_listitems;
+	free_listitems = item;
+	++free_listitem_cnt;
+    }
+    else
+	vim_free(item);
+}
+
+/*
+ * Free the list items, lists and dicts that were kept for reuse.
+ * Returns TRUE if something was freed.
+ */
+    int
+eval_free_cache()
+{
+    int		did_free = FALSE;
+    listitem_T	*item;
+    list_T	*l;
+    dict_T	*d;
+
+    while (free_listitems != NULL)
+    {
+	item = free_listitems;
+	free_listitems = item->li_next;
+	vim_free(item);
+	did_free = TRUE;
+    }
+    free_listitem_cnt = 0;
+    while (free_lists != NULL)
+    {
+	l = free_lists;
+	free_lists = l->lv_used_next;
+	vim_free(l);
+	did_free = TRUE;
+    }
+    free_list_cnt = 0;
+    while (free_dicts != NULL)
+    {
+	d = free_dicts;
+	free_dicts = d->dv_used_next;
+	vim_free(d);
+	did_free = TRUE;
+    }
+    free_dict_cnt = 0;
+    return did_free;
 }
 
 /*
@@ -6047,7 +6367,8 @@ list_equal(l1, l2, ic, recursive)
 }
 
 #if defined(FEAT_RUBY) || defined(FEAT_PYTHON) || defined(FEAT_PYTHON3) \
-	|| defined(FEAT_MZSCHEME) || defined(FEAT_LUA) || defined(PROTO)
+	|| defined(FEAT_MZSCHEME) || defined(FEAT_LUA) || defined(FEAT_SYN_HL) \
+	|| defined(PROTO)
 /*
  * Return the dictitem that an entry in a hashtable points to.
  */
@@ -6193,6 +6514,15 @@ list_find(l, n)
     if (n < 0 || n >= l->lv_len)
 	return NULL;
 
+    /* With the array of items the item is found directly. */
+    if (l->lv_items != NULL)
+    {
+	item = l->lv_items[l->lv_items_off + n];
+	l->lv_idx = n;
+	l->lv_idx_item = item;
+	return item;
+    }
+
     /* When there is a cached index may start search from there. */
     if (l->lv_idx_item != NULL)
     {
@@ -6231,6 +6561,17 @@ list_find(l, n)
 	}
     }
 
+    /* When the item is far away make an array of items, so that following
+     * lookups are quick.  Not when that takes much longer than going
+     * through the list. */
+    if (l->lv_len >= LIST_INDEX_MIN
+	    && (n > idx ? n - idx : idx - n) >= l->lv_len / 8
+	    && list_index_build(l) == OK)
+    {
+	item = l->lv_items[n];
+	idx = n;
+    }
+
     while (n > idx)
     {
 	/* search forward */
@@ -6251,6 +6592,40 @@ list_find(l, n)
     return item;
 }
 
+/*
+ * Make the array with all items of list "l".
+ * Returns FAIL when out of memory.
+ */
+    static int
+list_index_build(l)
+    list_T	*l;
+{
+    listitem_T	*li;
+    int		i = 0;
+
+    l->lv_items_size = l->lv_len + l->lv_len / 2;
+    l->lv_items = (listitem_T **)lalloc((long_u)(l->lv_items_size
+						* sizeof(listitem_T *)), FALSE);
+    if (l->lv_items == NULL)
+	return FAIL;
+    for (li = l->lv_first; li != NULL; li = li->li_next)
+	l->lv_items[i++] = li;
+    l->lv_items_off = 0;
+    return OK;
+}
+
+/*
+ * Drop the array with all items of list "l", after a change that can't be
+ * done in the array.  It is made again when needed.
+ */
+    static void
+list_index_clear(l)
+    list_T	*l;
+{
+    vim_free(l->lv_items);
+    l->lv_items = NULL;
+}
+
 /*
  * Get list item "l[idx]" as a number.
  */
@@ -6321,6 +6696,9 @@ list_append(l, item)
     list_T	*l;
     listitem_T	*item;
 {
+    listitem_T	**items;
+    int		size;
+
     if (l->lv_last == NULL)
     {
 	/* empty list */
@@ -6334,6 +6712,29 @@ list_append(l, item)
 	item->li_prev = l->lv_last;
 	l->lv_last = item;
     }
+    if (l->lv_items != NULL)
+    {
+	/* Add the item to the array, make it bigger when it is full. */
+	if (l->lv_items_off + l->lv_len >= l->lv_items_size)
+	{
+	    size = l->lv_len * 2 + 10;
+	    items = (listitem_T **)lalloc((long_u)(size
+						* sizeof(listitem_T *)), FALSE);
+	    if (items == NULL)
+		list_index_clear(l);
+	    else
+	    {
+		mch_memmove(items, l->lv_items + l->lv_items_off,
+				       (size_t)l->lv_len * sizeof(listitem_T *));
+		vim_free(l->lv_items);
+		l->lv_items = items;
+		l->lv_items_off = 0;
+		l->lv_items_size = size;
+	    }
+	}
+	if (l->lv_items != NULL)
+	    l->lv_items[l->lv_items_off + l->lv_len] = item;
+    }
     ++l->lv_len;
     item->li_next = NULL;
 }
@@ -6462,11 +6863,19 @@ list_insert(l, ni, item)
 	{
 	    l->lv_first = ni;
 	    ++l->lv_idx;
+	    if (l->lv_items != NULL)
+	    {
+		if (l->lv_items_off > 0)
+		    l->lv_items[--l->lv_items_off] = ni;
+		else
+		    list_index_clear(l);
+	    }
 	}
 	else
 	{
 	    item->li_prev->li_next = ni;
 	    l->lv_idx_item = NULL;
+	    list_index_clear(l);
 	}
 	item->li_prev = ni;
 	++l->lv_len;
@@ -6560,7 +6969,7 @@ list_copy(orig, deep, copyID)
 	    {
 		if (item_copy(&item->li_tv, &ni->li_tv, deep, copyID) == FAIL)
 		{
-		    vim_free(ni);
+		    listitem_dispose(ni);
 		    break;
 		}
 	    }
@@ -6592,6 +7001,7 @@ vimlist_remove(l, item, item2)
     listitem_T	*item2;
 {
     listitem_T	*ip;
+    int		len = l->lv_len;
 
     /* notify watchers */
     for (ip = item; ip != NULL; ip = ip->li_next)
@@ -6602,6 +7012,16 @@ vimlist_remove(l, item, item2)
 	    break;
     }
 
+    /* The array of items stays valid when removing at the start or the
+     * end. */
+    if (l->lv_items != NULL)
+    {
+	if (item->li_prev == NULL)
+	    l->lv_items_off += len - l->lv_len;
+	else if (item2->li_next != NULL)
+	    list_index_clear(l);
+    }
+
     if (item2->li_next == NULL)
 	l->lv_last = item->li_prev;
     else
@@ -6778,21 +7198,23 @@ list_join(gap, l, sep, echo_style, copyID)
 garbage_collect()
 {
     int		copyID;
-    buf_T	*buf;
-    win_T	*wp;
-    int		i;
-    funccall_T	*fc, **pfc;
     int		did_free;
-    int		did_free_funccal = FALSE;
-#ifdef FEAT_WINDOWS
-    tabpage_T	*tp;
-#endif
+    int		did_free_funccal;
+
+    /* Not while doing a step, the lists and dicts are being gone through. */
+    if (gc_busy)
+	return FALSE;
 
     /* Only do this once. */
     want_garbage_collect = FALSE;
     may_garbage_collect = FALSE;
     garbage_collect_at_exit = FALSE;
 
+    /* Drop what garbage_collect_step() was doing. */
+    ga_clear(&gc_stack);
+    gc_copyID = 0;
+    gc_may_have_cycle = FALSE;
+
     /* We advance by two because we add one for items referenced through
      * previous_funccal. */
     current_copyID += COPYID_INC;
@@ -6802,6 +7224,97 @@ garbage_collect()
      * 1. Go through all accessible variables and mark all lists and dicts
      *    with copyID.
      */
+    set_ref_in_roots(copyID);
+
+    /*
+     * 2. Free lists and dictionaries that are not referenced.
+     */
+    did_free = free_unref_items(copyID);
+
+    /*
+     * 3. Check if any funccal can be freed now.
+     */
+    did_free_funccal = free_unref_funccal(copyID);
+    if (did_free_funccal)
+	/* When a funccal was freed some more items might be garbage
+	 * collected, so run again. */
+	(void)garbage_collect();
+
+    return did_free || did_free_funccal;
+}
+
+/*
+ * Do a part of garbage collection, to be called while waiting for a key.
+ * Lists and dicts are marked GC_STEP_ITEMS items at a time.  Marking starts
+ * again when Vim script may have changed them since the previous step.
+ * Nothing is done when no list or dict was unreferenced without being freed
+ * since the last collection, only then there can be unreferenced cycles.
+ * Returns TRUE when there is more to do.
+ */
+    int
+garbage_collect_step()
+{
+    int		copyID;
+
+    if (gc_copyID != 0 && gc_tick != eval_tick)
+    {
+	/* Lists and dicts may have changed, start all over. */
+	ga_clear(&gc_stack);
+	gc_copyID = 0;
+	gc_may_have_cycle = TRUE;
+    }
+
+    gc_busy = TRUE;
+    if (gc_copyID == 0)
+    {
+	if (!gc_may_have_cycle)
+	{
+	    gc_busy = FALSE;
+	    return FALSE;
+	}
+	gc_may_have_cycle = FALSE;
+	current_copyID += COPYID_INC;
+	gc_copyID = current_copyID;
+	gc_tick = eval_tick;
+
+	/* Only put the lists and dicts referenced from variables on the
+	 * stack, they are gone through in the next steps. */
+	gc_use_stack = TRUE;
+	set_ref_in_roots(gc_copyID);
+	gc_use_stack = FALSE;
+    }
+    else if (gc_stack.ga_len > 0)
+	gc_mark_items(GC_STEP_ITEMS);
+    else
+    {
+	/* Everything found was marked.  Mark from the variables again, in case
+	 * one was added, then free what is not referenced. */
+	copyID = gc_copyID;
+	gc_copyID = 0;
+	set_ref_in_roots(copyID);
+	(void)free_unref_items(copyID);
+	if (free_unref_funccal(copyID))
+	    /* More items might be unreferenced now. */
+	    gc_may_have_cycle = TRUE;
+    }
+    gc_busy = FALSE;
+    return gc_copyID != 0 || gc_may_have_cycle;
+}
+
+/*
+ * Mark all lists and dicts referenced from variables with "copyID".
+ */
+    static void
+set_ref_in_roots(copyID)
+    int		copyID;
+{
+    buf_T	*buf;
+    win_T	*wp;
+    int		i;
+    funccall_T	*fc;
+#ifdef FEAT_WINDOWS
+    tabpage_T	*tp;
+#endif
 
     /* Don't free variables in the previous_funccal list unless they are only
      * referenced through previous_funccal.  This must be first, because if
@@ -6858,15 +7371,20 @@ garbage_collect()
 #ifdef FEAT_PYTHON3
     set_ref_in_python3(copyID);
 #endif
+}
 
-    /*
-     * 2. Free lists and dictionaries that are not referenced.
-     */
-    did_free = free_unref_items(copyID);
+/*
+ * Free the funccals in the previous_funccal list that are no longer
+ * referenced.
+ * Returns TRUE if one was freed.
+ */
+    static int
+free_unref_funccal(copyID)
+    int		copyID;
+{
+    funccall_T	*fc, **pfc;
+    int		did_free = FALSE;
 
-    /*
-     * 3. Check if any funccal can be freed now.
-     */
     for (pfc = &previous_funccal; *pfc != NULL; )
     {
 	if (can_free_funccal(*pfc, copyID))
@@ -6875,16 +7393,10 @@ garbage_collect()
 	    *pfc = fc->caller;
 	    free_funccal(fc, TRUE);
 	    did_free = TRUE;
-	    did_free_funccal = TRUE;
 	}
 	else
 	    pfc = &(*pfc)->caller;
     }
-    if (did_free_funccal)
-	/* When a funccal was freed some more items might be garbage
-	 * collected, so run again. */
-	(void)garbage_collect();
-
     return did_free;
 }
 
@@ -6895,14 +7407,18 @@ garbage_collect()
 free_unref_items(copyID)
     int copyID;
 {
-    dict_T	*dd;
-    list_T	*ll;
+    dict_T	*dd, *dd_next;
+    list_T	*ll, *ll_next;
     int		did_free = FALSE;
 
     /*
      * Go through the list of dicts and free items without the copyID.
+     * Freeing a dict without recursing does not free other dicts, thus the
+     * next one can be remembered.
      */
-    for (dd = first_dict; dd != NULL; )
+    for (dd = first_dict; dd != NULL; dd = dd_next)
+    {
+	dd_next = dd->dv_used_next;
 	if ((dd->dv_copyID & COPYID_MASK) != (copyID & COPYID_MASK))
 	{
 	    /* Free the Dictionary and ordinary items it contains, but don't
@@ -6910,19 +7426,17 @@ free_unref_items(copyID)
 	     * of dicts or list of lists. */
 	    dict_free(dd, FALSE);
 	    did_free = TRUE;
-
-	    /* restart, next dict may also have been freed */
-	    dd = first_dict;
 	}
-	else
-	    dd = dd->dv_used_next;
+    }
 
     /*
      * Go through the list of lists and free items without the copyID.
      * But don't free a list that has a watcher (used in a for loop), these
      * are not referenced anywhere.
      */
-    for (ll = first_list; ll != NULL; )
+    for (ll = first_list; ll != NULL; ll = ll_next)
+    {
+	ll_next = ll->lv_used_next;
 	if ((ll->lv_copyID & COPYID_MASK) != (copyID & COPYID_MASK)
 						      && ll->lv_watch == NULL)
 	{
@@ -6931,14 +7445,100 @@ free_unref_items(copyID)
 	     * or list of lists. */
 	    list_free(ll, FALSE);
 	    did_free = TRUE;
+	}
+    }
+
+    return did_free;
+}
+
+/*
+ * Put list "l" or dict "d" on the stack of garbage_collect_step(), to go
+ * through its items later.
+ * Returns FAIL when out of memory.
+ */
+    static int
+gc_push(l, d, copyID)
+    list_T	*l;
+    dict_T	*d;
+    int		copyID;
+{
+    gcentry_T	*gs;
+
+    if (ga_grow(&gc_stack, 1) == FAIL)
+	return FAIL;
+    gs = ((gcentry_T *)gc_stack.ga_data) + gc_stack.ga_len++;
+    gs->gs_copyID = copyID;
+    gs->gs_list = l;
+    gs->gs_li = l == NULL ? NULL : l->lv_first;
+    gs->gs_dict = d;
+    if (d != NULL)
+    {
+	gs->gs_hi = d->dv_hashtab.ht_array;
+	gs->gs_todo = (long)d->dv_hashtab.ht_used;
+    }
+    return OK;
+}
+
+/*
+ * Go through about "count" items of the lists and dicts on the stack of
+ * garbage_collect_step() and mark what they refer to.
+ */
+    static void
+gc_mark_items(count)
+    long	count;
+{
+    gcentry_T	gs;
 
-	    /* restart, next list may also have been freed */
-	    ll = first_list;
+    gc_use_stack = TRUE;
+    while (gc_stack.ga_len > 0 && count > 0)
+    {
+	/* Take the entry from the stack, marking may add entries. */
+	gs = ((gcentry_T *)gc_stack.ga_data)[--gc_stack.ga_len];
+	if (gs.gs_list != NULL)
+	{
+	    for ( ; gs.gs_li != NULL && count > 0; gs.gs_li = gs.gs_li->li_next)
+	    {
+		set_ref_in_item(&gs.gs_li->li_tv, gs.gs_copyID);
+		--count;
+	    }
+	    if (gs.gs_li == NULL)
+		continue;
 	}
 	else
-	    ll = ll->lv_used_next;
+	{
+	    for ( ; gs.gs_todo > 0 && count > 0; ++gs.gs_hi)
+		if (!HASHITEM_EMPTY(gs.gs_hi))
+		{
+		    set_ref_in_item(&HI2DI(gs.gs_hi)->di_tv, gs.gs_copyID);
+		    --gs.gs_todo;
+		    --count;
+		}
+	    if (gs.gs_todo == 0)
+		continue;
+	}
 
-    return did_free;
+	/* Not finished, put it back for the next step. */
+	if (ga_grow(&gc_stack, 1) == FAIL)
+	{
+	    /* Out of memory, do the rest right now. */
+	    gc_use_stack = FALSE;
+	    if (gs.gs_list != NULL)
+		for ( ; gs.gs_li != NULL; gs.gs_li = gs.gs_li->li_next)
+		    set_ref_in_item(&gs.gs_li->li_tv, gs.gs_copyID);
+	    else
+		for ( ; gs.gs_todo > 0; ++gs.gs_hi)
+		    if (!HASHITEM_EMPTY(gs.gs_hi))
+		    {
+			set_ref_in_item(&HI2DI(gs.gs_hi)->di_tv,
+							       gs.gs_copyID);
+			--gs.gs_todo;
+		    }
+	    gc_use_stack = TRUE;
+	}
+	else
+	    ((gcentry_T *)gc_stack.ga_data)[gc_stack.ga_len++] = gs;
+    }
+    gc_use_stack = FALSE;
 }
 
 /*
@@ -6992,9 +7592,11 @@ set_ref_in_item(tv, copyID)
 	    dd = tv->vval.v_dict;
 	    if (dd != NULL && dd->dv_copyID != copyID)
 	    {
-		/* Didn't see this dict yet. */
+		/* Didn't see this dict yet.  For garbage_collect_step() go
+		 * through it later. */
 		dd->dv_copyID = copyID;
-		set_ref_in_ht(&dd->dv_hashtab, copyID);
+		if (!gc_use_stack || gc_push(NULL, dd, copyID) == FAIL)
+		    set_ref_in_ht(&dd->dv_hashtab, copyID);
 	    }
 	    break;
 
@@ -7004,7 +7606,8 @@ set_ref_in_item(tv, copyID)
 	    {
 		/* Didn't see this list yet. */
 		ll->lv_copyID = copyID;
-		set_ref_in_list(ll, copyID);
+		if (!gc_use_stack || gc_push(ll, NULL, copyID) == FAIL)
+		    set_ref_in_list(ll, copyID);
 	    }
 	    break;
     }
@@ -7019,7 +7622,15 @@ dict_alloc()
 {
     dict_T *d;
 
-    d = (dict_T *)alloc(sizeof(dict_T));
+    ++eval_tick;
+    if (free_dicts != NULL)
+    {
+	d = free_dicts;
+	free_dicts = d->dv_used_next;
+	--free_dict_cnt;
+    }
+    else
+	d = (dict_T *)alloc(sizeof(dict_T));
     if (d != NULL)
     {
 	/* Add the dict to the list of dicts for garbage collection. */
@@ -7066,8 +7677,13 @@ rettv_dict_alloc(rettv)
 dict_unref(d)
     dict_T *d;
 {
-    if (d != NULL && --d->dv_refcount <= 0)
-	dict_free(d, TRUE);
+    if (d != NULL)
+    {
+	if (--d->dv_refcount <= 0)
+	    dict_free(d, TRUE);
+	else
+	    gc_may_have_cycle = TRUE;
+    }
 }
 
 /*
@@ -7083,6 +7699,8 @@ dict_free(d, recurse)
     hashitem_T	*hi;
     dictitem_T	*di;
 
+    ++eval_tick;
+
     /* Remove the dict from the list of dicts for garbage collection. */
     if (d->dv_used_prev == NULL)
 	first_dict = d->dv_used_next;
@@ -7110,7 +7728,14 @@ dict_free(d, recurse)
 	}
     }
     hash_clear(&d->dv_hashtab);
-    vim_free(d);
+    if (free_dict_cnt < FREE_DICT_MAX)
+    {
+	d->dv_used_next = free_dicts;
+	free_dicts = d;
+	++free_dict_cnt;
+    }
+    else
+	vim_free(d);
 }
 
 /*
@@ -7180,7 +7805,8 @@ dictitem_free(item)
     dictitem_T *item;
 {
     clear_tv(&item->di_tv);
-    vim_free(item);
+    if ((item->di_flags & DI_FLAGS_NOFREE) == 0)
+	vim_free(item);
 }
 
 /*
@@ -7802,65 +8428,672 @@ string2float(text, value)
 #endif
 
 /*
- * Get the value of an environment variable.
- * "arg" is pointing to the '$'.  It is advanced to after the name.
- * If the environment variable was not set, silently assume it is empty.
- * Return FAIL if the name is invalid.
+ * Add the JSON encoding of string "str" to "gap".
  */
-    static int
-get_env_tv(arg, rettv, evaluate)
-    char_u	**arg;
-    typval_T	*rettv;
-    int		evaluate;
+    static void
+json_encode_string(gap, str)
+    garray_T	*gap;
+    char_u	*str;
 {
-    char_u	*string = NULL;
-    int		len;
-    int		cc;
-    char_u	*name;
-    int		mustfree = FALSE;
+    char_u	*p;
+    char_u	*s = str;
+    char_u	*tofree = NULL;
+    char_u	numbuf[NUMBUFLEN];
 
-    ++*arg;
-    name = *arg;
-    len = get_env_len(arg);
-    if (evaluate)
+    ga_append(gap, '"');
+    if (s == NULL)
     {
-	if (len == 0)
-           return FAIL; /* can't be an environment variable */
+	ga_append(gap, '"');
+	return;
+    }
+#ifdef FEAT_MBYTE
+    /* JSON text is UTF-8. */
+    if (!enc_utf8)
+    {
+	vimconv_T   vc;
 
-	cc = name[len];
-	name[len] = NUL;
-	/* first try vim_getenv(), fast for normal environment vars */
-	string = vim_getenv(name, &mustfree);
-	if (string != NULL && *string != NUL)
+	vc.vc_type = CONV_NONE;
+	if (convert_setup(&vc, p_enc, (char_u *)"utf-8") == OK
+						   && vc.vc_type != CONV_NONE)
+	    s = tofree = string_convert(&vc, str, NULL);
+	convert_setup(&vc, NULL, NULL);
+	if (s == NULL)
+	    s = str;
+    }
+#endif
+    for (p = s; *p != NUL; ++p)
+    {
+	switch (*p)
 	{
-	    if (!mustfree)
-		string = vim_strsave(string);
+	    case '"':  ga_concat(gap, (char_u *)"\\\""); break;
+	    case '\\': ga_concat(gap, (char_u *)"\\\\"); break;
+	    case '\b': ga_concat(gap, (char_u *)"\\b"); break;
+	    case '\f': ga_concat(gap, (char_u *)"\\f"); break;
+	    case '\n': ga_concat(gap, (char_u *)"\\n"); break;
+	    case '\r': ga_concat(gap, (char_u *)"\\r"); break;
+	    case '\t': ga_concat(gap, (char_u *)"\\t"); break;
+	    default:
+		if (*p < 0x20)
+		{
+		    vim_snprintf((char *)numbuf, NUMBUFLEN, "\\u%04x", *p);
+		    ga_concat(gap, numbuf);
+		}
+		else
+		    ga_append(gap, *p);
 	}
-	else
-	{
-	    if (mustfree)
-		vim_free(string);
+    }
+    ga_append(gap, '"');
+    vim_free(tofree);
+}
 
-	    /* next try expanding things like $VIM and ${HOME} */
-	    string = expand_env_save(name - 1);
-	    if (string != NULL && *string == '$')
+/*
+ * Add the JSON encoding of "tv" to "gap".
+ * Returns FAIL and gives an error message for a value that can't be encoded.
+ */
+    static int
+json_encode_item(gap, tv, depth)
+    garray_T	*gap;
+    typval_T	*tv;
+    int		depth;
+{
+    char_u	numbuf[NUMBUFLEN];
+    listitem_T	*li;
+    hashitem_T	*hi;
+    int		todo;
+    int		first = TRUE;
+
+    if (depth > DICT_MAXNEST)
+    {
+	/* Also catches a List or Dictionary that contains itself. */
+	EMSG(_("E724: variable nested too deep for displaying"));
+	return FAIL;
+    }
+
+    switch (tv->v_type)
+    {
+	case VAR_NUMBER:
+	    vim_snprintf((char *)numbuf, NUMBUFLEN, "%ld",
+						    (long)tv->vval.v_number);
+	    ga_concat(gap, numbuf);
+	    break;
+
+	case VAR_STRING:
+	    json_encode_string(gap, tv->vval.v_string);
+	    break;
+
+#ifdef FEAT_FLOAT
+	case VAR_FLOAT:
+	    /* Infinity and NaN are not valid JSON, for them "f - f" is NaN,
+	     * which is not equal to itself. */
+	    if (tv->vval.v_float - tv->vval.v_float
+				      != tv->vval.v_float - tv->vval.v_float)
 	    {
-		vim_free(string);
-		string = NULL;
+		EMSG(_(e_invarg));
+		return FAIL;
 	    }
-	}
-	name[len] = cc;
+	    vim_snprintf((char *)numbuf, NUMBUFLEN, "%g", tv->vval.v_float);
+	    ga_concat(gap, numbuf);
+	    break;
+#endif
 
-	rettv->v_type = VAR_STRING;
-	rettv->vval.v_string = string;
-    }
+	case VAR_LIST:
+	    ga_append(gap, '[');
+	    if (tv->vval.v_list != NULL)
+		for (li = tv->vval.v_list->lv_first; li != NULL;
+							      li = li->li_next)
+		{
+		    if (li != tv->vval.v_list->lv_first)
+			ga_append(gap, ',');
+		    if (json_encode_item(gap, &li->li_tv, depth + 1) == FAIL)
+			return FAIL;
+		}
+	    ga_append(gap, ']');
+	    break;
+
+	case VAR_DICT:
+	    ga_append(gap, '{');
+	    if (tv->vval.v_dict != NULL)
+	    {
+		todo = (int)tv->vval.v_dict->dv_hashtab.ht_used;
+		for (hi = tv->vval.v_dict->dv_hashtab.ht_array; todo > 0; ++hi)
+		    if (!HASHITEM_EMPTY(hi))
+		    {
+			--todo;
+			if (first)
+			    first = FALSE;
+			else
+			    ga_append(gap, ',');
+			json_encode_string(gap, hi->hi_key);
+			ga_append(gap, ':');
+			if (json_encode_item(gap, &HI2DI(hi)->di_tv, depth + 1)
+								      == FAIL)
+			    return FAIL;
+		    }
+	    }
+	    ga_append(gap, '}');
+	    break;
 
+	default:
+	    /* A Funcref can't be encoded. */
+	    EMSG(_(e_invarg));
+	    return FAIL;
+    }
     return OK;
 }
 
 /*
- * Array with names and number of arguments of all internal functions
- * MUST BE KEPT SORTED IN strcmp() ORDER FOR BINARY SEARCH!
+ * When reading from a file make sure "need" bytes are available in
+ * "reader->js_buf", unless the end of the file was reached.
+ */
+    static void
+json_fill(reader, need)
+    jsread_T	*reader;
+    int		need;
+{
+    int		len = reader->js_len - reader->js_used;
+
+    if (reader->js_fd == NULL || len >= need)
+	return;
+    mch_memmove(reader->js_buf, reader->js_buf + reader->js_used, (size_t)len);
+    reader->js_used = 0;
+    len += (int)fread(reader->js_buf + len, 1, (size_t)(JSON_BUFSIZE - len),
+							      reader->js_fd);
+    reader->js_len = len;
+    reader->js_buf[len] = NUL;
+}
+
+/*
+ * Skip white space in the JSON text.
+ */
+    static void
+json_skipwhite(reader)
+    jsread_T	*reader;
+{
+    int		c;
+
+    for (;;)
+    {
+	json_fill(reader, 1);
+	c = reader->js_buf[reader->js_used];
+	if (c != ' ' && c != TAB && c != NL && c != CAR)
+	    break;
+	++reader->js_used;
+    }
+}
+
+/*
+ * Decode a JSON string, "reader->js_used" is at the '"'.
+ * Returns the allocated string, NULL for an error.
+ */
+    static char_u *
+json_decode_string(reader)
+    jsread_T	*reader;
+{
+    garray_T	ga;
+    char_u	*p;
+    char_u	*s;
+    int		len;
+    int		c;
+    int		c2;
+    int		i;
+
+    /* Mostly there is nothing to unescape, the whole string can be copied
+     * at once. */
+    p = reader->js_buf + reader->js_used + 1;
+    for (s = p; *s != '"' && *s != '\\' && *s != NUL; ++s)
+	;
+    if (*s == '"')
+    {
+	reader->js_used += (int)(s - p) + 2;
+	s = vim_strnsave(p, (int)(s - p));
+    }
+    else
+    {
+	++reader->js_used;
+	ga_init2(&ga, 1, 80);
+	for (;;)
+	{
+	    /* Enough to decode "\uXXXX\uXXXX". */
+	    json_fill(reader, 12);
+	    p = reader->js_buf + reader->js_used;
+	    if (*p == '"')
+	    {
+		++reader->js_used;
+		break;
+	    }
+	    if (*p == NUL)
+	    {
+		/* end of the text or a NUL byte */
+		ga_clear(&ga);
+		return NULL;
+	    }
+	    if (*p != '\\')
+	    {
+		for (s = p; *s != '"' && *s != '\\' && *s != NUL; ++s)
+		    ;
+		len = (int)(s - p);
+		if (ga_grow(&ga, len) == FAIL)
+		    break;
+		mch_memmove((char_u *)ga.ga_data + ga.ga_len, p, (size_t)len);
+		ga.ga_len += len;
+		reader->js_used += len;
+		continue;
+	    }
+
+	    len = 2;
+	    switch (p[1])
+	    {
+		case '"':
+		case '\\':
+		case '/': c = p[1]; break;
+		case 'b': c = BS; break;
+		case 'f': c = FF; break;
+		case 'n': c = NL; break;
+		case 'r': c = CAR; break;
+		case 't': c = TAB; break;
+		case 'u':
+		    c = 0;
+		    for (i = 2; i < 6; ++i)
+		    {
+			if (!vim_isxdigit(p[i]))
+			{
+			    ga_clear(&ga);
+			    return NULL;
+			}
+			c = (c << 4) + hex2nr(p[i]);
+		    }
+		    len = 6;
+		    if (c >= 0xd800 && c <= 0xdbff && p[6] == '\\'
+								&& p[7] == 'u')
+		    {
+			/* surrogate pair */
+			c2 = 0;
+			for (i = 8; i < 12 && vim_isxdigit(p[i]); ++i)
+			    c2 = (c2 << 4) + hex2nr(p[i]);
+			if (i == 12 && c2 >= 0xdc00 && c2 <= 0xdfff)
+			{
+			    c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+			    len = 12;
+			}
+		    }
+		    break;
+		default:
+		    ga_clear(&ga);
+		    return NULL;
+	    }
+	    reader->js_used += len;
+
+	    /* A NUL is stored as a NL, like in buffer text. */
+	    if (c == NUL)
+		c = NL;
+	    if (ga_grow(&ga, MB_MAXBYTES) == FAIL)
+		break;
+#ifdef FEAT_MBYTE
+	    ga.ga_len += utf_char2bytes(c, (char_u *)ga.ga_data + ga.ga_len);
+#else
+	    ((char_u *)ga.ga_data)[ga.ga_len++] = c < 0x100 ? c : '?';
+#endif
+	}
+	ga_append(&ga, NUL);
+	s = (char_u *)ga.ga_data;
+	if (s == NULL)
+	    s = vim_strsave((char_u *)"");
+    }
+
+#ifdef FEAT_MBYTE
+    if (s != NULL && reader->js_conv.vc_type != CONV_NONE)
+    {
+	p = string_convert(&reader->js_conv, s, NULL);
+	if (p != NULL)
+	{
+	    vim_free(s);
+	    s = p;
+	}
+    }
+#endif
+    return s;
+}
+
+/*
+ * Decode a JSON number, "reader->js_used" is at the first character.
+ * Returns FAIL when it is not a valid number.
+ */
+    static int
+json_decode_number(reader, res)
+    jsread_T	*reader;
+    typval_T	*res;
+{
+    char_u	*start;
+    char_u	*p;
+    char_u	*q;
+    int		is_float = FALSE;
+    varnumber_T	n = 0;
+    int		d;
+
+    json_fill(reader, JSON_NUMLEN);
+    start = reader->js_buf + reader->js_used;
+    p = start;
+    if (*p == '-')
+	++p;
+    if (!VIM_ISDIGIT(*p) || (*p == '0' && VIM_ISDIGIT(p[1])))
+	return FAIL;
+    while (VIM_ISDIGIT(*p))
+	++p;
+    if (*p == '.')
+    {
+	is_float = TRUE;
+	if (!VIM_ISDIGIT(*++p))
+	    return FAIL;
+	while (VIM_ISDIGIT(*p))
+	    ++p;
+    }
+    if (*p == 'e' || *p == 'E')
+    {
+	is_float = TRUE;
+	++p;
+	if (*p == '-' || *p == '+')
+	    ++p;
+	if (!VIM_ISDIGIT(*p))
+	    return FAIL;
+	while (VIM_ISDIGIT(*p))
+	    ++p;
+    }
+
+    if (!is_float)
+    {
+	/* Compute the negative value, it can be one bigger. */
+	for (q = *start == '-' ? start + 1 : start; q < p; ++q)
+	{
+	    d = *q - '0';
+	    if (n < (-JSON_NUMBER_MAX - 1 + d) / 10)
+		break;
+	    n = n * 10 - d;
+	}
+	if (q < p || (*start != '-' && n < -JSON_NUMBER_MAX))
+	{
+	    /* Too big for a Number, use a Float. */
+	    is_float = TRUE;
+#ifndef FEAT_FLOAT
+	    EMSG(_("E889: JSON number too big"));
+#endif
+	}
+	else
+	{
+	    res->v_type = VAR_NUMBER;
+	    res->vval.v_number = *start == '-' ? n : -n;
+	}
+    }
+    if (is_float)
+    {
+#ifdef FEAT_FLOAT
+	res->v_type = VAR_FLOAT;
+	(void)string2float(start, &res->vval.v_float);
+#else
+	return FAIL;
+#endif
+    }
+    reader->js_used += (int)(p - start);
+    return OK;
+}
+
+/*
+ * Decode one JSON value into "res".
+ * Returns FAIL when the text is not valid JSON.
+ */
+    static int
+json_decode_item(reader, res, depth)
+    jsread_T	*reader;
+    typval_T	*res;
+    int		depth;
+{
+    char_u	*p;
+    char_u	*key;
+    typval_T	item;
+    listitem_T	*li;
+    dictitem_T	*di;
+
+    /* The caller clears "res" when decoding fails. */
+    res->v_type = VAR_UNKNOWN;
+    if (depth > DICT_MAXNEST)
+    {
+	EMSG(_("E888: JSON nested too deep"));
+	return FAIL;
+    }
+
+    json_skipwhite(reader);
+    json_fill(reader, 5);
+    p = reader->js_buf + reader->js_used;
+    switch (*p)
+    {
+	case '[':
+	    ++reader->js_used;
+	    if (rettv_list_alloc(res) == FAIL)
+		return FAIL;
+	    json_skipwhite(reader);
+	    if (reader->js_buf[reader->js_used] == ']')
+	    {
+		++reader->js_used;
+		return OK;
+	    }
+	    for (;;)
+	    {
+		if (json_decode_item(reader, &item, depth + 1) == FAIL)
+		{
+		    clear_tv(&item);
+		    return FAIL;
+		}
+		li = listitem_alloc();
+		if (li == NULL)
+		{
+		    clear_tv(&item);
+		    return FAIL;
+		}
+		li->li_tv = item;
+		list_append(res->vval.v_list, li);
+
+		json_skipwhite(reader);
+		p = reader->js_buf + reader->js_used;
+		if (*p != ',' && *p != ']')
+		    return FAIL;
+		++reader->js_used;
+		if (*p == ']')
+		    return OK;
+	    }
+
+	case '{':
+	    ++reader->js_used;
+	    if (rettv_dict_alloc(res) == FAIL)
+		return FAIL;
+	    json_skipwhite(reader);
+	    if (reader->js_buf[reader->js_used] == '}')
+	    {
+		++reader->js_used;
+		return OK;
+	    }
+	    for (;;)
+	    {
+		json_skipwhite(reader);
+		if (reader->js_buf[reader->js_used] != '"'
+			|| (key = json_decode_string(reader)) == NULL)
+		    return FAIL;
+		if (*key == NUL)
+		{
+		    vim_free(key);
+		    EMSG(_(e_emptykey));
+		    return FAIL;
+		}
+		json_skipwhite(reader);
+		if (reader->js_buf[reader->js_used] != ':')
+		{
+		    vim_free(key);
+		    return FAIL;
+		}
+		++reader->js_used;
+		if (json_decode_item(reader, &item, depth + 1) == FAIL)
+		{
+		    clear_tv(&item);
+		    vim_free(key);
+		    return FAIL;
+		}
+
+		/* When a key appears twice the last value is used. */
+		di = dict_find(res->vval.v_dict, key, -1);
+		if (di != NULL)
+		{
+		    clear_tv(&di->di_tv);
+		    di->di_tv = item;
+		}
+		else
+		{
+		    di = dictitem_alloc(key);
+		    if (di == NULL)
+		    {
+			vim_free(key);
+			clear_tv(&item);
+			return FAIL;
+		    }
+		    di->di_tv = item;
+		    if (dict_add(res->vval.v_dict, di) == FAIL)
+		    {
+			dictitem_free(di);
+			vim_free(key);
+			return FAIL;
+		    }
+		}
+		vim_free(key);
+
+		json_skipwhite(reader);
+		p = reader->js_buf + reader->js_used;
+		if (*p != ',' && *p != '}')
+		    return FAIL;
+		++reader->js_used;
+		if (*p == '}')
+		    return OK;
+	    }
+
+	case '"':
+	    res->v_type = VAR_STRING;
+	    res->vval.v_string = json_decode_string(reader);
+	    return res->vval.v_string == NULL ? FAIL : OK;
+
+	default:
+	    res->v_type = VAR_NUMBER;
+	    if (STRNCMP(p, "true", 4) == 0)
+	    {
+		reader->js_used += 4;
+		res->vval.v_number = 1;
+		return OK;
+	    }
+	    if (STRNCMP(p, "false", 5) == 0 || STRNCMP(p, "null", 4) == 0)
+	    {
+		reader->js_used += *p == 'f' ? 5 : 4;
+		res->vval.v_number = 0;
+		return OK;
+	    }
+	    return json_decode_number(reader, res);
+    }
+}
+
+/*
+ * Decode the JSON text of "reader" into "rettv".  Gives an error message when
+ * it is not valid JSON.
+ */
+    static void
+json_decode(reader, rettv)
+    jsread_T	*reader;
+    typval_T	*rettv;
+{
+    int		save_did_emsg = did_emsg;
+    int		ok = FALSE;
+    typval_T	res;
+
+#ifdef FEAT_MBYTE
+    reader->js_conv.vc_type = CONV_NONE;
+    if (!enc_utf8)
+	convert_setup(&reader->js_conv, (char_u *)"utf-8", p_enc);
+#endif
+    did_emsg = FALSE;
+    if (json_decode_item(reader, &res, 0) == OK)
+    {
+	/* Only white space may follow. */
+	json_skipwhite(reader);
+	ok = reader->js_used == reader->js_len;
+    }
+    if (ok)
+	*rettv = res;
+    else
+    {
+	/* Also frees the Lists and Dictionaries decoded so far. */
+	clear_tv(&res);
+	if (!did_emsg)
+	    EMSG(_(e_invarg));
+    }
+    did_emsg |= save_did_emsg;
+#ifdef FEAT_MBYTE
+    convert_setup(&reader->js_conv, NULL, NULL);
+#endif
+}
+
+/*
+ * Get the value of an environment variable.
+ * "arg" is pointing to the '$'.  It is advanced to after the name.
+ * If the environment variable was not set, silently assume it is empty.
+ * Return FAIL if the name is invalid.
+ */
+    static int
+get_env_tv(arg, rettv, evaluate)
+    char_u	**arg;
+    typval_T	*rettv;
+    int		evaluate;
+{
+    char_u	*string = NULL;
+    int		len;
+    int		cc;
+    char_u	*name;
+    int		mustfree = FALSE;
+
+    ++*arg;
+    name = *arg;
+    len = get_env_len(arg);
+    if (evaluate)
+    {
+	if (len == 0)
+           return FAIL; /* can't be an environment variable */
+
+	cc = name[len];
+	name[len] = NUL;
+	/* first try vim_getenv(), fast for normal environment vars */
+	string = vim_getenv(name, &mustfree);
+	if (string != NULL && *string != NUL)
+	{
+	    if (!mustfree)
+		string = vim_strsave(string);
+	}
+	else
+	{
+	    if (mustfree)
+		vim_free(string);
+
+	    /* next try expanding things like $VIM and ${HOME} */
+	    string = expand_env_save(name - 1);
+	    if (string != NULL && *string == '$')
+	    {
+		vim_free(string);
+		string = NULL;
+	    }
+	}
+	name[len] = cc;
+
+	rettv->v_type = VAR_STRING;
+	rettv->vval.v_string = string;
+    }
+
+    return OK;
+}
+
+/*
+ * Array with names and number of arguments of all internal functions
+ * MUST BE KEPT SORTED IN strcmp() ORDER FOR BINARY SEARCH!
  */
 static struct fst
 {
@@ -8019,6 +9252,9 @@ static struct fst
     {"islocked",	1, 1, f_islocked},
     {"items",		1, 1, f_items},
     {"join",		1, 2, f_join},
+    {"json_decode",	1, 1, f_json_decode},
+    {"json_decodefile",	1, 1, f_json_decodefile},
+    {"json_encode",	1, 1, f_json_encode},
     {"keys",		1, 1, f_keys},
     {"last_buffer_nr",	0, 0, f_last_buffer_nr},/* obsolete */
     {"len",		1, 1, f_len},
@@ -8439,6 +9675,8 @@ call_func(funcname, len, rettv, argcount, argvars, firstline, lastline,
     char_u	*fname;
     char_u	*name;
 
+    ++eval_tick;
+
     /* Make a copy of the name, if it comes from a funcref variable it could
      * be changed or deleted in the called function. */
     name = vim_strnsave(funcname, len);
@@ -8777,6 +10015,43 @@ f_and(argvars, rettv)
 					& get_tv_number_chk(&argvars[1], NULL);
 }
 
+static long append_list_lines __ARGS((linenr_T lnum, listitem_T *li, int *okp));
+
+/*
+ * Append the items of a list, starting at "li", below line "lnum" of the
+ * current buffer at once.  Only done when all the items are Strings.
+ * Returns the number of lines appended and sets "*okp" to FALSE when this
+ * failed.  Returns -1 when the lines need to be appended one by one.
+ */
+    static long
+append_list_lines(lnum, li, okp)
+    linenr_T	lnum;
+    listitem_T	*li;
+    int		*okp;
+{
+    garray_T	ga;
+    listitem_T	*item;
+    char_u	*p;
+    long	n = -1;
+
+    ga_init2(&ga, (int)sizeof(char_u *), 100);
+    for (item = li; item != NULL; item = item->li_next)
+    {
+	if (item->li_tv.v_type != VAR_STRING || ga_grow(&ga, 1) == FAIL)
+	    break;
+	p = item->li_tv.vval.v_string;
+	((char_u **)ga.ga_data)[ga.ga_len++] = p == NULL ? (char_u *)"" : p;
+    }
+    if (item == NULL && ga.ga_len > 1)
+    {
+	n = ga.ga_len;
+	*okp = ml_append_lines(lnum, (char_u **)ga.ga_data, NULL, n, FALSE)
+									 == OK;
+    }
+    ga_clear(&ga);
+    return n;
+}
+
 /*
  * "append(lnum, string/list)" function
  */
@@ -8791,6 +10066,7 @@ f_append(argvars, rettv)
     listitem_T	*li = NULL;
     typval_T	*tv;
     long	added = 0;
+    int		ok;
 
     /* When coming here from Insert mode, sync undo, so that this can be
      * undone separately from what was previously inserted. */
@@ -8811,6 +10087,11 @@ f_append(argvars, rettv)
 	    if (l == NULL)
 		return;
 	    li = l->lv_first;
+	    added = append_list_lines(lnum, li, &ok);
+	    if (added >= 0)
+		li = NULL;	/* done */
+	    else
+		added = 0;
 	}
 	for (;;)
 	{
@@ -12450,6 +13731,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_SESSION
 	"mksession",
 #endif
+#ifdef FEAT_MMAP
+	"mmap",
+#endif
 #ifdef FEAT_MODIFY_FNAME
 	"modify_fname",
 #endif
@@ -12654,11135 +13938,14159 @@ f_has(argvars, rettv)
 #ifdef FEAT_WRITEBACKUP
 	"writebackup",
 #endif
-#ifdef FEAT_XIM
-	"xim",
+#ifdef FEAT_XIM
+	"xim",
+#endif
+#ifdef FEAT_XFONTSET
+	"xfontset",
+#endif
+#ifdef FEAT_XPM_W32
+	"xpm",
+	"xpm_w32",	/* for backward compatibility */
+#else
+# if defined(HAVE_XPM)
+	"xpm",
+# endif
+#endif
+#ifdef USE_XSMP
+	"xsmp",
+#endif
+#ifdef USE_XSMP_INTERACT
+	"xsmp_interact",
+#endif
+#ifdef FEAT_XCLIPBOARD
+	"xterm_clipboard",
+#endif
+#ifdef FEAT_XTERM_SAVE
+	"xterm_save",
+#endif
+#if defined(UNIX) && defined(FEAT_X11)
+	"X11",
+#endif
+	NULL
+    };
+
+    name = get_tv_string(&argvars[0]);
+    for (i = 0; has_list[i] != NULL; ++i)
+	if (STRICMP(name, has_list[i]) == 0)
+	{
+	    n = TRUE;
+	    break;
+	}
+
+    if (n == FALSE)
+    {
+	if (STRNICMP(name, "patch", 5) == 0)
+	{
+	    if (name[5] == '-'
+		    && STRLEN(name) > 11
+		    && vim_isdigit(name[6])
+		    && vim_isdigit(name[8])
+		    && vim_isdigit(name[10]))
+	    {
+		int major = atoi((char *)name + 6);
+		int minor = atoi((char *)name + 8);
+
+		/* Expect "patch-9.9.01234". */
+		n = (major < VIM_VERSION_MAJOR
+		     || (major == VIM_VERSION_MAJOR
+			 && (minor < VIM_VERSION_MINOR
+			     || (minor == VIM_VERSION_MINOR
+				 && has_patch(atoi((char *)name + 10))))));
+	    }
+	    else
+		n = has_patch(atoi((char *)name + 5));
+	}
+	else if (STRICMP(name, "vim_starting") == 0)
+	    n = (starting != 0);
+#ifdef FEAT_MBYTE
+	else if (STRICMP(name, "multi_byte_encoding") == 0)
+	    n = has_mbyte;
+#endif
+#if defined(FEAT_BEVAL) && defined(FEAT_GUI_W32)
+	else if (STRICMP(name, "balloon_multiline") == 0)
+	    n = multiline_balloon_available();
+#endif
+#ifdef DYNAMIC_TCL
+	else if (STRICMP(name, "tcl") == 0)
+	    n = tcl_enabled(FALSE);
+#endif
+#if defined(USE_ICONV) && defined(DYNAMIC_ICONV)
+	else if (STRICMP(name, "iconv") == 0)
+	    n = iconv_enabled(FALSE);
+#endif
+#ifdef DYNAMIC_LUA
+	else if (STRICMP(name, "lua") == 0)
+	    n = lua_enabled(FALSE);
+#endif
+#ifdef DYNAMIC_MZSCHEME
+	else if (STRICMP(name, "mzscheme") == 0)
+	    n = mzscheme_enabled(FALSE);
+#endif
+#ifdef DYNAMIC_RUBY
+	else if (STRICMP(name, "ruby") == 0)
+	    n = ruby_enabled(FALSE);
+#endif
+#ifdef FEAT_PYTHON
+#ifdef DYNAMIC_PYTHON
+	else if (STRICMP(name, "python") == 0)
+	    n = python_enabled(FALSE);
+#endif
+#endif
+#ifdef FEAT_PYTHON3
+#ifdef DYNAMIC_PYTHON3
+	else if (STRICMP(name, "python3") == 0)
+	    n = python3_enabled(FALSE);
+#endif
+#endif
+#ifdef DYNAMIC_PERL
+	else if (STRICMP(name, "perl") == 0)
+	    n = perl_enabled(FALSE);
+#endif
+#ifdef FEAT_GUI
+	else if (STRICMP(name, "gui_running") == 0)
+	    n = (gui.in_use || gui.starting);
+# ifdef FEAT_GUI_W32
+	else if (STRICMP(name, "gui_win32s") == 0)
+	    n = gui_is_win32s();
+# endif
+# ifdef FEAT_BROWSE
+	else if (STRICMP(name, "browse") == 0)
+	    n = gui.in_use;	/* gui_mch_browse() works when GUI is running */
+# endif
+#endif
+#ifdef FEAT_SYN_HL
+	else if (STRICMP(name, "syntax_items") == 0)
+	    n = syntax_present(curwin);
+#endif
+#if defined(WIN3264)
+	else if (STRICMP(name, "win95") == 0)
+	    n = mch_windows95();
+#endif
+#ifdef FEAT_NETBEANS_INTG
+	else if (STRICMP(name, "netbeans_enabled") == 0)
+	    n = netbeans_active();
 #endif
-#ifdef FEAT_XFONTSET
-	"xfontset",
+    }
+
+    rettv->vval.v_number = n;
+}
+
+/*
+ * "has_key()" function
+ */
+    static void
+f_has_key(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    if (argvars[0].v_type != VAR_DICT)
+    {
+	EMSG(_(e_dictreq));
+	return;
+    }
+    if (argvars[0].vval.v_dict == NULL)
+	return;
+
+    rettv->vval.v_number = dict_find(argvars[0].vval.v_dict,
+				      get_tv_string(&argvars[1]), -1) != NULL;
+}
+
+/*
+ * "haslocaldir()" function
+ */
+    static void
+f_haslocaldir(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    rettv->vval.v_number = (curwin->w_localdir != NULL);
+}
+
+/*
+ * "hasmapto()" function
+ */
+    static void
+f_hasmapto(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    char_u	*name;
+    char_u	*mode;
+    char_u	buf[NUMBUFLEN];
+    int		abbr = FALSE;
+
+    name = get_tv_string(&argvars[0]);
+    if (argvars[1].v_type == VAR_UNKNOWN)
+	mode = (char_u *)"nvo";
+    else
+    {
+	mode = get_tv_string_buf(&argvars[1], buf);
+	if (argvars[2].v_type != VAR_UNKNOWN)
+	    abbr = get_tv_number(&argvars[2]);
+    }
+
+    if (map_to_exists(name, mode, abbr))
+	rettv->vval.v_number = TRUE;
+    else
+	rettv->vval.v_number = FALSE;
+}
+
+/*
+ * "histadd()" function
+ */
+    static void
+f_histadd(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+#ifdef FEAT_CMDHIST
+    int		histype;
+    char_u	*str;
+    char_u	buf[NUMBUFLEN];
 #endif
-#ifdef FEAT_XPM_W32
-	"xpm",
-	"xpm_w32",	/* for backward compatibility */
-#else
-# if defined(HAVE_XPM)
-	"xpm",
-# endif
+
+    rettv->vval.v_number = FALSE;
+    if (check_restricted() || check_secure())
+	return;
+#ifdef FEAT_CMDHIST
+    str = get_tv_string_chk(&argvars[0]);	/* NULL on type error */
+    histype = str != NULL ? get_histtype(str) : -1;
+    if (histype >= 0)
+    {
+	str = get_tv_string_buf(&argvars[1], buf);
+	if (*str != NUL)
+	{
+	    init_history();
+	    add_to_history(histype, str, FALSE, NUL);
+	    rettv->vval.v_number = TRUE;
+	    return;
+	}
+    }
 #endif
-#ifdef USE_XSMP
-	"xsmp",
+}
+
+/*
+ * "histdel()" function
+ */
+    static void
+f_histdel(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv UNUSED;
+{
+#ifdef FEAT_CMDHIST
+    int		n;
+    char_u	buf[NUMBUFLEN];
+    char_u	*str;
+
+    str = get_tv_string_chk(&argvars[0]);	/* NULL on type error */
+    if (str == NULL)
+	n = 0;
+    else if (argvars[1].v_type == VAR_UNKNOWN)
+	/* only one argument: clear entire history */
+	n = clr_history(get_histtype(str));
+    else if (argvars[1].v_type == VAR_NUMBER)
+	/* index given: remove that entry */
+	n = del_history_idx(get_histtype(str),
+					  (int)get_tv_number(&argvars[1]));
+    else
+	/* string given: remove all matching entries */
+	n = del_history_entry(get_histtype(str),
+				      get_tv_string_buf(&argvars[1], buf));
+    rettv->vval.v_number = n;
 #endif
-#ifdef USE_XSMP_INTERACT
-	"xsmp_interact",
+}
+
+/*
+ * "histget()" function
+ */
+    static void
+f_histget(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+#ifdef FEAT_CMDHIST
+    int		type;
+    int		idx;
+    char_u	*str;
+
+    str = get_tv_string_chk(&argvars[0]);	/* NULL on type error */
+    if (str == NULL)
+	rettv->vval.v_string = NULL;
+    else
+    {
+	type = get_histtype(str);
+	if (argvars[1].v_type == VAR_UNKNOWN)
+	    idx = get_history_idx(type);
+	else
+	    idx = (int)get_tv_number_chk(&argvars[1], NULL);
+						    /* -1 on type error */
+	rettv->vval.v_string = vim_strsave(get_history_entry(type, idx));
+    }
+#else
+    rettv->vval.v_string = NULL;
 #endif
-#ifdef FEAT_XCLIPBOARD
-	"xterm_clipboard",
+    rettv->v_type = VAR_STRING;
+}
+
+/*
+ * "histnr()" function
+ */
+    static void
+f_histnr(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    int		i;
+
+#ifdef FEAT_CMDHIST
+    char_u	*history = get_tv_string_chk(&argvars[0]);
+
+    i = history == NULL ? HIST_CMD - 1 : get_histtype(history);
+    if (i >= HIST_CMD && i < HIST_COUNT)
+	i = get_history_idx(i);
+    else
 #endif
-#ifdef FEAT_XTERM_SAVE
-	"xterm_save",
+	i = -1;
+    rettv->vval.v_number = i;
+}
+
+/*
+ * "highlightID(name)" function
+ */
+    static void
+f_hlID(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    rettv->vval.v_number = syn_name2id(get_tv_string(&argvars[0]));
+}
+
+/*
+ * "highlight_exists()" function
+ */
+    static void
+f_hlexists(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    rettv->vval.v_number = highlight_exists(get_tv_string(&argvars[0]));
+}
+
+/*
+ * "hostname()" function
+ */
+    static void
+f_hostname(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    char_u hostname[256];
+
+    mch_get_host_name(hostname, 256);
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = vim_strsave(hostname);
+}
+
+/*
+ * iconv() function
+ */
+    static void
+f_iconv(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+#ifdef FEAT_MBYTE
+    char_u	buf1[NUMBUFLEN];
+    char_u	buf2[NUMBUFLEN];
+    char_u	*from, *to, *str;
+    vimconv_T	vimconv;
 #endif
-#if defined(UNIX) && defined(FEAT_X11)
-	"X11",
+
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+
+#ifdef FEAT_MBYTE
+    str = get_tv_string(&argvars[0]);
+    from = enc_canonize(enc_skip(get_tv_string_buf(&argvars[1], buf1)));
+    to = enc_canonize(enc_skip(get_tv_string_buf(&argvars[2], buf2)));
+    vimconv.vc_type = CONV_NONE;
+    convert_setup(&vimconv, from, to);
+
+    /* If the encodings are equal, no conversion needed. */
+    if (vimconv.vc_type == CONV_NONE)
+	rettv->vval.v_string = vim_strsave(str);
+    else
+	rettv->vval.v_string = string_convert(&vimconv, str, NULL);
+
+    convert_setup(&vimconv, NULL, NULL);
+    vim_free(from);
+    vim_free(to);
 #endif
-	NULL
-    };
+}
 
-    name = get_tv_string(&argvars[0]);
-    for (i = 0; has_list[i] != NULL; ++i)
-	if (STRICMP(name, has_list[i]) == 0)
+/*
+ * "indent()" function
+ */
+    static void
+f_indent(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    linenr_T	lnum;
+
+    lnum = get_tv_lnum(argvars);
+    if (lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count)
+	rettv->vval.v_number = get_indent_lnum(lnum);
+    else
+	rettv->vval.v_number = -1;
+}
+
+/*
+ * "index()" function
+ */
+    static void
+f_index(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    list_T	*l;
+    listitem_T	*item;
+    long	idx = 0;
+    int		ic = FALSE;
+
+    rettv->vval.v_number = -1;
+    if (argvars[0].v_type != VAR_LIST)
+    {
+	EMSG(_(e_listreq));
+	return;
+    }
+    l = argvars[0].vval.v_list;
+    if (l != NULL)
+    {
+	item = l->lv_first;
+	if (argvars[2].v_type != VAR_UNKNOWN)
 	{
-	    n = TRUE;
-	    break;
+	    int		error = FALSE;
+
+	    /* Start at specified item.  Use the cached index that list_find()
+	     * sets, so that a negative number also works. */
+	    item = list_find(l, get_tv_number_chk(&argvars[2], &error));
+	    idx = l->lv_idx;
+	    if (argvars[3].v_type != VAR_UNKNOWN)
+		ic = get_tv_number_chk(&argvars[3], &error);
+	    if (error)
+		item = NULL;
 	}
 
-    if (n == FALSE)
+	for ( ; item != NULL; item = item->li_next, ++idx)
+	    if (tv_equal(&item->li_tv, &argvars[1], ic, FALSE))
+	    {
+		rettv->vval.v_number = idx;
+		break;
+	    }
+    }
+}
+
+static int inputsecret_flag = 0;
+
+static void get_user_input __ARGS((typval_T *argvars, typval_T *rettv, int inputdialog));
+
+/*
+ * This function is used by f_input() and f_inputdialog() functions. The third
+ * argument to f_input() specifies the type of completion to use at the
+ * prompt. The third argument to f_inputdialog() specifies the value to return
+ * when the user cancels the prompt.
+ */
+    static void
+get_user_input(argvars, rettv, inputdialog)
+    typval_T	*argvars;
+    typval_T	*rettv;
+    int		inputdialog;
+{
+    char_u	*prompt = get_tv_string_chk(&argvars[0]);
+    char_u	*p = NULL;
+    int		c;
+    char_u	buf[NUMBUFLEN];
+    int		cmd_silent_save = cmd_silent;
+    char_u	*defstr = (char_u *)"";
+    int		xp_type = EXPAND_NOTHING;
+    char_u	*xp_arg = NULL;
+
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+
+#ifdef NO_CONSOLE_INPUT
+    /* While starting up, there is no place to enter text. */
+    if (no_console_input())
+	return;
+#endif
+
+    cmd_silent = FALSE;		/* Want to see the prompt. */
+    if (prompt != NULL)
     {
-	if (STRNICMP(name, "patch", 5) == 0)
+	/* Only the part of the message after the last NL is considered as
+	 * prompt for the command line */
+	p = vim_strrchr(prompt, '\n');
+	if (p == NULL)
+	    p = prompt;
+	else
 	{
-	    if (name[5] == '-'
-		    && STRLEN(name) > 11
-		    && vim_isdigit(name[6])
-		    && vim_isdigit(name[8])
-		    && vim_isdigit(name[10]))
+	    ++p;
+	    c = *p;
+	    *p = NUL;
+	    msg_start();
+	    msg_clr_eos();
+	    msg_puts_attr(prompt, echo_attr);
+	    msg_didout = FALSE;
+	    msg_starthere();
+	    *p = c;
+	}
+	cmdline_row = msg_row;
+
+	if (argvars[1].v_type != VAR_UNKNOWN)
+	{
+	    defstr = get_tv_string_buf_chk(&argvars[1], buf);
+	    if (defstr != NULL)
+		stuffReadbuffSpec(defstr);
+
+	    if (!inputdialog && argvars[2].v_type != VAR_UNKNOWN)
 	    {
-		int major = atoi((char *)name + 6);
-		int minor = atoi((char *)name + 8);
+		char_u	*xp_name;
+		int	xp_namelen;
+		long	argt;
 
-		/* Expect "patch-9.9.01234". */
-		n = (major < VIM_VERSION_MAJOR
-		     || (major == VIM_VERSION_MAJOR
-			 && (minor < VIM_VERSION_MINOR
-			     || (minor == VIM_VERSION_MINOR
-				 && has_patch(atoi((char *)name + 10))))));
+		/* input() with a third argument: completion */
+		rettv->vval.v_string = NULL;
+
+		xp_name = get_tv_string_buf_chk(&argvars[2], buf);
+		if (xp_name == NULL)
+		    return;
+
+		xp_namelen = (int)STRLEN(xp_name);
+
+		if (parse_compl_arg(xp_name, xp_namelen, &xp_type, &argt,
+							     &xp_arg) == FAIL)
+		    return;
 	    }
-	    else
-		n = has_patch(atoi((char *)name + 5));
 	}
-	else if (STRICMP(name, "vim_starting") == 0)
-	    n = (starting != 0);
-#ifdef FEAT_MBYTE
-	else if (STRICMP(name, "multi_byte_encoding") == 0)
-	    n = has_mbyte;
-#endif
-#if defined(FEAT_BEVAL) && defined(FEAT_GUI_W32)
-	else if (STRICMP(name, "balloon_multiline") == 0)
-	    n = multiline_balloon_available();
-#endif
-#ifdef DYNAMIC_TCL
-	else if (STRICMP(name, "tcl") == 0)
-	    n = tcl_enabled(FALSE);
-#endif
-#if defined(USE_ICONV) && defined(DYNAMIC_ICONV)
-	else if (STRICMP(name, "iconv") == 0)
-	    n = iconv_enabled(FALSE);
-#endif
-#ifdef DYNAMIC_LUA
-	else if (STRICMP(name, "lua") == 0)
-	    n = lua_enabled(FALSE);
-#endif
-#ifdef DYNAMIC_MZSCHEME
-	else if (STRICMP(name, "mzscheme") == 0)
-	    n = mzscheme_enabled(FALSE);
-#endif
-#ifdef DYNAMIC_RUBY
-	else if (STRICMP(name, "ruby") == 0)
-	    n = ruby_enabled(FALSE);
-#endif
-#ifdef FEAT_PYTHON
-#ifdef DYNAMIC_PYTHON
-	else if (STRICMP(name, "python") == 0)
-	    n = python_enabled(FALSE);
-#endif
-#endif
-#ifdef FEAT_PYTHON3
-#ifdef DYNAMIC_PYTHON3
-	else if (STRICMP(name, "python3") == 0)
-	    n = python3_enabled(FALSE);
-#endif
-#endif
-#ifdef DYNAMIC_PERL
-	else if (STRICMP(name, "perl") == 0)
-	    n = perl_enabled(FALSE);
-#endif
-#ifdef FEAT_GUI
-	else if (STRICMP(name, "gui_running") == 0)
-	    n = (gui.in_use || gui.starting);
-# ifdef FEAT_GUI_W32
-	else if (STRICMP(name, "gui_win32s") == 0)
-	    n = gui_is_win32s();
-# endif
-# ifdef FEAT_BROWSE
-	else if (STRICMP(name, "browse") == 0)
-	    n = gui.in_use;	/* gui_mch_browse() works when GUI is running */
+
+	if (defstr != NULL)
+	{
+# ifdef FEAT_EX_EXTRA
+	    int save_ex_normal_busy = ex_normal_busy;
+	    ex_normal_busy = 0;
 # endif
-#endif
-#ifdef FEAT_SYN_HL
-	else if (STRICMP(name, "syntax_items") == 0)
-	    n = syntax_present(curwin);
-#endif
-#if defined(WIN3264)
-	else if (STRICMP(name, "win95") == 0)
-	    n = mch_windows95();
-#endif
-#ifdef FEAT_NETBEANS_INTG
-	else if (STRICMP(name, "netbeans_enabled") == 0)
-	    n = netbeans_active();
-#endif
+	    rettv->vval.v_string =
+		getcmdline_prompt(inputsecret_flag ? NUL : '@', p, echo_attr,
+				  xp_type, xp_arg);
+# ifdef FEAT_EX_EXTRA
+	    ex_normal_busy = save_ex_normal_busy;
+# endif
+	}
+	if (inputdialog && rettv->vval.v_string == NULL
+		&& argvars[1].v_type != VAR_UNKNOWN
+		&& argvars[2].v_type != VAR_UNKNOWN)
+	    rettv->vval.v_string = vim_strsave(get_tv_string_buf(
+							   &argvars[2], buf));
+
+	vim_free(xp_arg);
+
+	/* since the user typed this, no need to wait for return */
+	need_wait_return = FALSE;
+	msg_didout = FALSE;
     }
+    cmd_silent = cmd_silent_save;
+}
 
-    rettv->vval.v_number = n;
+/*
+ * "input()" function
+ *     Also handles inputsecret() when inputsecret is set.
+ */
+    static void
+f_input(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    get_user_input(argvars, rettv, FALSE);
 }
 
 /*
- * "has_key()" function
+ * "inputdialog()" function
  */
     static void
-f_has_key(argvars, rettv)
+f_inputdialog(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    if (argvars[0].v_type != VAR_DICT)
+#if defined(FEAT_GUI_TEXTDIALOG)
+    /* Use a GUI dialog if the GUI is running and 'c' is not in 'guioptions' */
+    if (gui.in_use && vim_strchr(p_go, GO_CONDIALOG) == NULL)
     {
-	EMSG(_(e_dictreq));
-	return;
+	char_u	*message;
+	char_u	buf[NUMBUFLEN];
+	char_u	*defstr = (char_u *)"";
+
+	message = get_tv_string_chk(&argvars[0]);
+	if (argvars[1].v_type != VAR_UNKNOWN
+		&& (defstr = get_tv_string_buf_chk(&argvars[1], buf)) != NULL)
+	    vim_strncpy(IObuff, defstr, IOSIZE - 1);
+	else
+	    IObuff[0] = NUL;
+	if (message != NULL && defstr != NULL
+		&& do_dialog(VIM_QUESTION, NULL, message,
+			  (char_u *)_("&OK\n&Cancel"), 1, IObuff, FALSE) == 1)
+	    rettv->vval.v_string = vim_strsave(IObuff);
+	else
+	{
+	    if (message != NULL && defstr != NULL
+					&& argvars[1].v_type != VAR_UNKNOWN
+					&& argvars[2].v_type != VAR_UNKNOWN)
+		rettv->vval.v_string = vim_strsave(
+				      get_tv_string_buf(&argvars[2], buf));
+	    else
+		rettv->vval.v_string = NULL;
+	}
+	rettv->v_type = VAR_STRING;
     }
-    if (argvars[0].vval.v_dict == NULL)
+    else
+#endif
+	get_user_input(argvars, rettv, TRUE);
+}
+
+/*
+ * "inputlist()" function
+ */
+    static void
+f_inputlist(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    listitem_T	*li;
+    int		selected;
+    int		mouse_used;
+
+#ifdef NO_CONSOLE_INPUT
+    /* While starting up, there is no place to enter text. */
+    if (no_console_input())
+	return;
+#endif
+    if (argvars[0].v_type != VAR_LIST || argvars[0].vval.v_list == NULL)
+    {
+	EMSG2(_(e_listarg), "inputlist()");
 	return;
+    }
 
-    rettv->vval.v_number = dict_find(argvars[0].vval.v_dict,
-				      get_tv_string(&argvars[1]), -1) != NULL;
+    msg_start();
+    msg_row = Rows - 1;	/* for when 'cmdheight' > 1 */
+    lines_left = Rows;	/* avoid more prompt */
+    msg_scroll = TRUE;
+    msg_clr_eos();
+
+    for (li = argvars[0].vval.v_list->lv_first; li != NULL; li = li->li_next)
+    {
+	msg_puts(get_tv_string(&li->li_tv));
+	msg_putchar('\n');
+    }
+
+    /* Ask for choice. */
+    selected = prompt_for_number(&mouse_used);
+    if (mouse_used)
+	selected -= lines_left;
+
+    rettv->vval.v_number = selected;
 }
 
+
+static garray_T	    ga_userinput = {0, 0, sizeof(tasave_T), 4, NULL};
+
 /*
- * "haslocaldir()" function
+ * "inputrestore()" function
  */
     static void
-f_haslocaldir(argvars, rettv)
+f_inputrestore(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = (curwin->w_localdir != NULL);
+    if (ga_userinput.ga_len > 0)
+    {
+	--ga_userinput.ga_len;
+	restore_typeahead((tasave_T *)(ga_userinput.ga_data)
+						       + ga_userinput.ga_len);
+	/* default return is zero == OK */
+    }
+    else if (p_verbose > 1)
+    {
+	verb_msg((char_u *)_("called inputrestore() more often than inputsave()"));
+	rettv->vval.v_number = 1; /* Failed */
+    }
 }
 
 /*
- * "hasmapto()" function
+ * "inputsave()" function
  */
     static void
-f_hasmapto(argvars, rettv)
-    typval_T	*argvars;
+f_inputsave(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    char_u	*name;
-    char_u	*mode;
-    char_u	buf[NUMBUFLEN];
-    int		abbr = FALSE;
-
-    name = get_tv_string(&argvars[0]);
-    if (argvars[1].v_type == VAR_UNKNOWN)
-	mode = (char_u *)"nvo";
-    else
+    /* Add an entry to the stack of typeahead storage. */
+    if (ga_grow(&ga_userinput, 1) == OK)
     {
-	mode = get_tv_string_buf(&argvars[1], buf);
-	if (argvars[2].v_type != VAR_UNKNOWN)
-	    abbr = get_tv_number(&argvars[2]);
+	save_typeahead((tasave_T *)(ga_userinput.ga_data)
+						       + ga_userinput.ga_len);
+	++ga_userinput.ga_len;
+	/* default return is zero == OK */
     }
-
-    if (map_to_exists(name, mode, abbr))
-	rettv->vval.v_number = TRUE;
     else
-	rettv->vval.v_number = FALSE;
+	rettv->vval.v_number = 1; /* Failed */
 }
 
 /*
- * "histadd()" function
+ * "inputsecret()" function
  */
     static void
-f_histadd(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_inputsecret(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-#ifdef FEAT_CMDHIST
-    int		histype;
-    char_u	*str;
-    char_u	buf[NUMBUFLEN];
-#endif
+    ++cmdline_star;
+    ++inputsecret_flag;
+    f_input(argvars, rettv);
+    --cmdline_star;
+    --inputsecret_flag;
+}
 
-    rettv->vval.v_number = FALSE;
-    if (check_restricted() || check_secure())
-	return;
-#ifdef FEAT_CMDHIST
-    str = get_tv_string_chk(&argvars[0]);	/* NULL on type error */
-    histype = str != NULL ? get_histtype(str) : -1;
-    if (histype >= 0)
+/*
+ * "insert()" function
+ */
+    static void
+f_insert(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    long	before = 0;
+    listitem_T	*item;
+    list_T	*l;
+    int		error = FALSE;
+
+    if (argvars[0].v_type != VAR_LIST)
+	EMSG2(_(e_listarg), "insert()");
+    else if ((l = argvars[0].vval.v_list) != NULL
+	    && !tv_check_lock(l->lv_lock, (char_u *)_("insert() argument")))
     {
-	str = get_tv_string_buf(&argvars[1], buf);
-	if (*str != NUL)
+	if (argvars[2].v_type != VAR_UNKNOWN)
+	    before = get_tv_number_chk(&argvars[2], &error);
+	if (error)
+	    return;		/* type error; errmsg already given */
+
+	if (before == l->lv_len)
+	    item = NULL;
+	else
 	{
-	    init_history();
-	    add_to_history(histype, str, FALSE, NUL);
-	    rettv->vval.v_number = TRUE;
-	    return;
+	    item = list_find(l, before);
+	    if (item == NULL)
+	    {
+		EMSGN(_(e_listidx), before);
+		l = NULL;
+	    }
+	}
+	if (l != NULL)
+	{
+	    list_insert_tv(l, &argvars[1], item);
+	    copy_tv(&argvars[0], rettv);
 	}
     }
-#endif
 }
 
 /*
- * "histdel()" function
+ * "invert(expr)" function
  */
     static void
-f_histdel(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
-{
-#ifdef FEAT_CMDHIST
-    int		n;
-    char_u	buf[NUMBUFLEN];
-    char_u	*str;
-
-    str = get_tv_string_chk(&argvars[0]);	/* NULL on type error */
-    if (str == NULL)
-	n = 0;
-    else if (argvars[1].v_type == VAR_UNKNOWN)
-	/* only one argument: clear entire history */
-	n = clr_history(get_histtype(str));
-    else if (argvars[1].v_type == VAR_NUMBER)
-	/* index given: remove that entry */
-	n = del_history_idx(get_histtype(str),
-					  (int)get_tv_number(&argvars[1]));
-    else
-	/* string given: remove all matching entries */
-	n = del_history_entry(get_histtype(str),
-				      get_tv_string_buf(&argvars[1], buf));
-    rettv->vval.v_number = n;
-#endif
+f_invert(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    rettv->vval.v_number = ~get_tv_number_chk(&argvars[0], NULL);
 }
 
 /*
- * "histget()" function
+ * "isdirectory()" function
  */
     static void
-f_histget(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_isdirectory(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-#ifdef FEAT_CMDHIST
-    int		type;
-    int		idx;
-    char_u	*str;
+    rettv->vval.v_number = mch_isdir(get_tv_string(&argvars[0]));
+}
 
-    str = get_tv_string_chk(&argvars[0]);	/* NULL on type error */
-    if (str == NULL)
-	rettv->vval.v_string = NULL;
-    else
+/*
+ * "islocked()" function
+ */
+    static void
+f_islocked(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    lval_T	lv;
+    char_u	*end;
+    dictitem_T	*di;
+
+    rettv->vval.v_number = -1;
+    end = get_lval(get_tv_string(&argvars[0]), NULL, &lv, FALSE, FALSE,
+					GLV_NO_AUTOLOAD, FNE_CHECK_START);
+    if (end != NULL && lv.ll_name != NULL)
     {
-	type = get_histtype(str);
-	if (argvars[1].v_type == VAR_UNKNOWN)
-	    idx = get_history_idx(type);
+	if (*end != NUL)
+	    EMSG(_(e_trailing));
 	else
-	    idx = (int)get_tv_number_chk(&argvars[1], NULL);
-						    /* -1 on type error */
-	rettv->vval.v_string = vim_strsave(get_history_entry(type, idx));
+	{
+	    if (lv.ll_tv == NULL)
+	    {
+		if (check_changedtick(lv.ll_name))
+		    rettv->vval.v_number = 1;	    /* always locked */
+		else
+		{
+		    di = find_var(lv.ll_name, NULL, TRUE);
+		    if (di != NULL)
+		    {
+			/* Consider a variable locked when:
+			 * 1. the variable itself is locked
+			 * 2. the value of the variable is locked.
+			 * 3. the List or Dict value is locked.
+			 */
+			rettv->vval.v_number = ((di->di_flags & DI_FLAGS_LOCK)
+						  || tv_islocked(&di->di_tv));
+		    }
+		}
+	    }
+	    else if (lv.ll_range)
+		EMSG(_("E786: Range not allowed"));
+	    else if (lv.ll_newkey != NULL)
+		EMSG2(_(e_dictkey), lv.ll_newkey);
+	    else if (lv.ll_list != NULL)
+		/* List item. */
+		rettv->vval.v_number = tv_islocked(&lv.ll_li->li_tv);
+	    else
+		/* Dictionary item. */
+		rettv->vval.v_number = tv_islocked(&lv.ll_di->di_tv);
+	}
     }
-#else
-    rettv->vval.v_string = NULL;
-#endif
-    rettv->v_type = VAR_STRING;
+
+    clear_lval(&lv);
 }
 
+static void dict_list __ARGS((typval_T *argvars, typval_T *rettv, int what));
+
 /*
- * "histnr()" function
+ * Turn a dict into a list:
+ * "what" == 0: list of keys
+ * "what" == 1: list of values
+ * "what" == 2: list of items
  */
     static void
-f_histnr(argvars, rettv)
-    typval_T	*argvars UNUSED;
+dict_list(argvars, rettv, what)
+    typval_T	*argvars;
     typval_T	*rettv;
+    int		what;
 {
-    int		i;
+    list_T	*l2;
+    dictitem_T	*di;
+    hashitem_T	*hi;
+    listitem_T	*li;
+    listitem_T	*li2;
+    dict_T	*d;
+    int		todo;
 
-#ifdef FEAT_CMDHIST
-    char_u	*history = get_tv_string_chk(&argvars[0]);
+    if (argvars[0].v_type != VAR_DICT)
+    {
+	EMSG(_(e_dictreq));
+	return;
+    }
+    if ((d = argvars[0].vval.v_dict) == NULL)
+	return;
 
-    i = history == NULL ? HIST_CMD - 1 : get_histtype(history);
-    if (i >= HIST_CMD && i < HIST_COUNT)
-	i = get_history_idx(i);
-    else
-#endif
-	i = -1;
-    rettv->vval.v_number = i;
+    if (rettv_list_alloc(rettv) == FAIL)
+	return;
+
+    todo = (int)d->dv_hashtab.ht_used;
+    for (hi = d->dv_hashtab.ht_array; todo > 0; ++hi)
+    {
+	if (!HASHITEM_EMPTY(hi))
+	{
+	    --todo;
+	    di = HI2DI(hi);
+
+	    li = listitem_alloc();
+	    if (li == NULL)
+		break;
+	    list_append(rettv->vval.v_list, li);
+
+	    if (what == 0)
+	    {
+		/* keys() */
+		li->li_tv.v_type = VAR_STRING;
+		li->li_tv.v_lock = 0;
+		li->li_tv.vval.v_string = vim_strsave(di->di_key);
+	    }
+	    else if (what == 1)
+	    {
+		/* values() */
+		copy_tv(&di->di_tv, &li->li_tv);
+	    }
+	    else
+	    {
+		/* items() */
+		l2 = list_alloc();
+		li->li_tv.v_type = VAR_LIST;
+		li->li_tv.v_lock = 0;
+		li->li_tv.vval.v_list = l2;
+		if (l2 == NULL)
+		    break;
+		++l2->lv_refcount;
+
+		li2 = listitem_alloc();
+		if (li2 == NULL)
+		    break;
+		list_append(l2, li2);
+		li2->li_tv.v_type = VAR_STRING;
+		li2->li_tv.v_lock = 0;
+		li2->li_tv.vval.v_string = vim_strsave(di->di_key);
+
+		li2 = listitem_alloc();
+		if (li2 == NULL)
+		    break;
+		list_append(l2, li2);
+		copy_tv(&di->di_tv, &li2->li_tv);
+	    }
+	}
+    }
 }
 
 /*
- * "highlightID(name)" function
+ * "items(dict)" function
  */
     static void
-f_hlID(argvars, rettv)
+f_items(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = syn_name2id(get_tv_string(&argvars[0]));
+    dict_list(argvars, rettv, 2);
 }
 
 /*
- * "highlight_exists()" function
+ * "join()" function
  */
     static void
-f_hlexists(argvars, rettv)
+f_join(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = highlight_exists(get_tv_string(&argvars[0]));
+    garray_T	ga;
+    char_u	*sep;
+
+    if (argvars[0].v_type != VAR_LIST)
+    {
+	EMSG(_(e_listreq));
+	return;
+    }
+    if (argvars[0].vval.v_list == NULL)
+	return;
+    if (argvars[1].v_type == VAR_UNKNOWN)
+	sep = (char_u *)" ";
+    else
+	sep = get_tv_string_chk(&argvars[1]);
+
+    rettv->v_type = VAR_STRING;
+
+    if (sep != NULL)
+    {
+	ga_init2(&ga, (int)sizeof(char), 80);
+	list_join(&ga, argvars[0].vval.v_list, sep, TRUE, 0);
+	ga_append(&ga, NUL);
+	rettv->vval.v_string = (char_u *)ga.ga_data;
+    }
+    else
+	rettv->vval.v_string = NULL;
 }
 
 /*
- * "hostname()" function
+ * "json_decode()" function
  */
     static void
-f_hostname(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_json_decode(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u hostname[256];
+    jsread_T	reader;
 
-    mch_get_host_name(hostname, 256);
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = vim_strsave(hostname);
+    reader.js_buf = get_tv_string(&argvars[0]);
+    reader.js_used = 0;
+    reader.js_len = (int)STRLEN(reader.js_buf);
+    reader.js_fd = NULL;
+    json_decode(&reader, rettv);
 }
 
 /*
- * iconv() function
+ * "json_decodefile()" function
  */
     static void
-f_iconv(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_json_decodefile(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-#ifdef FEAT_MBYTE
-    char_u	buf1[NUMBUFLEN];
-    char_u	buf2[NUMBUFLEN];
-    char_u	*from, *to, *str;
-    vimconv_T	vimconv;
-#endif
-
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
-
-#ifdef FEAT_MBYTE
-    str = get_tv_string(&argvars[0]);
-    from = enc_canonize(enc_skip(get_tv_string_buf(&argvars[1], buf1)));
-    to = enc_canonize(enc_skip(get_tv_string_buf(&argvars[2], buf2)));
-    vimconv.vc_type = CONV_NONE;
-    convert_setup(&vimconv, from, to);
+    jsread_T	reader;
+    char_u	*fname;
+    FILE	*fd;
 
-    /* If the encodings are equal, no conversion needed. */
-    if (vimconv.vc_type == CONV_NONE)
-	rettv->vval.v_string = vim_strsave(str);
-    else
-	rettv->vval.v_string = string_convert(&vimconv, str, NULL);
+    /* Always open the file in binary mode, the text is read in chunks. */
+    fname = get_tv_string(&argvars[0]);
+    if (*fname == NUL || (fd = mch_fopen((char *)fname, READBIN)) == NULL)
+    {
+	EMSG2(_(e_notopen), *fname == NUL ? (char_u *)_("<empty>") : fname);
+	return;
+    }
+    reader.js_buf = alloc(JSON_BUFSIZE + 1);
+    if (reader.js_buf != NULL)
+    {
+	reader.js_buf[0] = NUL;
+	reader.js_used = 0;
+	reader.js_len = 0;
+	reader.js_fd = fd;
 
-    convert_setup(&vimconv, NULL, NULL);
-    vim_free(from);
-    vim_free(to);
-#endif
+	/* Skip a UTF-8 byte order mark. */
+	json_fill(&reader, 3);
+	if (STRNCMP(reader.js_buf, "\357\273\277", 3) == 0)
+	    reader.js_used = 3;
+	json_decode(&reader, rettv);
+	vim_free(reader.js_buf);
+    }
+    fclose(fd);
 }
 
 /*
- * "indent()" function
+ * "json_encode()" function
  */
     static void
-f_indent(argvars, rettv)
+f_json_encode(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    linenr_T	lnum;
+    garray_T	ga;
 
-    lnum = get_tv_lnum(argvars);
-    if (lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count)
-	rettv->vval.v_number = get_indent_lnum(lnum);
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+    ga_init2(&ga, (int)sizeof(char), 80);
+    if (json_encode_item(&ga, &argvars[0], 0) == OK)
+    {
+	ga_append(&ga, NUL);
+	rettv->vval.v_string = (char_u *)ga.ga_data;
+    }
     else
-	rettv->vval.v_number = -1;
+	ga_clear(&ga);
 }
 
 /*
- * "index()" function
+ * "keys()" function
  */
     static void
-f_index(argvars, rettv)
+f_keys(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    list_T	*l;
-    listitem_T	*item;
-    long	idx = 0;
-    int		ic = FALSE;
+    dict_list(argvars, rettv, 0);
+}
 
-    rettv->vval.v_number = -1;
-    if (argvars[0].v_type != VAR_LIST)
-    {
-	EMSG(_(e_listreq));
-	return;
-    }
-    l = argvars[0].vval.v_list;
-    if (l != NULL)
-    {
-	item = l->lv_first;
-	if (argvars[2].v_type != VAR_UNKNOWN)
-	{
-	    int		error = FALSE;
+/*
+ * "last_buffer_nr()" function.
+ */
+    static void
+f_last_buffer_nr(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    int		n = 0;
+    buf_T	*buf;
 
-	    /* Start at specified item.  Use the cached index that list_find()
-	     * sets, so that a negative number also works. */
-	    item = list_find(l, get_tv_number_chk(&argvars[2], &error));
-	    idx = l->lv_idx;
-	    if (argvars[3].v_type != VAR_UNKNOWN)
-		ic = get_tv_number_chk(&argvars[3], &error);
-	    if (error)
-		item = NULL;
-	}
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+	if (n < buf->b_fnum)
+	    n = buf->b_fnum;
 
-	for ( ; item != NULL; item = item->li_next, ++idx)
-	    if (tv_equal(&item->li_tv, &argvars[1], ic, FALSE))
-	    {
-		rettv->vval.v_number = idx;
-		break;
-	    }
-    }
+    rettv->vval.v_number = n;
 }
 
-static int inputsecret_flag = 0;
-
-static void get_user_input __ARGS((typval_T *argvars, typval_T *rettv, int inputdialog));
-
 /*
- * This function is used by f_input() and f_inputdialog() functions. The third
- * argument to f_input() specifies the type of completion to use at the
- * prompt. The third argument to f_inputdialog() specifies the value to return
- * when the user cancels the prompt.
+ * "len()" function
  */
     static void
-get_user_input(argvars, rettv, inputdialog)
+f_len(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
-    int		inputdialog;
 {
-    char_u	*prompt = get_tv_string_chk(&argvars[0]);
-    char_u	*p = NULL;
-    int		c;
-    char_u	buf[NUMBUFLEN];
-    int		cmd_silent_save = cmd_silent;
-    char_u	*defstr = (char_u *)"";
-    int		xp_type = EXPAND_NOTHING;
-    char_u	*xp_arg = NULL;
-
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
-
-#ifdef NO_CONSOLE_INPUT
-    /* While starting up, there is no place to enter text. */
-    if (no_console_input())
-	return;
-#endif
-
-    cmd_silent = FALSE;		/* Want to see the prompt. */
-    if (prompt != NULL)
+    switch (argvars[0].v_type)
     {
-	/* Only the part of the message after the last NL is considered as
-	 * prompt for the command line */
-	p = vim_strrchr(prompt, '\n');
-	if (p == NULL)
-	    p = prompt;
-	else
-	{
-	    ++p;
-	    c = *p;
-	    *p = NUL;
-	    msg_start();
-	    msg_clr_eos();
-	    msg_puts_attr(prompt, echo_attr);
-	    msg_didout = FALSE;
-	    msg_starthere();
-	    *p = c;
-	}
-	cmdline_row = msg_row;
-
-	if (argvars[1].v_type != VAR_UNKNOWN)
-	{
-	    defstr = get_tv_string_buf_chk(&argvars[1], buf);
-	    if (defstr != NULL)
-		stuffReadbuffSpec(defstr);
-
-	    if (!inputdialog && argvars[2].v_type != VAR_UNKNOWN)
-	    {
-		char_u	*xp_name;
-		int	xp_namelen;
-		long	argt;
+	case VAR_STRING:
+	case VAR_NUMBER:
+	    rettv->vval.v_number = (varnumber_T)STRLEN(
+					       get_tv_string(&argvars[0]));
+	    break;
+	case VAR_LIST:
+	    rettv->vval.v_number = list_len(argvars[0].vval.v_list);
+	    break;
+	case VAR_DICT:
+	    rettv->vval.v_number = dict_len(argvars[0].vval.v_dict);
+	    break;
+	default:
+	    EMSG(_("E701: Invalid type for len()"));
+	    break;
+    }
+}
 
-		/* input() with a third argument: completion */
-		rettv->vval.v_string = NULL;
+static void libcall_common __ARGS((typval_T *argvars, typval_T *rettv, int type));
 
-		xp_name = get_tv_string_buf_chk(&argvars[2], buf);
-		if (xp_name == NULL)
-		    return;
+    static void
+libcall_common(argvars, rettv, type)
+    typval_T	*argvars;
+    typval_T	*rettv;
+    int		type;
+{
+#ifdef FEAT_LIBCALL
+    char_u		*string_in;
+    char_u		**string_result;
+    int			nr_result;
+#endif
 
-		xp_namelen = (int)STRLEN(xp_name);
+    rettv->v_type = type;
+    if (type != VAR_NUMBER)
+	rettv->vval.v_string = NULL;
 
-		if (parse_compl_arg(xp_name, xp_namelen, &xp_type, &argt,
-							     &xp_arg) == FAIL)
-		    return;
-	    }
-	}
+    if (check_restricted() || check_secure())
+	return;
 
-	if (defstr != NULL)
-	{
-# ifdef FEAT_EX_EXTRA
-	    int save_ex_normal_busy = ex_normal_busy;
-	    ex_normal_busy = 0;
-# endif
-	    rettv->vval.v_string =
-		getcmdline_prompt(inputsecret_flag ? NUL : '@', p, echo_attr,
-				  xp_type, xp_arg);
-# ifdef FEAT_EX_EXTRA
-	    ex_normal_busy = save_ex_normal_busy;
-# endif
-	}
-	if (inputdialog && rettv->vval.v_string == NULL
-		&& argvars[1].v_type != VAR_UNKNOWN
-		&& argvars[2].v_type != VAR_UNKNOWN)
-	    rettv->vval.v_string = vim_strsave(get_tv_string_buf(
-							   &argvars[2], buf));
+#ifdef FEAT_LIBCALL
+    /* The first two args must be strings, otherwise its meaningless */
+    if (argvars[0].v_type == VAR_STRING && argvars[1].v_type == VAR_STRING)
+    {
+	string_in = NULL;
+	if (argvars[2].v_type == VAR_STRING)
+	    string_in = argvars[2].vval.v_string;
+	if (type == VAR_NUMBER)
+	    string_result = NULL;
+	else
+	    string_result = &rettv->vval.v_string;
+	if (mch_libcall(argvars[0].vval.v_string,
+			     argvars[1].vval.v_string,
+			     string_in,
+			     argvars[2].vval.v_number,
+			     string_result,
+			     &nr_result) == OK
+		&& type == VAR_NUMBER)
+	    rettv->vval.v_number = nr_result;
+    }
+#endif
+}
 
-	vim_free(xp_arg);
+/*
+ * "libcall()" function
+ */
+    static void
+f_libcall(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    libcall_common(argvars, rettv, VAR_STRING);
+}
 
-	/* since the user typed this, no need to wait for return */
-	need_wait_return = FALSE;
-	msg_didout = FALSE;
-    }
-    cmd_silent = cmd_silent_save;
+/*
+ * "libcallnr()" function
+ */
+    static void
+f_libcallnr(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    libcall_common(argvars, rettv, VAR_NUMBER);
 }
 
 /*
- * "input()" function
- *     Also handles inputsecret() when inputsecret is set.
+ * "line(string)" function
  */
     static void
-f_input(argvars, rettv)
+f_line(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    get_user_input(argvars, rettv, FALSE);
+    linenr_T	lnum = 0;
+    pos_T	*fp;
+    int		fnum;
+
+    fp = var2fpos(&argvars[0], TRUE, &fnum);
+    if (fp != NULL)
+	lnum = fp->lnum;
+    rettv->vval.v_number = lnum;
 }
 
 /*
- * "inputdialog()" function
+ * "line2byte(lnum)" function
  */
     static void
-f_inputdialog(argvars, rettv)
-    typval_T	*argvars;
+f_line2byte(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-#if defined(FEAT_GUI_TEXTDIALOG)
-    /* Use a GUI dialog if the GUI is running and 'c' is not in 'guioptions' */
-    if (gui.in_use && vim_strchr(p_go, GO_CONDIALOG) == NULL)
-    {
-	char_u	*message;
-	char_u	buf[NUMBUFLEN];
-	char_u	*defstr = (char_u *)"";
+#ifndef FEAT_BYTEOFF
+    rettv->vval.v_number = -1;
+#else
+    linenr_T	lnum;
 
-	message = get_tv_string_chk(&argvars[0]);
-	if (argvars[1].v_type != VAR_UNKNOWN
-		&& (defstr = get_tv_string_buf_chk(&argvars[1], buf)) != NULL)
-	    vim_strncpy(IObuff, defstr, IOSIZE - 1);
-	else
-	    IObuff[0] = NUL;
-	if (message != NULL && defstr != NULL
-		&& do_dialog(VIM_QUESTION, NULL, message,
-			  (char_u *)_("&OK\n&Cancel"), 1, IObuff, FALSE) == 1)
-	    rettv->vval.v_string = vim_strsave(IObuff);
-	else
-	{
-	    if (message != NULL && defstr != NULL
-					&& argvars[1].v_type != VAR_UNKNOWN
-					&& argvars[2].v_type != VAR_UNKNOWN)
-		rettv->vval.v_string = vim_strsave(
-				      get_tv_string_buf(&argvars[2], buf));
-	    else
-		rettv->vval.v_string = NULL;
-	}
-	rettv->v_type = VAR_STRING;
-    }
+    lnum = get_tv_lnum(argvars);
+    if (lnum < 1 || lnum > curbuf->b_ml.ml_line_count + 1)
+	rettv->vval.v_number = -1;
     else
+	rettv->vval.v_number = ml_find_line_or_offset(curbuf, lnum, NULL);
+    if (rettv->vval.v_number >= 0)
+	++rettv->vval.v_number;
 #endif
-	get_user_input(argvars, rettv, TRUE);
 }
 
 /*
- * "inputlist()" function
+ * "lispindent(lnum)" function
  */
     static void
-f_inputlist(argvars, rettv)
-    typval_T	*argvars;
+f_lispindent(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    listitem_T	*li;
-    int		selected;
-    int		mouse_used;
-
-#ifdef NO_CONSOLE_INPUT
-    /* While starting up, there is no place to enter text. */
-    if (no_console_input())
-	return;
-#endif
-    if (argvars[0].v_type != VAR_LIST || argvars[0].vval.v_list == NULL)
-    {
-	EMSG2(_(e_listarg), "inputlist()");
-	return;
-    }
-
-    msg_start();
-    msg_row = Rows - 1;	/* for when 'cmdheight' > 1 */
-    lines_left = Rows;	/* avoid more prompt */
-    msg_scroll = TRUE;
-    msg_clr_eos();
+#ifdef FEAT_LISP
+    pos_T	pos;
+    linenr_T	lnum;
 
-    for (li = argvars[0].vval.v_list->lv_first; li != NULL; li = li->li_next)
+    pos = curwin->w_cursor;
+    lnum = get_tv_lnum(argvars);
+    if (lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count)
     {
-	msg_puts(get_tv_string(&li->li_tv));
-	msg_putchar('\n');
+	curwin->w_cursor.lnum = lnum;
+	rettv->vval.v_number = get_lisp_indent();
+	curwin->w_cursor = pos;
     }
-
-    /* Ask for choice. */
-    selected = prompt_for_number(&mouse_used);
-    if (mouse_used)
-	selected -= lines_left;
-
-    rettv->vval.v_number = selected;
+    else
+#endif
+	rettv->vval.v_number = -1;
 }
 
-
-static garray_T	    ga_userinput = {0, 0, sizeof(tasave_T), 4, NULL};
-
 /*
- * "inputrestore()" function
+ * "localtime()" function
  */
     static void
-f_inputrestore(argvars, rettv)
+f_localtime(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    if (ga_userinput.ga_len > 0)
-    {
-	--ga_userinput.ga_len;
-	restore_typeahead((tasave_T *)(ga_userinput.ga_data)
-						       + ga_userinput.ga_len);
-	/* default return is zero == OK */
-    }
-    else if (p_verbose > 1)
-    {
-	verb_msg((char_u *)_("called inputrestore() more often than inputsave()"));
-	rettv->vval.v_number = 1; /* Failed */
-    }
+    rettv->vval.v_number = (varnumber_T)time(NULL);
 }
 
-/*
- * "inputsave()" function
- */
+static void get_maparg __ARGS((typval_T *argvars, typval_T *rettv, int exact));
+
     static void
-f_inputsave(argvars, rettv)
-    typval_T	*argvars UNUSED;
+get_maparg(argvars, rettv, exact)
+    typval_T	*argvars;
     typval_T	*rettv;
+    int		exact;
 {
-    /* Add an entry to the stack of typeahead storage. */
-    if (ga_grow(&ga_userinput, 1) == OK)
+    char_u	*keys;
+    char_u	*which;
+    char_u	buf[NUMBUFLEN];
+    char_u	*keys_buf = NULL;
+    char_u	*rhs;
+    int		mode;
+    int		abbr = FALSE;
+    int		get_dict = FALSE;
+    mapblock_T	*mp;
+    int		buffer_local;
+
+    /* return empty string for failure */
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+
+    keys = get_tv_string(&argvars[0]);
+    if (*keys == NUL)
+	return;
+
+    if (argvars[1].v_type != VAR_UNKNOWN)
     {
-	save_typeahead((tasave_T *)(ga_userinput.ga_data)
-						       + ga_userinput.ga_len);
-	++ga_userinput.ga_len;
-	/* default return is zero == OK */
+	which = get_tv_string_buf_chk(&argvars[1], buf);
+	if (argvars[2].v_type != VAR_UNKNOWN)
+	{
+	    abbr = get_tv_number(&argvars[2]);
+	    if (argvars[3].v_type != VAR_UNKNOWN)
+		get_dict = get_tv_number(&argvars[3]);
+	}
     }
     else
-	rettv->vval.v_number = 1; /* Failed */
+	which = (char_u *)"";
+    if (which == NULL)
+	return;
+
+    mode = get_map_mode(&which, 0);
+
+    keys = replace_termcodes(keys, &keys_buf, TRUE, TRUE, FALSE);
+    rhs = check_map(keys, mode, exact, FALSE, abbr, &mp, &buffer_local);
+    vim_free(keys_buf);
+
+    if (!get_dict)
+    {
+	/* Return a string. */
+	if (rhs != NULL)
+	    rettv->vval.v_string = str2special_save(rhs, FALSE);
+
+    }
+    else if (rettv_dict_alloc(rettv) != FAIL && rhs != NULL)
+    {
+	/* Return a dictionary. */
+	char_u	    *lhs = str2special_save(mp->m_keys, TRUE);
+	char_u	    *mapmode = map_mode_to_chars(mp->m_mode);
+	dict_T	    *dict = rettv->vval.v_dict;
+
+	dict_add_nr_str(dict, "lhs",	 0L, lhs);
+	dict_add_nr_str(dict, "rhs",     0L, mp->m_orig_str);
+	dict_add_nr_str(dict, "noremap", mp->m_noremap ? 1L : 0L , NULL);
+	dict_add_nr_str(dict, "expr",    mp->m_expr    ? 1L : 0L, NULL);
+	dict_add_nr_str(dict, "silent",  mp->m_silent  ? 1L : 0L, NULL);
+	dict_add_nr_str(dict, "sid",     (long)mp->m_script_ID, NULL);
+	dict_add_nr_str(dict, "buffer",  (long)buffer_local, NULL);
+	dict_add_nr_str(dict, "nowait",  mp->m_nowait  ? 1L : 0L, NULL);
+	dict_add_nr_str(dict, "mode",    0L, mapmode);
+
+	vim_free(lhs);
+	vim_free(mapmode);
+    }
 }
 
+#ifdef FEAT_FLOAT
 /*
- * "inputsecret()" function
+ * "log()" function
  */
     static void
-f_inputsecret(argvars, rettv)
+f_log(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    ++cmdline_star;
-    ++inputsecret_flag;
-    f_input(argvars, rettv);
-    --cmdline_star;
-    --inputsecret_flag;
+    float_T	f;
+
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	rettv->vval.v_float = log(f);
+    else
+	rettv->vval.v_float = 0.0;
 }
 
 /*
- * "insert()" function
+ * "log10()" function
  */
     static void
-f_insert(argvars, rettv)
+f_log10(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    long	before = 0;
-    listitem_T	*item;
-    list_T	*l;
-    int		error = FALSE;
+    float_T	f;
 
-    if (argvars[0].v_type != VAR_LIST)
-	EMSG2(_(e_listarg), "insert()");
-    else if ((l = argvars[0].vval.v_list) != NULL
-	    && !tv_check_lock(l->lv_lock, (char_u *)_("insert() argument")))
-    {
-	if (argvars[2].v_type != VAR_UNKNOWN)
-	    before = get_tv_number_chk(&argvars[2], &error);
-	if (error)
-	    return;		/* type error; errmsg already given */
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	rettv->vval.v_float = log10(f);
+    else
+	rettv->vval.v_float = 0.0;
+}
+#endif
 
-	if (before == l->lv_len)
-	    item = NULL;
-	else
-	{
-	    item = list_find(l, before);
-	    if (item == NULL)
-	    {
-		EMSGN(_(e_listidx), before);
-		l = NULL;
-	    }
-	}
-	if (l != NULL)
-	{
-	    list_insert_tv(l, &argvars[1], item);
-	    copy_tv(&argvars[0], rettv);
-	}
-    }
+#ifdef FEAT_LUA
+/*
+ * "luaeval()" function
+ */
+    static void
+f_luaeval(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    char_u	*str;
+    char_u	buf[NUMBUFLEN];
+
+    str = get_tv_string_buf(&argvars[0], buf);
+    do_luaeval(str, argvars + 1, rettv);
 }
+#endif
 
 /*
- * "invert(expr)" function
+ * "map()" function
  */
     static void
-f_invert(argvars, rettv)
+f_map(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = ~get_tv_number_chk(&argvars[0], NULL);
+    filter_map(argvars, rettv, TRUE);
 }
 
 /*
- * "isdirectory()" function
+ * "maparg()" function
  */
     static void
-f_isdirectory(argvars, rettv)
+f_maparg(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = mch_isdir(get_tv_string(&argvars[0]));
+    get_maparg(argvars, rettv, TRUE);
 }
 
 /*
- * "islocked()" function
+ * "mapcheck()" function
  */
     static void
-f_islocked(argvars, rettv)
+f_mapcheck(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    lval_T	lv;
-    char_u	*end;
-    dictitem_T	*di;
+    get_maparg(argvars, rettv, FALSE);
+}
+
+static void find_some_match __ARGS((typval_T *argvars, typval_T *rettv, int start));
+
+    static void
+find_some_match(argvars, rettv, type)
+    typval_T	*argvars;
+    typval_T	*rettv;
+    int		type;
+{
+    char_u	*str = NULL;
+    long	len = 0;
+    char_u	*expr = NULL;
+    char_u	*pat;
+    regmatch_T	regmatch;
+    char_u	patbuf[NUMBUFLEN];
+    char_u	strbuf[NUMBUFLEN];
+    char_u	*save_cpo;
+    long	start = 0;
+    long	nth = 1;
+    colnr_T	startcol = 0;
+    int		match = 0;
+    list_T	*l = NULL;
+    listitem_T	*li = NULL;
+    long	idx = 0;
+    char_u	*tofree = NULL;
+
+    /* Make 'cpoptions' empty, the 'l' flag should not be used here. */
+    save_cpo = p_cpo;
+    p_cpo = (char_u *)"";
 
     rettv->vval.v_number = -1;
-    end = get_lval(get_tv_string(&argvars[0]), NULL, &lv, FALSE, FALSE,
-					GLV_NO_AUTOLOAD, FNE_CHECK_START);
-    if (end != NULL && lv.ll_name != NULL)
+    if (type == 3)
     {
-	if (*end != NUL)
-	    EMSG(_(e_trailing));
+	/* return empty list when there are no matches */
+	if (rettv_list_alloc(rettv) == FAIL)
+	    goto theend;
+    }
+    else if (type == 2)
+    {
+	rettv->v_type = VAR_STRING;
+	rettv->vval.v_string = NULL;
+    }
+
+    if (argvars[0].v_type == VAR_LIST)
+    {
+	if ((l = argvars[0].vval.v_list) == NULL)
+	    goto theend;
+	li = l->lv_first;
+    }
+    else
+    {
+	expr = str = get_tv_string(&argvars[0]);
+	len = (long)STRLEN(str);
+    }
+
+    pat = get_tv_string_buf_chk(&argvars[1], patbuf);
+    if (pat == NULL)
+	goto theend;
+
+    if (argvars[2].v_type != VAR_UNKNOWN)
+    {
+	int	    error = FALSE;
+
+	start = get_tv_number_chk(&argvars[2], &error);
+	if (error)
+	    goto theend;
+	if (l != NULL)
+	{
+	    li = list_find(l, start);
+	    if (li == NULL)
+		goto theend;
+	    idx = l->lv_idx;	/* use the cached index */
+	}
 	else
 	{
-	    if (lv.ll_tv == NULL)
+	    if (start < 0)
+		start = 0;
+	    if (start > len)
+		goto theend;
+	    /* When "count" argument is there ignore matches before "start",
+	     * otherwise skip part of the string.  Differs when pattern is "^"
+	     * or "\<". */
+	    if (argvars[3].v_type != VAR_UNKNOWN)
+		startcol = start;
+	    else
 	    {
-		if (check_changedtick(lv.ll_name))
-		    rettv->vval.v_number = 1;	    /* always locked */
-		else
+		str += start;
+		len -= start;
+	    }
+	}
+
+	if (argvars[3].v_type != VAR_UNKNOWN)
+	    nth = get_tv_number_chk(&argvars[3], &error);
+	if (error)
+	    goto theend;
+    }
+
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    if (regmatch.regprog != NULL)
+    {
+	regmatch.rm_ic = p_ic;
+
+	for (;;)
+	{
+	    if (l != NULL)
+	    {
+		if (li == NULL)
 		{
-		    di = find_var(lv.ll_name, NULL, TRUE);
-		    if (di != NULL)
+		    match = FALSE;
+		    break;
+		}
+		vim_free(tofree);
+		str = echo_string(&li->li_tv, &tofree, strbuf, 0);
+		if (str == NULL)
+		    break;
+	    }
+
+	    match = vim_regexec_nl(&regmatch, str, (colnr_T)startcol);
+
+	    if (match && --nth <= 0)
+		break;
+	    if (l == NULL && !match)
+		break;
+
+	    /* Advance to just after the match. */
+	    if (l != NULL)
+	    {
+		li = li->li_next;
+		++idx;
+	    }
+	    else
+	    {
+#ifdef FEAT_MBYTE
+		startcol = (colnr_T)(regmatch.startp[0]
+				    + (*mb_ptr2len)(regmatch.startp[0]) - str);
+#else
+		startcol = (colnr_T)(regmatch.startp[0] + 1 - str);
+#endif
+		if (startcol > (colnr_T)len
+				      || str + startcol <= regmatch.startp[0])
+		{
+		    match = FALSE;
+		    break;
+		}
+	    }
+	}
+
+	if (match)
+	{
+	    if (type == 3)
+	    {
+		int i;
+
+		/* return list with matched string and submatches */
+		for (i = 0; i < NSUBEXP; ++i)
+		{
+		    if (regmatch.endp[i] == NULL)
 		    {
-			/* Consider a variable locked when:
-			 * 1. the variable itself is locked
-			 * 2. the value of the variable is locked.
-			 * 3. the List or Dict value is locked.
-			 */
-			rettv->vval.v_number = ((di->di_flags & DI_FLAGS_LOCK)
-						  || tv_islocked(&di->di_tv));
+			if (list_append_string(rettv->vval.v_list,
+						     (char_u *)"", 0) == FAIL)
+			    break;
 		    }
+		    else if (list_append_string(rettv->vval.v_list,
+				regmatch.startp[i],
+				(int)(regmatch.endp[i] - regmatch.startp[i]))
+			    == FAIL)
+			break;
 		}
 	    }
-	    else if (lv.ll_range)
-		EMSG(_("E786: Range not allowed"));
-	    else if (lv.ll_newkey != NULL)
-		EMSG2(_(e_dictkey), lv.ll_newkey);
-	    else if (lv.ll_list != NULL)
-		/* List item. */
-		rettv->vval.v_number = tv_islocked(&lv.ll_li->li_tv);
+	    else if (type == 2)
+	    {
+		/* return matched string */
+		if (l != NULL)
+		    copy_tv(&li->li_tv, rettv);
+		else
+		    rettv->vval.v_string = vim_strnsave(regmatch.startp[0],
+				(int)(regmatch.endp[0] - regmatch.startp[0]));
+	    }
+	    else if (l != NULL)
+		rettv->vval.v_number = idx;
 	    else
-		/* Dictionary item. */
-		rettv->vval.v_number = tv_islocked(&lv.ll_di->di_tv);
+	    {
+		if (type != 0)
+		    rettv->vval.v_number =
+				      (varnumber_T)(regmatch.startp[0] - str);
+		else
+		    rettv->vval.v_number =
+					(varnumber_T)(regmatch.endp[0] - str);
+		rettv->vval.v_number += (varnumber_T)(str - expr);
+	    }
 	}
+	vim_regfree(regmatch.regprog);
     }
 
-    clear_lval(&lv);
+theend:
+    vim_free(tofree);
+    p_cpo = save_cpo;
+}
+
+/*
+ * "match()" function
+ */
+    static void
+f_match(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    find_some_match(argvars, rettv, 1);
 }
 
-static void dict_list __ARGS((typval_T *argvars, typval_T *rettv, int what));
-
 /*
- * Turn a dict into a list:
- * "what" == 0: list of keys
- * "what" == 1: list of values
- * "what" == 2: list of items
+ * "matchadd()" function
  */
     static void
-dict_list(argvars, rettv, what)
-    typval_T	*argvars;
-    typval_T	*rettv;
-    int		what;
+f_matchadd(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv UNUSED;
 {
-    list_T	*l2;
-    dictitem_T	*di;
-    hashitem_T	*hi;
-    listitem_T	*li;
-    listitem_T	*li2;
-    dict_T	*d;
-    int		todo;
+#ifdef FEAT_SEARCH_EXTRA
+    char_u	buf[NUMBUFLEN];
+    char_u	*grp = get_tv_string_buf_chk(&argvars[0], buf);	/* group */
+    char_u	*pat = get_tv_string_buf_chk(&argvars[1], buf);	/* pattern */
+    int		prio = 10;	/* default priority */
+    int		id = -1;
+    int		error = FALSE;
 
-    if (argvars[0].v_type != VAR_DICT)
-    {
-	EMSG(_(e_dictreq));
+    rettv->vval.v_number = -1;
+
+    if (grp == NULL || pat == NULL)
 	return;
+    if (argvars[2].v_type != VAR_UNKNOWN)
+    {
+	prio = get_tv_number_chk(&argvars[2], &error);
+	if (argvars[3].v_type != VAR_UNKNOWN)
+	    id = get_tv_number_chk(&argvars[3], &error);
     }
-    if ((d = argvars[0].vval.v_dict) == NULL)
+    if (error == TRUE)
 	return;
-
-    if (rettv_list_alloc(rettv) == FAIL)
+    if (id >= 1 && id <= 3)
+    {
+	EMSGN("E798: ID is reserved for \":match\": %ld", id);
 	return;
+    }
 
-    todo = (int)d->dv_hashtab.ht_used;
-    for (hi = d->dv_hashtab.ht_array; todo > 0; ++hi)
-    {
-	if (!HASHITEM_EMPTY(hi))
-	{
-	    --todo;
-	    di = HI2DI(hi);
+    rettv->vval.v_number = match_add(curwin, grp, pat, prio, id);
+#endif
+}
 
-	    li = listitem_alloc();
-	    if (li == NULL)
-		break;
-	    list_append(rettv->vval.v_list, li);
+/*
+ * "matcharg()" function
+ */
+    static void
+f_matcharg(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    if (rettv_list_alloc(rettv) == OK)
+    {
+#ifdef FEAT_SEARCH_EXTRA
+	int	    id = get_tv_number(&argvars[0]);
+	matchitem_T *m;
 
-	    if (what == 0)
-	    {
-		/* keys() */
-		li->li_tv.v_type = VAR_STRING;
-		li->li_tv.v_lock = 0;
-		li->li_tv.vval.v_string = vim_strsave(di->di_key);
-	    }
-	    else if (what == 1)
+	if (id >= 1 && id <= 3)
+	{
+	    if ((m = (matchitem_T *)get_match(curwin, id)) != NULL)
 	    {
-		/* values() */
-		copy_tv(&di->di_tv, &li->li_tv);
+		list_append_string(rettv->vval.v_list,
+						syn_id2name(m->hlg_id), -1);
+		list_append_string(rettv->vval.v_list, m->pattern, -1);
 	    }
 	    else
 	    {
-		/* items() */
-		l2 = list_alloc();
-		li->li_tv.v_type = VAR_LIST;
-		li->li_tv.v_lock = 0;
-		li->li_tv.vval.v_list = l2;
-		if (l2 == NULL)
-		    break;
-		++l2->lv_refcount;
-
-		li2 = listitem_alloc();
-		if (li2 == NULL)
-		    break;
-		list_append(l2, li2);
-		li2->li_tv.v_type = VAR_STRING;
-		li2->li_tv.v_lock = 0;
-		li2->li_tv.vval.v_string = vim_strsave(di->di_key);
-
-		li2 = listitem_alloc();
-		if (li2 == NULL)
-		    break;
-		list_append(l2, li2);
-		copy_tv(&di->di_tv, &li2->li_tv);
+		list_append_string(rettv->vval.v_list, NULL, -1);
+		list_append_string(rettv->vval.v_list, NULL, -1);
 	    }
 	}
+#endif
     }
 }
 
 /*
- * "items(dict)" function
+ * "matchdelete()" function
  */
     static void
-f_items(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+f_matchdelete(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv UNUSED;
 {
-    dict_list(argvars, rettv, 2);
+#ifdef FEAT_SEARCH_EXTRA
+    rettv->vval.v_number = match_delete(curwin,
+				       (int)get_tv_number(&argvars[0]), TRUE);
+#endif
 }
 
 /*
- * "join()" function
+ * "matchend()" function
  */
     static void
-f_join(argvars, rettv)
+f_matchend(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    garray_T	ga;
-    char_u	*sep;
-
-    if (argvars[0].v_type != VAR_LIST)
-    {
-	EMSG(_(e_listreq));
-	return;
-    }
-    if (argvars[0].vval.v_list == NULL)
-	return;
-    if (argvars[1].v_type == VAR_UNKNOWN)
-	sep = (char_u *)" ";
-    else
-	sep = get_tv_string_chk(&argvars[1]);
-
-    rettv->v_type = VAR_STRING;
-
-    if (sep != NULL)
-    {
-	ga_init2(&ga, (int)sizeof(char), 80);
-	list_join(&ga, argvars[0].vval.v_list, sep, TRUE, 0);
-	ga_append(&ga, NUL);
-	rettv->vval.v_string = (char_u *)ga.ga_data;
-    }
-    else
-	rettv->vval.v_string = NULL;
+    find_some_match(argvars, rettv, 0);
 }
 
 /*
- * "keys()" function
+ * "matchlist()" function
  */
     static void
-f_keys(argvars, rettv)
+f_matchlist(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    dict_list(argvars, rettv, 0);
+    find_some_match(argvars, rettv, 3);
 }
 
 /*
- * "last_buffer_nr()" function.
+ * "matchstr()" function
  */
     static void
-f_last_buffer_nr(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_matchstr(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-    int		n = 0;
-    buf_T	*buf;
+    find_some_match(argvars, rettv, 2);
+}
 
-    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
-	if (n < buf->b_fnum)
-	    n = buf->b_fnum;
+static void max_min __ARGS((typval_T *argvars, typval_T *rettv, int domax));
 
-    rettv->vval.v_number = n;
+    static void
+max_min(argvars, rettv, domax)
+    typval_T	*argvars;
+    typval_T	*rettv;
+    int		domax;
+{
+    long	n = 0;
+    long	i;
+    int		error = FALSE;
+
+    if (argvars[0].v_type == VAR_LIST)
+    {
+	list_T		*l;
+	listitem_T	*li;
+
+	l = argvars[0].vval.v_list;
+	if (l != NULL)
+	{
+	    li = l->lv_first;
+	    if (li != NULL)
+	    {
+		n = get_tv_number_chk(&li->li_tv, &error);
+		for (;;)
+		{
+		    li = li->li_next;
+		    if (li == NULL)
+			break;
+		    i = get_tv_number_chk(&li->li_tv, &error);
+		    if (domax ? i > n : i < n)
+			n = i;
+		}
+	    }
+	}
+    }
+    else if (argvars[0].v_type == VAR_DICT)
+    {
+	dict_T		*d;
+	int		first = TRUE;
+	hashitem_T	*hi;
+	int		todo;
+
+	d = argvars[0].vval.v_dict;
+	if (d != NULL)
+	{
+	    todo = (int)d->dv_hashtab.ht_used;
+	    for (hi = d->dv_hashtab.ht_array; todo > 0; ++hi)
+	    {
+		if (!HASHITEM_EMPTY(hi))
+		{
+		    --todo;
+		    i = get_tv_number_chk(&HI2DI(hi)->di_tv, &error);
+		    if (first)
+		    {
+			n = i;
+			first = FALSE;
+		    }
+		    else if (domax ? i > n : i < n)
+			n = i;
+		}
+	    }
+	}
+    }
+    else
+	EMSG(_(e_listdictarg));
+    rettv->vval.v_number = error ? 0 : n;
+}
+
+/*
+ * "max()" function
+ */
+    static void
+f_max(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    max_min(argvars, rettv, TRUE);
 }
 
 /*
- * "len()" function
+ * "min()" function
  */
     static void
-f_len(argvars, rettv)
+f_min(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    switch (argvars[0].v_type)
-    {
-	case VAR_STRING:
-	case VAR_NUMBER:
-	    rettv->vval.v_number = (varnumber_T)STRLEN(
-					       get_tv_string(&argvars[0]));
-	    break;
-	case VAR_LIST:
-	    rettv->vval.v_number = list_len(argvars[0].vval.v_list);
-	    break;
-	case VAR_DICT:
-	    rettv->vval.v_number = dict_len(argvars[0].vval.v_dict);
-	    break;
-	default:
-	    EMSG(_("E701: Invalid type for len()"));
-	    break;
-    }
+    max_min(argvars, rettv, FALSE);
 }
 
-static void libcall_common __ARGS((typval_T *argvars, typval_T *rettv, int type));
+static int mkdir_recurse __ARGS((char_u *dir, int prot));
+
+/*
+ * Create the directory in which "dir" is located, and higher levels when
+ * needed.
+ */
+    static int
+mkdir_recurse(dir, prot)
+    char_u	*dir;
+    int		prot;
+{
+    char_u	*p;
+    char_u	*updir;
+    int		r = FAIL;
+
+    /* Get end of directory name in "dir".
+     * We're done when it's "/" or "c:/". */
+    p = gettail_sep(dir);
+    if (p <= get_past_head(dir))
+	return OK;
+
+    /* If the directory exists we're done.  Otherwise: create it.*/
+    updir = vim_strnsave(dir, (int)(p - dir));
+    if (updir == NULL)
+	return FAIL;
+    if (mch_isdir(updir))
+	r = OK;
+    else if (mkdir_recurse(updir, prot) == OK)
+	r = vim_mkdir_emsg(updir, prot);
+    vim_free(updir);
+    return r;
+}
 
+#ifdef vim_mkdir
+/*
+ * "mkdir()" function
+ */
     static void
-libcall_common(argvars, rettv, type)
+f_mkdir(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
-    int		type;
 {
-#ifdef FEAT_LIBCALL
-    char_u		*string_in;
-    char_u		**string_result;
-    int			nr_result;
-#endif
-
-    rettv->v_type = type;
-    if (type != VAR_NUMBER)
-	rettv->vval.v_string = NULL;
+    char_u	*dir;
+    char_u	buf[NUMBUFLEN];
+    int		prot = 0755;
 
+    rettv->vval.v_number = FAIL;
     if (check_restricted() || check_secure())
 	return;
 
-#ifdef FEAT_LIBCALL
-    /* The first two args must be strings, otherwise its meaningless */
-    if (argvars[0].v_type == VAR_STRING && argvars[1].v_type == VAR_STRING)
+    dir = get_tv_string_buf(&argvars[0], buf);
+    if (*dir == NUL)
+	rettv->vval.v_number = FAIL;
+    else
     {
-	string_in = NULL;
-	if (argvars[2].v_type == VAR_STRING)
-	    string_in = argvars[2].vval.v_string;
-	if (type == VAR_NUMBER)
-	    string_result = NULL;
-	else
-	    string_result = &rettv->vval.v_string;
-	if (mch_libcall(argvars[0].vval.v_string,
-			     argvars[1].vval.v_string,
-			     string_in,
-			     argvars[2].vval.v_number,
-			     string_result,
-			     &nr_result) == OK
-		&& type == VAR_NUMBER)
-	    rettv->vval.v_number = nr_result;
+	if (*gettail(dir) == NUL)
+	    /* remove trailing slashes */
+	    *gettail_sep(dir) = NUL;
+
+	if (argvars[1].v_type != VAR_UNKNOWN)
+	{
+	    if (argvars[2].v_type != VAR_UNKNOWN)
+		prot = get_tv_number_chk(&argvars[2], NULL);
+	    if (prot != -1 && STRCMP(get_tv_string(&argvars[1]), "p") == 0)
+		mkdir_recurse(dir, prot);
+	}
+	rettv->vval.v_number = prot == -1 ? FAIL : vim_mkdir_emsg(dir, prot);
     }
-#endif
 }
+#endif
 
 /*
- * "libcall()" function
+ * "mode()" function
  */
     static void
-f_libcall(argvars, rettv)
+f_mode(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    libcall_common(argvars, rettv, VAR_STRING);
+    char_u	buf[3];
+
+    buf[1] = NUL;
+    buf[2] = NUL;
+
+    if (VIsual_active)
+    {
+	if (VIsual_select)
+	    buf[0] = VIsual_mode + 's' - 'v';
+	else
+	    buf[0] = VIsual_mode;
+    }
+    else if (State == HITRETURN || State == ASKMORE || State == SETWSIZE
+		|| State == CONFIRM)
+    {
+	buf[0] = 'r';
+	if (State == ASKMORE)
+	    buf[1] = 'm';
+	else if (State == CONFIRM)
+	    buf[1] = '?';
+    }
+    else if (State == EXTERNCMD)
+	buf[0] = '!';
+    else if (State & INSERT)
+    {
+#ifdef FEAT_VREPLACE
+	if (State & VREPLACE_FLAG)
+	{
+	    buf[0] = 'R';
+	    buf[1] = 'v';
+	}
+	else
+#endif
+	if (State & REPLACE_FLAG)
+	    buf[0] = 'R';
+	else
+	    buf[0] = 'i';
+    }
+    else if (State & CMDLINE)
+    {
+	buf[0] = 'c';
+	if (exmode_active)
+	    buf[1] = 'v';
+    }
+    else if (exmode_active)
+    {
+	buf[0] = 'c';
+	buf[1] = 'e';
+    }
+    else
+    {
+	buf[0] = 'n';
+	if (finish_op)
+	    buf[1] = 'o';
+    }
+
+    /* Clear out the minor mode when the argument is not a non-zero number or
+     * non-empty string.  */
+    if (!non_zero_arg(&argvars[0]))
+	buf[1] = NUL;
+
+    rettv->vval.v_string = vim_strsave(buf);
+    rettv->v_type = VAR_STRING;
 }
 
+#if defined(FEAT_MZSCHEME) || defined(PROTO)
 /*
- * "libcallnr()" function
+ * "mzeval()" function
  */
     static void
-f_libcallnr(argvars, rettv)
+f_mzeval(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    libcall_common(argvars, rettv, VAR_NUMBER);
+    char_u	*str;
+    char_u	buf[NUMBUFLEN];
+
+    str = get_tv_string_buf(&argvars[0], buf);
+    do_mzeval(str, rettv);
 }
 
-/*
- * "line(string)" function
- */
-    static void
-f_line(argvars, rettv)
-    typval_T	*argvars;
+    void
+mzscheme_call_vim(name, args, rettv)
+    char_u	*name;
+    typval_T	*args;
     typval_T	*rettv;
 {
-    linenr_T	lnum = 0;
-    pos_T	*fp;
-    int		fnum;
+    typval_T argvars[3];
 
-    fp = var2fpos(&argvars[0], TRUE, &fnum);
-    if (fp != NULL)
-	lnum = fp->lnum;
-    rettv->vval.v_number = lnum;
+    argvars[0].v_type = VAR_STRING;
+    argvars[0].vval.v_string = name;
+    copy_tv(args, &argvars[1]);
+    argvars[2].v_type = VAR_UNKNOWN;
+    f_call(argvars, rettv);
+    clear_tv(&argvars[1]);
 }
+#endif
 
 /*
- * "line2byte(lnum)" function
+ * "nextnonblank()" function
  */
     static void
-f_line2byte(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_nextnonblank(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-#ifndef FEAT_BYTEOFF
-    rettv->vval.v_number = -1;
-#else
     linenr_T	lnum;
 
-    lnum = get_tv_lnum(argvars);
-    if (lnum < 1 || lnum > curbuf->b_ml.ml_line_count + 1)
-	rettv->vval.v_number = -1;
-    else
-	rettv->vval.v_number = ml_find_line_or_offset(curbuf, lnum, NULL);
-    if (rettv->vval.v_number >= 0)
-	++rettv->vval.v_number;
-#endif
+    for (lnum = get_tv_lnum(argvars); ; ++lnum)
+    {
+	if (lnum < 0 || lnum > curbuf->b_ml.ml_line_count)
+	{
+	    lnum = 0;
+	    break;
+	}
+	if (*skipwhite(ml_get(lnum)) != NUL)
+	    break;
+    }
+    rettv->vval.v_number = lnum;
 }
 
 /*
- * "lispindent(lnum)" function
+ * "nr2char()" function
  */
     static void
-f_lispindent(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_nr2char(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-#ifdef FEAT_LISP
-    pos_T	pos;
-    linenr_T	lnum;
+    char_u	buf[NUMBUFLEN];
 
-    pos = curwin->w_cursor;
-    lnum = get_tv_lnum(argvars);
-    if (lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count)
+#ifdef FEAT_MBYTE
+    if (has_mbyte)
     {
-	curwin->w_cursor.lnum = lnum;
-	rettv->vval.v_number = get_lisp_indent();
-	curwin->w_cursor = pos;
+	int	utf8 = 0;
+
+	if (argvars[1].v_type != VAR_UNKNOWN)
+	    utf8 = get_tv_number_chk(&argvars[1], NULL);
+	if (utf8)
+	    buf[(*utf_char2bytes)((int)get_tv_number(&argvars[0]), buf)] = NUL;
+	else
+	    buf[(*mb_char2bytes)((int)get_tv_number(&argvars[0]), buf)] = NUL;
     }
     else
 #endif
-	rettv->vval.v_number = -1;
+    {
+	buf[0] = (char_u)get_tv_number(&argvars[0]);
+	buf[1] = NUL;
+    }
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = vim_strsave(buf);
 }
 
 /*
- * "localtime()" function
+ * "or(expr, expr)" function
  */
     static void
-f_localtime(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_or(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = (varnumber_T)time(NULL);
+    rettv->vval.v_number = get_tv_number_chk(&argvars[0], NULL)
+					| get_tv_number_chk(&argvars[1], NULL);
 }
 
-static void get_maparg __ARGS((typval_T *argvars, typval_T *rettv, int exact));
-
+/*
+ * "pathshorten()" function
+ */
     static void
-get_maparg(argvars, rettv, exact)
+f_pathshorten(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
-    int		exact;
 {
-    char_u	*keys;
-    char_u	*which;
-    char_u	buf[NUMBUFLEN];
-    char_u	*keys_buf = NULL;
-    char_u	*rhs;
-    int		mode;
-    int		abbr = FALSE;
-    int		get_dict = FALSE;
-    mapblock_T	*mp;
-    int		buffer_local;
+    char_u	*p;
 
-    /* return empty string for failure */
     rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
-
-    keys = get_tv_string(&argvars[0]);
-    if (*keys == NUL)
-	return;
-
-    if (argvars[1].v_type != VAR_UNKNOWN)
-    {
-	which = get_tv_string_buf_chk(&argvars[1], buf);
-	if (argvars[2].v_type != VAR_UNKNOWN)
-	{
-	    abbr = get_tv_number(&argvars[2]);
-	    if (argvars[3].v_type != VAR_UNKNOWN)
-		get_dict = get_tv_number(&argvars[3]);
-	}
-    }
+    p = get_tv_string_chk(&argvars[0]);
+    if (p == NULL)
+	rettv->vval.v_string = NULL;
     else
-	which = (char_u *)"";
-    if (which == NULL)
-	return;
-
-    mode = get_map_mode(&which, 0);
-
-    keys = replace_termcodes(keys, &keys_buf, TRUE, TRUE, FALSE);
-    rhs = check_map(keys, mode, exact, FALSE, abbr, &mp, &buffer_local);
-    vim_free(keys_buf);
-
-    if (!get_dict)
-    {
-	/* Return a string. */
-	if (rhs != NULL)
-	    rettv->vval.v_string = str2special_save(rhs, FALSE);
-
-    }
-    else if (rettv_dict_alloc(rettv) != FAIL && rhs != NULL)
     {
-	/* Return a dictionary. */
-	char_u	    *lhs = str2special_save(mp->m_keys, TRUE);
-	char_u	    *mapmode = map_mode_to_chars(mp->m_mode);
-	dict_T	    *dict = rettv->vval.v_dict;
-
-	dict_add_nr_str(dict, "lhs",	 0L, lhs);
-	dict_add_nr_str(dict, "rhs",     0L, mp->m_orig_str);
-	dict_add_nr_str(dict, "noremap", mp->m_noremap ? 1L : 0L , NULL);
-	dict_add_nr_str(dict, "expr",    mp->m_expr    ? 1L : 0L, NULL);
-	dict_add_nr_str(dict, "silent",  mp->m_silent  ? 1L : 0L, NULL);
-	dict_add_nr_str(dict, "sid",     (long)mp->m_script_ID, NULL);
-	dict_add_nr_str(dict, "buffer",  (long)buffer_local, NULL);
-	dict_add_nr_str(dict, "nowait",  mp->m_nowait  ? 1L : 0L, NULL);
-	dict_add_nr_str(dict, "mode",    0L, mapmode);
-
-	vim_free(lhs);
-	vim_free(mapmode);
+	p = vim_strsave(p);
+	rettv->vval.v_string = p;
+	if (p != NULL)
+	    shorten_dir(p);
     }
 }
 
 #ifdef FEAT_FLOAT
 /*
- * "log()" function
+ * "pow()" function
  */
     static void
-f_log(argvars, rettv)
+f_pow(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    float_T	f;
+    float_T	fx, fy;
 
     rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	rettv->vval.v_float = log(f);
+    if (get_float_arg(argvars, &fx) == OK
+				     && get_float_arg(&argvars[1], &fy) == OK)
+	rettv->vval.v_float = pow(fx, fy);
     else
 	rettv->vval.v_float = 0.0;
 }
+#endif
 
 /*
- * "log10()" function
+ * "prevnonblank()" function
  */
     static void
-f_log10(argvars, rettv)
+f_prevnonblank(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    float_T	f;
+    linenr_T	lnum;
 
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	rettv->vval.v_float = log10(f);
+    lnum = get_tv_lnum(argvars);
+    if (lnum < 1 || lnum > curbuf->b_ml.ml_line_count)
+	lnum = 0;
     else
-	rettv->vval.v_float = 0.0;
+	while (lnum >= 1 && *skipwhite(ml_get(lnum)) == NUL)
+	    --lnum;
+    rettv->vval.v_number = lnum;
 }
+
+#ifdef HAVE_STDARG_H
+/* This dummy va_list is here because:
+ * - passing a NULL pointer doesn't work when va_list isn't a pointer
+ * - locally in the function results in a "used before set" warning
+ * - using va_start() to initialize it gives "function with fixed args" error */
+static va_list	ap;
 #endif
 
-#ifdef FEAT_LUA
 /*
- * "luaeval()" function
+ * "printf()" function
  */
     static void
-f_luaeval(argvars, rettv)
+f_printf(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	*str;
-    char_u	buf[NUMBUFLEN];
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+#ifdef HAVE_STDARG_H	    /* only very old compilers can't do this */
+    {
+	char_u	buf[NUMBUFLEN];
+	int	len;
+	char_u	*s;
+	int	saved_did_emsg = did_emsg;
+	char	*fmt;
 
-    str = get_tv_string_buf(&argvars[0], buf);
-    do_luaeval(str, argvars + 1, rettv);
-}
+	/* Get the required length, allocate the buffer and do it for real. */
+	did_emsg = FALSE;
+	fmt = (char *)get_tv_string_buf(&argvars[0], buf);
+	len = vim_vsnprintf(NULL, 0, fmt, ap, argvars + 1);
+	if (!did_emsg)
+	{
+	    s = alloc(len + 1);
+	    if (s != NULL)
+	    {
+		rettv->vval.v_string = s;
+		(void)vim_vsnprintf((char *)s, len + 1, fmt, ap, argvars + 1);
+	    }
+	}
+	did_emsg |= saved_did_emsg;
+    }
 #endif
+}
 
 /*
- * "map()" function
+ * "pumvisible()" function
  */
     static void
-f_map(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+f_pumvisible(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv UNUSED;
 {
-    filter_map(argvars, rettv, TRUE);
+#ifdef FEAT_INS_EXPAND
+    if (pum_visible())
+	rettv->vval.v_number = 1;
+#endif
 }
 
+#ifdef FEAT_PYTHON3
 /*
- * "maparg()" function
+ * "py3eval()" function
  */
     static void
-f_maparg(argvars, rettv)
+f_py3eval(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    get_maparg(argvars, rettv, TRUE);
+    char_u	*str;
+    char_u	buf[NUMBUFLEN];
+
+    str = get_tv_string_buf(&argvars[0], buf);
+    do_py3eval(str, rettv);
 }
+#endif
 
+#ifdef FEAT_PYTHON
 /*
- * "mapcheck()" function
+ * "pyeval()" function
  */
     static void
-f_mapcheck(argvars, rettv)
+f_pyeval(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    get_maparg(argvars, rettv, FALSE);
-}
+    char_u	*str;
+    char_u	buf[NUMBUFLEN];
 
-static void find_some_match __ARGS((typval_T *argvars, typval_T *rettv, int start));
+    str = get_tv_string_buf(&argvars[0], buf);
+    do_pyeval(str, rettv);
+}
+#endif
 
+/*
+ * "range()" function
+ */
     static void
-find_some_match(argvars, rettv, type)
+f_range(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
-    int		type;
 {
-    char_u	*str = NULL;
-    long	len = 0;
-    char_u	*expr = NULL;
-    char_u	*pat;
-    regmatch_T	regmatch;
-    char_u	patbuf[NUMBUFLEN];
-    char_u	strbuf[NUMBUFLEN];
-    char_u	*save_cpo;
-    long	start = 0;
-    long	nth = 1;
-    colnr_T	startcol = 0;
-    int		match = 0;
-    list_T	*l = NULL;
-    listitem_T	*li = NULL;
-    long	idx = 0;
-    char_u	*tofree = NULL;
-
-    /* Make 'cpoptions' empty, the 'l' flag should not be used here. */
-    save_cpo = p_cpo;
-    p_cpo = (char_u *)"";
+    long	start;
+    long	end;
+    long	stride = 1;
+    long	i;
+    int		error = FALSE;
 
-    rettv->vval.v_number = -1;
-    if (type == 3)
-    {
-	/* return empty list when there are no matches */
-	if (rettv_list_alloc(rettv) == FAIL)
-	    goto theend;
-    }
-    else if (type == 2)
+    start = get_tv_number_chk(&argvars[0], &error);
+    if (argvars[1].v_type == VAR_UNKNOWN)
     {
-	rettv->v_type = VAR_STRING;
-	rettv->vval.v_string = NULL;
+	end = start - 1;
+	start = 0;
     }
-
-    if (argvars[0].v_type == VAR_LIST)
+    else
     {
-	if ((l = argvars[0].vval.v_list) == NULL)
-	    goto theend;
-	li = l->lv_first;
+	end = get_tv_number_chk(&argvars[1], &error);
+	if (argvars[2].v_type != VAR_UNKNOWN)
+	    stride = get_tv_number_chk(&argvars[2], &error);
     }
+
+    if (error)
+	return;		/* type error; errmsg already given */
+    if (stride == 0)
+	EMSG(_("E726: Stride is zero"));
+    else if (stride > 0 ? end + 1 < start : end - 1 > start)
+	EMSG(_("E727: Start past end"));
     else
     {
-	expr = str = get_tv_string(&argvars[0]);
-	len = (long)STRLEN(str);
+	if (rettv_list_alloc(rettv) == OK)
+	    for (i = start; stride > 0 ? i <= end : i >= end; i += stride)
+		if (list_append_number(rettv->vval.v_list,
+						      (varnumber_T)i) == FAIL)
+		    break;
     }
+}
 
-    pat = get_tv_string_buf_chk(&argvars[1], patbuf);
-    if (pat == NULL)
-	goto theend;
+/*
+ * "readfile()" function
+ */
+    static void
+f_readfile(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    int		binary = FALSE;
+    int		failed = FALSE;
+    char_u	*fname;
+    FILE	*fd;
+    char_u	buf[(IOSIZE/256)*256];	/* rounded to avoid odd + 1 */
+    int		io_size = sizeof(buf);
+    int		readlen;		/* size of last fread() */
+    char_u	*prev	 = NULL;	/* previously read bytes, if any */
+    long	prevlen  = 0;		/* length of data in prev */
+    long	prevsize = 0;		/* size of prev buffer */
+    long	maxline  = MAXLNUM;
+    long	cnt	 = 0;
+    char_u	*p;			/* position in buf */
+    char_u	*start;			/* start of current line */
 
-    if (argvars[2].v_type != VAR_UNKNOWN)
+    if (argvars[1].v_type != VAR_UNKNOWN)
     {
-	int	    error = FALSE;
+	if (STRCMP(get_tv_string(&argvars[1]), "b") == 0)
+	    binary = TRUE;
+	if (argvars[2].v_type != VAR_UNKNOWN)
+	    maxline = get_tv_number(&argvars[2]);
+    }
 
-	start = get_tv_number_chk(&argvars[2], &error);
-	if (error)
-	    goto theend;
-	if (l != NULL)
-	{
-	    li = list_find(l, start);
-	    if (li == NULL)
-		goto theend;
-	    idx = l->lv_idx;	/* use the cached index */
-	}
-	else
-	{
-	    if (start < 0)
-		start = 0;
-	    if (start > len)
-		goto theend;
-	    /* When "count" argument is there ignore matches before "start",
-	     * otherwise skip part of the string.  Differs when pattern is "^"
-	     * or "\<". */
-	    if (argvars[3].v_type != VAR_UNKNOWN)
-		startcol = start;
-	    else
-	    {
-		str += start;
-		len -= start;
-	    }
-	}
+    if (rettv_list_alloc(rettv) == FAIL)
+	return;
 
-	if (argvars[3].v_type != VAR_UNKNOWN)
-	    nth = get_tv_number_chk(&argvars[3], &error);
-	if (error)
-	    goto theend;
+    /* Always open the file in binary mode, library functions have a mind of
+     * their own about CR-LF conversion. */
+    fname = get_tv_string(&argvars[0]);
+    if (*fname == NUL || (fd = mch_fopen((char *)fname, READBIN)) == NULL)
+    {
+	EMSG2(_(e_notopen), *fname == NUL ? (char_u *)_("<empty>") : fname);
+	return;
     }
 
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
-    if (regmatch.regprog != NULL)
+    while (cnt < maxline || maxline < 0)
     {
-	regmatch.rm_ic = p_ic;
+	readlen = (int)fread(buf, 1, io_size, fd);
 
-	for (;;)
+	/* This for loop processes what was read, but is also entered at end
+	 * of file so that either:
+	 * - an incomplete line gets written
+	 * - a "binary" file gets an empty line at the end if it ends in a
+	 *   newline.  */
+	for (p = buf, start = buf;
+		p < buf + readlen || (readlen <= 0 && (prevlen > 0 || binary));
+		++p)
 	{
-	    if (l != NULL)
+	    if (*p == '\n' || readlen <= 0)
 	    {
-		if (li == NULL)
+		listitem_T  *li;
+		char_u	    *s	= NULL;
+		long_u	    len = p - start;
+
+		/* Finished a line.  Remove CRs before NL. */
+		if (readlen > 0 && !binary)
 		{
-		    match = FALSE;
-		    break;
+		    while (len > 0 && start[len - 1] == '\r')
+			--len;
+		    /* removal may cross back to the "prev" string */
+		    if (len == 0)
+			while (prevlen > 0 && prev[prevlen - 1] == '\r')
+			    --prevlen;
 		}
-		vim_free(tofree);
-		str = echo_string(&li->li_tv, &tofree, strbuf, 0);
-		if (str == NULL)
+		if (prevlen == 0)
+		    s = vim_strnsave(start, (int)len);
+		else
+		{
+		    /* Change "prev" buffer to be the right size.  This way
+		     * the bytes are only copied once, and very long lines are
+		     * allocated only once.  */
+		    if ((s = vim_realloc(prev, prevlen + len + 1)) != NULL)
+		    {
+			mch_memmove(s + prevlen, start, len);
+			s[prevlen + len] = NUL;
+			prev = NULL; /* the list will own the string */
+			prevlen = prevsize = 0;
+		    }
+		}
+		if (s == NULL)
+		{
+		    do_outofmem_msg((long_u) prevlen + len + 1);
+		    failed = TRUE;
 		    break;
-	    }
-
-	    match = vim_regexec_nl(&regmatch, str, (colnr_T)startcol);
-
-	    if (match && --nth <= 0)
-		break;
-	    if (l == NULL && !match)
-		break;
+		}
 
-	    /* Advance to just after the match. */
-	    if (l != NULL)
-	    {
-		li = li->li_next;
-		++idx;
-	    }
-	    else
-	    {
-#ifdef FEAT_MBYTE
-		startcol = (colnr_T)(regmatch.startp[0]
-				    + (*mb_ptr2len)(regmatch.startp[0]) - str);
-#else
-		startcol = (colnr_T)(regmatch.startp[0] + 1 - str);
-#endif
-		if (startcol > (colnr_T)len
-				      || str + startcol <= regmatch.startp[0])
+		if ((li = listitem_alloc()) == NULL)
 		{
-		    match = FALSE;
+		    vim_free(s);
+		    failed = TRUE;
 		    break;
 		}
-	    }
-	}
+		li->li_tv.v_type = VAR_STRING;
+		li->li_tv.v_lock = 0;
+		li->li_tv.vval.v_string = s;
+		list_append(rettv->vval.v_list, li);
 
-	if (match)
-	{
-	    if (type == 3)
+		start = p + 1; /* step over newline */
+		if ((++cnt >= maxline && maxline >= 0) || readlen <= 0)
+		    break;
+	    }
+	    else if (*p == NUL)
+		*p = '\n';
+#ifdef FEAT_MBYTE
+	    /* Check for utf8 "bom"; U+FEFF is encoded as EF BB BF.  Do this
+	     * when finding the BF and check the previous two bytes. */
+	    else if (*p == 0xbf && enc_utf8 && !binary)
 	    {
-		int i;
+		/* Find the two bytes before the 0xbf.	If p is at buf, or buf
+		 * + 1, these may be in the "prev" string. */
+		char_u back1 = p >= buf + 1 ? p[-1]
+				     : prevlen >= 1 ? prev[prevlen - 1] : NUL;
+		char_u back2 = p >= buf + 2 ? p[-2]
+			  : p == buf + 1 && prevlen >= 1 ? prev[prevlen - 1]
+			  : prevlen >= 2 ? prev[prevlen - 2] : NUL;
 
-		/* return list with matched string and submatches */
-		for (i = 0; i < NSUBEXP; ++i)
+		if (back2 == 0xef && back1 == 0xbb)
 		{
-		    if (regmatch.endp[i] == NULL)
+		    char_u *dest = p - 2;
+
+		    /* Usually a BOM is at the beginning of a file, and so at
+		     * the beginning of a line; then we can just step over it.
+		     */
+		    if (start == dest)
+			start = p + 1;
+		    else
 		    {
-			if (list_append_string(rettv->vval.v_list,
-						     (char_u *)"", 0) == FAIL)
-			    break;
+			/* have to shuffle buf to close gap */
+			int adjust_prevlen = 0;
+
+			if (dest < buf)
+			{
+			    adjust_prevlen = (int)(buf - dest); /* must be 1 or 2 */
+			    dest = buf;
+			}
+			if (readlen > p - buf + 1)
+			    mch_memmove(dest, p + 1, readlen - (p - buf) - 1);
+			readlen -= 3 - adjust_prevlen;
+			prevlen -= adjust_prevlen;
+			p = dest - 1;
 		    }
-		    else if (list_append_string(rettv->vval.v_list,
-				regmatch.startp[i],
-				(int)(regmatch.endp[i] - regmatch.startp[i]))
-			    == FAIL)
-			break;
 		}
 	    }
-	    else if (type == 2)
-	    {
-		/* return matched string */
-		if (l != NULL)
-		    copy_tv(&li->li_tv, rettv);
-		else
-		    rettv->vval.v_string = vim_strnsave(regmatch.startp[0],
-				(int)(regmatch.endp[0] - regmatch.startp[0]));
-	    }
-	    else if (l != NULL)
-		rettv->vval.v_number = idx;
-	    else
+#endif
+	} /* for */
+
+	if (failed || (cnt >= maxline && maxline >= 0) || readlen <= 0)
+	    break;
+	if (start < p)
+	{
+	    /* There's part of a line in buf, store it in "prev". */
+	    if (p - start + prevlen >= prevsize)
 	    {
-		if (type != 0)
-		    rettv->vval.v_number =
-				      (varnumber_T)(regmatch.startp[0] - str);
+		/* need bigger "prev" buffer */
+		char_u *newprev;
+
+		/* A common use case is ordinary text files and "prev" gets a
+		 * fragment of a line, so the first allocation is made
+		 * small, to avoid repeatedly 'allocing' large and
+		 * 'reallocing' small. */
+		if (prevsize == 0)
+		    prevsize = (long)(p - start);
 		else
-		    rettv->vval.v_number =
-					(varnumber_T)(regmatch.endp[0] - str);
-		rettv->vval.v_number += (varnumber_T)(str - expr);
+		{
+		    long grow50pc = (prevsize * 3) / 2;
+		    long growmin  = (long)((p - start) * 2 + prevlen);
+		    prevsize = grow50pc > growmin ? grow50pc : growmin;
+		}
+		newprev = prev == NULL ? alloc(prevsize)
+						: vim_realloc(prev, prevsize);
+		if (newprev == NULL)
+		{
+		    do_outofmem_msg((long_u)prevsize);
+		    failed = TRUE;
+		    break;
+		}
+		prev = newprev;
 	    }
+	    /* Add the line part to end of "prev". */
+	    mch_memmove(prev + prevlen, start, p - start);
+	    prevlen += (long)(p - start);
 	}
-	vim_regfree(regmatch.regprog);
+    } /* while */
+
+    /*
+     * For a negative line count use only the lines at the end of the file,
+     * free the rest.
+     */
+    if (!failed && maxline < 0)
+	while (cnt > -maxline)
+	{
+	    listitem_remove(rettv->vval.v_list, rettv->vval.v_list->lv_first);
+	    --cnt;
+	}
+
+    if (failed)
+    {
+	list_free(rettv->vval.v_list, TRUE);
+	/* readfile doc says an empty list is returned on error */
+	rettv->vval.v_list = list_alloc();
     }
 
-theend:
-    vim_free(tofree);
-    p_cpo = save_cpo;
+    vim_free(prev);
+    fclose(fd);
 }
 
+#if defined(FEAT_RELTIME)
+static int list2proftime __ARGS((typval_T *arg, proftime_T *tm));
+
 /*
- * "match()" function
+ * Convert a List to proftime_T.
+ * Return FAIL when there is something wrong.
  */
-    static void
-f_match(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static int
+list2proftime(arg, tm)
+    typval_T	*arg;
+    proftime_T  *tm;
 {
-    find_some_match(argvars, rettv, 1);
+    long	n1, n2;
+    int	error = FALSE;
+
+    if (arg->v_type != VAR_LIST || arg->vval.v_list == NULL
+					     || arg->vval.v_list->lv_len != 2)
+	return FAIL;
+    n1 = list_find_nr(arg->vval.v_list, 0L, &error);
+    n2 = list_find_nr(arg->vval.v_list, 1L, &error);
+# ifdef WIN3264
+    tm->HighPart = n1;
+    tm->LowPart = n2;
+# else
+    tm->tv_sec = n1;
+    tm->tv_usec = n2;
+# endif
+    return error ? FAIL : OK;
 }
+#endif /* FEAT_RELTIME */
 
 /*
- * "matchadd()" function
+ * "reltime()" function
  */
     static void
-f_matchadd(argvars, rettv)
+f_reltime(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv UNUSED;
 {
-#ifdef FEAT_SEARCH_EXTRA
-    char_u	buf[NUMBUFLEN];
-    char_u	*grp = get_tv_string_buf_chk(&argvars[0], buf);	/* group */
-    char_u	*pat = get_tv_string_buf_chk(&argvars[1], buf);	/* pattern */
-    int		prio = 10;	/* default priority */
-    int		id = -1;
-    int		error = FALSE;
-
-    rettv->vval.v_number = -1;
+#ifdef FEAT_RELTIME
+    proftime_T	res;
+    proftime_T	start;
 
-    if (grp == NULL || pat == NULL)
-	return;
-    if (argvars[2].v_type != VAR_UNKNOWN)
+    if (argvars[0].v_type == VAR_UNKNOWN)
     {
-	prio = get_tv_number_chk(&argvars[2], &error);
-	if (argvars[3].v_type != VAR_UNKNOWN)
-	    id = get_tv_number_chk(&argvars[3], &error);
+	/* No arguments: get current time. */
+	profile_start(&res);
     }
-    if (error == TRUE)
-	return;
-    if (id >= 1 && id <= 3)
+    else if (argvars[1].v_type == VAR_UNKNOWN)
     {
-	EMSGN("E798: ID is reserved for \":match\": %ld", id);
-	return;
+	if (list2proftime(&argvars[0], &res) == FAIL)
+	    return;
+	profile_end(&res);
     }
-
-    rettv->vval.v_number = match_add(curwin, grp, pat, prio, id);
-#endif
-}
-
-/*
- * "matcharg()" function
- */
-    static void
-f_matcharg(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
-{
-    if (rettv_list_alloc(rettv) == OK)
+    else
     {
-#ifdef FEAT_SEARCH_EXTRA
-	int	    id = get_tv_number(&argvars[0]);
-	matchitem_T *m;
-
-	if (id >= 1 && id <= 3)
-	{
-	    if ((m = (matchitem_T *)get_match(curwin, id)) != NULL)
-	    {
-		list_append_string(rettv->vval.v_list,
-						syn_id2name(m->hlg_id), -1);
-		list_append_string(rettv->vval.v_list, m->pattern, -1);
-	    }
-	    else
-	    {
-		list_append_string(rettv->vval.v_list, NULL, -1);
-		list_append_string(rettv->vval.v_list, NULL, -1);
-	    }
-	}
-#endif
+	/* Two arguments: compute the difference. */
+	if (list2proftime(&argvars[0], &start) == FAIL
+		|| list2proftime(&argvars[1], &res) == FAIL)
+	    return;
+	profile_sub(&res, &start);
     }
-}
-
-/*
- * "matchdelete()" function
- */
-    static void
-f_matchdelete(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
-{
-#ifdef FEAT_SEARCH_EXTRA
-    rettv->vval.v_number = match_delete(curwin,
-				       (int)get_tv_number(&argvars[0]), TRUE);
-#endif
-}
-
-/*
- * "matchend()" function
- */
-    static void
-f_matchend(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    find_some_match(argvars, rettv, 0);
-}
-
-/*
- * "matchlist()" function
- */
-    static void
-f_matchlist(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    find_some_match(argvars, rettv, 3);
-}
-
-/*
- * "matchstr()" function
- */
-    static void
-f_matchstr(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    find_some_match(argvars, rettv, 2);
-}
-
-static void max_min __ARGS((typval_T *argvars, typval_T *rettv, int domax));
-
-    static void
-max_min(argvars, rettv, domax)
-    typval_T	*argvars;
-    typval_T	*rettv;
-    int		domax;
-{
-    long	n = 0;
-    long	i;
-    int		error = FALSE;
-
-    if (argvars[0].v_type == VAR_LIST)
-    {
-	list_T		*l;
-	listitem_T	*li;
 
-	l = argvars[0].vval.v_list;
-	if (l != NULL)
-	{
-	    li = l->lv_first;
-	    if (li != NULL)
-	    {
-		n = get_tv_number_chk(&li->li_tv, &error);
-		for (;;)
-		{
-		    li = li->li_next;
-		    if (li == NULL)
-			break;
-		    i = get_tv_number_chk(&li->li_tv, &error);
-		    if (domax ? i > n : i < n)
-			n = i;
-		}
-	    }
-	}
-    }
-    else if (argvars[0].v_type == VAR_DICT)
+    if (rettv_list_alloc(rettv) == OK)
     {
-	dict_T		*d;
-	int		first = TRUE;
-	hashitem_T	*hi;
-	int		todo;
+	long	n1, n2;
 
-	d = argvars[0].vval.v_dict;
-	if (d != NULL)
-	{
-	    todo = (int)d->dv_hashtab.ht_used;
-	    for (hi = d->dv_hashtab.ht_array; todo > 0; ++hi)
-	    {
-		if (!HASHITEM_EMPTY(hi))
-		{
-		    --todo;
-		    i = get_tv_number_chk(&HI2DI(hi)->di_tv, &error);
-		    if (first)
-		    {
-			n = i;
-			first = FALSE;
-		    }
-		    else if (domax ? i > n : i < n)
-			n = i;
-		}
-	    }
-	}
+# ifdef WIN3264
+	n1 = res.HighPart;
+	n2 = res.LowPart;
+# else
+	n1 = res.tv_sec;
+	n2 = res.tv_usec;
+# endif
+	list_append_number(rettv->vval.v_list, (varnumber_T)n1);
+	list_append_number(rettv->vval.v_list, (varnumber_T)n2);
     }
-    else
-	EMSG(_(e_listdictarg));
-    rettv->vval.v_number = error ? 0 : n;
+#endif
 }
 
 /*
- * "max()" function
+ * "reltimestr()" function
  */
     static void
-f_max(argvars, rettv)
-    typval_T	*argvars;
+f_reltimestr(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    max_min(argvars, rettv, TRUE);
+#ifdef FEAT_RELTIME
+    proftime_T	tm;
+#endif
+
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+#ifdef FEAT_RELTIME
+    if (list2proftime(&argvars[0], &tm) == OK)
+	rettv->vval.v_string = vim_strsave((char_u *)profile_msg(&tm));
+#endif
 }
 
-/*
- * "min()" function
- */
+#if defined(FEAT_CLIENTSERVER) && defined(FEAT_X11)
+static void make_connection __ARGS((void));
+static int check_connection __ARGS((void));
+
     static void
-f_min(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+make_connection()
 {
-    max_min(argvars, rettv, FALSE);
+    if (X_DISPLAY == NULL
+# ifdef FEAT_GUI
+	    && !gui.in_use
+# endif
+	    )
+    {
+	x_force_connect = TRUE;
+	setup_term_clip();
+	x_force_connect = FALSE;
+    }
 }
 
-static int mkdir_recurse __ARGS((char_u *dir, int prot));
-
-/*
- * Create the directory in which "dir" is located, and higher levels when
- * needed.
- */
     static int
-mkdir_recurse(dir, prot)
-    char_u	*dir;
-    int		prot;
+check_connection()
 {
-    char_u	*p;
-    char_u	*updir;
-    int		r = FAIL;
-
-    /* Get end of directory name in "dir".
-     * We're done when it's "/" or "c:/". */
-    p = gettail_sep(dir);
-    if (p <= get_past_head(dir))
-	return OK;
-
-    /* If the directory exists we're done.  Otherwise: create it.*/
-    updir = vim_strnsave(dir, (int)(p - dir));
-    if (updir == NULL)
+    make_connection();
+    if (X_DISPLAY == NULL)
+    {
+	EMSG(_("E240: No connection to Vim server"));
 	return FAIL;
-    if (mch_isdir(updir))
-	r = OK;
-    else if (mkdir_recurse(updir, prot) == OK)
-	r = vim_mkdir_emsg(updir, prot);
-    vim_free(updir);
-    return r;
+    }
+    return OK;
 }
+#endif
+
+#ifdef FEAT_CLIENTSERVER
+static void remote_common __ARGS((typval_T *argvars, typval_T *rettv, int expr));
 
-#ifdef vim_mkdir
-/*
- * "mkdir()" function
- */
     static void
-f_mkdir(argvars, rettv)
+remote_common(argvars, rettv, expr)
     typval_T	*argvars;
     typval_T	*rettv;
+    int		expr;
 {
-    char_u	*dir;
+    char_u	*server_name;
+    char_u	*keys;
+    char_u	*r = NULL;
     char_u	buf[NUMBUFLEN];
-    int		prot = 0755;
+# ifdef WIN32
+    HWND	w;
+# else
+    Window	w;
+# endif
 
-    rettv->vval.v_number = FAIL;
     if (check_restricted() || check_secure())
 	return;
 
-    dir = get_tv_string_buf(&argvars[0], buf);
-    if (*dir == NUL)
-	rettv->vval.v_number = FAIL;
-    else
+# ifdef FEAT_X11
+    if (check_connection() == FAIL)
+	return;
+# endif
+
+    server_name = get_tv_string_chk(&argvars[0]);
+    if (server_name == NULL)
+	return;		/* type error; errmsg already given */
+    keys = get_tv_string_buf(&argvars[1], buf);
+# ifdef WIN32
+    if (serverSendToVim(server_name, keys, &r, &w, expr, TRUE) < 0)
+# else
+    if (serverSendToVim(X_DISPLAY, server_name, keys, &r, &w, expr, 0, TRUE)
+									  < 0)
+# endif
     {
-	if (*gettail(dir) == NUL)
-	    /* remove trailing slashes */
-	    *gettail_sep(dir) = NUL;
+	if (r != NULL)
+	    EMSG(r);		/* sending worked but evaluation failed */
+	else
+	    EMSG2(_("E241: Unable to send to %s"), server_name);
+	return;
+    }
 
-	if (argvars[1].v_type != VAR_UNKNOWN)
-	{
-	    if (argvars[2].v_type != VAR_UNKNOWN)
-		prot = get_tv_number_chk(&argvars[2], NULL);
-	    if (prot != -1 && STRCMP(get_tv_string(&argvars[1]), "p") == 0)
-		mkdir_recurse(dir, prot);
-	}
-	rettv->vval.v_number = prot == -1 ? FAIL : vim_mkdir_emsg(dir, prot);
+    rettv->vval.v_string = r;
+
+    if (argvars[2].v_type != VAR_UNKNOWN)
+    {
+	dictitem_T	v;
+	char_u		str[30];
+	char_u		*idvar;
+
+	sprintf((char *)str, PRINTF_HEX_LONG_U, (long_u)w);
+	v.di_tv.v_type = VAR_STRING;
+	v.di_tv.vval.v_string = vim_strsave(str);
+	idvar = get_tv_string_chk(&argvars[2]);
+	if (idvar != NULL)
+	    set_var(idvar, &v.di_tv, FALSE);
+	vim_free(v.di_tv.vval.v_string);
     }
 }
 #endif
 
 /*
- * "mode()" function
+ * "remote_expr()" function
  */
     static void
-f_mode(argvars, rettv)
-    typval_T	*argvars;
+f_remote_expr(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    char_u	buf[3];
-
-    buf[1] = NUL;
-    buf[2] = NUL;
-
-    if (VIsual_active)
-    {
-	if (VIsual_select)
-	    buf[0] = VIsual_mode + 's' - 'v';
-	else
-	    buf[0] = VIsual_mode;
-    }
-    else if (State == HITRETURN || State == ASKMORE || State == SETWSIZE
-		|| State == CONFIRM)
-    {
-	buf[0] = 'r';
-	if (State == ASKMORE)
-	    buf[1] = 'm';
-	else if (State == CONFIRM)
-	    buf[1] = '?';
-    }
-    else if (State == EXTERNCMD)
-	buf[0] = '!';
-    else if (State & INSERT)
-    {
-#ifdef FEAT_VREPLACE
-	if (State & VREPLACE_FLAG)
-	{
-	    buf[0] = 'R';
-	    buf[1] = 'v';
-	}
-	else
-#endif
-	if (State & REPLACE_FLAG)
-	    buf[0] = 'R';
-	else
-	    buf[0] = 'i';
-    }
-    else if (State & CMDLINE)
-    {
-	buf[0] = 'c';
-	if (exmode_active)
-	    buf[1] = 'v';
-    }
-    else if (exmode_active)
-    {
-	buf[0] = 'c';
-	buf[1] = 'e';
-    }
-    else
-    {
-	buf[0] = 'n';
-	if (finish_op)
-	    buf[1] = 'o';
-    }
-
-    /* Clear out the minor mode when the argument is not a non-zero number or
-     * non-empty string.  */
-    if (!non_zero_arg(&argvars[0]))
-	buf[1] = NUL;
-
-    rettv->vval.v_string = vim_strsave(buf);
     rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+#ifdef FEAT_CLIENTSERVER
+    remote_common(argvars, rettv, TRUE);
+#endif
 }
 
-#if defined(FEAT_MZSCHEME) || defined(PROTO)
 /*
- * "mzeval()" function
+ * "remote_foreground()" function
  */
     static void
-f_mzeval(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    char_u	*str;
-    char_u	buf[NUMBUFLEN];
-
-    str = get_tv_string_buf(&argvars[0], buf);
-    do_mzeval(str, rettv);
-}
-
-    void
-mzscheme_call_vim(name, args, rettv)
-    char_u	*name;
-    typval_T	*args;
-    typval_T	*rettv;
+f_remote_foreground(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv UNUSED;
 {
-    typval_T argvars[3];
+#ifdef FEAT_CLIENTSERVER
+# ifdef WIN32
+    /* On Win32 it's done in this application. */
+    {
+	char_u	*server_name = get_tv_string_chk(&argvars[0]);
 
-    argvars[0].v_type = VAR_STRING;
-    argvars[0].vval.v_string = name;
-    copy_tv(args, &argvars[1]);
+	if (server_name != NULL)
+	    serverForeground(server_name);
+    }
+# else
+    /* Send a foreground() expression to the server. */
+    argvars[1].v_type = VAR_STRING;
+    argvars[1].vval.v_string = vim_strsave((char_u *)"foreground()");
     argvars[2].v_type = VAR_UNKNOWN;
-    f_call(argvars, rettv);
-    clear_tv(&argvars[1]);
-}
+    remote_common(argvars, rettv, TRUE);
+    vim_free(argvars[1].vval.v_string);
+# endif
 #endif
+}
 
-/*
- * "nextnonblank()" function
- */
     static void
-f_nextnonblank(argvars, rettv)
-    typval_T	*argvars;
+f_remote_peek(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    linenr_T	lnum;
+#ifdef FEAT_CLIENTSERVER
+    dictitem_T	v;
+    char_u	*s = NULL;
+# ifdef WIN32
+    long_u	n = 0;
+# endif
+    char_u	*serverid;
 
-    for (lnum = get_tv_lnum(argvars); ; ++lnum)
+    if (check_restricted() || check_secure())
     {
-	if (lnum < 0 || lnum > curbuf->b_ml.ml_line_count)
-	{
-	    lnum = 0;
-	    break;
-	}
-	if (*skipwhite(ml_get(lnum)) != NUL)
-	    break;
+	rettv->vval.v_number = -1;
+	return;
     }
-    rettv->vval.v_number = lnum;
+    serverid = get_tv_string_chk(&argvars[0]);
+    if (serverid == NULL)
+    {
+	rettv->vval.v_number = -1;
+	return;		/* type error; errmsg already given */
+    }
+# ifdef WIN32
+    sscanf(serverid, SCANF_HEX_LONG_U, &n);
+    if (n == 0)
+	rettv->vval.v_number = -1;
+    else
+    {
+	s = serverGetReply((HWND)n, FALSE, FALSE, FALSE);
+	rettv->vval.v_number = (s != NULL);
+    }
+# else
+    if (check_connection() == FAIL)
+	return;
+
+    rettv->vval.v_number = serverPeekReply(X_DISPLAY,
+						serverStrToWin(serverid), &s);
+# endif
+
+    if (argvars[1].v_type != VAR_UNKNOWN && rettv->vval.v_number > 0)
+    {
+	char_u		*retvar;
+
+	v.di_tv.v_type = VAR_STRING;
+	v.di_tv.vval.v_string = vim_strsave(s);
+	retvar = get_tv_string_chk(&argvars[1]);
+	if (retvar != NULL)
+	    set_var(retvar, &v.di_tv, FALSE);
+	vim_free(v.di_tv.vval.v_string);
+    }
+#else
+    rettv->vval.v_number = -1;
+#endif
 }
 
-/*
- * "nr2char()" function
- */
     static void
-f_nr2char(argvars, rettv)
-    typval_T	*argvars;
+f_remote_read(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    char_u	buf[NUMBUFLEN];
+    char_u	*r = NULL;
 
-#ifdef FEAT_MBYTE
-    if (has_mbyte)
+#ifdef FEAT_CLIENTSERVER
+    char_u	*serverid = get_tv_string_chk(&argvars[0]);
+
+    if (serverid != NULL && !check_restricted() && !check_secure())
     {
-	int	utf8 = 0;
+# ifdef WIN32
+	/* The server's HWND is encoded in the 'id' parameter */
+	long_u		n = 0;
 
-	if (argvars[1].v_type != VAR_UNKNOWN)
-	    utf8 = get_tv_number_chk(&argvars[1], NULL);
-	if (utf8)
-	    buf[(*utf_char2bytes)((int)get_tv_number(&argvars[0]), buf)] = NUL;
-	else
-	    buf[(*mb_char2bytes)((int)get_tv_number(&argvars[0]), buf)] = NUL;
+	sscanf(serverid, SCANF_HEX_LONG_U, &n);
+	if (n != 0)
+	    r = serverGetReply((HWND)n, FALSE, TRUE, TRUE);
+	if (r == NULL)
+# else
+	if (check_connection() == FAIL || serverReadReply(X_DISPLAY,
+		serverStrToWin(serverid), &r, FALSE) < 0)
+# endif
+	    EMSG(_("E277: Unable to read a server reply"));
     }
-    else
 #endif
-    {
-	buf[0] = (char_u)get_tv_number(&argvars[0]);
-	buf[1] = NUL;
-    }
     rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = vim_strsave(buf);
+    rettv->vval.v_string = r;
 }
 
 /*
- * "or(expr, expr)" function
+ * "remote_send()" function
  */
     static void
-f_or(argvars, rettv)
-    typval_T	*argvars;
+f_remote_send(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = get_tv_number_chk(&argvars[0], NULL)
-					| get_tv_number_chk(&argvars[1], NULL);
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+#ifdef FEAT_CLIENTSERVER
+    remote_common(argvars, rettv, FALSE);
+#endif
 }
 
 /*
- * "pathshorten()" function
+ * "remove()" function
  */
     static void
-f_pathshorten(argvars, rettv)
+f_remove(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	*p;
+    list_T	*l;
+    listitem_T	*item, *item2;
+    listitem_T	*li;
+    long	idx;
+    long	end;
+    char_u	*key;
+    dict_T	*d;
+    dictitem_T	*di;
+    char	*arg_errmsg = N_("remove() argument");
 
-    rettv->v_type = VAR_STRING;
-    p = get_tv_string_chk(&argvars[0]);
-    if (p == NULL)
-	rettv->vval.v_string = NULL;
-    else
+    if (argvars[0].v_type == VAR_DICT)
     {
-	p = vim_strsave(p);
-	rettv->vval.v_string = p;
-	if (p != NULL)
-	    shorten_dir(p);
+	if (argvars[2].v_type != VAR_UNKNOWN)
+	    EMSG2(_(e_toomanyarg), "remove()");
+	else if ((d = argvars[0].vval.v_dict) != NULL
+		&& !tv_check_lock(d->dv_lock, (char_u *)_(arg_errmsg)))
+	{
+	    key = get_tv_string_chk(&argvars[1]);
+	    if (key != NULL)
+	    {
+		di = dict_find(d, key, -1);
+		if (di == NULL)
+		    EMSG2(_(e_dictkey), key);
+		else
+		{
+		    *rettv = di->di_tv;
+		    init_tv(&di->di_tv);
+		    dictitem_remove(d, di);
+		}
+	    }
+	}
+    }
+    else if (argvars[0].v_type != VAR_LIST)
+	EMSG2(_(e_listdictarg), "remove()");
+    else if ((l = argvars[0].vval.v_list) != NULL
+	    && !tv_check_lock(l->lv_lock, (char_u *)_(arg_errmsg)))
+    {
+	int	    error = FALSE;
+
+	idx = get_tv_number_chk(&argvars[1], &error);
+	if (error)
+	    ;		/* type error: do nothing, errmsg already given */
+	else if ((item = list_find(l, idx)) == NULL)
+	    EMSGN(_(e_listidx), idx);
+	else
+	{
+	    if (argvars[2].v_type == VAR_UNKNOWN)
+	    {
+		/* Remove one item, return its value. */
+		vimlist_remove(l, item, item);
+		*rettv = item->li_tv;
+		listitem_dispose(item);
+	    }
+	    else
+	    {
+		/* Remove range of items, return list with values. */
+		end = get_tv_number_chk(&argvars[2], &error);
+		if (error)
+		    ;		/* type error: do nothing */
+		else if ((item2 = list_find(l, end)) == NULL)
+		    EMSGN(_(e_listidx), end);
+		else
+		{
+		    int	    cnt = 0;
+
+		    for (li = item; li != NULL; li = li->li_next)
+		    {
+			++cnt;
+			if (li == item2)
+			    break;
+		    }
+		    if (li == NULL)  /* didn't find "item2" after "item" */
+			EMSG(_(e_invrange));
+		    else
+		    {
+			vimlist_remove(l, item, item2);
+			if (rettv_list_alloc(rettv) == OK)
+			{
+			    l = rettv->vval.v_list;
+			    l->lv_first = item;
+			    l->lv_last = item2;
+			    item->li_prev = NULL;
+			    item2->li_next = NULL;
+			    l->lv_len = cnt;
+			}
+		    }
+		}
+	    }
+	}
     }
 }
 
-#ifdef FEAT_FLOAT
 /*
- * "pow()" function
+ * "rename({from}, {to})" function
  */
     static void
-f_pow(argvars, rettv)
+f_rename(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    float_T	fx, fy;
+    char_u	buf[NUMBUFLEN];
 
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &fx) == OK
-				     && get_float_arg(&argvars[1], &fy) == OK)
-	rettv->vval.v_float = pow(fx, fy);
+    if (check_restricted() || check_secure())
+	rettv->vval.v_number = -1;
     else
-	rettv->vval.v_float = 0.0;
+	rettv->vval.v_number = vim_rename(get_tv_string(&argvars[0]),
+				      get_tv_string_buf(&argvars[1], buf));
 }
-#endif
 
 /*
- * "prevnonblank()" function
+ * "repeat()" function
  */
     static void
-f_prevnonblank(argvars, rettv)
+f_repeat(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    linenr_T	lnum;
+    char_u	*p;
+    int		n;
+    int		slen;
+    int		len;
+    char_u	*r;
+    int		i;
 
-    lnum = get_tv_lnum(argvars);
-    if (lnum < 1 || lnum > curbuf->b_ml.ml_line_count)
-	lnum = 0;
+    n = get_tv_number(&argvars[1]);
+    if (argvars[0].v_type == VAR_LIST)
+    {
+	if (rettv_list_alloc(rettv) == OK && argvars[0].vval.v_list != NULL)
+	    while (n-- > 0)
+		if (list_extend(rettv->vval.v_list,
+					argvars[0].vval.v_list, NULL) == FAIL)
+		    break;
+    }
     else
-	while (lnum >= 1 && *skipwhite(ml_get(lnum)) == NUL)
-	    --lnum;
-    rettv->vval.v_number = lnum;
-}
+    {
+	p = get_tv_string(&argvars[0]);
+	rettv->v_type = VAR_STRING;
+	rettv->vval.v_string = NULL;
 
-#ifdef HAVE_STDARG_H
-/* This dummy va_list is here because:
- * - passing a NULL pointer doesn't work when va_list isn't a pointer
- * - locally in the function results in a "used before set" warning
- * - using va_start() to initialize it gives "function with fixed args" error */
-static va_list	ap;
-#endif
+	slen = (int)STRLEN(p);
+	len = slen * n;
+	if (len <= 0)
+	    return;
+
+	r = alloc(len + 1);
+	if (r != NULL)
+	{
+	    for (i = 0; i < n; i++)
+		mch_memmove(r + i * slen, p, (size_t)slen);
+	    r[len] = NUL;
+	}
+
+	rettv->vval.v_string = r;
+    }
+}
 
 /*
- * "printf()" function
+ * "resolve()" function
  */
     static void
-f_printf(argvars, rettv)
+f_resolve(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
-#ifdef HAVE_STDARG_H	    /* only very old compilers can't do this */
+    char_u	*p;
+#ifdef HAVE_READLINK
+    char_u	*buf = NULL;
+#endif
+
+    p = get_tv_string(&argvars[0]);
+#ifdef FEAT_SHORTCUT
     {
-	char_u	buf[NUMBUFLEN];
+	char_u	*v = NULL;
+
+	v = mch_resolve_shortcut(p);
+	if (v != NULL)
+	    rettv->vval.v_string = v;
+	else
+	    rettv->vval.v_string = vim_strsave(p);
+    }
+#else
+# ifdef HAVE_READLINK
+    {
+	char_u	*cpy;
 	int	len;
-	char_u	*s;
-	int	saved_did_emsg = did_emsg;
-	char	*fmt;
+	char_u	*remain = NULL;
+	char_u	*q;
+	int	is_relative_to_current = FALSE;
+	int	has_trailing_pathsep = FALSE;
+	int	limit = 100;
 
-	/* Get the required length, allocate the buffer and do it for real. */
-	did_emsg = FALSE;
-	fmt = (char *)get_tv_string_buf(&argvars[0], buf);
-	len = vim_vsnprintf(NULL, 0, fmt, ap, argvars + 1);
-	if (!did_emsg)
+	p = vim_strsave(p);
+
+	if (p[0] == '.' && (vim_ispathsep(p[1])
+				   || (p[1] == '.' && (vim_ispathsep(p[2])))))
+	    is_relative_to_current = TRUE;
+
+	len = STRLEN(p);
+	if (len > 0 && after_pathsep(p, p + len))
 	{
-	    s = alloc(len + 1);
-	    if (s != NULL)
+	    has_trailing_pathsep = TRUE;
+	    p[len - 1] = NUL; /* the trailing slash breaks readlink() */
+	}
+
+	q = getnextcomp(p);
+	if (*q != NUL)
+	{
+	    /* Separate the first path component in "p", and keep the
+	     * remainder (beginning with the path separator). */
+	    remain = vim_strsave(q - 1);
+	    q[-1] = NUL;
+	}
+
+	buf = alloc(MAXPATHL + 1);
+	if (buf == NULL)
+	    goto fail;
+
+	for (;;)
+	{
+	    for (;;)
+	    {
+		len = readlink((char *)p, (char *)buf, MAXPATHL);
+		if (len <= 0)
+		    break;
+		buf[len] = NUL;
+
+		if (limit-- == 0)
+		{
+		    vim_free(p);
+		    vim_free(remain);
+		    EMSG(_("E655: Too many symbolic links (cycle?)"));
+		    rettv->vval.v_string = NULL;
+		    goto fail;
+		}
+
+		/* Ensure that the result will have a trailing path separator
+		 * if the argument has one. */
+		if (remain == NULL && has_trailing_pathsep)
+		    add_pathsep(buf);
+
+		/* Separate the first path component in the link value and
+		 * concatenate the remainders. */
+		q = getnextcomp(vim_ispathsep(*buf) ? buf + 1 : buf);
+		if (*q != NUL)
+		{
+		    if (remain == NULL)
+			remain = vim_strsave(q - 1);
+		    else
+		    {
+			cpy = concat_str(q - 1, remain);
+			if (cpy != NULL)
+			{
+			    vim_free(remain);
+			    remain = cpy;
+			}
+		    }
+		    q[-1] = NUL;
+		}
+
+		q = gettail(p);
+		if (q > p && *q == NUL)
+		{
+		    /* Ignore trailing path separator. */
+		    q[-1] = NUL;
+		    q = gettail(p);
+		}
+		if (q > p && !mch_isFullName(buf))
+		{
+		    /* symlink is relative to directory of argument */
+		    cpy = alloc((unsigned)(STRLEN(p) + STRLEN(buf) + 1));
+		    if (cpy != NULL)
+		    {
+			STRCPY(cpy, p);
+			STRCPY(gettail(cpy), buf);
+			vim_free(p);
+			p = cpy;
+		    }
+		}
+		else
+		{
+		    vim_free(p);
+		    p = vim_strsave(buf);
+		}
+	    }
+
+	    if (remain == NULL)
+		break;
+
+	    /* Append the first path component of "remain" to "p". */
+	    q = getnextcomp(remain + 1);
+	    len = q - remain - (*q != NUL);
+	    cpy = vim_strnsave(p, STRLEN(p) + len);
+	    if (cpy != NULL)
+	    {
+		STRNCAT(cpy, remain, len);
+		vim_free(p);
+		p = cpy;
+	    }
+	    /* Shorten "remain". */
+	    if (*q != NUL)
+		STRMOVE(remain, q - 1);
+	    else
+	    {
+		vim_free(remain);
+		remain = NULL;
+	    }
+	}
+
+	/* If the result is a relative path name, make it explicitly relative to
+	 * the current directory if and only if the argument had this form. */
+	if (!vim_ispathsep(*p))
+	{
+	    if (is_relative_to_current
+		    && *p != NUL
+		    && !(p[0] == '.'
+			&& (p[1] == NUL
+			    || vim_ispathsep(p[1])
+			    || (p[1] == '.'
+				&& (p[2] == NUL
+				    || vim_ispathsep(p[2]))))))
+	    {
+		/* Prepend "./". */
+		cpy = concat_str((char_u *)"./", p);
+		if (cpy != NULL)
+		{
+		    vim_free(p);
+		    p = cpy;
+		}
+	    }
+	    else if (!is_relative_to_current)
 	    {
-		rettv->vval.v_string = s;
-		(void)vim_vsnprintf((char *)s, len + 1, fmt, ap, argvars + 1);
+		/* Strip leading "./". */
+		q = p;
+		while (q[0] == '.' && vim_ispathsep(q[1]))
+		    q += 2;
+		if (q > p)
+		    STRMOVE(p, p + 2);
 	    }
 	}
-	did_emsg |= saved_did_emsg;
+
+	/* Ensure that the result will have no trailing path separator
+	 * if the argument had none.  But keep "/" or "//". */
+	if (!has_trailing_pathsep)
+	{
+	    q = p + STRLEN(p);
+	    if (after_pathsep(p, q))
+		*gettail_sep(p) = NUL;
+	}
+
+	rettv->vval.v_string = p;
     }
+# else
+    rettv->vval.v_string = vim_strsave(p);
+# endif
 #endif
-}
 
-/*
- * "pumvisible()" function
- */
-    static void
-f_pumvisible(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
-{
-#ifdef FEAT_INS_EXPAND
-    if (pum_visible())
-	rettv->vval.v_number = 1;
+    simplify_filename(rettv->vval.v_string);
+
+#ifdef HAVE_READLINK
+fail:
+    vim_free(buf);
 #endif
+    rettv->v_type = VAR_STRING;
 }
 
-#ifdef FEAT_PYTHON3
 /*
- * "py3eval()" function
+ * "reverse({list})" function
  */
     static void
-f_py3eval(argvars, rettv)
+f_reverse(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	*str;
-    char_u	buf[NUMBUFLEN];
+    list_T	*l;
+    listitem_T	*li, *ni;
 
-    str = get_tv_string_buf(&argvars[0], buf);
-    do_py3eval(str, rettv);
+    if (argvars[0].v_type != VAR_LIST)
+	EMSG2(_(e_listarg), "reverse()");
+    else if ((l = argvars[0].vval.v_list) != NULL
+	    && !tv_check_lock(l->lv_lock, (char_u *)_("reverse() argument")))
+    {
+	li = l->lv_last;
+	l->lv_first = l->lv_last = NULL;
+	l->lv_len = 0;
+	while (li != NULL)
+	{
+	    ni = li->li_prev;
+	    list_append(l, li);
+	    li = ni;
+	}
+	rettv->vval.v_list = l;
+	rettv->v_type = VAR_LIST;
+	++l->lv_refcount;
+	l->lv_idx = l->lv_len - l->lv_idx - 1;
+    }
 }
-#endif
 
-#ifdef FEAT_PYTHON
-/*
- * "pyeval()" function
- */
-    static void
-f_pyeval(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    char_u	*str;
-    char_u	buf[NUMBUFLEN];
+#define SP_NOMOVE	0x01	    /* don't move cursor */
+#define SP_REPEAT	0x02	    /* repeat to find outer pair */
+#define SP_RETCOUNT	0x04	    /* return matchcount */
+#define SP_SETPCMARK	0x08	    /* set previous context mark */
+#define SP_START	0x10	    /* accept match at start position */
+#define SP_SUBPAT	0x20	    /* return nr of matching sub-pattern */
+#define SP_END		0x40	    /* leave cursor at end of match */
 
-    str = get_tv_string_buf(&argvars[0], buf);
-    do_pyeval(str, rettv);
-}
-#endif
+static int get_search_arg __ARGS((typval_T *varp, int *flagsp));
 
 /*
- * "range()" function
+ * Get flags for a search function.
+ * Possibly sets "p_ws".
+ * Returns BACKWARD, FORWARD or zero (for an error).
  */
-    static void
-f_range(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static int
+get_search_arg(varp, flagsp)
+    typval_T	*varp;
+    int		*flagsp;
 {
-    long	start;
-    long	end;
-    long	stride = 1;
-    long	i;
-    int		error = FALSE;
-
-    start = get_tv_number_chk(&argvars[0], &error);
-    if (argvars[1].v_type == VAR_UNKNOWN)
-    {
-	end = start - 1;
-	start = 0;
-    }
-    else
-    {
-	end = get_tv_number_chk(&argvars[1], &error);
-	if (argvars[2].v_type != VAR_UNKNOWN)
-	    stride = get_tv_number_chk(&argvars[2], &error);
-    }
+    int		dir = FORWARD;
+    char_u	*flags;
+    char_u	nbuf[NUMBUFLEN];
+    int		mask;
 
-    if (error)
-	return;		/* type error; errmsg already given */
-    if (stride == 0)
-	EMSG(_("E726: Stride is zero"));
-    else if (stride > 0 ? end + 1 < start : end - 1 > start)
-	EMSG(_("E727: Start past end"));
-    else
+    if (varp->v_type != VAR_UNKNOWN)
     {
-	if (rettv_list_alloc(rettv) == OK)
-	    for (i = start; stride > 0 ? i <= end : i >= end; i += stride)
-		if (list_append_number(rettv->vval.v_list,
-						      (varnumber_T)i) == FAIL)
-		    break;
+	flags = get_tv_string_buf_chk(varp, nbuf);
+	if (flags == NULL)
+	    return 0;		/* type error; errmsg already given */
+	while (*flags != NUL)
+	{
+	    switch (*flags)
+	    {
+		case 'b': dir = BACKWARD; break;
+		case 'w': p_ws = TRUE; break;
+		case 'W': p_ws = FALSE; break;
+		default:  mask = 0;
+			  if (flagsp != NULL)
+			     switch (*flags)
+			     {
+				 case 'c': mask = SP_START; break;
+				 case 'e': mask = SP_END; break;
+				 case 'm': mask = SP_RETCOUNT; break;
+				 case 'n': mask = SP_NOMOVE; break;
+				 case 'p': mask = SP_SUBPAT; break;
+				 case 'r': mask = SP_REPEAT; break;
+				 case 's': mask = SP_SETPCMARK; break;
+			     }
+			  if (mask == 0)
+			  {
+			      EMSG2(_(e_invarg2), flags);
+			      dir = 0;
+			  }
+			  else
+			      *flagsp |= mask;
+	    }
+	    if (dir == 0)
+		break;
+	    ++flags;
+	}
     }
+    return dir;
 }
 
 /*
- * "readfile()" function
+ * Shared by search() and searchpos() functions
  */
-    static void
-f_readfile(argvars, rettv)
+    static int
+search_cmn(argvars, match_pos, flagsp)
     typval_T	*argvars;
-    typval_T	*rettv;
+    pos_T	*match_pos;
+    int		*flagsp;
 {
-    int		binary = FALSE;
-    int		failed = FALSE;
-    char_u	*fname;
-    FILE	*fd;
-    char_u	buf[(IOSIZE/256)*256];	/* rounded to avoid odd + 1 */
-    int		io_size = sizeof(buf);
-    int		readlen;		/* size of last fread() */
-    char_u	*prev	 = NULL;	/* previously read bytes, if any */
-    long	prevlen  = 0;		/* length of data in prev */
-    long	prevsize = 0;		/* size of prev buffer */
-    long	maxline  = MAXLNUM;
-    long	cnt	 = 0;
-    char_u	*p;			/* position in buf */
-    char_u	*start;			/* start of current line */
+    int		flags;
+    char_u	*pat;
+    pos_T	pos;
+    pos_T	save_cursor;
+    int		save_p_ws = p_ws;
+    int		dir;
+    int		retval = 0;	/* default: FAIL */
+    long	lnum_stop = 0;
+    proftime_T	tm;
+#ifdef FEAT_RELTIME
+    long	time_limit = 0;
+#endif
+    int		options = SEARCH_KEEP;
+    int		subpatnum;
 
-    if (argvars[1].v_type != VAR_UNKNOWN)
+    pat = get_tv_string(&argvars[0]);
+    dir = get_search_arg(&argvars[1], flagsp);	/* may set p_ws */
+    if (dir == 0)
+	goto theend;
+    flags = *flagsp;
+    if (flags & SP_START)
+	options |= SEARCH_START;
+    if (flags & SP_END)
+	options |= SEARCH_END;
+
+    /* Optional arguments: line number to stop searching and timeout. */
+    if (argvars[1].v_type != VAR_UNKNOWN && argvars[2].v_type != VAR_UNKNOWN)
     {
-	if (STRCMP(get_tv_string(&argvars[1]), "b") == 0)
-	    binary = TRUE;
-	if (argvars[2].v_type != VAR_UNKNOWN)
-	    maxline = get_tv_number(&argvars[2]);
+	lnum_stop = get_tv_number_chk(&argvars[2], NULL);
+	if (lnum_stop < 0)
+	    goto theend;
+#ifdef FEAT_RELTIME
+	if (argvars[3].v_type != VAR_UNKNOWN)
+	{
+	    time_limit = get_tv_number_chk(&argvars[3], NULL);
+	    if (time_limit < 0)
+		goto theend;
+	}
+#endif
     }
 
-    if (rettv_list_alloc(rettv) == FAIL)
-	return;
-
-    /* Always open the file in binary mode, library functions have a mind of
-     * their own about CR-LF conversion. */
-    fname = get_tv_string(&argvars[0]);
-    if (*fname == NUL || (fd = mch_fopen((char *)fname, READBIN)) == NULL)
+#ifdef FEAT_RELTIME
+    /* Set the time limit, if there is one. */
+    profile_setlimit(time_limit, &tm);
+#endif
+
+    /*
+     * This function does not accept SP_REPEAT and SP_RETCOUNT flags.
+     * Check to make sure only those flags are set.
+     * Also, Only the SP_NOMOVE or the SP_SETPCMARK flag can be set. Both
+     * flags cannot be set. Check for that condition also.
+     */
+    if (((flags & (SP_REPEAT | SP_RETCOUNT)) != 0)
+	    || ((flags & SP_NOMOVE) && (flags & SP_SETPCMARK)))
     {
-	EMSG2(_(e_notopen), *fname == NUL ? (char_u *)_("<empty>") : fname);
-	return;
+	EMSG2(_(e_invarg2), get_tv_string(&argvars[1]));
+	goto theend;
     }
 
-    while (cnt < maxline || maxline < 0)
+    pos = save_cursor = curwin->w_cursor;
+    subpatnum = searchit(curwin, curbuf, &pos, dir, pat, 1L,
+				options, RE_SEARCH, (linenr_T)lnum_stop, &tm);
+    if (subpatnum != FAIL)
     {
-	readlen = (int)fread(buf, 1, io_size, fd);
-
-	/* This for loop processes what was read, but is also entered at end
-	 * of file so that either:
-	 * - an incomplete line gets written
-	 * - a "binary" file gets an empty line at the end if it ends in a
-	 *   newline.  */
-	for (p = buf, start = buf;
-		p < buf + readlen || (readlen <= 0 && (prevlen > 0 || binary));
-		++p)
+	if (flags & SP_SUBPAT)
+	    retval = subpatnum;
+	else
+	    retval = pos.lnum;
+	if (flags & SP_SETPCMARK)
+	    setpcmark();
+	curwin->w_cursor = pos;
+	if (match_pos != NULL)
 	{
-	    if (*p == '\n' || readlen <= 0)
-	    {
-		listitem_T  *li;
-		char_u	    *s	= NULL;
-		long_u	    len = p - start;
+	    /* Store the match cursor position */
+	    match_pos->lnum = pos.lnum;
+	    match_pos->col = pos.col + 1;
+	}
+	/* "/$" will put the cursor after the end of the line, may need to
+	 * correct that here */
+	check_cursor();
+    }
 
-		/* Finished a line.  Remove CRs before NL. */
-		if (readlen > 0 && !binary)
-		{
-		    while (len > 0 && start[len - 1] == '\r')
-			--len;
-		    /* removal may cross back to the "prev" string */
-		    if (len == 0)
-			while (prevlen > 0 && prev[prevlen - 1] == '\r')
-			    --prevlen;
-		}
-		if (prevlen == 0)
-		    s = vim_strnsave(start, (int)len);
-		else
-		{
-		    /* Change "prev" buffer to be the right size.  This way
-		     * the bytes are only copied once, and very long lines are
-		     * allocated only once.  */
-		    if ((s = vim_realloc(prev, prevlen + len + 1)) != NULL)
-		    {
-			mch_memmove(s + prevlen, start, len);
-			s[prevlen + len] = NUL;
-			prev = NULL; /* the list will own the string */
-			prevlen = prevsize = 0;
-		    }
-		}
-		if (s == NULL)
-		{
-		    do_outofmem_msg((long_u) prevlen + len + 1);
-		    failed = TRUE;
-		    break;
-		}
+    /* If 'n' flag is used: restore cursor position. */
+    if (flags & SP_NOMOVE)
+	curwin->w_cursor = save_cursor;
+    else
+	curwin->w_set_curswant = TRUE;
+theend:
+    p_ws = save_p_ws;
 
-		if ((li = listitem_alloc()) == NULL)
-		{
-		    vim_free(s);
-		    failed = TRUE;
-		    break;
-		}
-		li->li_tv.v_type = VAR_STRING;
-		li->li_tv.v_lock = 0;
-		li->li_tv.vval.v_string = s;
-		list_append(rettv->vval.v_list, li);
+    return retval;
+}
 
-		start = p + 1; /* step over newline */
-		if ((++cnt >= maxline && maxline >= 0) || readlen <= 0)
-		    break;
-	    }
-	    else if (*p == NUL)
-		*p = '\n';
-#ifdef FEAT_MBYTE
-	    /* Check for utf8 "bom"; U+FEFF is encoded as EF BB BF.  Do this
-	     * when finding the BF and check the previous two bytes. */
-	    else if (*p == 0xbf && enc_utf8 && !binary)
-	    {
-		/* Find the two bytes before the 0xbf.	If p is at buf, or buf
-		 * + 1, these may be in the "prev" string. */
-		char_u back1 = p >= buf + 1 ? p[-1]
-				     : prevlen >= 1 ? prev[prevlen - 1] : NUL;
-		char_u back2 = p >= buf + 2 ? p[-2]
-			  : p == buf + 1 && prevlen >= 1 ? prev[prevlen - 1]
-			  : prevlen >= 2 ? prev[prevlen - 2] : NUL;
+#ifdef FEAT_FLOAT
 
-		if (back2 == 0xef && back1 == 0xbb)
-		{
-		    char_u *dest = p - 2;
+/*
+ * round() is not in C90, use ceil() or floor() instead.
+ */
+    float_T
+vim_round(f)
+    float_T f;
+{
+    return f > 0 ? floor(f + 0.5) : ceil(f - 0.5);
+}
 
-		    /* Usually a BOM is at the beginning of a file, and so at
-		     * the beginning of a line; then we can just step over it.
-		     */
-		    if (start == dest)
-			start = p + 1;
-		    else
-		    {
-			/* have to shuffle buf to close gap */
-			int adjust_prevlen = 0;
+/*
+ * "round({float})" function
+ */
+    static void
+f_round(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    float_T	f;
 
-			if (dest < buf)
-			{
-			    adjust_prevlen = (int)(buf - dest); /* must be 1 or 2 */
-			    dest = buf;
-			}
-			if (readlen > p - buf + 1)
-			    mch_memmove(dest, p + 1, readlen - (p - buf) - 1);
-			readlen -= 3 - adjust_prevlen;
-			prevlen -= adjust_prevlen;
-			p = dest - 1;
-		    }
-		}
-	    }
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	rettv->vval.v_float = vim_round(f);
+    else
+	rettv->vval.v_float = 0.0;
+}
 #endif
-	} /* for */
 
-	if (failed || (cnt >= maxline && maxline >= 0) || readlen <= 0)
-	    break;
-	if (start < p)
-	{
-	    /* There's part of a line in buf, store it in "prev". */
-	    if (p - start + prevlen >= prevsize)
-	    {
-		/* need bigger "prev" buffer */
-		char_u *newprev;
+/*
+ * "screenattr()" function
+ */
+    static void
+f_screenattr(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    int		row;
+    int		col;
+    int		c;
 
-		/* A common use case is ordinary text files and "prev" gets a
-		 * fragment of a line, so the first allocation is made
-		 * small, to avoid repeatedly 'allocing' large and
-		 * 'reallocing' small. */
-		if (prevsize == 0)
-		    prevsize = (long)(p - start);
-		else
-		{
-		    long grow50pc = (prevsize * 3) / 2;
-		    long growmin  = (long)((p - start) * 2 + prevlen);
-		    prevsize = grow50pc > growmin ? grow50pc : growmin;
-		}
-		newprev = prev == NULL ? alloc(prevsize)
-						: vim_realloc(prev, prevsize);
-		if (newprev == NULL)
-		{
-		    do_outofmem_msg((long_u)prevsize);
-		    failed = TRUE;
-		    break;
-		}
-		prev = newprev;
-	    }
-	    /* Add the line part to end of "prev". */
-	    mch_memmove(prev + prevlen, start, p - start);
-	    prevlen += (long)(p - start);
-	}
-    } /* while */
+    row = get_tv_number_chk(&argvars[0], NULL) - 1;
+    col = get_tv_number_chk(&argvars[1], NULL) - 1;
+    if (row < 0 || row >= screen_Rows
+	    || col < 0 || col >= screen_Columns)
+	c = -1;
+    else
+	c = ScreenAttrs[LineOffset[row] + col];
+    rettv->vval.v_number = c;
+}
 
-    /*
-     * For a negative line count use only the lines at the end of the file,
-     * free the rest.
-     */
-    if (!failed && maxline < 0)
-	while (cnt > -maxline)
-	{
-	    listitem_remove(rettv->vval.v_list, rettv->vval.v_list->lv_first);
-	    --cnt;
-	}
+/*
+ * "screenchar()" function
+ */
+    static void
+f_screenchar(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    int		row;
+    int		col;
+    int		off;
+    int		c;
 
-    if (failed)
+    row = get_tv_number_chk(&argvars[0], NULL) - 1;
+    col = get_tv_number_chk(&argvars[1], NULL) - 1;
+    if (row < 0 || row >= screen_Rows
+	    || col < 0 || col >= screen_Columns)
+	c = -1;
+    else
     {
-	list_free(rettv->vval.v_list, TRUE);
-	/* readfile doc says an empty list is returned on error */
-	rettv->vval.v_list = list_alloc();
+	off = LineOffset[row] + col;
+#ifdef FEAT_MBYTE
+	if (enc_utf8 && ScreenLinesUC[off] != 0)
+	    c = ScreenLinesUC[off];
+	else
+#endif
+	    c = ScreenLines[off];
     }
+    rettv->vval.v_number = c;
+}
 
-    vim_free(prev);
-    fclose(fd);
+/*
+ * "screencol()" function
+ *
+ * First column is 1 to be consistent with virtcol().
+ */
+    static void
+f_screencol(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    rettv->vval.v_number = screen_screencol() + 1;
 }
 
-#if defined(FEAT_RELTIME)
-static int list2proftime __ARGS((typval_T *arg, proftime_T *tm));
+/*
+ * "screenrow()" function
+ */
+    static void
+f_screenrow(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    rettv->vval.v_number = screen_screenrow() + 1;
+}
 
 /*
- * Convert a List to proftime_T.
- * Return FAIL when there is something wrong.
+ * "search()" function
  */
-    static int
-list2proftime(arg, tm)
-    typval_T	*arg;
-    proftime_T  *tm;
+    static void
+f_search(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
 {
-    long	n1, n2;
-    int	error = FALSE;
+    int		flags = 0;
 
-    if (arg->v_type != VAR_LIST || arg->vval.v_list == NULL
-					     || arg->vval.v_list->lv_len != 2)
-	return FAIL;
-    n1 = list_find_nr(arg->vval.v_list, 0L, &error);
-    n2 = list_find_nr(arg->vval.v_list, 1L, &error);
-# ifdef WIN3264
-    tm->HighPart = n1;
-    tm->LowPart = n2;
-# else
-    tm->tv_sec = n1;
-    tm->tv_usec = n2;
-# endif
-    return error ? FAIL : OK;
+    rettv->vval.v_number = search_cmn(argvars, NULL, &flags);
 }
-#endif /* FEAT_RELTIME */
 
 /*
- * "reltime()" function
+ * "searchdecl()" function
  */
     static void
-f_reltime(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
+f_searchdecl(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
 {
-#ifdef FEAT_RELTIME
-    proftime_T	res;
-    proftime_T	start;
+    int		locally = 1;
+    int		thisblock = 0;
+    int		error = FALSE;
+    char_u	*name;
 
-    if (argvars[0].v_type == VAR_UNKNOWN)
+    rettv->vval.v_number = 1;	/* default: FAIL */
+
+    name = get_tv_string_chk(&argvars[0]);
+    if (argvars[1].v_type != VAR_UNKNOWN)
     {
-	/* No arguments: get current time. */
-	profile_start(&res);
+	locally = get_tv_number_chk(&argvars[1], &error) == 0;
+	if (!error && argvars[2].v_type != VAR_UNKNOWN)
+	    thisblock = get_tv_number_chk(&argvars[2], &error) != 0;
     }
-    else if (argvars[1].v_type == VAR_UNKNOWN)
+    if (!error && name != NULL)
+	rettv->vval.v_number = find_decl(name, (int)STRLEN(name),
+				     locally, thisblock, SEARCH_KEEP) == FAIL;
+}
+
+/*
+ * Used by searchpair() and searchpairpos()
+ */
+    static int
+searchpair_cmn(argvars, match_pos)
+    typval_T	*argvars;
+    pos_T	*match_pos;
+{
+    char_u	*spat, *mpat, *epat;
+    char_u	*skip;
+    int		save_p_ws = p_ws;
+    int		dir;
+    int		flags = 0;
+    char_u	nbuf1[NUMBUFLEN];
+    char_u	nbuf2[NUMBUFLEN];
+    char_u	nbuf3[NUMBUFLEN];
+    int		retval = 0;		/* default: FAIL */
+    long	lnum_stop = 0;
+    long	time_limit = 0;
+
+    /* Get the three pattern arguments: start, middle, end. */
+    spat = get_tv_string_chk(&argvars[0]);
+    mpat = get_tv_string_buf_chk(&argvars[1], nbuf1);
+    epat = get_tv_string_buf_chk(&argvars[2], nbuf2);
+    if (spat == NULL || mpat == NULL || epat == NULL)
+	goto theend;	    /* type error */
+
+    /* Handle the optional fourth argument: flags */
+    dir = get_search_arg(&argvars[3], &flags); /* may set p_ws */
+    if (dir == 0)
+	goto theend;
+
+    /* Don't accept SP_END or SP_SUBPAT.
+     * Only one of the SP_NOMOVE or SP_SETPCMARK flags can be set.
+     */
+    if ((flags & (SP_END | SP_SUBPAT)) != 0
+	    || ((flags & SP_NOMOVE) && (flags & SP_SETPCMARK)))
     {
-	if (list2proftime(&argvars[0], &res) == FAIL)
-	    return;
-	profile_end(&res);
+	EMSG2(_(e_invarg2), get_tv_string(&argvars[3]));
+	goto theend;
     }
+
+    /* Using 'r' implies 'W', otherwise it doesn't work. */
+    if (flags & SP_REPEAT)
+	p_ws = FALSE;
+
+    /* Optional fifth argument: skip expression */
+    if (argvars[3].v_type == VAR_UNKNOWN
+	    || argvars[4].v_type == VAR_UNKNOWN)
+	skip = (char_u *)"";
     else
     {
-	/* Two arguments: compute the difference. */
-	if (list2proftime(&argvars[0], &start) == FAIL
-		|| list2proftime(&argvars[1], &res) == FAIL)
-	    return;
-	profile_sub(&res, &start);
+	skip = get_tv_string_buf_chk(&argvars[4], nbuf3);
+	if (argvars[5].v_type != VAR_UNKNOWN)
+	{
+	    lnum_stop = get_tv_number_chk(&argvars[5], NULL);
+	    if (lnum_stop < 0)
+		goto theend;
+#ifdef FEAT_RELTIME
+	    if (argvars[6].v_type != VAR_UNKNOWN)
+	    {
+		time_limit = get_tv_number_chk(&argvars[6], NULL);
+		if (time_limit < 0)
+		    goto theend;
+	    }
+#endif
+	}
     }
+    if (skip == NULL)
+	goto theend;	    /* type error */
 
-    if (rettv_list_alloc(rettv) == OK)
-    {
-	long	n1, n2;
+    retval = do_searchpair(spat, mpat, epat, dir, skip, flags,
+					    match_pos, lnum_stop, time_limit);
 
-# ifdef WIN3264
-	n1 = res.HighPart;
-	n2 = res.LowPart;
-# else
-	n1 = res.tv_sec;
-	n2 = res.tv_usec;
-# endif
-	list_append_number(rettv->vval.v_list, (varnumber_T)n1);
-	list_append_number(rettv->vval.v_list, (varnumber_T)n2);
-    }
-#endif
+theend:
+    p_ws = save_p_ws;
+
+    return retval;
 }
 
 /*
- * "reltimestr()" function
+ * "searchpair()" function
  */
     static void
-f_reltimestr(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_searchpair(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-#ifdef FEAT_RELTIME
+    rettv->vval.v_number = searchpair_cmn(argvars, NULL);
+}
+
+/*
+ * "searchpairpos()" function
+ */
+    static void
+f_searchpairpos(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    pos_T	match_pos;
+    int		lnum = 0;
+    int		col = 0;
+
+    if (rettv_list_alloc(rettv) == FAIL)
+	return;
+
+    if (searchpair_cmn(argvars, &match_pos) > 0)
+    {
+	lnum = match_pos.lnum;
+	col = match_pos.col;
+    }
+
+    list_append_number(rettv->vval.v_list, (varnumber_T)lnum);
+    list_append_number(rettv->vval.v_list, (varnumber_T)col);
+}
+
+/*
+ * Search for a start/middle/end thing.
+ * Used by searchpair(), see its documentation for the details.
+ * Returns 0 or -1 for no match,
+ */
+    long
+do_searchpair(spat, mpat, epat, dir, skip, flags, match_pos,
+							lnum_stop, time_limit)
+    char_u	*spat;	    /* start pattern */
+    char_u	*mpat;	    /* middle pattern */
+    char_u	*epat;	    /* end pattern */
+    int		dir;	    /* BACKWARD or FORWARD */
+    char_u	*skip;	    /* skip expression */
+    int		flags;	    /* SP_SETPCMARK and other SP_ values */
+    pos_T	*match_pos;
+    linenr_T	lnum_stop;  /* stop at this line if not zero */
+    long	time_limit UNUSED; /* stop after this many msec */
+{
+    char_u	*save_cpo;
+    char_u	*pat, *pat2 = NULL, *pat3 = NULL;
+    long	retval = 0;
+    pos_T	pos;
+    pos_T	firstpos;
+    pos_T	foundpos;
+    pos_T	save_cursor;
+    pos_T	save_pos;
+    int		n;
+    int		r;
+    int		nest = 1;
+    int		err;
+    int		options = SEARCH_KEEP;
     proftime_T	tm;
-#endif
 
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
+    /* Make 'cpoptions' empty, the 'l' flag should not be used here. */
+    save_cpo = p_cpo;
+    p_cpo = empty_option;
+
 #ifdef FEAT_RELTIME
-    if (list2proftime(&argvars[0], &tm) == OK)
-	rettv->vval.v_string = vim_strsave((char_u *)profile_msg(&tm));
+    /* Set the time limit, if there is one. */
+    profile_setlimit(time_limit, &tm);
 #endif
-}
 
-#if defined(FEAT_CLIENTSERVER) && defined(FEAT_X11)
-static void make_connection __ARGS((void));
-static int check_connection __ARGS((void));
+    /* Make two search patterns: start/end (pat2, for in nested pairs) and
+     * start/middle/end (pat3, for the top pair). */
+    pat2 = alloc((unsigned)(STRLEN(spat) + STRLEN(epat) + 15));
+    pat3 = alloc((unsigned)(STRLEN(spat) + STRLEN(mpat) + STRLEN(epat) + 23));
+    if (pat2 == NULL || pat3 == NULL)
+	goto theend;
+    sprintf((char *)pat2, "\\(%s\\m\\)\\|\\(%s\\m\\)", spat, epat);
+    if (*mpat == NUL)
+	STRCPY(pat3, pat2);
+    else
+	sprintf((char *)pat3, "\\(%s\\m\\)\\|\\(%s\\m\\)\\|\\(%s\\m\\)",
+							    spat, epat, mpat);
+    if (flags & SP_START)
+	options |= SEARCH_START;
 
-    static void
-make_connection()
-{
-    if (X_DISPLAY == NULL
-# ifdef FEAT_GUI
-	    && !gui.in_use
-# endif
-	    )
+    save_cursor = curwin->w_cursor;
+    pos = curwin->w_cursor;
+    clearpos(&firstpos);
+    clearpos(&foundpos);
+    pat = pat3;
+    for (;;)
     {
-	x_force_connect = TRUE;
-	setup_term_clip();
-	x_force_connect = FALSE;
-    }
-}
+	n = searchit(curwin, curbuf, &pos, dir, pat, 1L,
+					   options, RE_SEARCH, lnum_stop, &tm);
+	if (n == FAIL || (firstpos.lnum != 0 && equalpos(pos, firstpos)))
+	    /* didn't find it or found the first match again: FAIL */
+	    break;
 
-    static int
-check_connection()
-{
-    make_connection();
-    if (X_DISPLAY == NULL)
-    {
-	EMSG(_("E240: No connection to Vim server"));
-	return FAIL;
-    }
-    return OK;
-}
-#endif
+	if (firstpos.lnum == 0)
+	    firstpos = pos;
+	if (equalpos(pos, foundpos))
+	{
+	    /* Found the same position again.  Can happen with a pattern that
+	     * has "\zs" at the end and searching backwards.  Advance one
+	     * character and try again. */
+	    if (dir == BACKWARD)
+		decl(&pos);
+	    else
+		incl(&pos);
+	}
+	foundpos = pos;
 
-#ifdef FEAT_CLIENTSERVER
-static void remote_common __ARGS((typval_T *argvars, typval_T *rettv, int expr));
+	/* clear the start flag to avoid getting stuck here */
+	options &= ~SEARCH_START;
 
-    static void
-remote_common(argvars, rettv, expr)
-    typval_T	*argvars;
-    typval_T	*rettv;
-    int		expr;
-{
-    char_u	*server_name;
-    char_u	*keys;
-    char_u	*r = NULL;
-    char_u	buf[NUMBUFLEN];
-# ifdef WIN32
-    HWND	w;
-# else
-    Window	w;
-# endif
+	/* If the skip pattern matches, ignore this match. */
+	if (*skip != NUL)
+	{
+	    save_pos = curwin->w_cursor;
+	    curwin->w_cursor = pos;
+	    r = eval_to_bool(skip, &err, NULL, FALSE);
+	    curwin->w_cursor = save_pos;
+	    if (err)
+	    {
+		/* Evaluating {skip} caused an error, break here. */
+		curwin->w_cursor = save_cursor;
+		retval = -1;
+		break;
+	    }
+	    if (r)
+		continue;
+	}
 
-    if (check_restricted() || check_secure())
-	return;
+	if ((dir == BACKWARD && n == 3) || (dir == FORWARD && n == 2))
+	{
+	    /* Found end when searching backwards or start when searching
+	     * forward: nested pair. */
+	    ++nest;
+	    pat = pat2;		/* nested, don't search for middle */
+	}
+	else
+	{
+	    /* Found end when searching forward or start when searching
+	     * backward: end of (nested) pair; or found middle in outer pair. */
+	    if (--nest == 1)
+		pat = pat3;	/* outer level, search for middle */
+	}
 
-# ifdef FEAT_X11
-    if (check_connection() == FAIL)
-	return;
-# endif
+	if (nest == 0)
+	{
+	    /* Found the match: return matchcount or line number. */
+	    if (flags & SP_RETCOUNT)
+		++retval;
+	    else
+		retval = pos.lnum;
+	    if (flags & SP_SETPCMARK)
+		setpcmark();
+	    curwin->w_cursor = pos;
+	    if (!(flags & SP_REPEAT))
+		break;
+	    nest = 1;	    /* search for next unmatched */
+	}
+    }
 
-    server_name = get_tv_string_chk(&argvars[0]);
-    if (server_name == NULL)
-	return;		/* type error; errmsg already given */
-    keys = get_tv_string_buf(&argvars[1], buf);
-# ifdef WIN32
-    if (serverSendToVim(server_name, keys, &r, &w, expr, TRUE) < 0)
-# else
-    if (serverSendToVim(X_DISPLAY, server_name, keys, &r, &w, expr, 0, TRUE)
-									  < 0)
-# endif
+    if (match_pos != NULL)
     {
-	if (r != NULL)
-	    EMSG(r);		/* sending worked but evaluation failed */
-	else
-	    EMSG2(_("E241: Unable to send to %s"), server_name);
-	return;
+	/* Store the match cursor position */
+	match_pos->lnum = curwin->w_cursor.lnum;
+	match_pos->col = curwin->w_cursor.col + 1;
     }
 
-    rettv->vval.v_string = r;
+    /* If 'n' flag is used or search failed: restore cursor position. */
+    if ((flags & SP_NOMOVE) || retval == 0)
+	curwin->w_cursor = save_cursor;
 
-    if (argvars[2].v_type != VAR_UNKNOWN)
-    {
-	dictitem_T	v;
-	char_u		str[30];
-	char_u		*idvar;
+theend:
+    vim_free(pat2);
+    vim_free(pat3);
+    if (p_cpo == empty_option)
+	p_cpo = save_cpo;
+    else
+	/* Darn, evaluating the {skip} expression changed the value. */
+	free_string_option(save_cpo);
 
-	sprintf((char *)str, PRINTF_HEX_LONG_U, (long_u)w);
-	v.di_tv.v_type = VAR_STRING;
-	v.di_tv.vval.v_string = vim_strsave(str);
-	idvar = get_tv_string_chk(&argvars[2]);
-	if (idvar != NULL)
-	    set_var(idvar, &v.di_tv, FALSE);
-	vim_free(v.di_tv.vval.v_string);
-    }
+    return retval;
 }
-#endif
 
 /*
- * "remote_expr()" function
+ * "searchpos()" function
  */
     static void
-f_remote_expr(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_searchpos(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
-#ifdef FEAT_CLIENTSERVER
-    remote_common(argvars, rettv, TRUE);
-#endif
-}
+    pos_T	match_pos;
+    int		lnum = 0;
+    int		col = 0;
+    int		n;
+    int		flags = 0;
 
-/*
- * "remote_foreground()" function
- */
-    static void
-f_remote_foreground(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
-{
-#ifdef FEAT_CLIENTSERVER
-# ifdef WIN32
-    /* On Win32 it's done in this application. */
-    {
-	char_u	*server_name = get_tv_string_chk(&argvars[0]);
+    if (rettv_list_alloc(rettv) == FAIL)
+	return;
 
-	if (server_name != NULL)
-	    serverForeground(server_name);
+    n = search_cmn(argvars, &match_pos, &flags);
+    if (n > 0)
+    {
+	lnum = match_pos.lnum;
+	col = match_pos.col;
     }
-# else
-    /* Send a foreground() expression to the server. */
-    argvars[1].v_type = VAR_STRING;
-    argvars[1].vval.v_string = vim_strsave((char_u *)"foreground()");
-    argvars[2].v_type = VAR_UNKNOWN;
-    remote_common(argvars, rettv, TRUE);
-    vim_free(argvars[1].vval.v_string);
-# endif
-#endif
+
+    list_append_number(rettv->vval.v_list, (varnumber_T)lnum);
+    list_append_number(rettv->vval.v_list, (varnumber_T)col);
+    if (flags & SP_SUBPAT)
+	list_append_number(rettv->vval.v_list, (varnumber_T)n);
 }
 
+
     static void
-f_remote_peek(argvars, rettv)
+f_server2client(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
 #ifdef FEAT_CLIENTSERVER
-    dictitem_T	v;
-    char_u	*s = NULL;
-# ifdef WIN32
-    long_u	n = 0;
-# endif
-    char_u	*serverid;
+    char_u	buf[NUMBUFLEN];
+    char_u	*server = get_tv_string_chk(&argvars[0]);
+    char_u	*reply = get_tv_string_buf_chk(&argvars[1], buf);
 
+    rettv->vval.v_number = -1;
+    if (server == NULL || reply == NULL)
+	return;
     if (check_restricted() || check_secure())
-    {
-	rettv->vval.v_number = -1;
 	return;
-    }
-    serverid = get_tv_string_chk(&argvars[0]);
-    if (serverid == NULL)
-    {
-	rettv->vval.v_number = -1;
-	return;		/* type error; errmsg already given */
-    }
-# ifdef WIN32
-    sscanf(serverid, SCANF_HEX_LONG_U, &n);
-    if (n == 0)
-	rettv->vval.v_number = -1;
-    else
-    {
-	s = serverGetReply((HWND)n, FALSE, FALSE, FALSE);
-	rettv->vval.v_number = (s != NULL);
-    }
-# else
+# ifdef FEAT_X11
     if (check_connection() == FAIL)
 	return;
-
-    rettv->vval.v_number = serverPeekReply(X_DISPLAY,
-						serverStrToWin(serverid), &s);
 # endif
 
-    if (argvars[1].v_type != VAR_UNKNOWN && rettv->vval.v_number > 0)
+    if (serverSendReply(server, reply) < 0)
     {
-	char_u		*retvar;
-
-	v.di_tv.v_type = VAR_STRING;
-	v.di_tv.vval.v_string = vim_strsave(s);
-	retvar = get_tv_string_chk(&argvars[1]);
-	if (retvar != NULL)
-	    set_var(retvar, &v.di_tv, FALSE);
-	vim_free(v.di_tv.vval.v_string);
+	EMSG(_("E258: Unable to send to client"));
+	return;
     }
+    rettv->vval.v_number = 0;
 #else
     rettv->vval.v_number = -1;
 #endif
 }
 
     static void
-f_remote_read(argvars, rettv)
+f_serverlist(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
     char_u	*r = NULL;
 
 #ifdef FEAT_CLIENTSERVER
-    char_u	*serverid = get_tv_string_chk(&argvars[0]);
-
-    if (serverid != NULL && !check_restricted() && !check_secure())
-    {
 # ifdef WIN32
-	/* The server's HWND is encoded in the 'id' parameter */
-	long_u		n = 0;
-
-	sscanf(serverid, SCANF_HEX_LONG_U, &n);
-	if (n != 0)
-	    r = serverGetReply((HWND)n, FALSE, TRUE, TRUE);
-	if (r == NULL)
+    r = serverGetVimNames();
 # else
-	if (check_connection() == FAIL || serverReadReply(X_DISPLAY,
-		serverStrToWin(serverid), &r, FALSE) < 0)
+    make_connection();
+    if (X_DISPLAY != NULL)
+	r = serverGetVimNames(X_DISPLAY);
 # endif
-	    EMSG(_("E277: Unable to read a server reply"));
-    }
 #endif
     rettv->v_type = VAR_STRING;
     rettv->vval.v_string = r;
 }
 
 /*
- * "remote_send()" function
+ * "setbufvar()" function
  */
     static void
-f_remote_send(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_setbufvar(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv UNUSED;
+{
+    buf_T	*buf;
+    aco_save_T	aco;
+    char_u	*varname, *bufvarname;
+    typval_T	*varp;
+    char_u	nbuf[NUMBUFLEN];
+
+    if (check_restricted() || check_secure())
+	return;
+    (void)get_tv_number(&argvars[0]);	    /* issue errmsg if type error */
+    varname = get_tv_string_chk(&argvars[1]);
+    buf = get_buf_tv(&argvars[0], FALSE);
+    varp = &argvars[2];
+
+    if (buf != NULL && varname != NULL && varp != NULL)
+    {
+	/* set curbuf to be our buf, temporarily */
+	aucmd_prepbuf(&aco, buf);
+
+	if (*varname == '&')
+	{
+	    long	numval;
+	    char_u	*strval;
+	    int		error = FALSE;
+
+	    ++varname;
+	    numval = get_tv_number_chk(varp, &error);
+	    strval = get_tv_string_buf_chk(varp, nbuf);
+	    if (!error && strval != NULL)
+		set_option_value(varname, numval, strval, OPT_LOCAL);
+	}
+	else
+	{
+	    bufvarname = alloc((unsigned)STRLEN(varname) + 3);
+	    if (bufvarname != NULL)
+	    {
+		STRCPY(bufvarname, "b:");
+		STRCPY(bufvarname + 2, varname);
+		set_var(bufvarname, varp, TRUE);
+		vim_free(bufvarname);
+	    }
+	}
+
+	/* reset notion of buffer */
+	aucmd_restbuf(&aco);
+    }
+}
+
+/*
+ * "setcmdpos()" function
+ */
+    static void
+f_setcmdpos(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
-#ifdef FEAT_CLIENTSERVER
-    remote_common(argvars, rettv, FALSE);
-#endif
+    int		pos = (int)get_tv_number(&argvars[0]) - 1;
+
+    if (pos >= 0)
+	rettv->vval.v_number = set_cmdline_pos(pos);
 }
 
 /*
- * "remove()" function
+ * "setline()" function
  */
     static void
-f_remove(argvars, rettv)
+f_setline(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    list_T	*l;
-    listitem_T	*item, *item2;
-    listitem_T	*li;
-    long	idx;
-    long	end;
-    char_u	*key;
-    dict_T	*d;
-    dictitem_T	*di;
-    char	*arg_errmsg = N_("remove() argument");
+    linenr_T	lnum;
+    char_u	*line = NULL;
+    list_T	*l = NULL;
+    listitem_T	*li = NULL;
+    listitem_T	*li_line = NULL;
+    long	added = 0;
+    long	n;
+    int		ok;
+    linenr_T	lcount = curbuf->b_ml.ml_line_count;
 
-    if (argvars[0].v_type == VAR_DICT)
+    lnum = get_tv_lnum(&argvars[0]);
+    if (argvars[1].v_type == VAR_LIST)
     {
-	if (argvars[2].v_type != VAR_UNKNOWN)
-	    EMSG2(_(e_toomanyarg), "remove()");
-	else if ((d = argvars[0].vval.v_dict) != NULL
-		&& !tv_check_lock(d->dv_lock, (char_u *)_(arg_errmsg)))
-	{
-	    key = get_tv_string_chk(&argvars[1]);
-	    if (key != NULL)
-	    {
-		di = dict_find(d, key, -1);
-		if (di == NULL)
-		    EMSG2(_(e_dictkey), key);
-		else
-		{
-		    *rettv = di->di_tv;
-		    init_tv(&di->di_tv);
-		    dictitem_remove(d, di);
-		}
-	    }
-	}
+	l = argvars[1].vval.v_list;
+	li = l->lv_first;
     }
-    else if (argvars[0].v_type != VAR_LIST)
-	EMSG2(_(e_listdictarg), "remove()");
-    else if ((l = argvars[0].vval.v_list) != NULL
-	    && !tv_check_lock(l->lv_lock, (char_u *)_(arg_errmsg)))
+    else
+	line = get_tv_string_chk(&argvars[1]);
+
+    /* default result is zero == OK */
+    for (;;)
     {
-	int	    error = FALSE;
+	if (l != NULL)
+	{
+	    /* list argument, get next string */
+	    if (li == NULL)
+		break;
+	    li_line = li;
+	    line = get_tv_string_chk(&li->li_tv);
+	    li = li->li_next;
+	}
 
-	idx = get_tv_number_chk(&argvars[1], &error);
-	if (error)
-	    ;		/* type error: do nothing, errmsg already given */
-	else if ((item = list_find(l, idx)) == NULL)
-	    EMSGN(_(e_listidx), idx);
-	else
+	rettv->vval.v_number = 1;	/* FAIL */
+	if (line == NULL || lnum < 1 || lnum > curbuf->b_ml.ml_line_count + 1)
+	    break;
+
+	/* When coming here from Insert mode, sync undo, so that this can be
+	 * undone separately from what was previously inserted. */
+	if (u_sync_once == 2)
 	{
-	    if (argvars[2].v_type == VAR_UNKNOWN)
+	    u_sync_once = 1; /* notify that u_sync() was called */
+	    u_sync(TRUE);
+	}
+
+	if (lnum <= curbuf->b_ml.ml_line_count)
+	{
+	    /* existing line, replace it */
+	    if (u_savesub(lnum) == OK && ml_replace(lnum, line, TRUE) == OK)
 	    {
-		/* Remove one item, return its value. */
-		vimlist_remove(l, item, item);
-		*rettv = item->li_tv;
-		vim_free(item);
+		changed_bytes(lnum, 0);
+		if (lnum == curwin->w_cursor.lnum)
+		    check_cursor_col();
+		rettv->vval.v_number = 0;	/* OK */
 	    }
-	    else
-	    {
-		/* Remove range of items, return list with values. */
-		end = get_tv_number_chk(&argvars[2], &error);
-		if (error)
-		    ;		/* type error: do nothing */
-		else if ((item2 = list_find(l, end)) == NULL)
-		    EMSGN(_(e_listidx), end);
-		else
-		{
-		    int	    cnt = 0;
-
-		    for (li = item; li != NULL; li = li->li_next)
-		    {
-			++cnt;
-			if (li == item2)
-			    break;
-		    }
-		    if (li == NULL)  /* didn't find "item2" after "item" */
-			EMSG(_(e_invrange));
-		    else
-		    {
-			vimlist_remove(l, item, item2);
-			if (rettv_list_alloc(rettv) == OK)
-			{
-			    l = rettv->vval.v_list;
-			    l->lv_first = item;
-			    l->lv_last = item2;
-			    item->li_prev = NULL;
-			    item2->li_next = NULL;
-			    l->lv_len = cnt;
-			}
-		    }
-		}
+	}
+	else if (added > 0 || u_save(lnum - 1, lnum) == OK)
+	{
+	    /* lnum is one past the last line, append the remaining lines at
+	     * once if possible */
+	    if (l != NULL
+		    && (n = append_list_lines(lnum - 1, li_line, &ok)) >= 0)
+	    {
+		added += n;
+		if (ok)
+		    rettv->vval.v_number = 0;	/* OK */
+		break;
 	    }
+	    ++added;
+	    if (ml_append(lnum - 1, line, (colnr_T)0, FALSE) == OK)
+		rettv->vval.v_number = 0;	/* OK */
 	}
+
+	if (l == NULL)			/* only one string argument */
+	    break;
+	++lnum;
     }
+
+    if (added > 0)
+	appended_lines_mark(lcount, added);
 }
 
+static void set_qf_ll_list __ARGS((win_T *wp, typval_T *list_arg, typval_T *action_arg, typval_T *rettv));
+
 /*
- * "rename({from}, {to})" function
+ * Used by "setqflist()" and "setloclist()" functions
  */
     static void
-f_rename(argvars, rettv)
-    typval_T	*argvars;
+set_qf_ll_list(wp, list_arg, action_arg, rettv)
+    win_T	*wp UNUSED;
+    typval_T	*list_arg UNUSED;
+    typval_T	*action_arg UNUSED;
     typval_T	*rettv;
 {
-    char_u	buf[NUMBUFLEN];
+#ifdef FEAT_QUICKFIX
+    char_u	*act;
+    int		action = ' ';
+#endif
 
-    if (check_restricted() || check_secure())
-	rettv->vval.v_number = -1;
+    rettv->vval.v_number = -1;
+
+#ifdef FEAT_QUICKFIX
+    if (list_arg->v_type != VAR_LIST)
+	EMSG(_(e_listreq));
     else
-	rettv->vval.v_number = vim_rename(get_tv_string(&argvars[0]),
-				      get_tv_string_buf(&argvars[1], buf));
+    {
+	list_T  *l = list_arg->vval.v_list;
+
+	if (action_arg->v_type == VAR_STRING)
+	{
+	    act = get_tv_string_chk(action_arg);
+	    if (act == NULL)
+		return;		/* type error; errmsg already given */
+	    if (*act == 'a' || *act == 'r')
+		action = *act;
+	}
+
+	if (l != NULL && set_errorlist(wp, l, action,
+	       (char_u *)(wp == NULL ? "setqflist()" : "setloclist()")) == OK)
+	    rettv->vval.v_number = 0;
+    }
+#endif
 }
 
 /*
- * "repeat()" function
+ * "setloclist()" function
  */
     static void
-f_repeat(argvars, rettv)
+f_setloclist(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	*p;
-    int		n;
-    int		slen;
-    int		len;
-    char_u	*r;
-    int		i;
-
-    n = get_tv_number(&argvars[1]);
-    if (argvars[0].v_type == VAR_LIST)
-    {
-	if (rettv_list_alloc(rettv) == OK && argvars[0].vval.v_list != NULL)
-	    while (n-- > 0)
-		if (list_extend(rettv->vval.v_list,
-					argvars[0].vval.v_list, NULL) == FAIL)
-		    break;
-    }
-    else
-    {
-	p = get_tv_string(&argvars[0]);
-	rettv->v_type = VAR_STRING;
-	rettv->vval.v_string = NULL;
-
-	slen = (int)STRLEN(p);
-	len = slen * n;
-	if (len <= 0)
-	    return;
+    win_T	*win;
 
-	r = alloc(len + 1);
-	if (r != NULL)
-	{
-	    for (i = 0; i < n; i++)
-		mch_memmove(r + i * slen, p, (size_t)slen);
-	    r[len] = NUL;
-	}
+    rettv->vval.v_number = -1;
 
-	rettv->vval.v_string = r;
-    }
+    win = find_win_by_nr(&argvars[0], NULL);
+    if (win != NULL)
+	set_qf_ll_list(win, &argvars[1], &argvars[2], rettv);
 }
 
 /*
- * "resolve()" function
+ * "setmatches()" function
  */
     static void
-f_resolve(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+f_setmatches(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv UNUSED;
 {
-    char_u	*p;
-#ifdef HAVE_READLINK
-    char_u	*buf = NULL;
-#endif
+#ifdef FEAT_SEARCH_EXTRA
+    list_T	*l;
+    listitem_T	*li;
+    dict_T	*d;
 
-    p = get_tv_string(&argvars[0]);
-#ifdef FEAT_SHORTCUT
+    rettv->vval.v_number = -1;
+    if (argvars[0].v_type != VAR_LIST)
     {
-	char_u	*v = NULL;
-
-	v = mch_resolve_shortcut(p);
-	if (v != NULL)
-	    rettv->vval.v_string = v;
-	else
-	    rettv->vval.v_string = vim_strsave(p);
+	EMSG(_(e_listreq));
+	return;
     }
-#else
-# ifdef HAVE_READLINK
+    if ((l = argvars[0].vval.v_list) != NULL)
     {
-	char_u	*cpy;
-	int	len;
-	char_u	*remain = NULL;
-	char_u	*q;
-	int	is_relative_to_current = FALSE;
-	int	has_trailing_pathsep = FALSE;
-	int	limit = 100;
-
-	p = vim_strsave(p);
-
-	if (p[0] == '.' && (vim_ispathsep(p[1])
-				   || (p[1] == '.' && (vim_ispathsep(p[2])))))
-	    is_relative_to_current = TRUE;
-
-	len = STRLEN(p);
-	if (len > 0 && after_pathsep(p, p + len))
-	{
-	    has_trailing_pathsep = TRUE;
-	    p[len - 1] = NUL; /* the trailing slash breaks readlink() */
-	}
-
-	q = getnextcomp(p);
-	if (*q != NUL)
-	{
-	    /* Separate the first path component in "p", and keep the
-	     * remainder (beginning with the path separator). */
-	    remain = vim_strsave(q - 1);
-	    q[-1] = NUL;
-	}
-
-	buf = alloc(MAXPATHL + 1);
-	if (buf == NULL)
-	    goto fail;
-
-	for (;;)
-	{
-	    for (;;)
-	    {
-		len = readlink((char *)p, (char *)buf, MAXPATHL);
-		if (len <= 0)
-		    break;
-		buf[len] = NUL;
-
-		if (limit-- == 0)
-		{
-		    vim_free(p);
-		    vim_free(remain);
-		    EMSG(_("E655: Too many symbolic links (cycle?)"));
-		    rettv->vval.v_string = NULL;
-		    goto fail;
-		}
-
-		/* Ensure that the result will have a trailing path separator
-		 * if the argument has one. */
-		if (remain == NULL && has_trailing_pathsep)
-		    add_pathsep(buf);
-
-		/* Separate the first path component in the link value and
-		 * concatenate the remainders. */
-		q = getnextcomp(vim_ispathsep(*buf) ? buf + 1 : buf);
-		if (*q != NUL)
-		{
-		    if (remain == NULL)
-			remain = vim_strsave(q - 1);
-		    else
-		    {
-			cpy = concat_str(q - 1, remain);
-			if (cpy != NULL)
-			{
-			    vim_free(remain);
-			    remain = cpy;
-			}
-		    }
-		    q[-1] = NUL;
-		}
-
-		q = gettail(p);
-		if (q > p && *q == NUL)
-		{
-		    /* Ignore trailing path separator. */
-		    q[-1] = NUL;
-		    q = gettail(p);
-		}
-		if (q > p && !mch_isFullName(buf))
-		{
-		    /* symlink is relative to directory of argument */
-		    cpy = alloc((unsigned)(STRLEN(p) + STRLEN(buf) + 1));
-		    if (cpy != NULL)
-		    {
-			STRCPY(cpy, p);
-			STRCPY(gettail(cpy), buf);
-			vim_free(p);
-			p = cpy;
-		    }
-		}
-		else
-		{
-		    vim_free(p);
-		    p = vim_strsave(buf);
-		}
-	    }
-
-	    if (remain == NULL)
-		break;
-
-	    /* Append the first path component of "remain" to "p". */
-	    q = getnextcomp(remain + 1);
-	    len = q - remain - (*q != NUL);
-	    cpy = vim_strnsave(p, STRLEN(p) + len);
-	    if (cpy != NULL)
-	    {
-		STRNCAT(cpy, remain, len);
-		vim_free(p);
-		p = cpy;
-	    }
-	    /* Shorten "remain". */
-	    if (*q != NUL)
-		STRMOVE(remain, q - 1);
-	    else
-	    {
-		vim_free(remain);
-		remain = NULL;
-	    }
-	}
 
-	/* If the result is a relative path name, make it explicitly relative to
-	 * the current directory if and only if the argument had this form. */
-	if (!vim_ispathsep(*p))
+	/* To some extent make sure that we are dealing with a list from
+	 * "getmatches()". */
+	li = l->lv_first;
+	while (li != NULL)
 	{
-	    if (is_relative_to_current
-		    && *p != NUL
-		    && !(p[0] == '.'
-			&& (p[1] == NUL
-			    || vim_ispathsep(p[1])
-			    || (p[1] == '.'
-				&& (p[2] == NUL
-				    || vim_ispathsep(p[2]))))))
+	    if (li->li_tv.v_type != VAR_DICT
+		    || (d = li->li_tv.vval.v_dict) == NULL)
 	    {
-		/* Prepend "./". */
-		cpy = concat_str((char_u *)"./", p);
-		if (cpy != NULL)
-		{
-		    vim_free(p);
-		    p = cpy;
-		}
+		EMSG(_(e_invarg));
+		return;
 	    }
-	    else if (!is_relative_to_current)
+	    if (!(dict_find(d, (char_u *)"group", -1) != NULL
+			&& dict_find(d, (char_u *)"pattern", -1) != NULL
+			&& dict_find(d, (char_u *)"priority", -1) != NULL
+			&& dict_find(d, (char_u *)"id", -1) != NULL))
 	    {
-		/* Strip leading "./". */
-		q = p;
-		while (q[0] == '.' && vim_ispathsep(q[1]))
-		    q += 2;
-		if (q > p)
-		    STRMOVE(p, p + 2);
+		EMSG(_(e_invarg));
+		return;
 	    }
+	    li = li->li_next;
 	}
 
-	/* Ensure that the result will have no trailing path separator
-	 * if the argument had none.  But keep "/" or "//". */
-	if (!has_trailing_pathsep)
+	clear_matches(curwin);
+	li = l->lv_first;
+	while (li != NULL)
 	{
-	    q = p + STRLEN(p);
-	    if (after_pathsep(p, q))
-		*gettail_sep(p) = NUL;
+	    d = li->li_tv.vval.v_dict;
+	    match_add(curwin, get_dict_string(d, (char_u *)"group", FALSE),
+		    get_dict_string(d, (char_u *)"pattern", FALSE),
+		    (int)get_dict_number(d, (char_u *)"priority"),
+		    (int)get_dict_number(d, (char_u *)"id"));
+	    li = li->li_next;
 	}
-
-	rettv->vval.v_string = p;
+	rettv->vval.v_number = 0;
     }
-# else
-    rettv->vval.v_string = vim_strsave(p);
-# endif
-#endif
-
-    simplify_filename(rettv->vval.v_string);
-
-#ifdef HAVE_READLINK
-fail:
-    vim_free(buf);
 #endif
-    rettv->v_type = VAR_STRING;
 }
 
 /*
- * "reverse({list})" function
+ * "setpos()" function
  */
     static void
-f_reverse(argvars, rettv)
+f_setpos(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    list_T	*l;
-    listitem_T	*li, *ni;
+    pos_T	pos;
+    int		fnum;
+    char_u	*name;
 
-    if (argvars[0].v_type != VAR_LIST)
-	EMSG2(_(e_listarg), "reverse()");
-    else if ((l = argvars[0].vval.v_list) != NULL
-	    && !tv_check_lock(l->lv_lock, (char_u *)_("reverse() argument")))
+    rettv->vval.v_number = -1;
+    name = get_tv_string_chk(argvars);
+    if (name != NULL)
     {
-	li = l->lv_last;
-	l->lv_first = l->lv_last = NULL;
-	l->lv_len = 0;
-	while (li != NULL)
+	if (list2fpos(&argvars[1], &pos, &fnum) == OK)
 	{
-	    ni = li->li_prev;
-	    list_append(l, li);
-	    li = ni;
+	    if (--pos.col < 0)
+		pos.col = 0;
+	    if (name[0] == '.' && name[1] == NUL)
+	    {
+		/* set cursor */
+		if (fnum == curbuf->b_fnum)
+		{
+		    curwin->w_cursor = pos;
+		    check_cursor();
+		    rettv->vval.v_number = 0;
+		}
+		else
+		    EMSG(_(e_invarg));
+	    }
+	    else if (name[0] == '\'' && name[1] != NUL && name[2] == NUL)
+	    {
+		/* set mark */
+		if (setmark_pos(name[1], &pos, fnum) == OK)
+		    rettv->vval.v_number = 0;
+	    }
+	    else
+		EMSG(_(e_invarg));
 	}
-	rettv->vval.v_list = l;
-	rettv->v_type = VAR_LIST;
-	++l->lv_refcount;
-	l->lv_idx = l->lv_len - l->lv_idx - 1;
     }
 }
 
-#define SP_NOMOVE	0x01	    /* don't move cursor */
-#define SP_REPEAT	0x02	    /* repeat to find outer pair */
-#define SP_RETCOUNT	0x04	    /* return matchcount */
-#define SP_SETPCMARK	0x08	    /* set previous context mark */
-#define SP_START	0x10	    /* accept match at start position */
-#define SP_SUBPAT	0x20	    /* return nr of matching sub-pattern */
-#define SP_END		0x40	    /* leave cursor at end of match */
-
-static int get_search_arg __ARGS((typval_T *varp, int *flagsp));
+/*
+ * "setqflist()" function
+ */
+    static void
+f_setqflist(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    set_qf_ll_list(NULL, &argvars[0], &argvars[1], rettv);
+}
 
 /*
- * Get flags for a search function.
- * Possibly sets "p_ws".
- * Returns BACKWARD, FORWARD or zero (for an error).
+ * "setreg()" function
  */
-    static int
-get_search_arg(varp, flagsp)
-    typval_T	*varp;
-    int		*flagsp;
+    static void
+f_setreg(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
 {
-    int		dir = FORWARD;
-    char_u	*flags;
-    char_u	nbuf[NUMBUFLEN];
-    int		mask;
+    int		regname;
+    char_u	*strregname;
+    char_u	*stropt;
+    char_u	*strval;
+    int		append;
+    char_u	yank_type;
+    long	block_len;
 
-    if (varp->v_type != VAR_UNKNOWN)
+    block_len = -1;
+    yank_type = MAUTO;
+    append = FALSE;
+
+    strregname = get_tv_string_chk(argvars);
+    rettv->vval.v_number = 1;		/* FAIL is default */
+
+    if (strregname == NULL)
+	return;		/* type error; errmsg already given */
+    regname = *strregname;
+    if (regname == 0 || regname == '@')
+	regname = '"';
+
+    if (argvars[2].v_type != VAR_UNKNOWN)
     {
-	flags = get_tv_string_buf_chk(varp, nbuf);
-	if (flags == NULL)
-	    return 0;		/* type error; errmsg already given */
-	while (*flags != NUL)
+	stropt = get_tv_string_chk(&argvars[2]);
+	if (stropt == NULL)
+	    return;		/* type error */
+	for (; *stropt != NUL; ++stropt)
+	    switch (*stropt)
+	    {
+		case 'a': case 'A':	/* append */
+		    append = TRUE;
+		    break;
+		case 'v': case 'c':	/* character-wise selection */
+		    yank_type = MCHAR;
+		    break;
+		case 'V': case 'l':	/* line-wise selection */
+		    yank_type = MLINE;
+		    break;
+		case 'b': case Ctrl_V:	/* block-wise selection */
+		    yank_type = MBLOCK;
+		    if (VIM_ISDIGIT(stropt[1]))
+		    {
+			++stropt;
+			block_len = getdigits(&stropt) - 1;
+			--stropt;
+		    }
+		    break;
+	    }
+    }
+
+    if (argvars[1].v_type == VAR_LIST)
+    {
+	char_u		**lstval;
+	char_u		**allocval;
+	char_u		buf[NUMBUFLEN];
+	char_u		**curval;
+	char_u		**curallocval;
+	int		len = argvars[1].vval.v_list->lv_len;
+	listitem_T	*li;
+
+	/* First half: use for pointers to result lines; second half: use for
+	 * pointers to allocated copies. */
+	lstval = (char_u **)alloc(sizeof(char_u *) * ((len + 1) * 2));
+	if (lstval == NULL)
+	    return;
+	curval = lstval;
+	allocval = lstval + len + 2;
+	curallocval = allocval;
+
+	for (li = argvars[1].vval.v_list->lv_first; li != NULL;
+							     li = li->li_next)
 	{
-	    switch (*flags)
+	    strval = get_tv_string_buf_chk(&li->li_tv, buf);
+	    if (strval == NULL)
+		goto free_lstval;
+	    if (strval == buf)
 	    {
-		case 'b': dir = BACKWARD; break;
-		case 'w': p_ws = TRUE; break;
-		case 'W': p_ws = FALSE; break;
-		default:  mask = 0;
-			  if (flagsp != NULL)
-			     switch (*flags)
-			     {
-				 case 'c': mask = SP_START; break;
-				 case 'e': mask = SP_END; break;
-				 case 'm': mask = SP_RETCOUNT; break;
-				 case 'n': mask = SP_NOMOVE; break;
-				 case 'p': mask = SP_SUBPAT; break;
-				 case 'r': mask = SP_REPEAT; break;
-				 case 's': mask = SP_SETPCMARK; break;
-			     }
-			  if (mask == 0)
-			  {
-			      EMSG2(_(e_invarg2), flags);
-			      dir = 0;
-			  }
-			  else
-			      *flagsp |= mask;
+		/* Need to make a copy, next get_tv_string_buf_chk() will
+		 * overwrite the string. */
+		strval = vim_strsave(buf);
+		if (strval == NULL)
+		    goto free_lstval;
+		*curallocval++ = strval;
 	    }
-	    if (dir == 0)
-		break;
-	    ++flags;
+	    *curval++ = strval;
 	}
+	*curval++ = NULL;
+
+	write_reg_contents_lst(regname, lstval, -1,
+						append, yank_type, block_len);
+free_lstval:
+	while (curallocval > allocval)
+	    vim_free(*--curallocval);
+	vim_free(lstval);
     }
-    return dir;
+    else
+    {
+	strval = get_tv_string_chk(&argvars[1]);
+	if (strval == NULL)
+	    return;
+	write_reg_contents_ex(regname, strval, -1,
+						append, yank_type, block_len);
+    }
+    rettv->vval.v_number = 0;
 }
 
 /*
- * Shared by search() and searchpos() functions
+ * "settabvar()" function
  */
-    static int
-search_cmn(argvars, match_pos, flagsp)
+    static void
+f_settabvar(argvars, rettv)
     typval_T	*argvars;
-    pos_T	*match_pos;
-    int		*flagsp;
+    typval_T	*rettv;
 {
-    int		flags;
-    char_u	*pat;
-    pos_T	pos;
-    pos_T	save_cursor;
-    int		save_p_ws = p_ws;
-    int		dir;
-    int		retval = 0;	/* default: FAIL */
-    long	lnum_stop = 0;
-    proftime_T	tm;
-#ifdef FEAT_RELTIME
-    long	time_limit = 0;
+#ifdef FEAT_WINDOWS
+    tabpage_T	*save_curtab;
+    tabpage_T	*tp;
 #endif
-    int		options = SEARCH_KEEP;
-    int		subpatnum;
+    char_u	*varname, *tabvarname;
+    typval_T	*varp;
 
-    pat = get_tv_string(&argvars[0]);
-    dir = get_search_arg(&argvars[1], flagsp);	/* may set p_ws */
-    if (dir == 0)
-	goto theend;
-    flags = *flagsp;
-    if (flags & SP_START)
-	options |= SEARCH_START;
-    if (flags & SP_END)
-	options |= SEARCH_END;
+    rettv->vval.v_number = 0;
 
-    /* Optional arguments: line number to stop searching and timeout. */
-    if (argvars[1].v_type != VAR_UNKNOWN && argvars[2].v_type != VAR_UNKNOWN)
-    {
-	lnum_stop = get_tv_number_chk(&argvars[2], NULL);
-	if (lnum_stop < 0)
-	    goto theend;
-#ifdef FEAT_RELTIME
-	if (argvars[3].v_type != VAR_UNKNOWN)
-	{
-	    time_limit = get_tv_number_chk(&argvars[3], NULL);
-	    if (time_limit < 0)
-		goto theend;
-	}
-#endif
-    }
+    if (check_restricted() || check_secure())
+	return;
 
-#ifdef FEAT_RELTIME
-    /* Set the time limit, if there is one. */
-    profile_setlimit(time_limit, &tm);
+#ifdef FEAT_WINDOWS
+    tp = find_tabpage((int)get_tv_number_chk(&argvars[0], NULL));
 #endif
+    varname = get_tv_string_chk(&argvars[1]);
+    varp = &argvars[2];
 
-    /*
-     * This function does not accept SP_REPEAT and SP_RETCOUNT flags.
-     * Check to make sure only those flags are set.
-     * Also, Only the SP_NOMOVE or the SP_SETPCMARK flag can be set. Both
-     * flags cannot be set. Check for that condition also.
-     */
-    if (((flags & (SP_REPEAT | SP_RETCOUNT)) != 0)
-	    || ((flags & SP_NOMOVE) && (flags & SP_SETPCMARK)))
+    if (varname != NULL && varp != NULL
+#ifdef FEAT_WINDOWS
+	    && tp != NULL
+#endif
+	    )
     {
-	EMSG2(_(e_invarg2), get_tv_string(&argvars[1]));
-	goto theend;
-    }
+#ifdef FEAT_WINDOWS
+	save_curtab = curtab;
+	goto_tabpage_tp(tp, FALSE, FALSE);
+#endif
 
-    pos = save_cursor = curwin->w_cursor;
-    subpatnum = searchit(curwin, curbuf, &pos, dir, pat, 1L,
-				options, RE_SEARCH, (linenr_T)lnum_stop, &tm);
-    if (subpatnum != FAIL)
-    {
-	if (flags & SP_SUBPAT)
-	    retval = subpatnum;
-	else
-	    retval = pos.lnum;
-	if (flags & SP_SETPCMARK)
-	    setpcmark();
-	curwin->w_cursor = pos;
-	if (match_pos != NULL)
+	tabvarname = alloc((unsigned)STRLEN(varname) + 3);
+	if (tabvarname != NULL)
 	{
-	    /* Store the match cursor position */
-	    match_pos->lnum = pos.lnum;
-	    match_pos->col = pos.col + 1;
+	    STRCPY(tabvarname, "t:");
+	    STRCPY(tabvarname + 2, varname);
+	    set_var(tabvarname, varp, TRUE);
+	    vim_free(tabvarname);
 	}
-	/* "/$" will put the cursor after the end of the line, may need to
-	 * correct that here */
-	check_cursor();
-    }
-
-    /* If 'n' flag is used: restore cursor position. */
-    if (flags & SP_NOMOVE)
-	curwin->w_cursor = save_cursor;
-    else
-	curwin->w_set_curswant = TRUE;
-theend:
-    p_ws = save_p_ws;
 
-    return retval;
+#ifdef FEAT_WINDOWS
+	/* Restore current tabpage */
+	if (valid_tabpage(save_curtab))
+	    goto_tabpage_tp(save_curtab, FALSE, FALSE);
+#endif
+    }
 }
 
-#ifdef FEAT_FLOAT
-
 /*
- * round() is not in C90, use ceil() or floor() instead.
+ * "settabwinvar()" function
  */
-    float_T
-vim_round(f)
-    float_T f;
+    static void
+f_settabwinvar(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
 {
-    return f > 0 ? floor(f + 0.5) : ceil(f - 0.5);
+    setwinvar(argvars, rettv, 1);
 }
 
 /*
- * "round({float})" function
+ * "setwinvar()" function
  */
     static void
-f_round(argvars, rettv)
+f_setwinvar(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    float_T	f;
-
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	rettv->vval.v_float = vim_round(f);
-    else
-	rettv->vval.v_float = 0.0;
+    setwinvar(argvars, rettv, 0);
 }
-#endif
 
 /*
- * "screenattr()" function
+ * "setwinvar()" and "settabwinvar()" functions
  */
+
     static void
-f_screenattr(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+setwinvar(argvars, rettv, off)
+    typval_T	*argvars;
+    typval_T	*rettv UNUSED;
+    int		off;
 {
-    int		row;
-    int		col;
-    int		c;
+    win_T	*win;
+#ifdef FEAT_WINDOWS
+    win_T	*save_curwin;
+    tabpage_T	*save_curtab;
+#endif
+    char_u	*varname, *winvarname;
+    typval_T	*varp;
+    char_u	nbuf[NUMBUFLEN];
+    tabpage_T	*tp = NULL;
 
-    row = get_tv_number_chk(&argvars[0], NULL) - 1;
-    col = get_tv_number_chk(&argvars[1], NULL) - 1;
-    if (row < 0 || row >= screen_Rows
-	    || col < 0 || col >= screen_Columns)
-	c = -1;
+    if (check_restricted() || check_secure())
+	return;
+
+#ifdef FEAT_WINDOWS
+    if (off == 1)
+	tp = find_tabpage((int)get_tv_number_chk(&argvars[0], NULL));
     else
-	c = ScreenAttrs[LineOffset[row] + col];
-    rettv->vval.v_number = c;
+	tp = curtab;
+#endif
+    win = find_win_by_nr(&argvars[off], tp);
+    varname = get_tv_string_chk(&argvars[off + 1]);
+    varp = &argvars[off + 2];
+
+    if (win != NULL && varname != NULL && varp != NULL)
+    {
+#ifdef FEAT_WINDOWS
+	if (switch_win(&save_curwin, &save_curtab, win, tp, TRUE) == FAIL)
+	    return;
+#endif
+
+	if (*varname == '&')
+	{
+	    long	numval;
+	    char_u	*strval;
+	    int		error = FALSE;
+
+	    ++varname;
+	    numval = get_tv_number_chk(varp, &error);
+	    strval = get_tv_string_buf_chk(varp, nbuf);
+	    if (!error && strval != NULL)
+		set_option_value(varname, numval, strval, OPT_LOCAL);
+	}
+	else
+	{
+	    winvarname = alloc((unsigned)STRLEN(varname) + 3);
+	    if (winvarname != NULL)
+	    {
+		STRCPY(winvarname, "w:");
+		STRCPY(winvarname + 2, varname);
+		set_var(winvarname, varp, TRUE);
+		vim_free(winvarname);
+	    }
+	}
+
+#ifdef FEAT_WINDOWS
+	restore_win(save_curwin, save_curtab, TRUE);
+#endif
+    }
 }
 
+#ifdef FEAT_CRYPT
 /*
- * "screenchar()" function
+ * "sha256({string})" function
  */
     static void
-f_screenchar(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_sha256(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-    int		row;
-    int		col;
-    int		off;
-    int		c;
+    char_u	*p;
 
-    row = get_tv_number_chk(&argvars[0], NULL) - 1;
-    col = get_tv_number_chk(&argvars[1], NULL) - 1;
-    if (row < 0 || row >= screen_Rows
-	    || col < 0 || col >= screen_Columns)
-	c = -1;
-    else
-    {
-	off = LineOffset[row] + col;
-#ifdef FEAT_MBYTE
-	if (enc_utf8 && ScreenLinesUC[off] != 0)
-	    c = ScreenLinesUC[off];
-	else
-#endif
-	    c = ScreenLines[off];
-    }
-    rettv->vval.v_number = c;
+    p = get_tv_string(&argvars[0]);
+    rettv->vval.v_string = vim_strsave(
+				    sha256_bytes(p, (int)STRLEN(p), NULL, 0));
+    rettv->v_type = VAR_STRING;
 }
+#endif /* FEAT_CRYPT */
 
 /*
- * "screencol()" function
- *
- * First column is 1 to be consistent with virtcol().
+ * "shellescape({string})" function
  */
     static void
-f_screencol(argvars, rettv)
-    typval_T	*argvars UNUSED;
+f_shellescape(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = screen_screencol() + 1;
+    rettv->vval.v_string = vim_strsave_shellescape(
+		get_tv_string(&argvars[0]), non_zero_arg(&argvars[1]), TRUE);
+    rettv->v_type = VAR_STRING;
 }
 
 /*
- * "screenrow()" function
+ * shiftwidth() function
  */
     static void
-f_screenrow(argvars, rettv)
+f_shiftwidth(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = screen_screenrow() + 1;
+    rettv->vval.v_number = get_sw_value(curbuf);
 }
 
 /*
- * "search()" function
+ * "simplify()" function
  */
     static void
-f_search(argvars, rettv)
+f_simplify(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    int		flags = 0;
+    char_u	*p;
 
-    rettv->vval.v_number = search_cmn(argvars, NULL, &flags);
+    p = get_tv_string(&argvars[0]);
+    rettv->vval.v_string = vim_strsave(p);
+    simplify_filename(rettv->vval.v_string);	/* simplify in place */
+    rettv->v_type = VAR_STRING;
 }
 
+#ifdef FEAT_FLOAT
 /*
- * "searchdecl()" function
+ * "sin()" function
  */
     static void
-f_searchdecl(argvars, rettv)
+f_sin(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    int		locally = 1;
-    int		thisblock = 0;
-    int		error = FALSE;
-    char_u	*name;
-
-    rettv->vval.v_number = 1;	/* default: FAIL */
+    float_T	f;
 
-    name = get_tv_string_chk(&argvars[0]);
-    if (argvars[1].v_type != VAR_UNKNOWN)
-    {
-	locally = get_tv_number_chk(&argvars[1], &error) == 0;
-	if (!error && argvars[2].v_type != VAR_UNKNOWN)
-	    thisblock = get_tv_number_chk(&argvars[2], &error) != 0;
-    }
-    if (!error && name != NULL)
-	rettv->vval.v_number = find_decl(name, (int)STRLEN(name),
-				     locally, thisblock, SEARCH_KEEP) == FAIL;
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	rettv->vval.v_float = sin(f);
+    else
+	rettv->vval.v_float = 0.0;
 }
 
 /*
- * Used by searchpair() and searchpairpos()
+ * "sinh()" function
  */
-    static int
-searchpair_cmn(argvars, match_pos)
+    static void
+f_sinh(argvars, rettv)
     typval_T	*argvars;
-    pos_T	*match_pos;
+    typval_T	*rettv;
 {
-    char_u	*spat, *mpat, *epat;
-    char_u	*skip;
-    int		save_p_ws = p_ws;
-    int		dir;
-    int		flags = 0;
-    char_u	nbuf1[NUMBUFLEN];
-    char_u	nbuf2[NUMBUFLEN];
-    char_u	nbuf3[NUMBUFLEN];
-    int		retval = 0;		/* default: FAIL */
-    long	lnum_stop = 0;
-    long	time_limit = 0;
-
-    /* Get the three pattern arguments: start, middle, end. */
-    spat = get_tv_string_chk(&argvars[0]);
-    mpat = get_tv_string_buf_chk(&argvars[1], nbuf1);
-    epat = get_tv_string_buf_chk(&argvars[2], nbuf2);
-    if (spat == NULL || mpat == NULL || epat == NULL)
-	goto theend;	    /* type error */
-
-    /* Handle the optional fourth argument: flags */
-    dir = get_search_arg(&argvars[3], &flags); /* may set p_ws */
-    if (dir == 0)
-	goto theend;
-
-    /* Don't accept SP_END or SP_SUBPAT.
-     * Only one of the SP_NOMOVE or SP_SETPCMARK flags can be set.
-     */
-    if ((flags & (SP_END | SP_SUBPAT)) != 0
-	    || ((flags & SP_NOMOVE) && (flags & SP_SETPCMARK)))
-    {
-	EMSG2(_(e_invarg2), get_tv_string(&argvars[3]));
-	goto theend;
-    }
-
-    /* Using 'r' implies 'W', otherwise it doesn't work. */
-    if (flags & SP_REPEAT)
-	p_ws = FALSE;
+    float_T	f;
 
-    /* Optional fifth argument: skip expression */
-    if (argvars[3].v_type == VAR_UNKNOWN
-	    || argvars[4].v_type == VAR_UNKNOWN)
-	skip = (char_u *)"";
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	rettv->vval.v_float = sinh(f);
     else
-    {
-	skip = get_tv_string_buf_chk(&argvars[4], nbuf3);
-	if (argvars[5].v_type != VAR_UNKNOWN)
-	{
-	    lnum_stop = get_tv_number_chk(&argvars[5], NULL);
-	    if (lnum_stop < 0)
-		goto theend;
-#ifdef FEAT_RELTIME
-	    if (argvars[6].v_type != VAR_UNKNOWN)
-	    {
-		time_limit = get_tv_number_chk(&argvars[6], NULL);
-		if (time_limit < 0)
-		    goto theend;
-	    }
+	rettv->vval.v_float = 0.0;
+}
 #endif
-	}
-    }
-    if (skip == NULL)
-	goto theend;	    /* type error */
-
-    retval = do_searchpair(spat, mpat, epat, dir, skip, flags,
-					    match_pos, lnum_stop, time_limit);
 
-theend:
-    p_ws = save_p_ws;
+static int
+#ifdef __BORLANDC__
+    _RTLENTRYF
+#endif
+	item_compare __ARGS((const void *s1, const void *s2));
+static int
+#ifdef __BORLANDC__
+    _RTLENTRYF
+#endif
+	item_compare2 __ARGS((const void *s1, const void *s2));
 
-    return retval;
-}
+static int	item_compare_ic;
+static char_u	*item_compare_func;
+static dict_T	*item_compare_selfdict;
+static int	item_compare_func_err;
+static void	do_sort_uniq __ARGS((typval_T *argvars, typval_T *rettv, int sort));
+#define ITEM_COMPARE_FAIL 999
 
 /*
- * "searchpair()" function
+ * Compare functions for f_sort() and f_uniq() below.
  */
-    static void
-f_searchpair(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+item_compare(s1, s2)
+    const void	*s1;
+    const void	*s2;
 {
-    rettv->vval.v_number = searchpair_cmn(argvars, NULL);
+    char_u	*p1, *p2;
+    char_u	*tofree1, *tofree2;
+    int		res;
+    char_u	numbuf1[NUMBUFLEN];
+    char_u	numbuf2[NUMBUFLEN];
+
+    p1 = tv2string(&(*(listitem_T **)s1)->li_tv, &tofree1, numbuf1, 0);
+    p2 = tv2string(&(*(listitem_T **)s2)->li_tv, &tofree2, numbuf2, 0);
+    if (p1 == NULL)
+	p1 = (char_u *)"";
+    if (p2 == NULL)
+	p2 = (char_u *)"";
+    if (item_compare_ic)
+	res = STRICMP(p1, p2);
+    else
+	res = STRCMP(p1, p2);
+    vim_free(tofree1);
+    vim_free(tofree2);
+    return res;
 }
 
-/*
- * "searchpairpos()" function
- */
-    static void
-f_searchpairpos(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+item_compare2(s1, s2)
+    const void	*s1;
+    const void	*s2;
 {
-    pos_T	match_pos;
-    int		lnum = 0;
-    int		col = 0;
+    int		res;
+    typval_T	rettv;
+    typval_T	argv[3];
+    int		dummy;
 
-    if (rettv_list_alloc(rettv) == FAIL)
-	return;
+    /* shortcut after failure in previous call; compare all items equal */
+    if (item_compare_func_err)
+	return 0;
 
-    if (searchpair_cmn(argvars, &match_pos) > 0)
-    {
-	lnum = match_pos.lnum;
-	col = match_pos.col;
-    }
+    /* copy the values.  This is needed to be able to set v_lock to VAR_FIXED
+     * in the copy without changing the original list items. */
+    copy_tv(&(*(listitem_T **)s1)->li_tv, &argv[0]);
+    copy_tv(&(*(listitem_T **)s2)->li_tv, &argv[1]);
 
-    list_append_number(rettv->vval.v_list, (varnumber_T)lnum);
-    list_append_number(rettv->vval.v_list, (varnumber_T)col);
+    rettv.v_type = VAR_UNKNOWN;		/* clear_tv() uses this */
+    res = call_func(item_compare_func, (int)STRLEN(item_compare_func),
+				 &rettv, 2, argv, 0L, 0L, &dummy, TRUE,
+				 item_compare_selfdict);
+    clear_tv(&argv[0]);
+    clear_tv(&argv[1]);
+
+    if (res == FAIL)
+	res = ITEM_COMPARE_FAIL;
+    else
+	res = get_tv_number_chk(&rettv, &item_compare_func_err);
+    if (item_compare_func_err)
+	res = ITEM_COMPARE_FAIL;  /* return value has wrong type */
+    clear_tv(&rettv);
+    return res;
 }
 
 /*
- * Search for a start/middle/end thing.
- * Used by searchpair(), see its documentation for the details.
- * Returns 0 or -1 for no match,
+ * "sort({list})" function
  */
-    long
-do_searchpair(spat, mpat, epat, dir, skip, flags, match_pos,
-							lnum_stop, time_limit)
-    char_u	*spat;	    /* start pattern */
-    char_u	*mpat;	    /* middle pattern */
-    char_u	*epat;	    /* end pattern */
-    int		dir;	    /* BACKWARD or FORWARD */
-    char_u	*skip;	    /* skip expression */
-    int		flags;	    /* SP_SETPCMARK and other SP_ values */
-    pos_T	*match_pos;
-    linenr_T	lnum_stop;  /* stop at this line if not zero */
-    long	time_limit UNUSED; /* stop after this many msec */
+    static void
+do_sort_uniq(argvars, rettv, sort)
+    typval_T	*argvars;
+    typval_T	*rettv;
+    int		sort;
 {
-    char_u	*save_cpo;
-    char_u	*pat, *pat2 = NULL, *pat3 = NULL;
-    long	retval = 0;
-    pos_T	pos;
-    pos_T	firstpos;
-    pos_T	foundpos;
-    pos_T	save_cursor;
-    pos_T	save_pos;
-    int		n;
-    int		r;
-    int		nest = 1;
-    int		err;
-    int		options = SEARCH_KEEP;
-    proftime_T	tm;
-
-    /* Make 'cpoptions' empty, the 'l' flag should not be used here. */
-    save_cpo = p_cpo;
-    p_cpo = empty_option;
-
-#ifdef FEAT_RELTIME
-    /* Set the time limit, if there is one. */
-    profile_setlimit(time_limit, &tm);
-#endif
+    list_T	*l;
+    listitem_T	*li;
+    listitem_T	**ptrs;
+    long	len;
+    long	i;
 
-    /* Make two search patterns: start/end (pat2, for in nested pairs) and
-     * start/middle/end (pat3, for the top pair). */
-    pat2 = alloc((unsigned)(STRLEN(spat) + STRLEN(epat) + 15));
-    pat3 = alloc((unsigned)(STRLEN(spat) + STRLEN(mpat) + STRLEN(epat) + 23));
-    if (pat2 == NULL || pat3 == NULL)
-	goto theend;
-    sprintf((char *)pat2, "\\(%s\\m\\)\\|\\(%s\\m\\)", spat, epat);
-    if (*mpat == NUL)
-	STRCPY(pat3, pat2);
+    if (argvars[0].v_type != VAR_LIST)
+	EMSG2(_(e_listarg), sort ? "sort()" : "uniq()");
     else
-	sprintf((char *)pat3, "\\(%s\\m\\)\\|\\(%s\\m\\)\\|\\(%s\\m\\)",
-							    spat, epat, mpat);
-    if (flags & SP_START)
-	options |= SEARCH_START;
-
-    save_cursor = curwin->w_cursor;
-    pos = curwin->w_cursor;
-    clearpos(&firstpos);
-    clearpos(&foundpos);
-    pat = pat3;
-    for (;;)
     {
-	n = searchit(curwin, curbuf, &pos, dir, pat, 1L,
-					   options, RE_SEARCH, lnum_stop, &tm);
-	if (n == FAIL || (firstpos.lnum != 0 && equalpos(pos, firstpos)))
-	    /* didn't find it or found the first match again: FAIL */
-	    break;
+	l = argvars[0].vval.v_list;
+	if (l == NULL || tv_check_lock(l->lv_lock,
+	       (char_u *)(sort ? _("sort() argument") : _("uniq() argument"))))
+	    return;
+	rettv->vval.v_list = l;
+	rettv->v_type = VAR_LIST;
+	++l->lv_refcount;
 
-	if (firstpos.lnum == 0)
-	    firstpos = pos;
-	if (equalpos(pos, foundpos))
+	len = list_len(l);
+	if (len <= 1)
+	    return;	/* short list sorts pretty quickly */
+
+	item_compare_ic = FALSE;
+	item_compare_func = NULL;
+	item_compare_selfdict = NULL;
+	if (argvars[1].v_type != VAR_UNKNOWN)
 	{
-	    /* Found the same position again.  Can happen with a pattern that
-	     * has "\zs" at the end and searching backwards.  Advance one
-	     * character and try again. */
-	    if (dir == BACKWARD)
-		decl(&pos);
+	    /* optional second argument: {func} */
+	    if (argvars[1].v_type == VAR_FUNC)
+		item_compare_func = argvars[1].vval.v_string;
 	    else
-		incl(&pos);
-	}
-	foundpos = pos;
+	    {
+		int	    error = FALSE;
 
-	/* clear the start flag to avoid getting stuck here */
-	options &= ~SEARCH_START;
+		i = get_tv_number_chk(&argvars[1], &error);
+		if (error)
+		    return;		/* type error; errmsg already given */
+		if (i == 1)
+		    item_compare_ic = TRUE;
+		else
+		    item_compare_func = get_tv_string(&argvars[1]);
+	    }
 
-	/* If the skip pattern matches, ignore this match. */
-	if (*skip != NUL)
-	{
-	    save_pos = curwin->w_cursor;
-	    curwin->w_cursor = pos;
-	    r = eval_to_bool(skip, &err, NULL, FALSE);
-	    curwin->w_cursor = save_pos;
-	    if (err)
+	    if (argvars[2].v_type != VAR_UNKNOWN)
 	    {
-		/* Evaluating {skip} caused an error, break here. */
-		curwin->w_cursor = save_cursor;
-		retval = -1;
-		break;
+		/* optional third argument: {dict} */
+		if (argvars[2].v_type != VAR_DICT)
+		{
+		    EMSG(_(e_dictreq));
+		    return;
+		}
+		item_compare_selfdict = argvars[2].vval.v_dict;
 	    }
-	    if (r)
-		continue;
 	}
 
-	if ((dir == BACKWARD && n == 3) || (dir == FORWARD && n == 2))
+	/* Make an array with each entry pointing to an item in the List. */
+	ptrs = (listitem_T **)alloc((int)(len * sizeof(listitem_T *)));
+	if (ptrs == NULL)
+	    return;
+
+	i = 0;
+	if (sort)
 	{
-	    /* Found end when searching backwards or start when searching
-	     * forward: nested pair. */
-	    ++nest;
-	    pat = pat2;		/* nested, don't search for middle */
+	    /* sort(): ptrs will be the list to sort */
+	    for (li = l->lv_first; li != NULL; li = li->li_next)
+		ptrs[i++] = li;
+
+	    item_compare_func_err = FALSE;
+	    /* test the compare function */
+	    if (item_compare_func != NULL
+		    && item_compare2((void *)&ptrs[0], (void *)&ptrs[1])
+							 == ITEM_COMPARE_FAIL)
+		EMSG(_("E702: Sort compare function failed"));
+	    else
+	    {
+		/* Sort the array with item pointers. */
+		qsort((void *)ptrs, (size_t)len, sizeof(listitem_T *),
+		    item_compare_func == NULL ? item_compare : item_compare2);
+
+		if (!item_compare_func_err)
+		{
+		    /* Clear the List and append the items in sorted order. */
+		    l->lv_first = l->lv_last = l->lv_idx_item = NULL;
+		    l->lv_len = 0;
+		    for (i = 0; i < len; ++i)
+			list_append(l, ptrs[i]);
+		}
+	    }
 	}
 	else
 	{
-	    /* Found end when searching forward or start when searching
-	     * backward: end of (nested) pair; or found middle in outer pair. */
-	    if (--nest == 1)
-		pat = pat3;	/* outer level, search for middle */
-	}
+	    int	(*item_compare_func_ptr)__ARGS((const void *, const void *));
 
-	if (nest == 0)
-	{
-	    /* Found the match: return matchcount or line number. */
-	    if (flags & SP_RETCOUNT)
-		++retval;
-	    else
-		retval = pos.lnum;
-	    if (flags & SP_SETPCMARK)
-		setpcmark();
-	    curwin->w_cursor = pos;
-	    if (!(flags & SP_REPEAT))
-		break;
-	    nest = 1;	    /* search for next unmatched */
-	}
-    }
+	    /* f_uniq(): ptrs will be a stack of items to remove */
+	    item_compare_func_err = FALSE;
+	    item_compare_func_ptr = item_compare_func
+					       ? item_compare2 : item_compare;
 
-    if (match_pos != NULL)
-    {
-	/* Store the match cursor position */
-	match_pos->lnum = curwin->w_cursor.lnum;
-	match_pos->col = curwin->w_cursor.col + 1;
-    }
+	    for (li = l->lv_first; li != NULL && li->li_next != NULL;
+							     li = li->li_next)
+	    {
+		if (item_compare_func_ptr((void *)&li, (void *)&li->li_next)
+									 == 0)
+		    ptrs[i++] = li;
+		if (item_compare_func_err)
+		{
+		    EMSG(_("E882: Uniq compare function failed"));
+		    break;
+		}
+	    }
 
-    /* If 'n' flag is used or search failed: restore cursor position. */
-    if ((flags & SP_NOMOVE) || retval == 0)
-	curwin->w_cursor = save_cursor;
+	    if (!item_compare_func_err)
+	    {
+		while (--i >= 0)
+		{
+		    li = ptrs[i]->li_next;
+		    vimlist_remove(l, li, li);
+		    listitem_free(li);
+		}
+	    }
+	}
 
-theend:
-    vim_free(pat2);
-    vim_free(pat3);
-    if (p_cpo == empty_option)
-	p_cpo = save_cpo;
-    else
-	/* Darn, evaluating the {skip} expression changed the value. */
-	free_string_option(save_cpo);
+	vim_free(ptrs);
+    }
+}
 
-    return retval;
+/*
+ * "sort({list})" function
+ */
+    static void
+f_sort(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    do_sort_uniq(argvars, rettv, TRUE);
 }
 
 /*
- * "searchpos()" function
+ * "uniq({list})" function
  */
     static void
-f_searchpos(argvars, rettv)
+f_uniq(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    pos_T	match_pos;
-    int		lnum = 0;
-    int		col = 0;
-    int		n;
-    int		flags = 0;
-
-    if (rettv_list_alloc(rettv) == FAIL)
-	return;
+    do_sort_uniq(argvars, rettv, FALSE);
+}
 
-    n = search_cmn(argvars, &match_pos, &flags);
-    if (n > 0)
-    {
-	lnum = match_pos.lnum;
-	col = match_pos.col;
-    }
+/*
+ * "soundfold({word})" function
+ */
+    static void
+f_soundfold(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    char_u	*s;
 
-    list_append_number(rettv->vval.v_list, (varnumber_T)lnum);
-    list_append_number(rettv->vval.v_list, (varnumber_T)col);
-    if (flags & SP_SUBPAT)
-	list_append_number(rettv->vval.v_list, (varnumber_T)n);
+    rettv->v_type = VAR_STRING;
+    s = get_tv_string(&argvars[0]);
+#ifdef FEAT_SPELL
+    rettv->vval.v_string = eval_soundfold(s);
+#else
+    rettv->vval.v_string = vim_strsave(s);
+#endif
 }
 
-
+/*
+ * "spellbadword()" function
+ */
     static void
-f_server2client(argvars, rettv)
+f_spellbadword(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-#ifdef FEAT_CLIENTSERVER
-    char_u	buf[NUMBUFLEN];
-    char_u	*server = get_tv_string_chk(&argvars[0]);
-    char_u	*reply = get_tv_string_buf_chk(&argvars[1], buf);
+    char_u	*word = (char_u *)"";
+    hlf_T	attr = HLF_COUNT;
+    int		len = 0;
 
-    rettv->vval.v_number = -1;
-    if (server == NULL || reply == NULL)
-	return;
-    if (check_restricted() || check_secure())
-	return;
-# ifdef FEAT_X11
-    if (check_connection() == FAIL)
+    if (rettv_list_alloc(rettv) == FAIL)
 	return;
-# endif
 
-    if (serverSendReply(server, reply) < 0)
+#ifdef FEAT_SPELL
+    if (argvars[0].v_type == VAR_UNKNOWN)
     {
-	EMSG(_("E258: Unable to send to client"));
-	return;
+	/* Find the start and length of the badly spelled word. */
+	len = spell_move_to(curwin, FORWARD, TRUE, TRUE, &attr);
+	if (len != 0)
+	    word = ml_get_cursor();
+    }
+    else if (curwin->w_p_spell && *curbuf->b_s.b_p_spl != NUL)
+    {
+	char_u	*str = get_tv_string_chk(&argvars[0]);
+	int	capcol = -1;
+
+	if (str != NULL)
+	{
+	    /* Check the argument for spelling. */
+	    while (*str != NUL)
+	    {
+		len = spell_check(curwin, str, &attr, &capcol, FALSE);
+		if (attr != HLF_COUNT)
+		{
+		    word = str;
+		    break;
+		}
+		str += len;
+	    }
+	}
     }
-    rettv->vval.v_number = 0;
-#else
-    rettv->vval.v_number = -1;
 #endif
+
+    list_append_string(rettv->vval.v_list, word, len);
+    list_append_string(rettv->vval.v_list, (char_u *)(
+			attr == HLF_SPB ? "bad" :
+			attr == HLF_SPR ? "rare" :
+			attr == HLF_SPL ? "local" :
+			attr == HLF_SPC ? "caps" :
+			""), -1);
 }
 
+/*
+ * "spellsuggest()" function
+ */
     static void
-f_serverlist(argvars, rettv)
+f_spellsuggest(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    char_u	*r = NULL;
+#ifdef FEAT_SPELL
+    char_u	*str;
+    int		typeerr = FALSE;
+    int		maxcount;
+    garray_T	ga;
+    int		i;
+    listitem_T	*li;
+    int		need_capital = FALSE;
+#endif
 
-#ifdef FEAT_CLIENTSERVER
-# ifdef WIN32
-    r = serverGetVimNames();
-# else
-    make_connection();
-    if (X_DISPLAY != NULL)
-	r = serverGetVimNames(X_DISPLAY);
-# endif
+    if (rettv_list_alloc(rettv) == FAIL)
+	return;
+
+#ifdef FEAT_SPELL
+    if (curwin->w_p_spell && *curwin->w_s->b_p_spl != NUL)
+    {
+	str = get_tv_string(&argvars[0]);
+	if (argvars[1].v_type != VAR_UNKNOWN)
+	{
+	    maxcount = get_tv_number_chk(&argvars[1], &typeerr);
+	    if (maxcount <= 0)
+		return;
+	    if (argvars[2].v_type != VAR_UNKNOWN)
+	    {
+		need_capital = get_tv_number_chk(&argvars[2], &typeerr);
+		if (typeerr)
+		    return;
+	    }
+	}
+	else
+	    maxcount = 25;
+
+	spell_suggest_list(&ga, str, maxcount, need_capital, FALSE);
+
+	for (i = 0; i < ga.ga_len; ++i)
+	{
+	    str = ((char_u **)ga.ga_data)[i];
+
+	    li = listitem_alloc();
+	    if (li == NULL)
+		vim_free(str);
+	    else
+	    {
+		li->li_tv.v_type = VAR_STRING;
+		li->li_tv.v_lock = 0;
+		li->li_tv.vval.v_string = str;
+		list_append(rettv->vval.v_list, li);
+	    }
+	}
+	ga_clear(&ga);
+    }
 #endif
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = r;
 }
 
-/*
- * "setbufvar()" function
- */
     static void
-f_setbufvar(argvars, rettv)
+f_split(argvars, rettv)
     typval_T	*argvars;
-    typval_T	*rettv UNUSED;
+    typval_T	*rettv;
 {
-    buf_T	*buf;
-    aco_save_T	aco;
-    char_u	*varname, *bufvarname;
-    typval_T	*varp;
-    char_u	nbuf[NUMBUFLEN];
+    char_u	*str;
+    char_u	*end;
+    char_u	*pat = NULL;
+    regmatch_T	regmatch;
+    char_u	patbuf[NUMBUFLEN];
+    char_u	*save_cpo;
+    int		match;
+    colnr_T	col = 0;
+    int		keepempty = FALSE;
+    int		typeerr = FALSE;
 
-    if (check_restricted() || check_secure())
-	return;
-    (void)get_tv_number(&argvars[0]);	    /* issue errmsg if type error */
-    varname = get_tv_string_chk(&argvars[1]);
-    buf = get_buf_tv(&argvars[0], FALSE);
-    varp = &argvars[2];
+    /* Make 'cpoptions' empty, the 'l' flag should not be used here. */
+    save_cpo = p_cpo;
+    p_cpo = (char_u *)"";
 
-    if (buf != NULL && varname != NULL && varp != NULL)
+    str = get_tv_string(&argvars[0]);
+    if (argvars[1].v_type != VAR_UNKNOWN)
     {
-	/* set curbuf to be our buf, temporarily */
-	aucmd_prepbuf(&aco, buf);
+	pat = get_tv_string_buf_chk(&argvars[1], patbuf);
+	if (pat == NULL)
+	    typeerr = TRUE;
+	if (argvars[2].v_type != VAR_UNKNOWN)
+	    keepempty = get_tv_number_chk(&argvars[2], &typeerr);
+    }
+    if (pat == NULL || *pat == NUL)
+	pat = (char_u *)"[\\x01- ]\\+";
 
-	if (*varname == '&')
-	{
-	    long	numval;
-	    char_u	*strval;
-	    int		error = FALSE;
+    if (rettv_list_alloc(rettv) == FAIL)
+	return;
+    if (typeerr)
+	return;
 
-	    ++varname;
-	    numval = get_tv_number_chk(varp, &error);
-	    strval = get_tv_string_buf_chk(varp, nbuf);
-	    if (!error && strval != NULL)
-		set_option_value(varname, numval, strval, OPT_LOCAL);
-	}
-	else
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    if (regmatch.regprog != NULL)
+    {
+	regmatch.rm_ic = FALSE;
+	while (*str != NUL || keepempty)
 	{
-	    bufvarname = alloc((unsigned)STRLEN(varname) + 3);
-	    if (bufvarname != NULL)
+	    if (*str == NUL)
+		match = FALSE;	/* empty item at the end */
+	    else
+		match = vim_regexec_nl(&regmatch, str, col);
+	    if (match)
+		end = regmatch.startp[0];
+	    else
+		end = str + STRLEN(str);
+	    if (keepempty || end > str || (rettv->vval.v_list->lv_len > 0
+			   && *str != NUL && match && end < regmatch.endp[0]))
+	    {
+		if (list_append_string(rettv->vval.v_list, str,
+						    (int)(end - str)) == FAIL)
+		    break;
+	    }
+	    if (!match)
+		break;
+	    /* Advance to just after the match. */
+	    if (regmatch.endp[0] > str)
+		col = 0;
+	    else
 	    {
-		STRCPY(bufvarname, "b:");
-		STRCPY(bufvarname + 2, varname);
-		set_var(bufvarname, varp, TRUE);
-		vim_free(bufvarname);
+		/* Don't get stuck at the same match. */
+#ifdef FEAT_MBYTE
+		col = (*mb_ptr2len)(regmatch.endp[0]);
+#else
+		col = 1;
+#endif
 	    }
+	    str = regmatch.endp[0];
 	}
 
-	/* reset notion of buffer */
-	aucmd_restbuf(&aco);
+	vim_regfree(regmatch.regprog);
     }
+
+    p_cpo = save_cpo;
 }
 
+#ifdef FEAT_FLOAT
 /*
- * "setcmdpos()" function
+ * "sqrt()" function
  */
     static void
-f_setcmdpos(argvars, rettv)
+f_sqrt(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    int		pos = (int)get_tv_number(&argvars[0]) - 1;
+    float_T	f;
 
-    if (pos >= 0)
-	rettv->vval.v_number = set_cmdline_pos(pos);
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	rettv->vval.v_float = sqrt(f);
+    else
+	rettv->vval.v_float = 0.0;
 }
 
 /*
- * "setline()" function
+ * "str2float()" function
  */
     static void
-f_setline(argvars, rettv)
+f_str2float(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    linenr_T	lnum;
-    char_u	*line = NULL;
-    list_T	*l = NULL;
-    listitem_T	*li = NULL;
-    long	added = 0;
-    linenr_T	lcount = curbuf->b_ml.ml_line_count;
+    char_u *p = skipwhite(get_tv_string(&argvars[0]));
 
-    lnum = get_tv_lnum(&argvars[0]);
-    if (argvars[1].v_type == VAR_LIST)
-    {
-	l = argvars[1].vval.v_list;
-	li = l->lv_first;
-    }
-    else
-	line = get_tv_string_chk(&argvars[1]);
+    if (*p == '+')
+	p = skipwhite(p + 1);
+    (void)string2float(p, &rettv->vval.v_float);
+    rettv->v_type = VAR_FLOAT;
+}
+#endif
 
-    /* default result is zero == OK */
-    for (;;)
+/*
+ * "str2nr()" function
+ */
+    static void
+f_str2nr(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    int		base = 10;
+    char_u	*p;
+    long	n;
+
+    if (argvars[1].v_type != VAR_UNKNOWN)
     {
-	if (l != NULL)
+	base = get_tv_number(&argvars[1]);
+	if (base != 8 && base != 10 && base != 16)
 	{
-	    /* list argument, get next string */
-	    if (li == NULL)
-		break;
-	    line = get_tv_string_chk(&li->li_tv);
-	    li = li->li_next;
+	    EMSG(_(e_invarg));
+	    return;
 	}
+    }
 
-	rettv->vval.v_number = 1;	/* FAIL */
-	if (line == NULL || lnum < 1 || lnum > curbuf->b_ml.ml_line_count + 1)
-	    break;
+    p = skipwhite(get_tv_string(&argvars[0]));
+    if (*p == '+')
+	p = skipwhite(p + 1);
+    vim_str2nr(p, NULL, NULL, base == 8 ? 2 : 0, base == 16 ? 2 : 0, &n, NULL);
+    rettv->vval.v_number = n;
+}
 
-	/* When coming here from Insert mode, sync undo, so that this can be
-	 * undone separately from what was previously inserted. */
-	if (u_sync_once == 2)
-	{
-	    u_sync_once = 1; /* notify that u_sync() was called */
-	    u_sync(TRUE);
-	}
+#ifdef HAVE_STRFTIME
+/*
+ * "strftime({format}[, {time}])" function
+ */
+    static void
+f_strftime(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    char_u	result_buf[256];
+    struct tm	*curtime;
+    time_t	seconds;
+    char_u	*p;
 
-	if (lnum <= curbuf->b_ml.ml_line_count)
-	{
-	    /* existing line, replace it */
-	    if (u_savesub(lnum) == OK && ml_replace(lnum, line, TRUE) == OK)
-	    {
-		changed_bytes(lnum, 0);
-		if (lnum == curwin->w_cursor.lnum)
-		    check_cursor_col();
-		rettv->vval.v_number = 0;	/* OK */
-	    }
-	}
-	else if (added > 0 || u_save(lnum - 1, lnum) == OK)
-	{
-	    /* lnum is one past the last line, append the line */
-	    ++added;
-	    if (ml_append(lnum - 1, line, (colnr_T)0, FALSE) == OK)
-		rettv->vval.v_number = 0;	/* OK */
-	}
+    rettv->v_type = VAR_STRING;
 
-	if (l == NULL)			/* only one string argument */
-	    break;
-	++lnum;
-    }
+    p = get_tv_string(&argvars[0]);
+    if (argvars[1].v_type == VAR_UNKNOWN)
+	seconds = time(NULL);
+    else
+	seconds = (time_t)get_tv_number(&argvars[1]);
+    curtime = localtime(&seconds);
+    /* MSVC returns NULL for an invalid value of seconds. */
+    if (curtime == NULL)
+	rettv->vval.v_string = vim_strsave((char_u *)_("(Invalid)"));
+    else
+    {
+# ifdef FEAT_MBYTE
+	vimconv_T   conv;
+	char_u	    *enc;
 
-    if (added > 0)
-	appended_lines_mark(lcount, added);
-}
+	conv.vc_type = CONV_NONE;
+	enc = enc_locale();
+	convert_setup(&conv, p_enc, enc);
+	if (conv.vc_type != CONV_NONE)
+	    p = string_convert(&conv, p, NULL);
+# endif
+	if (p != NULL)
+	    (void)strftime((char *)result_buf, sizeof(result_buf),
+							  (char *)p, curtime);
+	else
+	    result_buf[0] = NUL;
 
-static void set_qf_ll_list __ARGS((win_T *wp, typval_T *list_arg, typval_T *action_arg, typval_T *rettv));
+# ifdef FEAT_MBYTE
+	if (conv.vc_type != CONV_NONE)
+	    vim_free(p);
+	convert_setup(&conv, enc, p_enc);
+	if (conv.vc_type != CONV_NONE)
+	    rettv->vval.v_string = string_convert(&conv, result_buf, NULL);
+	else
+# endif
+	    rettv->vval.v_string = vim_strsave(result_buf);
+
+# ifdef FEAT_MBYTE
+	/* Release conversion descriptors */
+	convert_setup(&conv, NULL, NULL);
+	vim_free(enc);
+# endif
+    }
+}
+#endif
 
 /*
- * Used by "setqflist()" and "setloclist()" functions
+ * "stridx()" function
  */
     static void
-set_qf_ll_list(wp, list_arg, action_arg, rettv)
-    win_T	*wp UNUSED;
-    typval_T	*list_arg UNUSED;
-    typval_T	*action_arg UNUSED;
+f_stridx(argvars, rettv)
+    typval_T	*argvars;
     typval_T	*rettv;
 {
-#ifdef FEAT_QUICKFIX
-    char_u	*act;
-    int		action = ' ';
-#endif
+    char_u	buf[NUMBUFLEN];
+    char_u	*needle;
+    char_u	*haystack;
+    char_u	*save_haystack;
+    char_u	*pos;
+    int		start_idx;
 
+    needle = get_tv_string_chk(&argvars[1]);
+    save_haystack = haystack = get_tv_string_buf_chk(&argvars[0], buf);
     rettv->vval.v_number = -1;
+    if (needle == NULL || haystack == NULL)
+	return;		/* type error; errmsg already given */
 
-#ifdef FEAT_QUICKFIX
-    if (list_arg->v_type != VAR_LIST)
-	EMSG(_(e_listreq));
-    else
+    if (argvars[2].v_type != VAR_UNKNOWN)
     {
-	list_T  *l = list_arg->vval.v_list;
-
-	if (action_arg->v_type == VAR_STRING)
-	{
-	    act = get_tv_string_chk(action_arg);
-	    if (act == NULL)
-		return;		/* type error; errmsg already given */
-	    if (*act == 'a' || *act == 'r')
-		action = *act;
-	}
+	int	    error = FALSE;
 
-	if (l != NULL && set_errorlist(wp, l, action,
-	       (char_u *)(wp == NULL ? "setqflist()" : "setloclist()")) == OK)
-	    rettv->vval.v_number = 0;
+	start_idx = get_tv_number_chk(&argvars[2], &error);
+	if (error || start_idx >= (int)STRLEN(haystack))
+	    return;
+	if (start_idx >= 0)
+	    haystack += start_idx;
     }
-#endif
+
+    pos	= (char_u *)strstr((char *)haystack, (char *)needle);
+    if (pos != NULL)
+	rettv->vval.v_number = (varnumber_T)(pos - save_haystack);
 }
 
 /*
- * "setloclist()" function
+ * "string()" function
  */
     static void
-f_setloclist(argvars, rettv)
+f_string(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    win_T	*win;
+    char_u	*tofree;
+    char_u	numbuf[NUMBUFLEN];
 
-    rettv->vval.v_number = -1;
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = tv2string(&argvars[0], &tofree, numbuf, 0);
+    /* Make a copy if we have a value but it's not in allocated memory. */
+    if (rettv->vval.v_string != NULL && tofree == NULL)
+	rettv->vval.v_string = vim_strsave(rettv->vval.v_string);
+}
 
-    win = find_win_by_nr(&argvars[0], NULL);
-    if (win != NULL)
-	set_qf_ll_list(win, &argvars[1], &argvars[2], rettv);
+/*
+ * "strlen()" function
+ */
+    static void
+f_strlen(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    rettv->vval.v_number = (varnumber_T)(STRLEN(
+					      get_tv_string(&argvars[0])));
 }
 
 /*
- * "setmatches()" function
+ * "strchars()" function
  */
     static void
-f_setmatches(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
+f_strchars(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
 {
-#ifdef FEAT_SEARCH_EXTRA
-    list_T	*l;
-    listitem_T	*li;
-    dict_T	*d;
+    char_u		*s = get_tv_string(&argvars[0]);
+#ifdef FEAT_MBYTE
+    varnumber_T		len = 0;
 
-    rettv->vval.v_number = -1;
-    if (argvars[0].v_type != VAR_LIST)
-    {
-	EMSG(_(e_listreq));
-	return;
-    }
-    if ((l = argvars[0].vval.v_list) != NULL)
+    while (*s != NUL)
     {
-
-	/* To some extent make sure that we are dealing with a list from
-	 * "getmatches()". */
-	li = l->lv_first;
-	while (li != NULL)
-	{
-	    if (li->li_tv.v_type != VAR_DICT
-		    || (d = li->li_tv.vval.v_dict) == NULL)
-	    {
-		EMSG(_(e_invarg));
-		return;
-	    }
-	    if (!(dict_find(d, (char_u *)"group", -1) != NULL
-			&& dict_find(d, (char_u *)"pattern", -1) != NULL
-			&& dict_find(d, (char_u *)"priority", -1) != NULL
-			&& dict_find(d, (char_u *)"id", -1) != NULL))
-	    {
-		EMSG(_(e_invarg));
-		return;
-	    }
-	    li = li->li_next;
-	}
-
-	clear_matches(curwin);
-	li = l->lv_first;
-	while (li != NULL)
-	{
-	    d = li->li_tv.vval.v_dict;
-	    match_add(curwin, get_dict_string(d, (char_u *)"group", FALSE),
-		    get_dict_string(d, (char_u *)"pattern", FALSE),
-		    (int)get_dict_number(d, (char_u *)"priority"),
-		    (int)get_dict_number(d, (char_u *)"id"));
-	    li = li->li_next;
-	}
-	rettv->vval.v_number = 0;
+	mb_cptr2char_adv(&s);
+	++len;
     }
+    rettv->vval.v_number = len;
+#else
+    rettv->vval.v_number = (varnumber_T)(STRLEN(s));
 #endif
 }
 
 /*
- * "setpos()" function
+ * "strdisplaywidth()" function
  */
     static void
-f_setpos(argvars, rettv)
+f_strdisplaywidth(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    pos_T	pos;
-    int		fnum;
-    char_u	*name;
+    char_u	*s = get_tv_string(&argvars[0]);
+    int		col = 0;
 
-    rettv->vval.v_number = -1;
-    name = get_tv_string_chk(argvars);
-    if (name != NULL)
-    {
-	if (list2fpos(&argvars[1], &pos, &fnum) == OK)
-	{
-	    if (--pos.col < 0)
-		pos.col = 0;
-	    if (name[0] == '.' && name[1] == NUL)
-	    {
-		/* set cursor */
-		if (fnum == curbuf->b_fnum)
-		{
-		    curwin->w_cursor = pos;
-		    check_cursor();
-		    rettv->vval.v_number = 0;
-		}
-		else
-		    EMSG(_(e_invarg));
-	    }
-	    else if (name[0] == '\'' && name[1] != NUL && name[2] == NUL)
-	    {
-		/* set mark */
-		if (setmark_pos(name[1], &pos, fnum) == OK)
-		    rettv->vval.v_number = 0;
-	    }
-	    else
-		EMSG(_(e_invarg));
-	}
-    }
+    if (argvars[1].v_type != VAR_UNKNOWN)
+	col = get_tv_number(&argvars[1]);
+
+    rettv->vval.v_number = (varnumber_T)(linetabsize_col(col, s) - col);
 }
 
 /*
- * "setqflist()" function
+ * "strwidth()" function
  */
     static void
-f_setqflist(argvars, rettv)
+f_strwidth(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    set_qf_ll_list(NULL, &argvars[0], &argvars[1], rettv);
+    char_u	*s = get_tv_string(&argvars[0]);
+
+    rettv->vval.v_number = (varnumber_T)(
+#ifdef FEAT_MBYTE
+	    mb_string2cells(s, -1)
+#else
+	    STRLEN(s)
+#endif
+	    );
 }
 
 /*
- * "setreg()" function
+ * "strpart()" function
  */
     static void
-f_setreg(argvars, rettv)
+f_strpart(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    int		regname;
-    char_u	*strregname;
-    char_u	*stropt;
-    char_u	*strval;
-    int		append;
-    char_u	yank_type;
-    long	block_len;
-
-    block_len = -1;
-    yank_type = MAUTO;
-    append = FALSE;
+    char_u	*p;
+    int		n;
+    int		len;
+    int		slen;
+    int		error = FALSE;
 
-    strregname = get_tv_string_chk(argvars);
-    rettv->vval.v_number = 1;		/* FAIL is default */
+    p = get_tv_string(&argvars[0]);
+    slen = (int)STRLEN(p);
 
-    if (strregname == NULL)
-	return;		/* type error; errmsg already given */
-    regname = *strregname;
-    if (regname == 0 || regname == '@')
-	regname = '"';
+    n = get_tv_number_chk(&argvars[1], &error);
+    if (error)
+	len = 0;
+    else if (argvars[2].v_type != VAR_UNKNOWN)
+	len = get_tv_number(&argvars[2]);
+    else
+	len = slen - n;	    /* default len: all bytes that are available. */
 
-    if (argvars[2].v_type != VAR_UNKNOWN)
+    /*
+     * Only return the overlap between the specified part and the actual
+     * string.
+     */
+    if (n < 0)
     {
-	stropt = get_tv_string_chk(&argvars[2]);
-	if (stropt == NULL)
-	    return;		/* type error */
-	for (; *stropt != NUL; ++stropt)
-	    switch (*stropt)
-	    {
-		case 'a': case 'A':	/* append */
-		    append = TRUE;
-		    break;
-		case 'v': case 'c':	/* character-wise selection */
-		    yank_type = MCHAR;
-		    break;
-		case 'V': case 'l':	/* line-wise selection */
-		    yank_type = MLINE;
-		    break;
-		case 'b': case Ctrl_V:	/* block-wise selection */
-		    yank_type = MBLOCK;
-		    if (VIM_ISDIGIT(stropt[1]))
-		    {
-			++stropt;
-			block_len = getdigits(&stropt) - 1;
-			--stropt;
-		    }
-		    break;
-	    }
+	len += n;
+	n = 0;
     }
+    else if (n > slen)
+	n = slen;
+    if (len < 0)
+	len = 0;
+    else if (n + len > slen)
+	len = slen - n;
 
-    if (argvars[1].v_type == VAR_LIST)
-    {
-	char_u		**lstval;
-	char_u		**allocval;
-	char_u		buf[NUMBUFLEN];
-	char_u		**curval;
-	char_u		**curallocval;
-	int		len = argvars[1].vval.v_list->lv_len;
-	listitem_T	*li;
-
-	/* First half: use for pointers to result lines; second half: use for
-	 * pointers to allocated copies. */
-	lstval = (char_u **)alloc(sizeof(char_u *) * ((len + 1) * 2));
-	if (lstval == NULL)
-	    return;
-	curval = lstval;
-	allocval = lstval + len + 2;
-	curallocval = allocval;
-
-	for (li = argvars[1].vval.v_list->lv_first; li != NULL;
-							     li = li->li_next)
-	{
-	    strval = get_tv_string_buf_chk(&li->li_tv, buf);
-	    if (strval == NULL)
-		goto free_lstval;
-	    if (strval == buf)
-	    {
-		/* Need to make a copy, next get_tv_string_buf_chk() will
-		 * overwrite the string. */
-		strval = vim_strsave(buf);
-		if (strval == NULL)
-		    goto free_lstval;
-		*curallocval++ = strval;
-	    }
-	    *curval++ = strval;
-	}
-	*curval++ = NULL;
-
-	write_reg_contents_lst(regname, lstval, -1,
-						append, yank_type, block_len);
-free_lstval:
-	while (curallocval > allocval)
-	    vim_free(*--curallocval);
-	vim_free(lstval);
-    }
-    else
-    {
-	strval = get_tv_string_chk(&argvars[1]);
-	if (strval == NULL)
-	    return;
-	write_reg_contents_ex(regname, strval, -1,
-						append, yank_type, block_len);
-    }
-    rettv->vval.v_number = 0;
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = vim_strnsave(p + n, len);
 }
 
 /*
- * "settabvar()" function
+ * "strridx()" function
  */
     static void
-f_settabvar(argvars, rettv)
+f_strridx(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-#ifdef FEAT_WINDOWS
-    tabpage_T	*save_curtab;
-    tabpage_T	*tp;
-#endif
-    char_u	*varname, *tabvarname;
-    typval_T	*varp;
-
-    rettv->vval.v_number = 0;
+    char_u	buf[NUMBUFLEN];
+    char_u	*needle;
+    char_u	*haystack;
+    char_u	*rest;
+    char_u	*lastmatch = NULL;
+    int		haystack_len, end_idx;
 
-    if (check_restricted() || check_secure())
-	return;
+    needle = get_tv_string_chk(&argvars[1]);
+    haystack = get_tv_string_buf_chk(&argvars[0], buf);
 
-#ifdef FEAT_WINDOWS
-    tp = find_tabpage((int)get_tv_number_chk(&argvars[0], NULL));
-#endif
-    varname = get_tv_string_chk(&argvars[1]);
-    varp = &argvars[2];
+    rettv->vval.v_number = -1;
+    if (needle == NULL || haystack == NULL)
+	return;		/* type error; errmsg already given */
 
-    if (varname != NULL && varp != NULL
-#ifdef FEAT_WINDOWS
-	    && tp != NULL
-#endif
-	    )
+    haystack_len = (int)STRLEN(haystack);
+    if (argvars[2].v_type != VAR_UNKNOWN)
     {
-#ifdef FEAT_WINDOWS
-	save_curtab = curtab;
-	goto_tabpage_tp(tp, FALSE, FALSE);
-#endif
+	/* Third argument: upper limit for index */
+	end_idx = get_tv_number_chk(&argvars[2], NULL);
+	if (end_idx < 0)
+	    return;	/* can never find a match */
+    }
+    else
+	end_idx = haystack_len;
 
-	tabvarname = alloc((unsigned)STRLEN(varname) + 3);
-	if (tabvarname != NULL)
+    if (*needle == NUL)
+    {
+	/* Empty string matches past the end. */
+	lastmatch = haystack + end_idx;
+    }
+    else
+    {
+	for (rest = haystack; *rest != '\0'; ++rest)
 	{
-	    STRCPY(tabvarname, "t:");
-	    STRCPY(tabvarname + 2, varname);
-	    set_var(tabvarname, varp, TRUE);
-	    vim_free(tabvarname);
+	    rest = (char_u *)strstr((char *)rest, (char *)needle);
+	    if (rest == NULL || rest > haystack + end_idx)
+		break;
+	    lastmatch = rest;
 	}
-
-#ifdef FEAT_WINDOWS
-	/* Restore current tabpage */
-	if (valid_tabpage(save_curtab))
-	    goto_tabpage_tp(save_curtab, FALSE, FALSE);
-#endif
     }
+
+    if (lastmatch == NULL)
+	rettv->vval.v_number = -1;
+    else
+	rettv->vval.v_number = (varnumber_T)(lastmatch - haystack);
 }
 
 /*
- * "settabwinvar()" function
+ * "strtrans()" function
  */
     static void
-f_settabwinvar(argvars, rettv)
+f_strtrans(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    setwinvar(argvars, rettv, 1);
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = transstr(get_tv_string(&argvars[0]));
 }
 
 /*
- * "setwinvar()" function
+ * "submatch()" function
  */
     static void
-f_setwinvar(argvars, rettv)
+f_submatch(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    setwinvar(argvars, rettv, 0);
+    int		error = FALSE;
+    int		no;
+    int		retList = 0;
+
+    no = (int)get_tv_number_chk(&argvars[0], &error);
+    if (error)
+	return;
+    error = FALSE;
+    if (argvars[1].v_type != VAR_UNKNOWN)
+	retList = get_tv_number_chk(&argvars[1], &error);
+    if (error)
+	return;
+
+    if (retList == 0)
+    {
+	rettv->v_type = VAR_STRING;
+	rettv->vval.v_string = reg_submatch(no);
+    }
+    else
+    {
+	rettv->v_type = VAR_LIST;
+	rettv->vval.v_list = reg_submatch_list(no);
+    }
 }
 
 /*
- * "setwinvar()" and "settabwinvar()" functions
+ * "substitute()" function
  */
-
     static void
-setwinvar(argvars, rettv, off)
+f_substitute(argvars, rettv)
     typval_T	*argvars;
-    typval_T	*rettv UNUSED;
-    int		off;
+    typval_T	*rettv;
 {
-    win_T	*win;
-#ifdef FEAT_WINDOWS
-    win_T	*save_curwin;
-    tabpage_T	*save_curtab;
-#endif
-    char_u	*varname, *winvarname;
-    typval_T	*varp;
-    char_u	nbuf[NUMBUFLEN];
-    tabpage_T	*tp = NULL;
+    char_u	patbuf[NUMBUFLEN];
+    char_u	subbuf[NUMBUFLEN];
+    char_u	flagsbuf[NUMBUFLEN];
 
-    if (check_restricted() || check_secure())
-	return;
+    char_u	*str = get_tv_string_chk(&argvars[0]);
+    char_u	*pat = get_tv_string_buf_chk(&argvars[1], patbuf);
+    char_u	*sub = get_tv_string_buf_chk(&argvars[2], subbuf);
+    char_u	*flg = get_tv_string_buf_chk(&argvars[3], flagsbuf);
 
-#ifdef FEAT_WINDOWS
-    if (off == 1)
-	tp = find_tabpage((int)get_tv_number_chk(&argvars[0], NULL));
+    rettv->v_type = VAR_STRING;
+    if (str == NULL || pat == NULL || sub == NULL || flg == NULL)
+	rettv->vval.v_string = NULL;
     else
-	tp = curtab;
+	rettv->vval.v_string = do_string_sub(str, pat, sub, flg);
+}
+
+/*
+ * "synID(lnum, col, trans)" function
+ */
+    static void
+f_synID(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    int		id = 0;
+#ifdef FEAT_SYN_HL
+    long	lnum;
+    long	col;
+    int		trans;
+    int		transerr = FALSE;
+
+    lnum = get_tv_lnum(argvars);		/* -1 on type error */
+    col = get_tv_number(&argvars[1]) - 1;	/* -1 on type error */
+    trans = get_tv_number_chk(&argvars[2], &transerr);
+
+    if (!transerr && lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count
+	    && col >= 0 && col < (long)STRLEN(ml_get(lnum)))
+	id = syn_get_id(curwin, lnum, (colnr_T)col, trans, NULL, FALSE);
 #endif
-    win = find_win_by_nr(&argvars[off], tp);
-    varname = get_tv_string_chk(&argvars[off + 1]);
-    varp = &argvars[off + 2];
 
-    if (win != NULL && varname != NULL && varp != NULL)
+    rettv->vval.v_number = id;
+}
+
+/*
+ * "synIDattr(id, what [, mode])" function
+ */
+    static void
+f_synIDattr(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    char_u	*p = NULL;
+#ifdef FEAT_SYN_HL
+    int		id;
+    char_u	*what;
+    char_u	*mode;
+    char_u	modebuf[NUMBUFLEN];
+    int		modec;
+
+    id = get_tv_number(&argvars[0]);
+    what = get_tv_string(&argvars[1]);
+    if (argvars[2].v_type != VAR_UNKNOWN)
     {
-#ifdef FEAT_WINDOWS
-	if (switch_win(&save_curwin, &save_curtab, win, tp, TRUE) == FAIL)
-	    return;
+	mode = get_tv_string_buf(&argvars[2], modebuf);
+	modec = TOLOWER_ASC(mode[0]);
+	if (modec != 't' && modec != 'c' && modec != 'g')
+	    modec = 0;	/* replace invalid with current */
+    }
+    else
+    {
+#ifdef FEAT_GUI
+	if (gui.in_use)
+	    modec = 'g';
+	else
 #endif
+	    if (t_colors > 1)
+	    modec = 'c';
+	else
+	    modec = 't';
+    }
 
-	if (*varname == '&')
-	{
-	    long	numval;
-	    char_u	*strval;
-	    int		error = FALSE;
 
-	    ++varname;
-	    numval = get_tv_number_chk(varp, &error);
-	    strval = get_tv_string_buf_chk(varp, nbuf);
-	    if (!error && strval != NULL)
-		set_option_value(varname, numval, strval, OPT_LOCAL);
-	}
-	else
-	{
-	    winvarname = alloc((unsigned)STRLEN(varname) + 3);
-	    if (winvarname != NULL)
-	    {
-		STRCPY(winvarname, "w:");
-		STRCPY(winvarname + 2, varname);
-		set_var(winvarname, varp, TRUE);
-		vim_free(winvarname);
-	    }
-	}
+    switch (TOLOWER_ASC(what[0]))
+    {
+	case 'b':
+		if (TOLOWER_ASC(what[1]) == 'g')	/* bg[#] */
+		    p = highlight_color(id, what, modec);
+		else					/* bold */
+		    p = highlight_has_attr(id, HL_BOLD, modec);
+		break;
+
+	case 'f':					/* fg[#] or font */
+		p = highlight_color(id, what, modec);
+		break;
+
+	case 'i':
+		if (TOLOWER_ASC(what[1]) == 'n')	/* inverse */
+		    p = highlight_has_attr(id, HL_INVERSE, modec);
+		else					/* italic */
+		    p = highlight_has_attr(id, HL_ITALIC, modec);
+		break;
 
-#ifdef FEAT_WINDOWS
-	restore_win(save_curwin, save_curtab, TRUE);
-#endif
-    }
-}
+	case 'n':					/* name */
+		p = get_highlight_name(NULL, id - 1);
+		break;
 
-#ifdef FEAT_CRYPT
-/*
- * "sha256({string})" function
- */
-    static void
-f_sha256(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    char_u	*p;
+	case 'r':					/* reverse */
+		p = highlight_has_attr(id, HL_INVERSE, modec);
+		break;
 
-    p = get_tv_string(&argvars[0]);
-    rettv->vval.v_string = vim_strsave(
-				    sha256_bytes(p, (int)STRLEN(p), NULL, 0));
-    rettv->v_type = VAR_STRING;
-}
-#endif /* FEAT_CRYPT */
+	case 's':
+		if (TOLOWER_ASC(what[1]) == 'p')	/* sp[#] */
+		    p = highlight_color(id, what, modec);
+		else					/* standout */
+		    p = highlight_has_attr(id, HL_STANDOUT, modec);
+		break;
 
-/*
- * "shellescape({string})" function
- */
-    static void
-f_shellescape(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    rettv->vval.v_string = vim_strsave_shellescape(
-		get_tv_string(&argvars[0]), non_zero_arg(&argvars[1]), TRUE);
+	case 'u':
+		if (STRLEN(what) <= 5 || TOLOWER_ASC(what[5]) != 'c')
+							/* underline */
+		    p = highlight_has_attr(id, HL_UNDERLINE, modec);
+		else
+							/* undercurl */
+		    p = highlight_has_attr(id, HL_UNDERCURL, modec);
+		break;
+    }
+
+    if (p != NULL)
+	p = vim_strsave(p);
+#endif
     rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = p;
 }
 
 /*
- * shiftwidth() function
+ * "synIDtrans(id)" function
  */
     static void
-f_shiftwidth(argvars, rettv)
+f_synIDtrans(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = get_sw_value(curbuf);
-}
+    int		id;
 
-/*
- * "simplify()" function
- */
-    static void
-f_simplify(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    char_u	*p;
+#ifdef FEAT_SYN_HL
+    id = get_tv_number(&argvars[0]);
 
-    p = get_tv_string(&argvars[0]);
-    rettv->vval.v_string = vim_strsave(p);
-    simplify_filename(rettv->vval.v_string);	/* simplify in place */
-    rettv->v_type = VAR_STRING;
+    if (id > 0)
+	id = syn_get_final_id(id);
+    else
+#endif
+	id = 0;
+
+    rettv->vval.v_number = id;
 }
 
-#ifdef FEAT_FLOAT
 /*
- * "sin()" function
+ * "synconcealed(lnum, col)" function
  */
     static void
-f_sin(argvars, rettv)
-    typval_T	*argvars;
+f_synconcealed(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    float_T	f;
+#if defined(FEAT_SYN_HL) && defined(FEAT_CONCEAL)
+    long	lnum;
+    long	col;
+    int		syntax_flags = 0;
+    int		cchar;
+    int		matchid = 0;
+    char_u	str[NUMBUFLEN];
+#endif
 
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	rettv->vval.v_float = sin(f);
-    else
-	rettv->vval.v_float = 0.0;
-}
+    rettv->v_type = VAR_LIST;
+    rettv->vval.v_list = NULL;
 
-/*
- * "sinh()" function
- */
-    static void
-f_sinh(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    float_T	f;
+#if defined(FEAT_SYN_HL) && defined(FEAT_CONCEAL)
+    lnum = get_tv_lnum(argvars);		/* -1 on type error */
+    col = get_tv_number(&argvars[1]) - 1;	/* -1 on type error */
 
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	rettv->vval.v_float = sinh(f);
-    else
-	rettv->vval.v_float = 0.0;
-}
-#endif
+    vim_memset(str, NUL, sizeof(str));
 
-static int
-#ifdef __BORLANDC__
-    _RTLENTRYF
-#endif
-	item_compare __ARGS((const void *s1, const void *s2));
-static int
-#ifdef __BORLANDC__
-    _RTLENTRYF
-#endif
-	item_compare2 __ARGS((const void *s1, const void *s2));
+    if (rettv_list_alloc(rettv) != FAIL)
+    {
+	if (lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count
+	    && col >= 0 && col <= (long)STRLEN(ml_get(lnum))
+	    && curwin->w_p_cole > 0)
+	{
+	    (void)syn_get_id(curwin, lnum, col, FALSE, NULL, FALSE);
+	    syntax_flags = get_syntax_info(&matchid);
 
-static int	item_compare_ic;
-static char_u	*item_compare_func;
-static dict_T	*item_compare_selfdict;
-static int	item_compare_func_err;
-static void	do_sort_uniq __ARGS((typval_T *argvars, typval_T *rettv, int sort));
-#define ITEM_COMPARE_FAIL 999
+	    /* get the conceal character */
+	    if ((syntax_flags & HL_CONCEAL) && curwin->w_p_cole < 3)
+	    {
+		cchar = syn_get_sub_char();
+		if (cchar == NUL && curwin->w_p_cole == 1 && lcs_conceal != NUL)
+		    cchar = lcs_conceal;
+		if (cchar != NUL)
+		{
+# ifdef FEAT_MBYTE
+		    if (has_mbyte)
+			(*mb_char2bytes)(cchar, str);
+		    else
+# endif
+			str[0] = cchar;
+		}
+	    }
+	}
 
-/*
- * Compare functions for f_sort() and f_uniq() below.
- */
-    static int
-#ifdef __BORLANDC__
-_RTLENTRYF
+	list_append_number(rettv->vval.v_list,
+					    (syntax_flags & HL_CONCEAL) != 0);
+	/* -1 to auto-determine strlen */
+	list_append_string(rettv->vval.v_list, str, -1);
+	list_append_number(rettv->vval.v_list, matchid);
+    }
 #endif
-item_compare(s1, s2)
-    const void	*s1;
-    const void	*s2;
-{
-    char_u	*p1, *p2;
-    char_u	*tofree1, *tofree2;
-    int		res;
-    char_u	numbuf1[NUMBUFLEN];
-    char_u	numbuf2[NUMBUFLEN];
-
-    p1 = tv2string(&(*(listitem_T **)s1)->li_tv, &tofree1, numbuf1, 0);
-    p2 = tv2string(&(*(listitem_T **)s2)->li_tv, &tofree2, numbuf2, 0);
-    if (p1 == NULL)
-	p1 = (char_u *)"";
-    if (p2 == NULL)
-	p2 = (char_u *)"";
-    if (item_compare_ic)
-	res = STRICMP(p1, p2);
-    else
-	res = STRCMP(p1, p2);
-    vim_free(tofree1);
-    vim_free(tofree2);
-    return res;
 }
 
-    static int
-#ifdef __BORLANDC__
-_RTLENTRYF
-#endif
-item_compare2(s1, s2)
-    const void	*s1;
-    const void	*s2;
+/*
+ * "synstack(lnum, col)" function
+ */
+    static void
+f_synstack(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
 {
-    int		res;
-    typval_T	rettv;
-    typval_T	argv[3];
-    int		dummy;
-
-    /* shortcut after failure in previous call; compare all items equal */
-    if (item_compare_func_err)
-	return 0;
-
-    /* copy the values.  This is needed to be able to set v_lock to VAR_FIXED
-     * in the copy without changing the original list items. */
-    copy_tv(&(*(listitem_T **)s1)->li_tv, &argv[0]);
-    copy_tv(&(*(listitem_T **)s2)->li_tv, &argv[1]);
+#ifdef FEAT_SYN_HL
+    long	lnum;
+    long	col;
+    int		i;
+    int		id;
+#endif
 
-    rettv.v_type = VAR_UNKNOWN;		/* clear_tv() uses this */
-    res = call_func(item_compare_func, (int)STRLEN(item_compare_func),
-				 &rettv, 2, argv, 0L, 0L, &dummy, TRUE,
-				 item_compare_selfdict);
-    clear_tv(&argv[0]);
-    clear_tv(&argv[1]);
+    rettv->v_type = VAR_LIST;
+    rettv->vval.v_list = NULL;
 
-    if (res == FAIL)
-	res = ITEM_COMPARE_FAIL;
-    else
-	res = get_tv_number_chk(&rettv, &item_compare_func_err);
-    if (item_compare_func_err)
-	res = ITEM_COMPARE_FAIL;  /* return value has wrong type */
-    clear_tv(&rettv);
-    return res;
+#ifdef FEAT_SYN_HL
+    lnum = get_tv_lnum(argvars);		/* -1 on type error */
+    col = get_tv_number(&argvars[1]) - 1;	/* -1 on type error */
+
+    if (lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count
+	    && col >= 0 && col <= (long)STRLEN(ml_get(lnum))
+	    && rettv_list_alloc(rettv) != FAIL)
+    {
+	(void)syn_get_id(curwin, lnum, (colnr_T)col, FALSE, NULL, TRUE);
+	for (i = 0; ; ++i)
+	{
+	    id = syn_get_stack_item(i);
+	    if (id < 0)
+		break;
+	    if (list_append_number(rettv->vval.v_list, id) == FAIL)
+		break;
+	}
+    }
+#endif
 }
 
-/*
- * "sort({list})" function
- */
     static void
-do_sort_uniq(argvars, rettv, sort)
+get_cmd_output_as_rettv(argvars, rettv, retlist)
     typval_T	*argvars;
     typval_T	*rettv;
-    int		sort;
+    int		retlist;
 {
-    list_T	*l;
-    listitem_T	*li;
-    listitem_T	**ptrs;
-    long	len;
-    long	i;
-
-    if (argvars[0].v_type != VAR_LIST)
-	EMSG2(_(e_listarg), sort ? "sort()" : "uniq()");
-    else
-    {
-	l = argvars[0].vval.v_list;
-	if (l == NULL || tv_check_lock(l->lv_lock,
-	       (char_u *)(sort ? _("sort() argument") : _("uniq() argument"))))
-	    return;
-	rettv->vval.v_list = l;
-	rettv->v_type = VAR_LIST;
-	++l->lv_refcount;
+    char_u	*res = NULL;
+    char_u	*p;
+    char_u	*infile = NULL;
+    char_u	buf[NUMBUFLEN];
+    int		err = FALSE;
+    FILE	*fd;
+    list_T	*list = NULL;
 
-	len = list_len(l);
-	if (len <= 1)
-	    return;	/* short list sorts pretty quickly */
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+    if (check_restricted() || check_secure())
+	goto errret;
 
-	item_compare_ic = FALSE;
-	item_compare_func = NULL;
-	item_compare_selfdict = NULL;
-	if (argvars[1].v_type != VAR_UNKNOWN)
+    if (argvars[1].v_type != VAR_UNKNOWN)
+    {
+	/*
+	 * Write the string to a temp file, to be used for input of the shell
+	 * command.
+	 */
+	if ((infile = vim_tempname('i')) == NULL)
 	{
-	    /* optional second argument: {func} */
-	    if (argvars[1].v_type == VAR_FUNC)
-		item_compare_func = argvars[1].vval.v_string;
-	    else
-	    {
-		int	    error = FALSE;
-
-		i = get_tv_number_chk(&argvars[1], &error);
-		if (error)
-		    return;		/* type error; errmsg already given */
-		if (i == 1)
-		    item_compare_ic = TRUE;
-		else
-		    item_compare_func = get_tv_string(&argvars[1]);
-	    }
+	    EMSG(_(e_notmp));
+	    goto errret;
+	}
 
-	    if (argvars[2].v_type != VAR_UNKNOWN)
+	fd = mch_fopen((char *)infile, WRITEBIN);
+	if (fd == NULL)
+	{
+	    EMSG2(_(e_notopen), infile);
+	    goto errret;
+	}
+	if (argvars[1].v_type == VAR_LIST)
+	{
+	    if (write_list(fd, argvars[1].vval.v_list, TRUE) == FAIL)
+		err = TRUE;
+	}
+	else
+	{
+	    p = get_tv_string_buf_chk(&argvars[1], buf);
+	    if (p == NULL)
 	    {
-		/* optional third argument: {dict} */
-		if (argvars[2].v_type != VAR_DICT)
-		{
-		    EMSG(_(e_dictreq));
-		    return;
-		}
-		item_compare_selfdict = argvars[2].vval.v_dict;
+		fclose(fd);
+		goto errret;		/* type error; errmsg already given */
 	    }
+	    if (fwrite(p, STRLEN(p), 1, fd) != 1)
+		err = TRUE;
+	}
+	if (fclose(fd) != 0)
+	    err = TRUE;
+	if (err)
+	{
+	    EMSG(_("E677: Error writing temp file"));
+	    goto errret;
 	}
+    }
 
-	/* Make an array with each entry pointing to an item in the List. */
-	ptrs = (listitem_T **)alloc((int)(len * sizeof(listitem_T *)));
-	if (ptrs == NULL)
-	    return;
+    if (retlist)
+    {
+	int		len;
+	listitem_T	*li;
+	char_u		*s = NULL;
+	char_u		*start;
+	char_u		*end;
+	int		i;
 
-	i = 0;
-	if (sort)
+	res = get_cmd_output(get_tv_string(&argvars[0]), infile,
+					   SHELL_SILENT | SHELL_COOKED, &len);
+	if (res == NULL)
+	    goto errret;
+
+	list = list_alloc();
+	if (list == NULL)
+	    goto errret;
+
+	for (i = 0; i < len; ++i)
 	{
-	    /* sort(): ptrs will be the list to sort */
-	    for (li = l->lv_first; li != NULL; li = li->li_next)
-		ptrs[i++] = li;
+	    start = res + i;
+	    while (i < len && res[i] != NL)
+		++i;
+	    end = res + i;
 
-	    item_compare_func_err = FALSE;
-	    /* test the compare function */
-	    if (item_compare_func != NULL
-		    && item_compare2((void *)&ptrs[0], (void *)&ptrs[1])
-							 == ITEM_COMPARE_FAIL)
-		EMSG(_("E702: Sort compare function failed"));
-	    else
-	    {
-		/* Sort the array with item pointers. */
-		qsort((void *)ptrs, (size_t)len, sizeof(listitem_T *),
-		    item_compare_func == NULL ? item_compare : item_compare2);
+	    s = alloc((unsigned)(end - start + 1));
+	    if (s == NULL)
+		goto errret;
 
-		if (!item_compare_func_err)
-		{
-		    /* Clear the List and append the items in sorted order. */
-		    l->lv_first = l->lv_last = l->lv_idx_item = NULL;
-		    l->lv_len = 0;
-		    for (i = 0; i < len; ++i)
-			list_append(l, ptrs[i]);
-		}
+	    for (p = s; start < end; ++p, ++start)
+		*p = *start == NUL ? NL : *start;
+	    *p = NUL;
+
+	    li = listitem_alloc();
+	    if (li == NULL)
+	    {
+		vim_free(s);
+		goto errret;
 	    }
+	    li->li_tv.v_type = VAR_STRING;
+	    li->li_tv.vval.v_string = s;
+	    list_append(list, li);
 	}
-	else
-	{
-	    int	(*item_compare_func_ptr)__ARGS((const void *, const void *));
 
-	    /* f_uniq(): ptrs will be a stack of items to remove */
-	    item_compare_func_err = FALSE;
-	    item_compare_func_ptr = item_compare_func
-					       ? item_compare2 : item_compare;
+	++list->lv_refcount;
+	rettv->v_type = VAR_LIST;
+	rettv->vval.v_list = list;
+	list = NULL;
+    }
+    else
+    {
+	res = get_cmd_output(get_tv_string(&argvars[0]), infile,
+					   SHELL_SILENT | SHELL_COOKED, NULL);
+#ifdef USE_CR
+	/* translate <CR> into <NL> */
+	if (res != NULL)
+	{
+	    char_u	*s;
 
-	    for (li = l->lv_first; li != NULL && li->li_next != NULL;
-							     li = li->li_next)
+	    for (s = res; *s; ++s)
 	    {
-		if (item_compare_func_ptr((void *)&li, (void *)&li->li_next)
-									 == 0)
-		    ptrs[i++] = li;
-		if (item_compare_func_err)
-		{
-		    EMSG(_("E882: Uniq compare function failed"));
-		    break;
-		}
+		if (*s == CAR)
+		    *s = NL;
 	    }
+	}
+#else
+# ifdef USE_CRNL
+	/* translate <CR><NL> into <NL> */
+	if (res != NULL)
+	{
+	    char_u	*s, *d;
 
-	    if (!item_compare_func_err)
+	    d = res;
+	    for (s = res; *s; ++s)
 	    {
-		while (--i >= 0)
-		{
-		    li = ptrs[i]->li_next;
-		    ptrs[i]->li_next = li->li_next;
-		    if (li->li_next != NULL)
-			li->li_next->li_prev = ptrs[i];
-		    else
-			l->lv_last = ptrs[i];
-		    list_fix_watch(l, li);
-		    listitem_free(li);
-		    l->lv_len--;
-		}
+		if (s[0] == CAR && s[1] == NL)
+		    ++s;
+		*d++ = *s;
 	    }
+	    *d = NUL;
 	}
-
-	vim_free(ptrs);
-    }
-}
-
-/*
- * "sort({list})" function
- */
-    static void
-f_sort(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    do_sort_uniq(argvars, rettv, TRUE);
+# endif
+#endif
+	rettv->vval.v_string = res;
+	res = NULL;
+    }
+
+errret:
+    if (infile != NULL)
+    {
+	mch_remove(infile);
+	vim_free(infile);
+    }
+    if (res != NULL)
+	vim_free(res);
+    if (list != NULL)
+	list_free(list, TRUE);
 }
 
 /*
- * "uniq({list})" function
+ * "system()" function
  */
     static void
-f_uniq(argvars, rettv)
+f_system(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    do_sort_uniq(argvars, rettv, FALSE);
+    get_cmd_output_as_rettv(argvars, rettv, FALSE);
 }
 
 /*
- * "soundfold({word})" function
+ * "systemlist()" function
  */
     static void
-f_soundfold(argvars, rettv)
+f_systemlist(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	*s;
-
-    rettv->v_type = VAR_STRING;
-    s = get_tv_string(&argvars[0]);
-#ifdef FEAT_SPELL
-    rettv->vval.v_string = eval_soundfold(s);
-#else
-    rettv->vval.v_string = vim_strsave(s);
-#endif
+    get_cmd_output_as_rettv(argvars, rettv, TRUE);
 }
 
 /*
- * "spellbadword()" function
+ * "tabpagebuflist()" function
  */
     static void
-f_spellbadword(argvars, rettv)
+f_tabpagebuflist(argvars, rettv)
     typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+    typval_T	*rettv UNUSED;
 {
-    char_u	*word = (char_u *)"";
-    hlf_T	attr = HLF_COUNT;
-    int		len = 0;
-
-    if (rettv_list_alloc(rettv) == FAIL)
-	return;
+#ifdef FEAT_WINDOWS
+    tabpage_T	*tp;
+    win_T	*wp = NULL;
 
-#ifdef FEAT_SPELL
     if (argvars[0].v_type == VAR_UNKNOWN)
+	wp = firstwin;
+    else
     {
-	/* Find the start and length of the badly spelled word. */
-	len = spell_move_to(curwin, FORWARD, TRUE, TRUE, &attr);
-	if (len != 0)
-	    word = ml_get_cursor();
+	tp = find_tabpage((int)get_tv_number(&argvars[0]));
+	if (tp != NULL)
+	    wp = (tp == curtab) ? firstwin : tp->tp_firstwin;
     }
-    else if (curwin->w_p_spell && *curbuf->b_s.b_p_spl != NUL)
+    if (wp != NULL && rettv_list_alloc(rettv) != FAIL)
     {
-	char_u	*str = get_tv_string_chk(&argvars[0]);
-	int	capcol = -1;
-
-	if (str != NULL)
-	{
-	    /* Check the argument for spelling. */
-	    while (*str != NUL)
-	    {
-		len = spell_check(curwin, str, &attr, &capcol, FALSE);
-		if (attr != HLF_COUNT)
-		{
-		    word = str;
-		    break;
-		}
-		str += len;
-	    }
-	}
+	for (; wp != NULL; wp = wp->w_next)
+	    if (list_append_number(rettv->vval.v_list,
+						wp->w_buffer->b_fnum) == FAIL)
+		break;
     }
 #endif
-
-    list_append_string(rettv->vval.v_list, word, len);
-    list_append_string(rettv->vval.v_list, (char_u *)(
-			attr == HLF_SPB ? "bad" :
-			attr == HLF_SPR ? "rare" :
-			attr == HLF_SPL ? "local" :
-			attr == HLF_SPC ? "caps" :
-			""), -1);
 }
 
+
 /*
- * "spellsuggest()" function
+ * "tabpagenr()" function
  */
     static void
-f_spellsuggest(argvars, rettv)
+f_tabpagenr(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-#ifdef FEAT_SPELL
-    char_u	*str;
-    int		typeerr = FALSE;
-    int		maxcount;
-    garray_T	ga;
-    int		i;
-    listitem_T	*li;
-    int		need_capital = FALSE;
-#endif
-
-    if (rettv_list_alloc(rettv) == FAIL)
-	return;
+    int		nr = 1;
+#ifdef FEAT_WINDOWS
+    char_u	*arg;
 
-#ifdef FEAT_SPELL
-    if (curwin->w_p_spell && *curwin->w_s->b_p_spl != NUL)
+    if (argvars[0].v_type != VAR_UNKNOWN)
     {
-	str = get_tv_string(&argvars[0]);
-	if (argvars[1].v_type != VAR_UNKNOWN)
-	{
-	    maxcount = get_tv_number_chk(&argvars[1], &typeerr);
-	    if (maxcount <= 0)
-		return;
-	    if (argvars[2].v_type != VAR_UNKNOWN)
-	    {
-		need_capital = get_tv_number_chk(&argvars[2], &typeerr);
-		if (typeerr)
-		    return;
-	    }
-	}
-	else
-	    maxcount = 25;
-
-	spell_suggest_list(&ga, str, maxcount, need_capital, FALSE);
-
-	for (i = 0; i < ga.ga_len; ++i)
+	arg = get_tv_string_chk(&argvars[0]);
+	nr = 0;
+	if (arg != NULL)
 	{
-	    str = ((char_u **)ga.ga_data)[i];
-
-	    li = listitem_alloc();
-	    if (li == NULL)
-		vim_free(str);
+	    if (STRCMP(arg, "$") == 0)
+		nr = tabpage_index(NULL) - 1;
 	    else
-	    {
-		li->li_tv.v_type = VAR_STRING;
-		li->li_tv.v_lock = 0;
-		li->li_tv.vval.v_string = str;
-		list_append(rettv->vval.v_list, li);
-	    }
+		EMSG2(_(e_invexpr2), arg);
 	}
-	ga_clear(&ga);
     }
+    else
+	nr = tabpage_index(curtab);
 #endif
+    rettv->vval.v_number = nr;
 }
 
-    static void
-f_split(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    char_u	*str;
-    char_u	*end;
-    char_u	*pat = NULL;
-    regmatch_T	regmatch;
-    char_u	patbuf[NUMBUFLEN];
-    char_u	*save_cpo;
-    int		match;
-    colnr_T	col = 0;
-    int		keepempty = FALSE;
-    int		typeerr = FALSE;
 
-    /* Make 'cpoptions' empty, the 'l' flag should not be used here. */
-    save_cpo = p_cpo;
-    p_cpo = (char_u *)"";
+#ifdef FEAT_WINDOWS
+static int get_winnr __ARGS((tabpage_T *tp, typval_T *argvar));
 
-    str = get_tv_string(&argvars[0]);
-    if (argvars[1].v_type != VAR_UNKNOWN)
+/*
+ * Common code for tabpagewinnr() and winnr().
+ */
+    static int
+get_winnr(tp, argvar)
+    tabpage_T	*tp;
+    typval_T	*argvar;
+{
+    win_T	*twin;
+    int		nr = 1;
+    win_T	*wp;
+    char_u	*arg;
+
+    twin = (tp == curtab) ? curwin : tp->tp_curwin;
+    if (argvar->v_type != VAR_UNKNOWN)
     {
-	pat = get_tv_string_buf_chk(&argvars[1], patbuf);
-	if (pat == NULL)
-	    typeerr = TRUE;
-	if (argvars[2].v_type != VAR_UNKNOWN)
-	    keepempty = get_tv_number_chk(&argvars[2], &typeerr);
+	arg = get_tv_string_chk(argvar);
+	if (arg == NULL)
+	    nr = 0;		/* type error; errmsg already given */
+	else if (STRCMP(arg, "$") == 0)
+	    twin = (tp == curtab) ? lastwin : tp->tp_lastwin;
+	else if (STRCMP(arg, "#") == 0)
+	{
+	    twin = (tp == curtab) ? prevwin : tp->tp_prevwin;
+	    if (twin == NULL)
+		nr = 0;
+	}
+	else
+	{
+	    EMSG2(_(e_invexpr2), arg);
+	    nr = 0;
+	}
     }
-    if (pat == NULL || *pat == NUL)
-	pat = (char_u *)"[\\x01- ]\\+";
-
-    if (rettv_list_alloc(rettv) == FAIL)
-	return;
-    if (typeerr)
-	return;
 
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
-    if (regmatch.regprog != NULL)
-    {
-	regmatch.rm_ic = FALSE;
-	while (*str != NUL || keepempty)
+    if (nr > 0)
+	for (wp = (tp == curtab) ? firstwin : tp->tp_firstwin;
+					      wp != twin; wp = wp->w_next)
 	{
-	    if (*str == NUL)
-		match = FALSE;	/* empty item at the end */
-	    else
-		match = vim_regexec_nl(&regmatch, str, col);
-	    if (match)
-		end = regmatch.startp[0];
-	    else
-		end = str + STRLEN(str);
-	    if (keepempty || end > str || (rettv->vval.v_list->lv_len > 0
-			   && *str != NUL && match && end < regmatch.endp[0]))
-	    {
-		if (list_append_string(rettv->vval.v_list, str,
-						    (int)(end - str)) == FAIL)
-		    break;
-	    }
-	    if (!match)
-		break;
-	    /* Advance to just after the match. */
-	    if (regmatch.endp[0] > str)
-		col = 0;
-	    else
+	    if (wp == NULL)
 	    {
-		/* Don't get stuck at the same match. */
-#ifdef FEAT_MBYTE
-		col = (*mb_ptr2len)(regmatch.endp[0]);
-#else
-		col = 1;
-#endif
+		/* didn't find it in this tabpage */
+		nr = 0;
+		break;
 	    }
-	    str = regmatch.endp[0];
+	    ++nr;
 	}
-
-	vim_regfree(regmatch.regprog);
-    }
-
-    p_cpo = save_cpo;
+    return nr;
 }
+#endif
 
-#ifdef FEAT_FLOAT
 /*
- * "sqrt()" function
+ * "tabpagewinnr()" function
  */
     static void
-f_sqrt(argvars, rettv)
-    typval_T	*argvars;
+f_tabpagewinnr(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    float_T	f;
+    int		nr = 1;
+#ifdef FEAT_WINDOWS
+    tabpage_T	*tp;
 
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	rettv->vval.v_float = sqrt(f);
+    tp = find_tabpage((int)get_tv_number(&argvars[0]));
+    if (tp == NULL)
+	nr = 0;
     else
-	rettv->vval.v_float = 0.0;
+	nr = get_winnr(tp, &argvars[1]);
+#endif
+    rettv->vval.v_number = nr;
 }
 
+
 /*
- * "str2float()" function
+ * "tagfiles()" function
  */
     static void
-f_str2float(argvars, rettv)
-    typval_T	*argvars;
+f_tagfiles(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    char_u *p = skipwhite(get_tv_string(&argvars[0]));
+    char_u	*fname;
+    tagname_T	tn;
+    int		first;
 
-    if (*p == '+')
-	p = skipwhite(p + 1);
-    (void)string2float(p, &rettv->vval.v_float);
-    rettv->v_type = VAR_FLOAT;
+    if (rettv_list_alloc(rettv) == FAIL)
+	return;
+    fname = alloc(MAXPATHL);
+    if (fname == NULL)
+	return;
+
+    for (first = TRUE; ; first = FALSE)
+	if (get_tagfname(&tn, first, fname) == FAIL
+		|| list_append_string(rettv->vval.v_list, fname, -1) == FAIL)
+	    break;
+    tagname_free(&tn);
+    vim_free(fname);
 }
-#endif
 
 /*
- * "str2nr()" function
+ * "taglist()" function
  */
     static void
-f_str2nr(argvars, rettv)
-    typval_T	*argvars;
+f_taglist(argvars, rettv)
+    typval_T  *argvars;
+    typval_T  *rettv;
+{
+    char_u  *tag_pattern;
+
+    tag_pattern = get_tv_string(&argvars[0]);
+
+    rettv->vval.v_number = FALSE;
+    if (*tag_pattern == NUL)
+	return;
+
+    if (rettv_list_alloc(rettv) == OK)
+	(void)get_tags(rettv->vval.v_list, tag_pattern);
+}
+
+/*
+ * "tempname()" function
+ */
+    static void
+f_tempname(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    int		base = 10;
-    char_u	*p;
-    long	n;
+    static int	x = 'A';
 
-    if (argvars[1].v_type != VAR_UNKNOWN)
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = vim_tempname(x);
+
+    /* Advance 'x' to use A-Z and 0-9, so that there are at least 34 different
+     * names.  Skip 'I' and 'O', they are used for shell redirection. */
+    do
     {
-	base = get_tv_number(&argvars[1]);
-	if (base != 8 && base != 10 && base != 16)
+	if (x == 'Z')
+	    x = '0';
+	else if (x == '9')
+	    x = 'A';
+	else
 	{
-	    EMSG(_(e_invarg));
-	    return;
+#ifdef EBCDIC
+	    if (x == 'I')
+		x = 'J';
+	    else if (x == 'R')
+		x = 'S';
+	    else
+#endif
+		++x;
 	}
-    }
+    } while (x == 'I' || x == 'O');
+}
 
-    p = skipwhite(get_tv_string(&argvars[0]));
-    if (*p == '+')
-	p = skipwhite(p + 1);
-    vim_str2nr(p, NULL, NULL, base == 8 ? 2 : 0, base == 16 ? 2 : 0, &n, NULL);
-    rettv->vval.v_number = n;
+/*
+ * "test(list)" function: Just checking the walls...
+ */
+    static void
+f_test(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv UNUSED;
+{
+    /* Used for unit testing.  Change the code below to your liking. */
+#if 0
+    listitem_T	*li;
+    list_T	*l;
+    char_u	*bad, *good;
+
+    if (argvars[0].v_type != VAR_LIST)
+	return;
+    l = argvars[0].vval.v_list;
+    if (l == NULL)
+	return;
+    li = l->lv_first;
+    if (li == NULL)
+	return;
+    bad = get_tv_string(&li->li_tv);
+    li = li->li_next;
+    if (li == NULL)
+	return;
+    good = get_tv_string(&li->li_tv);
+    rettv->vval.v_number = test_edit_score(bad, good);
+#endif
 }
 
-#ifdef HAVE_STRFTIME
+#ifdef FEAT_FLOAT
 /*
- * "strftime({format}[, {time}])" function
+ * "tan()" function
  */
     static void
-f_strftime(argvars, rettv)
+f_tan(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	result_buf[256];
-    struct tm	*curtime;
-    time_t	seconds;
-    char_u	*p;
-
-    rettv->v_type = VAR_STRING;
+    float_T	f;
 
-    p = get_tv_string(&argvars[0]);
-    if (argvars[1].v_type == VAR_UNKNOWN)
-	seconds = time(NULL);
-    else
-	seconds = (time_t)get_tv_number(&argvars[1]);
-    curtime = localtime(&seconds);
-    /* MSVC returns NULL for an invalid value of seconds. */
-    if (curtime == NULL)
-	rettv->vval.v_string = vim_strsave((char_u *)_("(Invalid)"));
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	rettv->vval.v_float = tan(f);
     else
-    {
-# ifdef FEAT_MBYTE
-	vimconv_T   conv;
-	char_u	    *enc;
-
-	conv.vc_type = CONV_NONE;
-	enc = enc_locale();
-	convert_setup(&conv, p_enc, enc);
-	if (conv.vc_type != CONV_NONE)
-	    p = string_convert(&conv, p, NULL);
-# endif
-	if (p != NULL)
-	    (void)strftime((char *)result_buf, sizeof(result_buf),
-							  (char *)p, curtime);
-	else
-	    result_buf[0] = NUL;
+	rettv->vval.v_float = 0.0;
+}
 
-# ifdef FEAT_MBYTE
-	if (conv.vc_type != CONV_NONE)
-	    vim_free(p);
-	convert_setup(&conv, enc, p_enc);
-	if (conv.vc_type != CONV_NONE)
-	    rettv->vval.v_string = string_convert(&conv, result_buf, NULL);
-	else
-# endif
-	    rettv->vval.v_string = vim_strsave(result_buf);
+/*
+ * "tanh()" function
+ */
+    static void
+f_tanh(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    float_T	f;
 
-# ifdef FEAT_MBYTE
-	/* Release conversion descriptors */
-	convert_setup(&conv, NULL, NULL);
-	vim_free(enc);
-# endif
-    }
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	rettv->vval.v_float = tanh(f);
+    else
+	rettv->vval.v_float = 0.0;
 }
 #endif
 
 /*
- * "stridx()" function
+ * "tolower(string)" function
  */
     static void
-f_stridx(argvars, rettv)
+f_tolower(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	buf[NUMBUFLEN];
-    char_u	*needle;
-    char_u	*haystack;
-    char_u	*save_haystack;
-    char_u	*pos;
-    int		start_idx;
+    char_u	*p;
 
-    needle = get_tv_string_chk(&argvars[1]);
-    save_haystack = haystack = get_tv_string_buf_chk(&argvars[0], buf);
-    rettv->vval.v_number = -1;
-    if (needle == NULL || haystack == NULL)
-	return;		/* type error; errmsg already given */
+    p = vim_strsave(get_tv_string(&argvars[0]));
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = p;
 
-    if (argvars[2].v_type != VAR_UNKNOWN)
-    {
-	int	    error = FALSE;
+    if (p != NULL)
+	while (*p != NUL)
+	{
+#ifdef FEAT_MBYTE
+	    int		l;
 
-	start_idx = get_tv_number_chk(&argvars[2], &error);
-	if (error || start_idx >= (int)STRLEN(haystack))
-	    return;
-	if (start_idx >= 0)
-	    haystack += start_idx;
-    }
+	    if (enc_utf8)
+	    {
+		int c, lc;
 
-    pos	= (char_u *)strstr((char *)haystack, (char *)needle);
-    if (pos != NULL)
-	rettv->vval.v_number = (varnumber_T)(pos - save_haystack);
+		c = utf_ptr2char(p);
+		lc = utf_tolower(c);
+		l = utf_ptr2len(p);
+		/* TODO: reallocate string when byte count changes. */
+		if (utf_char2len(lc) == l)
+		    utf_char2bytes(lc, p);
+		p += l;
+	    }
+	    else if (has_mbyte && (l = (*mb_ptr2len)(p)) > 1)
+		p += l;		/* skip multi-byte character */
+	    else
+#endif
+	    {
+		*p = TOLOWER_LOC(*p); /* note that tolower() can be a macro */
+		++p;
+	    }
+	}
 }
 
 /*
- * "string()" function
+ * "toupper(string)" function
  */
     static void
-f_string(argvars, rettv)
+f_toupper(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	*tofree;
-    char_u	numbuf[NUMBUFLEN];
-
     rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = tv2string(&argvars[0], &tofree, numbuf, 0);
-    /* Make a copy if we have a value but it's not in allocated memory. */
-    if (rettv->vval.v_string != NULL && tofree == NULL)
-	rettv->vval.v_string = vim_strsave(rettv->vval.v_string);
+    rettv->vval.v_string = strup_save(get_tv_string(&argvars[0]));
 }
 
 /*
- * "strlen()" function
+ * "tr(string, fromstr, tostr)" function
  */
     static void
-f_strlen(argvars, rettv)
+f_tr(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->vval.v_number = (varnumber_T)(STRLEN(
-					      get_tv_string(&argvars[0])));
-}
+    char_u	*in_str;
+    char_u	*fromstr;
+    char_u	*tostr;
+    char_u	*p;
+#ifdef FEAT_MBYTE
+    int		inlen;
+    int		fromlen;
+    int		tolen;
+    int		idx;
+    char_u	*cpstr;
+    int		cplen;
+    int		first = TRUE;
+#endif
+    char_u	buf[NUMBUFLEN];
+    char_u	buf2[NUMBUFLEN];
+    garray_T	ga;
+
+    in_str = get_tv_string(&argvars[0]);
+    fromstr = get_tv_string_buf_chk(&argvars[1], buf);
+    tostr = get_tv_string_buf_chk(&argvars[2], buf2);
+
+    /* Default return value: empty string. */
+    rettv->v_type = VAR_STRING;
+    rettv->vval.v_string = NULL;
+    if (fromstr == NULL || tostr == NULL)
+	    return;		/* type error; errmsg already given */
+    ga_init2(&ga, (int)sizeof(char), 80);
 
-/*
- * "strchars()" function
- */
-    static void
-f_strchars(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    char_u		*s = get_tv_string(&argvars[0]);
 #ifdef FEAT_MBYTE
-    varnumber_T		len = 0;
+    if (!has_mbyte)
+#endif
+	/* not multi-byte: fromstr and tostr must be the same length */
+	if (STRLEN(fromstr) != STRLEN(tostr))
+	{
+#ifdef FEAT_MBYTE
+error:
+#endif
+	    EMSG2(_(e_invarg2), fromstr);
+	    ga_clear(&ga);
+	    return;
+	}
 
-    while (*s != NUL)
+    /* fromstr and tostr have to contain the same number of chars */
+    while (*in_str != NUL)
     {
-	mb_cptr2char_adv(&s);
-	++len;
-    }
-    rettv->vval.v_number = len;
-#else
-    rettv->vval.v_number = (varnumber_T)(STRLEN(s));
+#ifdef FEAT_MBYTE
+	if (has_mbyte)
+	{
+	    inlen = (*mb_ptr2len)(in_str);
+	    cpstr = in_str;
+	    cplen = inlen;
+	    idx = 0;
+	    for (p = fromstr; *p != NUL; p += fromlen)
+	    {
+		fromlen = (*mb_ptr2len)(p);
+		if (fromlen == inlen && STRNCMP(in_str, p, inlen) == 0)
+		{
+		    for (p = tostr; *p != NUL; p += tolen)
+		    {
+			tolen = (*mb_ptr2len)(p);
+			if (idx-- == 0)
+			{
+			    cplen = tolen;
+			    cpstr = p;
+			    break;
+			}
+		    }
+		    if (*p == NUL)	/* tostr is shorter than fromstr */
+			goto error;
+		    break;
+		}
+		++idx;
+	    }
+
+	    if (first && cpstr == in_str)
+	    {
+		/* Check that fromstr and tostr have the same number of
+		 * (multi-byte) characters.  Done only once when a character
+		 * of in_str doesn't appear in fromstr. */
+		first = FALSE;
+		for (p = tostr; *p != NUL; p += tolen)
+		{
+		    tolen = (*mb_ptr2len)(p);
+		    --idx;
+		}
+		if (idx != 0)
+		    goto error;
+	    }
+
+	    ga_grow(&ga, cplen);
+	    mch_memmove((char *)ga.ga_data + ga.ga_len, cpstr, (size_t)cplen);
+	    ga.ga_len += cplen;
+
+	    in_str += inlen;
+	}
+	else
 #endif
+	{
+	    /* When not using multi-byte chars we can do it faster. */
+	    p = vim_strchr(fromstr, *in_str);
+	    if (p != NULL)
+		ga_append(&ga, tostr[p - fromstr]);
+	    else
+		ga_append(&ga, *in_str);
+	    ++in_str;
+	}
+    }
+
+    /* add a terminating NUL */
+    ga_grow(&ga, 1);
+    ga_append(&ga, NUL);
+
+    rettv->vval.v_string = ga.ga_data;
 }
 
+#ifdef FEAT_FLOAT
 /*
- * "strdisplaywidth()" function
+ * "trunc({float})" function
  */
     static void
-f_strdisplaywidth(argvars, rettv)
+f_trunc(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	*s = get_tv_string(&argvars[0]);
-    int		col = 0;
-
-    if (argvars[1].v_type != VAR_UNKNOWN)
-	col = get_tv_number(&argvars[1]);
+    float_T	f;
 
-    rettv->vval.v_number = (varnumber_T)(linetabsize_col(col, s) - col);
+    rettv->v_type = VAR_FLOAT;
+    if (get_float_arg(argvars, &f) == OK)
+	/* trunc() is not in C90, use floor() or ceil() instead. */
+	rettv->vval.v_float = f > 0 ? floor(f) : ceil(f);
+    else
+	rettv->vval.v_float = 0.0;
 }
+#endif
 
 /*
- * "strwidth()" function
+ * "type(expr)" function
  */
     static void
-f_strwidth(argvars, rettv)
+f_type(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    char_u	*s = get_tv_string(&argvars[0]);
+    int n;
 
-    rettv->vval.v_number = (varnumber_T)(
-#ifdef FEAT_MBYTE
-	    mb_string2cells(s, -1)
-#else
-	    STRLEN(s)
+    switch (argvars[0].v_type)
+    {
+	case VAR_NUMBER: n = 0; break;
+	case VAR_STRING: n = 1; break;
+	case VAR_FUNC:   n = 2; break;
+	case VAR_LIST:   n = 3; break;
+	case VAR_DICT:   n = 4; break;
+#ifdef FEAT_FLOAT
+	case VAR_FLOAT:  n = 5; break;
 #endif
-	    );
+	default: EMSG2(_(e_intern2), "f_type()"); n = 0; break;
+    }
+    rettv->vval.v_number = n;
 }
 
 /*
- * "strpart()" function
+ * "undofile(name)" function
  */
     static void
-f_strpart(argvars, rettv)
-    typval_T	*argvars;
+f_undofile(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    char_u	*p;
-    int		n;
-    int		len;
-    int		slen;
-    int		error = FALSE;
-
-    p = get_tv_string(&argvars[0]);
-    slen = (int)STRLEN(p);
-
-    n = get_tv_number_chk(&argvars[1], &error);
-    if (error)
-	len = 0;
-    else if (argvars[2].v_type != VAR_UNKNOWN)
-	len = get_tv_number(&argvars[2]);
-    else
-	len = slen - n;	    /* default len: all bytes that are available. */
-
-    /*
-     * Only return the overlap between the specified part and the actual
-     * string.
-     */
-    if (n < 0)
+    rettv->v_type = VAR_STRING;
+#ifdef FEAT_PERSISTENT_UNDO
     {
-	len += n;
-	n = 0;
-    }
-    else if (n > slen)
-	n = slen;
-    if (len < 0)
-	len = 0;
-    else if (n + len > slen)
-	len = slen - n;
+	char_u *fname = get_tv_string(&argvars[0]);
+
+	if (*fname == NUL)
+	{
+	    /* If there is no file name there will be no undo file. */
+	    rettv->vval.v_string = NULL;
+	}
+	else
+	{
+	    char_u *ffname = FullName_save(fname, FALSE);
 
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = vim_strnsave(p + n, len);
+	    if (ffname != NULL)
+		rettv->vval.v_string = u_get_undo_file_name(ffname, FALSE);
+	    vim_free(ffname);
+	}
+    }
+#else
+    rettv->vval.v_string = NULL;
+#endif
 }
 
 /*
- * "strridx()" function
+ * "undotree()" function
  */
     static void
-f_strridx(argvars, rettv)
-    typval_T	*argvars;
+f_undotree(argvars, rettv)
+    typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    char_u	buf[NUMBUFLEN];
-    char_u	*needle;
-    char_u	*haystack;
-    char_u	*rest;
-    char_u	*lastmatch = NULL;
-    int		haystack_len, end_idx;
-
-    needle = get_tv_string_chk(&argvars[1]);
-    haystack = get_tv_string_buf_chk(&argvars[0], buf);
-
-    rettv->vval.v_number = -1;
-    if (needle == NULL || haystack == NULL)
-	return;		/* type error; errmsg already given */
-
-    haystack_len = (int)STRLEN(haystack);
-    if (argvars[2].v_type != VAR_UNKNOWN)
+    if (rettv_dict_alloc(rettv) == OK)
     {
-	/* Third argument: upper limit for index */
-	end_idx = get_tv_number_chk(&argvars[2], NULL);
-	if (end_idx < 0)
-	    return;	/* can never find a match */
-    }
-    else
-	end_idx = haystack_len;
+	dict_T *dict = rettv->vval.v_dict;
+	list_T *list;
 
-    if (*needle == NUL)
-    {
-	/* Empty string matches past the end. */
-	lastmatch = haystack + end_idx;
-    }
-    else
-    {
-	for (rest = haystack; *rest != '\0'; ++rest)
+	dict_add_nr_str(dict, "synced", (long)curbuf->b_u_synced, NULL);
+	dict_add_nr_str(dict, "seq_last", curbuf->b_u_seq_last, NULL);
+	dict_add_nr_str(dict, "save_last",
+					(long)curbuf->b_u_save_nr_last, NULL);
+	dict_add_nr_str(dict, "seq_cur", curbuf->b_u_seq_cur, NULL);
+	dict_add_nr_str(dict, "time_cur", (long)curbuf->b_u_time_cur, NULL);
+	dict_add_nr_str(dict, "save_cur", (long)curbuf->b_u_save_nr_cur, NULL);
+
+	list = list_alloc();
+	if (list != NULL)
 	{
-	    rest = (char_u *)strstr((char *)rest, (char *)needle);
-	    if (rest == NULL || rest > haystack + end_idx)
-		break;
-	    lastmatch = rest;
+	    u_eval_tree(curbuf->b_u_oldhead, list);
+	    dict_add_list(dict, "entries", list);
 	}
     }
-
-    if (lastmatch == NULL)
-	rettv->vval.v_number = -1;
-    else
-	rettv->vval.v_number = (varnumber_T)(lastmatch - haystack);
 }
 
 /*
- * "strtrans()" function
+ * "values(dict)" function
  */
     static void
-f_strtrans(argvars, rettv)
+f_values(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = transstr(get_tv_string(&argvars[0]));
+    dict_list(argvars, rettv, 1);
 }
 
 /*
- * "submatch()" function
+ * "virtcol(string)" function
  */
     static void
-f_submatch(argvars, rettv)
+f_virtcol(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
 {
-    int		error = FALSE;
-    int		no;
-    int		retList = 0;
-
-    no = (int)get_tv_number_chk(&argvars[0], &error);
-    if (error)
-	return;
-    error = FALSE;
-    if (argvars[1].v_type != VAR_UNKNOWN)
-	retList = get_tv_number_chk(&argvars[1], &error);
-    if (error)
-	return;
+    colnr_T	vcol = 0;
+    pos_T	*fp;
+    int		fnum = curbuf->b_fnum;
 
-    if (retList == 0)
-    {
-	rettv->v_type = VAR_STRING;
-	rettv->vval.v_string = reg_submatch(no);
-    }
-    else
+    fp = var2fpos(&argvars[0], FALSE, &fnum);
+    if (fp != NULL && fp->lnum <= curbuf->b_ml.ml_line_count
+						    && fnum == curbuf->b_fnum)
     {
-	rettv->v_type = VAR_LIST;
-	rettv->vval.v_list = reg_submatch_list(no);
+	getvvcol(curwin, fp, NULL, NULL, &vcol);
+	++vcol;
     }
+
+    rettv->vval.v_number = vcol;
 }
 
 /*
- * "substitute()" function
+ * "visualmode()" function
  */
     static void
-f_substitute(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+f_visualmode(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv UNUSED;
 {
-    char_u	patbuf[NUMBUFLEN];
-    char_u	subbuf[NUMBUFLEN];
-    char_u	flagsbuf[NUMBUFLEN];
-
-    char_u	*str = get_tv_string_chk(&argvars[0]);
-    char_u	*pat = get_tv_string_buf_chk(&argvars[1], patbuf);
-    char_u	*sub = get_tv_string_buf_chk(&argvars[2], subbuf);
-    char_u	*flg = get_tv_string_buf_chk(&argvars[3], flagsbuf);
+    char_u	str[2];
 
     rettv->v_type = VAR_STRING;
-    if (str == NULL || pat == NULL || sub == NULL || flg == NULL)
-	rettv->vval.v_string = NULL;
-    else
-	rettv->vval.v_string = do_string_sub(str, pat, sub, flg);
+    str[0] = curbuf->b_visual_mode_eval;
+    str[1] = NUL;
+    rettv->vval.v_string = vim_strsave(str);
+
+    /* A non-zero number or non-empty string argument: reset mode. */
+    if (non_zero_arg(&argvars[0]))
+	curbuf->b_visual_mode_eval = NUL;
 }
 
 /*
- * "synID(lnum, col, trans)" function
+ * "wildmenumode()" function
  */
     static void
-f_synID(argvars, rettv)
+f_wildmenumode(argvars, rettv)
     typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+    typval_T	*rettv UNUSED;
 {
-    int		id = 0;
-#ifdef FEAT_SYN_HL
-    long	lnum;
-    long	col;
-    int		trans;
-    int		transerr = FALSE;
-
-    lnum = get_tv_lnum(argvars);		/* -1 on type error */
-    col = get_tv_number(&argvars[1]) - 1;	/* -1 on type error */
-    trans = get_tv_number_chk(&argvars[2], &transerr);
-
-    if (!transerr && lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count
-	    && col >= 0 && col < (long)STRLEN(ml_get(lnum)))
-	id = syn_get_id(curwin, lnum, (colnr_T)col, trans, NULL, FALSE);
+#ifdef FEAT_WILDMENU
+    if (wild_menu_showing)
+	rettv->vval.v_number = 1;
 #endif
-
-    rettv->vval.v_number = id;
 }
 
 /*
- * "synIDattr(id, what [, mode])" function
+ * "winbufnr(nr)" function
  */
     static void
-f_synIDattr(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
-{
-    char_u	*p = NULL;
-#ifdef FEAT_SYN_HL
-    int		id;
-    char_u	*what;
-    char_u	*mode;
-    char_u	modebuf[NUMBUFLEN];
-    int		modec;
-
-    id = get_tv_number(&argvars[0]);
-    what = get_tv_string(&argvars[1]);
-    if (argvars[2].v_type != VAR_UNKNOWN)
-    {
-	mode = get_tv_string_buf(&argvars[2], modebuf);
-	modec = TOLOWER_ASC(mode[0]);
-	if (modec != 't' && modec != 'c' && modec != 'g')
-	    modec = 0;	/* replace invalid with current */
-    }
-    else
-    {
-#ifdef FEAT_GUI
-	if (gui.in_use)
-	    modec = 'g';
-	else
-#endif
-	    if (t_colors > 1)
-	    modec = 'c';
-	else
-	    modec = 't';
-    }
-
-
-    switch (TOLOWER_ASC(what[0]))
-    {
-	case 'b':
-		if (TOLOWER_ASC(what[1]) == 'g')	/* bg[#] */
-		    p = highlight_color(id, what, modec);
-		else					/* bold */
-		    p = highlight_has_attr(id, HL_BOLD, modec);
-		break;
-
-	case 'f':					/* fg[#] or font */
-		p = highlight_color(id, what, modec);
-		break;
-
-	case 'i':
-		if (TOLOWER_ASC(what[1]) == 'n')	/* inverse */
-		    p = highlight_has_attr(id, HL_INVERSE, modec);
-		else					/* italic */
-		    p = highlight_has_attr(id, HL_ITALIC, modec);
-		break;
-
-	case 'n':					/* name */
-		p = get_highlight_name(NULL, id - 1);
-		break;
-
-	case 'r':					/* reverse */
-		p = highlight_has_attr(id, HL_INVERSE, modec);
-		break;
-
-	case 's':
-		if (TOLOWER_ASC(what[1]) == 'p')	/* sp[#] */
-		    p = highlight_color(id, what, modec);
-		else					/* standout */
-		    p = highlight_has_attr(id, HL_STANDOUT, modec);
-		break;
-
-	case 'u':
-		if (STRLEN(what) <= 5 || TOLOWER_ASC(what[5]) != 'c')
-							/* underline */
-		    p = highlight_has_attr(id, HL_UNDERLINE, modec);
-		else
-							/* undercurl */
-		    p = highlight_has_attr(id, HL_UNDERCURL, modec);
-		break;
-    }
-
-    if (p != NULL)
-	p = vim_strsave(p);
-#endif
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = p;
+f_winbufnr(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    win_T	*wp;
+
+    wp = find_win_by_nr(&argvars[0], NULL);
+    if (wp == NULL)
+	rettv->vval.v_number = -1;
+    else
+	rettv->vval.v_number = wp->w_buffer->b_fnum;
 }
 
 /*
- * "synIDtrans(id)" function
+ * "wincol()" function
  */
     static void
-f_synIDtrans(argvars, rettv)
+f_wincol(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-    int		id;
+    validate_cursor();
+    rettv->vval.v_number = curwin->w_wcol + 1;
+}
 
-#ifdef FEAT_SYN_HL
-    id = get_tv_number(&argvars[0]);
+/*
+ * "winheight(nr)" function
+ */
+    static void
+f_winheight(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    win_T	*wp;
 
-    if (id > 0)
-	id = syn_get_final_id(id);
+    wp = find_win_by_nr(&argvars[0], NULL);
+    if (wp == NULL)
+	rettv->vval.v_number = -1;
     else
-#endif
-	id = 0;
+	rettv->vval.v_number = wp->w_height;
+}
 
-    rettv->vval.v_number = id;
+/*
+ * "winline()" function
+ */
+    static void
+f_winline(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    validate_cursor();
+    rettv->vval.v_number = curwin->w_wrow + 1;
 }
 
 /*
- * "synconcealed(lnum, col)" function
+ * "winnr()" function
  */
     static void
-f_synconcealed(argvars, rettv)
+f_winnr(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-#if defined(FEAT_SYN_HL) && defined(FEAT_CONCEAL)
-    long	lnum;
-    long	col;
-    int		syntax_flags = 0;
-    int		cchar;
-    int		matchid = 0;
-    char_u	str[NUMBUFLEN];
+    int		nr = 1;
+
+#ifdef FEAT_WINDOWS
+    nr = get_winnr(curtab, &argvars[0]);
 #endif
+    rettv->vval.v_number = nr;
+}
 
-    rettv->v_type = VAR_LIST;
-    rettv->vval.v_list = NULL;
+/*
+ * "winrestcmd()" function
+ */
+    static void
+f_winrestcmd(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+#ifdef FEAT_WINDOWS
+    win_T	*wp;
+    int		winnr = 1;
+    garray_T	ga;
+    char_u	buf[50];
 
-#if defined(FEAT_SYN_HL) && defined(FEAT_CONCEAL)
-    lnum = get_tv_lnum(argvars);		/* -1 on type error */
-    col = get_tv_number(&argvars[1]) - 1;	/* -1 on type error */
+    ga_init2(&ga, (int)sizeof(char), 70);
+    for (wp = firstwin; wp != NULL; wp = wp->w_next)
+    {
+	sprintf((char *)buf, "%dresize %d|", winnr, wp->w_height);
+	ga_concat(&ga, buf);
+# ifdef FEAT_VERTSPLIT
+	sprintf((char *)buf, "vert %dresize %d|", winnr, wp->w_width);
+	ga_concat(&ga, buf);
+# endif
+	++winnr;
+    }
+    ga_append(&ga, NUL);
 
-    vim_memset(str, NUL, sizeof(str));
+    rettv->vval.v_string = ga.ga_data;
+#else
+    rettv->vval.v_string = NULL;
+#endif
+    rettv->v_type = VAR_STRING;
+}
 
-    if (rettv_list_alloc(rettv) != FAIL)
+/*
+ * "winrestview()" function
+ */
+    static void
+f_winrestview(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv UNUSED;
+{
+    dict_T	*dict;
+
+    if (argvars[0].v_type != VAR_DICT
+	    || (dict = argvars[0].vval.v_dict) == NULL)
+	EMSG(_(e_invarg));
+    else
     {
-	if (lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count
-	    && col >= 0 && col <= (long)STRLEN(ml_get(lnum))
-	    && curwin->w_p_cole > 0)
-	{
-	    (void)syn_get_id(curwin, lnum, col, FALSE, NULL, FALSE);
-	    syntax_flags = get_syntax_info(&matchid);
+	curwin->w_cursor.lnum = get_dict_number(dict, (char_u *)"lnum");
+	curwin->w_cursor.col = get_dict_number(dict, (char_u *)"col");
+#ifdef FEAT_VIRTUALEDIT
+	curwin->w_cursor.coladd = get_dict_number(dict, (char_u *)"coladd");
+#endif
+	curwin->w_curswant = get_dict_number(dict, (char_u *)"curswant");
+	curwin->w_set_curswant = FALSE;
 
-	    /* get the conceal character */
-	    if ((syntax_flags & HL_CONCEAL) && curwin->w_p_cole < 3)
-	    {
-		cchar = syn_get_sub_char();
-		if (cchar == NUL && curwin->w_p_cole == 1 && lcs_conceal != NUL)
-		    cchar = lcs_conceal;
-		if (cchar != NUL)
-		{
-# ifdef FEAT_MBYTE
-		    if (has_mbyte)
-			(*mb_char2bytes)(cchar, str);
-		    else
+	set_topline(curwin, get_dict_number(dict, (char_u *)"topline"));
+#ifdef FEAT_DIFF
+	curwin->w_topfill = get_dict_number(dict, (char_u *)"topfill");
+#endif
+	curwin->w_leftcol = get_dict_number(dict, (char_u *)"leftcol");
+	curwin->w_skipcol = get_dict_number(dict, (char_u *)"skipcol");
+
+	check_cursor();
+	win_new_height(curwin, curwin->w_height);
+# ifdef FEAT_VERTSPLIT
+	win_new_width(curwin, W_WIDTH(curwin));
 # endif
-			str[0] = cchar;
-		}
-	    }
-	}
+	changed_window_setting();
 
-	list_append_number(rettv->vval.v_list,
-					    (syntax_flags & HL_CONCEAL) != 0);
-	/* -1 to auto-determine strlen */
-	list_append_string(rettv->vval.v_list, str, -1);
-	list_append_number(rettv->vval.v_list, matchid);
-    }
+	if (curwin->w_topline == 0)
+	    curwin->w_topline = 1;
+	if (curwin->w_topline > curbuf->b_ml.ml_line_count)
+	    curwin->w_topline = curbuf->b_ml.ml_line_count;
+#ifdef FEAT_DIFF
+	check_topfill(curwin, TRUE);
 #endif
+    }
 }
 
 /*
- * "synstack(lnum, col)" function
+ * "winsaveview()" function
  */
     static void
-f_synstack(argvars, rettv)
+f_winsaveview(argvars, rettv)
     typval_T	*argvars UNUSED;
     typval_T	*rettv;
 {
-#ifdef FEAT_SYN_HL
-    long	lnum;
-    long	col;
-    int		i;
-    int		id;
+    dict_T	*dict;
+
+    if (rettv_dict_alloc(rettv) == FAIL)
+	return;
+    dict = rettv->vval.v_dict;
+
+    dict_add_nr_str(dict, "lnum", (long)curwin->w_cursor.lnum, NULL);
+    dict_add_nr_str(dict, "col", (long)curwin->w_cursor.col, NULL);
+#ifdef FEAT_VIRTUALEDIT
+    dict_add_nr_str(dict, "coladd", (long)curwin->w_cursor.coladd, NULL);
+#endif
+    update_curswant();
+    dict_add_nr_str(dict, "curswant", (long)curwin->w_curswant, NULL);
+
+    dict_add_nr_str(dict, "topline", (long)curwin->w_topline, NULL);
+#ifdef FEAT_DIFF
+    dict_add_nr_str(dict, "topfill", (long)curwin->w_topfill, NULL);
 #endif
+    dict_add_nr_str(dict, "leftcol", (long)curwin->w_leftcol, NULL);
+    dict_add_nr_str(dict, "skipcol", (long)curwin->w_skipcol, NULL);
+}
 
-    rettv->v_type = VAR_LIST;
-    rettv->vval.v_list = NULL;
+/*
+ * "winwidth(nr)" function
+ */
+    static void
+f_winwidth(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    win_T	*wp;
 
-#ifdef FEAT_SYN_HL
-    lnum = get_tv_lnum(argvars);		/* -1 on type error */
-    col = get_tv_number(&argvars[1]) - 1;	/* -1 on type error */
+    wp = find_win_by_nr(&argvars[0], NULL);
+    if (wp == NULL)
+	rettv->vval.v_number = -1;
+    else
+#ifdef FEAT_VERTSPLIT
+	rettv->vval.v_number = wp->w_width;
+#else
+	rettv->vval.v_number = Columns;
+#endif
+}
 
-    if (lnum >= 1 && lnum <= curbuf->b_ml.ml_line_count
-	    && col >= 0 && col <= (long)STRLEN(ml_get(lnum))
-	    && rettv_list_alloc(rettv) != FAIL)
+/*
+ * Write list of strings to file
+ */
+    static int
+write_list(fd, list, binary)
+    FILE	*fd;
+    list_T	*list;
+    int		binary;
+{
+    listitem_T	*li;
+    int		c;
+    int		ret = OK;
+    char_u	*s;
+
+    for (li = list->lv_first; li != NULL; li = li->li_next)
     {
-	(void)syn_get_id(curwin, lnum, (colnr_T)col, FALSE, NULL, TRUE);
-	for (i = 0; ; ++i)
+	for (s = get_tv_string(&li->li_tv); *s != NUL; ++s)
 	{
-	    id = syn_get_stack_item(i);
-	    if (id < 0)
+	    if (*s == '\n')
+		c = putc(NUL, fd);
+	    else
+		c = putc(*s, fd);
+	    if (c == EOF)
+	    {
+		ret = FAIL;
 		break;
-	    if (list_append_number(rettv->vval.v_list, id) == FAIL)
+	    }
+	}
+	if (!binary || li->li_next != NULL)
+	    if (putc('\n', fd) == EOF)
+	    {
+		ret = FAIL;
 		break;
+	    }
+	if (ret == FAIL)
+	{
+	    EMSG(_(e_write));
+	    break;
 	}
     }
-#endif
+    return ret;
 }
 
+/*
+ * "writefile()" function
+ */
     static void
-get_cmd_output_as_rettv(argvars, rettv, retlist)
+f_writefile(argvars, rettv)
     typval_T	*argvars;
     typval_T	*rettv;
-    int		retlist;
 {
-    char_u	*res = NULL;
-    char_u	*p;
-    char_u	*infile = NULL;
-    char_u	buf[NUMBUFLEN];
-    int		err = FALSE;
+    int		binary = FALSE;
+    char_u	*fname;
     FILE	*fd;
-    list_T	*list = NULL;
+    int		ret = 0;
 
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
     if (check_restricted() || check_secure())
-	goto errret;
+	return;
 
-    if (argvars[1].v_type != VAR_UNKNOWN)
+    if (argvars[0].v_type != VAR_LIST)
     {
-	/*
-	 * Write the string to a temp file, to be used for input of the shell
-	 * command.
-	 */
-	if ((infile = vim_tempname('i')) == NULL)
-	{
-	    EMSG(_(e_notmp));
-	    goto errret;
-	}
+	EMSG2(_(e_listarg), "writefile()");
+	return;
+    }
+    if (argvars[0].vval.v_list == NULL)
+	return;
 
-	fd = mch_fopen((char *)infile, WRITEBIN);
-	if (fd == NULL)
-	{
-	    EMSG2(_(e_notopen), infile);
-	    goto errret;
-	}
-	if (argvars[1].v_type == VAR_LIST)
-	{
-	    if (write_list(fd, argvars[1].vval.v_list, TRUE) == FAIL)
-		err = TRUE;
-	}
-	else
-	{
-	    p = get_tv_string_buf_chk(&argvars[1], buf);
-	    if (p == NULL)
-	    {
-		fclose(fd);
-		goto errret;		/* type error; errmsg already given */
-	    }
-	    if (fwrite(p, STRLEN(p), 1, fd) != 1)
-		err = TRUE;
-	}
-	if (fclose(fd) != 0)
-	    err = TRUE;
-	if (err)
-	{
-	    EMSG(_("E677: Error writing temp file"));
-	    goto errret;
-	}
+    if (argvars[2].v_type != VAR_UNKNOWN
+			      && STRCMP(get_tv_string(&argvars[2]), "b") == 0)
+	binary = TRUE;
+
+    /* Always open the file in binary mode, library functions have a mind of
+     * their own about CR-LF conversion. */
+    fname = get_tv_string(&argvars[1]);
+    if (*fname == NUL || (fd = mch_fopen((char *)fname, WRITEBIN)) == NULL)
+    {
+	EMSG2(_(e_notcreate), *fname == NUL ? (char_u *)_("<empty>") : fname);
+	ret = -1;
+    }
+    else
+    {
+	if (write_list(fd, argvars[0].vval.v_list, binary) == FAIL)
+	    ret = -1;
+	fclose(fd);
     }
 
-    if (retlist)
+    rettv->vval.v_number = ret;
+}
+
+/*
+ * "xor(expr, expr)" function
+ */
+    static void
+f_xor(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+    rettv->vval.v_number = get_tv_number_chk(&argvars[0], NULL)
+					^ get_tv_number_chk(&argvars[1], NULL);
+}
+
+
+/*
+ * Translate a String variable into a position.
+ * Returns NULL when there is an error.
+ */
+    static pos_T *
+var2fpos(varp, dollar_lnum, fnum)
+    typval_T	*varp;
+    int		dollar_lnum;	/* TRUE when $ is last line */
+    int		*fnum;		/* set to fnum for '0, 'A, etc. */
+{
+    char_u		*name;
+    static pos_T	pos;
+    pos_T		*pp;
+
+    /* Argument can be [lnum, col, coladd]. */
+    if (varp->v_type == VAR_LIST)
     {
+	list_T		*l;
 	int		len;
+	int		error = FALSE;
 	listitem_T	*li;
-	char_u		*s = NULL;
-	char_u		*start;
-	char_u		*end;
-	int		i;
 
-	res = get_cmd_output(get_tv_string(&argvars[0]), infile,
-					   SHELL_SILENT | SHELL_COOKED, &len);
-	if (res == NULL)
-	    goto errret;
+	l = varp->vval.v_list;
+	if (l == NULL)
+	    return NULL;
 
-	list = list_alloc();
-	if (list == NULL)
-	    goto errret;
+	/* Get the line number */
+	pos.lnum = list_find_nr(l, 0L, &error);
+	if (error || pos.lnum <= 0 || pos.lnum > curbuf->b_ml.ml_line_count)
+	    return NULL;	/* invalid line number */
 
-	for (i = 0; i < len; ++i)
-	{
-	    start = res + i;
-	    while (i < len && res[i] != NL)
-		++i;
-	    end = res + i;
+	/* Get the column number */
+	pos.col = list_find_nr(l, 1L, &error);
+	if (error)
+	    return NULL;
+	len = (long)STRLEN(ml_get(pos.lnum));
 
-	    s = alloc((unsigned)(end - start + 1));
-	    if (s == NULL)
-		goto errret;
+	/* We accept "$" for the column number: last column. */
+	li = list_find(l, 1L);
+	if (li != NULL && li->li_tv.v_type == VAR_STRING
+		&& li->li_tv.vval.v_string != NULL
+		&& STRCMP(li->li_tv.vval.v_string, "$") == 0)
+	    pos.col = len + 1;
 
-	    for (p = s; start < end; ++p, ++start)
-		*p = *start == NUL ? NL : *start;
-	    *p = NUL;
+	/* Accept a position up to the NUL after the line. */
+	if (pos.col == 0 || (int)pos.col > len + 1)
+	    return NULL;	/* invalid column number */
+	--pos.col;
 
-	    li = listitem_alloc();
-	    if (li == NULL)
-	    {
-		vim_free(s);
-		goto errret;
-	    }
-	    li->li_tv.v_type = VAR_STRING;
-	    li->li_tv.vval.v_string = s;
-	    list_append(list, li);
-	}
+#ifdef FEAT_VIRTUALEDIT
+	/* Get the virtual offset.  Defaults to zero. */
+	pos.coladd = list_find_nr(l, 2L, &error);
+	if (error)
+	    pos.coladd = 0;
+#endif
 
-	++list->lv_refcount;
-	rettv->v_type = VAR_LIST;
-	rettv->vval.v_list = list;
-	list = NULL;
+	return &pos;
     }
-    else
+
+    name = get_tv_string_chk(varp);
+    if (name == NULL)
+	return NULL;
+    if (name[0] == '.')				/* cursor */
+	return &curwin->w_cursor;
+    if (name[0] == 'v' && name[1] == NUL)	/* Visual start */
     {
-	res = get_cmd_output(get_tv_string(&argvars[0]), infile,
-					   SHELL_SILENT | SHELL_COOKED, NULL);
-#ifdef USE_CR
-	/* translate <CR> into <NL> */
-	if (res != NULL)
-	{
-	    char_u	*s;
+	if (VIsual_active)
+	    return &VIsual;
+	return &curwin->w_cursor;
+    }
+    if (name[0] == '\'')			/* mark */
+    {
+	pp = getmark_buf_fnum(curbuf, name[1], FALSE, fnum);
+	if (pp == NULL || pp == (pos_T *)-1 || pp->lnum <= 0)
+	    return NULL;
+	return pp;
+    }
 
-	    for (s = res; *s; ++s)
-	    {
-		if (*s == CAR)
-		    *s = NL;
-	    }
+#ifdef FEAT_VIRTUALEDIT
+    pos.coladd = 0;
+#endif
+
+    if (name[0] == 'w' && dollar_lnum)
+    {
+	pos.col = 0;
+	if (name[1] == '0')		/* "w0": first visible line */
+	{
+	    update_topline();
+	    pos.lnum = curwin->w_topline;
+	    return &pos;
 	}
-#else
-# ifdef USE_CRNL
-	/* translate <CR><NL> into <NL> */
-	if (res != NULL)
+	else if (name[1] == '$')	/* "w$": last visible line */
+	{
+	    validate_botline();
+	    pos.lnum = curwin->w_botline - 1;
+	    return &pos;
+	}
+    }
+    else if (name[0] == '$')		/* last column or line */
+    {
+	if (dollar_lnum)
+	{
+	    pos.lnum = curbuf->b_ml.ml_line_count;
+	    pos.col = 0;
+	}
+	else
 	{
-	    char_u	*s, *d;
-
-	    d = res;
-	    for (s = res; *s; ++s)
-	    {
-		if (s[0] == CAR && s[1] == NL)
-		    ++s;
-		*d++ = *s;
-	    }
-	    *d = NUL;
+	    pos.lnum = curwin->w_cursor.lnum;
+	    pos.col = (colnr_T)STRLEN(ml_get_curline());
 	}
-# endif
-#endif
-	rettv->vval.v_string = res;
-	res = NULL;
+	return &pos;
     }
+    return NULL;
+}
 
-errret:
-    if (infile != NULL)
+/*
+ * Convert list in "arg" into a position and optional file number.
+ * When "fnump" is NULL there is no file number, only 3 items.
+ * Note that the column is passed on as-is, the caller may want to decrement
+ * it to use 1 for the first column.
+ * Return FAIL when conversion is not possible, doesn't check the position for
+ * validity.
+ */
+    static int
+list2fpos(arg, posp, fnump)
+    typval_T	*arg;
+    pos_T	*posp;
+    int		*fnump;
+{
+    list_T	*l = arg->vval.v_list;
+    long	i = 0;
+    long	n;
+
+    /* List must be: [fnum, lnum, col, coladd], where "fnum" is only there
+     * when "fnump" isn't NULL and "coladd" is optional. */
+    if (arg->v_type != VAR_LIST
+	    || l == NULL
+	    || l->lv_len < (fnump == NULL ? 2 : 3)
+	    || l->lv_len > (fnump == NULL ? 3 : 4))
+	return FAIL;
+
+    if (fnump != NULL)
     {
-	mch_remove(infile);
-	vim_free(infile);
+	n = list_find_nr(l, i++, NULL);	/* fnum */
+	if (n < 0)
+	    return FAIL;
+	if (n == 0)
+	    n = curbuf->b_fnum;		/* current buffer */
+	*fnump = n;
     }
-    if (res != NULL)
-	vim_free(res);
-    if (list != NULL)
-	list_free(list, TRUE);
+
+    n = list_find_nr(l, i++, NULL);	/* lnum */
+    if (n < 0)
+	return FAIL;
+    posp->lnum = n;
+
+    n = list_find_nr(l, i++, NULL);	/* col */
+    if (n < 0)
+	return FAIL;
+    posp->col = n;
+
+#ifdef FEAT_VIRTUALEDIT
+    n = list_find_nr(l, i, NULL);
+    if (n < 0)
+	posp->coladd = 0;
+    else
+	posp->coladd = n;
+#endif
+
+    return OK;
 }
 
 /*
- * "system()" function
+ * Get the length of an environment variable name.
+ * Advance "arg" to the first character after the name.
+ * Return 0 for error.
  */
-    static void
-f_system(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static int
+get_env_len(arg)
+    char_u	**arg;
 {
-    get_cmd_output_as_rettv(argvars, rettv, FALSE);
+    char_u	*p;
+    int		len;
+
+    for (p = *arg; vim_isIDc(*p); ++p)
+	;
+    if (p == *arg)	    /* no name found */
+	return 0;
+
+    len = (int)(p - *arg);
+    *arg = p;
+    return len;
 }
 
 /*
- * "systemlist()" function
+ * Get the length of the name of a function or internal variable.
+ * "arg" is advanced to the first non-white character after the name.
+ * Return 0 if something is wrong.
  */
-    static void
-f_systemlist(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static int
+get_id_len(arg)
+    char_u	**arg;
 {
-    get_cmd_output_as_rettv(argvars, rettv, TRUE);
+    char_u	*p;
+    int		len;
+
+    /* Find the end of the name. */
+    for (p = *arg; eval_isnamec(*p); ++p)
+	;
+    if (p == *arg)	    /* no name found */
+	return 0;
+
+    len = (int)(p - *arg);
+    *arg = skipwhite(p);
+
+    return len;
 }
 
 /*
- * "tabpagebuflist()" function
+ * Get the length of the name of a variable or function.
+ * Only the name is recognized, does not handle ".key" or "[idx]".
+ * "arg" is advanced to the first non-white character after the name.
+ * Return -1 if curly braces expansion failed.
+ * Return 0 if something else is wrong.
+ * If the name contains 'magic' {}'s, expand them and return the
+ * expanded name in an allocated string via 'alias' - caller must free.
  */
-    static void
-f_tabpagebuflist(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
+    static int
+get_name_len(arg, alias, evaluate, verbose)
+    char_u	**arg;
+    char_u	**alias;
+    int		evaluate;
+    int		verbose;
 {
-#ifdef FEAT_WINDOWS
-    tabpage_T	*tp;
-    win_T	*wp = NULL;
+    int		len;
+    char_u	*p;
+    char_u	*expr_start;
+    char_u	*expr_end;
 
-    if (argvars[0].v_type == VAR_UNKNOWN)
-	wp = firstwin;
-    else
+    *alias = NULL;  /* default to no alias */
+
+    if ((*arg)[0] == K_SPECIAL && (*arg)[1] == KS_EXTRA
+						  && (*arg)[2] == (int)KE_SNR)
     {
-	tp = find_tabpage((int)get_tv_number(&argvars[0]));
-	if (tp != NULL)
-	    wp = (tp == curtab) ? firstwin : tp->tp_firstwin;
+	/* hard coded <SNR>, already translated */
+	*arg += 3;
+	return get_id_len(arg) + 3;
     }
-    if (wp != NULL && rettv_list_alloc(rettv) != FAIL)
+    len = eval_fname_script(*arg);
+    if (len > 0)
     {
-	for (; wp != NULL; wp = wp->w_next)
-	    if (list_append_number(rettv->vval.v_list,
-						wp->w_buffer->b_fnum) == FAIL)
-		break;
+	/* literal "<SID>", "s:" or "<SNR>" */
+	*arg += len;
     }
-#endif
-}
-
-
-/*
- * "tabpagenr()" function
- */
-    static void
-f_tabpagenr(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
-{
-    int		nr = 1;
-#ifdef FEAT_WINDOWS
-    char_u	*arg;
 
-    if (argvars[0].v_type != VAR_UNKNOWN)
+    /*
+     * Find the end of the name; check for {} construction.
+     */
+    p = find_name_end(*arg, &expr_start, &expr_end,
+					       len > 0 ? 0 : FNE_CHECK_START);
+    if (expr_start != NULL)
     {
-	arg = get_tv_string_chk(&argvars[0]);
-	nr = 0;
-	if (arg != NULL)
+	char_u	*temp_string;
+
+	if (!evaluate)
 	{
-	    if (STRCMP(arg, "$") == 0)
-		nr = tabpage_index(NULL) - 1;
-	    else
-		EMSG2(_(e_invexpr2), arg);
+	    len += (int)(p - *arg);
+	    *arg = skipwhite(p);
+	    return len;
 	}
+
+	/*
+	 * Include any <SID> etc in the expanded string:
+	 * Thus the -len here.
+	 */
+	temp_string = make_expanded_name(*arg - len, expr_start, expr_end, p);
+	if (temp_string == NULL)
+	    return -1;
+	*alias = temp_string;
+	*arg = skipwhite(p);
+	return (int)STRLEN(temp_string);
     }
-    else
-	nr = tabpage_index(curtab);
-#endif
-    rettv->vval.v_number = nr;
-}
 
+    len += get_id_len(arg);
+    if (len == 0 && verbose)
+	EMSG2(_(e_invexpr2), *arg);
 
-#ifdef FEAT_WINDOWS
-static int get_winnr __ARGS((tabpage_T *tp, typval_T *argvar));
+    return len;
+}
 
 /*
- * Common code for tabpagewinnr() and winnr().
+ * Find the end of a variable or function name, taking care of magic braces.
+ * If "expr_start" is not NULL then "expr_start" and "expr_end" are set to the
+ * start and end of the first magic braces item.
+ * "flags" can have FNE_INCL_BR and FNE_CHECK_START.
+ * Return a pointer to just after the name.  Equal to "arg" if there is no
+ * valid name.
  */
-    static int
-get_winnr(tp, argvar)
-    tabpage_T	*tp;
-    typval_T	*argvar;
-{
-    win_T	*twin;
-    int		nr = 1;
-    win_T	*wp;
+    static char_u *
+find_name_end(arg, expr_start, expr_end, flags)
     char_u	*arg;
+    char_u	**expr_start;
+    char_u	**expr_end;
+    int		flags;
+{
+    int		mb_nest = 0;
+    int		br_nest = 0;
+    char_u	*p;
 
-    twin = (tp == curtab) ? curwin : tp->tp_curwin;
-    if (argvar->v_type != VAR_UNKNOWN)
+    if (expr_start != NULL)
     {
-	arg = get_tv_string_chk(argvar);
-	if (arg == NULL)
-	    nr = 0;		/* type error; errmsg already given */
-	else if (STRCMP(arg, "$") == 0)
-	    twin = (tp == curtab) ? lastwin : tp->tp_lastwin;
-	else if (STRCMP(arg, "#") == 0)
+	*expr_start = NULL;
+	*expr_end = NULL;
+    }
+
+    /* Quick check for valid starting character. */
+    if ((flags & FNE_CHECK_START) && !eval_isnamec1(*arg) && *arg != '{')
+	return arg;
+
+    for (p = arg; *p != NUL
+		    && (eval_isnamec(*p)
+			|| *p == '{'
+			|| ((flags & FNE_INCL_BR) && (*p == '[' || *p == '.'))
+			|| mb_nest != 0
+			|| br_nest != 0); mb_ptr_adv(p))
+    {
+	if (*p == '\'')
 	{
-	    twin = (tp == curtab) ? prevwin : tp->tp_prevwin;
-	    if (twin == NULL)
-		nr = 0;
+	    /* skip over 'string' to avoid counting [ and ] inside it. */
+	    for (p = p + 1; *p != NUL && *p != '\''; mb_ptr_adv(p))
+		;
+	    if (*p == NUL)
+		break;
 	}
-	else
+	else if (*p == '"')
 	{
-	    EMSG2(_(e_invexpr2), arg);
-	    nr = 0;
+	    /* skip over "str\"ing" to avoid counting [ and ] inside it. */
+	    for (p = p + 1; *p != NUL && *p != '"'; mb_ptr_adv(p))
+		if (*p == '\\' && p[1] != NUL)
+		    ++p;
+	    if (*p == NUL)
+		break;
 	}
-    }
 
-    if (nr > 0)
-	for (wp = (tp == curtab) ? firstwin : tp->tp_firstwin;
-					      wp != twin; wp = wp->w_next)
+	if (mb_nest == 0)
 	{
-	    if (wp == NULL)
+	    if (*p == '[')
+		++br_nest;
+	    else if (*p == ']')
+		--br_nest;
+	}
+
+	if (br_nest == 0)
+	{
+	    if (*p == '{')
 	    {
-		/* didn't find it in this tabpage */
-		nr = 0;
-		break;
+		mb_nest++;
+		if (expr_start != NULL && *expr_start == NULL)
+		    *expr_start = p;
+	    }
+	    else if (*p == '}')
+	    {
+		mb_nest--;
+		if (expr_start != NULL && mb_nest == 0 && *expr_end == NULL)
+		    *expr_end = p;
 	    }
-	    ++nr;
 	}
-    return nr;
-}
-#endif
-
-/*
- * "tabpagewinnr()" function
- */
-    static void
-f_tabpagewinnr(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
-{
-    int		nr = 1;
-#ifdef FEAT_WINDOWS
-    tabpage_T	*tp;
+    }
 
-    tp = find_tabpage((int)get_tv_number(&argvars[0]));
-    if (tp == NULL)
-	nr = 0;
-    else
-	nr = get_winnr(tp, &argvars[1]);
-#endif
-    rettv->vval.v_number = nr;
+    return p;
 }
 
-
 /*
- * "tagfiles()" function
+ * Expands out the 'magic' {}'s in a variable/function name.
+ * Note that this can call itself recursively, to deal with
+ * constructs like foo{bar}{baz}{bam}
+ * The four pointer arguments point to "foo{expre}ss{ion}bar"
+ *			"in_start"      ^
+ *			"expr_start"	   ^
+ *			"expr_end"		 ^
+ *			"in_end"			    ^
+ *
+ * Returns a new allocated string, which the caller must free.
+ * Returns NULL for failure.
  */
-    static void
-f_tagfiles(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+    static char_u *
+make_expanded_name(in_start, expr_start, expr_end, in_end)
+    char_u	*in_start;
+    char_u	*expr_start;
+    char_u	*expr_end;
+    char_u	*in_end;
 {
-    char_u	*fname;
-    tagname_T	tn;
-    int		first;
-
-    if (rettv_list_alloc(rettv) == FAIL)
-	return;
-    fname = alloc(MAXPATHL);
-    if (fname == NULL)
-	return;
+    char_u	c1;
+    char_u	*retval = NULL;
+    char_u	*temp_result;
+    char_u	*nextcmd = NULL;
 
-    for (first = TRUE; ; first = FALSE)
-	if (get_tagfname(&tn, first, fname) == FAIL
-		|| list_append_string(rettv->vval.v_list, fname, -1) == FAIL)
-	    break;
-    tagname_free(&tn);
-    vim_free(fname);
-}
+    if (expr_end == NULL || in_end == NULL)
+	return NULL;
+    *expr_start	= NUL;
+    *expr_end = NUL;
+    c1 = *in_end;
+    *in_end = NUL;
 
-/*
- * "taglist()" function
- */
-    static void
-f_taglist(argvars, rettv)
-    typval_T  *argvars;
-    typval_T  *rettv;
-{
-    char_u  *tag_pattern;
+    temp_result = eval_to_string(expr_start + 1, &nextcmd, FALSE);
+    if (temp_result != NULL && nextcmd == NULL)
+    {
+	retval = alloc((unsigned)(STRLEN(temp_result) + (expr_start - in_start)
+						   + (in_end - expr_end) + 1));
+	if (retval != NULL)
+	{
+	    STRCPY(retval, in_start);
+	    STRCAT(retval, temp_result);
+	    STRCAT(retval, expr_end + 1);
+	}
+    }
+    vim_free(temp_result);
 
-    tag_pattern = get_tv_string(&argvars[0]);
+    *in_end = c1;		/* put char back for error messages */
+    *expr_start = '{';
+    *expr_end = '}';
 
-    rettv->vval.v_number = FALSE;
-    if (*tag_pattern == NUL)
-	return;
+    if (retval != NULL)
+    {
+	temp_result = find_name_end(retval, &expr_start, &expr_end, 0);
+	if (expr_start != NULL)
+	{
+	    /* Further expansion! */
+	    temp_result = make_expanded_name(retval, expr_start,
+						       expr_end, temp_result);
+	    vim_free(retval);
+	    retval = temp_result;
+	}
+    }
 
-    if (rettv_list_alloc(rettv) == OK)
-	(void)get_tags(rettv->vval.v_list, tag_pattern);
+    return retval;
 }
 
 /*
- * "tempname()" function
+ * Return TRUE if character "c" can be used in a variable or function name.
+ * Does not include '{' or '}' for magic braces.
  */
-    static void
-f_tempname(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+    static int
+eval_isnamec(c)
+    int	    c;
 {
-    static int	x = 'A';
-
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = vim_tempname(x);
-
-    /* Advance 'x' to use A-Z and 0-9, so that there are at least 34 different
-     * names.  Skip 'I' and 'O', they are used for shell redirection. */
-    do
-    {
-	if (x == 'Z')
-	    x = '0';
-	else if (x == '9')
-	    x = 'A';
-	else
-	{
-#ifdef EBCDIC
-	    if (x == 'I')
-		x = 'J';
-	    else if (x == 'R')
-		x = 'S';
-	    else
-#endif
-		++x;
-	}
-    } while (x == 'I' || x == 'O');
+    return (ASCII_ISALNUM(c) || c == '_' || c == ':' || c == AUTOLOAD_CHAR);
 }
 
 /*
- * "test(list)" function: Just checking the walls...
+ * Return TRUE if character "c" can be used as the first character in a
+ * variable or function name (excluding '{' and '}').
  */
-    static void
-f_test(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
+    static int
+eval_isnamec1(c)
+    int	    c;
 {
-    /* Used for unit testing.  Change the code below to your liking. */
-#if 0
-    listitem_T	*li;
-    list_T	*l;
-    char_u	*bad, *good;
-
-    if (argvars[0].v_type != VAR_LIST)
-	return;
-    l = argvars[0].vval.v_list;
-    if (l == NULL)
-	return;
-    li = l->lv_first;
-    if (li == NULL)
-	return;
-    bad = get_tv_string(&li->li_tv);
-    li = li->li_next;
-    if (li == NULL)
-	return;
-    good = get_tv_string(&li->li_tv);
-    rettv->vval.v_number = test_edit_score(bad, good);
-#endif
+    return (ASCII_ISALPHA(c) || c == '_');
 }
 
-#ifdef FEAT_FLOAT
 /*
- * "tan()" function
+ * Set number v: variable to "val".
  */
-    static void
-f_tan(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    void
+set_vim_var_nr(idx, val)
+    int		idx;
+    long	val;
 {
-    float_T	f;
+    vimvars[idx].vv_nr = val;
+}
 
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	rettv->vval.v_float = tan(f);
-    else
-	rettv->vval.v_float = 0.0;
+/*
+ * Get number v: variable value.
+ */
+    long
+get_vim_var_nr(idx)
+    int		idx;
+{
+    return vimvars[idx].vv_nr;
 }
 
 /*
- * "tanh()" function
+ * Get string v: variable value.  Uses a static buffer, can only be used once.
  */
-    static void
-f_tanh(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    char_u *
+get_vim_var_str(idx)
+    int		idx;
 {
-    float_T	f;
+    return get_tv_string(&vimvars[idx].vv_tv);
+}
 
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	rettv->vval.v_float = tanh(f);
-    else
-	rettv->vval.v_float = 0.0;
+/*
+ * Get List v: variable value.  Caller must take care of reference count when
+ * needed.
+ */
+    list_T *
+get_vim_var_list(idx)
+    int		idx;
+{
+    return vimvars[idx].vv_list;
 }
-#endif
 
+#if defined(FEAT_SYN_HL) || defined(PROTO)
 /*
- * "tolower(string)" function
+ * Get the dictionary with global variables.
  */
-    static void
-f_tolower(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    dict_T *
+get_globvar_dict()
 {
-    char_u	*p;
+    return &globvardict;
+}
+#endif
 
-    p = vim_strsave(get_tv_string(&argvars[0]));
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = p;
+/*
+ * Set v:char to character "c".
+ */
+    void
+set_vim_var_char(c)
+    int c;
+{
+    char_u	buf[MB_MAXBYTES + 1];
 
-    if (p != NULL)
-	while (*p != NUL)
-	{
 #ifdef FEAT_MBYTE
-	    int		l;
-
-	    if (enc_utf8)
-	    {
-		int c, lc;
-
-		c = utf_ptr2char(p);
-		lc = utf_tolower(c);
-		l = utf_ptr2len(p);
-		/* TODO: reallocate string when byte count changes. */
-		if (utf_char2len(lc) == l)
-		    utf_char2bytes(lc, p);
-		p += l;
-	    }
-	    else if (has_mbyte && (l = (*mb_ptr2len)(p)) > 1)
-		p += l;		/* skip multi-byte character */
-	    else
+    if (has_mbyte)
+	buf[(*mb_char2bytes)(c, buf)] = NUL;
+    else
 #endif
-	    {
-		*p = TOLOWER_LOC(*p); /* note that tolower() can be a macro */
-		++p;
-	    }
-	}
+    {
+	buf[0] = c;
+	buf[1] = NUL;
+    }
+    set_vim_var_string(VV_CHAR, buf, -1);
 }
 
 /*
- * "toupper(string)" function
+ * Set v:count to "count" and v:count1 to "count1".
+ * When "set_prevcount" is TRUE first set v:prevcount from v:count.
  */
-    static void
-f_toupper(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    void
+set_vcount(count, count1, set_prevcount)
+    long	count;
+    long	count1;
+    int		set_prevcount;
 {
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = strup_save(get_tv_string(&argvars[0]));
+    if (set_prevcount)
+	vimvars[VV_PREVCOUNT].vv_nr = vimvars[VV_COUNT].vv_nr;
+    vimvars[VV_COUNT].vv_nr = count;
+    vimvars[VV_COUNT1].vv_nr = count1;
 }
 
 /*
- * "tr(string, fromstr, tostr)" function
+ * Set string v: variable to a copy of "val".
  */
-    static void
-f_tr(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
-{
-    char_u	*in_str;
-    char_u	*fromstr;
-    char_u	*tostr;
-    char_u	*p;
-#ifdef FEAT_MBYTE
-    int		inlen;
-    int		fromlen;
-    int		tolen;
+    void
+set_vim_var_string(idx, val, len)
     int		idx;
-    char_u	*cpstr;
-    int		cplen;
-    int		first = TRUE;
-#endif
-    char_u	buf[NUMBUFLEN];
-    char_u	buf2[NUMBUFLEN];
-    garray_T	ga;
-
-    in_str = get_tv_string(&argvars[0]);
-    fromstr = get_tv_string_buf_chk(&argvars[1], buf);
-    tostr = get_tv_string_buf_chk(&argvars[2], buf2);
-
-    /* Default return value: empty string. */
-    rettv->v_type = VAR_STRING;
-    rettv->vval.v_string = NULL;
-    if (fromstr == NULL || tostr == NULL)
-	    return;		/* type error; errmsg already given */
-    ga_init2(&ga, (int)sizeof(char), 80);
-
-#ifdef FEAT_MBYTE
-    if (!has_mbyte)
-#endif
-	/* not multi-byte: fromstr and tostr must be the same length */
-	if (STRLEN(fromstr) != STRLEN(tostr))
-	{
-#ifdef FEAT_MBYTE
-error:
-#endif
-	    EMSG2(_(e_invarg2), fromstr);
-	    ga_clear(&ga);
-	    return;
-	}
+    char_u	*val;
+    int		len;	    /* length of "val" to use or -1 (whole string) */
+{
+    /* Need to do this (at least) once, since we can't initialize a union.
+     * Will always be invoked when "v:progname" is set. */
+    vimvars[VV_VERSION].vv_nr = VIM_VERSION_100;
 
-    /* fromstr and tostr have to contain the same number of chars */
-    while (*in_str != NUL)
-    {
-#ifdef FEAT_MBYTE
-	if (has_mbyte)
-	{
-	    inlen = (*mb_ptr2len)(in_str);
-	    cpstr = in_str;
-	    cplen = inlen;
-	    idx = 0;
-	    for (p = fromstr; *p != NUL; p += fromlen)
-	    {
-		fromlen = (*mb_ptr2len)(p);
-		if (fromlen == inlen && STRNCMP(in_str, p, inlen) == 0)
-		{
-		    for (p = tostr; *p != NUL; p += tolen)
-		    {
-			tolen = (*mb_ptr2len)(p);
-			if (idx-- == 0)
-			{
-			    cplen = tolen;
-			    cpstr = p;
-			    break;
-			}
-		    }
-		    if (*p == NUL)	/* tostr is shorter than fromstr */
-			goto error;
-		    break;
-		}
-		++idx;
-	    }
+    vim_free(vimvars[idx].vv_str);
+    if (val == NULL)
+	vimvars[idx].vv_str = NULL;
+    else if (len == -1)
+	vimvars[idx].vv_str = vim_strsave(val);
+    else
+	vimvars[idx].vv_str = vim_strnsave(val, len);
+}
 
-	    if (first && cpstr == in_str)
-	    {
-		/* Check that fromstr and tostr have the same number of
-		 * (multi-byte) characters.  Done only once when a character
-		 * of in_str doesn't appear in fromstr. */
-		first = FALSE;
-		for (p = tostr; *p != NUL; p += tolen)
-		{
-		    tolen = (*mb_ptr2len)(p);
-		    --idx;
-		}
-		if (idx != 0)
-		    goto error;
-	    }
+/*
+ * Set List v: variable to "val".
+ */
+    void
+set_vim_var_list(idx, val)
+    int		idx;
+    list_T	*val;
+{
+    list_unref(vimvars[idx].vv_list);
+    vimvars[idx].vv_list = val;
+    if (val != NULL)
+	++val->lv_refcount;
+}
 
-	    ga_grow(&ga, cplen);
-	    mch_memmove((char *)ga.ga_data + ga.ga_len, cpstr, (size_t)cplen);
-	    ga.ga_len += cplen;
+/*
+ * Set v:register if needed.
+ */
+    void
+set_reg_var(c)
+    int		c;
+{
+    char_u	regname;
 
-	    in_str += inlen;
-	}
-	else
-#endif
-	{
-	    /* When not using multi-byte chars we can do it faster. */
-	    p = vim_strchr(fromstr, *in_str);
-	    if (p != NULL)
-		ga_append(&ga, tostr[p - fromstr]);
-	    else
-		ga_append(&ga, *in_str);
-	    ++in_str;
-	}
-    }
+    if (c == 0 || c == ' ')
+	regname = '"';
+    else
+	regname = c;
+    /* Avoid free/alloc when the value is already right. */
+    if (vimvars[VV_REG].vv_str == NULL || vimvars[VV_REG].vv_str[0] != c)
+	set_vim_var_string(VV_REG, &regname, 1);
+}
 
-    /* add a terminating NUL */
-    ga_grow(&ga, 1);
-    ga_append(&ga, NUL);
+/*
+ * Get or set v:exception.  If "oldval" == NULL, return the current value.
+ * Otherwise, restore the value to "oldval" and return NULL.
+ * Must always be called in pairs to save and restore v:exception!  Does not
+ * take care of memory allocations.
+ */
+    char_u *
+v_exception(oldval)
+    char_u	*oldval;
+{
+    if (oldval == NULL)
+	return vimvars[VV_EXCEPTION].vv_str;
 
-    rettv->vval.v_string = ga.ga_data;
+    vimvars[VV_EXCEPTION].vv_str = oldval;
+    return NULL;
 }
 
-#ifdef FEAT_FLOAT
 /*
- * "trunc({float})" function
+ * Get or set v:throwpoint.  If "oldval" == NULL, return the current value.
+ * Otherwise, restore the value to "oldval" and return NULL.
+ * Must always be called in pairs to save and restore v:throwpoint!  Does not
+ * take care of memory allocations.
  */
-    static void
-f_trunc(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    char_u *
+v_throwpoint(oldval)
+    char_u	*oldval;
 {
-    float_T	f;
+    if (oldval == NULL)
+	return vimvars[VV_THROWPOINT].vv_str;
 
-    rettv->v_type = VAR_FLOAT;
-    if (get_float_arg(argvars, &f) == OK)
-	/* trunc() is not in C90, use floor() or ceil() instead. */
-	rettv->vval.v_float = f > 0 ? floor(f) : ceil(f);
-    else
-	rettv->vval.v_float = 0.0;
+    vimvars[VV_THROWPOINT].vv_str = oldval;
+    return NULL;
 }
-#endif
 
+#if defined(FEAT_AUTOCMD) || defined(PROTO)
 /*
- * "type(expr)" function
+ * Set v:cmdarg.
+ * If "eap" != NULL, use "eap" to generate the value and return the old value.
+ * If "oldarg" != NULL, restore the value to "oldarg" and return NULL.
+ * Must always be called in pairs!
  */
-    static void
-f_type(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    char_u *
+set_cmdarg(eap, oldarg)
+    exarg_T	*eap;
+    char_u	*oldarg;
 {
-    int n;
+    char_u	*oldval;
+    char_u	*newval;
+    unsigned	len;
 
-    switch (argvars[0].v_type)
+    oldval = vimvars[VV_CMDARG].vv_str;
+    if (eap == NULL)
     {
-	case VAR_NUMBER: n = 0; break;
-	case VAR_STRING: n = 1; break;
-	case VAR_FUNC:   n = 2; break;
-	case VAR_LIST:   n = 3; break;
-	case VAR_DICT:   n = 4; break;
-#ifdef FEAT_FLOAT
-	case VAR_FLOAT:  n = 5; break;
-#endif
-	default: EMSG2(_(e_intern2), "f_type()"); n = 0; break;
+	vim_free(oldval);
+	vimvars[VV_CMDARG].vv_str = oldarg;
+	return NULL;
     }
-    rettv->vval.v_number = n;
+
+    if (eap->force_bin == FORCE_BIN)
+	len = 6;
+    else if (eap->force_bin == FORCE_NOBIN)
+	len = 8;
+    else
+	len = 0;
+
+    if (eap->read_edit)
+	len += 7;
+
+    if (eap->force_ff != 0)
+	len += (unsigned)STRLEN(eap->cmd + eap->force_ff) + 6;
+# ifdef FEAT_MBYTE
+    if (eap->force_enc != 0)
+	len += (unsigned)STRLEN(eap->cmd + eap->force_enc) + 7;
+    if (eap->bad_char != 0)
+	len += 7 + 4;  /* " ++bad=" + "keep" or "drop" */
+# endif
+
+    newval = alloc(len + 1);
+    if (newval == NULL)
+	return NULL;
+
+    if (eap->force_bin == FORCE_BIN)
+	sprintf((char *)newval, " ++bin");
+    else if (eap->force_bin == FORCE_NOBIN)
+	sprintf((char *)newval, " ++nobin");
+    else
+	*newval = NUL;
+
+    if (eap->read_edit)
+	STRCAT(newval, " ++edit");
+
+    if (eap->force_ff != 0)
+	sprintf((char *)newval + STRLEN(newval), " ++ff=%s",
+						eap->cmd + eap->force_ff);
+# ifdef FEAT_MBYTE
+    if (eap->force_enc != 0)
+	sprintf((char *)newval + STRLEN(newval), " ++enc=%s",
+					       eap->cmd + eap->force_enc);
+    if (eap->bad_char == BAD_KEEP)
+	STRCPY(newval + STRLEN(newval), " ++bad=keep");
+    else if (eap->bad_char == BAD_DROP)
+	STRCPY(newval + STRLEN(newval), " ++bad=drop");
+    else if (eap->bad_char != 0)
+	sprintf((char *)newval + STRLEN(newval), " ++bad=%c", eap->bad_char);
+# endif
+    vimvars[VV_CMDARG].vv_str = newval;
+    return oldval;
 }
+#endif
 
 /*
- * "undofile(name)" function
+ * Get the value of internal variable "name".
+ * Return OK or FAIL.
  */
-    static void
-f_undofile(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+    static int
+get_var_tv(name, len, rettv, verbose, no_autoload)
+    char_u	*name;
+    int		len;		/* length of "name" */
+    typval_T	*rettv;		/* NULL when only checking existence */
+    int		verbose;	/* may give error message */
+    int		no_autoload;	/* do not use script autoloading */
 {
-    rettv->v_type = VAR_STRING;
-#ifdef FEAT_PERSISTENT_UNDO
+    int		ret = OK;
+    typval_T	*tv = NULL;
+    typval_T	atv;
+    dictitem_T	*v;
+    int		cc;
+
+    /* truncate the name, so that we can use strcmp() */
+    cc = name[len];
+    name[len] = NUL;
+
+    /*
+     * Check for "b:changedtick".
+     */
+    if (STRCMP(name, "b:changedtick") == 0)
     {
-	char_u *fname = get_tv_string(&argvars[0]);
+	atv.v_type = VAR_NUMBER;
+	atv.vval.v_number = curbuf->b_changedtick;
+	tv = &atv;
+    }
 
-	if (*fname == NUL)
-	{
-	    /* If there is no file name there will be no undo file. */
-	    rettv->vval.v_string = NULL;
-	}
-	else
-	{
-	    char_u *ffname = FullName_save(fname, FALSE);
+    /*
+     * Check for user-defined variables.
+     */
+    else
+    {
+	v = find_var(name, NULL, no_autoload);
+	if (v != NULL)
+	    tv = &v->di_tv;
+    }
 
-	    if (ffname != NULL)
-		rettv->vval.v_string = u_get_undo_file_name(ffname, FALSE);
-	    vim_free(ffname);
-	}
+    if (tv == NULL)
+    {
+	if (rettv != NULL && verbose)
+	    EMSG2(_(e_undefvar), name);
+	ret = FAIL;
     }
-#else
-    rettv->vval.v_string = NULL;
-#endif
+    else if (rettv != NULL)
+	copy_tv(tv, rettv);
+
+    name[len] = cc;
+
+    return ret;
 }
 
 /*
- * "undotree()" function
+ * Handle expr[expr], expr[expr:expr] subscript and .name lookup.
+ * Also handle function call with Funcref variable: func(expr)
+ * Can all be combined: dict.func(expr)[idx]['func'](expr)
  */
-    static void
-f_undotree(argvars, rettv)
-    typval_T	*argvars UNUSED;
+    static int
+handle_subscript(arg, rettv, evaluate, verbose)
+    char_u	**arg;
     typval_T	*rettv;
+    int		evaluate;	/* do more than finding the end */
+    int		verbose;	/* give error messages */
 {
-    if (rettv_dict_alloc(rettv) == OK)
+    int		ret = OK;
+    dict_T	*selfdict = NULL;
+    char_u	*s;
+    int		len;
+    typval_T	functv;
+
+    while (ret == OK
+	    && (**arg == '['
+		|| (**arg == '.' && rettv->v_type == VAR_DICT)
+		|| (**arg == '(' && (!evaluate || rettv->v_type == VAR_FUNC)))
+	    && !vim_iswhite(*(*arg - 1)))
     {
-	dict_T *dict = rettv->vval.v_dict;
-	list_T *list;
+	if (**arg == '(')
+	{
+	    /* need to copy the funcref so that we can clear rettv */
+	    if (evaluate)
+	    {
+		functv = *rettv;
+		rettv->v_type = VAR_UNKNOWN;
+
+		/* Invoke the function.  Recursive! */
+		s = functv.vval.v_string;
+	    }
+	    else
+		s = (char_u *)"";
+	    ret = get_func_tv(s, (int)STRLEN(s), rettv, arg,
+			curwin->w_cursor.lnum, curwin->w_cursor.lnum,
+			&len, evaluate, selfdict);
 
-	dict_add_nr_str(dict, "synced", (long)curbuf->b_u_synced, NULL);
-	dict_add_nr_str(dict, "seq_last", curbuf->b_u_seq_last, NULL);
-	dict_add_nr_str(dict, "save_last",
-					(long)curbuf->b_u_save_nr_last, NULL);
-	dict_add_nr_str(dict, "seq_cur", curbuf->b_u_seq_cur, NULL);
-	dict_add_nr_str(dict, "time_cur", (long)curbuf->b_u_time_cur, NULL);
-	dict_add_nr_str(dict, "save_cur", (long)curbuf->b_u_save_nr_cur, NULL);
+	    /* Clear the funcref afterwards, so that deleting it while
+	     * evaluating the arguments is possible (see test55). */
+	    if (evaluate)
+		clear_tv(&functv);
 
-	list = list_alloc();
-	if (list != NULL)
+	    /* Stop the expression evaluation when immediately aborting on
+	     * error, or when an interrupt occurred or an exception was thrown
+	     * but not caught. */
+	    if (aborting())
+	    {
+		if (ret == OK)
+		    clear_tv(rettv);
+		ret = FAIL;
+	    }
+	    dict_unref(selfdict);
+	    selfdict = NULL;
+	}
+	else /* **arg == '[' || **arg == '.' */
 	{
-	    u_eval_tree(curbuf->b_u_oldhead, list);
-	    dict_add_list(dict, "entries", list);
+	    dict_unref(selfdict);
+	    if (rettv->v_type == VAR_DICT)
+	    {
+		selfdict = rettv->vval.v_dict;
+		if (selfdict != NULL)
+		    ++selfdict->dv_refcount;
+	    }
+	    else
+		selfdict = NULL;
+	    if (eval_index(arg, rettv, evaluate, verbose) == FAIL)
+	    {
+		clear_tv(rettv);
+		ret = FAIL;
+	    }
 	}
     }
+    dict_unref(selfdict);
+    return ret;
 }
 
 /*
- * "values(dict)" function
+ * Allocate memory for a variable type-value, and make it empty (0 or NULL
+ * value).
  */
-    static void
-f_values(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static typval_T *
+alloc_tv()
 {
-    dict_list(argvars, rettv, 1);
+    return (typval_T *)alloc_clear((unsigned)sizeof(typval_T));
 }
 
 /*
- * "virtcol(string)" function
+ * Allocate memory for a variable type-value, and assign a string to it.
+ * The string "s" must have been allocated, it is consumed.
+ * Return NULL for out of memory, the variable otherwise.
  */
-    static void
-f_virtcol(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static typval_T *
+alloc_string_tv(s)
+    char_u	*s;
 {
-    colnr_T	vcol = 0;
-    pos_T	*fp;
-    int		fnum = curbuf->b_fnum;
+    typval_T	*rettv;
 
-    fp = var2fpos(&argvars[0], FALSE, &fnum);
-    if (fp != NULL && fp->lnum <= curbuf->b_ml.ml_line_count
-						    && fnum == curbuf->b_fnum)
+    rettv = alloc_tv();
+    if (rettv != NULL)
     {
-	getvvcol(curwin, fp, NULL, NULL, &vcol);
-	++vcol;
+	rettv->v_type = VAR_STRING;
+	rettv->vval.v_string = s;
     }
-
-    rettv->vval.v_number = vcol;
-}
-
-/*
- * "visualmode()" function
- */
-    static void
-f_visualmode(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
-{
-    char_u	str[2];
-
-    rettv->v_type = VAR_STRING;
-    str[0] = curbuf->b_visual_mode_eval;
-    str[1] = NUL;
-    rettv->vval.v_string = vim_strsave(str);
-
-    /* A non-zero number or non-empty string argument: reset mode. */
-    if (non_zero_arg(&argvars[0]))
-	curbuf->b_visual_mode_eval = NUL;
+    else
+	vim_free(s);
+    return rettv;
 }
 
 /*
- * "wildmenumode()" function
+ * Free the memory for a variable type-value.
  */
-    static void
-f_wildmenumode(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv UNUSED;
+    void
+free_tv(varp)
+    typval_T *varp;
 {
-#ifdef FEAT_WILDMENU
-    if (wild_menu_showing)
-	rettv->vval.v_number = 1;
+    if (varp != NULL)
+    {
+	switch (varp->v_type)
+	{
+	    case VAR_FUNC:
+		func_unref(varp->vval.v_string);
+		/*FALLTHROUGH*/
+	    case VAR_STRING:
+		vim_free(varp->vval.v_string);
+		break;
+	    case VAR_LIST:
+		list_unref(varp->vval.v_list);
+		break;
+	    case VAR_DICT:
+		dict_unref(varp->vval.v_dict);
+		break;
+	    case VAR_NUMBER:
+#ifdef FEAT_FLOAT
+	    case VAR_FLOAT:
 #endif
+	    case VAR_UNKNOWN:
+		break;
+	    default:
+		EMSG2(_(e_intern2), "free_tv()");
+		break;
+	}
+	vim_free(varp);
+    }
 }
 
 /*
- * "winbufnr(nr)" function
+ * Free the memory for a variable value and set the value to NULL or 0.
  */
-    static void
-f_winbufnr(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    void
+clear_tv(varp)
+    typval_T *varp;
 {
-    win_T	*wp;
-
-    wp = find_win_by_nr(&argvars[0], NULL);
-    if (wp == NULL)
-	rettv->vval.v_number = -1;
-    else
-	rettv->vval.v_number = wp->w_buffer->b_fnum;
+    if (varp != NULL)
+    {
+	switch (varp->v_type)
+	{
+	    case VAR_FUNC:
+		func_unref(varp->vval.v_string);
+		/*FALLTHROUGH*/
+	    case VAR_STRING:
+		vim_free(varp->vval.v_string);
+		varp->vval.v_string = NULL;
+		break;
+	    case VAR_LIST:
+		list_unref(varp->vval.v_list);
+		varp->vval.v_list = NULL;
+		break;
+	    case VAR_DICT:
+		dict_unref(varp->vval.v_dict);
+		varp->vval.v_dict = NULL;
+		break;
+	    case VAR_NUMBER:
+		varp->vval.v_number = 0;
+		break;
+#ifdef FEAT_FLOAT
+	    case VAR_FLOAT:
+		varp->vval.v_float = 0.0;
+		break;
+#endif
+	    case VAR_UNKNOWN:
+		break;
+	    default:
+		EMSG2(_(e_intern2), "clear_tv()");
+	}
+	varp->v_lock = 0;
+    }
 }
 
 /*
- * "wincol()" function
+ * Set the value of a variable to NULL without freeing items.
  */
     static void
-f_wincol(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+init_tv(varp)
+    typval_T *varp;
 {
-    validate_cursor();
-    rettv->vval.v_number = curwin->w_wcol + 1;
+    if (varp != NULL)
+	vim_memset(varp, 0, sizeof(typval_T));
 }
 
 /*
- * "winheight(nr)" function
+ * Get the number value of a variable.
+ * If it is a String variable, uses vim_str2nr().
+ * For incompatible types, return 0.
+ * get_tv_number_chk() is similar to get_tv_number(), but informs the
+ * caller of incompatible types: it sets *denote to TRUE if "denote"
+ * is not NULL or returns -1 otherwise.
  */
-    static void
-f_winheight(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static long
+get_tv_number(varp)
+    typval_T	*varp;
 {
-    win_T	*wp;
-
-    wp = find_win_by_nr(&argvars[0], NULL);
-    if (wp == NULL)
-	rettv->vval.v_number = -1;
-    else
-	rettv->vval.v_number = wp->w_height;
-}
+    int		error = FALSE;
 
-/*
- * "winline()" function
- */
-    static void
-f_winline(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
-{
-    validate_cursor();
-    rettv->vval.v_number = curwin->w_wrow + 1;
+    return get_tv_number_chk(varp, &error);	/* return 0L on error */
 }
 
-/*
- * "winnr()" function
- */
-    static void
-f_winnr(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+    long
+get_tv_number_chk(varp, denote)
+    typval_T	*varp;
+    int		*denote;
 {
-    int		nr = 1;
+    long	n = 0L;
 
-#ifdef FEAT_WINDOWS
-    nr = get_winnr(curtab, &argvars[0]);
+    switch (varp->v_type)
+    {
+	case VAR_NUMBER:
+	    return (long)(varp->vval.v_number);
+#ifdef FEAT_FLOAT
+	case VAR_FLOAT:
+	    EMSG(_("E805: Using a Float as a Number"));
+	    break;
 #endif
-    rettv->vval.v_number = nr;
+	case VAR_FUNC:
+	    EMSG(_("E703: Using a Funcref as a Number"));
+	    break;
+	case VAR_STRING:
+	    if (varp->vval.v_string != NULL)
+		vim_str2nr(varp->vval.v_string, NULL, NULL,
+							TRUE, TRUE, &n, NULL);
+	    return n;
+	case VAR_LIST:
+	    EMSG(_("E745: Using a List as a Number"));
+	    break;
+	case VAR_DICT:
+	    EMSG(_("E728: Using a Dictionary as a Number"));
+	    break;
+	default:
+	    EMSG2(_(e_intern2), "get_tv_number()");
+	    break;
+    }
+    if (denote == NULL)		/* useful for values that must be unsigned */
+	n = -1;
+    else
+	*denote = TRUE;
+    return n;
 }
 
 /*
- * "winrestcmd()" function
+ * Get the lnum from the first argument.
+ * Also accepts ".", "$", etc., but that only works for the current buffer.
+ * Returns -1 on error.
  */
-    static void
-f_winrestcmd(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+    static linenr_T
+get_tv_lnum(argvars)
+    typval_T	*argvars;
 {
-#ifdef FEAT_WINDOWS
-    win_T	*wp;
-    int		winnr = 1;
-    garray_T	ga;
-    char_u	buf[50];
+    typval_T	rettv;
+    linenr_T	lnum;
 
-    ga_init2(&ga, (int)sizeof(char), 70);
-    for (wp = firstwin; wp != NULL; wp = wp->w_next)
+    lnum = get_tv_number_chk(&argvars[0], NULL);
+    if (lnum == 0)  /* no valid number, try using line() */
     {
-	sprintf((char *)buf, "%dresize %d|", winnr, wp->w_height);
-	ga_concat(&ga, buf);
-# ifdef FEAT_VERTSPLIT
-	sprintf((char *)buf, "vert %dresize %d|", winnr, wp->w_width);
-	ga_concat(&ga, buf);
-# endif
-	++winnr;
+	rettv.v_type = VAR_NUMBER;
+	f_line(argvars, &rettv);
+	lnum = rettv.vval.v_number;
+	clear_tv(&rettv);
     }
-    ga_append(&ga, NUL);
-
-    rettv->vval.v_string = ga.ga_data;
-#else
-    rettv->vval.v_string = NULL;
-#endif
-    rettv->v_type = VAR_STRING;
+    return lnum;
 }
 
 /*
- * "winrestview()" function
+ * Get the lnum from the first argument.
+ * Also accepts "$", then "buf" is used.
+ * Returns 0 on error.
  */
-    static void
-f_winrestview(argvars, rettv)
+    static linenr_T
+get_tv_lnum_buf(argvars, buf)
     typval_T	*argvars;
-    typval_T	*rettv UNUSED;
+    buf_T	*buf;
 {
-    dict_T	*dict;
-
-    if (argvars[0].v_type != VAR_DICT
-	    || (dict = argvars[0].vval.v_dict) == NULL)
-	EMSG(_(e_invarg));
-    else
-    {
-	curwin->w_cursor.lnum = get_dict_number(dict, (char_u *)"lnum");
-	curwin->w_cursor.col = get_dict_number(dict, (char_u *)"col");
-#ifdef FEAT_VIRTUALEDIT
-	curwin->w_cursor.coladd = get_dict_number(dict, (char_u *)"coladd");
-#endif
-	curwin->w_curswant = get_dict_number(dict, (char_u *)"curswant");
-	curwin->w_set_curswant = FALSE;
-
-	set_topline(curwin, get_dict_number(dict, (char_u *)"topline"));
-#ifdef FEAT_DIFF
-	curwin->w_topfill = get_dict_number(dict, (char_u *)"topfill");
-#endif
-	curwin->w_leftcol = get_dict_number(dict, (char_u *)"leftcol");
-	curwin->w_skipcol = get_dict_number(dict, (char_u *)"skipcol");
-
-	check_cursor();
-	win_new_height(curwin, curwin->w_height);
-# ifdef FEAT_VERTSPLIT
-	win_new_width(curwin, W_WIDTH(curwin));
-# endif
-	changed_window_setting();
-
-	if (curwin->w_topline == 0)
-	    curwin->w_topline = 1;
-	if (curwin->w_topline > curbuf->b_ml.ml_line_count)
-	    curwin->w_topline = curbuf->b_ml.ml_line_count;
-#ifdef FEAT_DIFF
-	check_topfill(curwin, TRUE);
-#endif
-    }
+    if (argvars[0].v_type == VAR_STRING
+	    && argvars[0].vval.v_string != NULL
+	    && argvars[0].vval.v_string[0] == '$'
+	    && buf != NULL)
+	return buf->b_ml.ml_line_count;
+    return get_tv_number_chk(&argvars[0], NULL);
 }
 
 /*
- * "winsaveview()" function
+ * Get the string value of a variable.
+ * If it is a Number variable, the number is converted into a string.
+ * get_tv_string() uses a single, static buffer.  YOU CAN ONLY USE IT ONCE!
+ * get_tv_string_buf() uses a given buffer.
+ * If the String variable has never been set, return an empty string.
+ * Never returns NULL;
+ * get_tv_string_chk() and get_tv_string_buf_chk() are similar, but return
+ * NULL on error.
  */
-    static void
-f_winsaveview(argvars, rettv)
-    typval_T	*argvars UNUSED;
-    typval_T	*rettv;
+    static char_u *
+get_tv_string(varp)
+    typval_T	*varp;
 {
-    dict_T	*dict;
+    static char_u   mybuf[NUMBUFLEN];
 
-    if (rettv_dict_alloc(rettv) == FAIL)
-	return;
-    dict = rettv->vval.v_dict;
+    return get_tv_string_buf(varp, mybuf);
+}
 
-    dict_add_nr_str(dict, "lnum", (long)curwin->w_cursor.lnum, NULL);
-    dict_add_nr_str(dict, "col", (long)curwin->w_cursor.col, NULL);
-#ifdef FEAT_VIRTUALEDIT
-    dict_add_nr_str(dict, "coladd", (long)curwin->w_cursor.coladd, NULL);
-#endif
-    update_curswant();
-    dict_add_nr_str(dict, "curswant", (long)curwin->w_curswant, NULL);
+    static char_u *
+get_tv_string_buf(varp, buf)
+    typval_T	*varp;
+    char_u	*buf;
+{
+    char_u	*res =  get_tv_string_buf_chk(varp, buf);
 
-    dict_add_nr_str(dict, "topline", (long)curwin->w_topline, NULL);
-#ifdef FEAT_DIFF
-    dict_add_nr_str(dict, "topfill", (long)curwin->w_topfill, NULL);
-#endif
-    dict_add_nr_str(dict, "leftcol", (long)curwin->w_leftcol, NULL);
-    dict_add_nr_str(dict, "skipcol", (long)curwin->w_skipcol, NULL);
+    return res != NULL ? res : (char_u *)"";
 }
 
 /*
- * "winwidth(nr)" function
+ * Careful: This uses a single, static buffer.  YOU CAN ONLY USE IT ONCE!
  */
-    static void
-f_winwidth(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    char_u *
+get_tv_string_chk(varp)
+    typval_T	*varp;
 {
-    win_T	*wp;
+    static char_u   mybuf[NUMBUFLEN];
 
-    wp = find_win_by_nr(&argvars[0], NULL);
-    if (wp == NULL)
-	rettv->vval.v_number = -1;
-    else
-#ifdef FEAT_VERTSPLIT
-	rettv->vval.v_number = wp->w_width;
-#else
-	rettv->vval.v_number = Columns;
-#endif
+    return get_tv_string_buf_chk(varp, mybuf);
 }
 
-/*
- * Write list of strings to file
- */
-    static int
-write_list(fd, list, binary)
-    FILE	*fd;
-    list_T	*list;
-    int		binary;
+    static char_u *
+get_tv_string_buf_chk(varp, buf)
+    typval_T	*varp;
+    char_u	*buf;
 {
-    listitem_T	*li;
-    int		c;
-    int		ret = OK;
-    char_u	*s;
-
-    for (li = list->lv_first; li != NULL; li = li->li_next)
+    switch (varp->v_type)
     {
-	for (s = get_tv_string(&li->li_tv); *s != NUL; ++s)
-	{
-	    if (*s == '\n')
-		c = putc(NUL, fd);
-	    else
-		c = putc(*s, fd);
-	    if (c == EOF)
-	    {
-		ret = FAIL;
-		break;
-	    }
-	}
-	if (!binary || li->li_next != NULL)
-	    if (putc('\n', fd) == EOF)
-	    {
-		ret = FAIL;
-		break;
-	    }
-	if (ret == FAIL)
-	{
-	    EMSG(_(e_write));
+	case VAR_NUMBER:
+	    sprintf((char *)buf, "%ld", (long)varp->vval.v_number);
+	    return buf;
+	case VAR_FUNC:
+	    EMSG(_("E729: using Funcref as a String"));
+	    break;
+	case VAR_LIST:
+	    EMSG(_("E730: using List as a String"));
+	    break;
+	case VAR_DICT:
+	    EMSG(_("E731: using Dictionary as a String"));
+	    break;
+#ifdef FEAT_FLOAT
+	case VAR_FLOAT:
+	    EMSG(_(e_float_as_string));
+	    break;
+#endif
+	case VAR_STRING:
+	    if (varp->vval.v_string != NULL)
+		return varp->vval.v_string;
+	    return (char_u *)"";
+	default:
+	    EMSG2(_(e_intern2), "get_tv_string_buf()");
 	    break;
-	}
     }
-    return ret;
+    return NULL;
 }
 
 /*
- * "writefile()" function
+ * Find variable "name" in the list of variables.
+ * Return a pointer to it if found, NULL if not found.
+ * Careful: "a:0" variables don't have a name.
+ * When "htp" is not NULL we are writing to the variable, set "htp" to the
+ * hashtab_T used.
  */
-    static void
-f_writefile(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+    static dictitem_T *
+find_var(name, htp, no_autoload)
+    char_u	*name;
+    hashtab_T	**htp;
+    int		no_autoload;
 {
-    int		binary = FALSE;
-    char_u	*fname;
-    FILE	*fd;
-    int		ret = 0;
+    char_u	*varname;
+    hashtab_T	*ht;
 
-    if (check_restricted() || check_secure())
-	return;
+    ht = find_var_ht(name, &varname);
+    if (htp != NULL)
+	*htp = ht;
+    if (ht == NULL)
+	return NULL;
+    return find_var_in_ht(ht, *name, varname, no_autoload || htp != NULL);
+}
 
-    if (argvars[0].v_type != VAR_LIST)
+/*
+ * Find variable "varname" in hashtab "ht" with name "htname".
+ * Returns NULL if not found.
+ */
+    static dictitem_T *
+find_var_in_ht(ht, htname, varname, no_autoload)
+    hashtab_T	*ht;
+    int		htname;
+    char_u	*varname;
+    int		no_autoload;
+{
+    hashitem_T	*hi;
+
+    if (*varname == NUL)
     {
-	EMSG2(_(e_listarg), "writefile()");
-	return;
+	/* Must be something like "s:", otherwise "ht" would be NULL. */
+	switch (htname)
+	{
+	    case 's': return &SCRIPT_SV(current_SID)->sv_var;
+	    case 'v': return &vimvars_var;
+	    case 'l': return current_funccal == NULL
+					? NULL : &current_funccal->l_vars_var;
+	    case 'a': return current_funccal == NULL
+				       ? NULL : &current_funccal->l_avars_var;
+	}
+#ifdef FEAT_SYN_HL
+	/* Can't tell which global, buffer, window or tab page variables are
+	 * used. */
+	if (syn_cache_buf != NULL)
+	    syn_cache_cancel();
+#endif
+	switch (htname)
+	{
+	    case 'g': return &globvars_var;
+	    case 'b': return &curbuf->b_bufvar;
+	    case 'w': return &curwin->w_winvar;
+#ifdef FEAT_WINDOWS
+	    case 't': return &curtab->tp_winvar;
+#endif
+	}
+	return NULL;
     }
-    if (argvars[0].vval.v_list == NULL)
-	return;
 
-    if (argvars[2].v_type != VAR_UNKNOWN
-			      && STRCMP(get_tv_string(&argvars[2]), "b") == 0)
-	binary = TRUE;
+#ifdef FEAT_SYN_HL
+    if (syn_cache_buf != NULL)
+	syn_cache_var_check(ht, varname);
+#endif
 
-    /* Always open the file in binary mode, library functions have a mind of
-     * their own about CR-LF conversion. */
-    fname = get_tv_string(&argvars[1]);
-    if (*fname == NUL || (fd = mch_fopen((char *)fname, WRITEBIN)) == NULL)
-    {
-	EMSG2(_(e_notcreate), *fname == NUL ? (char_u *)_("<empty>") : fname);
-	ret = -1;
-    }
-    else
+    hi = hash_find(ht, varname);
+    if (HASHITEM_EMPTY(hi))
     {
-	if (write_list(fd, argvars[0].vval.v_list, binary) == FAIL)
-	    ret = -1;
-	fclose(fd);
+	/* For global variables we may try auto-loading the script.  If it
+	 * worked find the variable again.  Don't auto-load a script if it was
+	 * loaded already, otherwise it would be loaded every time when
+	 * checking if a function name is a Funcref variable. */
+	if (ht == &globvarht && !no_autoload)
+	{
+	    /* Note: script_autoload() may make "hi" invalid. It must either
+	     * be obtained again or not used. */
+	    if (!script_autoload(varname, FALSE) || aborting())
+		return NULL;
+	    hi = hash_find(ht, varname);
+	}
+	if (HASHITEM_EMPTY(hi))
+	    return NULL;
     }
-
-    rettv->vval.v_number = ret;
+    return HI2DI(hi);
 }
 
+#ifdef FEAT_SYN_HL
 /*
- * "xor(expr, expr)" function
+ * Called when variable "varname" in "ht" is used while a syntax file is being
+ * sourced.  A syntax file that uses a global variable or a variable of the
+ * buffer can only be cached for its current value.  One that uses a window or
+ * tab page variable, or a variable of another buffer, is not cached.
  */
     static void
-f_xor(argvars, rettv)
-    typval_T	*argvars;
-    typval_T	*rettv;
+syn_cache_var_check(ht, varname)
+    hashtab_T	*ht;
+    char_u	*varname;
 {
-    rettv->vval.v_number = get_tv_number_chk(&argvars[0], NULL)
-					^ get_tv_number_chk(&argvars[1], NULL);
+    if (ht == &globvarht)
+	syn_cache_var_used('g', varname);
+    else if (ht == &syn_cache_buf->b_vars->dv_hashtab)
+	syn_cache_var_used('b', varname);
+    else if (ht != &vimvarht && ht != &compat_hashtab
+	    && (current_SID <= 0 || current_SID > ga_scripts.ga_len
+					       || ht != &SCRIPT_VARS(current_SID))
+	    && (current_funccal == NULL
+		|| (ht != &current_funccal->l_vars.dv_hashtab
+			      && ht != &current_funccal->l_avars.dv_hashtab)))
+	syn_cache_cancel();
 }
-
+#endif
 
 /*
- * Translate a String variable into a position.
- * Returns NULL when there is an error.
+ * Find the hashtab used for a variable name.
+ * Set "varname" to the start of name without ':'.
  */
-    static pos_T *
-var2fpos(varp, dollar_lnum, fnum)
-    typval_T	*varp;
-    int		dollar_lnum;	/* TRUE when $ is last line */
-    int		*fnum;		/* set to fnum for '0, 'A, etc. */
+    static hashtab_T *
+find_var_ht(name, varname)
+    char_u  *name;
+    char_u  **varname;
 {
-    char_u		*name;
-    static pos_T	pos;
-    pos_T		*pp;
+    hashitem_T	*hi;
 
-    /* Argument can be [lnum, col, coladd]. */
-    if (varp->v_type == VAR_LIST)
+    if (name[1] != ':')
     {
-	list_T		*l;
-	int		len;
-	int		error = FALSE;
-	listitem_T	*li;
-
-	l = varp->vval.v_list;
-	if (l == NULL)
-	    return NULL;
-
-	/* Get the line number */
-	pos.lnum = list_find_nr(l, 0L, &error);
-	if (error || pos.lnum <= 0 || pos.lnum > curbuf->b_ml.ml_line_count)
-	    return NULL;	/* invalid line number */
-
-	/* Get the column number */
-	pos.col = list_find_nr(l, 1L, &error);
-	if (error)
+	/* The name must not start with a colon or #. */
+	if (name[0] == ':' || name[0] == AUTOLOAD_CHAR)
 	    return NULL;
-	len = (long)STRLEN(ml_get(pos.lnum));
-
-	/* We accept "$" for the column number: last column. */
-	li = list_find(l, 1L);
-	if (li != NULL && li->li_tv.v_type == VAR_STRING
-		&& li->li_tv.vval.v_string != NULL
-		&& STRCMP(li->li_tv.vval.v_string, "$") == 0)
-	    pos.col = len + 1;
+	*varname = name;
 
-	/* Accept a position up to the NUL after the line. */
-	if (pos.col == 0 || (int)pos.col > len + 1)
-	    return NULL;	/* invalid column number */
-	--pos.col;
+	/* "version" is "v:version" in all scopes */
+	hi = hash_find(&compat_hashtab, name);
+	if (!HASHITEM_EMPTY(hi))
+	    return &compat_hashtab;
 
-#ifdef FEAT_VIRTUALEDIT
-	/* Get the virtual offset.  Defaults to zero. */
-	pos.coladd = list_find_nr(l, 2L, &error);
-	if (error)
-	    pos.coladd = 0;
+	if (current_funccal == NULL)
+	    return &globvarht;			/* global variable */
+	return &current_funccal->l_vars.dv_hashtab; /* l: variable */
+    }
+    *varname = name + 2;
+    if (*name == 'g')				/* global variable */
+	return &globvarht;
+    /* There must be no ':' or '#' in the rest of the name, unless g: is used
+     */
+    if (vim_strchr(name + 2, ':') != NULL
+			       || vim_strchr(name + 2, AUTOLOAD_CHAR) != NULL)
+	return NULL;
+    if (*name == 'b')				/* buffer variable */
+	return &curbuf->b_vars->dv_hashtab;
+    if (*name == 'w')				/* window variable */
+	return &curwin->w_vars->dv_hashtab;
+#ifdef FEAT_WINDOWS
+    if (*name == 't')				/* tab page variable */
+	return &curtab->tp_vars->dv_hashtab;
 #endif
+    if (*name == 'v')				/* v: variable */
+	return &vimvarht;
+    if (*name == 'a' && current_funccal != NULL) /* function argument */
+	return &current_funccal->l_avars.dv_hashtab;
+    if (*name == 'l' && current_funccal != NULL) /* local function variable */
+	return &current_funccal->l_vars.dv_hashtab;
+    if (*name == 's'				/* script variable */
+	    && current_SID > 0 && current_SID <= ga_scripts.ga_len)
+	return &SCRIPT_VARS(current_SID);
+    return NULL;
+}
 
-	return &pos;
-    }
+/*
+ * Get the string value of a (global/local) variable.
+ * Note: see get_tv_string() for how long the pointer remains valid.
+ * Returns NULL when it doesn't exist.
+ */
+    char_u *
+get_var_value(name)
+    char_u	*name;
+{
+    dictitem_T	*v;
 
-    name = get_tv_string_chk(varp);
-    if (name == NULL)
+    v = find_var(name, NULL, FALSE);
+    if (v == NULL)
 	return NULL;
-    if (name[0] == '.')				/* cursor */
-	return &curwin->w_cursor;
-    if (name[0] == 'v' && name[1] == NUL)	/* Visual start */
-    {
-	if (VIsual_active)
-	    return &VIsual;
-	return &curwin->w_cursor;
-    }
-    if (name[0] == '\'')			/* mark */
-    {
-	pp = getmark_buf_fnum(curbuf, name[1], FALSE, fnum);
-	if (pp == NULL || pp == (pos_T *)-1 || pp->lnum <= 0)
-	    return NULL;
-	return pp;
-    }
+    return get_tv_string(&v->di_tv);
+}
 
-#ifdef FEAT_VIRTUALEDIT
-    pos.coladd = 0;
-#endif
+/*
+ * Allocate a new hashtab for a sourced script.  It will be used while
+ * sourcing this script and when executing functions defined in the script.
+ */
+    void
+new_script_vars(id)
+    scid_T id;
+{
+    int		i;
+    hashtab_T	*ht;
+    scriptvar_T *sv;
 
-    if (name[0] == 'w' && dollar_lnum)
-    {
-	pos.col = 0;
-	if (name[1] == '0')		/* "w0": first visible line */
-	{
-	    update_topline();
-	    pos.lnum = curwin->w_topline;
-	    return &pos;
-	}
-	else if (name[1] == '$')	/* "w$": last visible line */
-	{
-	    validate_botline();
-	    pos.lnum = curwin->w_botline - 1;
-	    return &pos;
-	}
-    }
-    else if (name[0] == '$')		/* last column or line */
+    if (ga_grow(&ga_scripts, (int)(id - ga_scripts.ga_len)) == OK)
     {
-	if (dollar_lnum)
+	/* Re-allocating ga_data means that an ht_array pointing to
+	 * ht_smallarray becomes invalid.  We can recognize this: ht_mask is
+	 * at its init value.  Also reset "v_dict", it's always the same. */
+	for (i = 1; i <= ga_scripts.ga_len; ++i)
 	{
-	    pos.lnum = curbuf->b_ml.ml_line_count;
-	    pos.col = 0;
+	    ht = &SCRIPT_VARS(i);
+	    if (ht->ht_mask == HT_INIT_SIZE - 1)
+		ht->ht_array = ht->ht_smallarray;
+	    sv = SCRIPT_SV(i);
+	    sv->sv_var.di_tv.vval.v_dict = &sv->sv_dict;
 	}
-	else
+
+	while (ga_scripts.ga_len < id)
 	{
-	    pos.lnum = curwin->w_cursor.lnum;
-	    pos.col = (colnr_T)STRLEN(ml_get_curline());
+	    sv = SCRIPT_SV(ga_scripts.ga_len + 1) =
+		(scriptvar_T *)alloc_clear(sizeof(scriptvar_T));
+	    init_var_dict(&sv->sv_dict, &sv->sv_var, VAR_SCOPE);
+	    ++ga_scripts.ga_len;
 	}
-	return &pos;
     }
-    return NULL;
 }
 
 /*
- * Convert list in "arg" into a position and optional file number.
- * When "fnump" is NULL there is no file number, only 3 items.
- * Note that the column is passed on as-is, the caller may want to decrement
- * it to use 1 for the first column.
- * Return FAIL when conversion is not possible, doesn't check the position for
- * validity.
+ * Initialize dictionary "dict" as a scope and set variable "dict_var" to
+ * point to it.
  */
-    static int
-list2fpos(arg, posp, fnump)
-    typval_T	*arg;
-    pos_T	*posp;
-    int		*fnump;
+    void
+init_var_dict(dict, dict_var, scope)
+    dict_T	*dict;
+    dictitem_T	*dict_var;
+    int		scope;
 {
-    list_T	*l = arg->vval.v_list;
-    long	i = 0;
-    long	n;
-
-    /* List must be: [fnum, lnum, col, coladd], where "fnum" is only there
-     * when "fnump" isn't NULL and "coladd" is optional. */
-    if (arg->v_type != VAR_LIST
-	    || l == NULL
-	    || l->lv_len < (fnump == NULL ? 2 : 3)
-	    || l->lv_len > (fnump == NULL ? 3 : 4))
-	return FAIL;
-
-    if (fnump != NULL)
-    {
-	n = list_find_nr(l, i++, NULL);	/* fnum */
-	if (n < 0)
-	    return FAIL;
-	if (n == 0)
-	    n = curbuf->b_fnum;		/* current buffer */
-	*fnump = n;
-    }
-
-    n = list_find_nr(l, i++, NULL);	/* lnum */
-    if (n < 0)
-	return FAIL;
-    posp->lnum = n;
-
-    n = list_find_nr(l, i++, NULL);	/* col */
-    if (n < 0)
-	return FAIL;
-    posp->col = n;
+    hash_init(&dict->dv_hashtab);
+    dict->dv_lock = 0;
+    dict->dv_scope = scope;
+    dict->dv_refcount = DO_NOT_FREE_CNT;
+    dict->dv_copyID = 0;
+    dict_var->di_tv.vval.v_dict = dict;
+    dict_var->di_tv.v_type = VAR_DICT;
+    dict_var->di_tv.v_lock = VAR_FIXED;
+    dict_var->di_flags = DI_FLAGS_RO | DI_FLAGS_FIX;
+    dict_var->di_key[0] = NUL;
+}
 
-#ifdef FEAT_VIRTUALEDIT
-    n = list_find_nr(l, i, NULL);
-    if (n < 0)
-	posp->coladd = 0;
-    else
-	posp->coladd = n;
-#endif
+/*
+ * Unreference a dictionary initialized by init_var_dict().
+ */
+    void
+unref_var_dict(dict)
+    dict_T	*dict;
+{
+    /* Now the dict needs to be freed if no one else is using it, go back to
+     * normal reference counting. */
+    dict->dv_refcount -= DO_NOT_FREE_CNT - 1;
+    dict_unref(dict);
+}
 
-    return OK;
+/*
+ * Clean up a list of internal variables.
+ * Frees all allocated variables and the value they contain.
+ * Clears hashtab "ht", does not free it.
+ */
+    void
+vars_clear(ht)
+    hashtab_T *ht;
+{
+    vars_clear_ext(ht, TRUE);
 }
 
 /*
- * Get the length of an environment variable name.
- * Advance "arg" to the first character after the name.
- * Return 0 for error.
+ * Like vars_clear(), but only free the value if "free_val" is TRUE.
  */
-    static int
-get_env_len(arg)
-    char_u	**arg;
+    static void
+vars_clear_ext(ht, free_val)
+    hashtab_T	*ht;
+    int		free_val;
 {
-    char_u	*p;
-    int		len;
+    int		todo;
+    hashitem_T	*hi;
+    dictitem_T	*v;
 
-    for (p = *arg; vim_isIDc(*p); ++p)
-	;
-    if (p == *arg)	    /* no name found */
-	return 0;
+    ++eval_tick;
+    hash_lock(ht);
+    todo = (int)ht->ht_used;
+    for (hi = ht->ht_array; todo > 0; ++hi)
+    {
+	if (!HASHITEM_EMPTY(hi))
+	{
+	    --todo;
 
-    len = (int)(p - *arg);
-    *arg = p;
-    return len;
+	    /* Free the variable.  Don't remove it from the hashtab,
+	     * ht_array might change then.  hash_clear() takes care of it
+	     * later. */
+	    v = HI2DI(hi);
+	    if (free_val)
+		clear_tv(&v->di_tv);
+	    if ((v->di_flags & (DI_FLAGS_FIX | DI_FLAGS_NOFREE)) == 0)
+		vim_free(v);
+	}
+    }
+    hash_clear(ht);
+    ht->ht_used = 0;
 }
 
 /*
- * Get the length of the name of a function or internal variable.
- * "arg" is advanced to the first non-white character after the name.
- * Return 0 if something is wrong.
+ * Delete a variable from hashtab "ht" at item "hi".
+ * Clear the variable value and free the dictitem.
  */
-    static int
-get_id_len(arg)
-    char_u	**arg;
+    static void
+delete_var(ht, hi)
+    hashtab_T	*ht;
+    hashitem_T	*hi;
 {
-    char_u	*p;
-    int		len;
-
-    /* Find the end of the name. */
-    for (p = *arg; eval_isnamec(*p); ++p)
-	;
-    if (p == *arg)	    /* no name found */
-	return 0;
-
-    len = (int)(p - *arg);
-    *arg = skipwhite(p);
+    dictitem_T	*di = HI2DI(hi);
 
-    return len;
+    hash_remove(ht, hi);
+    clear_tv(&di->di_tv);
+    if ((di->di_flags & DI_FLAGS_NOFREE) == 0)
+	vim_free(di);
 }
 
 /*
- * Get the length of the name of a variable or function.
- * Only the name is recognized, does not handle ".key" or "[idx]".
- * "arg" is advanced to the first non-white character after the name.
- * Return -1 if curly braces expansion failed.
- * Return 0 if something else is wrong.
- * If the name contains 'magic' {}'s, expand them and return the
- * expanded name in an allocated string via 'alias' - caller must free.
+ * List the value of one internal variable.
  */
-    static int
-get_name_len(arg, alias, evaluate, verbose)
-    char_u	**arg;
-    char_u	**alias;
-    int		evaluate;
-    int		verbose;
+    static void
+list_one_var(v, prefix, first)
+    dictitem_T	*v;
+    char_u	*prefix;
+    int		*first;
 {
-    int		len;
-    char_u	*p;
-    char_u	*expr_start;
-    char_u	*expr_end;
+    char_u	*tofree;
+    char_u	*s;
+    char_u	numbuf[NUMBUFLEN];
 
-    *alias = NULL;  /* default to no alias */
+    current_copyID += COPYID_INC;
+    s = echo_string(&v->di_tv, &tofree, numbuf, current_copyID);
+    list_one_var_a(prefix, v->di_key, v->di_tv.v_type,
+					 s == NULL ? (char_u *)"" : s, first);
+    vim_free(tofree);
+}
 
-    if ((*arg)[0] == K_SPECIAL && (*arg)[1] == KS_EXTRA
-						  && (*arg)[2] == (int)KE_SNR)
+    static void
+list_one_var_a(prefix, name, type, string, first)
+    char_u	*prefix;
+    char_u	*name;
+    int		type;
+    char_u	*string;
+    int		*first;  /* when TRUE clear rest of screen and set to FALSE */
+{
+    /* don't use msg() or msg_attr() to avoid overwriting "v:statusmsg" */
+    msg_start();
+    msg_puts(prefix);
+    if (name != NULL)	/* "a:" vars don't have a name stored */
+	msg_puts(name);
+    msg_putchar(' ');
+    msg_advance(22);
+    if (type == VAR_NUMBER)
+	msg_putchar('#');
+    else if (type == VAR_FUNC)
+	msg_putchar('*');
+    else if (type == VAR_LIST)
     {
-	/* hard coded <SNR>, already translated */
-	*arg += 3;
-	return get_id_len(arg) + 3;
+	msg_putchar('[');
+	if (*string == '[')
+	    ++string;
     }
-    len = eval_fname_script(*arg);
-    if (len > 0)
+    else if (type == VAR_DICT)
     {
-	/* literal "<SID>", "s:" or "<SNR>" */
-	*arg += len;
+	msg_putchar('{');
+	if (*string == '{')
+	    ++string;
     }
+    else
+	msg_putchar(' ');
 
-    /*
-     * Find the end of the name; check for {} construction.
-     */
-    p = find_name_end(*arg, &expr_start, &expr_end,
-					       len > 0 ? 0 : FNE_CHECK_START);
-    if (expr_start != NULL)
-    {
-	char_u	*temp_string;
-
-	if (!evaluate)
-	{
-	    len += (int)(p - *arg);
-	    *arg = skipwhite(p);
-	    return len;
-	}
+    msg_outtrans(string);
 
-	/*
-	 * Include any <SID> etc in the expanded string:
-	 * Thus the -len here.
-	 */
-	temp_string = make_expanded_name(*arg - len, expr_start, expr_end, p);
-	if (temp_string == NULL)
-	    return -1;
-	*alias = temp_string;
-	*arg = skipwhite(p);
-	return (int)STRLEN(temp_string);
+    if (type == VAR_FUNC)
+	msg_puts((char_u *)"()");
+    if (*first)
+    {
+	msg_clr_eos();
+	*first = FALSE;
     }
-
-    len += get_id_len(arg);
-    if (len == 0 && verbose)
-	EMSG2(_(e_invexpr2), *arg);
-
-    return len;
 }
 
 /*
- * Find the end of a variable or function name, taking care of magic braces.
- * If "expr_start" is not NULL then "expr_start" and "expr_end" are set to the
- * start and end of the first magic braces item.
- * "flags" can have FNE_INCL_BR and FNE_CHECK_START.
- * Return a pointer to just after the name.  Equal to "arg" if there is no
- * valid name.
+ * Set variable "name" to value in "tv".
+ * If the variable already exists, the value is updated.
+ * Otherwise the variable is created.
  */
-    static char_u *
-find_name_end(arg, expr_start, expr_end, flags)
-    char_u	*arg;
-    char_u	**expr_start;
-    char_u	**expr_end;
-    int		flags;
+    static void
+set_var(name, tv, copy)
+    char_u	*name;
+    typval_T	*tv;
+    int		copy;	    /* make copy of value in "tv" */
 {
-    int		mb_nest = 0;
-    int		br_nest = 0;
-    char_u	*p;
+    dictitem_T	*v;
+    char_u	*varname;
+    hashtab_T	*ht;
 
-    if (expr_start != NULL)
+    ht = find_var_ht(name, &varname);
+    if (ht == NULL || *varname == NUL)
     {
-	*expr_start = NULL;
-	*expr_end = NULL;
+	EMSG2(_(e_illvar), name);
+	return;
     }
+    v = find_var_in_ht(ht, 0, varname, TRUE);
 
-    /* Quick check for valid starting character. */
-    if ((flags & FNE_CHECK_START) && !eval_isnamec1(*arg) && *arg != '{')
-	return arg;
+    if (tv->v_type == VAR_FUNC && var_check_func_name(name, v == NULL))
+	return;
 
-    for (p = arg; *p != NUL
-		    && (eval_isnamec(*p)
-			|| *p == '{'
-			|| ((flags & FNE_INCL_BR) && (*p == '[' || *p == '.'))
-			|| mb_nest != 0
-			|| br_nest != 0); mb_ptr_adv(p))
+    if (v != NULL)
     {
-	if (*p == '\'')
-	{
-	    /* skip over 'string' to avoid counting [ and ] inside it. */
-	    for (p = p + 1; *p != NUL && *p != '\''; mb_ptr_adv(p))
-		;
-	    if (*p == NUL)
-		break;
-	}
-	else if (*p == '"')
+	/* existing variable, need to clear the value */
+	if (var_check_set(v, name, tv))
+	    return;
+
+	/*
+	 * Handle setting internal v: variables separately: we don't change
+	 * the type.
+	 */
+	if (ht == &vimvarht)
 	{
-	    /* skip over "str\"ing" to avoid counting [ and ] inside it. */
-	    for (p = p + 1; *p != NUL && *p != '"'; mb_ptr_adv(p))
-		if (*p == '\\' && p[1] != NUL)
-		    ++p;
-	    if (*p == NUL)
-		break;
+	    if (v->di_tv.v_type == VAR_STRING)
+	    {
+		vim_free(v->di_tv.vval.v_string);
+		if (copy || tv->v_type != VAR_STRING)
+		    v->di_tv.vval.v_string = vim_strsave(get_tv_string(tv));
+		else
+		{
+		    /* Take over the string to avoid an extra alloc/free. */
+		    v->di_tv.vval.v_string = tv->vval.v_string;
+		    tv->vval.v_string = NULL;
+		}
+	    }
+	    else if (v->di_tv.v_type != VAR_NUMBER)
+		EMSG2(_(e_intern2), "set_var()");
+	    else
+	    {
+		v->di_tv.vval.v_number = get_tv_number(tv);
+		if (STRCMP(varname, "searchforward") == 0)
+		    set_search_direction(v->di_tv.vval.v_number ? '/' : '?');
+#ifdef FEAT_SEARCH_EXTRA
+		else if (STRCMP(varname, "hlsearch") == 0)
+		{
+		    no_hlsearch = !v->di_tv.vval.v_number;
+		    redraw_all_later(SOME_VALID);
+		}
+#endif
+	    }
+	    return;
 	}
 
-	if (mb_nest == 0)
+	clear_tv(&v->di_tv);
+    }
+    else		    /* add a new variable */
+    {
+	/* Can't add "v:" variable. */
+	if (ht == &vimvarht)
 	{
-	    if (*p == '[')
-		++br_nest;
-	    else if (*p == ']')
-		--br_nest;
+	    EMSG2(_(e_illvar), name);
+	    return;
 	}
 
-	if (br_nest == 0)
+	/* Make sure the variable name is valid. */
+	if (!valid_varname(varname))
+	    return;
+
+	v = (dictitem_T *)alloc((unsigned)(sizeof(dictitem_T)
+							  + STRLEN(varname)));
+	if (v == NULL)
+	    return;
+	STRCPY(v->di_key, varname);
+	if (hash_add(ht, DI2HIKEY(v)) == FAIL)
 	{
-	    if (*p == '{')
-	    {
-		mb_nest++;
-		if (expr_start != NULL && *expr_start == NULL)
-		    *expr_start = p;
-	    }
-	    else if (*p == '}')
-	    {
-		mb_nest--;
-		if (expr_start != NULL && mb_nest == 0 && *expr_end == NULL)
-		    *expr_end = p;
-	    }
+	    vim_free(v);
+	    return;
 	}
+	v->di_flags = 0;
     }
 
-    return p;
+    set_var_value(v, tv, copy);
 }
 
 /*
- * Expands out the 'magic' {}'s in a variable/function name.
- * Note that this can call itself recursively, to deal with
- * constructs like foo{bar}{baz}{bam}
- * The four pointer arguments point to "foo{expre}ss{ion}bar"
- *			"in_start"      ^
- *			"expr_start"	   ^
- *			"expr_end"		 ^
- *			"in_end"			    ^
- *
- * Returns a new allocated string, which the caller must free.
- * Returns NULL for failure.
+ * Return TRUE if existing variable "v" can't be set to the value in "tv":
+ * it is read-only, locked or has another type.  Also give an error message.
  */
-    static char_u *
-make_expanded_name(in_start, expr_start, expr_end, in_end)
-    char_u	*in_start;
-    char_u	*expr_start;
-    char_u	*expr_end;
-    char_u	*in_end;
+    static int
+var_check_set(v, name, tv)
+    dictitem_T	*v;
+    char_u	*name;
+    typval_T	*tv;
 {
-    char_u	c1;
-    char_u	*retval = NULL;
-    char_u	*temp_result;
-    char_u	*nextcmd = NULL;
-
-    if (expr_end == NULL || in_end == NULL)
-	return NULL;
-    *expr_start	= NUL;
-    *expr_end = NUL;
-    c1 = *in_end;
-    *in_end = NUL;
+    if (var_check_ro(v->di_flags, name)
+				      || tv_check_lock(v->di_tv.v_lock, name))
+	return TRUE;
+    if (v->di_tv.v_type != tv->v_type
+	    && !((v->di_tv.v_type == VAR_STRING
+		    || v->di_tv.v_type == VAR_NUMBER)
+		&& (tv->v_type == VAR_STRING
+		    || tv->v_type == VAR_NUMBER))
+#ifdef FEAT_FLOAT
+	    && !((v->di_tv.v_type == VAR_NUMBER
+		    || v->di_tv.v_type == VAR_FLOAT)
+		&& (tv->v_type == VAR_NUMBER
+		    || tv->v_type == VAR_FLOAT))
+#endif
+	    )
+    {
+	EMSG2(_("E706: Variable type mismatch for: %s"), name);
+	return TRUE;
+    }
+    return FALSE;
+}
 
-    temp_result = eval_to_string(expr_start + 1, &nextcmd, FALSE);
-    if (temp_result != NULL && nextcmd == NULL)
+/*
+ * Set the value of variable "v", which must be empty, to "tv".
+ * When "copy" is FALSE the value is moved and "tv" is cleared.
+ */
+    static void
+set_var_value(v, tv, copy)
+    dictitem_T	*v;
+    typval_T	*tv;
+    int		copy;
+{
+    if (copy || tv->v_type == VAR_NUMBER || tv->v_type == VAR_FLOAT)
+	copy_tv(tv, &v->di_tv);
+    else
     {
-	retval = alloc((unsigned)(STRLEN(temp_result) + (expr_start - in_start)
-						   + (in_end - expr_end) + 1));
-	if (retval != NULL)
-	{
-	    STRCPY(retval, in_start);
-	    STRCAT(retval, temp_result);
-	    STRCAT(retval, expr_end + 1);
-	}
+	v->di_tv = *tv;
+	v->di_tv.v_lock = 0;
+	init_tv(tv);
     }
-    vim_free(temp_result);
-
-    *in_end = c1;		/* put char back for error messages */
-    *expr_start = '{';
-    *expr_end = '}';
+}
 
-    if (retval != NULL)
+/*
+ * Return TRUE if di_flags "flags" indicates variable "name" is read-only.
+ * Also give an error message.
+ */
+    static int
+var_check_ro(flags, name)
+    int		flags;
+    char_u	*name;
+{
+    if (flags & DI_FLAGS_RO)
     {
-	temp_result = find_name_end(retval, &expr_start, &expr_end, 0);
-	if (expr_start != NULL)
-	{
-	    /* Further expansion! */
-	    temp_result = make_expanded_name(retval, expr_start,
-						       expr_end, temp_result);
-	    vim_free(retval);
-	    retval = temp_result;
-	}
+	EMSG2(_(e_readonlyvar), name);
+	return TRUE;
     }
-
-    return retval;
+    if ((flags & DI_FLAGS_RO_SBX) && sandbox)
+    {
+	EMSG2(_(e_readonlysbx), name);
+	return TRUE;
+    }
+    return FALSE;
 }
 
 /*
- * Return TRUE if character "c" can be used in a variable or function name.
- * Does not include '{' or '}' for magic braces.
+ * Return TRUE if di_flags "flags" indicates variable "name" is fixed.
+ * Also give an error message.
  */
     static int
-eval_isnamec(c)
-    int	    c;
+var_check_fixed(flags, name)
+    int		flags;
+    char_u	*name;
 {
-    return (ASCII_ISALNUM(c) || c == '_' || c == ':' || c == AUTOLOAD_CHAR);
+    if (flags & DI_FLAGS_FIX)
+    {
+	EMSG2(_("E795: Cannot delete variable %s"), name);
+	return TRUE;
+    }
+    return FALSE;
 }
 
 /*
- * Return TRUE if character "c" can be used as the first character in a
- * variable or function name (excluding '{' and '}').
+ * Check if a funcref is assigned to a valid variable name.
+ * Return TRUE and give an error if not.
  */
     static int
-eval_isnamec1(c)
-    int	    c;
+var_check_func_name(name, new_var)
+    char_u *name;    /* points to start of variable name */
+    int    new_var;  /* TRUE when creating the variable */
 {
-    return (ASCII_ISALPHA(c) || c == '_');
+    if (!(vim_strchr((char_u *)"wbs", name[0]) != NULL && name[1] == ':')
+	    && !ASCII_ISUPPER((name[0] != NUL && name[1] == ':')
+						     ? name[2] : name[0]))
+    {
+	EMSG2(_("E704: Funcref variable name must start with a capital: %s"),
+									name);
+	return TRUE;
+    }
+    /* Don't allow hiding a function.  When "v" is not NULL we might be
+     * assigning another function to the same var, the type is checked
+     * below. */
+    if (new_var && function_exists(name))
+    {
+	EMSG2(_("E705: Variable name conflicts with existing function: %s"),
+								    name);
+	return TRUE;
+    }
+    return FALSE;
 }
 
 /*
- * Set number v: variable to "val".
+ * Check if a variable name is valid.
+ * Return FALSE and give an error if not.
  */
-    void
-set_vim_var_nr(idx, val)
-    int		idx;
-    long	val;
+    static int
+valid_varname(varname)
+    char_u *varname;
 {
-    vimvars[idx].vv_nr = val;
+    char_u *p;
+
+    for (p = varname; *p != NUL; ++p)
+	if (!eval_isnamec1(*p) && (p == varname || !VIM_ISDIGIT(*p))
+						   && *p != AUTOLOAD_CHAR)
+	{
+	    EMSG2(_(e_illvar), varname);
+	    return FALSE;
+	}
+    return TRUE;
 }
 
 /*
- * Get number v: variable value.
+ * Return TRUE if typeval "tv" is set to be locked (immutable).
+ * Also give an error message, using "name".
  */
-    long
-get_vim_var_nr(idx)
-    int		idx;
+    static int
+tv_check_lock(lock, name)
+    int		lock;
+    char_u	*name;
 {
-    return vimvars[idx].vv_nr;
+    if (lock & VAR_LOCKED)
+    {
+	EMSG2(_("E741: Value is locked: %s"),
+				name == NULL ? (char_u *)_("Unknown") : name);
+	return TRUE;
+    }
+    if (lock & VAR_FIXED)
+    {
+	EMSG2(_("E742: Cannot change value of %s"),
+				name == NULL ? (char_u *)_("Unknown") : name);
+	return TRUE;
+    }
+    return FALSE;
 }
 
 /*
- * Get string v: variable value.  Uses a static buffer, can only be used once.
+ * Copy the values from typval_T "from" to typval_T "to".
+ * When needed allocates string or increases reference count.
+ * Does not make a copy of a list or dict but copies the reference!
+ * It is OK for "from" and "to" to point to the same item.  This is used to
+ * make a copy later.
  */
-    char_u *
-get_vim_var_str(idx)
-    int		idx;
+    void
+copy_tv(from, to)
+    typval_T *from;
+    typval_T *to;
 {
-    return get_tv_string(&vimvars[idx].vv_tv);
+    to->v_type = from->v_type;
+    to->v_lock = 0;
+    switch (from->v_type)
+    {
+	case VAR_NUMBER:
+	    to->vval.v_number = from->vval.v_number;
+	    break;
+#ifdef FEAT_FLOAT
+	case VAR_FLOAT:
+	    to->vval.v_float = from->vval.v_float;
+	    break;
+#endif
+	case VAR_STRING:
+	case VAR_FUNC:
+	    if (from->vval.v_string == NULL)
+		to->vval.v_string = NULL;
+	    else
+	    {
+		to->vval.v_string = vim_strsave(from->vval.v_string);
+		if (from->v_type == VAR_FUNC)
+		    func_ref(to->vval.v_string);
+	    }
+	    break;
+	case VAR_LIST:
+	    if (from->vval.v_list == NULL)
+		to->vval.v_list = NULL;
+	    else
+	    {
+		to->vval.v_list = from->vval.v_list;
+		++to->vval.v_list->lv_refcount;
+	    }
+	    break;
+	case VAR_DICT:
+	    if (from->vval.v_dict == NULL)
+		to->vval.v_dict = NULL;
+	    else
+	    {
+		to->vval.v_dict = from->vval.v_dict;
+		++to->vval.v_dict->dv_refcount;
+	    }
+	    break;
+	default:
+	    EMSG2(_(e_intern2), "copy_tv()");
+	    break;
+    }
 }
 
 /*
- * Get List v: variable value.  Caller must take care of reference count when
- * needed.
+ * Make a copy of an item.
+ * Lists and Dictionaries are also copied.  A deep copy if "deep" is set.
+ * For deepcopy() "copyID" is zero for a full copy or the ID for when a
+ * reference to an already copied list/dict can be used.
+ * Returns FAIL or OK.
  */
-    list_T *
-get_vim_var_list(idx)
-    int		idx;
+    static int
+item_copy(from, to, deep, copyID)
+    typval_T	*from;
+    typval_T	*to;
+    int		deep;
+    int		copyID;
 {
-    return vimvars[idx].vv_list;
+    static int	recurse = 0;
+    int		ret = OK;
+
+    if (recurse >= DICT_MAXNEST)
+    {
+	EMSG(_("E698: variable nested too deep for making a copy"));
+	return FAIL;
+    }
+    ++recurse;
+
+    switch (from->v_type)
+    {
+	case VAR_NUMBER:
+#ifdef FEAT_FLOAT
+	case VAR_FLOAT:
+#endif
+	case VAR_STRING:
+	case VAR_FUNC:
+	    copy_tv(from, to);
+	    break;
+	case VAR_LIST:
+	    to->v_type = VAR_LIST;
+	    to->v_lock = 0;
+	    if (from->vval.v_list == NULL)
+		to->vval.v_list = NULL;
+	    else if (copyID != 0 && from->vval.v_list->lv_copyID == copyID)
+	    {
+		/* use the copy made earlier */
+		to->vval.v_list = from->vval.v_list->lv_copylist;
+		++to->vval.v_list->lv_refcount;
+	    }
+	    else
+		to->vval.v_list = list_copy(from->vval.v_list, deep, copyID);
+	    if (to->vval.v_list == NULL)
+		ret = FAIL;
+	    break;
+	case VAR_DICT:
+	    to->v_type = VAR_DICT;
+	    to->v_lock = 0;
+	    if (from->vval.v_dict == NULL)
+		to->vval.v_dict = NULL;
+	    else if (copyID != 0 && from->vval.v_dict->dv_copyID == copyID)
+	    {
+		/* use the copy made earlier */
+		to->vval.v_dict = from->vval.v_dict->dv_copydict;
+		++to->vval.v_dict->dv_refcount;
+	    }
+	    else
+		to->vval.v_dict = dict_copy(from->vval.v_dict, deep, copyID);
+	    if (to->vval.v_dict == NULL)
+		ret = FAIL;
+	    break;
+	default:
+	    EMSG2(_(e_intern2), "item_copy()");
+	    ret = FAIL;
+    }
+    --recurse;
+    return ret;
 }
 
 /*
- * Set v:char to character "c".
+ * ":echo expr1 ..."	print each argument separated with a space, add a
+ *			newline at the end.
+ * ":echon expr1 ..."	print each argument plain.
  */
     void
-set_vim_var_char(c)
-    int c;
+ex_echo(eap)
+    exarg_T	*eap;
 {
-    char_u	buf[MB_MAXBYTES + 1];
+    char_u	*arg = eap->arg;
+    typval_T	rettv;
+    char_u	*tofree;
+    char_u	*p;
+    int		needclr = TRUE;
+    int		atstart = TRUE;
+    char_u	numbuf[NUMBUFLEN];
+
+    if (eap->skip)
+	++emsg_skip;
+    while (*arg != NUL && *arg != '|' && *arg != '\n' && !got_int)
+    {
+	/* If eval1() causes an error message the text from the command may
+	 * still need to be cleared. E.g., "echo 22,44". */
+	need_clr_eos = needclr;
+
+	p = arg;
+	if (eval1(&arg, &rettv, !eap->skip) == FAIL)
+	{
+	    /*
+	     * Report the invalid expression unless the expression evaluation
+	     * has been cancelled due to an aborting error, an interrupt, or an
+	     * exception.
+	     */
+	    if (!aborting())
+		EMSG2(_(e_invexpr2), p);
+	    need_clr_eos = FALSE;
+	    break;
+	}
+	need_clr_eos = FALSE;
 
+	if (!eap->skip)
+	{
+	    if (atstart)
+	    {
+		atstart = FALSE;
+		/* Call msg_start() after eval1(), evaluating the expression
+		 * may cause a message to appear. */
+		if (eap->cmdidx == CMD_echo)
+		{
+		    /* Mark the saved text as finishing the line, so that what
+		     * follows is displayed on a new line when scrolling back
+		     * at the more prompt. */
+		    msg_sb_eol();
+		    msg_start();
+		}
+	    }
+	    else if (eap->cmdidx == CMD_echo)
+		msg_puts_attr((char_u *)" ", echo_attr);
+	    current_copyID += COPYID_INC;
+	    p = echo_string(&rettv, &tofree, numbuf, current_copyID);
+	    if (p != NULL)
+		for ( ; *p != NUL && !got_int; ++p)
+		{
+		    if (*p == '\n' || *p == '\r' || *p == TAB)
+		    {
+			if (*p != TAB && needclr)
+			{
+			    /* remove any text still there from the command */
+			    msg_clr_eos();
+			    needclr = FALSE;
+			}
+			msg_putchar_attr(*p, echo_attr);
+		    }
+		    else
+		    {
 #ifdef FEAT_MBYTE
-    if (has_mbyte)
-	buf[(*mb_char2bytes)(c, buf)] = NUL;
-    else
+			if (has_mbyte)
+			{
+			    int i = (*mb_ptr2len)(p);
+
+			    (void)msg_outtrans_len_attr(p, i, echo_attr);
+			    p += i - 1;
+			}
+			else
 #endif
-    {
-	buf[0] = c;
-	buf[1] = NUL;
+			    (void)msg_outtrans_len_attr(p, 1, echo_attr);
+		    }
+		}
+	    vim_free(tofree);
+	}
+	clear_tv(&rettv);
+	arg = skipwhite(arg);
     }
-    set_vim_var_string(VV_CHAR, buf, -1);
-}
+    eap->nextcmd = check_nextcmd(arg);
 
-/*
- * Set v:count to "count" and v:count1 to "count1".
- * When "set_prevcount" is TRUE first set v:prevcount from v:count.
- */
-    void
-set_vcount(count, count1, set_prevcount)
-    long	count;
-    long	count1;
-    int		set_prevcount;
-{
-    if (set_prevcount)
-	vimvars[VV_PREVCOUNT].vv_nr = vimvars[VV_COUNT].vv_nr;
-    vimvars[VV_COUNT].vv_nr = count;
-    vimvars[VV_COUNT1].vv_nr = count1;
+    if (eap->skip)
+	--emsg_skip;
+    else
+    {
+	/* remove text that may still be there from the command */
+	if (needclr)
+	    msg_clr_eos();
+	if (eap->cmdidx == CMD_echo)
+	    msg_end();
+    }
 }
 
 /*
- * Set string v: variable to a copy of "val".
+ * ":echohl {name}".
  */
     void
-set_vim_var_string(idx, val, len)
-    int		idx;
-    char_u	*val;
-    int		len;	    /* length of "val" to use or -1 (whole string) */
+ex_echohl(eap)
+    exarg_T	*eap;
 {
-    /* Need to do this (at least) once, since we can't initialize a union.
-     * Will always be invoked when "v:progname" is set. */
-    vimvars[VV_VERSION].vv_nr = VIM_VERSION_100;
+    int		id;
 
-    vim_free(vimvars[idx].vv_str);
-    if (val == NULL)
-	vimvars[idx].vv_str = NULL;
-    else if (len == -1)
-	vimvars[idx].vv_str = vim_strsave(val);
+    id = syn_name2id(eap->arg);
+    if (id == 0)
+	echo_attr = 0;
     else
-	vimvars[idx].vv_str = vim_strnsave(val, len);
+	echo_attr = syn_id2attr(id);
 }
 
 /*
- * Set List v: variable to "val".
+ * ":execute expr1 ..."	execute the result of an expression.
+ * ":echomsg expr1 ..."	Print a message
+ * ":echoerr expr1 ..."	Print an error
+ * Each gets spaces around each argument and a newline at the end for
+ * echo commands
  */
     void
-set_vim_var_list(idx, val)
-    int		idx;
-    list_T	*val;
+ex_execute(eap)
+    exarg_T	*eap;
 {
-    list_unref(vimvars[idx].vv_list);
-    vimvars[idx].vv_list = val;
-    if (val != NULL)
-	++val->lv_refcount;
-}
+    char_u	*arg = eap->arg;
+    typval_T	rettv;
+    int		ret = OK;
+    char_u	*p;
+    garray_T	ga;
+    int		len;
+    int		save_did_emsg;
 
-/*
- * Set v:register if needed.
- */
-    void
-set_reg_var(c)
-    int		c;
-{
-    char_u	regname;
+    ga_init2(&ga, 1, 80);
 
-    if (c == 0 || c == ' ')
-	regname = '"';
-    else
-	regname = c;
-    /* Avoid free/alloc when the value is already right. */
-    if (vimvars[VV_REG].vv_str == NULL || vimvars[VV_REG].vv_str[0] != c)
-	set_vim_var_string(VV_REG, &regname, 1);
-}
+    if (eap->skip)
+	++emsg_skip;
+    while (*arg != NUL && *arg != '|' && *arg != '\n')
+    {
+	p = arg;
+	if (eval1(&arg, &rettv, !eap->skip) == FAIL)
+	{
+	    /*
+	     * Report the invalid expression unless the expression evaluation
+	     * has been cancelled due to an aborting error, an interrupt, or an
+	     * exception.
+	     */
+	    if (!aborting())
+		EMSG2(_(e_invexpr2), p);
+	    ret = FAIL;
+	    break;
+	}
 
-/*
- * Get or set v:exception.  If "oldval" == NULL, return the current value.
- * Otherwise, restore the value to "oldval" and return NULL.
- * Must always be called in pairs to save and restore v:exception!  Does not
- * take care of memory allocations.
- */
-    char_u *
-v_exception(oldval)
-    char_u	*oldval;
-{
-    if (oldval == NULL)
-	return vimvars[VV_EXCEPTION].vv_str;
+	if (!eap->skip)
+	{
+	    p = get_tv_string(&rettv);
+	    len = (int)STRLEN(p);
+	    if (ga_grow(&ga, len + 2) == FAIL)
+	    {
+		clear_tv(&rettv);
+		ret = FAIL;
+		break;
+	    }
+	    if (ga.ga_len)
+		((char_u *)(ga.ga_data))[ga.ga_len++] = ' ';
+	    STRCPY((char_u *)(ga.ga_data) + ga.ga_len, p);
+	    ga.ga_len += len;
+	}
+
+	clear_tv(&rettv);
+	arg = skipwhite(arg);
+    }
+
+    if (ret != FAIL && ga.ga_data != NULL)
+    {
+	if (eap->cmdidx == CMD_echomsg)
+	{
+	    MSG_ATTR(ga.ga_data, echo_attr);
+	    out_flush();
+	}
+	else if (eap->cmdidx == CMD_echoerr)
+	{
+	    /* We don't want to abort following commands, restore did_emsg. */
+	    save_did_emsg = did_emsg;
+	    EMSG((char_u *)ga.ga_data);
+	    if (!force_abort)
+		did_emsg = save_did_emsg;
+	}
+	else if (eap->cmdidx == CMD_execute)
+	    do_cmdline((char_u *)ga.ga_data,
+		       eap->getline, eap->cookie, DOCMD_NOWAIT|DOCMD_VERBOSE);
+    }
 
-    vimvars[VV_EXCEPTION].vv_str = oldval;
-    return NULL;
-}
+    ga_clear(&ga);
 
-/*
- * Get or set v:throwpoint.  If "oldval" == NULL, return the current value.
- * Otherwise, restore the value to "oldval" and return NULL.
- * Must always be called in pairs to save and restore v:throwpoint!  Does not
- * take care of memory allocations.
- */
-    char_u *
-v_throwpoint(oldval)
-    char_u	*oldval;
-{
-    if (oldval == NULL)
-	return vimvars[VV_THROWPOINT].vv_str;
+    if (eap->skip)
+	--emsg_skip;
 
-    vimvars[VV_THROWPOINT].vv_str = oldval;
-    return NULL;
+    eap->nextcmd = check_nextcmd(arg);
 }
 
-#if defined(FEAT_AUTOCMD) || defined(PROTO)
 /*
- * Set v:cmdarg.
- * If "eap" != NULL, use "eap" to generate the value and return the old value.
- * If "oldarg" != NULL, restore the value to "oldarg" and return NULL.
- * Must always be called in pairs!
+ * Skip over the name of an option: "&option", "&g:option" or "&l:option".
+ * "arg" points to the "&" or '+' when called, to "option" when returning.
+ * Returns NULL when no option name found.  Otherwise pointer to the char
+ * after the option name.
  */
-    char_u *
-set_cmdarg(eap, oldarg)
-    exarg_T	*eap;
-    char_u	*oldarg;
+    static char_u *
+find_option_end(arg, opt_flags)
+    char_u	**arg;
+    int		*opt_flags;
 {
-    char_u	*oldval;
-    char_u	*newval;
-    unsigned	len;
+    char_u	*p = *arg;
 
-    oldval = vimvars[VV_CMDARG].vv_str;
-    if (eap == NULL)
+    ++p;
+    if (*p == 'g' && p[1] == ':')
     {
-	vim_free(oldval);
-	vimvars[VV_CMDARG].vv_str = oldarg;
-	return NULL;
+	*opt_flags = OPT_GLOBAL;
+	p += 2;
+    }
+    else if (*p == 'l' && p[1] == ':')
+    {
+	*opt_flags = OPT_LOCAL;
+	p += 2;
     }
-
-    if (eap->force_bin == FORCE_BIN)
-	len = 6;
-    else if (eap->force_bin == FORCE_NOBIN)
-	len = 8;
     else
-	len = 0;
-
-    if (eap->read_edit)
-	len += 7;
-
-    if (eap->force_ff != 0)
-	len += (unsigned)STRLEN(eap->cmd + eap->force_ff) + 6;
-# ifdef FEAT_MBYTE
-    if (eap->force_enc != 0)
-	len += (unsigned)STRLEN(eap->cmd + eap->force_enc) + 7;
-    if (eap->bad_char != 0)
-	len += 7 + 4;  /* " ++bad=" + "keep" or "drop" */
-# endif
+	*opt_flags = 0;
 
-    newval = alloc(len + 1);
-    if (newval == NULL)
+    if (!ASCII_ISALPHA(*p))
 	return NULL;
+    *arg = p;
 
-    if (eap->force_bin == FORCE_BIN)
-	sprintf((char *)newval, " ++bin");
-    else if (eap->force_bin == FORCE_NOBIN)
-	sprintf((char *)newval, " ++nobin");
+    if (p[0] == 't' && p[1] == '_' && p[2] != NUL && p[3] != NUL)
+	p += 4;	    /* termcap option */
     else
-	*newval = NUL;
-
-    if (eap->read_edit)
-	STRCAT(newval, " ++edit");
-
-    if (eap->force_ff != 0)
-	sprintf((char *)newval + STRLEN(newval), " ++ff=%s",
-						eap->cmd + eap->force_ff);
-# ifdef FEAT_MBYTE
-    if (eap->force_enc != 0)
-	sprintf((char *)newval + STRLEN(newval), " ++enc=%s",
-					       eap->cmd + eap->force_enc);
-    if (eap->bad_char == BAD_KEEP)
-	STRCPY(newval + STRLEN(newval), " ++bad=keep");
-    else if (eap->bad_char == BAD_DROP)
-	STRCPY(newval + STRLEN(newval), " ++bad=drop");
-    else if (eap->bad_char != 0)
-	sprintf((char *)newval + STRLEN(newval), " ++bad=%c", eap->bad_char);
-# endif
-    vimvars[VV_CMDARG].vv_str = newval;
-    return oldval;
+	while (ASCII_ISALPHA(*p))
+	    ++p;
+    return p;
 }
-#endif
 
 /*
- * Get the value of internal variable "name".
- * Return OK or FAIL.
+ * ":function"
  */
-    static int
-get_var_tv(name, len, rettv, verbose, no_autoload)
-    char_u	*name;
-    int		len;		/* length of "name" */
-    typval_T	*rettv;		/* NULL when only checking existence */
-    int		verbose;	/* may give error message */
-    int		no_autoload;	/* do not use script autoloading */
+    void
+ex_function(eap)
+    exarg_T	*eap;
 {
-    int		ret = OK;
-    typval_T	*tv = NULL;
-    typval_T	atv;
+    char_u	*theline;
+    int		i;
+    int		j;
+    int		c;
+    int		saved_did_emsg;
+    int		saved_wait_return = need_wait_return;
+    char_u	*name = NULL;
+    char_u	*p;
+    char_u	*arg;
+    char_u	*line_arg = NULL;
+    garray_T	newargs;
+    garray_T	newlines;
+    int		varargs = FALSE;
+    int		mustend = FALSE;
+    int		flags = 0;
+    ufunc_T	*fp;
+    int		indent;
+    int		nesting;
+    char_u	*skip_until = NULL;
     dictitem_T	*v;
-    int		cc;
+    funcdict_T	fudi;
+    static int	func_nr = 0;	    /* number for nameless function */
+    int		paren;
+    hashtab_T	*ht;
+    int		todo;
+    hashitem_T	*hi;
+    int		sourcing_lnum_off;
 
-    /* truncate the name, so that we can use strcmp() */
-    cc = name[len];
-    name[len] = NUL;
+    /*
+     * ":function" without argument: list functions.
+     */
+    if (ends_excmd(*eap->arg))
+    {
+	if (!eap->skip)
+	{
+	    todo = (int)func_hashtab.ht_used;
+	    for (hi = func_hashtab.ht_array; todo > 0 && !got_int; ++hi)
+	    {
+		if (!HASHITEM_EMPTY(hi))
+		{
+		    --todo;
+		    fp = HI2UF(hi);
+		    if (!isdigit(*fp->uf_name))
+			list_func_head(fp, FALSE);
+		}
+	    }
+	}
+	eap->nextcmd = check_nextcmd(eap->arg);
+	return;
+    }
+
+    /*
+     * ":function /pat": list functions matching pattern.
+     */
+    if (*eap->arg == '/')
+    {
+	p = skip_regexp(eap->arg + 1, '/', TRUE, NULL);
+	if (!eap->skip)
+	{
+	    regmatch_T	regmatch;
+
+	    c = *p;
+	    *p = NUL;
+	    regmatch.regprog = vim_regcomp(eap->arg + 1, RE_MAGIC);
+	    *p = c;
+	    if (regmatch.regprog != NULL)
+	    {
+		regmatch.rm_ic = p_ic;
+
+		todo = (int)func_hashtab.ht_used;
+		for (hi = func_hashtab.ht_array; todo > 0 && !got_int; ++hi)
+		{
+		    if (!HASHITEM_EMPTY(hi))
+		    {
+			--todo;
+			fp = HI2UF(hi);
+			if (!isdigit(*fp->uf_name)
+				    && vim_regexec(&regmatch, fp->uf_name, 0))
+			    list_func_head(fp, FALSE);
+		    }
+		}
+		vim_regfree(regmatch.regprog);
+	    }
+	}
+	if (*p == '/')
+	    ++p;
+	eap->nextcmd = check_nextcmd(p);
+	return;
+    }
+
+    /*
+     * Get the function name.  There are these situations:
+     * func	    normal function name
+     *		    "name" == func, "fudi.fd_dict" == NULL
+     * dict.func    new dictionary entry
+     *		    "name" == NULL, "fudi.fd_dict" set,
+     *		    "fudi.fd_di" == NULL, "fudi.fd_newkey" == func
+     * dict.func    existing dict entry with a Funcref
+     *		    "name" == func, "fudi.fd_dict" set,
+     *		    "fudi.fd_di" set, "fudi.fd_newkey" == NULL
+     * dict.func    existing dict entry that's not a Funcref
+     *		    "name" == NULL, "fudi.fd_dict" set,
+     *		    "fudi.fd_di" set, "fudi.fd_newkey" == NULL
+     * s:func	    script-local function name
+     * g:func	    global function name, same as "func"
+     */
+    p = eap->arg;
+    name = trans_function_name(&p, eap->skip, 0, &fudi);
+    paren = (vim_strchr(p, '(') != NULL);
+    if (name == NULL && (fudi.fd_dict == NULL || !paren) && !eap->skip)
+    {
+	/*
+	 * Return on an invalid expression in braces, unless the expression
+	 * evaluation has been cancelled due to an aborting error, an
+	 * interrupt, or an exception.
+	 */
+	if (!aborting())
+	{
+	    if (!eap->skip && fudi.fd_newkey != NULL)
+		EMSG2(_(e_dictkey), fudi.fd_newkey);
+	    vim_free(fudi.fd_newkey);
+	    return;
+	}
+	else
+	    eap->skip = TRUE;
+    }
+
+    /* An error in a function call during evaluation of an expression in magic
+     * braces should not cause the function not to be defined. */
+    saved_did_emsg = did_emsg;
+    did_emsg = FALSE;
 
     /*
-     * Check for "b:changedtick".
+     * ":function func" with only function name: list function.
      */
-    if (STRCMP(name, "b:changedtick") == 0)
+    if (!paren)
     {
-	atv.v_type = VAR_NUMBER;
-	atv.vval.v_number = curbuf->b_changedtick;
-	tv = &atv;
+	if (!ends_excmd(*skipwhite(p)))
+	{
+	    EMSG(_(e_trailing));
+	    goto ret_free;
+	}
+	eap->nextcmd = check_nextcmd(p);
+	if (eap->nextcmd != NULL)
+	    *p = NUL;
+	if (!eap->skip && !got_int)
+	{
+	    fp = find_func(name);
+	    if (fp != NULL)
+	    {
+		list_func_head(fp, TRUE);
+		for (j = 0; j < fp->uf_lines.ga_len && !got_int; ++j)
+		{
+		    if (FUNCLINE(fp, j) == NULL)
+			continue;
+		    msg_putchar('\n');
+		    msg_outnum((long)(j + 1));
+		    if (j < 9)
+			msg_putchar(' ');
+		    if (j < 99)
+			msg_putchar(' ');
+		    msg_prt_line(FUNCLINE(fp, j), FALSE);
+		    out_flush();	/* show a line at a time */
+		    ui_breakcheck();
+		}
+		if (!got_int)
+		{
+		    msg_putchar('\n');
+		    msg_puts((char_u *)"   endfunction");
+		}
+	    }
+	    else
+		emsg_funcname(N_("E123: Undefined function: %s"), name);
+	}
+	goto ret_free;
     }
 
     /*
-     * Check for user-defined variables.
+     * ":function name(arg1, arg2)" Define function.
      */
-    else
-    {
-	v = find_var(name, NULL, no_autoload);
-	if (v != NULL)
-	    tv = &v->di_tv;
-    }
-
-    if (tv == NULL)
+    p = skipwhite(p);
+    if (*p != '(')
     {
-	if (rettv != NULL && verbose)
-	    EMSG2(_(e_undefvar), name);
-	ret = FAIL;
+	if (!eap->skip)
+	{
+	    EMSG2(_("E124: Missing '(': %s"), eap->arg);
+	    goto ret_free;
+	}
+	/* attempt to continue by skipping some text */
+	if (vim_strchr(p, '(') != NULL)
+	    p = vim_strchr(p, '(');
     }
-    else if (rettv != NULL)
-	copy_tv(tv, rettv);
-
-    name[len] = cc;
-
-    return ret;
-}
+    p = skipwhite(p + 1);
 
-/*
- * Handle expr[expr], expr[expr:expr] subscript and .name lookup.
- * Also handle function call with Funcref variable: func(expr)
- * Can all be combined: dict.func(expr)[idx]['func'](expr)
- */
-    static int
-handle_subscript(arg, rettv, evaluate, verbose)
-    char_u	**arg;
-    typval_T	*rettv;
-    int		evaluate;	/* do more than finding the end */
-    int		verbose;	/* give error messages */
-{
-    int		ret = OK;
-    dict_T	*selfdict = NULL;
-    char_u	*s;
-    int		len;
-    typval_T	functv;
+    ga_init2(&newargs, (int)sizeof(char_u *), 3);
+    ga_init2(&newlines, (int)sizeof(char_u *), 3);
 
-    while (ret == OK
-	    && (**arg == '['
-		|| (**arg == '.' && rettv->v_type == VAR_DICT)
-		|| (**arg == '(' && (!evaluate || rettv->v_type == VAR_FUNC)))
-	    && !vim_iswhite(*(*arg - 1)))
+    if (!eap->skip)
     {
-	if (**arg == '(')
+	/* Check the name of the function.  Unless it's a dictionary function
+	 * (that we are overwriting). */
+	if (name != NULL)
+	    arg = name;
+	else
+	    arg = fudi.fd_newkey;
+	if (arg != NULL && (fudi.fd_di == NULL
+				     || fudi.fd_di->di_tv.v_type != VAR_FUNC))
 	{
-	    /* need to copy the funcref so that we can clear rettv */
-	    if (evaluate)
-	    {
-		functv = *rettv;
-		rettv->v_type = VAR_UNKNOWN;
-
-		/* Invoke the function.  Recursive! */
-		s = functv.vval.v_string;
-	    }
+	    if (*arg == K_SPECIAL)
+		j = 3;
 	    else
-		s = (char_u *)"";
-	    ret = get_func_tv(s, (int)STRLEN(s), rettv, arg,
-			curwin->w_cursor.lnum, curwin->w_cursor.lnum,
-			&len, evaluate, selfdict);
-
-	    /* Clear the funcref afterwards, so that deleting it while
-	     * evaluating the arguments is possible (see test55). */
-	    if (evaluate)
-		clear_tv(&functv);
+		j = 0;
+	    while (arg[j] != NUL && (j == 0 ? eval_isnamec1(arg[j])
+						      : eval_isnamec(arg[j])))
+		++j;
+	    if (arg[j] != NUL)
+		emsg_funcname((char *)e_invarg2, arg);
+	}
+	/* Disallow using the g: dict. */
+	if (fudi.fd_dict != NULL && fudi.fd_dict->dv_scope == VAR_DEF_SCOPE)
+	    EMSG(_("E862: Cannot use g: here"));
+    }
 
-	    /* Stop the expression evaluation when immediately aborting on
-	     * error, or when an interrupt occurred or an exception was thrown
-	     * but not caught. */
-	    if (aborting())
-	    {
-		if (ret == OK)
-		    clear_tv(rettv);
-		ret = FAIL;
-	    }
-	    dict_unref(selfdict);
-	    selfdict = NULL;
+    /*
+     * Isolate the arguments: "arg1, arg2, ...)"
+     */
+    while (*p != ')')
+    {
+	if (p[0] == '.' && p[1] == '.' && p[2] == '.')
+	{
+	    varargs = TRUE;
+	    p += 3;
+	    mustend = TRUE;
 	}
-	else /* **arg == '[' || **arg == '.' */
+	else
 	{
-	    dict_unref(selfdict);
-	    if (rettv->v_type == VAR_DICT)
-	    {
-		selfdict = rettv->vval.v_dict;
-		if (selfdict != NULL)
-		    ++selfdict->dv_refcount;
-	    }
-	    else
-		selfdict = NULL;
-	    if (eval_index(arg, rettv, evaluate, verbose) == FAIL)
+	    arg = p;
+	    while (ASCII_ISALNUM(*p) || *p == '_')
+		++p;
+	    if (arg == p || isdigit(*arg)
+		    || (p - arg == 9 && STRNCMP(arg, "firstline", 9) == 0)
+		    || (p - arg == 8 && STRNCMP(arg, "lastline", 8) == 0))
 	    {
-		clear_tv(rettv);
-		ret = FAIL;
+		if (!eap->skip)
+		    EMSG2(_("E125: Illegal argument: %s"), arg);
+		break;
 	    }
-	}
-    }
-    dict_unref(selfdict);
-    return ret;
-}
-
-/*
- * Allocate memory for a variable type-value, and make it empty (0 or NULL
- * value).
- */
-    static typval_T *
-alloc_tv()
-{
-    return (typval_T *)alloc_clear((unsigned)sizeof(typval_T));
-}
-
-/*
- * Allocate memory for a variable type-value, and assign a string to it.
- * The string "s" must have been allocated, it is consumed.
- * Return NULL for out of memory, the variable otherwise.
- */
-    static typval_T *
-alloc_string_tv(s)
-    char_u	*s;
-{
-    typval_T	*rettv;
+	    if (ga_grow(&newargs, 1) == FAIL)
+		goto erret;
+	    c = *p;
+	    *p = NUL;
+	    arg = vim_strsave(arg);
+	    if (arg == NULL)
+		goto erret;
 
-    rettv = alloc_tv();
-    if (rettv != NULL)
-    {
-	rettv->v_type = VAR_STRING;
-	rettv->vval.v_string = s;
-    }
-    else
-	vim_free(s);
-    return rettv;
-}
+	    /* Check for duplicate argument name. */
+	    for (i = 0; i < newargs.ga_len; ++i)
+		if (STRCMP(((char_u **)(newargs.ga_data))[i], arg) == 0)
+		{
+		    EMSG2(_("E853: Duplicate argument name: %s"), arg);
+		    vim_free(arg);
+		    goto erret;
+		}
 
-/*
- * Free the memory for a variable type-value.
- */
-    void
-free_tv(varp)
-    typval_T *varp;
-{
-    if (varp != NULL)
-    {
-	switch (varp->v_type)
+	    ((char_u **)(newargs.ga_data))[newargs.ga_len] = arg;
+	    *p = c;
+	    newargs.ga_len++;
+	    if (*p == ',')
+		++p;
+	    else
+		mustend = TRUE;
+	}
+	p = skipwhite(p);
+	if (mustend && *p != ')')
 	{
-	    case VAR_FUNC:
-		func_unref(varp->vval.v_string);
-		/*FALLTHROUGH*/
-	    case VAR_STRING:
-		vim_free(varp->vval.v_string);
-		break;
-	    case VAR_LIST:
-		list_unref(varp->vval.v_list);
-		break;
-	    case VAR_DICT:
-		dict_unref(varp->vval.v_dict);
-		break;
-	    case VAR_NUMBER:
-#ifdef FEAT_FLOAT
-	    case VAR_FLOAT:
-#endif
-	    case VAR_UNKNOWN:
-		break;
-	    default:
-		EMSG2(_(e_intern2), "free_tv()");
-		break;
+	    if (!eap->skip)
+		EMSG2(_(e_invarg2), eap->arg);
+	    break;
 	}
-	vim_free(varp);
     }
-}
+    ++p;	/* skip the ')' */
 
-/*
- * Free the memory for a variable value and set the value to NULL or 0.
- */
-    void
-clear_tv(varp)
-    typval_T *varp;
-{
-    if (varp != NULL)
+    /* find extra arguments "range", "dict" and "abort" */
+    for (;;)
     {
-	switch (varp->v_type)
+	p = skipwhite(p);
+	if (STRNCMP(p, "range", 5) == 0)
 	{
-	    case VAR_FUNC:
-		func_unref(varp->vval.v_string);
-		/*FALLTHROUGH*/
-	    case VAR_STRING:
-		vim_free(varp->vval.v_string);
-		varp->vval.v_string = NULL;
-		break;
-	    case VAR_LIST:
-		list_unref(varp->vval.v_list);
-		varp->vval.v_list = NULL;
-		break;
-	    case VAR_DICT:
-		dict_unref(varp->vval.v_dict);
-		varp->vval.v_dict = NULL;
-		break;
-	    case VAR_NUMBER:
-		varp->vval.v_number = 0;
-		break;
-#ifdef FEAT_FLOAT
-	    case VAR_FLOAT:
-		varp->vval.v_float = 0.0;
-		break;
-#endif
-	    case VAR_UNKNOWN:
-		break;
-	    default:
-		EMSG2(_(e_intern2), "clear_tv()");
+	    flags |= FC_RANGE;
+	    p += 5;
 	}
-	varp->v_lock = 0;
+	else if (STRNCMP(p, "dict", 4) == 0)
+	{
+	    flags |= FC_DICT;
+	    p += 4;
+	}
+	else if (STRNCMP(p, "abort", 5) == 0)
+	{
+	    flags |= FC_ABORT;
+	    p += 5;
+	}
+	else
+	    break;
     }
-}
 
-/*
- * Set the value of a variable to NULL without freeing items.
- */
-    static void
-init_tv(varp)
-    typval_T *varp;
-{
-    if (varp != NULL)
-	vim_memset(varp, 0, sizeof(typval_T));
-}
+    /* When there is a line break use what follows for the function body.
+     * Makes 'exe "func Test()\n...\nendfunc"' work. */
+    if (*p == '\n')
+	line_arg = p + 1;
+    else if (*p != NUL && *p != '"' && !eap->skip && !did_emsg)
+	EMSG(_(e_trailing));
 
-/*
- * Get the number value of a variable.
- * If it is a String variable, uses vim_str2nr().
- * For incompatible types, return 0.
- * get_tv_number_chk() is similar to get_tv_number(), but informs the
- * caller of incompatible types: it sets *denote to TRUE if "denote"
- * is not NULL or returns -1 otherwise.
- */
-    static long
-get_tv_number(varp)
-    typval_T	*varp;
-{
-    int		error = FALSE;
+    /*
+     * Read the body of the function, until ":endfunction" is found.
+     */
+    if (KeyTyped)
+    {
+	/* Check if the function already exists, don't let the user type the
+	 * whole function before telling him it doesn't work!  For a script we
+	 * need to skip the body to be able to find what follows. */
+	if (!eap->skip && !eap->forceit)
+	{
+	    if (fudi.fd_dict != NULL && fudi.fd_newkey == NULL)
+		EMSG(_(e_funcdict));
+	    else if (name != NULL && find_func(name) != NULL)
+		emsg_funcname(e_funcexts, name);
+	}
 
-    return get_tv_number_chk(varp, &error);	/* return 0L on error */
-}
+	if (!eap->skip && did_emsg)
+	    goto erret;
 
-    long
-get_tv_number_chk(varp, denote)
-    typval_T	*varp;
-    int		*denote;
-{
-    long	n = 0L;
+	msg_putchar('\n');	    /* don't overwrite the function name */
+	cmdline_row = msg_row;
+    }
 
-    switch (varp->v_type)
+    indent = 2;
+    nesting = 0;
+    for (;;)
     {
-	case VAR_NUMBER:
-	    return (long)(varp->vval.v_number);
-#ifdef FEAT_FLOAT
-	case VAR_FLOAT:
-	    EMSG(_("E805: Using a Float as a Number"));
-	    break;
-#endif
-	case VAR_FUNC:
-	    EMSG(_("E703: Using a Funcref as a Number"));
-	    break;
-	case VAR_STRING:
-	    if (varp->vval.v_string != NULL)
-		vim_str2nr(varp->vval.v_string, NULL, NULL,
-							TRUE, TRUE, &n, NULL);
-	    return n;
-	case VAR_LIST:
-	    EMSG(_("E745: Using a List as a Number"));
-	    break;
-	case VAR_DICT:
-	    EMSG(_("E728: Using a Dictionary as a Number"));
-	    break;
-	default:
-	    EMSG2(_(e_intern2), "get_tv_number()");
-	    break;
-    }
-    if (denote == NULL)		/* useful for values that must be unsigned */
-	n = -1;
-    else
-	*denote = TRUE;
-    return n;
-}
+	if (KeyTyped)
+	{
+	    msg_scroll = TRUE;
+	    saved_wait_return = FALSE;
+	}
+	need_wait_return = FALSE;
+	sourcing_lnum_off = sourcing_lnum;
 
-/*
- * Get the lnum from the first argument.
- * Also accepts ".", "$", etc., but that only works for the current buffer.
- * Returns -1 on error.
- */
-    static linenr_T
-get_tv_lnum(argvars)
-    typval_T	*argvars;
-{
-    typval_T	rettv;
-    linenr_T	lnum;
+	if (line_arg != NULL)
+	{
+	    /* Use eap->arg, split up in parts by line breaks. */
+	    theline = line_arg;
+	    p = vim_strchr(theline, '\n');
+	    if (p == NULL)
+		line_arg += STRLEN(line_arg);
+	    else
+	    {
+		*p = NUL;
+		line_arg = p + 1;
+	    }
+	}
+	else if (eap->getline == NULL)
+	    theline = getcmdline(':', 0L, indent);
+	else
+	    theline = eap->getline(':', eap->cookie, indent);
+	if (KeyTyped)
+	    lines_left = Rows - 1;
+	if (theline == NULL)
+	{
+	    EMSG(_("E126: Missing :endfunction"));
+	    goto erret;
+	}
 
-    lnum = get_tv_number_chk(&argvars[0], NULL);
-    if (lnum == 0)  /* no valid number, try using line() */
-    {
-	rettv.v_type = VAR_NUMBER;
-	f_line(argvars, &rettv);
-	lnum = rettv.vval.v_number;
-	clear_tv(&rettv);
-    }
-    return lnum;
-}
+	/* Detect line continuation: sourcing_lnum increased more than one. */
+	if (sourcing_lnum > sourcing_lnum_off + 1)
+	    sourcing_lnum_off = sourcing_lnum - sourcing_lnum_off - 1;
+	else
+	    sourcing_lnum_off = 0;
+
+	if (skip_until != NULL)
+	{
+	    /* between ":append" and "." and between ":python <<EOF" and "EOF"
+	     * don't check for ":endfunc". */
+	    if (STRCMP(theline, skip_until) == 0)
+	    {
+		vim_free(skip_until);
+		skip_until = NULL;
+	    }
+	}
+	else
+	{
+	    /* skip ':' and blanks*/
+	    for (p = theline; vim_iswhite(*p) || *p == ':'; ++p)
+		;
+
+	    /* Check for "endfunction". */
+	    if (checkforcmd(&p, "endfunction", 4) && nesting-- == 0)
+	    {
+		if (line_arg == NULL)
+		    vim_free(theline);
+		break;
+	    }
 
-/*
- * Get the lnum from the first argument.
- * Also accepts "$", then "buf" is used.
- * Returns 0 on error.
- */
-    static linenr_T
-get_tv_lnum_buf(argvars, buf)
-    typval_T	*argvars;
-    buf_T	*buf;
-{
-    if (argvars[0].v_type == VAR_STRING
-	    && argvars[0].vval.v_string != NULL
-	    && argvars[0].vval.v_string[0] == '$'
-	    && buf != NULL)
-	return buf->b_ml.ml_line_count;
-    return get_tv_number_chk(&argvars[0], NULL);
-}
+	    /* Increase indent inside "if", "while", "for" and "try", decrease
+	     * at "end". */
+	    if (indent > 2 && STRNCMP(p, "end", 3) == 0)
+		indent -= 2;
+	    else if (STRNCMP(p, "if", 2) == 0
+		    || STRNCMP(p, "wh", 2) == 0
+		    || STRNCMP(p, "for", 3) == 0
+		    || STRNCMP(p, "try", 3) == 0)
+		indent += 2;
 
-/*
- * Get the string value of a variable.
- * If it is a Number variable, the number is converted into a string.
- * get_tv_string() uses a single, static buffer.  YOU CAN ONLY USE IT ONCE!
- * get_tv_string_buf() uses a given buffer.
- * If the String variable has never been set, return an empty string.
- * Never returns NULL;
- * get_tv_string_chk() and get_tv_string_buf_chk() are similar, but return
- * NULL on error.
- */
-    static char_u *
-get_tv_string(varp)
-    typval_T	*varp;
-{
-    static char_u   mybuf[NUMBUFLEN];
+	    /* Check for defining a function inside this function. */
+	    if (checkforcmd(&p, "function", 2))
+	    {
+		if (*p == '!')
+		    p = skipwhite(p + 1);
+		p += eval_fname_script(p);
+		if (ASCII_ISALPHA(*p))
+		{
+		    vim_free(trans_function_name(&p, TRUE, 0, NULL));
+		    if (*skipwhite(p) == '(')
+		    {
+			++nesting;
+			indent += 2;
+		    }
+		}
+	    }
 
-    return get_tv_string_buf(varp, mybuf);
-}
+	    /* Check for ":append" or ":insert". */
+	    p = skip_range(p, NULL);
+	    if ((p[0] == 'a' && (!ASCII_ISALPHA(p[1]) || p[1] == 'p'))
+		    || (p[0] == 'i'
+			&& (!ASCII_ISALPHA(p[1]) || (p[1] == 'n'
+				&& (!ASCII_ISALPHA(p[2]) || (p[2] == 's'))))))
+		skip_until = vim_strsave((char_u *)".");
 
-    static char_u *
-get_tv_string_buf(varp, buf)
-    typval_T	*varp;
-    char_u	*buf;
-{
-    char_u	*res =  get_tv_string_buf_chk(varp, buf);
+	    /* Check for ":python <<EOF", ":tcl <<EOF", etc. */
+	    arg = skipwhite(skiptowhite(p));
+	    if (arg[0] == '<' && arg[1] =='<'
+		    && ((p[0] == 'p' && p[1] == 'y'
+				    && (!ASCII_ISALPHA(p[2]) || p[2] == 't'))
+			|| (p[0] == 'p' && p[1] == 'e'
+				    && (!ASCII_ISALPHA(p[2]) || p[2] == 'r'))
+			|| (p[0] == 't' && p[1] == 'c'
+				    && (!ASCII_ISALPHA(p[2]) || p[2] == 'l'))
+			|| (p[0] == 'l' && p[1] == 'u' && p[2] == 'a'
+				    && !ASCII_ISALPHA(p[3]))
+			|| (p[0] == 'r' && p[1] == 'u' && p[2] == 'b'
+				    && (!ASCII_ISALPHA(p[3]) || p[3] == 'y'))
+			|| (p[0] == 'm' && p[1] == 'z'
+				    && (!ASCII_ISALPHA(p[2]) || p[2] == 's'))
+			))
+	    {
+		/* ":python <<" continues until a dot, like ":append" */
+		p = skipwhite(arg + 2);
+		if (*p == NUL)
+		    skip_until = vim_strsave((char_u *)".");
+		else
+		    skip_until = vim_strsave(p);
+	    }
+	}
 
-    return res != NULL ? res : (char_u *)"";
-}
+	/* Add the line to the function. */
+	if (ga_grow(&newlines, 1 + sourcing_lnum_off) == FAIL)
+	{
+	    if (line_arg == NULL)
+		vim_free(theline);
+	    goto erret;
+	}
 
-/*
- * Careful: This uses a single, static buffer.  YOU CAN ONLY USE IT ONCE!
- */
-    char_u *
-get_tv_string_chk(varp)
-    typval_T	*varp;
-{
-    static char_u   mybuf[NUMBUFLEN];
+	/* Copy the line to newly allocated memory.  get_one_sourceline()
+	 * allocates 250 bytes per line, this saves 80% on average.  The cost
+	 * is an extra alloc/free. */
+	p = vim_strsave(theline);
+	if (p != NULL)
+	{
+	    if (line_arg == NULL)
+		vim_free(theline);
+	    theline = p;
+	}
 
-    return get_tv_string_buf_chk(varp, mybuf);
-}
+	((char_u **)(newlines.ga_data))[newlines.ga_len++] = theline;
 
-    static char_u *
-get_tv_string_buf_chk(varp, buf)
-    typval_T	*varp;
-    char_u	*buf;
-{
-    switch (varp->v_type)
-    {
-	case VAR_NUMBER:
-	    sprintf((char *)buf, "%ld", (long)varp->vval.v_number);
-	    return buf;
-	case VAR_FUNC:
-	    EMSG(_("E729: using Funcref as a String"));
-	    break;
-	case VAR_LIST:
-	    EMSG(_("E730: using List as a String"));
-	    break;
-	case VAR_DICT:
-	    EMSG(_("E731: using Dictionary as a String"));
-	    break;
-#ifdef FEAT_FLOAT
-	case VAR_FLOAT:
-	    EMSG(_(e_float_as_string));
-	    break;
-#endif
-	case VAR_STRING:
-	    if (varp->vval.v_string != NULL)
-		return varp->vval.v_string;
-	    return (char_u *)"";
-	default:
-	    EMSG2(_(e_intern2), "get_tv_string_buf()");
-	    break;
-    }
-    return NULL;
-}
+	/* Add NULL lines for continuation lines, so that the line count is
+	 * equal to the index in the growarray.   */
+	while (sourcing_lnum_off-- > 0)
+	    ((char_u **)(newlines.ga_data))[newlines.ga_len++] = NULL;
 
-/*
- * Find variable "name" in the list of variables.
- * Return a pointer to it if found, NULL if not found.
- * Careful: "a:0" variables don't have a name.
- * When "htp" is not NULL we are writing to the variable, set "htp" to the
- * hashtab_T used.
- */
-    static dictitem_T *
-find_var(name, htp, no_autoload)
-    char_u	*name;
-    hashtab_T	**htp;
-    int		no_autoload;
-{
-    char_u	*varname;
-    hashtab_T	*ht;
+	/* Check for end of eap->arg. */
+	if (line_arg != NULL && *line_arg == NUL)
+	    line_arg = NULL;
+    }
 
-    ht = find_var_ht(name, &varname);
-    if (htp != NULL)
-	*htp = ht;
-    if (ht == NULL)
-	return NULL;
-    return find_var_in_ht(ht, *name, varname, no_autoload || htp != NULL);
-}
+    /* Don't define the function when skipping commands or when an error was
+     * detected. */
+    if (eap->skip || did_emsg)
+	goto erret;
 
-/*
- * Find variable "varname" in hashtab "ht" with name "htname".
- * Returns NULL if not found.
- */
-    static dictitem_T *
-find_var_in_ht(ht, htname, varname, no_autoload)
-    hashtab_T	*ht;
-    int		htname;
-    char_u	*varname;
-    int		no_autoload;
-{
-    hashitem_T	*hi;
+    /*
+     * If there are no errors, add the function
+     */
+    if (fudi.fd_dict == NULL)
+    {
+	v = find_var(name, &ht, FALSE);
+	if (v != NULL && v->di_tv.v_type == VAR_FUNC)
+	{
+	    emsg_funcname(N_("E707: Function name conflicts with variable: %s"),
+									name);
+	    goto erret;
+	}
 
-    if (*varname == NUL)
+	fp = find_func(name);
+	if (fp != NULL)
+	{
+	    if (!eap->forceit)
+	    {
+		emsg_funcname(e_funcexts, name);
+		goto erret;
+	    }
+	    if (fp->uf_calls > 0)
+	    {
+		emsg_funcname(N_("E127: Cannot redefine function %s: It is in use"),
+									name);
+		goto erret;
+	    }
+	    /* redefine existing function */
+	    ga_clear_strings(&(fp->uf_args));
+	    ga_clear_strings(&(fp->uf_lines));
+	    func_code_free(fp);
+	    vim_free(name);
+	    name = NULL;
+	}
+    }
+    else
     {
-	/* Must be something like "s:", otherwise "ht" would be NULL. */
-	switch (htname)
+	char	numbuf[20];
+
+	fp = NULL;
+	if (fudi.fd_newkey == NULL && !eap->forceit)
+	{
+	    EMSG(_(e_funcdict));
+	    goto erret;
+	}
+	if (fudi.fd_di == NULL)
 	{
-	    case 's': return &SCRIPT_SV(current_SID)->sv_var;
-	    case 'g': return &globvars_var;
-	    case 'v': return &vimvars_var;
-	    case 'b': return &curbuf->b_bufvar;
-	    case 'w': return &curwin->w_winvar;
-#ifdef FEAT_WINDOWS
-	    case 't': return &curtab->tp_winvar;
-#endif
-	    case 'l': return current_funccal == NULL
-					? NULL : &current_funccal->l_vars_var;
-	    case 'a': return current_funccal == NULL
-				       ? NULL : &current_funccal->l_avars_var;
+	    /* Can't add a function to a locked dictionary */
+	    if (tv_check_lock(fudi.fd_dict->dv_lock, eap->arg))
+		goto erret;
 	}
-	return NULL;
+	    /* Can't change an existing function if it is locked */
+	else if (tv_check_lock(fudi.fd_di->di_tv.v_lock, eap->arg))
+	    goto erret;
+
+	/* Give the function a sequential number.  Can only be used with a
+	 * Funcref! */
+	vim_free(name);
+	sprintf(numbuf, "%d", ++func_nr);
+	name = vim_strsave((char_u *)numbuf);
+	if (name == NULL)
+	    goto erret;
     }
 
-    hi = hash_find(ht, varname);
-    if (HASHITEM_EMPTY(hi))
+    if (fp == NULL)
     {
-	/* For global variables we may try auto-loading the script.  If it
-	 * worked find the variable again.  Don't auto-load a script if it was
-	 * loaded already, otherwise it would be loaded every time when
-	 * checking if a function name is a Funcref variable. */
-	if (ht == &globvarht && !no_autoload)
+	if (fudi.fd_dict == NULL && vim_strchr(name, AUTOLOAD_CHAR) != NULL)
 	{
-	    /* Note: script_autoload() may make "hi" invalid. It must either
-	     * be obtained again or not used. */
-	    if (!script_autoload(varname, FALSE) || aborting())
-		return NULL;
-	    hi = hash_find(ht, varname);
+	    int	    slen, plen;
+	    char_u  *scriptname;
+
+	    /* Check that the autoload name matches the script name. */
+	    j = FAIL;
+	    if (sourcing_name != NULL)
+	    {
+		scriptname = autoload_name(name);
+		if (scriptname != NULL)
+		{
+		    p = vim_strchr(scriptname, '/');
+		    plen = (int)STRLEN(p);
+		    slen = (int)STRLEN(sourcing_name);
+		    if (slen > plen && fnamecmp(p,
+					    sourcing_name + slen - plen) == 0)
+			j = OK;
+		    vim_free(scriptname);
+		}
+	    }
+	    if (j == FAIL)
+	    {
+		EMSG2(_("E746: Function name does not match script file name: %s"), name);
+		goto erret;
+	    }
 	}
-	if (HASHITEM_EMPTY(hi))
-	    return NULL;
-    }
-    return HI2DI(hi);
-}
 
-/*
- * Find the hashtab used for a variable name.
- * Set "varname" to the start of name without ':'.
- */
-    static hashtab_T *
-find_var_ht(name, varname)
-    char_u  *name;
-    char_u  **varname;
-{
-    hashitem_T	*hi;
+	fp = (ufunc_T *)alloc((unsigned)(sizeof(ufunc_T) + STRLEN(name)));
+	if (fp == NULL)
+	    goto erret;
 
-    if (name[1] != ':')
-    {
-	/* The name must not start with a colon or #. */
-	if (name[0] == ':' || name[0] == AUTOLOAD_CHAR)
-	    return NULL;
-	*varname = name;
+	if (fudi.fd_dict != NULL)
+	{
+	    if (fudi.fd_di == NULL)
+	    {
+		/* add new dict entry */
+		fudi.fd_di = dictitem_alloc(fudi.fd_newkey);
+		if (fudi.fd_di == NULL)
+		{
+		    vim_free(fp);
+		    goto erret;
+		}
+		if (dict_add(fudi.fd_dict, fudi.fd_di) == FAIL)
+		{
+		    vim_free(fudi.fd_di);
+		    vim_free(fp);
+		    goto erret;
+		}
+	    }
+	    else
+		/* overwrite existing dict entry */
+		clear_tv(&fudi.fd_di->di_tv);
+	    fudi.fd_di->di_tv.v_type = VAR_FUNC;
+	    fudi.fd_di->di_tv.v_lock = 0;
+	    fudi.fd_di->di_tv.vval.v_string = vim_strsave(name);
+	    fp->uf_refcount = 1;
 
-	/* "version" is "v:version" in all scopes */
-	hi = hash_find(&compat_hashtab, name);
-	if (!HASHITEM_EMPTY(hi))
-	    return &compat_hashtab;
+	    /* behave like "dict" was used */
+	    flags |= FC_DICT;
+	}
 
-	if (current_funccal == NULL)
-	    return &globvarht;			/* global variable */
-	return &current_funccal->l_vars.dv_hashtab; /* l: variable */
+	/* insert the new function in the function list */
+	STRCPY(fp->uf_name, name);
+	hash_add(&func_hashtab, UF2HIKEY(fp));
     }
-    *varname = name + 2;
-    if (*name == 'g')				/* global variable */
-	return &globvarht;
-    /* There must be no ':' or '#' in the rest of the name, unless g: is used
-     */
-    if (vim_strchr(name + 2, ':') != NULL
-			       || vim_strchr(name + 2, AUTOLOAD_CHAR) != NULL)
-	return NULL;
-    if (*name == 'b')				/* buffer variable */
-	return &curbuf->b_vars->dv_hashtab;
-    if (*name == 'w')				/* window variable */
-	return &curwin->w_vars->dv_hashtab;
-#ifdef FEAT_WINDOWS
-    if (*name == 't')				/* tab page variable */
-	return &curtab->tp_vars->dv_hashtab;
+    fp->uf_args = newargs;
+    fp->uf_lines = newlines;
+    fp->uf_code = NULL;
+    fp->uf_code_tried = FALSE;
+#ifdef FEAT_PROFILE
+    fp->uf_tml_count = NULL;
+    fp->uf_tml_total = NULL;
+    fp->uf_tml_self = NULL;
+    fp->uf_profiling = FALSE;
+    if (prof_def_func())
+	func_do_profile(fp);
 #endif
-    if (*name == 'v')				/* v: variable */
-	return &vimvarht;
-    if (*name == 'a' && current_funccal != NULL) /* function argument */
-	return &current_funccal->l_avars.dv_hashtab;
-    if (*name == 'l' && current_funccal != NULL) /* local function variable */
-	return &current_funccal->l_vars.dv_hashtab;
-    if (*name == 's'				/* script variable */
-	    && current_SID > 0 && current_SID <= ga_scripts.ga_len)
-	return &SCRIPT_VARS(current_SID);
-    return NULL;
+    fp->uf_varargs = varargs;
+    fp->uf_flags = flags;
+    fp->uf_calls = 0;
+    fp->uf_script_ID = current_SID;
+    goto ret_free;
+
+erret:
+    ga_clear_strings(&newargs);
+    ga_clear_strings(&newlines);
+ret_free:
+    vim_free(skip_until);
+    vim_free(fudi.fd_newkey);
+    vim_free(name);
+    did_emsg |= saved_did_emsg;
+    need_wait_return |= saved_wait_return;
 }
 
 /*
- * Get the string value of a (global/local) variable.
- * Note: see get_tv_string() for how long the pointer remains valid.
- * Returns NULL when it doesn't exist.
+ * Get a function name, translating "<SID>" and "<SNR>".
+ * Also handles a Funcref in a List or Dictionary.
+ * Returns the function name in allocated memory, or NULL for failure.
+ * flags:
+ * TFN_INT:         internal function name OK
+ * TFN_QUIET:       be quiet
+ * TFN_NO_AUTOLOAD: do not use script autoloading
+ * Advances "pp" to just after the function name (if no error).
  */
-    char_u *
-get_var_value(name)
-    char_u	*name;
+    static char_u *
+trans_function_name(pp, skip, flags, fdp)
+    char_u	**pp;
+    int		skip;		/* only find the end, don't evaluate */
+    int		flags;
+    funcdict_T	*fdp;		/* return: info about dictionary used */
 {
-    dictitem_T	*v;
+    char_u	*name = NULL;
+    char_u	*start;
+    char_u	*end;
+    int		lead;
+    char_u	sid_buf[20];
+    int		len;
+    lval_T	lv;
 
-    v = find_var(name, NULL, FALSE);
-    if (v == NULL)
-	return NULL;
-    return get_tv_string(&v->di_tv);
-}
+    if (fdp != NULL)
+	vim_memset(fdp, 0, sizeof(funcdict_T));
+    start = *pp;
 
-/*
- * Allocate a new hashtab for a sourced script.  It will be used while
- * sourcing this script and when executing functions defined in the script.
- */
-    void
-new_script_vars(id)
-    scid_T id;
-{
-    int		i;
-    hashtab_T	*ht;
-    scriptvar_T *sv;
+    /* Check for hard coded <SNR>: already translated function ID (from a user
+     * command). */
+    if ((*pp)[0] == K_SPECIAL && (*pp)[1] == KS_EXTRA
+						   && (*pp)[2] == (int)KE_SNR)
+    {
+	*pp += 3;
+	len = get_id_len(pp) + 3;
+	return vim_strnsave(start, len);
+    }
+
+    /* A name starting with "<SID>" or "<SNR>" is local to a script.  But
+     * don't skip over "s:", get_lval() needs it for "s:dict.func". */
+    lead = eval_fname_script(start);
+    if (lead > 2)
+	start += lead;
+
+    /* Note that TFN_ flags use the same values as GLV_ flags. */
+    end = get_lval(start, NULL, &lv, FALSE, skip, flags,
+					      lead > 2 ? 0 : FNE_CHECK_START);
+    if (end == start)
+    {
+	if (!skip)
+	    EMSG(_("E129: Function name required"));
+	goto theend;
+    }
+    if (end == NULL || (lv.ll_tv != NULL && (lead > 2 || lv.ll_range)))
+    {
+	/*
+	 * Report an invalid expression in braces, unless the expression
+	 * evaluation has been cancelled due to an aborting error, an
+	 * interrupt, or an exception.
+	 */
+	if (!aborting())
+	{
+	    if (end != NULL)
+		EMSG2(_(e_invarg2), start);
+	}
+	else
+	    *pp = find_name_end(start, NULL, NULL, FNE_INCL_BR);
+	goto theend;
+    }
 
-    if (ga_grow(&ga_scripts, (int)(id - ga_scripts.ga_len)) == OK)
+    if (lv.ll_tv != NULL)
     {
-	/* Re-allocating ga_data means that an ht_array pointing to
-	 * ht_smallarray becomes invalid.  We can recognize this: ht_mask is
-	 * at its init value.  Also reset "v_dict", it's always the same. */
-	for (i = 1; i <= ga_scripts.ga_len; ++i)
+	if (fdp != NULL)
 	{
-	    ht = &SCRIPT_VARS(i);
-	    if (ht->ht_mask == HT_INIT_SIZE - 1)
-		ht->ht_array = ht->ht_smallarray;
-	    sv = SCRIPT_SV(i);
-	    sv->sv_var.di_tv.vval.v_dict = &sv->sv_dict;
+	    fdp->fd_dict = lv.ll_dict;
+	    fdp->fd_newkey = lv.ll_newkey;
+	    lv.ll_newkey = NULL;
+	    fdp->fd_di = lv.ll_di;
 	}
-
-	while (ga_scripts.ga_len < id)
+	if (lv.ll_tv->v_type == VAR_FUNC && lv.ll_tv->vval.v_string != NULL)
 	{
-	    sv = SCRIPT_SV(ga_scripts.ga_len + 1) =
-		(scriptvar_T *)alloc_clear(sizeof(scriptvar_T));
-	    init_var_dict(&sv->sv_dict, &sv->sv_var, VAR_SCOPE);
-	    ++ga_scripts.ga_len;
+	    name = vim_strsave(lv.ll_tv->vval.v_string);
+	    *pp = end;
+	}
+	else
+	{
+	    if (!skip && !(flags & TFN_QUIET) && (fdp == NULL
+			     || lv.ll_dict == NULL || fdp->fd_newkey == NULL))
+		EMSG(_(e_funcref));
+	    else
+		*pp = end;
+	    name = NULL;
 	}
+	goto theend;
     }
-}
-
-/*
- * Initialize dictionary "dict" as a scope and set variable "dict_var" to
- * point to it.
- */
-    void
-init_var_dict(dict, dict_var, scope)
-    dict_T	*dict;
-    dictitem_T	*dict_var;
-    int		scope;
-{
-    hash_init(&dict->dv_hashtab);
-    dict->dv_lock = 0;
-    dict->dv_scope = scope;
-    dict->dv_refcount = DO_NOT_FREE_CNT;
-    dict->dv_copyID = 0;
-    dict_var->di_tv.vval.v_dict = dict;
-    dict_var->di_tv.v_type = VAR_DICT;
-    dict_var->di_tv.v_lock = VAR_FIXED;
-    dict_var->di_flags = DI_FLAGS_RO | DI_FLAGS_FIX;
-    dict_var->di_key[0] = NUL;
-}
 
-/*
- * Unreference a dictionary initialized by init_var_dict().
- */
-    void
-unref_var_dict(dict)
-    dict_T	*dict;
-{
-    /* Now the dict needs to be freed if no one else is using it, go back to
-     * normal reference counting. */
-    dict->dv_refcount -= DO_NOT_FREE_CNT - 1;
-    dict_unref(dict);
-}
+    if (lv.ll_name == NULL)
+    {
+	/* Error found, but continue after the function name. */
+	*pp = end;
+	goto theend;
+    }
 
-/*
- * Clean up a list of internal variables.
- * Frees all allocated variables and the value they contain.
- * Clears hashtab "ht", does not free it.
- */
-    void
-vars_clear(ht)
-    hashtab_T *ht;
-{
-    vars_clear_ext(ht, TRUE);
-}
+    /* Check if the name is a Funcref.  If so, use the value. */
+    if (lv.ll_exp_name != NULL)
+    {
+	len = (int)STRLEN(lv.ll_exp_name);
+	name = deref_func_name(lv.ll_exp_name, &len, flags & TFN_NO_AUTOLOAD);
+	if (name == lv.ll_exp_name)
+	    name = NULL;
+    }
+    else
+    {
+	len = (int)(end - *pp);
+	name = deref_func_name(*pp, &len, flags & TFN_NO_AUTOLOAD);
+	if (name == *pp)
+	    name = NULL;
+    }
+    if (name != NULL)
+    {
+	name = vim_strsave(name);
+	*pp = end;
+	if (STRNCMP(name, "<SNR>", 5) == 0)
+	{
+	    /* Change "<SNR>" to the byte sequence. */
+	    name[0] = K_SPECIAL;
+	    name[1] = KS_EXTRA;
+	    name[2] = (int)KE_SNR;
+	    mch_memmove(name + 3, name + 5, STRLEN(name + 5) + 1);
+	}
+	goto theend;
+    }
 
-/*
- * Like vars_clear(), but only free the value if "free_val" is TRUE.
- */
-    static void
-vars_clear_ext(ht, free_val)
-    hashtab_T	*ht;
-    int		free_val;
-{
-    int		todo;
-    hashitem_T	*hi;
-    dictitem_T	*v;
+    if (lv.ll_exp_name != NULL)
+    {
+	len = (int)STRLEN(lv.ll_exp_name);
+	if (lead <= 2 && lv.ll_name == lv.ll_exp_name
+					 && STRNCMP(lv.ll_name, "s:", 2) == 0)
+	{
+	    /* When there was "s:" already or the name expanded to get a
+	     * leading "s:" then remove it. */
+	    lv.ll_name += 2;
+	    len -= 2;
+	    lead = 2;
+	}
+    }
+    else
+    {
+	/* skip over "s:" and "g:" */
+	if (lead == 2 || (lv.ll_name[0] == 'g' && lv.ll_name[1] == ':'))
+	    lv.ll_name += 2;
+	len = (int)(end - lv.ll_name);
+    }
 
-    hash_lock(ht);
-    todo = (int)ht->ht_used;
-    for (hi = ht->ht_array; todo > 0; ++hi)
+    /*
+     * Copy the function name to allocated memory.
+     * Accept <SID>name() inside a script, translate into <SNR>123_name().
+     * Accept <SNR>123_name() outside a script.
+     */
+    if (skip)
+	lead = 0;	/* do nothing */
+    else if (lead > 0)
     {
-	if (!HASHITEM_EMPTY(hi))
+	lead = 3;
+	if ((lv.ll_exp_name != NULL && eval_fname_sid(lv.ll_exp_name))
+						       || eval_fname_sid(*pp))
 	{
-	    --todo;
+	    /* It's "s:" or "<SID>" */
+	    if (current_SID <= 0)
+	    {
+		EMSG(_(e_usingsid));
+		goto theend;
+	    }
+	    sprintf((char *)sid_buf, "%ld_", (long)current_SID);
+	    lead += (int)STRLEN(sid_buf);
+	}
+    }
+    else if (!(flags & TFN_INT) && builtin_function(lv.ll_name, len))
+    {
+	EMSG2(_("E128: Function name must start with a capital or \"s:\": %s"),
+								       start);
+	goto theend;
+    }
+    if (!skip && !(flags & TFN_QUIET))
+    {
+	char_u *cp = vim_strchr(lv.ll_name, ':');
 
-	    /* Free the variable.  Don't remove it from the hashtab,
-	     * ht_array might change then.  hash_clear() takes care of it
-	     * later. */
-	    v = HI2DI(hi);
-	    if (free_val)
-		clear_tv(&v->di_tv);
-	    if ((v->di_flags & DI_FLAGS_FIX) == 0)
-		vim_free(v);
+	if (cp != NULL && cp < end)
+	{
+	    EMSG2(_("E884: Function name cannot contain a colon: %s"), start);
+	    goto theend;
 	}
     }
-    hash_clear(ht);
-    ht->ht_used = 0;
+
+    name = alloc((unsigned)(len + lead + 1));
+    if (name != NULL)
+    {
+	if (lead > 0)
+	{
+	    name[0] = K_SPECIAL;
+	    name[1] = KS_EXTRA;
+	    name[2] = (int)KE_SNR;
+	    if (lead > 3)	/* If it's "<SID>" */
+		STRCPY(name + 3, sid_buf);
+	}
+	mch_memmove(name + lead, lv.ll_name, (size_t)len);
+	name[lead + len] = NUL;
+    }
+    *pp = end;
+
+theend:
+    clear_lval(&lv);
+    return name;
 }
 
 /*
- * Delete a variable from hashtab "ht" at item "hi".
- * Clear the variable value and free the dictitem.
+ * Return 5 if "p" starts with "<SID>" or "<SNR>" (ignoring case).
+ * Return 2 if "p" starts with "s:".
+ * Return 0 otherwise.
  */
-    static void
-delete_var(ht, hi)
-    hashtab_T	*ht;
-    hashitem_T	*hi;
+    static int
+eval_fname_script(p)
+    char_u	*p;
 {
-    dictitem_T	*di = HI2DI(hi);
-
-    hash_remove(ht, hi);
-    clear_tv(&di->di_tv);
-    vim_free(di);
+    if (p[0] == '<' && (STRNICMP(p + 1, "SID>", 4) == 0
+					  || STRNICMP(p + 1, "SNR>", 4) == 0))
+	return 5;
+    if (p[0] == 's' && p[1] == ':')
+	return 2;
+    return 0;
 }
 
 /*
- * List the value of one internal variable.
+ * Return TRUE if "p" starts with "<SID>" or "s:".
+ * Only works if eval_fname_script() returned non-zero for "p"!
  */
-    static void
-list_one_var(v, prefix, first)
-    dictitem_T	*v;
-    char_u	*prefix;
-    int		*first;
+    static int
+eval_fname_sid(p)
+    char_u	*p;
 {
-    char_u	*tofree;
-    char_u	*s;
-    char_u	numbuf[NUMBUFLEN];
-
-    current_copyID += COPYID_INC;
-    s = echo_string(&v->di_tv, &tofree, numbuf, current_copyID);
-    list_one_var_a(prefix, v->di_key, v->di_tv.v_type,
-					 s == NULL ? (char_u *)"" : s, first);
-    vim_free(tofree);
+    return (*p == 's' || TOUPPER_ASC(p[2]) == 'I');
 }
 
+/*
+ * List the head of the function: "name(arg1, arg2)".
+ */
     static void
-list_one_var_a(prefix, name, type, string, first)
-    char_u	*prefix;
-    char_u	*name;
-    int		type;
-    char_u	*string;
-    int		*first;  /* when TRUE clear rest of screen and set to FALSE */
+list_func_head(fp, indent)
+    ufunc_T	*fp;
+    int		indent;
 {
-    /* don't use msg() or msg_attr() to avoid overwriting "v:statusmsg" */
+    int		j;
+
     msg_start();
-    msg_puts(prefix);
-    if (name != NULL)	/* "a:" vars don't have a name stored */
-	msg_puts(name);
-    msg_putchar(' ');
-    msg_advance(22);
-    if (type == VAR_NUMBER)
-	msg_putchar('#');
-    else if (type == VAR_FUNC)
-	msg_putchar('*');
-    else if (type == VAR_LIST)
+    if (indent)
+	MSG_PUTS("   ");
+    MSG_PUTS("function ");
+    if (fp->uf_name[0] == K_SPECIAL)
     {
-	msg_putchar('[');
-	if (*string == '[')
-	    ++string;
+	MSG_PUTS_ATTR("<SNR>", hl_attr(HLF_8));
+	msg_puts(fp->uf_name + 3);
     }
-    else if (type == VAR_DICT)
+    else
+	msg_puts(fp->uf_name);
+    msg_putchar('(');
+    for (j = 0; j < fp->uf_args.ga_len; ++j)
     {
-	msg_putchar('{');
-	if (*string == '{')
-	    ++string;
+	if (j)
+	    MSG_PUTS(", ");
+	msg_puts(FUNCARG(fp, j));
     }
-    else
-	msg_putchar(' ');
-
-    msg_outtrans(string);
-
-    if (type == VAR_FUNC)
-	msg_puts((char_u *)"()");
-    if (*first)
+    if (fp->uf_varargs)
     {
-	msg_clr_eos();
-	*first = FALSE;
+	if (j)
+	    MSG_PUTS(", ");
+	MSG_PUTS("...");
     }
+    msg_putchar(')');
+    if (fp->uf_flags & FC_ABORT)
+	MSG_PUTS(" abort");
+    if (fp->uf_flags & FC_RANGE)
+	MSG_PUTS(" range");
+    if (fp->uf_flags & FC_DICT)
+	MSG_PUTS(" dict");
+    msg_clr_eos();
+    if (p_verbose > 0)
+	last_set_msg(fp->uf_script_ID);
 }
 
 /*
- * Set variable "name" to value in "tv".
- * If the variable already exists, the value is updated.
- * Otherwise the variable is created.
+ * Find a function by name, return pointer to it in ufuncs.
+ * Return NULL for unknown function.
  */
-    static void
-set_var(name, tv, copy)
+    static ufunc_T *
+find_func(name)
     char_u	*name;
-    typval_T	*tv;
-    int		copy;	    /* make copy of value in "tv" */
 {
-    dictitem_T	*v;
-    char_u	*varname;
-    hashtab_T	*ht;
-
-    ht = find_var_ht(name, &varname);
-    if (ht == NULL || *varname == NUL)
-    {
-	EMSG2(_(e_illvar), name);
-	return;
-    }
-    v = find_var_in_ht(ht, 0, varname, TRUE);
+    hashitem_T	*hi;
 
-    if (tv->v_type == VAR_FUNC && var_check_func_name(name, v == NULL))
-	return;
+    hi = hash_find(&func_hashtab, name);
+    if (!HASHITEM_EMPTY(hi))
+	return HI2UF(hi);
+    return NULL;
+}
 
-    if (v != NULL)
-    {
-	/* existing variable, need to clear the value */
-	if (var_check_ro(v->di_flags, name)
-				      || tv_check_lock(v->di_tv.v_lock, name))
-	    return;
-	if (v->di_tv.v_type != tv->v_type
-		&& !((v->di_tv.v_type == VAR_STRING
-			|| v->di_tv.v_type == VAR_NUMBER)
-		    && (tv->v_type == VAR_STRING
-			|| tv->v_type == VAR_NUMBER))
-#ifdef FEAT_FLOAT
-		&& !((v->di_tv.v_type == VAR_NUMBER
-			|| v->di_tv.v_type == VAR_FLOAT)
-		    && (tv->v_type == VAR_NUMBER
-			|| tv->v_type == VAR_FLOAT))
-#endif
-		)
-	{
-	    EMSG2(_("E706: Variable type mismatch for: %s"), name);
-	    return;
-	}
+#if defined(EXITFREE) || defined(PROTO)
+    void
+free_all_functions()
+{
+    hashitem_T	*hi;
 
-	/*
-	 * Handle setting internal v: variables separately: we don't change
-	 * the type.
-	 */
-	if (ht == &vimvarht)
-	{
-	    if (v->di_tv.v_type == VAR_STRING)
+    /* Need to start all over every time, because func_free() may change the
+     * hash table. */
+    while (func_hashtab.ht_used > 0)
+	for (hi = func_hashtab.ht_array; ; ++hi)
+	    if (!HASHITEM_EMPTY(hi))
 	    {
-		vim_free(v->di_tv.vval.v_string);
-		if (copy || tv->v_type != VAR_STRING)
-		    v->di_tv.vval.v_string = vim_strsave(get_tv_string(tv));
-		else
-		{
-		    /* Take over the string to avoid an extra alloc/free. */
-		    v->di_tv.vval.v_string = tv->vval.v_string;
-		    tv->vval.v_string = NULL;
-		}
+		func_free(HI2UF(hi));
+		break;
 	    }
-	    else if (v->di_tv.v_type != VAR_NUMBER)
-		EMSG2(_(e_intern2), "set_var()");
-	    else
-	    {
-		v->di_tv.vval.v_number = get_tv_number(tv);
-		if (STRCMP(varname, "searchforward") == 0)
-		    set_search_direction(v->di_tv.vval.v_number ? '/' : '?');
-#ifdef FEAT_SEARCH_EXTRA
-		else if (STRCMP(varname, "hlsearch") == 0)
-		{
-		    no_hlsearch = !v->di_tv.vval.v_number;
-		    redraw_all_later(SOME_VALID);
-		}
+}
 #endif
-	    }
-	    return;
-	}
-
-	clear_tv(&v->di_tv);
-    }
-    else		    /* add a new variable */
-    {
-	/* Can't add "v:" variable. */
-	if (ht == &vimvarht)
-	{
-	    EMSG2(_(e_illvar), name);
-	    return;
-	}
-
-	/* Make sure the variable name is valid. */
-	if (!valid_varname(varname))
-	    return;
-
-	v = (dictitem_T *)alloc((unsigned)(sizeof(dictitem_T)
-							  + STRLEN(varname)));
-	if (v == NULL)
-	    return;
-	STRCPY(v->di_key, varname);
-	if (hash_add(ht, DI2HIKEY(v)) == FAIL)
-	{
-	    vim_free(v);
-	    return;
-	}
-	v->di_flags = 0;
-    }
 
-    if (copy || tv->v_type == VAR_NUMBER || tv->v_type == VAR_FLOAT)
-	copy_tv(tv, &v->di_tv);
-    else
-    {
-	v->di_tv = *tv;
-	v->di_tv.v_lock = 0;
-	init_tv(tv);
-    }
+    int
+translated_function_exists(name)
+    char_u	*name;
+{
+    if (builtin_function(name, -1))
+	return find_internal_func(name) >= 0;
+    return find_func(name) != NULL;
 }
 
 /*
- * Return TRUE if di_flags "flags" indicates variable "name" is read-only.
- * Also give an error message.
+ * Return TRUE if a function "name" exists.
  */
     static int
-var_check_ro(flags, name)
-    int		flags;
+function_exists(name)
+    char_u *name;
+{
+    char_u  *nm = name;
+    char_u  *p;
+    int	    n = FALSE;
+
+    p = trans_function_name(&nm, FALSE, TFN_INT|TFN_QUIET|TFN_NO_AUTOLOAD,
+			    NULL);
+    nm = skipwhite(nm);
+
+    /* Only accept "funcname", "funcname ", "funcname (..." and
+     * "funcname(...", not "funcname!...". */
+    if (p != NULL && (*nm == NUL || *nm == '('))
+	n = translated_function_exists(p);
+    vim_free(p);
+    return n;
+}
+
+    char_u *
+get_expanded_name(name, check)
     char_u	*name;
+    int		check;
 {
-    if (flags & DI_FLAGS_RO)
-    {
-	EMSG2(_(e_readonlyvar), name);
-	return TRUE;
-    }
-    if ((flags & DI_FLAGS_RO_SBX) && sandbox)
-    {
-	EMSG2(_(e_readonlysbx), name);
-	return TRUE;
-    }
-    return FALSE;
+    char_u	*nm = name;
+    char_u	*p;
+
+    p = trans_function_name(&nm, FALSE, TFN_INT|TFN_QUIET, NULL);
+
+    if (p != NULL && *nm == NUL)
+	if (!check || translated_function_exists(p))
+	    return p;
+
+    vim_free(p);
+    return NULL;
 }
 
 /*
- * Return TRUE if di_flags "flags" indicates variable "name" is fixed.
- * Also give an error message.
+ * Return TRUE if "name" looks like a builtin function name: starts with a
+ * lower case letter and doesn't contain AUTOLOAD_CHAR.
+ * "len" is the length of "name", or -1 for NUL terminated.
  */
     static int
-var_check_fixed(flags, name)
-    int		flags;
-    char_u	*name;
+builtin_function(name, len)
+    char_u *name;
+    int len;
 {
-    if (flags & DI_FLAGS_FIX)
-    {
-	EMSG2(_("E795: Cannot delete variable %s"), name);
-	return TRUE;
-    }
-    return FALSE;
+    char_u *p;
+
+    if (!ASCII_ISLOWER(name[0]))
+	return FALSE;
+    p = vim_strchr(name, AUTOLOAD_CHAR);
+    return p == NULL || (len > 0 && p > name + len);
 }
 
+#if defined(FEAT_PROFILE) || defined(PROTO)
 /*
- * Check if a funcref is assigned to a valid variable name.
- * Return TRUE and give an error if not.
+ * Start profiling function "fp".
  */
-    static int
-var_check_func_name(name, new_var)
-    char_u *name;    /* points to start of variable name */
-    int    new_var;  /* TRUE when creating the variable */
+    static void
+func_do_profile(fp)
+    ufunc_T	*fp;
 {
-    if (!(vim_strchr((char_u *)"wbs", name[0]) != NULL && name[1] == ':')
-	    && !ASCII_ISUPPER((name[0] != NUL && name[1] == ':')
-						     ? name[2] : name[0]))
-    {
-	EMSG2(_("E704: Funcref variable name must start with a capital: %s"),
-									name);
-	return TRUE;
-    }
-    /* Don't allow hiding a function.  When "v" is not NULL we might be
-     * assigning another function to the same var, the type is checked
-     * below. */
-    if (new_var && function_exists(name))
-    {
-	EMSG2(_("E705: Variable name conflicts with existing function: %s"),
-								    name);
-	return TRUE;
-    }
-    return FALSE;
+    int		len = fp->uf_lines.ga_len;
+
+    if (len == 0)
+	len = 1;  /* avoid getting error for allocating zero bytes */
+    fp->uf_tm_count = 0;
+    profile_zero(&fp->uf_tm_self);
+    profile_zero(&fp->uf_tm_total);
+    if (fp->uf_tml_count == NULL)
+	fp->uf_tml_count = (int *)alloc_clear((unsigned) (sizeof(int) * len));
+    if (fp->uf_tml_total == NULL)
+	fp->uf_tml_total = (proftime_T *)alloc_clear((unsigned)
+						  (sizeof(proftime_T) * len));
+    if (fp->uf_tml_self == NULL)
+	fp->uf_tml_self = (proftime_T *)alloc_clear((unsigned)
+						  (sizeof(proftime_T) * len));
+    fp->uf_tml_idx = -1;
+    if (fp->uf_tml_count == NULL || fp->uf_tml_total == NULL
+						   || fp->uf_tml_self == NULL)
+	return;	    /* out of memory */
+
+    fp->uf_profiling = TRUE;
 }
 
 /*
- * Check if a variable name is valid.
- * Return FALSE and give an error if not.
+ * Dump the profiling results for all functions in file "fd".
  */
-    static int
-valid_varname(varname)
-    char_u *varname;
+    void
+func_dump_profile(fd)
+    FILE    *fd;
 {
-    char_u *p;
+    hashitem_T	*hi;
+    int		todo;
+    ufunc_T	*fp;
+    int		i;
+    ufunc_T	**sorttab;
+    int		st_len = 0;
 
-    for (p = varname; *p != NUL; ++p)
-	if (!eval_isnamec1(*p) && (p == varname || !VIM_ISDIGIT(*p))
-						   && *p != AUTOLOAD_CHAR)
+    todo = (int)func_hashtab.ht_used;
+    if (todo == 0)
+	return;     /* nothing to dump */
+
+    sorttab = (ufunc_T **)alloc((unsigned)(sizeof(ufunc_T) * todo));
+
+    for (hi = func_hashtab.ht_array; todo > 0; ++hi)
+    {
+	if (!HASHITEM_EMPTY(hi))
 	{
-	    EMSG2(_(e_illvar), varname);
-	    return FALSE;
+	    --todo;
+	    fp = HI2UF(hi);
+	    if (fp->uf_profiling)
+	    {
+		if (sorttab != NULL)
+		    sorttab[st_len++] = fp;
+
+		if (fp->uf_name[0] == K_SPECIAL)
+		    fprintf(fd, "FUNCTION  <SNR>%s()\n", fp->uf_name + 3);
+		else
+		    fprintf(fd, "FUNCTION  %s()\n", fp->uf_name);
+		if (fp->uf_tm_count == 1)
+		    fprintf(fd, "Called 1 time\n");
+		else
+		    fprintf(fd, "Called %d times\n", fp->uf_tm_count);
+		fprintf(fd, "Total time: %s\n", profile_msg(&fp->uf_tm_total));
+		fprintf(fd, " Self time: %s\n", profile_msg(&fp->uf_tm_self));
+		fprintf(fd, "\n");
+		fprintf(fd, "count  total (s)   self (s)\n");
+
+		for (i = 0; i < fp->uf_lines.ga_len; ++i)
+		{
+		    if (FUNCLINE(fp, i) == NULL)
+			continue;
+		    prof_func_line(fd, fp->uf_tml_count[i],
+			     &fp->uf_tml_total[i], &fp->uf_tml_self[i], TRUE);
+		    fprintf(fd, "%s\n", FUNCLINE(fp, i));
+		}
+		fprintf(fd, "\n");
+	    }
 	}
-    return TRUE;
-}
+    }
 
-/*
- * Return TRUE if typeval "tv" is set to be locked (immutable).
- * Also give an error message, using "name".
- */
-    static int
-tv_check_lock(lock, name)
-    int		lock;
-    char_u	*name;
-{
-    if (lock & VAR_LOCKED)
+    if (sorttab != NULL && st_len > 0)
     {
-	EMSG2(_("E741: Value is locked: %s"),
-				name == NULL ? (char_u *)_("Unknown") : name);
-	return TRUE;
+	qsort((void *)sorttab, (size_t)st_len, sizeof(ufunc_T *),
+							      prof_total_cmp);
+	prof_sort_list(fd, sorttab, st_len, "TOTAL", FALSE);
+	qsort((void *)sorttab, (size_t)st_len, sizeof(ufunc_T *),
+							      prof_self_cmp);
+	prof_sort_list(fd, sorttab, st_len, "SELF", TRUE);
     }
-    if (lock & VAR_FIXED)
+
+    vim_free(sorttab);
+}
+
+    static void
+prof_sort_list(fd, sorttab, st_len, title, prefer_self)
+    FILE	*fd;
+    ufunc_T	**sorttab;
+    int		st_len;
+    char	*title;
+    int		prefer_self;	/* when equal print only self time */
+{
+    int		i;
+    ufunc_T	*fp;
+
+    fprintf(fd, "FUNCTIONS SORTED ON %s TIME\n", title);
+    fprintf(fd, "count  total (s)   self (s)  function\n");
+    for (i = 0; i < 20 && i < st_len; ++i)
     {
-	EMSG2(_("E742: Cannot change value of %s"),
-				name == NULL ? (char_u *)_("Unknown") : name);
-	return TRUE;
+	fp = sorttab[i];
+	prof_func_line(fd, fp->uf_tm_count, &fp->uf_tm_total, &fp->uf_tm_self,
+								 prefer_self);
+	if (fp->uf_name[0] == K_SPECIAL)
+	    fprintf(fd, " <SNR>%s()\n", fp->uf_name + 3);
+	else
+	    fprintf(fd, " %s()\n", fp->uf_name);
     }
-    return FALSE;
+    fprintf(fd, "\n");
 }
 
 /*
- * Copy the values from typval_T "from" to typval_T "to".
- * When needed allocates string or increases reference count.
- * Does not make a copy of a list or dict but copies the reference!
- * It is OK for "from" and "to" to point to the same item.  This is used to
- * make a copy later.
+ * Print the count and times for one function or function line.
  */
-    void
-copy_tv(from, to)
-    typval_T *from;
-    typval_T *to;
+    static void
+prof_func_line(fd, count, total, self, prefer_self)
+    FILE	*fd;
+    int		count;
+    proftime_T	*total;
+    proftime_T	*self;
+    int		prefer_self;	/* when equal print only self time */
 {
-    to->v_type = from->v_type;
-    to->v_lock = 0;
-    switch (from->v_type)
+    if (count > 0)
     {
-	case VAR_NUMBER:
-	    to->vval.v_number = from->vval.v_number;
-	    break;
-#ifdef FEAT_FLOAT
-	case VAR_FLOAT:
-	    to->vval.v_float = from->vval.v_float;
-	    break;
-#endif
-	case VAR_STRING:
-	case VAR_FUNC:
-	    if (from->vval.v_string == NULL)
-		to->vval.v_string = NULL;
-	    else
-	    {
-		to->vval.v_string = vim_strsave(from->vval.v_string);
-		if (from->v_type == VAR_FUNC)
-		    func_ref(to->vval.v_string);
-	    }
-	    break;
-	case VAR_LIST:
-	    if (from->vval.v_list == NULL)
-		to->vval.v_list = NULL;
-	    else
-	    {
-		to->vval.v_list = from->vval.v_list;
-		++to->vval.v_list->lv_refcount;
-	    }
-	    break;
-	case VAR_DICT:
-	    if (from->vval.v_dict == NULL)
-		to->vval.v_dict = NULL;
-	    else
-	    {
-		to->vval.v_dict = from->vval.v_dict;
-		++to->vval.v_dict->dv_refcount;
-	    }
-	    break;
-	default:
-	    EMSG2(_(e_intern2), "copy_tv()");
-	    break;
+	fprintf(fd, "%5d ", count);
+	if (prefer_self && profile_equal(total, self))
+	    fprintf(fd, "           ");
+	else
+	    fprintf(fd, "%s ", profile_msg(total));
+	if (!prefer_self && profile_equal(total, self))
+	    fprintf(fd, "           ");
+	else
+	    fprintf(fd, "%s ", profile_msg(self));
     }
+    else
+	fprintf(fd, "                            ");
 }
 
 /*
- * Make a copy of an item.
- * Lists and Dictionaries are also copied.  A deep copy if "deep" is set.
- * For deepcopy() "copyID" is zero for a full copy or the ID for when a
- * reference to an already copied list/dict can be used.
- * Returns FAIL or OK.
+ * Compare function for total time sorting.
  */
     static int
-item_copy(from, to, deep, copyID)
-    typval_T	*from;
-    typval_T	*to;
-    int		deep;
-    int		copyID;
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+prof_total_cmp(s1, s2)
+    const void	*s1;
+    const void	*s2;
 {
-    static int	recurse = 0;
-    int		ret = OK;
+    ufunc_T	*p1, *p2;
 
-    if (recurse >= DICT_MAXNEST)
-    {
-	EMSG(_("E698: variable nested too deep for making a copy"));
-	return FAIL;
-    }
-    ++recurse;
+    p1 = *(ufunc_T **)s1;
+    p2 = *(ufunc_T **)s2;
+    return profile_cmp(&p1->uf_tm_total, &p2->uf_tm_total);
+}
 
-    switch (from->v_type)
-    {
-	case VAR_NUMBER:
-#ifdef FEAT_FLOAT
-	case VAR_FLOAT:
+/*
+ * Compare function for self time sorting.
+ */
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
 #endif
-	case VAR_STRING:
-	case VAR_FUNC:
-	    copy_tv(from, to);
-	    break;
-	case VAR_LIST:
-	    to->v_type = VAR_LIST;
-	    to->v_lock = 0;
-	    if (from->vval.v_list == NULL)
-		to->vval.v_list = NULL;
-	    else if (copyID != 0 && from->vval.v_list->lv_copyID == copyID)
-	    {
-		/* use the copy made earlier */
-		to->vval.v_list = from->vval.v_list->lv_copylist;
-		++to->vval.v_list->lv_refcount;
-	    }
-	    else
-		to->vval.v_list = list_copy(from->vval.v_list, deep, copyID);
-	    if (to->vval.v_list == NULL)
-		ret = FAIL;
-	    break;
-	case VAR_DICT:
-	    to->v_type = VAR_DICT;
-	    to->v_lock = 0;
-	    if (from->vval.v_dict == NULL)
-		to->vval.v_dict = NULL;
-	    else if (copyID != 0 && from->vval.v_dict->dv_copyID == copyID)
-	    {
-		/* use the copy made earlier */
-		to->vval.v_dict = from->vval.v_dict->dv_copydict;
-		++to->vval.v_dict->dv_refcount;
-	    }
-	    else
-		to->vval.v_dict = dict_copy(from->vval.v_dict, deep, copyID);
-	    if (to->vval.v_dict == NULL)
-		ret = FAIL;
-	    break;
-	default:
-	    EMSG2(_(e_intern2), "item_copy()");
-	    ret = FAIL;
-    }
-    --recurse;
-    return ret;
+prof_self_cmp(s1, s2)
+    const void	*s1;
+    const void	*s2;
+{
+    ufunc_T	*p1, *p2;
+
+    p1 = *(ufunc_T **)s1;
+    p2 = *(ufunc_T **)s2;
+    return profile_cmp(&p1->uf_tm_self, &p2->uf_tm_self);
 }
 
+#endif
+
 /*
- * ":echo expr1 ..."	print each argument separated with a space, add a
- *			newline at the end.
- * ":echon expr1 ..."	print each argument plain.
+ * If "name" has a package name try autoloading the script for it.
+ * Return TRUE if a package was loaded.
  */
-    void
-ex_echo(eap)
-    exarg_T	*eap;
+    static int
+script_autoload(name, reload)
+    char_u	*name;
+    int		reload;	    /* load script again when already loaded */
 {
-    char_u	*arg = eap->arg;
-    typval_T	rettv;
-    char_u	*tofree;
     char_u	*p;
-    int		needclr = TRUE;
-    int		atstart = TRUE;
-    char_u	numbuf[NUMBUFLEN];
+    char_u	*scriptname, *tofree;
+    int		ret = FALSE;
+    int		i;
 
-    if (eap->skip)
-	++emsg_skip;
-    while (*arg != NUL && *arg != '|' && *arg != '\n' && !got_int)
-    {
-	/* If eval1() causes an error message the text from the command may
-	 * still need to be cleared. E.g., "echo 22,44". */
-	need_clr_eos = needclr;
+    /* If there is no '#' after name[0] there is no package name. */
+    p = vim_strchr(name, AUTOLOAD_CHAR);
+    if (p == NULL || p == name)
+	return FALSE;
 
-	p = arg;
-	if (eval1(&arg, &rettv, !eap->skip) == FAIL)
-	{
-	    /*
-	     * Report the invalid expression unless the expression evaluation
-	     * has been cancelled due to an aborting error, an interrupt, or an
-	     * exception.
-	     */
-	    if (!aborting())
-		EMSG2(_(e_invexpr2), p);
-	    need_clr_eos = FALSE;
-	    break;
-	}
-	need_clr_eos = FALSE;
+    tofree = scriptname = autoload_name(name);
 
-	if (!eap->skip)
+    /* Find the name in the list of previously loaded package names.  Skip
+     * "autoload/", it's always the same. */
+    for (i = 0; i < ga_loaded.ga_len; ++i)
+	if (STRCMP(((char_u **)ga_loaded.ga_data)[i] + 9, scriptname + 9) == 0)
+	    break;
+    if (!reload && i < ga_loaded.ga_len)
+	ret = FALSE;	    /* was loaded already */
+    else
+    {
+	/* Remember the name if it wasn't loaded already. */
+	if (i == ga_loaded.ga_len && ga_grow(&ga_loaded, 1) == OK)
 	{
-	    if (atstart)
-	    {
-		atstart = FALSE;
-		/* Call msg_start() after eval1(), evaluating the expression
-		 * may cause a message to appear. */
-		if (eap->cmdidx == CMD_echo)
-		{
-		    /* Mark the saved text as finishing the line, so that what
-		     * follows is displayed on a new line when scrolling back
-		     * at the more prompt. */
-		    msg_sb_eol();
-		    msg_start();
-		}
-	    }
-	    else if (eap->cmdidx == CMD_echo)
-		msg_puts_attr((char_u *)" ", echo_attr);
-	    current_copyID += COPYID_INC;
-	    p = echo_string(&rettv, &tofree, numbuf, current_copyID);
-	    if (p != NULL)
-		for ( ; *p != NUL && !got_int; ++p)
-		{
-		    if (*p == '\n' || *p == '\r' || *p == TAB)
-		    {
-			if (*p != TAB && needclr)
-			{
-			    /* remove any text still there from the command */
-			    msg_clr_eos();
-			    needclr = FALSE;
-			}
-			msg_putchar_attr(*p, echo_attr);
-		    }
-		    else
-		    {
-#ifdef FEAT_MBYTE
-			if (has_mbyte)
-			{
-			    int i = (*mb_ptr2len)(p);
-
-			    (void)msg_outtrans_len_attr(p, i, echo_attr);
-			    p += i - 1;
-			}
-			else
-#endif
-			    (void)msg_outtrans_len_attr(p, 1, echo_attr);
-		    }
-		}
-	    vim_free(tofree);
+	    ((char_u **)ga_loaded.ga_data)[ga_loaded.ga_len++] = scriptname;
+	    tofree = NULL;
 	}
-	clear_tv(&rettv);
-	arg = skipwhite(arg);
+
+	/* Try loading the package from $VIMRUNTIME/autoload/<name>.vim */
+	if (source_runtime(scriptname, FALSE) == OK)
+	    ret = TRUE;
     }
-    eap->nextcmd = check_nextcmd(arg);
 
-    if (eap->skip)
-	--emsg_skip;
-    else
+    vim_free(tofree);
+    return ret;
+}
+
+/*
+ * Return the autoload script name for a function or variable name.
+ * Returns NULL when out of memory.
+ */
+    static char_u *
+autoload_name(name)
+    char_u	*name;
+{
+    char_u	*p;
+    char_u	*scriptname;
+
+    /* Get the script file name: replace '#' with '/', append ".vim". */
+    scriptname = alloc((unsigned)(STRLEN(name) + 14));
+    if (scriptname == NULL)
+	return FALSE;
+    STRCPY(scriptname, "autoload/");
+    STRCAT(scriptname, name);
+    *vim_strrchr(scriptname, AUTOLOAD_CHAR) = NUL;
+    STRCAT(scriptname, ".vim");
+    while ((p = vim_strchr(scriptname, AUTOLOAD_CHAR)) != NULL)
+	*p = '/';
+    return scriptname;
+}
+
+#if defined(FEAT_CMDL_COMPL) || defined(PROTO)
+
+/*
+ * Function given to ExpandGeneric() to obtain the list of user defined
+ * function names.
+ */
+    char_u *
+get_user_func_name(xp, idx)
+    expand_T	*xp;
+    int		idx;
+{
+    static long_u	done;
+    static hashitem_T	*hi;
+    ufunc_T		*fp;
+
+    if (idx == 0)
     {
-	/* remove text that may still be there from the command */
-	if (needclr)
-	    msg_clr_eos();
-	if (eap->cmdidx == CMD_echo)
-	    msg_end();
+	done = 0;
+	hi = func_hashtab.ht_array;
+    }
+    if (done < func_hashtab.ht_used)
+    {
+	if (done++ > 0)
+	    ++hi;
+	while (HASHITEM_EMPTY(hi))
+	    ++hi;
+	fp = HI2UF(hi);
+
+	if (fp->uf_flags & FC_DICT)
+	    return (char_u *)""; /* don't show dict functions */
+
+	if (STRLEN(fp->uf_name) + 4 >= IOSIZE)
+	    return fp->uf_name;	/* prevents overflow */
+
+	cat_func_name(IObuff, fp);
+	if (xp->xp_context != EXPAND_USER_FUNC)
+	{
+	    STRCAT(IObuff, "(");
+	    if (!fp->uf_varargs && fp->uf_args.ga_len == 0)
+		STRCAT(IObuff, ")");
+	}
+	return IObuff;
     }
+    return NULL;
 }
 
+#endif /* FEAT_CMDL_COMPL */
+
 /*
- * ":echohl {name}".
+ * Copy the function name of "fp" to buffer "buf".
+ * "buf" must be able to hold the function name plus three bytes.
+ * Takes care of script-local function names.
  */
-    void
-ex_echohl(eap)
-    exarg_T	*eap;
+    static void
+cat_func_name(buf, fp)
+    char_u	*buf;
+    ufunc_T	*fp;
 {
-    int		id;
-
-    id = syn_name2id(eap->arg);
-    if (id == 0)
-	echo_attr = 0;
+    if (fp->uf_name[0] == K_SPECIAL)
+    {
+	STRCPY(buf, "<SNR>");
+	STRCAT(buf, fp->uf_name + 3);
+    }
     else
-	echo_attr = syn_id2attr(id);
+	STRCPY(buf, fp->uf_name);
 }
 
 /*
- * ":execute expr1 ..."	execute the result of an expression.
- * ":echomsg expr1 ..."	Print a message
- * ":echoerr expr1 ..."	Print an error
- * Each gets spaces around each argument and a newline at the end for
- * echo commands
+ * ":delfunction {name}"
  */
     void
-ex_execute(eap)
+ex_delfunction(eap)
     exarg_T	*eap;
 {
-    char_u	*arg = eap->arg;
-    typval_T	rettv;
-    int		ret = OK;
+    ufunc_T	*fp = NULL;
     char_u	*p;
-    garray_T	ga;
-    int		len;
-    int		save_did_emsg;
+    char_u	*name;
+    funcdict_T	fudi;
 
-    ga_init2(&ga, 1, 80);
+    p = eap->arg;
+    name = trans_function_name(&p, eap->skip, 0, &fudi);
+    vim_free(fudi.fd_newkey);
+    if (name == NULL)
+    {
+	if (fudi.fd_dict != NULL && !eap->skip)
+	    EMSG(_(e_funcref));
+	return;
+    }
+    if (!ends_excmd(*skipwhite(p)))
+    {
+	vim_free(name);
+	EMSG(_(e_trailing));
+	return;
+    }
+    eap->nextcmd = check_nextcmd(p);
+    if (eap->nextcmd != NULL)
+	*p = NUL;
 
-    if (eap->skip)
-	++emsg_skip;
-    while (*arg != NUL && *arg != '|' && *arg != '\n')
+    if (!eap->skip)
+	fp = find_func(name);
+    vim_free(name);
+
+    if (!eap->skip)
     {
-	p = arg;
-	if (eval1(&arg, &rettv, !eap->skip) == FAIL)
+	if (fp == NULL)
 	{
-	    /*
-	     * Report the invalid expression unless the expression evaluation
-	     * has been cancelled due to an aborting error, an interrupt, or an
-	     * exception.
-	     */
-	    if (!aborting())
-		EMSG2(_(e_invexpr2), p);
-	    ret = FAIL;
-	    break;
+	    EMSG2(_(e_nofunc), eap->arg);
+	    return;
 	}
-
-	if (!eap->skip)
+	if (fp->uf_calls > 0)
 	{
-	    p = get_tv_string(&rettv);
-	    len = (int)STRLEN(p);
-	    if (ga_grow(&ga, len + 2) == FAIL)
-	    {
-		clear_tv(&rettv);
-		ret = FAIL;
-		break;
-	    }
-	    if (ga.ga_len)
-		((char_u *)(ga.ga_data))[ga.ga_len++] = ' ';
-	    STRCPY((char_u *)(ga.ga_data) + ga.ga_len, p);
-	    ga.ga_len += len;
+	    EMSG2(_("E131: Cannot delete function %s: It is in use"), eap->arg);
+	    return;
 	}
 
-	clear_tv(&rettv);
-	arg = skipwhite(arg);
-    }
-
-    if (ret != FAIL && ga.ga_data != NULL)
-    {
-	if (eap->cmdidx == CMD_echomsg)
-	{
-	    MSG_ATTR(ga.ga_data, echo_attr);
-	    out_flush();
-	}
-	else if (eap->cmdidx == CMD_echoerr)
+	if (fudi.fd_dict != NULL)
 	{
-	    /* We don't want to abort following commands, restore did_emsg. */
-	    save_did_emsg = did_emsg;
-	    EMSG((char_u *)ga.ga_data);
-	    if (!force_abort)
-		did_emsg = save_did_emsg;
+	    /* Delete the dict item that refers to the function, it will
+	     * invoke func_unref() and possibly delete the function. */
+	    dictitem_remove(fudi.fd_dict, fudi.fd_di);
 	}
-	else if (eap->cmdidx == CMD_execute)
-	    do_cmdline((char_u *)ga.ga_data,
-		       eap->getline, eap->cookie, DOCMD_NOWAIT|DOCMD_VERBOSE);
+	else
+	    func_free(fp);
     }
-
-    ga_clear(&ga);
-
-    if (eap->skip)
-	--emsg_skip;
-
-    eap->nextcmd = check_nextcmd(arg);
 }
 
 /*
- * Skip over the name of an option: "&option", "&g:option" or "&l:option".
- * "arg" points to the "&" or '+' when called, to "option" when returning.
- * Returns NULL when no option name found.  Otherwise pointer to the char
- * after the option name.
+ * Free a function and remove it from the list of functions.
  */
-    static char_u *
-find_option_end(arg, opt_flags)
-    char_u	**arg;
-    int		*opt_flags;
+    static void
+func_free(fp)
+    ufunc_T *fp;
 {
-    char_u	*p = *arg;
-
-    ++p;
-    if (*p == 'g' && p[1] == ':')
-    {
-	*opt_flags = OPT_GLOBAL;
-	p += 2;
-    }
-    else if (*p == 'l' && p[1] == ':')
-    {
-	*opt_flags = OPT_LOCAL;
-	p += 2;
-    }
-    else
-	*opt_flags = 0;
+    hashitem_T	*hi;
 
-    if (!ASCII_ISALPHA(*p))
-	return NULL;
-    *arg = p;
+    /* clear this function */
+    ga_clear_strings(&(fp->uf_args));
+    ga_clear_strings(&(fp->uf_lines));
+    func_code_free(fp);
+#ifdef FEAT_PROFILE
+    vim_free(fp->uf_tml_count);
+    vim_free(fp->uf_tml_total);
+    vim_free(fp->uf_tml_self);
+#endif
 
-    if (p[0] == 't' && p[1] == '_' && p[2] != NUL && p[3] != NUL)
-	p += 4;	    /* termcap option */
+    /* remove the function from the function hashtable */
+    hi = hash_find(&func_hashtab, UF2HIKEY(fp));
+    if (HASHITEM_EMPTY(hi))
+	EMSG2(_(e_intern2), "func_free()");
     else
-	while (ASCII_ISALPHA(*p))
-	    ++p;
-    return p;
+	hash_remove(&func_hashtab, hi);
+
+    vim_free(fp);
 }
 
 /*
- * ":function"
+ * Unreference a Function: decrement the reference count and free it when it
+ * becomes zero.  Only for numbered functions.
  */
     void
-ex_function(eap)
-    exarg_T	*eap;
+func_unref(name)
+    char_u	*name;
 {
-    char_u	*theline;
-    int		i;
-    int		j;
-    int		c;
-    int		saved_did_emsg;
-    int		saved_wait_return = need_wait_return;
-    char_u	*name = NULL;
-    char_u	*p;
-    char_u	*arg;
-    char_u	*line_arg = NULL;
-    garray_T	newargs;
-    garray_T	newlines;
-    int		varargs = FALSE;
-    int		mustend = FALSE;
-    int		flags = 0;
-    ufunc_T	*fp;
-    int		indent;
-    int		nesting;
-    char_u	*skip_until = NULL;
-    dictitem_T	*v;
-    funcdict_T	fudi;
-    static int	func_nr = 0;	    /* number for nameless function */
-    int		paren;
-    hashtab_T	*ht;
-    int		todo;
-    hashitem_T	*hi;
-    int		sourcing_lnum_off;
+    ufunc_T *fp;
 
-    /*
-     * ":function" without argument: list functions.
-     */
-    if (ends_excmd(*eap->arg))
+    if (name != NULL && isdigit(*name))
     {
-	if (!eap->skip)
+	fp = find_func(name);
+	if (fp == NULL)
+	    EMSG2(_(e_intern2), "func_unref()");
+	else if (--fp->uf_refcount <= 0)
 	{
-	    todo = (int)func_hashtab.ht_used;
-	    for (hi = func_hashtab.ht_array; todo > 0 && !got_int; ++hi)
-	    {
-		if (!HASHITEM_EMPTY(hi))
-		{
-		    --todo;
-		    fp = HI2UF(hi);
-		    if (!isdigit(*fp->uf_name))
-			list_func_head(fp, FALSE);
-		}
-	    }
+	    /* Only delete it when it's not being used.  Otherwise it's done
+	     * when "uf_calls" becomes zero. */
+	    if (fp->uf_calls == 0)
+		func_free(fp);
 	}
-	eap->nextcmd = check_nextcmd(eap->arg);
-	return;
     }
+}
 
-    /*
-     * ":function /pat": list functions matching pattern.
-     */
-    if (*eap->arg == '/')
+/*
+ * Count a reference to a Function.
+ */
+    void
+func_ref(name)
+    char_u	*name;
+{
+    ufunc_T *fp;
+
+    if (name != NULL && isdigit(*name))
     {
-	p = skip_regexp(eap->arg + 1, '/', TRUE, NULL);
-	if (!eap->skip)
-	{
-	    regmatch_T	regmatch;
+	fp = find_func(name);
+	if (fp == NULL)
+	    EMSG2(_(e_intern2), "func_ref()");
+	else
+	    ++fp->uf_refcount;
+    }
+}
 
-	    c = *p;
-	    *p = NUL;
-	    regmatch.regprog = vim_regcomp(eap->arg + 1, RE_MAGIC);
-	    *p = c;
-	    if (regmatch.regprog != NULL)
-	    {
-		regmatch.rm_ic = p_ic;
+/*
+ * Call a user function.
+ */
+    static void
+call_user_func(fp, argcount, argvars, rettv, firstline, lastline, selfdict)
+    ufunc_T	*fp;		/* pointer to function */
+    int		argcount;	/* nr of args */
+    typval_T	*argvars;	/* arguments */
+    typval_T	*rettv;		/* return value */
+    linenr_T	firstline;	/* first line of range */
+    linenr_T	lastline;	/* last line of range */
+    dict_T	*selfdict;	/* Dictionary for "self" */
+{
+    char_u	*save_sourcing_name;
+    linenr_T	save_sourcing_lnum;
+    scid_T	save_current_SID;
+    funccall_T	*fc;
+    int		save_did_emsg;
+    static int	depth = 0;
+    dictitem_T	*v;
+    int		fixvar_idx = 0;	/* index in fixvar[] */
+    int		room_len;
+    int		i;
+    int		ai;
+    char_u	numbuf[NUMBUFLEN];
+    char_u	*name;
+#ifdef FEAT_PROFILE
+    proftime_T	wait_start;
+    proftime_T	call_start;
+#endif
 
-		todo = (int)func_hashtab.ht_used;
-		for (hi = func_hashtab.ht_array; todo > 0 && !got_int; ++hi)
-		{
-		    if (!HASHITEM_EMPTY(hi))
-		    {
-			--todo;
-			fp = HI2UF(hi);
-			if (!isdigit(*fp->uf_name)
-				    && vim_regexec(&regmatch, fp->uf_name, 0))
-			    list_func_head(fp, FALSE);
-		    }
-		}
-		vim_regfree(regmatch.regprog);
-	    }
-	}
-	if (*p == '/')
-	    ++p;
-	eap->nextcmd = check_nextcmd(p);
+    /* If depth of calling is getting too high, don't execute the function */
+    if (depth >= p_mfd)
+    {
+	EMSG(_("E132: Function call depth is higher than 'maxfuncdepth'"));
+	rettv->v_type = VAR_NUMBER;
+	rettv->vval.v_number = -1;
 	return;
     }
+    ++depth;
+
+    line_breakcheck();		/* check for CTRL-C hit */
+
+    /* The local variables of compiled code are stored after the
+     * funccall_T, to avoid an alloc/free for each of them. */
+    room_len = func_code_room(fp);
+    fc = (funccall_T *)alloc((unsigned)(sizeof(funccall_T)
+					       + room_len * sizeof(fixvar_T)));
+    fc->l_room = room_len > 0 ? (fixvar_T *)(fc + 1) : NULL;
+    fc->l_room_len = room_len;
+    fc->caller = current_funccal;
+    current_funccal = fc;
+    fc->func = fp;
+    fc->rettv = rettv;
+    rettv->vval.v_number = 0;
+    fc->linenr = 0;
+    fc->returned = FALSE;
+    fc->level = ex_nesting_level;
+    /* Check if this function has a breakpoint. */
+    fc->breakpoint = dbg_find_breakpoint(FALSE, fp->uf_name, (linenr_T)0);
+    fc->dbg_tick = debug_tick;
 
     /*
-     * Get the function name.  There are these situations:
-     * func	    normal function name
-     *		    "name" == func, "fudi.fd_dict" == NULL
-     * dict.func    new dictionary entry
-     *		    "name" == NULL, "fudi.fd_dict" set,
-     *		    "fudi.fd_di" == NULL, "fudi.fd_newkey" == func
-     * dict.func    existing dict entry with a Funcref
-     *		    "name" == func, "fudi.fd_dict" set,
-     *		    "fudi.fd_di" set, "fudi.fd_newkey" == NULL
-     * dict.func    existing dict entry that's not a Funcref
-     *		    "name" == NULL, "fudi.fd_dict" set,
-     *		    "fudi.fd_di" set, "fudi.fd_newkey" == NULL
-     * s:func	    script-local function name
-     * g:func	    global function name, same as "func"
+     * Note about using fc->fixvar[]: This is an array of FIXVAR_CNT variables
+     * with names up to VAR_SHORT_LEN long.  This avoids having to alloc/free
+     * each argument variable and saves a lot of time.
      */
-    p = eap->arg;
-    name = trans_function_name(&p, eap->skip, 0, &fudi);
-    paren = (vim_strchr(p, '(') != NULL);
-    if (name == NULL && (fudi.fd_dict == NULL || !paren) && !eap->skip)
+    /*
+     * Init l: variables.
+     */
+    init_var_dict(&fc->l_vars, &fc->l_vars_var, VAR_DEF_SCOPE);
+    if (selfdict != NULL)
     {
-	/*
-	 * Return on an invalid expression in braces, unless the expression
-	 * evaluation has been cancelled due to an aborting error, an
-	 * interrupt, or an exception.
-	 */
-	if (!aborting())
-	{
-	    if (!eap->skip && fudi.fd_newkey != NULL)
-		EMSG2(_(e_dictkey), fudi.fd_newkey);
-	    vim_free(fudi.fd_newkey);
-	    return;
-	}
-	else
-	    eap->skip = TRUE;
+	/* Set l:self to "selfdict".  Use "name" to avoid a warning from
+	 * some compiler that checks the destination size. */
+	v = &fc->fixvar[fixvar_idx++].var;
+	name = v->di_key;
+	STRCPY(name, "self");
+	v->di_flags = DI_FLAGS_RO + DI_FLAGS_FIX;
+	hash_add(&fc->l_vars.dv_hashtab, DI2HIKEY(v));
+	v->di_tv.v_type = VAR_DICT;
+	v->di_tv.v_lock = 0;
+	v->di_tv.vval.v_dict = selfdict;
+	++selfdict->dv_refcount;
     }
 
-    /* An error in a function call during evaluation of an expression in magic
-     * braces should not cause the function not to be defined. */
-    saved_did_emsg = did_emsg;
-    did_emsg = FALSE;
+    /*
+     * Init a: variables.
+     * Set a:0 to "argcount".
+     * Set a:000 to a list with room for the "..." arguments.
+     */
+    init_var_dict(&fc->l_avars, &fc->l_avars_var, VAR_SCOPE);
+    add_nr_var(&fc->l_avars, &fc->fixvar[fixvar_idx++].var, "0",
+				(varnumber_T)(argcount - fp->uf_args.ga_len));
+    /* Use "name" to avoid a warning from some compiler that checks the
+     * destination size. */
+    v = &fc->fixvar[fixvar_idx++].var;
+    name = v->di_key;
+    STRCPY(name, "000");
+    v->di_flags = DI_FLAGS_RO | DI_FLAGS_FIX;
+    hash_add(&fc->l_avars.dv_hashtab, DI2HIKEY(v));
+    v->di_tv.v_type = VAR_LIST;
+    v->di_tv.v_lock = VAR_FIXED;
+    v->di_tv.vval.v_list = &fc->l_varlist;
+    vim_memset(&fc->l_varlist, 0, sizeof(list_T));
+    fc->l_varlist.lv_refcount = DO_NOT_FREE_CNT;
+    fc->l_varlist.lv_lock = VAR_FIXED;
 
     /*
-     * ":function func" with only function name: list function.
+     * Set a:firstline to "firstline" and a:lastline to "lastline".
+     * Set a:name to named arguments.
+     * Set a:N to the "..." arguments.
      */
-    if (!paren)
+    add_nr_var(&fc->l_avars, &fc->fixvar[fixvar_idx++].var, "firstline",
+						      (varnumber_T)firstline);
+    add_nr_var(&fc->l_avars, &fc->fixvar[fixvar_idx++].var, "lastline",
+						       (varnumber_T)lastline);
+    for (i = 0; i < argcount; ++i)
     {
-	if (!ends_excmd(*skipwhite(p)))
+	ai = i - fp->uf_args.ga_len;
+	if (ai < 0)
+	    /* named argument a:name */
+	    name = FUNCARG(fp, i);
+	else
 	{
-	    EMSG(_(e_trailing));
-	    goto ret_free;
+	    /* "..." argument a:1, a:2, etc. */
+	    sprintf((char *)numbuf, "%d", ai + 1);
+	    name = numbuf;
 	}
-	eap->nextcmd = check_nextcmd(p);
-	if (eap->nextcmd != NULL)
-	    *p = NUL;
-	if (!eap->skip && !got_int)
+	if (fixvar_idx < FIXVAR_CNT && STRLEN(name) <= VAR_SHORT_LEN)
 	{
-	    fp = find_func(name);
-	    if (fp != NULL)
-	    {
-		list_func_head(fp, TRUE);
-		for (j = 0; j < fp->uf_lines.ga_len && !got_int; ++j)
-		{
-		    if (FUNCLINE(fp, j) == NULL)
-			continue;
-		    msg_putchar('\n');
-		    msg_outnum((long)(j + 1));
-		    if (j < 9)
-			msg_putchar(' ');
-		    if (j < 99)
-			msg_putchar(' ');
-		    msg_prt_line(FUNCLINE(fp, j), FALSE);
-		    out_flush();	/* show a line at a time */
-		    ui_breakcheck();
-		}
-		if (!got_int)
-		{
-		    msg_putchar('\n');
-		    msg_puts((char_u *)"   endfunction");
-		}
-	    }
-	    else
-		emsg_funcname(N_("E123: Undefined function: %s"), name);
+	    v = &fc->fixvar[fixvar_idx++].var;
+	    v->di_flags = DI_FLAGS_RO | DI_FLAGS_FIX;
 	}
-	goto ret_free;
-    }
-
-    /*
-     * ":function name(arg1, arg2)" Define function.
-     */
-    p = skipwhite(p);
-    if (*p != '(')
-    {
-	if (!eap->skip)
+	else
 	{
-	    EMSG2(_("E124: Missing '(': %s"), eap->arg);
-	    goto ret_free;
+	    v = (dictitem_T *)alloc((unsigned)(sizeof(dictitem_T)
+							     + STRLEN(name)));
+	    if (v == NULL)
+		break;
+	    v->di_flags = DI_FLAGS_RO;
 	}
-	/* attempt to continue by skipping some text */
-	if (vim_strchr(p, '(') != NULL)
-	    p = vim_strchr(p, '(');
-    }
-    p = skipwhite(p + 1);
+	STRCPY(v->di_key, name);
+	hash_add(&fc->l_avars.dv_hashtab, DI2HIKEY(v));
 
-    ga_init2(&newargs, (int)sizeof(char_u *), 3);
-    ga_init2(&newlines, (int)sizeof(char_u *), 3);
+	/* Note: the values are copied directly to avoid alloc/free.
+	 * "argvars" must have VAR_FIXED for v_lock. */
+	v->di_tv = argvars[i];
+	v->di_tv.v_lock = VAR_FIXED;
 
-    if (!eap->skip)
-    {
-	/* Check the name of the function.  Unless it's a dictionary function
-	 * (that we are overwriting). */
-	if (name != NULL)
-	    arg = name;
-	else
-	    arg = fudi.fd_newkey;
-	if (arg != NULL && (fudi.fd_di == NULL
-				     || fudi.fd_di->di_tv.v_type != VAR_FUNC))
+	if (ai >= 0 && ai < MAX_FUNC_ARGS)
 	{
-	    if (*arg == K_SPECIAL)
-		j = 3;
-	    else
-		j = 0;
-	    while (arg[j] != NUL && (j == 0 ? eval_isnamec1(arg[j])
-						      : eval_isnamec(arg[j])))
-		++j;
-	    if (arg[j] != NUL)
-		emsg_funcname((char *)e_invarg2, arg);
+	    list_append(&fc->l_varlist, &fc->l_listitems[ai]);
+	    fc->l_listitems[ai].li_tv = argvars[i];
+	    fc->l_listitems[ai].li_tv.v_lock = VAR_FIXED;
 	}
-	/* Disallow using the g: dict. */
-	if (fudi.fd_dict != NULL && fudi.fd_dict->dv_scope == VAR_DEF_SCOPE)
-	    EMSG(_("E862: Cannot use g: here"));
     }
 
-    /*
-     * Isolate the arguments: "arg1, arg2, ...)"
-     */
-    while (*p != ')')
+    /* Don't redraw while executing the function. */
+    ++RedrawingDisabled;
+    save_sourcing_name = sourcing_name;
+    save_sourcing_lnum = sourcing_lnum;
+    sourcing_lnum = 1;
+    sourcing_name = alloc((unsigned)((save_sourcing_name == NULL ? 0
+		: STRLEN(save_sourcing_name)) + STRLEN(fp->uf_name) + 13));
+    if (sourcing_name != NULL)
     {
-	if (p[0] == '.' && p[1] == '.' && p[2] == '.')
-	{
-	    varargs = TRUE;
-	    p += 3;
-	    mustend = TRUE;
-	}
+	if (save_sourcing_name != NULL
+			  && STRNCMP(save_sourcing_name, "function ", 9) == 0)
+	    sprintf((char *)sourcing_name, "%s..", save_sourcing_name);
 	else
+	    STRCPY(sourcing_name, "function ");
+	cat_func_name(sourcing_name + STRLEN(sourcing_name), fp);
+
+	if (p_verbose >= 12)
 	{
-	    arg = p;
-	    while (ASCII_ISALNUM(*p) || *p == '_')
-		++p;
-	    if (arg == p || isdigit(*arg)
-		    || (p - arg == 9 && STRNCMP(arg, "firstline", 9) == 0)
-		    || (p - arg == 8 && STRNCMP(arg, "lastline", 8) == 0))
+	    ++no_wait_return;
+	    verbose_enter_scroll();
+
+	    smsg((char_u *)_("calling %s"), sourcing_name);
+	    if (p_verbose >= 14)
 	    {
-		if (!eap->skip)
-		    EMSG2(_("E125: Illegal argument: %s"), arg);
-		break;
-	    }
-	    if (ga_grow(&newargs, 1) == FAIL)
-		goto erret;
-	    c = *p;
-	    *p = NUL;
-	    arg = vim_strsave(arg);
-	    if (arg == NULL)
-		goto erret;
+		char_u	buf[MSG_BUF_LEN];
+		char_u	numbuf2[NUMBUFLEN];
+		char_u	*tofree;
+		char_u	*s;
 
-	    /* Check for duplicate argument name. */
-	    for (i = 0; i < newargs.ga_len; ++i)
-		if (STRCMP(((char_u **)(newargs.ga_data))[i], arg) == 0)
+		msg_puts((char_u *)"(");
+		for (i = 0; i < argcount; ++i)
 		{
-		    EMSG2(_("E853: Duplicate argument name: %s"), arg);
-		    vim_free(arg);
-		    goto erret;
+		    if (i > 0)
+			msg_puts((char_u *)", ");
+		    if (argvars[i].v_type == VAR_NUMBER)
+			msg_outnum((long)argvars[i].vval.v_number);
+		    else
+		    {
+			s = tv2string(&argvars[i], &tofree, numbuf2, 0);
+			if (s != NULL)
+			{
+			    if (vim_strsize(s) > MSG_BUF_CLEN)
+			    {
+				trunc_string(s, buf, MSG_BUF_CLEN, MSG_BUF_LEN);
+				s = buf;
+			    }
+			    msg_puts(s);
+			    vim_free(tofree);
+			}
+		    }
 		}
+		msg_puts((char_u *)")");
+	    }
+	    msg_puts((char_u *)"\n");   /* don't overwrite this either */
 
-	    ((char_u **)(newargs.ga_data))[newargs.ga_len] = arg;
-	    *p = c;
-	    newargs.ga_len++;
-	    if (*p == ',')
-		++p;
-	    else
-		mustend = TRUE;
+	    verbose_leave_scroll();
+	    --no_wait_return;
 	}
-	p = skipwhite(p);
-	if (mustend && *p != ')')
+    }
+#ifdef FEAT_PROFILE
+    if (do_profiling == PROF_YES)
+    {
+	if (!fp->uf_profiling && has_profiling(FALSE, fp->uf_name, NULL))
+	    func_do_profile(fp);
+	if (fp->uf_profiling
+		    || (fc->caller != NULL && fc->caller->func->uf_profiling))
 	{
-	    if (!eap->skip)
-		EMSG2(_(e_invarg2), eap->arg);
-	    break;
+	    ++fp->uf_tm_count;
+	    profile_start(&call_start);
+	    profile_zero(&fp->uf_tm_children);
 	}
+	script_prof_save(&wait_start);
     }
-    ++p;	/* skip the ')' */
+#endif
 
-    /* find extra arguments "range", "dict" and "abort" */
-    for (;;)
+    save_current_SID = current_SID;
+    current_SID = fp->uf_script_ID;
+    save_did_emsg = did_emsg;
+    did_emsg = FALSE;
+
+    /* call do_cmdline() to execute the lines */
+    do_cmdline(NULL, get_func_line, (void *)fc,
+				     DOCMD_NOWAIT|DOCMD_VERBOSE|DOCMD_REPEAT);
+
+    --RedrawingDisabled;
+
+    /* when the function was aborted because of an error, return -1 */
+    if ((did_emsg && (fp->uf_flags & FC_ABORT)) || rettv->v_type == VAR_UNKNOWN)
     {
-	p = skipwhite(p);
-	if (STRNCMP(p, "range", 5) == 0)
-	{
-	    flags |= FC_RANGE;
-	    p += 5;
-	}
-	else if (STRNCMP(p, "dict", 4) == 0)
+	clear_tv(rettv);
+	rettv->v_type = VAR_NUMBER;
+	rettv->vval.v_number = -1;
+    }
+
+#ifdef FEAT_PROFILE
+    if (do_profiling == PROF_YES && (fp->uf_profiling
+		    || (fc->caller != NULL && fc->caller->func->uf_profiling)))
+    {
+	profile_end(&call_start);
+	profile_sub_wait(&wait_start, &call_start);
+	profile_add(&fp->uf_tm_total, &call_start);
+	profile_self(&fp->uf_tm_self, &call_start, &fp->uf_tm_children);
+	if (fc->caller != NULL && fc->caller->func->uf_profiling)
 	{
-	    flags |= FC_DICT;
-	    p += 4;
+	    profile_add(&fc->caller->func->uf_tm_children, &call_start);
+	    profile_add(&fc->caller->func->uf_tml_children, &call_start);
 	}
-	else if (STRNCMP(p, "abort", 5) == 0)
+    }
+#endif
+
+    /* when being verbose, mention the return value */
+    if (p_verbose >= 12)
+    {
+	++no_wait_return;
+	verbose_enter_scroll();
+
+	if (aborting())
+	    smsg((char_u *)_("%s aborted"), sourcing_name);
+	else if (fc->rettv->v_type == VAR_NUMBER)
+	    smsg((char_u *)_("%s returning #%ld"), sourcing_name,
+					       (long)fc->rettv->vval.v_number);
+	else
 	{
-	    flags |= FC_ABORT;
-	    p += 5;
+	    char_u	buf[MSG_BUF_LEN];
+	    char_u	numbuf2[NUMBUFLEN];
+	    char_u	*tofree;
+	    char_u	*s;
+
+	    /* The value may be very long.  Skip the middle part, so that we
+	     * have some idea how it starts and ends. smsg() would always
+	     * truncate it at the end. */
+	    s = tv2string(fc->rettv, &tofree, numbuf2, 0);
+	    if (s != NULL)
+	    {
+		if (vim_strsize(s) > MSG_BUF_CLEN)
+		{
+		    trunc_string(s, buf, MSG_BUF_CLEN, MSG_BUF_LEN);
+		    s = buf;
+		}
+		smsg((char_u *)_("%s returning %s"), sourcing_name, s);
+		vim_free(tofree);
+	    }
 	}
-	else
-	    break;
+	msg_puts((char_u *)"\n");   /* don't overwrite this either */
+
+	verbose_leave_scroll();
+	--no_wait_return;
     }
 
-    /* When there is a line break use what follows for the function body.
-     * Makes 'exe "func Test()\n...\nendfunc"' work. */
-    if (*p == '\n')
-	line_arg = p + 1;
-    else if (*p != NUL && *p != '"' && !eap->skip && !did_emsg)
-	EMSG(_(e_trailing));
+    vim_free(sourcing_name);
+    sourcing_name = save_sourcing_name;
+    sourcing_lnum = save_sourcing_lnum;
+    current_SID = save_current_SID;
+#ifdef FEAT_PROFILE
+    if (do_profiling == PROF_YES)
+	script_prof_restore(&wait_start);
+#endif
 
-    /*
-     * Read the body of the function, until ":endfunction" is found.
-     */
-    if (KeyTyped)
+    if (p_verbose >= 12 && sourcing_name != NULL)
     {
-	/* Check if the function already exists, don't let the user type the
-	 * whole function before telling him it doesn't work!  For a script we
-	 * need to skip the body to be able to find what follows. */
-	if (!eap->skip && !eap->forceit)
-	{
-	    if (fudi.fd_dict != NULL && fudi.fd_newkey == NULL)
-		EMSG(_(e_funcdict));
-	    else if (name != NULL && find_func(name) != NULL)
-		emsg_funcname(e_funcexts, name);
-	}
+	++no_wait_return;
+	verbose_enter_scroll();
 
-	if (!eap->skip && did_emsg)
-	    goto erret;
+	smsg((char_u *)_("continuing in %s"), sourcing_name);
+	msg_puts((char_u *)"\n");   /* don't overwrite this either */
 
-	msg_putchar('\n');	    /* don't overwrite the function name */
-	cmdline_row = msg_row;
+	verbose_leave_scroll();
+	--no_wait_return;
     }
 
-    indent = 2;
-    nesting = 0;
-    for (;;)
+    did_emsg |= save_did_emsg;
+    current_funccal = fc->caller;
+    --depth;
+
+    /* If the a:000 list and the l: and a: dicts are not referenced we can
+     * free the funccall_T and what's in it. */
+    if (fc->l_varlist.lv_refcount == DO_NOT_FREE_CNT
+	    && fc->l_vars.dv_refcount == DO_NOT_FREE_CNT
+	    && fc->l_avars.dv_refcount == DO_NOT_FREE_CNT)
     {
-	if (KeyTyped)
-	{
-	    msg_scroll = TRUE;
-	    saved_wait_return = FALSE;
-	}
-	need_wait_return = FALSE;
-	sourcing_lnum_off = sourcing_lnum;
+	free_funccal(fc, FALSE);
+    }
+    else
+    {
+	hashitem_T	*hi;
+	listitem_T	*li;
+	int		todo;
 
-	if (line_arg != NULL)
+	/* "fc" is still in use.  This can happen when returning "a:000" or
+	 * assigning "l:" to a global variable.
+	 * Link "fc" in the list for garbage collection later. */
+	fc->caller = previous_funccal;
+	previous_funccal = fc;
+	gc_may_have_cycle = TRUE;
+
+	/* Make a copy of the a: variables, since we didn't do that above. */
+	todo = (int)fc->l_avars.dv_hashtab.ht_used;
+	for (hi = fc->l_avars.dv_hashtab.ht_array; todo > 0; ++hi)
 	{
-	    /* Use eap->arg, split up in parts by line breaks. */
-	    theline = line_arg;
-	    p = vim_strchr(theline, '\n');
-	    if (p == NULL)
-		line_arg += STRLEN(line_arg);
-	    else
+	    if (!HASHITEM_EMPTY(hi))
 	    {
-		*p = NUL;
-		line_arg = p + 1;
+		--todo;
+		v = HI2DI(hi);
+		copy_tv(&v->di_tv, &v->di_tv);
 	    }
 	}
-	else if (eap->getline == NULL)
-	    theline = getcmdline(':', 0L, indent);
-	else
-	    theline = eap->getline(':', eap->cookie, indent);
-	if (KeyTyped)
-	    lines_left = Rows - 1;
-	if (theline == NULL)
-	{
-	    EMSG(_("E126: Missing :endfunction"));
-	    goto erret;
-	}
 
-	/* Detect line continuation: sourcing_lnum increased more than one. */
-	if (sourcing_lnum > sourcing_lnum_off + 1)
-	    sourcing_lnum_off = sourcing_lnum - sourcing_lnum_off - 1;
-	else
-	    sourcing_lnum_off = 0;
+	/* Make a copy of the a:000 items, since we didn't do that above. */
+	for (li = fc->l_varlist.lv_first; li != NULL; li = li->li_next)
+	    copy_tv(&li->li_tv, &li->li_tv);
+    }
+}
 
-	if (skip_until != NULL)
-	{
-	    /* between ":append" and "." and between ":python <<EOF" and "EOF"
-	     * don't check for ":endfunc". */
-	    if (STRCMP(theline, skip_until) == 0)
-	    {
-		vim_free(skip_until);
-		skip_until = NULL;
-	    }
-	}
-	else
-	{
-	    /* skip ':' and blanks*/
-	    for (p = theline; vim_iswhite(*p) || *p == ':'; ++p)
-		;
+/*
+ * Return TRUE if items in "fc" do not have "copyID".  That means they are not
+ * referenced from anywhere that is in use.
+ */
+    static int
+can_free_funccal(fc, copyID)
+    funccall_T	*fc;
+    int		copyID;
+{
+    return (fc->l_varlist.lv_copyID != copyID
+	    && fc->l_vars.dv_copyID != copyID
+	    && fc->l_avars.dv_copyID != copyID);
+}
 
-	    /* Check for "endfunction". */
-	    if (checkforcmd(&p, "endfunction", 4) && nesting-- == 0)
-	    {
-		if (line_arg == NULL)
-		    vim_free(theline);
-		break;
-	    }
+/*
+ * Free "fc" and what it contains.
+ */
+   static void
+free_funccal(fc, free_val)
+    funccall_T	*fc;
+    int		free_val;  /* a: vars were allocated */
+{
+    listitem_T	*li;
 
-	    /* Increase indent inside "if", "while", "for" and "try", decrease
-	     * at "end". */
-	    if (indent > 2 && STRNCMP(p, "end", 3) == 0)
-		indent -= 2;
-	    else if (STRNCMP(p, "if", 2) == 0
-		    || STRNCMP(p, "wh", 2) == 0
-		    || STRNCMP(p, "for", 3) == 0
-		    || STRNCMP(p, "try", 3) == 0)
-		indent += 2;
+    /* The a: variables typevals may not have been allocated, only free the
+     * allocated variables. */
+    vars_clear_ext(&fc->l_avars.dv_hashtab, free_val);
 
-	    /* Check for defining a function inside this function. */
-	    if (checkforcmd(&p, "function", 2))
-	    {
-		if (*p == '!')
-		    p = skipwhite(p + 1);
-		p += eval_fname_script(p);
-		if (ASCII_ISALPHA(*p))
-		{
-		    vim_free(trans_function_name(&p, TRUE, 0, NULL));
-		    if (*skipwhite(p) == '(')
-		    {
-			++nesting;
-			indent += 2;
-		    }
-		}
-	    }
+    /* free all l: variables */
+    vars_clear(&fc->l_vars.dv_hashtab);
 
-	    /* Check for ":append" or ":insert". */
-	    p = skip_range(p, NULL);
-	    if ((p[0] == 'a' && (!ASCII_ISALPHA(p[1]) || p[1] == 'p'))
-		    || (p[0] == 'i'
-			&& (!ASCII_ISALPHA(p[1]) || (p[1] == 'n'
-				&& (!ASCII_ISALPHA(p[2]) || (p[2] == 's'))))))
-		skip_until = vim_strsave((char_u *)".");
+    /* Free the a:000 variables if they were allocated. */
+    if (free_val)
+	for (li = fc->l_varlist.lv_first; li != NULL; li = li->li_next)
+	    clear_tv(&li->li_tv);
 
-	    /* Check for ":python <<EOF", ":tcl <<EOF", etc. */
-	    arg = skipwhite(skiptowhite(p));
-	    if (arg[0] == '<' && arg[1] =='<'
-		    && ((p[0] == 'p' && p[1] == 'y'
-				    && (!ASCII_ISALPHA(p[2]) || p[2] == 't'))
-			|| (p[0] == 'p' && p[1] == 'e'
-				    && (!ASCII_ISALPHA(p[2]) || p[2] == 'r'))
-			|| (p[0] == 't' && p[1] == 'c'
-				    && (!ASCII_ISALPHA(p[2]) || p[2] == 'l'))
-			|| (p[0] == 'l' && p[1] == 'u' && p[2] == 'a'
-				    && !ASCII_ISALPHA(p[3]))
-			|| (p[0] == 'r' && p[1] == 'u' && p[2] == 'b'
-				    && (!ASCII_ISALPHA(p[3]) || p[3] == 'y'))
-			|| (p[0] == 'm' && p[1] == 'z'
-				    && (!ASCII_ISALPHA(p[2]) || p[2] == 's'))
-			))
-	    {
-		/* ":python <<" continues until a dot, like ":append" */
-		p = skipwhite(arg + 2);
-		if (*p == NUL)
-		    skip_until = vim_strsave((char_u *)".");
-		else
-		    skip_until = vim_strsave(p);
-	    }
-	}
+    vim_free(fc);
+}
 
-	/* Add the line to the function. */
-	if (ga_grow(&newlines, 1 + sourcing_lnum_off) == FAIL)
-	{
-	    if (line_arg == NULL)
-		vim_free(theline);
-	    goto erret;
-	}
+/*
+ * Add a number variable "name" to dict "dp" with value "nr".
+ */
+    static void
+add_nr_var(dp, v, name, nr)
+    dict_T	*dp;
+    dictitem_T	*v;
+    char	*name;
+    varnumber_T nr;
+{
+    STRCPY(v->di_key, name);
+    v->di_flags = DI_FLAGS_RO | DI_FLAGS_FIX;
+    hash_add(&dp->dv_hashtab, DI2HIKEY(v));
+    v->di_tv.v_type = VAR_NUMBER;
+    v->di_tv.v_lock = VAR_FIXED;
+    v->di_tv.vval.v_number = nr;
+}
 
-	/* Copy the line to newly allocated memory.  get_one_sourceline()
-	 * allocates 250 bytes per line, this saves 80% on average.  The cost
-	 * is an extra alloc/free. */
-	p = vim_strsave(theline);
-	if (p != NULL)
-	{
-	    if (line_arg == NULL)
-		vim_free(theline);
-	    theline = p;
-	}
+/*
+ * ":return [expr]"
+ */
+    void
+ex_return(eap)
+    exarg_T	*eap;
+{
+    char_u	*arg = eap->arg;
+    typval_T	rettv;
+    int		returning = FALSE;
 
-	((char_u **)(newlines.ga_data))[newlines.ga_len++] = theline;
+    if (current_funccal == NULL)
+    {
+	EMSG(_("E133: :return not inside a function"));
+	return;
+    }
 
-	/* Add NULL lines for continuation lines, so that the line count is
-	 * equal to the index in the growarray.   */
-	while (sourcing_lnum_off-- > 0)
-	    ((char_u **)(newlines.ga_data))[newlines.ga_len++] = NULL;
+    if (eap->skip)
+	++emsg_skip;
 
-	/* Check for end of eap->arg. */
-	if (line_arg != NULL && *line_arg == NUL)
-	    line_arg = NULL;
+    eap->nextcmd = NULL;
+    if ((*arg != NUL && *arg != '|' && *arg != '\n')
+	    && eval0(arg, &rettv, &eap->nextcmd, !eap->skip) != FAIL)
+    {
+	if (!eap->skip)
+	    returning = do_return(eap, FALSE, TRUE, &rettv);
+	else
+	    clear_tv(&rettv);
+    }
+    /* It's safer to return also on error. */
+    else if (!eap->skip)
+    {
+	/*
+	 * Return unless the expression evaluation has been cancelled due to an
+	 * aborting error, an interrupt, or an exception.
+	 */
+	if (!aborting())
+	    returning = do_return(eap, FALSE, TRUE, NULL);
     }
 
-    /* Don't define the function when skipping commands or when an error was
-     * detected. */
-    if (eap->skip || did_emsg)
-	goto erret;
+    /* When skipping or the return gets pending, advance to the next command
+     * in this line (!returning).  Otherwise, ignore the rest of the line.
+     * Following lines will be ignored by get_func_line(). */
+    if (returning)
+	eap->nextcmd = NULL;
+    else if (eap->nextcmd == NULL)	    /* no argument */
+	eap->nextcmd = check_nextcmd(arg);
+
+    if (eap->skip)
+	--emsg_skip;
+}
+
+/*
+ * Return from a function.  Possibly makes the return pending.  Also called
+ * for a pending return at the ":endtry" or after returning from an extra
+ * do_cmdline().  "reanimate" is used in the latter case.  "is_cmd" is set
+ * when called due to a ":return" command.  "rettv" may point to a typval_T
+ * with the return rettv.  Returns TRUE when the return can be carried out,
+ * FALSE when the return gets pending.
+ */
+    int
+do_return(eap, reanimate, is_cmd, rettv)
+    exarg_T	*eap;
+    int		reanimate;
+    int		is_cmd;
+    void	*rettv;
+{
+    int		idx;
+    struct condstack *cstack = eap->cstack;
+
+    if (reanimate)
+	/* Undo the return. */
+	current_funccal->returned = FALSE;
 
     /*
-     * If there are no errors, add the function
+     * Cleanup (and inactivate) conditionals, but stop when a try conditional
+     * not in its finally clause (which then is to be executed next) is found.
+     * In this case, make the ":return" pending for execution at the ":endtry".
+     * Otherwise, return normally.
      */
-    if (fudi.fd_dict == NULL)
+    idx = cleanup_conditionals(eap->cstack, 0, TRUE);
+    if (idx >= 0)
     {
-	v = find_var(name, &ht, FALSE);
-	if (v != NULL && v->di_tv.v_type == VAR_FUNC)
-	{
-	    emsg_funcname(N_("E707: Function name conflicts with variable: %s"),
-									name);
-	    goto erret;
-	}
+	cstack->cs_pending[idx] = CSTP_RETURN;
 
-	fp = find_func(name);
-	if (fp != NULL)
+	if (!is_cmd && !reanimate)
+	    /* A pending return again gets pending.  "rettv" points to an
+	     * allocated variable with the rettv of the original ":return"'s
+	     * argument if present or is NULL else. */
+	    cstack->cs_rettv[idx] = rettv;
+	else
 	{
-	    if (!eap->forceit)
+	    /* When undoing a return in order to make it pending, get the stored
+	     * return rettv. */
+	    if (reanimate)
+		rettv = current_funccal->rettv;
+
+	    if (rettv != NULL)
 	    {
-		emsg_funcname(e_funcexts, name);
-		goto erret;
+		/* Store the value of the pending return. */
+		if ((cstack->cs_rettv[idx] = alloc_tv()) != NULL)
+		    *(typval_T *)cstack->cs_rettv[idx] = *(typval_T *)rettv;
+		else
+		    EMSG(_(e_outofmem));
 	    }
-	    if (fp->uf_calls > 0)
+	    else
+		cstack->cs_rettv[idx] = NULL;
+
+	    if (reanimate)
 	    {
-		emsg_funcname(N_("E127: Cannot redefine function %s: It is in use"),
-									name);
-		goto erret;
+		/* The pending return value could be overwritten by a ":return"
+		 * without argument in a finally clause; reset the default
+		 * return value. */
+		current_funccal->rettv->v_type = VAR_NUMBER;
+		current_funccal->rettv->vval.v_number = 0;
 	    }
-	    /* redefine existing function */
-	    ga_clear_strings(&(fp->uf_args));
-	    ga_clear_strings(&(fp->uf_lines));
-	    vim_free(name);
-	    name = NULL;
 	}
+	report_make_pending(CSTP_RETURN, rettv);
     }
     else
     {
-	char	numbuf[20];
+	current_funccal->returned = TRUE;
 
-	fp = NULL;
-	if (fudi.fd_newkey == NULL && !eap->forceit)
-	{
-	    EMSG(_(e_funcdict));
-	    goto erret;
-	}
-	if (fudi.fd_di == NULL)
+	/* If the return is carried out now, store the return value.  For
+	 * a return immediately after reanimation, the value is already
+	 * there. */
+	if (!reanimate && rettv != NULL)
 	{
-	    /* Can't add a function to a locked dictionary */
-	    if (tv_check_lock(fudi.fd_dict->dv_lock, eap->arg))
-		goto erret;
+	    clear_tv(current_funccal->rettv);
+	    *current_funccal->rettv = *(typval_T *)rettv;
+	    if (!is_cmd)
+		vim_free(rettv);
 	}
-	    /* Can't change an existing function if it is locked */
-	else if (tv_check_lock(fudi.fd_di->di_tv.v_lock, eap->arg))
-	    goto erret;
-
-	/* Give the function a sequential number.  Can only be used with a
-	 * Funcref! */
-	vim_free(name);
-	sprintf(numbuf, "%d", ++func_nr);
-	name = vim_strsave((char_u *)numbuf);
-	if (name == NULL)
-	    goto erret;
     }
 
-    if (fp == NULL)
-    {
-	if (fudi.fd_dict == NULL && vim_strchr(name, AUTOLOAD_CHAR) != NULL)
-	{
-	    int	    slen, plen;
-	    char_u  *scriptname;
-
-	    /* Check that the autoload name matches the script name. */
-	    j = FAIL;
-	    if (sourcing_name != NULL)
-	    {
-		scriptname = autoload_name(name);
-		if (scriptname != NULL)
-		{
-		    p = vim_strchr(scriptname, '/');
-		    plen = (int)STRLEN(p);
-		    slen = (int)STRLEN(sourcing_name);
-		    if (slen > plen && fnamecmp(p,
-					    sourcing_name + slen - plen) == 0)
-			j = OK;
-		    vim_free(scriptname);
-		}
-	    }
-	    if (j == FAIL)
-	    {
-		EMSG2(_("E746: Function name does not match script file name: %s"), name);
-		goto erret;
-	    }
-	}
-
-	fp = (ufunc_T *)alloc((unsigned)(sizeof(ufunc_T) + STRLEN(name)));
-	if (fp == NULL)
-	    goto erret;
-
-	if (fudi.fd_dict != NULL)
-	{
-	    if (fudi.fd_di == NULL)
-	    {
-		/* add new dict entry */
-		fudi.fd_di = dictitem_alloc(fudi.fd_newkey);
-		if (fudi.fd_di == NULL)
-		{
-		    vim_free(fp);
-		    goto erret;
-		}
-		if (dict_add(fudi.fd_dict, fudi.fd_di) == FAIL)
-		{
-		    vim_free(fudi.fd_di);
-		    vim_free(fp);
-		    goto erret;
-		}
-	    }
-	    else
-		/* overwrite existing dict entry */
-		clear_tv(&fudi.fd_di->di_tv);
-	    fudi.fd_di->di_tv.v_type = VAR_FUNC;
-	    fudi.fd_di->di_tv.v_lock = 0;
-	    fudi.fd_di->di_tv.vval.v_string = vim_strsave(name);
-	    fp->uf_refcount = 1;
-
-	    /* behave like "dict" was used */
-	    flags |= FC_DICT;
-	}
-
-	/* insert the new function in the function list */
-	STRCPY(fp->uf_name, name);
-	hash_add(&func_hashtab, UF2HIKEY(fp));
-    }
-    fp->uf_args = newargs;
-    fp->uf_lines = newlines;
-#ifdef FEAT_PROFILE
-    fp->uf_tml_count = NULL;
-    fp->uf_tml_total = NULL;
-    fp->uf_tml_self = NULL;
-    fp->uf_profiling = FALSE;
-    if (prof_def_func())
-	func_do_profile(fp);
-#endif
-    fp->uf_varargs = varargs;
-    fp->uf_flags = flags;
-    fp->uf_calls = 0;
-    fp->uf_script_ID = current_SID;
-    goto ret_free;
+    return idx < 0;
+}
 
-erret:
-    ga_clear_strings(&newargs);
-    ga_clear_strings(&newlines);
-ret_free:
-    vim_free(skip_until);
-    vim_free(fudi.fd_newkey);
-    vim_free(name);
-    did_emsg |= saved_did_emsg;
-    need_wait_return |= saved_wait_return;
+/*
+ * Free the variable with a pending return value.
+ */
+    void
+discard_pending_return(rettv)
+    void	*rettv;
+{
+    free_tv((typval_T *)rettv);
 }
 
 /*
- * Get a function name, translating "<SID>" and "<SNR>".
- * Also handles a Funcref in a List or Dictionary.
- * Returns the function name in allocated memory, or NULL for failure.
- * flags:
- * TFN_INT:         internal function name OK
- * TFN_QUIET:       be quiet
- * TFN_NO_AUTOLOAD: do not use script autoloading
- * Advances "pp" to just after the function name (if no error).
+ * Generate a return command for producing the value of "rettv".  The result
+ * is an allocated string.  Used by report_pending() for verbose messages.
  */
-    static char_u *
-trans_function_name(pp, skip, flags, fdp)
-    char_u	**pp;
-    int		skip;		/* only find the end, don't evaluate */
-    int		flags;
-    funcdict_T	*fdp;		/* return: info about dictionary used */
+    char_u *
+get_return_cmd(rettv)
+    void	*rettv;
 {
-    char_u	*name = NULL;
-    char_u	*start;
-    char_u	*end;
-    int		lead;
-    char_u	sid_buf[20];
-    int		len;
-    lval_T	lv;
+    char_u	*s = NULL;
+    char_u	*tofree = NULL;
+    char_u	numbuf[NUMBUFLEN];
 
-    if (fdp != NULL)
-	vim_memset(fdp, 0, sizeof(funcdict_T));
-    start = *pp;
+    if (rettv != NULL)
+	s = echo_string((typval_T *)rettv, &tofree, numbuf, 0);
+    if (s == NULL)
+	s = (char_u *)"";
 
-    /* Check for hard coded <SNR>: already translated function ID (from a user
-     * command). */
-    if ((*pp)[0] == K_SPECIAL && (*pp)[1] == KS_EXTRA
-						   && (*pp)[2] == (int)KE_SNR)
-    {
-	*pp += 3;
-	len = get_id_len(pp) + 3;
-	return vim_strnsave(start, len);
-    }
+    STRCPY(IObuff, ":return ");
+    STRNCPY(IObuff + 8, s, IOSIZE - 8);
+    if (STRLEN(s) + 8 >= IOSIZE)
+	STRCPY(IObuff + IOSIZE - 4, "...");
+    vim_free(tofree);
+    return vim_strsave(IObuff);
+}
 
-    /* A name starting with "<SID>" or "<SNR>" is local to a script.  But
-     * don't skip over "s:", get_lval() needs it for "s:dict.func". */
-    lead = eval_fname_script(start);
-    if (lead > 2)
-	start += lead;
+/*
+ * Get next function line.
+ * Called by do_cmdline() to get the next line.
+ * Returns allocated string, or NULL for end of function.
+ */
+    char_u *
+get_func_line(c, cookie, indent)
+    int	    c UNUSED;
+    void    *cookie;
+    int	    indent UNUSED;
+{
+    funccall_T	*fcp = (funccall_T *)cookie;
+    ufunc_T	*fp = fcp->func;
+    char_u	*retval;
+    garray_T	*gap;  /* growarray with function lines */
 
-    /* Note that TFN_ flags use the same values as GLV_ flags. */
-    end = get_lval(start, NULL, &lv, FALSE, skip, flags,
-					      lead > 2 ? 0 : FNE_CHECK_START);
-    if (end == start)
-    {
-	if (!skip)
-	    EMSG(_("E129: Function name required"));
-	goto theend;
-    }
-    if (end == NULL || (lv.ll_tv != NULL && (lead > 2 || lv.ll_range)))
+    /* If breakpoints have been added/deleted need to check for it. */
+    if (fcp->dbg_tick != debug_tick)
     {
-	/*
-	 * Report an invalid expression in braces, unless the expression
-	 * evaluation has been cancelled due to an aborting error, an
-	 * interrupt, or an exception.
-	 */
-	if (!aborting())
-	{
-	    if (end != NULL)
-		EMSG2(_(e_invarg2), start);
-	}
-	else
-	    *pp = find_name_end(start, NULL, NULL, FNE_INCL_BR);
-	goto theend;
+	fcp->breakpoint = dbg_find_breakpoint(FALSE, fp->uf_name,
+							       sourcing_lnum);
+	fcp->dbg_tick = debug_tick;
     }
+#ifdef FEAT_PROFILE
+    if (do_profiling == PROF_YES)
+	func_line_end(cookie);
+#endif
 
-    if (lv.ll_tv != NULL)
+    gap = &fp->uf_lines;
+    if (((fp->uf_flags & FC_ABORT) && did_emsg && !aborted_in_try())
+	    || fcp->returned)
+	retval = NULL;
+    else
     {
-	if (fdp != NULL)
-	{
-	    fdp->fd_dict = lv.ll_dict;
-	    fdp->fd_newkey = lv.ll_newkey;
-	    lv.ll_newkey = NULL;
-	    fdp->fd_di = lv.ll_di;
-	}
-	if (lv.ll_tv->v_type == VAR_FUNC && lv.ll_tv->vval.v_string != NULL)
-	{
-	    name = vim_strsave(lv.ll_tv->vval.v_string);
-	    *pp = end;
-	}
+	/* Skip NULL lines (continuation lines). */
+	while (fcp->linenr < gap->ga_len
+			  && ((char_u **)(gap->ga_data))[fcp->linenr] == NULL)
+	    ++fcp->linenr;
+	if (fcp->linenr >= gap->ga_len)
+	    retval = NULL;
 	else
 	{
-	    if (!skip && !(flags & TFN_QUIET) && (fdp == NULL
-			     || lv.ll_dict == NULL || fdp->fd_newkey == NULL))
-		EMSG(_(e_funcref));
-	    else
-		*pp = end;
-	    name = NULL;
+	    retval = vim_strsave(((char_u **)(gap->ga_data))[fcp->linenr++]);
+	    sourcing_lnum = fcp->linenr;
+#ifdef FEAT_PROFILE
+	    if (do_profiling == PROF_YES)
+		func_line_start(cookie);
+#endif
 	}
-	goto theend;
     }
 
-    if (lv.ll_name == NULL)
+    /* Did we encounter a breakpoint? */
+    if (fcp->breakpoint != 0 && fcp->breakpoint <= sourcing_lnum)
     {
-	/* Error found, but continue after the function name. */
-	*pp = end;
-	goto theend;
+	dbg_breakpoint(fp->uf_name, sourcing_lnum);
+	/* Find next breakpoint. */
+	fcp->breakpoint = dbg_find_breakpoint(FALSE, fp->uf_name,
+							       sourcing_lnum);
+	fcp->dbg_tick = debug_tick;
     }
 
-    /* Check if the name is a Funcref.  If so, use the value. */
-    if (lv.ll_exp_name != NULL)
-    {
-	len = (int)STRLEN(lv.ll_exp_name);
-	name = deref_func_name(lv.ll_exp_name, &len, flags & TFN_NO_AUTOLOAD);
-	if (name == lv.ll_exp_name)
-	    name = NULL;
-    }
-    else
-    {
-	len = (int)(end - *pp);
-	name = deref_func_name(*pp, &len, flags & TFN_NO_AUTOLOAD);
-	if (name == *pp)
-	    name = NULL;
-    }
-    if (name != NULL)
-    {
-	name = vim_strsave(name);
-	*pp = end;
-	if (STRNCMP(name, "<SNR>", 5) == 0)
-	{
-	    /* Change "<SNR>" to the byte sequence. */
-	    name[0] = K_SPECIAL;
-	    name[1] = KS_EXTRA;
-	    name[2] = (int)KE_SNR;
-	    mch_memmove(name + 3, name + 5, STRLEN(name + 5) + 1);
-	}
-	goto theend;
-    }
+    return retval;
+}
 
-    if (lv.ll_exp_name != NULL)
-    {
-	len = (int)STRLEN(lv.ll_exp_name);
-	if (lead <= 2 && lv.ll_name == lv.ll_exp_name
-					 && STRNCMP(lv.ll_name, "s:", 2) == 0)
-	{
-	    /* When there was "s:" already or the name expanded to get a
-	     * leading "s:" then remove it. */
-	    lv.ll_name += 2;
-	    len -= 2;
-	    lead = 2;
-	}
-    }
-    else
-    {
-	/* skip over "s:" and "g:" */
-	if (lead == 2 || (lv.ll_name[0] == 'g' && lv.ll_name[1] == ':'))
-	    lv.ll_name += 2;
-	len = (int)(end - lv.ll_name);
-    }
+#if defined(FEAT_PROFILE) || defined(PROTO)
+/*
+ * Called when starting to read a function line.
+ * "sourcing_lnum" must be correct!
+ * When skipping lines it may not actually be executed, but we won't find out
+ * until later and we need to store the time now.
+ */
+    void
+func_line_start(cookie)
+    void    *cookie;
+{
+    funccall_T	*fcp = (funccall_T *)cookie;
+    ufunc_T	*fp = fcp->func;
 
-    /*
-     * Copy the function name to allocated memory.
-     * Accept <SID>name() inside a script, translate into <SNR>123_name().
-     * Accept <SNR>123_name() outside a script.
-     */
-    if (skip)
-	lead = 0;	/* do nothing */
-    else if (lead > 0)
-    {
-	lead = 3;
-	if ((lv.ll_exp_name != NULL && eval_fname_sid(lv.ll_exp_name))
-						       || eval_fname_sid(*pp))
-	{
-	    /* It's "s:" or "<SID>" */
-	    if (current_SID <= 0)
-	    {
-		EMSG(_(e_usingsid));
-		goto theend;
-	    }
-	    sprintf((char *)sid_buf, "%ld_", (long)current_SID);
-	    lead += (int)STRLEN(sid_buf);
-	}
-    }
-    else if (!(flags & TFN_INT) && builtin_function(lv.ll_name, len))
+    if (fp->uf_profiling && sourcing_lnum >= 1
+				      && sourcing_lnum <= fp->uf_lines.ga_len)
     {
-	EMSG2(_("E128: Function name must start with a capital or \"s:\": %s"),
-								       start);
-	goto theend;
+	fp->uf_tml_idx = sourcing_lnum - 1;
+	/* Skip continuation lines. */
+	while (fp->uf_tml_idx > 0 && FUNCLINE(fp, fp->uf_tml_idx) == NULL)
+	    --fp->uf_tml_idx;
+	fp->uf_tml_execed = FALSE;
+	profile_start(&fp->uf_tml_start);
+	profile_zero(&fp->uf_tml_children);
+	profile_get_wait(&fp->uf_tml_wait);
     }
-    if (!skip && !(flags & TFN_QUIET))
-    {
-	char_u *cp = vim_strchr(lv.ll_name, ':');
+}
 
-	if (cp != NULL && cp < end)
-	{
-	    EMSG2(_("E884: Function name cannot contain a colon: %s"), start);
-	    goto theend;
-	}
-    }
+/*
+ * Called when actually executing a function line.
+ */
+    void
+func_line_exec(cookie)
+    void    *cookie;
+{
+    funccall_T	*fcp = (funccall_T *)cookie;
+    ufunc_T	*fp = fcp->func;
 
-    name = alloc((unsigned)(len + lead + 1));
-    if (name != NULL)
+    if (fp->uf_profiling && fp->uf_tml_idx >= 0)
+	fp->uf_tml_execed = TRUE;
+}
+
+/*
+ * Called when done with a function line.
+ */
+    void
+func_line_end(cookie)
+    void    *cookie;
+{
+    funccall_T	*fcp = (funccall_T *)cookie;
+    ufunc_T	*fp = fcp->func;
+
+    if (fp->uf_profiling && fp->uf_tml_idx >= 0)
     {
-	if (lead > 0)
+	if (fp->uf_tml_execed)
 	{
-	    name[0] = K_SPECIAL;
-	    name[1] = KS_EXTRA;
-	    name[2] = (int)KE_SNR;
-	    if (lead > 3)	/* If it's "<SID>" */
-		STRCPY(name + 3, sid_buf);
+	    ++fp->uf_tml_count[fp->uf_tml_idx];
+	    profile_end(&fp->uf_tml_start);
+	    profile_sub_wait(&fp->uf_tml_wait, &fp->uf_tml_start);
+	    profile_add(&fp->uf_tml_total[fp->uf_tml_idx], &fp->uf_tml_start);
+	    profile_self(&fp->uf_tml_self[fp->uf_tml_idx], &fp->uf_tml_start,
+							&fp->uf_tml_children);
 	}
-	mch_memmove(name + lead, lv.ll_name, (size_t)len);
-	name[lead + len] = NUL;
+	fp->uf_tml_idx = -1;
     }
-    *pp = end;
-
-theend:
-    clear_lval(&lv);
-    return name;
 }
+#endif
 
 /*
- * Return 5 if "p" starts with "<SID>" or "<SNR>" (ignoring case).
- * Return 2 if "p" starts with "s:".
- * Return 0 otherwise.
+ * Return TRUE if the currently active function should be ended, because a
+ * return was encountered or an error occurred.  Used inside a ":while".
  */
-    static int
-eval_fname_script(p)
-    char_u	*p;
+    int
+func_has_ended(cookie)
+    void    *cookie;
 {
-    if (p[0] == '<' && (STRNICMP(p + 1, "SID>", 4) == 0
-					  || STRNICMP(p + 1, "SNR>", 4) == 0))
-	return 5;
-    if (p[0] == 's' && p[1] == ':')
-	return 2;
-    return 0;
+    funccall_T  *fcp = (funccall_T *)cookie;
+
+    /* Ignore the "abort" flag if the abortion behavior has been changed due to
+     * an error inside a try conditional. */
+    return (((fcp->func->uf_flags & FC_ABORT) && did_emsg && !aborted_in_try())
+	    || fcp->returned);
 }
 
 /*
- * Return TRUE if "p" starts with "<SID>" or "s:".
- * Only works if eval_fname_script() returned non-zero for "p"!
+ * return TRUE if cookie indicates a function which "abort"s on errors.
  */
-    static int
-eval_fname_sid(p)
-    char_u	*p;
+    int
+func_has_abort(cookie)
+    void    *cookie;
 {
-    return (*p == 's' || TOUPPER_ASC(p[2]) == 'I');
+    return ((funccall_T *)cookie)->func->uf_flags & FC_ABORT;
 }
 
+
 /*
- * List the head of the function: "name(arg1, arg2)".
+ * Compiled user functions.
+ *
+ * The first time a user function is called its lines are compiled into a
+ * list of instructions, which func_exec_code() executes instead of parsing
+ * the lines again and again.  ":if", ":while", ":for" and friends become
+ * jumps, ":let", ":call" and ":return" and the expressions they use become
+ * operations on a stack of typval_T.  Commands and expressions that are not
+ * compiled are kept as text and executed with do_one_cmd() and eval0().
+ * Each command still goes through the same checks as in do_cmdline(), thus
+ * error messages, aborting and exceptions work as before.
+ */
+
+/* Kind of a block, stored in fc_blocks. */
+#define VMB_NONE	0
+#define VMB_IF		1
+#define VMB_WHILE	2
+#define VMB_FOR		3
+
+/* Flags for ISN_END. */
+#define VME_LOOP	1	/* jump back to the loop unless aborting */
+#define VME_STOP	2	/* stop executing after the command */
+#define VME_SKIP	4	/* when failed skip the rest of the line, jump
+				   to isn_d */
+
+/* Result of a condition. */
+#define VMC_FALSE	0
+#define VMC_TRUE	1
+#define VMC_ERROR	2
+
+/* Result of vm_cmd_done(). */
+#define VMD_NEXT	0
+#define VMD_JUMP	1
+#define VMD_STOP	2
+
+#define VM_STACK_LEN	40	/* stack size that doesn't need allocating */
+#define VM_CALL_LEN	10	/* nr of calls that doesn't need allocating */
+#define VM_SLOT_LEN	30	/* nr of slots that doesn't need allocating */
+
+typedef enum
+{
+    ISN_LINE,		/* start command in line isn_a */
+    ISN_EXEC,		/* execute command isn_s in line isn_a */
+    ISN_END,		/* end of command isn_s */
+    ISN_EXPR,		/* start expression, isn_a uses the value */
+    ISN_EVAL0,		/* push the value of expression isn_s */
+    ISN_PUSHNR,		/* push Number isn_n */
+    ISN_PUSHSTR,	/* push String isn_s, "str" to be parsed if isn_b */
+#ifdef FEAT_FLOAT
+    ISN_PUSHFLOAT,	/* push Float isn_f */
+#endif
+    ISN_PUSHIC,		/* push the value of 'ignorecase' */
+    ISN_LOADVAR,	/* push variable isn_s */
+    ISN_LOADSLOT,	/* push variable isn_s in slot isn_b */
+    ISN_LOADOPT,	/* push option "&name" isn_s */
+    ISN_LOADENV,	/* push environment variable "$NAME" isn_s */
+    ISN_LOADREG,	/* push register isn_a */
+    ISN_NEWLIST,	/* make a List of isn_a values */
+    ISN_INDEXCHK,	/* check the value can be indexed */
+    ISN_STRCHK,		/* check the index is a Number or String */
+    ISN_INDEX,		/* index with isn_a: 1 first, 2 second; isn_b range */
+    ISN_ADDCHK,		/* check the first operand of isn_a */
+    ISN_ADD,		/* '+', '-' or '.' isn_a */
+    ISN_MULPREP,	/* make the first operand of '*' a Number */
+    ISN_MUL,		/* '*', '/' or '%' isn_a */
+    ISN_COMPARE,	/* compare isn_a, "is" isn_b, isn_c ic (2: on stack) */
+    ISN_ORTEST,		/* when TRUE push 1 and jump to isn_a */
+    ISN_ANDTEST,	/* when FALSE push 0 and jump to isn_a */
+    ISN_TERNTEST,	/* when FALSE jump to isn_a */
+    ISN_LEADER,		/* apply isn_a chars '!', '-' and '+' at isn_s */
+    ISN_FUNCPREP,	/* prepare call of isn_s, builtin isn_a or -1 */
+    ISN_CALLPREP,	/* prepare ":call" of isn_s */
+    ISN_BCALL,		/* call builtin isn_a with isn_b arguments */
+    ISN_UCALL,		/* call prepared function with isn_b arguments */
+    ISN_POP,		/* drop the value */
+    ISN_STORE,		/* assign to variable isn_s with operator isn_a */
+    ISN_STORESLOT,	/* idem, variable in slot isn_b */
+    ISN_TEST,		/* use the value as a condition */
+    ISN_JCOND,		/* jump to isn_a for FALSE, isn_b for an error */
+    ISN_JUMP,		/* jump to isn_a */
+    ISN_RETURN,		/* return, with the value if isn_a is set */
+    ISN_FORINIT,	/* start ":for" loop isn_a */
+    ISN_FORNEXT,	/* next item for ":for" loop isn_a */
+    ISN_FORFREE,	/* end ":for" loop isn_a */
+    ISN_FINISH		/* end of the function */
+} isntype_T;
+
+/*
+ * One instruction.  The meaning of the fields depends on "isn_type", see
+ * isntype_T.  Text in "isn_s" and "isn_s2" is owned by the fc_pool.
  */
-    static void
-list_func_head(fp, indent)
-    ufunc_T	*fp;
-    int		indent;
+typedef struct
 {
-    int		j;
+    int		isn_type;
+    int		isn_a;
+    int		isn_b;
+    int		isn_c;
+    int		isn_d;
+    char_u	*isn_s;
+    char_u	*isn_s2;
+    varnumber_T	isn_n;
+#ifdef FEAT_FLOAT
+    float_T	isn_f;
+#endif
+} isn_T;
 
-    msg_start();
-    if (indent)
-	MSG_PUTS("   ");
-    MSG_PUTS("function ");
-    if (fp->uf_name[0] == K_SPECIAL)
-    {
-	MSG_PUTS_ATTR("<SNR>", hl_attr(HLF_8));
-	msg_puts(fp->uf_name + 3);
-    }
-    else
-	msg_puts(fp->uf_name);
-    msg_putchar('(');
-    for (j = 0; j < fp->uf_args.ga_len; ++j)
-    {
-	if (j)
-	    MSG_PUTS(", ");
-	msg_puts(FUNCARG(fp, j));
-    }
-    if (fp->uf_varargs)
-    {
-	if (j)
-	    MSG_PUTS(", ");
-	MSG_PUTS("...");
-    }
-    msg_putchar(')');
-    if (fp->uf_flags & FC_ABORT)
-	MSG_PUTS(" abort");
-    if (fp->uf_flags & FC_RANGE)
-	MSG_PUTS(" range");
-    if (fp->uf_flags & FC_DICT)
-	MSG_PUTS(" dict");
-    msg_clr_eos();
-    if (p_verbose > 0)
-	last_set_msg(fp->uf_script_ID);
-}
+/*
+ * A local or argument variable used by the compiled code.  Each one gets a
+ * slot, the variable is looked up only once in a call.
+ */
+typedef struct
+{
+    char_u	*vs_name;	/* name without "l:" or "a:" */
+    int		vs_arg;		/* TRUE for an a: variable */
+    int		vs_room;	/* index in fc->l_room or -1 */
+} vmslot_T;
 
 /*
- * Find a function by name, return pointer to it in ufuncs.
- * Return NULL for unknown function.
+ * The compiled code of a user function.
  */
-    static ufunc_T *
-find_func(name)
-    char_u	*name;
+struct funccode_S
 {
-    hashitem_T	*hi;
+    garray_T	fc_instr;	/* isn_T items */
+    garray_T	fc_pool;	/* allocated text used by the instructions */
+    garray_T	fc_slots;	/* vmslot_T items */
+    int		fc_room_len;	/* nr of slots with a "vs_room" */
+    garray_T	fc_blocks;	/* VMB_ kind of each block, as int */
+    int		*fc_line_instr;	/* first instruction of each line */
+    int		*fc_line_block;	/* innermost block at start of each line */
+    int		fc_stack_len;	/* maximum depth of the stack */
+    int		fc_call_len;	/* maximum nr of calls being prepared */
+    int		fc_for_len;	/* nr of ":for" loops */
+};
 
-    hi = hash_find(&func_hashtab, name);
-    if (!HASHITEM_EMPTY(hi))
-	return HI2UF(hi);
-    return NULL;
-}
+/*
+ * Function call being prepared, while evaluating the arguments.
+ */
+typedef struct
+{
+    char_u	*vc_name;	/* function name */
+    int		vc_len;		/* length of "vc_name" */
+    char_u	*vc_tofree;	/* allocated name or NULL */
+    char_u	*vc_ename;	/* name for error messages */
+    dict_T	*vc_dict;	/* Dictionary for "self" */
+    linenr_T	vc_lnum;	/* cursor line when preparing */
+} vmcall_T;
 
-#if defined(EXITFREE) || defined(PROTO)
-    void
-free_all_functions()
+/*
+ * Block of ":if", ":while" or ":for" being compiled.
+ */
+typedef struct
 {
-    hashitem_T	*hi;
+    int		cb_kind;	/* VMB_IF, VMB_WHILE or VMB_FOR */
+    int		cb_id;		/* index in fc_blocks */
+    int		cb_head;	/* :while: instruction to jump back to */
+    int		cb_next;	/* :if: ISN_JCOND for the next branch or -1 */
+    int		cb_had_else;	/* :if: ":else" was found */
+    garray_T	cb_exit;	/* jumps to the end of the block */
+    garray_T	cb_cont;	/* :for: jumps to the head */
+    int		cb_body;	/* :for: first instruction of the body */
+    int		cb_lnum;	/* :for: line number */
+    isn_T	cb_fornext;	/* :for: the ISN_FORNEXT instruction */
+} vmblock_T;
 
-    /* Need to start all over every time, because func_free() may change the
-     * hash table. */
-    while (func_hashtab.ht_used > 0)
-	for (hi = func_hashtab.ht_array; ; ++hi)
-	    if (!HASHITEM_EMPTY(hi))
-	    {
-		func_free(HI2UF(hi));
-		break;
-	    }
-}
-#endif
+/*
+ * State while compiling a function.
+ */
+typedef struct
+{
+    funccode_T	*cc_code;
+    funccall_T	*cc_fc;		/* function call for a dry run */
+    int		cc_lnum;	/* line number being compiled */
+    int		cc_depth;	/* current depth of the stack */
+    int		cc_calls;	/* current nr of calls being prepared */
+    int		cc_blockcount;	/* nr of open blocks */
+    vmblock_T	cc_block[CSTACK_LEN];
+    garray_T	cc_execs;	/* ISN_EXEC instructions of the line */
+    garray_T	cc_skips;	/* ISN_END with VME_SKIP of the line */
+} vmcctx_T;
 
+/*
+ * State of the slots while executing compiled code.
+ */
+typedef struct
+{
+    funccall_T	*vf_fc;
+    funccode_T	*vf_code;
+    dictitem_T	**vf_slots;	/* variable of each slot or NULL */
+    long_u	vf_l_changed;	/* ht_changed of l: when "vf_slots" is valid */
+    long_u	vf_a_changed;	/* ht_changed of a: when "vf_slots" is valid */
+} vmframe_T;
+
+#define VM_ISN(cc, i)	(((isn_T *)(cc)->cc_code->fc_instr.ga_data) + (i))
+#define VM_LEN(cc)	((cc)->cc_code->fc_instr.ga_len)
+
+static funccode_T *func_compile __ARGS((funccall_T *fc));
+static isn_T *vm_emit __ARGS((vmcctx_T *cc, int type));
+static char_u *vm_pool __ARGS((vmcctx_T *cc, char_u *p, int len));
+static int vm_pool_add __ARGS((vmcctx_T *cc, char_u *p));
+static void vm_depth __ARGS((vmcctx_T *cc, int n));
+static int vm_add_patch __ARGS((garray_T *gap, int idx, int field));
+static void vm_patch __ARGS((vmcctx_T *cc, garray_T *gap, int target));
+static int vm_block_kind __ARGS((vmcctx_T *cc, int depth));
+static int vm_compile_line __ARGS((vmcctx_T *cc, char_u *line));
+static int vm_compile_cmd __ARGS((vmcctx_T *cc, char_u *seg, int first, char_u **nextp));
+static int vm_compile_exec __ARGS((vmcctx_T *cc, char_u *seg, char_u **nextp));
+static int vm_compile_let __ARGS((vmcctx_T *cc, char_u *arg, char_u **nextp));
+static int vm_compile_call __ARGS((vmcctx_T *cc, char_u *arg, char_u **nextp));
+static int vm_compile_return __ARGS((vmcctx_T *cc, char_u *arg, char_u **nextp));
+static int vm_compile_control __ARGS((vmcctx_T *cc, cmdidx_T cmdidx, char_u *arg, int first, char_u **nextp));
+static int vm_compile_expr __ARGS((vmcctx_T *cc, char_u *arg, char_u *e15text, char_u **nextp));
+static int vm_compile_cond __ARGS((vmcctx_T *cc, char_u *arg, char_u **nextp));
+static int vm_emit_line __ARGS((vmcctx_T *cc, int lnum));
+static int vm_emit_end __ARGS((vmcctx_T *cc, char *name, int target, int flags, int kind));
+static int vm_expr1 __ARGS((vmcctx_T *cc, char_u **arg));
+static int vm_expr2 __ARGS((vmcctx_T *cc, char_u **arg));
+static int vm_expr3 __ARGS((vmcctx_T *cc, char_u **arg));
+static int vm_expr4 __ARGS((vmcctx_T *cc, char_u **arg));
+static int vm_expr5 __ARGS((vmcctx_T *cc, char_u **arg));
+static int vm_expr6 __ARGS((vmcctx_T *cc, char_u **arg, int want_string));
+static int vm_expr7 __ARGS((vmcctx_T *cc, char_u **arg, int want_string));
+static int vm_call __ARGS((vmcctx_T *cc, char_u *name, int len, char_u *ename, int cmd, char_u **arg));
+static int vm_is_const __ARGS((vmcctx_T *cc, int idx));
+static void vm_isn2tv __ARGS((isn_T *isn, typval_T *tv));
+static int vm_tv2isn __ARGS((vmcctx_T *cc, typval_T *tv, int idx));
+static int vm_slot __ARGS((vmcctx_T *cc, char_u *name));
+static dictitem_T *vm_slot_find __ARGS((vmframe_T *vf, int idx));
+static void vm_slot_set __ARGS((vmframe_T *vf, int idx, char_u *name, typval_T *tv, int copy));
+static int vm_cmd_done __ARGS((funccall_T *fc, struct condstack *cstack, int initial_trylevel, int loop));
+
+/*
+ * Return TRUE when the function of "cookie" can be executed with
+ * func_exec_code().  Compiles the function the first time.
+ * Not when debugging, profiling or listing executed lines, these need to be
+ * done line by line.
+ */
     int
-translated_function_exists(name)
-    char_u	*name;
+func_code_usable(cookie)
+    void	*cookie;
 {
-    if (builtin_function(name, -1))
-	return find_internal_func(name) >= 0;
-    return find_func(name) != NULL;
+    funccall_T	*fc = (funccall_T *)cookie;
+    ufunc_T	*fp = fc->func;
+
+    if (fc->breakpoint != 0 || debug_break_level >= 0 || p_verbose >= 15
+#ifdef FEAT_PROFILE
+	    || do_profiling == PROF_YES
+#endif
+	    || got_int)
+	return FALSE;
+    if (!fp->uf_code_tried)
+    {
+	fp->uf_code_tried = TRUE;
+	fp->uf_code = func_compile(fc);
+    }
+    return fp->uf_code != NULL;
 }
 
 /*
- * Return TRUE if a function "name" exists.
+ * Free the compiled code of function "fp".
  */
-    static int
-function_exists(name)
-    char_u *name;
+    static void
+func_code_free(fp)
+    ufunc_T	*fp;
 {
-    char_u  *nm = name;
-    char_u  *p;
-    int	    n = FALSE;
+    funccode_T	*code = fp->uf_code;
 
-    p = trans_function_name(&nm, FALSE, TFN_INT|TFN_QUIET|TFN_NO_AUTOLOAD,
-			    NULL);
-    nm = skipwhite(nm);
+    if (code != NULL)
+    {
+	ga_clear(&code->fc_instr);
+	ga_clear_strings(&code->fc_pool);
+	ga_clear(&code->fc_slots);
+	ga_clear(&code->fc_blocks);
+	vim_free(code->fc_line_instr);
+	vim_free(code->fc_line_block);
+	vim_free(code);
+    }
+    fp->uf_code = NULL;
+    fp->uf_code_tried = FALSE;
+}
 
-    /* Only accept "funcname", "funcname ", "funcname (..." and
-     * "funcname(...", not "funcname!...". */
-    if (p != NULL && (*nm == NUL || *nm == '('))
-	n = translated_function_exists(p);
-    vim_free(p);
-    return n;
+/*
+ * Return the nr of local variables of function "fp" that can be stored in
+ * the funccall_T.  Zero when it was not compiled.
+ */
+    static int
+func_code_room(fp)
+    ufunc_T	*fp;
+{
+    return fp->uf_code == NULL ? 0 : fp->uf_code->fc_room_len;
 }
 
-    char_u *
-get_expanded_name(name, check)
-    char_u	*name;
-    int		check;
+/*
+ * Compile the lines of the function called with "fc".
+ * Returns NULL when the function can't be compiled, e.g. because it uses
+ * ":try" or the structure of ":if" and ":while" is wrong.
+ */
+    static funccode_T *
+func_compile(fc)
+    funccall_T	*fc;
+{
+    ufunc_T	*fp = fc->func;
+    int		len = fp->uf_lines.ga_len;
+    funccode_T	*code;
+    vmcctx_T	cc;
+    char_u	*line;
+    int		ok = TRUE;
+    int		i;
+
+    code = (funccode_T *)alloc_clear((unsigned)sizeof(funccode_T));
+    if (code == NULL)
+	return NULL;
+    ga_init2(&code->fc_instr, (int)sizeof(isn_T), 50);
+    ga_init2(&code->fc_pool, (int)sizeof(char_u *), 20);
+    ga_init2(&code->fc_slots, (int)sizeof(vmslot_T), 10);
+    ga_init2(&code->fc_blocks, (int)sizeof(int), 4);
+    code->fc_line_instr = (int *)alloc((unsigned)(sizeof(int) * (len + 1)));
+    code->fc_line_block = (int *)alloc((unsigned)(sizeof(int) * (len + 1)));
+    if (code->fc_line_instr == NULL || code->fc_line_block == NULL
+				 || ga_grow(&code->fc_blocks, 1) == FAIL)
+	ok = FALSE;
+    else
+	((int *)code->fc_blocks.ga_data)[code->fc_blocks.ga_len++] = VMB_NONE;
+
+    vim_memset(&cc, 0, sizeof(cc));
+    cc.cc_code = code;
+    cc.cc_fc = fc;
+    ga_init2(&cc.cc_execs, (int)sizeof(int), 5);
+    ga_init2(&cc.cc_skips, (int)sizeof(int), 5);
+
+    /* Nothing is evaluated, but avoid error messages from skipping. */
+    ++emsg_skip;
+    for (i = 0; ok && i < len; ++i)
+    {
+	code->fc_line_instr[i] = VM_LEN(&cc);
+	code->fc_line_block[i] = cc.cc_blockcount == 0 ? 0
+				 : cc.cc_block[cc.cc_blockcount - 1].cb_id;
+	line = ((char_u **)fp->uf_lines.ga_data)[i];
+	if (line == NULL)
+	    continue;
+	cc.cc_lnum = i + 1;
+	if (vm_compile_line(&cc, line) == FAIL)
+	    ok = FALSE;
+    }
+    --emsg_skip;
+
+    if (ok && cc.cc_blockcount == 0 && vm_emit(&cc, ISN_FINISH) != NULL)
+    {
+	code->fc_line_instr[len] = VM_LEN(&cc) - 1;
+	code->fc_line_block[len] = 0;
+    }
+    else
+	ok = FALSE;
+
+    for (i = 0; i < cc.cc_blockcount; ++i)
+    {
+	ga_clear(&cc.cc_block[i].cb_exit);
+	ga_clear(&cc.cc_block[i].cb_cont);
+    }
+    ga_clear(&cc.cc_execs);
+    ga_clear(&cc.cc_skips);
+
+    if (!ok)
+    {
+	ga_clear(&code->fc_instr);
+	ga_clear_strings(&code->fc_pool);
+	ga_clear(&code->fc_slots);
+	ga_clear(&code->fc_blocks);
+	vim_free(code->fc_line_instr);
+	vim_free(code->fc_line_block);
+	vim_free(code);
+	return NULL;
+    }
+    return code;
+}
+
+/*
+ * Add an instruction of type "type".  Returns NULL when out of memory.
+ * The pointer is only valid until the next instruction is added.
+ */
+    static isn_T *
+vm_emit(cc, type)
+    vmcctx_T	*cc;
+    int		type;
 {
-    char_u	*nm = name;
-    char_u	*p;
+    isn_T	*isn;
 
-    p = trans_function_name(&nm, FALSE, TFN_INT|TFN_QUIET, NULL);
+    if (ga_grow(&cc->cc_code->fc_instr, 1) == FAIL)
+	return NULL;
+    isn = VM_ISN(cc, cc->cc_code->fc_instr.ga_len++);
+    vim_memset(isn, 0, sizeof(isn_T));
+    isn->isn_type = type;
+    return isn;
+}
 
-    if (p != NULL && *nm == NUL)
-	if (!check || translated_function_exists(p))
-	    return p;
+/*
+ * Return a copy of "len" bytes at "p" owned by the compiled code.
+ */
+    static char_u *
+vm_pool(cc, p, len)
+    vmcctx_T	*cc;
+    char_u	*p;
+    int		len;
+{
+    char_u	*s = vim_strnsave(p, len);
 
-    vim_free(p);
-    return NULL;
+    if (s != NULL && vm_pool_add(cc, s) == FAIL)
+	return NULL;
+    return s;
 }
 
 /*
- * Return TRUE if "name" looks like a builtin function name: starts with a
- * lower case letter and doesn't contain AUTOLOAD_CHAR.
- * "len" is the length of "name", or -1 for NUL terminated.
+ * Let the compiled code own allocated text "p".  It is freed for FAIL.
  */
     static int
-builtin_function(name, len)
-    char_u *name;
-    int len;
+vm_pool_add(cc, p)
+    vmcctx_T	*cc;
+    char_u	*p;
 {
-    char_u *p;
-
-    if (!ASCII_ISLOWER(name[0]))
-	return FALSE;
-    p = vim_strchr(name, AUTOLOAD_CHAR);
-    return p == NULL || (len > 0 && p > name + len);
+    if (ga_grow(&cc->cc_code->fc_pool, 1) == FAIL)
+    {
+	vim_free(p);
+	return FAIL;
+    }
+    ((char_u **)cc->cc_code->fc_pool.ga_data)[cc->cc_code->fc_pool.ga_len++]
+									   = p;
+    return OK;
 }
 
-#if defined(FEAT_PROFILE) || defined(PROTO)
 /*
- * Start profiling function "fp".
+ * Adjust the depth of the stack by "n" and remember the maximum.
  */
     static void
-func_do_profile(fp)
-    ufunc_T	*fp;
+vm_depth(cc, n)
+    vmcctx_T	*cc;
+    int		n;
 {
-    int		len = fp->uf_lines.ga_len;
-
-    if (len == 0)
-	len = 1;  /* avoid getting error for allocating zero bytes */
-    fp->uf_tm_count = 0;
-    profile_zero(&fp->uf_tm_self);
-    profile_zero(&fp->uf_tm_total);
-    if (fp->uf_tml_count == NULL)
-	fp->uf_tml_count = (int *)alloc_clear((unsigned) (sizeof(int) * len));
-    if (fp->uf_tml_total == NULL)
-	fp->uf_tml_total = (proftime_T *)alloc_clear((unsigned)
-						  (sizeof(proftime_T) * len));
-    if (fp->uf_tml_self == NULL)
-	fp->uf_tml_self = (proftime_T *)alloc_clear((unsigned)
-						  (sizeof(proftime_T) * len));
-    fp->uf_tml_idx = -1;
-    if (fp->uf_tml_count == NULL || fp->uf_tml_total == NULL
-						   || fp->uf_tml_self == NULL)
-	return;	    /* out of memory */
+    cc->cc_depth += n;
+    if (cc->cc_depth > cc->cc_code->fc_stack_len)
+	cc->cc_code->fc_stack_len = cc->cc_depth;
+}
 
-    fp->uf_profiling = TRUE;
+/*
+ * Remember that field "field" (0 for isn_a, 1 for isn_b) of instruction
+ * "idx" is to be set to the end of a block.
+ */
+    static int
+vm_add_patch(gap, idx, field)
+    garray_T	*gap;
+    int		idx;
+    int		field;
+{
+    if (ga_grow(gap, 1) == FAIL)
+	return FAIL;
+    ((int *)gap->ga_data)[gap->ga_len++] = idx * 2 + field;
+    return OK;
 }
 
 /*
- * Dump the profiling results for all functions in file "fd".
+ * Set the fields remembered in "gap" to jump to "target" and clear "gap".
  */
-    void
-func_dump_profile(fd)
-    FILE    *fd;
+    static void
+vm_patch(cc, gap, target)
+    vmcctx_T	*cc;
+    garray_T	*gap;
+    int		target;
 {
-    hashitem_T	*hi;
-    int		todo;
-    ufunc_T	*fp;
     int		i;
-    ufunc_T	**sorttab;
-    int		st_len = 0;
-
-    todo = (int)func_hashtab.ht_used;
-    if (todo == 0)
-	return;     /* nothing to dump */
-
-    sorttab = (ufunc_T **)alloc((unsigned)(sizeof(ufunc_T) * todo));
+    int		item;
 
-    for (hi = func_hashtab.ht_array; todo > 0; ++hi)
+    for (i = 0; i < gap->ga_len; ++i)
     {
-	if (!HASHITEM_EMPTY(hi))
-	{
-	    --todo;
-	    fp = HI2UF(hi);
-	    if (fp->uf_profiling)
-	    {
-		if (sorttab != NULL)
-		    sorttab[st_len++] = fp;
+	item = ((int *)gap->ga_data)[i];
+	if (item & 1)
+	    VM_ISN(cc, item / 2)->isn_b = target;
+	else
+	    VM_ISN(cc, item / 2)->isn_a = target;
+    }
+    ga_clear(gap);
+}
 
-		if (fp->uf_name[0] == K_SPECIAL)
-		    fprintf(fd, "FUNCTION  <SNR>%s()\n", fp->uf_name + 3);
-		else
-		    fprintf(fd, "FUNCTION  %s()\n", fp->uf_name);
-		if (fp->uf_tm_count == 1)
-		    fprintf(fd, "Called 1 time\n");
-		else
-		    fprintf(fd, "Called %d times\n", fp->uf_tm_count);
-		fprintf(fd, "Total time: %s\n", profile_msg(&fp->uf_tm_total));
-		fprintf(fd, " Self time: %s\n", profile_msg(&fp->uf_tm_self));
-		fprintf(fd, "\n");
-		fprintf(fd, "count  total (s)   self (s)\n");
+/*
+ * Return the kind of the block "depth" levels below the innermost one.
+ */
+    static int
+vm_block_kind(cc, depth)
+    vmcctx_T	*cc;
+    int		depth;
+{
+    if (cc->cc_blockcount - depth <= 0)
+	return VMB_NONE;
+    return cc->cc_block[cc->cc_blockcount - 1 - depth].cb_kind;
+}
 
-		for (i = 0; i < fp->uf_lines.ga_len; ++i)
-		{
-		    if (FUNCLINE(fp, i) == NULL)
-			continue;
-		    prof_func_line(fd, fp->uf_tml_count[i],
-			     &fp->uf_tml_total[i], &fp->uf_tml_self[i], TRUE);
-		    fprintf(fd, "%s\n", FUNCLINE(fp, i));
-		}
-		fprintf(fd, "\n");
-	    }
-	}
-    }
+/*
+ * Compile the '|' separated commands of one function line.
+ */
+    static int
+vm_compile_line(cc, line)
+    vmcctx_T	*cc;
+    char_u	*line;
+{
+    char_u	*seg;
+    char_u	*next;
+    int		first = TRUE;
+    int		i;
 
-    if (sorttab != NULL && st_len > 0)
+    /* The instructions refer to the text, keep a copy. */
+    seg = vm_pool(cc, line, (int)STRLEN(line));
+    if (seg == NULL)
+	return FAIL;
+    cc->cc_execs.ga_len = 0;
+    cc->cc_skips.ga_len = 0;
+    while (seg != NULL)
     {
-	qsort((void *)sorttab, (size_t)st_len, sizeof(ufunc_T *),
-							      prof_total_cmp);
-	prof_sort_list(fd, sorttab, st_len, "TOTAL", FALSE);
-	qsort((void *)sorttab, (size_t)st_len, sizeof(ufunc_T *),
-							      prof_self_cmp);
-	prof_sort_list(fd, sorttab, st_len, "SELF", TRUE);
+	if (vm_compile_cmd(cc, seg, first, &next) == FAIL)
+	    return FAIL;
+	seg = next;
+	first = FALSE;
     }
 
-    vim_free(sorttab);
+    /* When a command consumes the rest of the line unexpectedly continue
+     * with the next line. */
+    for (i = 0; i < cc->cc_execs.ga_len; ++i)
+	VM_ISN(cc, ((int *)cc->cc_execs.ga_data)[i])->isn_c = VM_LEN(cc);
+    for (i = 0; i < cc->cc_skips.ga_len; ++i)
+	VM_ISN(cc, ((int *)cc->cc_skips.ga_data)[i])->isn_d = VM_LEN(cc);
+    return OK;
 }
 
-    static void
-prof_sort_list(fd, sorttab, st_len, title, prefer_self)
-    FILE	*fd;
-    ufunc_T	**sorttab;
-    int		st_len;
-    char	*title;
-    int		prefer_self;	/* when equal print only self time */
+/*
+ * Compile the command at "seg".  "first" is TRUE for the first command in the
+ * line.  Sets "*nextp" to the following command or NULL.
+ */
+    static int
+vm_compile_cmd(cc, seg, first, nextp)
+    vmcctx_T	*cc;
+    char_u	*seg;
+    int		first;
+    char_u	**nextp;
 {
+    char_u	*p;
+    char_u	*arg;
+    int		skipped;
+    cmdidx_T	cmdidx;
     int		i;
-    ufunc_T	*fp;
 
-    fprintf(fd, "FUNCTIONS SORTED ON %s TIME\n", title);
-    fprintf(fd, "count  total (s)   self (s)  function\n");
-    for (i = 0; i < 20 && i < st_len; ++i)
-    {
-	fp = sorttab[i];
-	prof_func_line(fd, fp->uf_tm_count, &fp->uf_tm_total, &fp->uf_tm_self,
-								 prefer_self);
-	if (fp->uf_name[0] == K_SPECIAL)
-	    fprintf(fd, " <SNR>%s()\n", fp->uf_name + 3);
-	else
-	    fprintf(fd, " %s()\n", fp->uf_name);
+    *nextp = NULL;
+    if (seg[0] == '#' && seg[1] == '!')
+	return OK;
+    for (p = seg; *p == ' ' || *p == '\t' || *p == ':'; ++p)
+	;
+    if (*p == '"')
+	return OK;
+    if (*p == NUL)
+	/* An empty command still does something in Ex mode. */
+	return vm_compile_exec(cc, seg, nextp);
+
+    cmdidx = find_cmdidx(seg, &arg, &skipped);
+    switch (cmdidx)
+    {
+	/* Commands that read following lines or need the condition stack
+	 * can't be compiled. */
+	case CMD_append:
+	case CMD_change:
+	case CMD_insert:
+	case CMD_function:
+	case CMD_endfunction:
+	case CMD_try:
+	case CMD_catch:
+	case CMD_finally:
+	case CMD_endtry:
+	case CMD_lua:
+	case CMD_mzscheme:
+	case CMD_perl:
+	case CMD_python:
+	case CMD_py3:
+	case CMD_python3:
+	case CMD_ruby:
+	case CMD_tcl:
+	    return FAIL;
+
+	case CMD_if:
+	case CMD_elseif:
+	case CMD_else:
+	case CMD_endif:
+	case CMD_while:
+	case CMD_endwhile:
+	case CMD_for:
+	case CMD_endfor:
+	case CMD_break:
+	case CMD_continue:
+	    if (skipped || *arg == '!')
+		return FAIL;
+	    /* When a ":call" before this in the line fails the rest of the
+	     * line is skipped, the block would not be closed or opened. */
+	    if (cc->cc_skips.ga_len > 0)
+		return FAIL;
+	    /* A command before this in the line can't jump here. */
+	    for (i = 0; i < cc->cc_execs.ga_len; ++i)
+		VM_ISN(cc, ((int *)cc->cc_execs.ga_data)[i])->isn_c = -1;
+	    cc->cc_execs.ga_len = 0;
+	    return vm_compile_control(cc, cmdidx, skipwhite(arg), first,
+									nextp);
+
+	case CMD_let:
+	    if (!skipped && *arg != '!'
+			    && vm_compile_let(cc, skipwhite(arg), nextp) == OK)
+		return OK;
+	    break;
+
+	case CMD_call:
+	    if (!skipped && *arg != '!'
+			   && vm_compile_call(cc, skipwhite(arg), nextp) == OK)
+		return OK;
+	    break;
+
+	case CMD_return:
+	    if (!skipped && *arg != '!'
+			 && vm_compile_return(cc, skipwhite(arg), nextp) == OK)
+		return OK;
+	    break;
+
+	default:
+	    break;
     }
-    fprintf(fd, "\n");
+    return vm_compile_exec(cc, seg, nextp);
 }
 
 /*
- * Print the count and times for one function or function line.
+ * Compile the command at "seg" to be executed with do_one_cmd().
+ * To find where the next command starts it is executed once while skipping,
+ * like it is done inside a false ":if".
  */
-    static void
-prof_func_line(fd, count, total, self, prefer_self)
-    FILE	*fd;
-    int		count;
-    proftime_T	*total;
-    proftime_T	*self;
-    int		prefer_self;	/* when equal print only self time */
-{
-    if (count > 0)
+    static int
+vm_compile_exec(cc, seg, nextp)
+    vmcctx_T	*cc;
+    char_u	*seg;
+    char_u	**nextp;
+{
+    struct condstack	cstack;
+    struct condstack	save_cstack;
+    char_u		*cmdline;
+    char_u		*copy;
+    char_u		*next;
+    int			off = -1;
+    int			ret = OK;
+    int			save_linenr = cc->cc_fc->linenr;
+    isn_T		*isn;
+
+    copy = vim_strsave(seg);
+    if (copy == NULL)
+	return FAIL;
+
+    /* An inactive ":if" makes do_one_cmd() skip the command. */
+    vim_memset(&cstack, 0, sizeof(cstack));
+    cstack.cs_idx = 0;
+    save_cstack = cstack;
+    cmdline = copy;
+    next = do_one_func_cmd(&cmdline, &cstack, cc->cc_fc);
+
+    if (cmdline != copy || cc->cc_fc->linenr != save_linenr
+		       || memcmp(&cstack, &save_cstack, sizeof(cstack)) != 0)
+	ret = FAIL;
+    else if (next != NULL)
     {
-	fprintf(fd, "%5d ", count);
-	if (prefer_self && profile_equal(total, self))
-	    fprintf(fd, "           ");
-	else
-	    fprintf(fd, "%s ", profile_msg(total));
-	if (!prefer_self && profile_equal(total, self))
-	    fprintf(fd, "           ");
-	else
-	    fprintf(fd, "%s ", profile_msg(self));
+	/* The text after the '|' must not have been changed, e.g. by
+	 * removing a backslash. */
+	off = (int)(next - cmdline);
+	if (off <= 0 || off > (int)STRLEN(seg)
+				       || STRCMP(cmdline + off, seg + off) != 0)
+	    ret = FAIL;
     }
-    else
-	fprintf(fd, "                            ");
+    cc->cc_fc->linenr = save_linenr;
+    vim_free(cmdline);
+    if (ret == FAIL)
+	return FAIL;
+
+    if ((isn = vm_emit(cc, ISN_EXEC)) == NULL
+				   || ga_grow(&cc->cc_execs, 1) == FAIL)
+	return FAIL;
+    isn->isn_a = cc->cc_lnum;
+    isn->isn_s = seg;
+    isn->isn_n = off;
+    isn->isn_c = -1;
+    isn->isn_d = cc->cc_blockcount == 0 ? 0
+				: cc->cc_block[cc->cc_blockcount - 1].cb_id;
+    ((int *)cc->cc_execs.ga_data)[cc->cc_execs.ga_len++] = VM_LEN(cc) - 1;
+    *nextp = off < 0 ? NULL : seg + off;
+    return OK;
 }
 
 /*
- * Compare function for total time sorting.
+ * Add ISN_END for command "name".  Jump to "target" when it is not -1,
+ * "flags" has VME_ flags, "kind" is the kind of the innermost block after
+ * the command.
  */
     static int
-#ifdef __BORLANDC__
-_RTLENTRYF
-#endif
-prof_total_cmp(s1, s2)
-    const void	*s1;
-    const void	*s2;
+vm_emit_end(cc, name, target, flags, kind)
+    vmcctx_T	*cc;
+    char	*name;
+    int		target;
+    int		flags;
+    int		kind;
 {
-    ufunc_T	*p1, *p2;
+    isn_T	*isn;
 
-    p1 = *(ufunc_T **)s1;
-    p2 = *(ufunc_T **)s2;
-    return profile_cmp(&p1->uf_tm_total, &p2->uf_tm_total);
+    if ((isn = vm_emit(cc, ISN_END)) == NULL)
+	return FAIL;
+    isn->isn_s = (char_u *)name;
+    isn->isn_a = target;
+    isn->isn_b = flags;
+    isn->isn_c = kind;
+    return OK;
 }
 
 /*
- * Compare function for self time sorting.
+ * Add ISN_LINE for line "lnum", it starts a compiled command.
  */
     static int
-#ifdef __BORLANDC__
-_RTLENTRYF
-#endif
-prof_self_cmp(s1, s2)
-    const void	*s1;
-    const void	*s2;
+vm_emit_line(cc, lnum)
+    vmcctx_T	*cc;
+    int		lnum;
 {
-    ufunc_T	*p1, *p2;
+    isn_T	*isn;
 
-    p1 = *(ufunc_T **)s1;
-    p2 = *(ufunc_T **)s2;
-    return profile_cmp(&p1->uf_tm_self, &p2->uf_tm_self);
+    if ((isn = vm_emit(cc, ISN_LINE)) == NULL)
+	return FAIL;
+    isn->isn_a = lnum;
+    return OK;
 }
 
-#endif
-
 /*
- * If "name" has a package name try autoloading the script for it.
- * Return TRUE if a package was loaded.
+ * Compile ":let var = expr" and ":let var op= expr" for a plain variable
+ * name, "arg" points to the name.
  */
     static int
-script_autoload(name, reload)
-    char_u	*name;
-    int		reload;	    /* load script again when already loaded */
+vm_compile_let(cc, arg, nextp)
+    vmcctx_T	*cc;
+    char_u	*arg;
+    char_u	**nextp;
 {
     char_u	*p;
-    char_u	*scriptname, *tofree;
-    int		ret = FALSE;
-    int		i;
-
-    /* If there is no '#' after name[0] there is no package name. */
-    p = vim_strchr(name, AUTOLOAD_CHAR);
-    if (p == NULL || p == name)
-	return FALSE;
-
-    tofree = scriptname = autoload_name(name);
+    char_u	*expr;
+    char_u	*name;
+    int		op = '=';
+    int		slot;
+    int		start = VM_LEN(cc);
+    isn_T	*isn;
 
-    /* Find the name in the list of previously loaded package names.  Skip
-     * "autoload/", it's always the same. */
-    for (i = 0; i < ga_loaded.ga_len; ++i)
-	if (STRCMP(((char_u **)ga_loaded.ga_data)[i] + 9, scriptname + 9) == 0)
-	    break;
-    if (!reload && i < ga_loaded.ga_len)
-	ret = FALSE;	    /* was loaded already */
-    else
+    if (!eval_isnamec1(*arg))
+	return FAIL;
+    for (p = arg + 1; eval_isnamec(*p); ++p)
+	;
+    if ((p - arg == 13 && STRNCMP(arg, "b:changedtick", 13) == 0)
+	    || p[-1] == ':' || *p == '[' || *p == '{'
+	    || (*p == '.' && p[1] != '='))
+	return FAIL;
+    expr = skipwhite(p);
+    if (*expr != '=')
     {
-	/* Remember the name if it wasn't loaded already. */
-	if (i == ga_loaded.ga_len && ga_grow(&ga_loaded, 1) == OK)
-	{
-	    ((char_u **)ga_loaded.ga_data)[ga_loaded.ga_len++] = scriptname;
-	    tofree = NULL;
-	}
-
-	/* Try loading the package from $VIMRUNTIME/autoload/<name>.vim */
-	if (source_runtime(scriptname, FALSE) == OK)
-	    ret = TRUE;
+	if (vim_strchr((char_u *)"+-.", *expr) == NULL || expr[1] != '=')
+	    return FAIL;
+	op = *expr;
+	++expr;
     }
+    expr = skipwhite(expr + 1);
+    if ((name = vm_pool(cc, arg, (int)(p - arg))) == NULL)
+	return FAIL;
 
-    vim_free(tofree);
-    return ret;
+    if (vm_emit_line(cc, cc->cc_lnum) == FAIL)
+	return FAIL;
+    if (vm_compile_expr(cc, expr, expr, nextp) == FAIL)
+    {
+	cc->cc_code->fc_instr.ga_len = start;
+	return FAIL;
+    }
+    slot = vm_slot(cc, name);
+    if ((isn = vm_emit(cc, slot >= 0 ? ISN_STORESLOT : ISN_STORE)) == NULL)
+	return FAIL;
+    isn->isn_s = name;
+    isn->isn_a = op;
+    isn->isn_b = slot;
+    vm_depth(cc, -1);
+    return vm_emit_end(cc, "let", -1, 0, vm_block_kind(cc, 0));
 }
 
 /*
- * Return the autoload script name for a function or variable name.
- * Returns NULL when out of memory.
+ * Compile ":call Func(args)" for a plain function name, "arg" points to the
+ * name.
  */
-    static char_u *
-autoload_name(name)
-    char_u	*name;
+    static int
+vm_compile_call(cc, arg, nextp)
+    vmcctx_T	*cc;
+    char_u	*arg;
+    char_u	**nextp;
 {
     char_u	*p;
-    char_u	*scriptname;
+    char_u	*name;
+    int		start = VM_LEN(cc);
+    isn_T	*isn;
 
-    /* Get the script file name: replace '#' with '/', append ".vim". */
-    scriptname = alloc((unsigned)(STRLEN(name) + 14));
-    if (scriptname == NULL)
-	return FALSE;
-    STRCPY(scriptname, "autoload/");
-    STRCAT(scriptname, name);
-    *vim_strrchr(scriptname, AUTOLOAD_CHAR) = NUL;
-    STRCAT(scriptname, ".vim");
-    while ((p = vim_strchr(scriptname, AUTOLOAD_CHAR)) != NULL)
-	*p = '/';
-    return scriptname;
-}
+    if (!eval_isnamec1(*arg))
+	return FAIL;
+    for (p = arg + 1; eval_isnamec(*p); ++p)
+	;
+    if ((name = vm_pool(cc, arg, (int)(p - arg))) == NULL)
+	return FAIL;
+    p = skipwhite(p);
+    if (*p != '(')
+	return FAIL;
 
-#if defined(FEAT_CMDL_COMPL) || defined(PROTO)
+    if (vm_emit_line(cc, cc->cc_lnum) == FAIL)
+	return FAIL;
+    if ((isn = vm_emit(cc, ISN_EXPR)) == NULL)
+	return FAIL;
+    if (vm_call(cc, name, (int)STRLEN(name), name, TRUE, &p) == FAIL
+							  || !ends_excmd(*p))
+    {
+	cc->cc_code->fc_instr.ga_len = start;
+	cc->cc_depth = 0;
+	cc->cc_calls = 0;
+	return FAIL;
+    }
+    VM_ISN(cc, start + 1)->isn_a = VM_LEN(cc);
+    if ((isn = vm_emit(cc, ISN_POP)) == NULL)
+	return FAIL;
+    vm_depth(cc, -1);
+    *nextp = check_nextcmd(p);
+    if (*nextp != NULL && **nextp == NUL)
+	*nextp = NULL;
+    /* Like ex_call(): when the call fails the rest of the line is skipped,
+     * vm_compile_line() fills in where it ends. */
+    if (vm_emit_end(cc, "call", -1, VME_SKIP, vm_block_kind(cc, 0)) == FAIL
+				       || ga_grow(&cc->cc_skips, 1) == FAIL)
+	return FAIL;
+    ((int *)cc->cc_skips.ga_data)[cc->cc_skips.ga_len++] = VM_LEN(cc) - 1;
+    return OK;
+}
 
 /*
- * Function given to ExpandGeneric() to obtain the list of user defined
- * function names.
+ * Compile ":return [expr]", "arg" points to the argument.
  */
-    char_u *
-get_user_func_name(xp, idx)
-    expand_T	*xp;
-    int		idx;
+    static int
+vm_compile_return(cc, arg, nextp)
+    vmcctx_T	*cc;
+    char_u	*arg;
+    char_u	**nextp;
 {
-    static long_u	done;
-    static hashitem_T	*hi;
-    ufunc_T		*fp;
+    int		start = VM_LEN(cc);
+    int		has_value = FALSE;
+    isn_T	*isn;
 
-    if (idx == 0)
-    {
-	done = 0;
-	hi = func_hashtab.ht_array;
-    }
-    if (done < func_hashtab.ht_used)
+    if (vm_emit_line(cc, cc->cc_lnum) == FAIL)
+	return FAIL;
+    if (*arg != NUL && *arg != '|' && *arg != '\n')
     {
-	if (done++ > 0)
-	    ++hi;
-	while (HASHITEM_EMPTY(hi))
-	    ++hi;
-	fp = HI2UF(hi);
-
-	if (fp->uf_flags & FC_DICT)
-	    return (char_u *)""; /* don't show dict functions */
-
-	if (STRLEN(fp->uf_name) + 4 >= IOSIZE)
-	    return fp->uf_name;	/* prevents overflow */
-
-	cat_func_name(IObuff, fp);
-	if (xp->xp_context != EXPAND_USER_FUNC)
+	if (vm_compile_expr(cc, arg, arg, nextp) == FAIL)
 	{
-	    STRCAT(IObuff, "(");
-	    if (!fp->uf_varargs && fp->uf_args.ga_len == 0)
-		STRCAT(IObuff, ")");
+	    cc->cc_code->fc_instr.ga_len = start;
+	    return FAIL;
 	}
-	return IObuff;
+	has_value = TRUE;
     }
-    return NULL;
+    if ((isn = vm_emit(cc, ISN_RETURN)) == NULL)
+	return FAIL;
+    isn->isn_a = has_value;
+    if (has_value)
+	vm_depth(cc, -1);
+    /* The rest of the line is not executed. */
+    *nextp = NULL;
+    return vm_emit_end(cc, "return", -1, VME_STOP, vm_block_kind(cc, 0));
 }
 
-#endif /* FEAT_CMDL_COMPL */
-
 /*
- * Copy the function name of "fp" to buffer "buf".
- * "buf" must be able to hold the function name plus three bytes.
- * Takes care of script-local function names.
+ * Compile expression "arg" of a command.  The instruction that uses the
+ * value is to be added next.  "e15text" is the text for the E15 error, NULL
+ * for none.  Sets "*nextp" to the next command in the line or NULL.
+ * Returns FAIL when the expression can't be compiled, nothing is added then.
  */
-    static void
-cat_func_name(buf, fp)
-    char_u	*buf;
-    ufunc_T	*fp;
+    static int
+vm_compile_expr(cc, arg, e15text, nextp)
+    vmcctx_T	*cc;
+    char_u	*arg;
+    char_u	*e15text;
+    char_u	**nextp;
 {
-    if (fp->uf_name[0] == K_SPECIAL)
+    int		start = VM_LEN(cc);
+    char_u	*p = arg;
+    isn_T	*isn;
+
+    if ((isn = vm_emit(cc, ISN_EXPR)) == NULL)
+	return FAIL;
+    isn->isn_s = e15text;
+    if (vm_expr1(cc, &p) == FAIL || !ends_excmd(*p))
     {
-	STRCPY(buf, "<SNR>");
-	STRCAT(buf, fp->uf_name + 3);
+	cc->cc_code->fc_instr.ga_len = start;
+	cc->cc_depth = 0;
+	cc->cc_calls = 0;
+	return FAIL;
     }
-    else
-	STRCPY(buf, fp->uf_name);
+    VM_ISN(cc, start)->isn_a = VM_LEN(cc);
+    *nextp = check_nextcmd(p);
+    if (*nextp != NULL && **nextp == NUL)
+	*nextp = NULL;
+    return OK;
 }
 
 /*
- * ":delfunction {name}"
+ * Compile the condition of ":if", ":elseif" and ":while" or the List of
+ * ":for" at "arg".  When the expression can't be compiled it is evaluated
+ * with eval0().
  */
-    void
-ex_delfunction(eap)
-    exarg_T	*eap;
+    static int
+vm_compile_cond(cc, arg, nextp)
+    vmcctx_T	*cc;
+    char_u	*arg;
+    char_u	**nextp;
 {
-    ufunc_T	*fp = NULL;
+    typval_T	tv;
+    isn_T	*isn;
+
+    if (vm_compile_expr(cc, arg, arg, nextp) == OK)
+	return OK;
+
+    /* Skip over the expression to find the next command. */
+    if (eval0(arg, &tv, nextp, FALSE) == FAIL)
+	return FAIL;
+    clear_tv(&tv);
+    if (*nextp != NULL && **nextp == NUL)
+	*nextp = NULL;
+    if ((isn = vm_emit(cc, ISN_EXPR)) == NULL)
+	return FAIL;
+    isn->isn_a = VM_LEN(cc) + 1;
+    if ((isn = vm_emit(cc, ISN_EVAL0)) == NULL)
+	return FAIL;
+    isn->isn_s = arg;
+    vm_depth(cc, 1);
+    return OK;
+}
+
+/*
+ * Compile ":if", ":while", ":for" and the other commands that make up their
+ * blocks.  "arg" points to the argument.  "first" is TRUE for the first
+ * command in the line.
+ */
+    static int
+vm_compile_control(cc, cmdidx, arg, first, nextp)
+    vmcctx_T	*cc;
+    cmdidx_T	cmdidx;
+    char_u	*arg;
+    int		first;
+    char_u	**nextp;
+{
+    vmblock_T	*cb = NULL;
+    vmblock_T	*loop = NULL;
+    isn_T	*isn;
+    int		i;
+    int		varcount = 0;
+    int		semicolon = 0;
     char_u	*p;
-    char_u	*name;
-    funcdict_T	fudi;
 
-    p = eap->arg;
-    name = trans_function_name(&p, eap->skip, 0, &fudi);
-    vim_free(fudi.fd_newkey);
-    if (name == NULL)
+    if (cc->cc_blockcount > 0)
+	cb = &cc->cc_block[cc->cc_blockcount - 1];
+    for (i = cc->cc_blockcount - 1; i >= 0; --i)
+	if (cc->cc_block[i].cb_kind != VMB_IF)
+	{
+	    loop = &cc->cc_block[i];
+	    break;
+	}
+
+    if (cmdidx != CMD_if && cmdidx != CMD_elseif && cmdidx != CMD_while
+							 && cmdidx != CMD_for)
     {
-	if (fudi.fd_dict != NULL && !eap->skip)
-	    EMSG(_(e_funcref));
-	return;
+	/* No argument, only a following command or comment. */
+	if (*arg == '|' || *arg == '\n')
+	    *nextp = arg[1] == NUL ? NULL : arg + 1;
+	else if (*arg == NUL || *arg == '"')
+	    *nextp = NULL;
+	else
+	    return FAIL;
     }
-    if (!ends_excmd(*skipwhite(p)))
+
+    switch (cmdidx)
     {
-	vim_free(name);
-	EMSG(_(e_trailing));
-	return;
-    }
-    eap->nextcmd = check_nextcmd(p);
-    if (eap->nextcmd != NULL)
-	*p = NUL;
+	case CMD_if:
+	case CMD_while:
+	case CMD_for:
+	    /* Jumping back to a loop starts at the beginning of the line. */
+	    if (cc->cc_blockcount >= CSTACK_LEN - 1
+					       || (!first && cmdidx != CMD_if)
+		    || ga_grow(&cc->cc_code->fc_blocks, 1) == FAIL)
+		return FAIL;
+	    cb = &cc->cc_block[cc->cc_blockcount];
+	    vim_memset(cb, 0, sizeof(vmblock_T));
+	    ga_init2(&cb->cb_exit, (int)sizeof(int), 5);
+	    ga_init2(&cb->cb_cont, (int)sizeof(int), 5);
+	    cb->cb_kind = cmdidx == CMD_if ? VMB_IF
+				     : cmdidx == CMD_while ? VMB_WHILE : VMB_FOR;
+	    cb->cb_next = -1;
+	    cb->cb_head = VM_LEN(cc);
+	    cb->cb_lnum = cc->cc_lnum;
+
+	    if (vm_emit_line(cc, cc->cc_lnum) == FAIL)
+	return FAIL;
+	    if (cmdidx == CMD_for)
+	    {
+		/* ":for var in list", ":for [a, b] in list" */
+		p = skip_var_list(arg, &varcount, &semicolon);
+		if (p == NULL)
+		    return FAIL;
+		p = skipwhite(p);
+		if (p[0] != 'i' || p[1] != 'n' || !vim_iswhite(p[2]))
+		    return FAIL;
+		if (vm_compile_cond(cc, skipwhite(p + 2), nextp) == FAIL
+			|| (isn = vm_emit(cc, ISN_FORINIT)) == NULL)
+		    return FAIL;
+		isn->isn_a = cc->cc_code->fc_for_len++;
+		isn->isn_b = varcount;
+		isn->isn_c = semicolon;
+		vm_depth(cc, -1);
+
+		isn = &cb->cb_fornext;
+		isn->isn_type = ISN_FORNEXT;
+		isn->isn_a = cc->cc_code->fc_for_len - 1;
+		isn->isn_s = arg;
+		if (eval_isnamec1(*arg))
+		{
+		    for (p = arg + 1; eval_isnamec(*p); ++p)
+			;
+		    if (!(p - arg == 13 && STRNCMP(arg, "b:changedtick", 13) == 0)
+			    && p[-1] != ':'
+			    && skip_var_list(arg, &varcount, &semicolon) == p)
+		    {
+			/* plain variable name */
+			isn->isn_s = vm_pool(cc, arg, (int)(p - arg));
+			if (isn->isn_s == NULL)
+			    return FAIL;
+			isn->isn_n = 1;
+			isn->isn_b = vm_slot(cc, isn->isn_s);
+		    }
+		}
+		if ((isn = vm_emit(cc, ISN_FORNEXT)) == NULL)
+		    return FAIL;
+		*isn = cb->cb_fornext;
+	    }
+	    else
+	    {
+		if (vm_compile_cond(cc, arg, nextp) == FAIL
+				 || (isn = vm_emit(cc, ISN_TEST)) == NULL)
+		    return FAIL;
+		vm_depth(cc, -1);
+	    }
 
-    if (!eap->skip)
-	fp = find_func(name);
-    vim_free(name);
+	    /* The block is open now. */
+	    ((int *)cc->cc_code->fc_blocks.ga_data)[
+				cc->cc_code->fc_blocks.ga_len] = cb->cb_kind;
+	    cb->cb_id = cc->cc_code->fc_blocks.ga_len++;
+	    ++cc->cc_blockcount;
+	    if (vm_emit_end(cc, cmdidx == CMD_if ? "if"
+			  : cmdidx == CMD_while ? "while" : "for",
+					      -1, 0, cb->cb_kind) == FAIL
+		    || (isn = vm_emit(cc, ISN_JCOND)) == NULL)
+		return FAIL;
+	    if (cmdidx == CMD_if)
+		cb->cb_next = VM_LEN(cc) - 1;
+	    else if (vm_add_patch(&cb->cb_exit, VM_LEN(cc) - 1, 0) == FAIL)
+		return FAIL;
+	    if (vm_add_patch(&cb->cb_exit, VM_LEN(cc) - 1, 1) == FAIL)
+		return FAIL;
+	    cb->cb_body = VM_LEN(cc);
+	    return OK;
 
-    if (!eap->skip)
-    {
-	if (fp == NULL)
-	{
-	    EMSG2(_(e_nofunc), eap->arg);
-	    return;
-	}
-	if (fp->uf_calls > 0)
-	{
-	    EMSG2(_("E131: Cannot delete function %s: It is in use"), eap->arg);
-	    return;
-	}
+	case CMD_elseif:
+	case CMD_else:
+	    if (cb == NULL || cb->cb_kind != VMB_IF || cb->cb_had_else)
+		return FAIL;
+	    /* The previous branch jumps to the end. */
+	    if (vm_emit(cc, ISN_JUMP) == NULL
+		    || vm_add_patch(&cb->cb_exit, VM_LEN(cc) - 1, 0) == FAIL)
+		return FAIL;
+	    VM_ISN(cc, cb->cb_next)->isn_a = VM_LEN(cc);
+	    cb->cb_next = -1;
+	    if (vm_emit_line(cc, cc->cc_lnum) == FAIL)
+	return FAIL;
+	    if (cmdidx == CMD_else)
+	    {
+		cb->cb_had_else = TRUE;
+		return vm_emit_end(cc, "else", -1, 0, VMB_IF);
+	    }
+	    if (vm_compile_cond(cc, arg, nextp) == FAIL
+				     || (isn = vm_emit(cc, ISN_TEST)) == NULL)
+		return FAIL;
+	    vm_depth(cc, -1);
+	    if (vm_emit_end(cc, "elseif", -1, 0, VMB_IF) == FAIL
+				    || (isn = vm_emit(cc, ISN_JCOND)) == NULL)
+		return FAIL;
+	    cb->cb_next = VM_LEN(cc) - 1;
+	    return vm_add_patch(&cb->cb_exit, VM_LEN(cc) - 1, 1);
+
+	case CMD_endif:
+	    if (cb == NULL || cb->cb_kind != VMB_IF)
+		return FAIL;
+	    if (cb->cb_next >= 0)
+		VM_ISN(cc, cb->cb_next)->isn_a = VM_LEN(cc);
+	    vm_patch(cc, &cb->cb_exit, VM_LEN(cc));
+	    ga_clear(&cb->cb_cont);
+	    --cc->cc_blockcount;
+	    if (vm_emit_line(cc, cc->cc_lnum) == FAIL)
+	return FAIL;
+	    return vm_emit_end(cc, "endif", -1, 0, vm_block_kind(cc, 0));
+
+	case CMD_endwhile:
+	case CMD_endfor:
+	    if (cb == NULL || cb->cb_kind != (cmdidx == CMD_endwhile
+						       ? VMB_WHILE : VMB_FOR))
+		return FAIL;
+	    if (vm_emit_line(cc, cc->cc_lnum) == FAIL)
+	return FAIL;
+	    if (vm_emit_end(cc, cmdidx == CMD_endwhile ? "endwhile" : "endfor",
+			cmdidx == CMD_endwhile ? cb->cb_head : VM_LEN(cc) + 1,
+				      VME_LOOP, vm_block_kind(cc, 1)) == FAIL)
+		return FAIL;
+	    if (cmdidx == CMD_endfor)
+	    {
+		/* Jumping back to the ":for" gets the next item. */
+		vm_patch(cc, &cb->cb_cont, VM_LEN(cc));
+		if ((isn = vm_emit(cc, ISN_LINE)) == NULL)
+		    return FAIL;
+		isn->isn_a = cb->cb_lnum;
+		if ((isn = vm_emit(cc, ISN_FORNEXT)) == NULL)
+		    return FAIL;
+		*isn = cb->cb_fornext;
+		if (vm_emit_end(cc, "for", -1, 0, VMB_FOR) == FAIL
+			|| vm_emit(cc, ISN_JCOND) == NULL
+			|| vm_add_patch(&cb->cb_exit, VM_LEN(cc) - 1, 0) == FAIL
+			|| vm_add_patch(&cb->cb_exit, VM_LEN(cc) - 1, 1) == FAIL
+			|| (isn = vm_emit(cc, ISN_JUMP)) == NULL)
+		    return FAIL;
+		isn->isn_a = cb->cb_body;
+	    }
+	    vm_patch(cc, &cb->cb_exit, VM_LEN(cc));
+	    ga_clear(&cb->cb_cont);
+	    --cc->cc_blockcount;
+	    if (cmdidx == CMD_endfor)
+	    {
+		if ((isn = vm_emit(cc, ISN_FORFREE)) == NULL)
+		    return FAIL;
+		isn->isn_a = cb->cb_fornext.isn_a;
+	    }
+	    return OK;
+
+	case CMD_break:
+	case CMD_continue:
+	    if (loop == NULL)
+		return FAIL;
+	    if (vm_emit_line(cc, cc->cc_lnum) == FAIL)
+	return FAIL;
+	    if (cmdidx == CMD_break)
+	    {
+		if (vm_emit_end(cc, "break", -1, 0, vm_block_kind(cc, 0))
+									== FAIL)
+		    return FAIL;
+		return vm_add_patch(&loop->cb_exit, VM_LEN(cc) - 1, 0);
+	    }
+	    if (vm_emit_end(cc, "continue", loop->cb_head, VME_LOOP,
+						      loop->cb_kind) == FAIL)
+		return FAIL;
+	    if (loop->cb_kind == VMB_FOR)
+		return vm_add_patch(&loop->cb_cont, VM_LEN(cc) - 1, 0);
+	    return OK;
 
-	if (fudi.fd_dict != NULL)
-	{
-	    /* Delete the dict item that refers to the function, it will
-	     * invoke func_unref() and possibly delete the function. */
-	    dictitem_remove(fudi.fd_dict, fudi.fd_di);
-	}
-	else
-	    func_free(fp);
+	default:
+	    break;
     }
+    return FAIL;
 }
 
 /*
- * Free a function and remove it from the list of functions.
+ * The vm_expr1() to vm_expr7() functions compile an expression the same way
+ * as eval1() to eval7() parse it.  They return FAIL when the expression
+ * can't be compiled, e.g. for a Dictionary or a curly-braces name, it is
+ * then evaluated with eval0() when the command is executed.
+ * "*arg" is advanced like the eval functions do.
  */
-    static void
-func_free(fp)
-    ufunc_T *fp;
-{
-    hashitem_T	*hi;
 
-    /* clear this function */
-    ga_clear_strings(&(fp->uf_args));
-    ga_clear_strings(&(fp->uf_lines));
-#ifdef FEAT_PROFILE
-    vim_free(fp->uf_tml_count);
-    vim_free(fp->uf_tml_total);
-    vim_free(fp->uf_tml_self);
-#endif
+/*
+ * Compile "expr ? expr : expr".
+ */
+    static int
+vm_expr1(cc, arg)
+    vmcctx_T	*cc;
+    char_u	**arg;
+{
+    int		test;
+    int		jump;
+    int		depth;
 
-    /* remove the function from the function hashtable */
-    hi = hash_find(&func_hashtab, UF2HIKEY(fp));
-    if (HASHITEM_EMPTY(hi))
-	EMSG2(_(e_intern2), "func_free()");
-    else
-	hash_remove(&func_hashtab, hi);
+    if (vm_expr2(cc, arg) == FAIL)
+	return FAIL;
+    if ((*arg)[0] != '?')
+	return OK;
 
-    vim_free(fp);
+    test = VM_LEN(cc);
+    if (vm_emit(cc, ISN_TERNTEST) == NULL)
+	return FAIL;
+    vm_depth(cc, -1);
+    depth = cc->cc_depth;
+    *arg = skipwhite(*arg + 1);
+    if (vm_expr1(cc, arg) == FAIL || (*arg)[0] != ':')
+	return FAIL;
+    jump = VM_LEN(cc);
+    if (vm_emit(cc, ISN_JUMP) == NULL)
+	return FAIL;
+    VM_ISN(cc, test)->isn_a = VM_LEN(cc);
+    cc->cc_depth = depth;
+    *arg = skipwhite(*arg + 1);
+    if (vm_expr1(cc, arg) == FAIL)
+	return FAIL;
+    VM_ISN(cc, jump)->isn_a = VM_LEN(cc);
+    return OK;
 }
 
 /*
- * Unreference a Function: decrement the reference count and free it when it
- * becomes zero.  Only for numbered functions.
+ * Compile "expr || expr || expr".
  */
-    void
-func_unref(name)
-    char_u	*name;
+    static int
+vm_expr2(cc, arg)
+    vmcctx_T	*cc;
+    char_u	**arg;
 {
-    ufunc_T *fp;
+    int		chain = -1;
+    int		idx;
+    isn_T	*isn;
 
-    if (name != NULL && isdigit(*name))
+    if (vm_expr3(cc, arg) == FAIL)
+	return FAIL;
+    if ((*arg)[0] != '|' || (*arg)[1] != '|')
+	return OK;
+
+    while ((*arg)[0] == '|' && (*arg)[1] == '|')
     {
-	fp = find_func(name);
-	if (fp == NULL)
-	    EMSG2(_(e_intern2), "func_unref()");
-	else if (--fp->uf_refcount <= 0)
-	{
-	    /* Only delete it when it's not being used.  Otherwise it's done
-	     * when "uf_calls" becomes zero. */
-	    if (fp->uf_calls == 0)
-		func_free(fp);
-	}
+	/* Link the tests through isn_a, set to the end below. */
+	if ((isn = vm_emit(cc, ISN_ORTEST)) == NULL)
+	    return FAIL;
+	isn->isn_a = chain;
+	chain = VM_LEN(cc) - 1;
+	vm_depth(cc, -1);
+	*arg = skipwhite(*arg + 2);
+	if (vm_expr3(cc, arg) == FAIL)
+	    return FAIL;
     }
+    if ((isn = vm_emit(cc, ISN_ORTEST)) == NULL)
+	return FAIL;
+    isn->isn_a = chain;
+    chain = VM_LEN(cc) - 1;
+    if ((isn = vm_emit(cc, ISN_PUSHNR)) == NULL)
+	return FAIL;
+    isn->isn_n = 0;
+    while (chain >= 0)
+    {
+	idx = VM_ISN(cc, chain)->isn_a;
+	VM_ISN(cc, chain)->isn_a = VM_LEN(cc);
+	chain = idx;
+    }
+    return OK;
 }
 
 /*
- * Count a reference to a Function.
+ * Compile "expr && expr && expr".
  */
-    void
-func_ref(name)
-    char_u	*name;
+    static int
+vm_expr3(cc, arg)
+    vmcctx_T	*cc;
+    char_u	**arg;
 {
-    ufunc_T *fp;
+    int		chain = -1;
+    int		idx;
+    isn_T	*isn;
 
-    if (name != NULL && isdigit(*name))
+    if (vm_expr4(cc, arg) == FAIL)
+	return FAIL;
+    if ((*arg)[0] != '&' || (*arg)[1] != '&')
+	return OK;
+
+    while ((*arg)[0] == '&' && (*arg)[1] == '&')
     {
-	fp = find_func(name);
-	if (fp == NULL)
-	    EMSG2(_(e_intern2), "func_ref()");
-	else
-	    ++fp->uf_refcount;
+	if ((isn = vm_emit(cc, ISN_ANDTEST)) == NULL)
+	    return FAIL;
+	isn->isn_a = chain;
+	chain = VM_LEN(cc) - 1;
+	vm_depth(cc, -1);
+	*arg = skipwhite(*arg + 2);
+	if (vm_expr4(cc, arg) == FAIL)
+	    return FAIL;
+    }
+    if ((isn = vm_emit(cc, ISN_ANDTEST)) == NULL)
+	return FAIL;
+    isn->isn_a = chain;
+    chain = VM_LEN(cc) - 1;
+    if ((isn = vm_emit(cc, ISN_PUSHNR)) == NULL)
+	return FAIL;
+    isn->isn_n = 1;
+    while (chain >= 0)
+    {
+	idx = VM_ISN(cc, chain)->isn_a;
+	VM_ISN(cc, chain)->isn_a = VM_LEN(cc);
+	chain = idx;
     }
+    return OK;
 }
 
 /*
- * Call a user function.
+ * Compile "expr == expr" and the other comparisons.
  */
-    static void
-call_user_func(fp, argcount, argvars, rettv, firstline, lastline, selfdict)
-    ufunc_T	*fp;		/* pointer to function */
-    int		argcount;	/* nr of args */
-    typval_T	*argvars;	/* arguments */
-    typval_T	*rettv;		/* return value */
-    linenr_T	firstline;	/* first line of range */
-    linenr_T	lastline;	/* last line of range */
-    dict_T	*selfdict;	/* Dictionary for "self" */
+    static int
+vm_expr4(cc, arg)
+    vmcctx_T	*cc;
+    char_u	**arg;
 {
-    char_u	*save_sourcing_name;
-    linenr_T	save_sourcing_lnum;
-    scid_T	save_current_SID;
-    funccall_T	*fc;
-    int		save_did_emsg;
-    static int	depth = 0;
-    dictitem_T	*v;
-    int		fixvar_idx = 0;	/* index in fixvar[] */
-    int		i;
-    int		ai;
-    char_u	numbuf[NUMBUFLEN];
-    char_u	*name;
-#ifdef FEAT_PROFILE
-    proftime_T	wait_start;
-    proftime_T	call_start;
-#endif
+    char_u	*p;
+    exptype_T	type = TYPE_UNKNOWN;
+    int		type_is = FALSE;
+    int		len = 2;
+    int		ic = 2;
+    isn_T	*isn;
 
-    /* If depth of calling is getting too high, don't execute the function */
-    if (depth >= p_mfd)
+    if (vm_expr5(cc, arg) == FAIL)
+	return FAIL;
+
+    p = *arg;
+    switch (p[0])
     {
-	EMSG(_("E132: Function call depth is higher than 'maxfuncdepth'"));
-	rettv->v_type = VAR_NUMBER;
-	rettv->vval.v_number = -1;
-	return;
+	case '=':   if (p[1] == '=')
+			type = TYPE_EQUAL;
+		    else if (p[1] == '~')
+			type = TYPE_MATCH;
+		    break;
+	case '!':   if (p[1] == '=')
+			type = TYPE_NEQUAL;
+		    else if (p[1] == '~')
+			type = TYPE_NOMATCH;
+		    break;
+	case '>':   if (p[1] != '=')
+		    {
+			type = TYPE_GREATER;
+			len = 1;
+		    }
+		    else
+			type = TYPE_GEQUAL;
+		    break;
+	case '<':   if (p[1] != '=')
+		    {
+			type = TYPE_SMALLER;
+			len = 1;
+		    }
+		    else
+			type = TYPE_SEQUAL;
+		    break;
+	case 'i':   if (p[1] == 's')
+		    {
+			if (p[2] == 'n' && p[3] == 'o' && p[4] == 't')
+			    len = 5;
+			if (!vim_isIDc(p[len]))
+			{
+			    type = len == 2 ? TYPE_EQUAL : TYPE_NEQUAL;
+			    type_is = TRUE;
+			}
+		    }
+		    break;
     }
-    ++depth;
-
-    line_breakcheck();		/* check for CTRL-C hit */
-
-    fc = (funccall_T *)alloc(sizeof(funccall_T));
-    fc->caller = current_funccal;
-    current_funccal = fc;
-    fc->func = fp;
-    fc->rettv = rettv;
-    rettv->vval.v_number = 0;
-    fc->linenr = 0;
-    fc->returned = FALSE;
-    fc->level = ex_nesting_level;
-    /* Check if this function has a breakpoint. */
-    fc->breakpoint = dbg_find_breakpoint(FALSE, fp->uf_name, (linenr_T)0);
-    fc->dbg_tick = debug_tick;
+    if (type == TYPE_UNKNOWN)
+	return OK;
 
-    /*
-     * Note about using fc->fixvar[]: This is an array of FIXVAR_CNT variables
-     * with names up to VAR_SHORT_LEN long.  This avoids having to alloc/free
-     * each argument variable and saves a lot of time.
-     */
-    /*
-     * Init l: variables.
-     */
-    init_var_dict(&fc->l_vars, &fc->l_vars_var, VAR_DEF_SCOPE);
-    if (selfdict != NULL)
+    if (p[len] == '?')
     {
-	/* Set l:self to "selfdict".  Use "name" to avoid a warning from
-	 * some compiler that checks the destination size. */
-	v = &fc->fixvar[fixvar_idx++].var;
-	name = v->di_key;
-	STRCPY(name, "self");
-	v->di_flags = DI_FLAGS_RO + DI_FLAGS_FIX;
-	hash_add(&fc->l_vars.dv_hashtab, DI2HIKEY(v));
-	v->di_tv.v_type = VAR_DICT;
-	v->di_tv.v_lock = 0;
-	v->di_tv.vval.v_dict = selfdict;
-	++selfdict->dv_refcount;
+	ic = TRUE;
+	++len;
+    }
+    else if (p[len] == '#')
+    {
+	ic = FALSE;
+	++len;
+    }
+    else
+    {
+	/* 'ignorecase' is used as it is before evaluating the second
+	 * operand. */
+	if (vm_emit(cc, ISN_PUSHIC) == NULL)
+	    return FAIL;
+	vm_depth(cc, 1);
     }
 
-    /*
-     * Init a: variables.
-     * Set a:0 to "argcount".
-     * Set a:000 to a list with room for the "..." arguments.
-     */
-    init_var_dict(&fc->l_avars, &fc->l_avars_var, VAR_SCOPE);
-    add_nr_var(&fc->l_avars, &fc->fixvar[fixvar_idx++].var, "0",
-				(varnumber_T)(argcount - fp->uf_args.ga_len));
-    /* Use "name" to avoid a warning from some compiler that checks the
-     * destination size. */
-    v = &fc->fixvar[fixvar_idx++].var;
-    name = v->di_key;
-    STRCPY(name, "000");
-    v->di_flags = DI_FLAGS_RO | DI_FLAGS_FIX;
-    hash_add(&fc->l_avars.dv_hashtab, DI2HIKEY(v));
-    v->di_tv.v_type = VAR_LIST;
-    v->di_tv.v_lock = VAR_FIXED;
-    v->di_tv.vval.v_list = &fc->l_varlist;
-    vim_memset(&fc->l_varlist, 0, sizeof(list_T));
-    fc->l_varlist.lv_refcount = DO_NOT_FREE_CNT;
-    fc->l_varlist.lv_lock = VAR_FIXED;
+    *arg = skipwhite(p + len);
+    if (vm_expr5(cc, arg) == FAIL || (isn = vm_emit(cc, ISN_COMPARE)) == NULL)
+	return FAIL;
+    isn->isn_a = (int)type;
+    isn->isn_b = type_is;
+    isn->isn_c = ic;
+    vm_depth(cc, ic == 2 ? -2 : -1);
+    return OK;
+}
 
-    /*
-     * Set a:firstline to "firstline" and a:lastline to "lastline".
-     * Set a:name to named arguments.
-     * Set a:N to the "..." arguments.
-     */
-    add_nr_var(&fc->l_avars, &fc->fixvar[fixvar_idx++].var, "firstline",
-						      (varnumber_T)firstline);
-    add_nr_var(&fc->l_avars, &fc->fixvar[fixvar_idx++].var, "lastline",
-						       (varnumber_T)lastline);
-    for (i = 0; i < argcount; ++i)
+/*
+ * Compile "expr + expr", "expr - expr" and "expr . expr".
+ */
+    static int
+vm_expr5(cc, arg)
+    vmcctx_T	*cc;
+    char_u	**arg;
+{
+    int		op;
+    int		start = VM_LEN(cc);
+    int		lhs_const;
+    typval_T	tv1;
+    typval_T	tv2;
+    isn_T	*isn;
+
+    if (vm_expr6(cc, arg, FALSE) == FAIL)
+	return FAIL;
+
+    for (;;)
     {
-	ai = i - fp->uf_args.ga_len;
-	if (ai < 0)
-	    /* named argument a:name */
-	    name = FUNCARG(fp, i);
-	else
+	op = **arg;
+	if (op != '+' && op != '-' && op != '.')
+	    break;
+
+	/* The check of the first operand is not needed when it is a
+	 * constant that always passes it. */
+	lhs_const = VM_LEN(cc) == start + 1 && vm_is_const(cc, start);
+	if (!lhs_const || (op == '.'
+		       && VM_ISN(cc, start)->isn_type != ISN_PUSHNR
+		       && VM_ISN(cc, start)->isn_type != ISN_PUSHSTR))
 	{
-	    /* "..." argument a:1, a:2, etc. */
-	    sprintf((char *)numbuf, "%d", ai + 1);
-	    name = numbuf;
+	    lhs_const = FALSE;
+	    if ((isn = vm_emit(cc, ISN_ADDCHK)) == NULL)
+		return FAIL;
+	    isn->isn_a = op;
 	}
-	if (fixvar_idx < FIXVAR_CNT && STRLEN(name) <= VAR_SHORT_LEN)
+
+	*arg = skipwhite(*arg + 1);
+	if (vm_expr6(cc, arg, op == '.') == FAIL)
+	    return FAIL;
+
+	if (lhs_const && VM_LEN(cc) == start + 2 && vm_is_const(cc, start + 1)
+#ifdef FEAT_FLOAT
+		&& !(op == '.' && VM_ISN(cc, start + 1)->isn_type
+							     == ISN_PUSHFLOAT)
+#endif
+		)
 	{
-	    v = &fc->fixvar[fixvar_idx++].var;
-	    v->di_flags = DI_FLAGS_RO | DI_FLAGS_FIX;
+	    /* Both operands are constants: compute the result now. */
+	    vm_isn2tv(VM_ISN(cc, start), &tv1);
+	    vm_isn2tv(VM_ISN(cc, start + 1), &tv2);
+	    if (eval_addsub(&tv1, &tv2, op) == OK)
+	    {
+		cc->cc_code->fc_instr.ga_len = start;
+		vm_depth(cc, -1);
+		if (vm_tv2isn(cc, &tv1, start) == FAIL)
+		    return FAIL;
+		continue;
+	    }
 	}
-	else
+
+	if ((isn = vm_emit(cc, ISN_ADD)) == NULL)
+	    return FAIL;
+	isn->isn_a = op;
+	vm_depth(cc, -1);
+    }
+    return OK;
+}
+
+/*
+ * Compile "expr * expr", "expr / expr" and "expr % expr".
+ */
+    static int
+vm_expr6(cc, arg, want_string)
+    vmcctx_T	*cc;
+    char_u	**arg;
+    int		want_string;
+{
+    int		op;
+    int		start = VM_LEN(cc);
+    int		lhs_const;
+    typval_T	tv1;
+    typval_T	tv2;
+    isn_T	*isn;
+
+    if (vm_expr7(cc, arg, want_string) == FAIL)
+	return FAIL;
+
+    for (;;)
+    {
+	op = **arg;
+	if (op != '*' && op != '/' && op != '%')
+	    break;
+
+	lhs_const = VM_LEN(cc) == start + 1 && vm_is_const(cc, start);
+	if (lhs_const)
 	{
-	    v = (dictitem_T *)alloc((unsigned)(sizeof(dictitem_T)
-							     + STRLEN(name)));
-	    if (v == NULL)
-		break;
-	    v->di_flags = DI_FLAGS_RO;
+	    isn = VM_ISN(cc, start);
+	    if (isn->isn_type == ISN_PUSHSTR)
+	    {
+		/* A String constant is turned into a Number now. */
+		vm_isn2tv(isn, &tv1);
+		if (eval_muldiv_prep(&tv1) == FAIL)
+		    return FAIL;
+		isn->isn_type = ISN_PUSHNR;
+		isn->isn_n = tv1.vval.v_number;
+	    }
 	}
-	STRCPY(v->di_key, name);
-	hash_add(&fc->l_avars.dv_hashtab, DI2HIKEY(v));
+	else if (vm_emit(cc, ISN_MULPREP) == NULL)
+	    return FAIL;
 
-	/* Note: the values are copied directly to avoid alloc/free.
-	 * "argvars" must have VAR_FIXED for v_lock. */
-	v->di_tv = argvars[i];
-	v->di_tv.v_lock = VAR_FIXED;
+	*arg = skipwhite(*arg + 1);
+	if (vm_expr7(cc, arg, FALSE) == FAIL)
+	    return FAIL;
 
-	if (ai >= 0 && ai < MAX_FUNC_ARGS)
+	if (lhs_const && VM_LEN(cc) == start + 2 && vm_is_const(cc, start + 1)
+#ifdef FEAT_FLOAT
+		&& !(op == '%' && (VM_ISN(cc, start)->isn_type == ISN_PUSHFLOAT
+			|| VM_ISN(cc, start + 1)->isn_type == ISN_PUSHFLOAT))
+#endif
+		)
 	{
-	    list_append(&fc->l_varlist, &fc->l_listitems[ai]);
-	    fc->l_listitems[ai].li_tv = argvars[i];
-	    fc->l_listitems[ai].li_tv.v_lock = VAR_FIXED;
+	    vm_isn2tv(VM_ISN(cc, start), &tv1);
+	    vm_isn2tv(VM_ISN(cc, start + 1), &tv2);
+	    if (eval_muldiv(&tv1, &tv2, op) == OK)
+	    {
+		cc->cc_code->fc_instr.ga_len = start;
+		vm_depth(cc, -1);
+		if (vm_tv2isn(cc, &tv1, start) == FAIL)
+		    return FAIL;
+		continue;
+	    }
 	}
+
+	if ((isn = vm_emit(cc, ISN_MUL)) == NULL)
+	    return FAIL;
+	isn->isn_a = op;
+	vm_depth(cc, -1);
     }
+    return OK;
+}
 
-    /* Don't redraw while executing the function. */
-    ++RedrawingDisabled;
-    save_sourcing_name = sourcing_name;
-    save_sourcing_lnum = sourcing_lnum;
-    sourcing_lnum = 1;
-    sourcing_name = alloc((unsigned)((save_sourcing_name == NULL ? 0
-		: STRLEN(save_sourcing_name)) + STRLEN(fp->uf_name) + 13));
-    if (sourcing_name != NULL)
-    {
-	if (save_sourcing_name != NULL
-			  && STRNCMP(save_sourcing_name, "function ", 9) == 0)
-	    sprintf((char *)sourcing_name, "%s..", save_sourcing_name);
-	else
-	    STRCPY(sourcing_name, "function ");
-	cat_func_name(sourcing_name + STRLEN(sourcing_name), fp);
+/*
+ * Compile a value with its leading '!', '-' and '+' and trailing "[expr]".
+ */
+    static int
+vm_expr7(cc, arg, want_string)
+    vmcctx_T	*cc;
+    char_u	**arg;
+    int		want_string;
+{
+    char_u	*start_leader, *end_leader;
+    char_u	*p;
+    char_u	*s;
+    char_u	*expr_start;
+    char_u	*expr_end;
+    int		len;
+    int		start;
+    int		is_var = FALSE;
+    int		flags;
+    int		slot;
+    long	n;
+    typval_T	tv;
+    isn_T	*isn;
 
-	if (p_verbose >= 12)
-	{
-	    ++no_wait_return;
-	    verbose_enter_scroll();
+    start_leader = *arg;
+    while (**arg == '!' || **arg == '-' || **arg == '+')
+	*arg = skipwhite(*arg + 1);
+    end_leader = *arg;
+    start = VM_LEN(cc);
 
-	    smsg((char_u *)_("calling %s"), sourcing_name);
-	    if (p_verbose >= 14)
+    switch (**arg)
+    {
+	case '0': case '1': case '2': case '3': case '4':
+	case '5': case '6': case '7': case '8': case '9':
 	    {
-		char_u	buf[MSG_BUF_LEN];
-		char_u	numbuf2[NUMBUFLEN];
-		char_u	*tofree;
-		char_u	*s;
+#ifdef FEAT_FLOAT
+		int	get_float = FALSE;
 
-		msg_puts((char_u *)"(");
-		for (i = 0; i < argcount; ++i)
+		/* Same check for a Float as in eval7(). */
+		p = skipdigits(*arg + 1);
+		if (!want_string && p[0] == '.' && vim_isdigit(p[1]))
 		{
-		    if (i > 0)
-			msg_puts((char_u *)", ");
-		    if (argvars[i].v_type == VAR_NUMBER)
-			msg_outnum((long)argvars[i].vval.v_number);
-		    else
+		    get_float = TRUE;
+		    p = skipdigits(p + 2);
+		    if (*p == 'e' || *p == 'E')
 		    {
-			s = tv2string(&argvars[i], &tofree, numbuf2, 0);
-			if (s != NULL)
-			{
-			    if (vim_strsize(s) > MSG_BUF_CLEN)
-			    {
-				trunc_string(s, buf, MSG_BUF_CLEN, MSG_BUF_LEN);
-				s = buf;
-			    }
-			    msg_puts(s);
-			    vim_free(tofree);
-			}
+			++p;
+			if (*p == '-' || *p == '+')
+			    ++p;
+			if (!vim_isdigit(*p))
+			    get_float = FALSE;
+			else
+			    p = skipdigits(p + 1);
 		    }
+		    if (ASCII_ISALPHA(*p) || *p == '.')
+			get_float = FALSE;
 		}
-		msg_puts((char_u *)")");
+		if (get_float)
+		{
+		    if ((isn = vm_emit(cc, ISN_PUSHFLOAT)) == NULL)
+			return FAIL;
+		    *arg += string2float(*arg, &isn->isn_f);
+		}
+		else
+#endif
+		{
+		    vim_str2nr(*arg, NULL, &len, TRUE, TRUE, &n, NULL);
+		    *arg += len;
+		    if ((isn = vm_emit(cc, ISN_PUSHNR)) == NULL)
+			return FAIL;
+		    isn->isn_n = n;
+		}
+		break;
 	    }
-	    msg_puts((char_u *)"\n");   /* don't overwrite this either */
 
-	    verbose_leave_scroll();
-	    --no_wait_return;
-	}
+	case '"':
+	    p = *arg;
+	    if (get_string_tv(&p, &tv, FALSE) == FAIL)
+		return FAIL;
+	    len = (int)(p - *arg);
+	    if ((s = vm_pool(cc, *arg, len)) == NULL
+				     || (isn = vm_emit(cc, ISN_PUSHSTR)) == NULL)
+		return FAIL;
+	    if (vim_strchr(s, '\\') != NULL)
+	    {
+		/* Backslashes are handled when executing. */
+		isn->isn_s = s;
+		isn->isn_b = TRUE;
+	    }
+	    else
+	    {
+		s[len - 1] = NUL;
+		isn->isn_s = s + 1;
+	    }
+	    *arg = p;
+	    break;
+
+	case '\'':
+	    if (get_lit_string_tv(arg, &tv, TRUE) == FAIL)
+		return FAIL;
+	    s = tv.vval.v_string;
+	    if (s == NULL)
+		return FAIL;
+	    if (vm_pool_add(cc, s) == FAIL
+				     || (isn = vm_emit(cc, ISN_PUSHSTR)) == NULL)
+		return FAIL;
+	    isn->isn_s = s;
+	    break;
+
+	case '[':
+	    *arg = skipwhite(*arg + 1);
+	    len = 0;
+	    while (**arg != ']' && **arg != NUL)
+	    {
+		if (vm_expr1(cc, arg) == FAIL)
+		    return FAIL;
+		++len;
+		if (**arg == ']')
+		    break;
+		if (**arg != ',')
+		    return FAIL;
+		*arg = skipwhite(*arg + 1);
+	    }
+	    if (**arg != ']' || (isn = vm_emit(cc, ISN_NEWLIST)) == NULL)
+		return FAIL;
+	    isn->isn_a = len;
+	    vm_depth(cc, -len);
+	    *arg = skipwhite(*arg + 1);
+	    break;
+
+	case '&':
+	    p = *arg;
+	    if (get_option_tv(&p, NULL, FALSE) == FAIL
+		    || (s = vm_pool(cc, *arg, (int)(p - *arg))) == NULL
+		    || (isn = vm_emit(cc, ISN_LOADOPT)) == NULL)
+		return FAIL;
+	    isn->isn_s = s;
+	    *arg = p;
+	    break;
+
+	case '$':
+	    p = *arg + 1;
+	    len = get_env_len(&p);
+	    if (len == 0
+		    || (s = vm_pool(cc, *arg, len + 1)) == NULL
+		    || (isn = vm_emit(cc, ISN_LOADENV)) == NULL)
+		return FAIL;
+	    isn->isn_s = s;
+	    *arg = p;
+	    break;
+
+	case '@':
+	    ++*arg;
+	    if ((isn = vm_emit(cc, ISN_LOADREG)) == NULL)
+		return FAIL;
+	    isn->isn_a = **arg;
+	    if (**arg != NUL)
+		++*arg;
+	    break;
+
+	case '(':
+	    *arg = skipwhite(*arg + 1);
+	    if (vm_expr1(cc, arg) == FAIL || **arg != ')')
+		return FAIL;
+	    ++*arg;
+	    is_var = TRUE;
+	    vm_depth(cc, -1);
+	    break;
+
+	case '{':
+	    /* Dictionary or curly-braces name */
+	    return FAIL;
+
+	default:
+	    /* Variable or function name.  Names with curly braces and
+	     * "<SID>" are left to eval7(). */
+	    s = *arg;
+	    if (s[0] == K_SPECIAL)
+		return FAIL;
+	    len = eval_fname_script(s);
+	    if (len == 5)
+		return FAIL;
+	    p = find_name_end(s + len, &expr_start, &expr_end,
+					       len > 0 ? 0 : FNE_CHECK_START);
+	    if (expr_start != NULL)
+		return FAIL;
+	    for (p = s + len; eval_isnamec(*p); ++p)
+		;
+	    len = (int)(p - s);
+	    if (len == 0)
+		return FAIL;
+	    *arg = skipwhite(p);
+	    if (**arg == '(')
+	    {
+		if (vm_call(cc, s, len, s, FALSE, arg) == FAIL)
+		    return FAIL;
+		vm_depth(cc, -1);
+	    }
+	    else
+	    {
+		if ((s = vm_pool(cc, s, len)) == NULL)
+		    return FAIL;
+		slot = vm_slot(cc, s);
+		if ((isn = vm_emit(cc, slot >= 0 ? ISN_LOADSLOT : ISN_LOADVAR))
+								       == NULL)
+		    return FAIL;
+		isn->isn_s = s;
+		isn->isn_a = len;
+		isn->isn_b = slot;
+	    }
+	    is_var = TRUE;
+	    break;
     }
-#ifdef FEAT_PROFILE
-    if (do_profiling == PROF_YES)
+    vm_depth(cc, 1);
+    *arg = skipwhite(*arg);
+
+    /* Subscripts "[expr]" and "[expr : expr]". */
+    while (**arg == '[' && !vim_iswhite(*(*arg - 1)))
     {
-	if (!fp->uf_profiling && has_profiling(FALSE, fp->uf_name, NULL))
-	    func_do_profile(fp);
-	if (fp->uf_profiling
-		    || (fc->caller != NULL && fc->caller->func->uf_profiling))
+	if (vm_emit(cc, ISN_INDEXCHK) == NULL)
+	    return FAIL;
+	flags = 0;
+	*arg = skipwhite(*arg + 1);
+	if (**arg != ':')
 	{
-	    ++fp->uf_tm_count;
-	    profile_start(&call_start);
-	    profile_zero(&fp->uf_tm_children);
+	    if (vm_expr1(cc, arg) == FAIL || vm_emit(cc, ISN_STRCHK) == NULL)
+		return FAIL;
+	    flags |= 1;
 	}
-	script_prof_save(&wait_start);
+	if (**arg == ':')
+	{
+	    *arg = skipwhite(*arg + 1);
+	    if (**arg != ']')
+	    {
+		if (vm_expr1(cc, arg) == FAIL
+					  || vm_emit(cc, ISN_STRCHK) == NULL)
+		    return FAIL;
+		flags |= 2;
+	    }
+	    flags |= 4;
+	}
+	if (**arg != ']' || (isn = vm_emit(cc, ISN_INDEX)) == NULL)
+	    return FAIL;
+	isn->isn_a = flags & 3;
+	isn->isn_b = (flags & 4) != 0;
+	vm_depth(cc, -((flags & 1) + ((flags & 2) >> 1)));
+	*arg = skipwhite(*arg + 1);
+	is_var = TRUE;
     }
-#endif
-
-    save_current_SID = current_SID;
-    current_SID = fp->uf_script_ID;
-    save_did_emsg = did_emsg;
-    did_emsg = FALSE;
-
-    /* call do_cmdline() to execute the lines */
-    do_cmdline(NULL, get_func_line, (void *)fc,
-				     DOCMD_NOWAIT|DOCMD_VERBOSE|DOCMD_REPEAT);
 
-    --RedrawingDisabled;
+    /* "dict.key" and "funcref(args)" depend on the type of the value. */
+    if (is_var && (**arg == '.' || **arg == '(')
+					       && !vim_iswhite(*(*arg - 1)))
+	return FAIL;
 
-    /* when the function was aborted because of an error, return -1 */
-    if ((did_emsg && (fp->uf_flags & FC_ABORT)) || rettv->v_type == VAR_UNKNOWN)
+    if (end_leader > start_leader)
     {
-	clear_tv(rettv);
-	rettv->v_type = VAR_NUMBER;
-	rettv->vval.v_number = -1;
+	if (VM_LEN(cc) == start + 1 && vm_is_const(cc, start))
+	{
+	    /* Apply the leader to a constant now. */
+	    vm_isn2tv(VM_ISN(cc, start), &tv);
+	    if (eval7_leader(&tv, start_leader, end_leader) == FAIL)
+		return FAIL;
+	    cc->cc_code->fc_instr.ga_len = start;
+	    if (vm_tv2isn(cc, &tv, start) == FAIL)
+		return FAIL;
+	}
+	else
+	{
+	    if ((isn = vm_emit(cc, ISN_LEADER)) == NULL)
+		return FAIL;
+	    isn->isn_s = start_leader;
+	    isn->isn_a = (int)(end_leader - start_leader);
+	}
     }
+    return OK;
+}
 
-#ifdef FEAT_PROFILE
-    if (do_profiling == PROF_YES && (fp->uf_profiling
-		    || (fc->caller != NULL && fc->caller->func->uf_profiling)))
+/*
+ * Compile a call of function "name" with length "len", "*arg" points to the
+ * '('.  "ename" is used for error messages.  "cmd" is TRUE for ":call".
+ * Adds the value of the call to the stack.
+ */
+    static int
+vm_call(cc, name, len, ename, cmd, arg)
+    vmcctx_T	*cc;
+    char_u	*name;
+    int		len;
+    char_u	*ename;
+    int		cmd;
+    char_u	**arg;
+{
+    char_u	*p;
+    char_u	*s = NULL;
+    int		argc = 0;
+    int		idx = -1;
+    int		prep;
+    int		i;
+    isn_T	*isn;
+
+    /* A builtin function can be called directly.  A variable can't have
+     * such a name, thus it is never a Funcref. */
+    if (ASCII_ISLOWER(*name))
     {
-	profile_end(&call_start);
-	profile_sub_wait(&wait_start, &call_start);
-	profile_add(&fp->uf_tm_total, &call_start);
-	profile_self(&fp->uf_tm_self, &call_start, &fp->uf_tm_children);
-	if (fc->caller != NULL && fc->caller->func->uf_profiling)
+	for (i = 0; i < len; ++i)
+	    if (name[i] == ':' || name[i] == AUTOLOAD_CHAR)
+		break;
+	if (i == len)
 	{
-	    profile_add(&fc->caller->func->uf_tm_children, &call_start);
-	    profile_add(&fc->caller->func->uf_tml_children, &call_start);
+	    s = vm_pool(cc, name, len);
+	    if (s == NULL)
+		return FAIL;
+	    idx = find_internal_func(s);
 	}
     }
-#endif
-
-    /* when being verbose, mention the return value */
-    if (p_verbose >= 12)
+    prep = VM_LEN(cc);
+    if (cmd && idx < 0)
     {
-	++no_wait_return;
-	verbose_enter_scroll();
-
-	if (aborting())
-	    smsg((char_u *)_("%s aborted"), sourcing_name);
-	else if (fc->rettv->v_type == VAR_NUMBER)
-	    smsg((char_u *)_("%s returning #%ld"), sourcing_name,
-					       (long)fc->rettv->vval.v_number);
-	else
-	{
-	    char_u	buf[MSG_BUF_LEN];
-	    char_u	numbuf2[NUMBUFLEN];
-	    char_u	*tofree;
-	    char_u	*s;
+	if ((isn = vm_emit(cc, ISN_CALLPREP)) == NULL)
+	    return FAIL;
+	isn->isn_s = name;
+    }
+    else
+    {
+	if (s == NULL && (s = vm_pool(cc, name, len)) == NULL)
+	    return FAIL;
+	if ((isn = vm_emit(cc, ISN_FUNCPREP)) == NULL)
+	    return FAIL;
+	isn->isn_s = s;
+	isn->isn_s2 = ename;
+	isn->isn_a = idx;
+    }
+    if (++cc->cc_calls > cc->cc_code->fc_call_len)
+	cc->cc_code->fc_call_len = cc->cc_calls;
 
-	    /* The value may be very long.  Skip the middle part, so that we
-	     * have some idea how it starts and ends. smsg() would always
-	     * truncate it at the end. */
-	    s = tv2string(fc->rettv, &tofree, numbuf2, 0);
-	    if (s != NULL)
-	    {
-		if (vim_strsize(s) > MSG_BUF_CLEN)
-		{
-		    trunc_string(s, buf, MSG_BUF_CLEN, MSG_BUF_LEN);
-		    s = buf;
-		}
-		smsg((char_u *)_("%s returning %s"), sourcing_name, s);
-		vim_free(tofree);
-	    }
-	}
-	msg_puts((char_u *)"\n");   /* don't overwrite this either */
+    /* Same loop as in get_func_tv(). */
+    p = *arg;
+    while (argc < MAX_FUNC_ARGS)
+    {
+	p = skipwhite(p + 1);
+	if (*p == ')' || *p == ',' || *p == NUL)
+	    break;
+	if (vm_expr1(cc, &p) == FAIL)
+	    return FAIL;
+	++argc;
+	if (*p != ',')
+	    break;
+    }
+    if (*p != ')' || argc == MAX_FUNC_ARGS)
+	return FAIL;
+    *arg = skipwhite(p + 1);
 
-	verbose_leave_scroll();
-	--no_wait_return;
+    if (idx >= 0 && argc >= functions[idx].f_min_argc
+					  && argc <= functions[idx].f_max_argc)
+    {
+	if ((isn = vm_emit(cc, ISN_BCALL)) == NULL)
+	    return FAIL;
+	isn->isn_a = idx;
+    }
+    else
+    {
+	if (idx >= 0)
+	    /* Wrong number of arguments, let call_func() give the error
+	     * message. */
+	    VM_ISN(cc, prep)->isn_a = -1;
+	if ((isn = vm_emit(cc, ISN_UCALL)) == NULL)
+	    return FAIL;
     }
+    isn->isn_b = argc;
+    vm_depth(cc, 1 - argc);
+    --cc->cc_calls;
+    return OK;
+}
 
-    vim_free(sourcing_name);
-    sourcing_name = save_sourcing_name;
-    sourcing_lnum = save_sourcing_lnum;
-    current_SID = save_current_SID;
-#ifdef FEAT_PROFILE
-    if (do_profiling == PROF_YES)
-	script_prof_restore(&wait_start);
+/*
+ * Return TRUE if instruction "idx" pushes a constant.
+ */
+    static int
+vm_is_const(cc, idx)
+    vmcctx_T	*cc;
+    int		idx;
+{
+    isn_T	*isn = VM_ISN(cc, idx);
+
+    return isn->isn_type == ISN_PUSHNR
+#ifdef FEAT_FLOAT
+	|| isn->isn_type == ISN_PUSHFLOAT
 #endif
+	|| (isn->isn_type == ISN_PUSHSTR && !isn->isn_b);
+}
 
-    if (p_verbose >= 12 && sourcing_name != NULL)
+/*
+ * Get the value of constant instruction "isn" in "tv".
+ */
+    static void
+vm_isn2tv(isn, tv)
+    isn_T	*isn;
+    typval_T	*tv;
+{
+    tv->v_lock = 0;
+    if (isn->isn_type == ISN_PUSHNR)
     {
-	++no_wait_return;
-	verbose_enter_scroll();
-
-	smsg((char_u *)_("continuing in %s"), sourcing_name);
-	msg_puts((char_u *)"\n");   /* don't overwrite this either */
-
-	verbose_leave_scroll();
-	--no_wait_return;
+	tv->v_type = VAR_NUMBER;
+	tv->vval.v_number = isn->isn_n;
     }
-
-    did_emsg |= save_did_emsg;
-    current_funccal = fc->caller;
-    --depth;
-
-    /* If the a:000 list and the l: and a: dicts are not referenced we can
-     * free the funccall_T and what's in it. */
-    if (fc->l_varlist.lv_refcount == DO_NOT_FREE_CNT
-	    && fc->l_vars.dv_refcount == DO_NOT_FREE_CNT
-	    && fc->l_avars.dv_refcount == DO_NOT_FREE_CNT)
+#ifdef FEAT_FLOAT
+    else if (isn->isn_type == ISN_PUSHFLOAT)
     {
-	free_funccal(fc, FALSE);
+	tv->v_type = VAR_FLOAT;
+	tv->vval.v_float = isn->isn_f;
     }
+#endif
     else
     {
-	hashitem_T	*hi;
-	listitem_T	*li;
-	int		todo;
-
-	/* "fc" is still in use.  This can happen when returning "a:000" or
-	 * assigning "l:" to a global variable.
-	 * Link "fc" in the list for garbage collection later. */
-	fc->caller = previous_funccal;
-	previous_funccal = fc;
+	tv->v_type = VAR_STRING;
+	tv->vval.v_string = isn->isn_s == NULL ? NULL : vim_strsave(isn->isn_s);
+    }
+}
 
-	/* Make a copy of the a: variables, since we didn't do that above. */
-	todo = (int)fc->l_avars.dv_hashtab.ht_used;
-	for (hi = fc->l_avars.dv_hashtab.ht_array; todo > 0; ++hi)
-	{
-	    if (!HASHITEM_EMPTY(hi))
-	    {
-		--todo;
-		v = HI2DI(hi);
-		copy_tv(&v->di_tv, &v->di_tv);
-	    }
-	}
+/*
+ * Add an instruction at "idx" that pushes the constant value "tv".  A String
+ * value is taken over.
+ */
+    static int
+vm_tv2isn(cc, tv, idx)
+    vmcctx_T	*cc;
+    typval_T	*tv;
+    int		idx;
+{
+    isn_T	*isn;
 
-	/* Make a copy of the a:000 items, since we didn't do that above. */
-	for (li = fc->l_varlist.lv_first; li != NULL; li = li->li_next)
-	    copy_tv(&li->li_tv, &li->li_tv);
-    }
+    cc->cc_code->fc_instr.ga_len = idx;
+    if (tv->v_type == VAR_STRING && tv->vval.v_string != NULL
+			       && vm_pool_add(cc, tv->vval.v_string) == FAIL)
+	return FAIL;
+    if ((isn = vm_emit(cc, tv->v_type == VAR_NUMBER ? ISN_PUSHNR
+#ifdef FEAT_FLOAT
+		: tv->v_type == VAR_FLOAT ? ISN_PUSHFLOAT
+#endif
+		: ISN_PUSHSTR)) == NULL)
+	return FAIL;
+    if (tv->v_type == VAR_NUMBER)
+	isn->isn_n = tv->vval.v_number;
+#ifdef FEAT_FLOAT
+    else if (tv->v_type == VAR_FLOAT)
+	isn->isn_f = tv->vval.v_float;
+#endif
+    else
+	isn->isn_s = tv->vval.v_string;
+    return OK;
 }
 
 /*
- * Return TRUE if items in "fc" do not have "copyID".  That means they are not
- * referenced from anywhere that is in use.
+ * Return the slot for variable "name" when it is a local or argument
+ * variable, -1 otherwise.
  */
     static int
-can_free_funccal(fc, copyID)
-    funccall_T	*fc;
-    int		copyID;
+vm_slot(cc, name)
+    vmcctx_T	*cc;
+    char_u	*name;
 {
-    return (fc->l_varlist.lv_copyID != copyID
-	    && fc->l_vars.dv_copyID != copyID
-	    && fc->l_avars.dv_copyID != copyID);
+    funccode_T	*code = cc->cc_code;
+    vmslot_T	*vs;
+    hashtab_T	*ht;
+    char_u	*varname;
+    int		arg;
+    int		i;
+
+    ht = find_var_ht(name, &varname);
+    if (ht == &cc->cc_fc->l_vars.dv_hashtab)
+	arg = FALSE;
+    else if (ht == &cc->cc_fc->l_avars.dv_hashtab)
+	arg = TRUE;
+    else
+	return -1;
+    if (*varname == NUL)
+	return -1;
+
+    for (i = 0; i < code->fc_slots.ga_len; ++i)
+    {
+	vs = (vmslot_T *)code->fc_slots.ga_data + i;
+	if (vs->vs_arg == arg && STRCMP(vs->vs_name, varname) == 0)
+	    return i;
+    }
+    if (ga_grow(&code->fc_slots, 1) == FAIL)
+	return -1;
+    vs = (vmslot_T *)code->fc_slots.ga_data + code->fc_slots.ga_len;
+    vs->vs_name = varname;
+    vs->vs_arg = arg;
+    vs->vs_room = !arg && STRLEN(varname) <= VAR_SHORT_LEN
+						    ? code->fc_room_len++ : -1;
+    return code->fc_slots.ga_len++;
 }
 
 /*
- * Free "fc" and what it contains.
+ * Do what do_cmdline() does after executing a command in a function.
+ * "loop" is TRUE for ":endwhile", ":endfor" and ":continue".
+ * Returns VMD_JUMP when jumping back to the loop, VMD_STOP when the function
+ * is to stop and VMD_NEXT otherwise.
  */
-   static void
-free_funccal(fc, free_val)
-    funccall_T	*fc;
-    int		free_val;  /* a: vars were allocated */
+    static int
+vm_cmd_done(fc, cstack, initial_trylevel, loop)
+    funccall_T		*fc;
+    struct condstack	*cstack;
+    int			initial_trylevel;
+    int			loop;
 {
-    listitem_T	*li;
+    int		ret = VMD_NEXT;
 
-    /* The a: variables typevals may not have been allocated, only free the
-     * allocated variables. */
-    vars_clear_ext(&fc->l_avars.dv_hashtab, free_val);
+    /* reset did_emsg for a function that is not aborted by an error */
+    if (did_emsg && !force_abort && !func_has_abort(fc))
+	did_emsg = FALSE;
+
+    if (loop && !did_emsg && !got_int && !did_throw)
+    {
+	ret = VMD_JUMP;
+	line_breakcheck();		/* check if CTRL-C typed */
+    }
 
-    /* free all l: variables */
-    vars_clear(&fc->l_vars.dv_hashtab);
+    trylevel = initial_trylevel;
+    if (trylevel == 0 && !did_emsg && !got_int && !did_throw)
+	force_abort = FALSE;
 
-    /* Free the a:000 variables if they were allocated. */
-    if (free_val)
-	for (li = fc->l_varlist.lv_first; li != NULL; li = li->li_next)
-	    clear_tv(&li->li_tv);
+    /* Convert an interrupt to an exception if appropriate. */
+    (void)do_intthrow(cstack);
 
-    vim_free(fc);
+    /* After an error in a function with the "abort" flag the rest of the
+     * line would be skipped and the function ends at the next line. */
+    if (got_int || did_emsg || did_throw)
+	return VMD_STOP;
+    return ret;
 }
 
 /*
- * Add a number variable "name" to dict "dp" with value "nr".
+ * Find the variable of slot "idx".  The item found before is used, unless a
+ * variable was removed from l: or a: since then.
+ * Returns NULL when the variable doesn't exist.
  */
-    static void
-add_nr_var(dp, v, name, nr)
-    dict_T	*dp;
-    dictitem_T	*v;
-    char	*name;
-    varnumber_T nr;
+    static dictitem_T *
+vm_slot_find(vf, idx)
+    vmframe_T	*vf;
+    int		idx;
 {
-    STRCPY(v->di_key, name);
-    v->di_flags = DI_FLAGS_RO | DI_FLAGS_FIX;
-    hash_add(&dp->dv_hashtab, DI2HIKEY(v));
-    v->di_tv.v_type = VAR_NUMBER;
-    v->di_tv.v_lock = VAR_FIXED;
-    v->di_tv.vval.v_number = nr;
+    funccall_T	*fc = vf->vf_fc;
+    vmslot_T	*vs;
+    hashitem_T	*hi;
+
+    if (fc->l_vars.dv_hashtab.ht_changed != vf->vf_l_changed
+		      || fc->l_avars.dv_hashtab.ht_changed != vf->vf_a_changed)
+    {
+	vim_memset(vf->vf_slots, 0,
+		     sizeof(dictitem_T *) * vf->vf_code->fc_slots.ga_len);
+	vf->vf_l_changed = fc->l_vars.dv_hashtab.ht_changed;
+	vf->vf_a_changed = fc->l_avars.dv_hashtab.ht_changed;
+    }
+    if (vf->vf_slots[idx] == NULL)
+    {
+	vs = (vmslot_T *)vf->vf_code->fc_slots.ga_data + idx;
+	hi = hash_find(vs->vs_arg ? &fc->l_avars.dv_hashtab
+				     : &fc->l_vars.dv_hashtab, vs->vs_name);
+	if (!HASHITEM_EMPTY(hi))
+	    vf->vf_slots[idx] = HI2DI(hi);
+    }
+    return vf->vf_slots[idx];
 }
 
 /*
- * ":return [expr]"
+ * Set the variable of slot "idx", called "name", to "tv".  Like set_var().
+ * A new local variable is stored in the room of the funccall_T when
+ * possible.
  */
-    void
-ex_return(eap)
-    exarg_T	*eap;
+    static void
+vm_slot_set(vf, idx, name, tv, copy)
+    vmframe_T	*vf;
+    int		idx;
+    char_u	*name;
+    typval_T	*tv;
+    int		copy;
 {
-    char_u	*arg = eap->arg;
-    typval_T	rettv;
-    int		returning = FALSE;
+    funccall_T	*fc = vf->vf_fc;
+    vmslot_T	*vs = (vmslot_T *)vf->vf_code->fc_slots.ga_data + idx;
+    dictitem_T	*di;
 
-    if (current_funccal == NULL)
+    di = vm_slot_find(vf, idx);
+    if (di == NULL && (vs->vs_room < 0 || vs->vs_room >= fc->l_room_len))
     {
-	EMSG(_("E133: :return not inside a function"));
+	set_var(name, tv, copy);
 	return;
     }
 
-    if (eap->skip)
-	++emsg_skip;
-
-    eap->nextcmd = NULL;
-    if ((*arg != NUL && *arg != '|' && *arg != '\n')
-	    && eval0(arg, &rettv, &eap->nextcmd, !eap->skip) != FAIL)
+    if (tv->v_type == VAR_FUNC && var_check_func_name(name, di == NULL))
+	return;
+    if (di != NULL)
     {
-	if (!eap->skip)
-	    returning = do_return(eap, FALSE, TRUE, &rettv);
-	else
-	    clear_tv(&rettv);
+	if (var_check_set(di, name, tv))
+	    return;
+	clear_tv(&di->di_tv);
     }
-    /* It's safer to return also on error. */
-    else if (!eap->skip)
+    else
     {
-	/*
-	 * Return unless the expression evaluation has been cancelled due to an
-	 * aborting error, an interrupt, or an exception.
-	 */
-	if (!aborting())
-	    returning = do_return(eap, FALSE, TRUE, NULL);
+	if (!valid_varname(vs->vs_name))
+	    return;
+	/* The room is not in use, otherwise the variable would exist. */
+	di = &fc->l_room[vs->vs_room].var;
+	STRCPY(di->di_key, vs->vs_name);
+	if (hash_add(&fc->l_vars.dv_hashtab, DI2HIKEY(di)) == FAIL)
+	    return;
+	di->di_flags = DI_FLAGS_NOFREE;
+	vf->vf_slots[idx] = di;
     }
-
-    /* When skipping or the return gets pending, advance to the next command
-     * in this line (!returning).  Otherwise, ignore the rest of the line.
-     * Following lines will be ignored by get_func_line(). */
-    if (returning)
-	eap->nextcmd = NULL;
-    else if (eap->nextcmd == NULL)	    /* no argument */
-	eap->nextcmd = check_nextcmd(arg);
-
-    if (eap->skip)
-	--emsg_skip;
+    set_var_value(di, tv, copy);
 }
 
 /*
- * Return from a function.  Possibly makes the return pending.  Also called
- * for a pending return at the ":endtry" or after returning from an extra
- * do_cmdline().  "reanimate" is used in the latter case.  "is_cmd" is set
- * when called due to a ":return" command.  "rettv" may point to a typval_T
- * with the return rettv.  Returns TRUE when the return can be carried out,
- * FALSE when the return gets pending.
+ * Execute the compiled function called with "cookie".  This replaces the
+ * loop in do_cmdline(), "cstack" is its (empty) condition stack.
  */
-    int
-do_return(eap, reanimate, is_cmd, rettv)
-    exarg_T	*eap;
-    int		reanimate;
-    int		is_cmd;
-    void	*rettv;
-{
-    int		idx;
-    struct condstack *cstack = eap->cstack;
+    void
+func_exec_code(cookie, cstack)
+    void		*cookie;
+    struct condstack	*cstack;
+{
+    funccall_T	*fc = (funccall_T *)cookie;
+    ufunc_T	*fp = fc->func;
+    funccode_T	*code = fp->uf_code;
+    isn_T	*instr = (isn_T *)code->fc_instr.ga_data;
+    isn_T	*isn;
+    typval_T	stack_buf[VM_STACK_LEN];
+    vmcall_T	call_buf[VM_CALL_LEN];
+    forinfo_T	*for_buf[VM_CALL_LEN];
+    dictitem_T	*slot_buf[VM_SLOT_LEN];
+    typval_T	*stack = stack_buf;
+    vmcall_T	*calls = call_buf;
+    forinfo_T	**fors = for_buf;
+    vmframe_T	vf;
+    forinfo_T	*fi;
+    dictitem_T	*di;
+    vmcall_T	*call;
+    typval_T	*tv;
+    typval_T	rettv;
+    listitem_T	*item;
+    list_T	*l;
+    funcdict_T	fudi;
+    cmdmod_T	save_cmdmod;
+    char_u	*cmdline;
+    char_u	*next;
+    char_u	*p;
+    char_u	op[2];
+    int		initial_trylevel = trylevel;
+    int		sp = 0;		/* stack pointer */
+    int		cp = 0;		/* nr of calls being prepared */
+    int		pc = 0;		/* next instruction */
+    int		expr = 0;	/* last ISN_EXPR */
+    int		failed = FALSE;	/* expression failed */
+    int		cond = VMC_FALSE;
+    int		cur_line = -1;
+    int		kind = VMB_NONE;
+    int		error;
+    int		doesrange;
+    int		len;
+    int		n;
+    int		r;
 
-    if (reanimate)
-	/* Undo the return. */
-	current_funccal->returned = FALSE;
+    /* do_one_cmd() executes each command without modifiers. */
+    save_cmdmod = cmdmod;
+
+    if (code->fc_stack_len >= VM_STACK_LEN)
+	stack = (typval_T *)alloc((unsigned)(sizeof(typval_T)
+						   * (code->fc_stack_len + 1)));
+    if (code->fc_call_len > VM_CALL_LEN)
+	calls = (vmcall_T *)alloc((unsigned)(sizeof(vmcall_T)
+							* code->fc_call_len));
+    if (code->fc_for_len > VM_CALL_LEN)
+	fors = (forinfo_T **)alloc((unsigned)(sizeof(forinfo_T *)
+							 * code->fc_for_len));
+    if (fors != NULL)
+	for (n = 0; n < code->fc_for_len; ++n)
+	    fors[n] = NULL;
+    vf.vf_fc = fc;
+    vf.vf_code = code;
+    vf.vf_slots = slot_buf;
+    if (code->fc_slots.ga_len > VM_SLOT_LEN)
+	vf.vf_slots = (dictitem_T **)alloc((unsigned)(sizeof(dictitem_T *)
+						    * code->fc_slots.ga_len));
+    if (vf.vf_slots != NULL)
+	vim_memset(vf.vf_slots, 0,
+			       sizeof(dictitem_T *) * code->fc_slots.ga_len);
+    vf.vf_l_changed = fc->l_vars.dv_hashtab.ht_changed;
+    vf.vf_a_changed = fc->l_avars.dv_hashtab.ht_changed;
+    if (stack == NULL || calls == NULL || fors == NULL || vf.vf_slots == NULL)
+	goto done;
+    vim_memset(&cmdmod, 0, sizeof(cmdmod));
 
-    /*
-     * Cleanup (and inactivate) conditionals, but stop when a try conditional
-     * not in its finally clause (which then is to be executed next) is found.
-     * In this case, make the ":return" pending for execution at the ":endtry".
-     * Otherwise, return normally.
-     */
-    idx = cleanup_conditionals(eap->cstack, 0, TRUE);
-    if (idx >= 0)
+    for (;;)
     {
-	cstack->cs_pending[idx] = CSTP_RETURN;
-
-	if (!is_cmd && !reanimate)
-	    /* A pending return again gets pending.  "rettv" points to an
-	     * allocated variable with the rettv of the original ":return"'s
-	     * argument if present or is NULL else. */
-	    cstack->cs_rettv[idx] = rettv;
-	else
+	isn = instr + pc++;
+	switch (isn->isn_type)
 	{
-	    /* When undoing a return in order to make it pending, get the stored
-	     * return rettv. */
-	    if (reanimate)
-		rettv = current_funccal->rettv;
+	    case ISN_LINE:
+	    case ISN_EXEC:
+		if (isn->isn_a != cur_line)
+		{
+		    /* Check if the function has returned or aborted. */
+		    if (func_has_ended(fc))
+			goto stop;
+		    cur_line = isn->isn_a;
+		}
+		sourcing_lnum = fc->linenr = isn->isn_a;
+		if (isn->isn_type == ISN_LINE)
+		{
+		    ++ex_nesting_level;
+		    break;
+		}
 
-	    if (rettv != NULL)
-	    {
-		/* Store the value of the pending return. */
-		if ((cstack->cs_rettv[idx] = alloc_tv()) != NULL)
-		    *(typval_T *)cstack->cs_rettv[idx] = *(typval_T *)rettv;
+		kind = ((int *)code->fc_blocks.ga_data)[isn->isn_d];
+		cmdline = vim_strsave(isn->isn_s);
+		if (cmdline == NULL)
+		    goto stop;
+		next = do_one_func_cmd(&cmdline, cstack, fc);
+		r = vm_cmd_done(fc, cstack, initial_trylevel, FALSE);
+		if (r != VMD_STOP && (fc->linenr != isn->isn_a
+			|| (next == NULL ? isn->isn_n >= 0
+				 : (int)(next - cmdline) != isn->isn_n)))
+		{
+		    /* The command did not end where it did when compiling or
+		     * read following lines.  Execute the rest of the line like
+		     * do_cmdline() does and continue with the next line. */
+		    while (next != NULL && r != VMD_STOP)
+		    {
+			STRMOVE(cmdline, next);
+			next = do_one_func_cmd(&cmdline, cstack, fc);
+			r = vm_cmd_done(fc, cstack, initial_trylevel, FALSE);
+		    }
+		    if (r != VMD_STOP)
+		    {
+			n = -1;
+			if (fc->linenr == isn->isn_a)
+			    n = isn->isn_c;
+			else if (fc->linenr > isn->isn_a
+				&& fc->linenr <= fp->uf_lines.ga_len
+				&& code->fc_line_block[fc->linenr]
+								== isn->isn_d)
+			    n = code->fc_line_instr[fc->linenr];
+			if (n < 0)
+			{
+			    EMSG2(_(e_intern2), "func_exec_code()");
+			    r = VMD_STOP;
+			}
+			pc = n;
+			cur_line = -1;
+		    }
+		}
+		vim_free(cmdline);
+		if (r == VMD_STOP)
+		    goto stop;
+		break;
+
+	    case ISN_END:
+		if (need_rethrow)
+		    do_throw(cstack);
+		need_rethrow = check_cstack = FALSE;
+		if (curwin->w_cursor.lnum == 0)
+		    curwin->w_cursor.lnum = 1;
+		do_errthrow(cstack, isn->isn_s);
+		--ex_nesting_level;
+
+		kind = isn->isn_c;
+		r = vm_cmd_done(fc, cstack, initial_trylevel,
+						     isn->isn_b & VME_LOOP);
+		if (r == VMD_STOP)
+		    goto stop;
+		if (r == VMD_JUMP)
+		{
+		    /* back to the ":while" or ":for" */
+		    pc = isn->isn_a;
+		    cur_line = -1;
+		}
+		else if (isn->isn_a >= 0)
+		    pc = isn->isn_a;
+		else if (isn->isn_b & VME_STOP)
+		    goto stop;
+		else if ((isn->isn_b & VME_SKIP) && failed)
+		{
+		    pc = isn->isn_d;
+		    cur_line = -1;
+		}
+		break;
+
+	    case ISN_EXPR:
+		expr = pc - 1;
+		failed = FALSE;
+		break;
+
+	    case ISN_EVAL0:
+		if (eval0(isn->isn_s, &stack[sp], NULL, TRUE) == FAIL)
+		    goto fail;
+		++sp;
+		break;
+
+	    case ISN_PUSHNR:
+		tv = &stack[sp++];
+		tv->v_type = VAR_NUMBER;
+		tv->v_lock = 0;
+		tv->vval.v_number = isn->isn_n;
+		break;
+
+	    case ISN_PUSHSTR:
+		tv = &stack[sp];
+		tv->v_lock = 0;
+		if (isn->isn_b)
+		{
+		    p = isn->isn_s;
+		    if (get_string_tv(&p, tv, TRUE) == FAIL)
+			goto fail;
+		}
 		else
-		    EMSG(_(e_outofmem));
-	    }
-	    else
-		cstack->cs_rettv[idx] = NULL;
+		{
+		    tv->v_type = VAR_STRING;
+		    tv->vval.v_string = isn->isn_s == NULL ? NULL
+						      : vim_strsave(isn->isn_s);
+		}
+		++sp;
+		break;
 
-	    if (reanimate)
-	    {
-		/* The pending return value could be overwritten by a ":return"
-		 * without argument in a finally clause; reset the default
-		 * return value. */
-		current_funccal->rettv->v_type = VAR_NUMBER;
-		current_funccal->rettv->vval.v_number = 0;
-	    }
-	}
-	report_make_pending(CSTP_RETURN, rettv);
-    }
-    else
-    {
-	current_funccal->returned = TRUE;
+#ifdef FEAT_FLOAT
+	    case ISN_PUSHFLOAT:
+		tv = &stack[sp++];
+		tv->v_type = VAR_FLOAT;
+		tv->v_lock = 0;
+		tv->vval.v_float = isn->isn_f;
+		break;
+#endif
 
-	/* If the return is carried out now, store the return value.  For
-	 * a return immediately after reanimation, the value is already
-	 * there. */
-	if (!reanimate && rettv != NULL)
-	{
-	    clear_tv(current_funccal->rettv);
-	    *current_funccal->rettv = *(typval_T *)rettv;
-	    if (!is_cmd)
-		vim_free(rettv);
-	}
-    }
+	    case ISN_PUSHIC:
+		tv = &stack[sp++];
+		tv->v_type = VAR_NUMBER;
+		tv->v_lock = 0;
+		tv->vval.v_number = p_ic;
+		break;
+
+	    case ISN_LOADVAR:
+		if (get_var_tv(isn->isn_s, isn->isn_a, &stack[sp], TRUE, FALSE)
+								       == FAIL)
+		    goto fail;
+		++sp;
+		break;
+
+	    case ISN_LOADSLOT:
+		di = vm_slot_find(&vf, isn->isn_b);
+		if (di != NULL)
+		    copy_tv(&di->di_tv, &stack[sp]);
+		else if (get_var_tv(isn->isn_s, isn->isn_a, &stack[sp], TRUE,
+							       FALSE) == FAIL)
+		    goto fail;
+		++sp;
+		break;
+
+	    case ISN_LOADOPT:
+		p = isn->isn_s;
+		if (get_option_tv(&p, &stack[sp], TRUE) == FAIL)
+		    goto fail;
+		++sp;
+		break;
+
+	    case ISN_LOADENV:
+		p = isn->isn_s;
+		if (get_env_tv(&p, &stack[sp], TRUE) == FAIL)
+		    goto fail;
+		++sp;
+		break;
+
+	    case ISN_LOADREG:
+		tv = &stack[sp++];
+		tv->v_type = VAR_STRING;
+		tv->v_lock = 0;
+		tv->vval.v_string = get_reg_contents(isn->isn_a, GREG_EXPR_SRC);
+		break;
+
+	    case ISN_NEWLIST:
+		l = list_alloc();
+		if (l == NULL)
+		    goto fail;
+		for (n = sp - isn->isn_a; n < sp; ++n)
+		{
+		    item = listitem_alloc();
+		    if (item != NULL)
+		    {
+			item->li_tv = stack[n];
+			item->li_tv.v_lock = 0;
+			list_append(l, item);
+		    }
+		    else
+			clear_tv(&stack[n]);
+		}
+		sp -= isn->isn_a;
+		tv = &stack[sp++];
+		tv->v_type = VAR_LIST;
+		tv->v_lock = 0;
+		tv->vval.v_list = l;
+		++l->lv_refcount;
+		break;
+
+	    case ISN_INDEXCHK:
+		if (stack[sp - 1].v_type == VAR_FUNC)
+		{
+		    EMSG(_("E695: Cannot index a Funcref"));
+		    goto fail;
+		}
+#ifdef FEAT_FLOAT
+		if (stack[sp - 1].v_type == VAR_FLOAT)
+		{
+		    EMSG(_(e_float_as_string));
+		    goto fail;
+		}
+#endif
+		break;
+
+	    case ISN_STRCHK:
+		if (get_tv_string_chk(&stack[sp - 1]) == NULL)
+		    goto fail;
+		break;
+
+	    case ISN_INDEX:
+		{
+		    typval_T	*var1 = NULL;
+		    typval_T	*var2 = NULL;
+
+		    if (isn->isn_a & 2)
+			var2 = &stack[--sp];
+		    if (isn->isn_a & 1)
+			var1 = &stack[--sp];
+		    if (eval_index_inner(&stack[sp - 1], isn->isn_b,
+					   var1, var2, NULL, 0, TRUE) == FAIL)
+			goto fail;
+		}
+		break;
+
+	    case ISN_ADDCHK:
+		if (eval_addsub_check(&stack[sp - 1], isn->isn_a) == FAIL)
+		    goto fail;
+		break;
+
+	    case ISN_ADD:
+		--sp;
+		if (eval_addsub(&stack[sp - 1], &stack[sp], isn->isn_a) == FAIL)
+		    goto fail;
+		break;
+
+	    case ISN_MULPREP:
+		if (eval_muldiv_prep(&stack[sp - 1]) == FAIL)
+		    goto fail;
+		break;
+
+	    case ISN_MUL:
+		--sp;
+		if (eval_muldiv(&stack[sp - 1], &stack[sp], isn->isn_a) == FAIL)
+		    goto fail;
+		break;
 
-    return idx < 0;
-}
+	    case ISN_COMPARE:
+		n = isn->isn_c;
+		if (n == 2)
+		{
+		    /* 'ignorecase' was pushed before the second operand */
+		    --sp;
+		    n = stack[sp - 1].vval.v_number;
+		    stack[sp - 1] = stack[sp];
+		}
+		--sp;
+		if (typval_compare(&stack[sp - 1], &stack[sp],
+			      (exptype_T)isn->isn_a, isn->isn_b, n) == FAIL)
+		    goto fail;
+		break;
 
-/*
- * Free the variable with a pending return value.
- */
-    void
-discard_pending_return(rettv)
-    void	*rettv;
-{
-    free_tv((typval_T *)rettv);
-}
+	    case ISN_ORTEST:
+	    case ISN_ANDTEST:
+	    case ISN_TERNTEST:
+		error = FALSE;
+		tv = &stack[--sp];
+		n = (get_tv_number_chk(tv, &error) != 0);
+		clear_tv(tv);
+		if (error)
+		    goto fail;
+		if (isn->isn_type == ISN_TERNTEST)
+		{
+		    if (!n)
+			pc = isn->isn_a;
+		}
+		else if (n == (isn->isn_type == ISN_ORTEST))
+		{
+		    tv->v_type = VAR_NUMBER;
+		    tv->vval.v_number = n;
+		    ++sp;
+		    pc = isn->isn_a;
+		}
+		break;
 
-/*
- * Generate a return command for producing the value of "rettv".  The result
- * is an allocated string.  Used by report_pending() for verbose messages.
- */
-    char_u *
-get_return_cmd(rettv)
-    void	*rettv;
-{
-    char_u	*s = NULL;
-    char_u	*tofree = NULL;
-    char_u	numbuf[NUMBUFLEN];
+	    case ISN_LEADER:
+		if (eval7_leader(&stack[sp - 1], isn->isn_s,
+					   isn->isn_s + isn->isn_a) == FAIL)
+		    goto fail;
+		break;
 
-    if (rettv != NULL)
-	s = echo_string((typval_T *)rettv, &tofree, numbuf, 0);
-    if (s == NULL)
-	s = (char_u *)"";
+	    case ISN_FUNCPREP:
+		call = &calls[cp++];
+		vim_memset(call, 0, sizeof(vmcall_T));
+		call->vc_ename = isn->isn_s2;
+		call->vc_lnum = curwin->w_cursor.lnum;
+		if (isn->isn_a < 0)
+		{
+		    /* If it is the name of a variable of type VAR_FUNC use
+		     * its contents.  Copy it, the variable may be changed
+		     * while evaluating the arguments. */
+		    len = (int)STRLEN(isn->isn_s);
+		    p = deref_func_name(isn->isn_s, &len, FALSE);
+		    if (p != isn->isn_s)
+		    {
+			call->vc_tofree = vim_strnsave(p, len);
+			if (call->vc_tofree == NULL)
+			    goto fail;
+			p = call->vc_ename = call->vc_tofree;
+		    }
+		    call->vc_name = p;
+		    call->vc_len = len;
+		}
+		break;
 
-    STRCPY(IObuff, ":return ");
-    STRNCPY(IObuff + 8, s, IOSIZE - 8);
-    if (STRLEN(s) + 8 >= IOSIZE)
-	STRCPY(IObuff + IOSIZE - 4, "...");
-    vim_free(tofree);
-    return vim_strsave(IObuff);
-}
+	    case ISN_CALLPREP:
+		p = isn->isn_s;
+		cmdline = trans_function_name(&p, FALSE, TFN_INT, &fudi);
+		if (fudi.fd_newkey != NULL)
+		{
+		    /* Still need to give an error message for missing key. */
+		    EMSG2(_(e_dictkey), fudi.fd_newkey);
+		    vim_free(fudi.fd_newkey);
+		}
+		if (cmdline == NULL)
+		    goto fail;
+		/* If it is the name of a variable of type VAR_FUNC use its
+		 * contents. */
+		len = (int)STRLEN(cmdline);
+		p = deref_func_name(cmdline, &len, FALSE);
+		if (p != cmdline)
+		{
+		    p = vim_strnsave(p, len);
+		    vim_free(cmdline);
+		    if (p == NULL)
+			goto fail;
+		}
+		call = &calls[cp++];
+		call->vc_name = call->vc_ename = call->vc_tofree = p;
+		call->vc_len = len;
+		/* Increase refcount on dictionary, it could get deleted when
+		 * evaluating the arguments. */
+		call->vc_dict = fudi.fd_dict;
+		if (call->vc_dict != NULL)
+		    ++call->vc_dict->dv_refcount;
+		call->vc_lnum = curwin->w_cursor.lnum;
+		break;
 
-/*
- * Get next function line.
- * Called by do_cmdline() to get the next line.
- * Returns allocated string, or NULL for end of function.
- */
-    char_u *
-get_func_line(c, cookie, indent)
-    int	    c UNUSED;
-    void    *cookie;
-    int	    indent UNUSED;
-{
-    funccall_T	*fcp = (funccall_T *)cookie;
-    ufunc_T	*fp = fcp->func;
-    char_u	*retval;
-    garray_T	*gap;  /* growarray with function lines */
+	    case ISN_BCALL:
+		--cp;
+		n = isn->isn_b;
+		sp -= n;
+		rettv.v_type = VAR_NUMBER;	/* default rettv is number zero */
+		rettv.v_lock = 0;
+		rettv.vval.v_number = 0;
+		stack[sp + n].v_type = VAR_UNKNOWN;
+		functions[isn->isn_a].f_func(&stack[sp], &rettv);
+		update_force_abort();
+		while (--n >= 0)
+		    clear_tv(&stack[sp + n]);
+		stack[sp++] = rettv;
+		if (aborting())
+		    goto fail;
+		break;
 
-    /* If breakpoints have been added/deleted need to check for it. */
-    if (fcp->dbg_tick != debug_tick)
-    {
-	fcp->breakpoint = dbg_find_breakpoint(FALSE, fp->uf_name,
-							       sourcing_lnum);
-	fcp->dbg_tick = debug_tick;
-    }
-#ifdef FEAT_PROFILE
-    if (do_profiling == PROF_YES)
-	func_line_end(cookie);
-#endif
+	    case ISN_UCALL:
+		call = &calls[--cp];
+		n = isn->isn_b;
+		sp -= n;
+		rettv.v_type = VAR_UNKNOWN;
+		rettv.v_lock = 0;
+		stack[sp + n].v_type = VAR_UNKNOWN;
+		r = call_func(call->vc_name, call->vc_len, &rettv, n, &stack[sp],
+			       call->vc_lnum, call->vc_lnum, &doesrange, TRUE,
+							       call->vc_dict);
+		while (--n >= 0)
+		    clear_tv(&stack[sp + n]);
+		vim_free(call->vc_tofree);
+		dict_unref(call->vc_dict);
+		if (r == FAIL)
+		    goto fail;
+		stack[sp++] = rettv;
+		if (aborting())
+		    goto fail;
+		break;
 
-    gap = &fp->uf_lines;
-    if (((fp->uf_flags & FC_ABORT) && did_emsg && !aborted_in_try())
-	    || fcp->returned)
-	retval = NULL;
-    else
-    {
-	/* Skip NULL lines (continuation lines). */
-	while (fcp->linenr < gap->ga_len
-			  && ((char_u **)(gap->ga_data))[fcp->linenr] == NULL)
-	    ++fcp->linenr;
-	if (fcp->linenr >= gap->ga_len)
-	    retval = NULL;
-	else
-	{
-	    retval = vim_strsave(((char_u **)(gap->ga_data))[fcp->linenr++]);
-	    sourcing_lnum = fcp->linenr;
-#ifdef FEAT_PROFILE
-	    if (do_profiling == PROF_YES)
-		func_line_start(cookie);
-#endif
-	}
-    }
+	    case ISN_POP:
+		if (!failed)
+		    clear_tv(&stack[--sp]);
+		break;
 
-    /* Did we encounter a breakpoint? */
-    if (fcp->breakpoint != 0 && fcp->breakpoint <= sourcing_lnum)
-    {
-	dbg_breakpoint(fp->uf_name, sourcing_lnum);
-	/* Find next breakpoint. */
-	fcp->breakpoint = dbg_find_breakpoint(FALSE, fp->uf_name,
-							       sourcing_lnum);
-	fcp->dbg_tick = debug_tick;
-    }
+	    case ISN_STORE:
+		if (failed)
+		    break;
+		tv = &stack[--sp];
+		if (isn->isn_a == '=')
+		    set_var(isn->isn_s, tv, FALSE);
+		else if (get_var_tv(isn->isn_s, (int)STRLEN(isn->isn_s),
+						 &rettv, TRUE, FALSE) == OK)
+		{
+		    /* handle +=, -= and .= */
+		    op[0] = isn->isn_a;
+		    op[1] = NUL;
+		    if (tv_op(&rettv, tv, op) == OK)
+			set_var(isn->isn_s, &rettv, FALSE);
+		    clear_tv(&rettv);
+		}
+		clear_tv(tv);
+		break;
 
-    return retval;
-}
+	    case ISN_STORESLOT:
+		if (failed)
+		    break;
+		tv = &stack[--sp];
+		if (isn->isn_a == '=')
+		    vm_slot_set(&vf, isn->isn_b, isn->isn_s, tv, FALSE);
+		else
+		{
+		    di = vm_slot_find(&vf, isn->isn_b);
+		    if (di != NULL)
+			copy_tv(&di->di_tv, &rettv);
+		    if (di != NULL || get_var_tv(isn->isn_s,
+				 (int)STRLEN(isn->isn_s), &rettv, TRUE, FALSE) == OK)
+		    {
+			op[0] = isn->isn_a;
+			op[1] = NUL;
+			if (tv_op(&rettv, tv, op) == OK)
+			    vm_slot_set(&vf, isn->isn_b, isn->isn_s, &rettv,
+									FALSE);
+			clear_tv(&rettv);
+		    }
+		}
+		clear_tv(tv);
+		break;
 
-#if defined(FEAT_PROFILE) || defined(PROTO)
-/*
- * Called when starting to read a function line.
- * "sourcing_lnum" must be correct!
- * When skipping lines it may not actually be executed, but we won't find out
- * until later and we need to store the time now.
- */
-    void
-func_line_start(cookie)
-    void    *cookie;
-{
-    funccall_T	*fcp = (funccall_T *)cookie;
-    ufunc_T	*fp = fcp->func;
+	    case ISN_TEST:
+		if (failed)
+		    cond = VMC_ERROR;
+		else
+		{
+		    error = FALSE;
+		    tv = &stack[--sp];
+		    n = (get_tv_number_chk(tv, &error) != 0);
+		    clear_tv(tv);
+		    cond = error ? VMC_ERROR : n ? VMC_TRUE : VMC_FALSE;
+		}
+		break;
 
-    if (fp->uf_profiling && sourcing_lnum >= 1
-				      && sourcing_lnum <= fp->uf_lines.ga_len)
-    {
-	fp->uf_tml_idx = sourcing_lnum - 1;
-	/* Skip continuation lines. */
-	while (fp->uf_tml_idx > 0 && FUNCLINE(fp, fp->uf_tml_idx) == NULL)
-	    --fp->uf_tml_idx;
-	fp->uf_tml_execed = FALSE;
-	profile_start(&fp->uf_tml_start);
-	profile_zero(&fp->uf_tml_children);
-	profile_get_wait(&fp->uf_tml_wait);
-    }
-}
+	    case ISN_JCOND:
+		if (cond == VMC_FALSE)
+		    pc = isn->isn_a;
+		else if (cond == VMC_ERROR)
+		    pc = isn->isn_b;
+		break;
 
-/*
- * Called when actually executing a function line.
- */
-    void
-func_line_exec(cookie)
-    void    *cookie;
-{
-    funccall_T	*fcp = (funccall_T *)cookie;
-    ufunc_T	*fp = fcp->func;
+	    case ISN_JUMP:
+		pc = isn->isn_a;
+		break;
 
-    if (fp->uf_profiling && fp->uf_tml_idx >= 0)
-	fp->uf_tml_execed = TRUE;
-}
+	    case ISN_RETURN:
+		/* It's safer to return also on error, unless the expression
+		 * evaluation has been cancelled. */
+		if (!failed || !aborting())
+		{
+		    fc->returned = TRUE;
+		    if (!failed && isn->isn_a)
+		    {
+			clear_tv(fc->rettv);
+			*fc->rettv = stack[--sp];
+		    }
+		}
+		break;
 
-/*
- * Called when done with a function line.
- */
-    void
-func_line_end(cookie)
-    void    *cookie;
-{
-    funccall_T	*fcp = (funccall_T *)cookie;
-    ufunc_T	*fp = fcp->func;
+	    case ISN_FORINIT:
+		free_for_info(fors[isn->isn_a]);
+		fors[isn->isn_a] = NULL;
+		if (failed)
+		    break;
+		tv = &stack[--sp];
+		if (tv->v_type != VAR_LIST || tv->vval.v_list == NULL)
+		{
+		    EMSG(_(e_listreq));
+		    clear_tv(tv);
+		    break;
+		}
+		fi = (forinfo_T *)alloc_clear(sizeof(forinfo_T));
+		if (fi == NULL)
+		{
+		    clear_tv(tv);
+		    break;
+		}
+		/* The reference of "tv" is used for the list. */
+		fi->fi_varcount = isn->isn_b;
+		fi->fi_semicolon = isn->isn_c;
+		fi->fi_list = tv->vval.v_list;
+		list_add_watch(fi->fi_list, &fi->fi_lw);
+		fi->fi_lw.lw_item = fi->fi_list->lv_first;
+		fors[isn->isn_a] = fi;
+		break;
 
-    if (fp->uf_profiling && fp->uf_tml_idx >= 0)
-    {
-	if (fp->uf_tml_execed)
-	{
-	    ++fp->uf_tml_count[fp->uf_tml_idx];
-	    profile_end(&fp->uf_tml_start);
-	    profile_sub_wait(&fp->uf_tml_wait, &fp->uf_tml_start);
-	    profile_add(&fp->uf_tml_total[fp->uf_tml_idx], &fp->uf_tml_start);
-	    profile_self(&fp->uf_tml_self[fp->uf_tml_idx], &fp->uf_tml_start,
-							&fp->uf_tml_children);
-	}
-	fp->uf_tml_idx = -1;
-    }
-}
-#endif
+	    case ISN_FORNEXT:
+		fi = fors[isn->isn_a];
+		if (fi == NULL)
+		    cond = VMC_ERROR;
+		else if (isn->isn_n == 1)
+		{
+		    /* use the item at the start of the list and advance */
+		    item = fi->fi_lw.lw_item;
+		    if (item == NULL)
+			cond = VMC_FALSE;
+		    else
+		    {
+			fi->fi_lw.lw_item = item->li_next;
+			if (isn->isn_b >= 0)
+			    vm_slot_set(&vf, isn->isn_b, isn->isn_s,
+							   &item->li_tv, TRUE);
+			else
+			    set_var(isn->isn_s, &item->li_tv, TRUE);
+			cond = VMC_TRUE;
+		    }
+		}
+		else
+		    cond = next_for_item(fi, isn->isn_s) ? VMC_TRUE : VMC_FALSE;
+		if (cond != VMC_TRUE)
+		{
+		    free_for_info(fi);
+		    fors[isn->isn_a] = NULL;
+		}
+		break;
 
-/*
- * Return TRUE if the currently active function should be ended, because a
- * return was encountered or an error occurred.  Used inside a ":while".
- */
-    int
-func_has_ended(cookie)
-    void    *cookie;
-{
-    funccall_T  *fcp = (funccall_T *)cookie;
+	    case ISN_FORFREE:
+		free_for_info(fors[isn->isn_a]);
+		fors[isn->isn_a] = NULL;
+		break;
 
-    /* Ignore the "abort" flag if the abortion behavior has been changed due to
-     * an error inside a try conditional. */
-    return (((fcp->func->uf_flags & FC_ABORT) && did_emsg && !aborted_in_try())
-	    || fcp->returned);
-}
+	    case ISN_FINISH:
+		goto done;
+	}
+	continue;
 
-/*
- * return TRUE if cookie indicates a function which "abort"s on errors.
- */
-    int
-func_has_abort(cookie)
-    void    *cookie;
-{
-    return ((funccall_T *)cookie)->func->uf_flags & FC_ABORT;
+fail:
+	/* The expression failed: give the messages that get_func_tv() and
+	 * eval0() give and continue with the command using the value. */
+	while (cp > 0)
+	{
+	    call = &calls[--cp];
+	    if (!aborting())
+		emsg_funcname(N_("E116: Invalid arguments for function %s"),
+							      call->vc_ename);
+	    vim_free(call->vc_tofree);
+	    dict_unref(call->vc_dict);
+	}
+	while (sp > 0)
+	    clear_tv(&stack[--sp]);
+	failed = TRUE;
+	if (instr[expr].isn_s != NULL && !aborting())
+	    EMSG2(_(e_invexpr2), instr[expr].isn_s);
+	pc = instr[expr].isn_a;
+    }
+
+stop:
+    /* Like do_cmdline(): a missing ":endif", ":endwhile" or ":endfor" is
+     * reported when the function stops inside it. */
+    if (kind != VMB_NONE && !got_int && !did_throw && !func_has_ended(fc))
+	EMSG(_(kind == VMB_IF ? e_endif
+			      : kind == VMB_WHILE ? e_endwhile : e_endfor));
+
+done:
+    if (stack != NULL)
+	while (sp > 0)
+	    clear_tv(&stack[--sp]);
+    if (calls != NULL)
+	while (cp > 0)
+	{
+	    --cp;
+	    vim_free(calls[cp].vc_tofree);
+	    dict_unref(calls[cp].vc_dict);
+	}
+    if (fors != NULL)
+	for (n = 0; n < code->fc_for_len; ++n)
+	    free_for_info(fors[n]);
+    if (stack != stack_buf)
+	vim_free(stack);
+    if (calls != call_buf)
+	vim_free(calls);
+    if (fors != for_buf)
+	vim_free(fors);
+    if (vf.vf_slots != slot_buf)
+	vim_free(vf.vf_slots);
+    cmdmod = save_cmdmod;
 }
 
 #if defined(FEAT_VIMINFO) || defined(FEAT_SESSION)
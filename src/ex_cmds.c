@@ -5485,8 +5485,13 @@ ex_global(eap)
      */
     for (lnum = eap->line1; lnum <= eap->line2 && !got_int; ++lnum)
     {
-	/* a match on this line? */
-	match = vim_regexec_multi(&regmatch, curwin, curbuf, lnum,
+	/* a match on this line?  For ":g" skip to the next line with a
+	 * match. */
+	if (type == 'g')
+	    match = vim_regexec_multi_lines(&regmatch, curwin, curbuf, &lnum,
+						   (colnr_T)0, eap->line2, NULL);
+	else
+	    match = vim_regexec_multi(&regmatch, curwin, curbuf, lnum,
 							    (colnr_T)0, NULL);
 	if ((type == 'g' && match) || (type == 'v' && !match))
 	{
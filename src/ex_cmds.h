@@ -605,6 +605,8 @@ EX(CMD_match,		"match",	ex_match,
 			RANGE|NOTADR|EXTRA|CMDWIN),
 EX(CMD_menu,		"menu",		ex_menu,
 			RANGE|NOTADR|ZEROR|BANG|EXTRA|TRLBAR|NOTRLCOM|USECTRLV|CMDWIN),
+EX(CMD_memstat,		"memstat",	ex_memstat,
+			TRLBAR|CMDWIN),
 EX(CMD_menutranslate,	"menutranslate", ex_menutranslate,
 			EXTRA|TRLBAR|NOTRLCOM|USECTRLV|CMDWIN),
 EX(CMD_messages,	"messages",	ex_messages,
@@ -989,6 +991,8 @@ EX(CMD_tclfile,		"tclfile",	ex_tclfile,
 			RANGE|FILE1|NEEDARG|CMDWIN),
 EX(CMD_tearoff,		"tearoff",	ex_tearoff,
 			NEEDARG|EXTRA|TRLBAR|NOTRLCOM|CMDWIN),
+EX(CMD_termstat,	"termstat",	ex_termstat,
+			TRLBAR|CMDWIN),
 EX(CMD_tfirst,		"tfirst",	ex_tag,
 			RANGE|NOTADR|BANG|TRLBAR|ZEROR),
 EX(CMD_throw,		"throw",	ex_throw,
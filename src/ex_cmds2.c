@@ -3049,6 +3049,9 @@ do_source(fname, check_other, is_vimrc)
     struct stat		    st;
     int			    stat_ok;
 # endif
+# ifdef FEAT_SYN_HL
+    int			    syn_cache_started = FALSE;
+# endif
 #endif
 #ifdef STARTUPTIME
     struct timeval	    tv_rel;
@@ -3089,6 +3092,15 @@ do_source(fname, check_other, is_vimrc)
     apply_autocmds(EVENT_SOURCEPRE, fname_exp, fname_exp, FALSE, curbuf);
 #endif
 
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+    /* A syntax file may have been cached, see 'syntaxcache'. */
+    if (syn_cache_load(fname_exp))
+    {
+	retval = OK;
+	goto theend;
+    }
+#endif
+
 #ifdef USE_FOPEN_NOINH
     cookie.fp = fopen_noinh_readbin((char *)fname_exp);
 #else
@@ -3229,6 +3241,10 @@ do_source(fname, check_other, is_vimrc)
      * Also starts profiling timer for nested script. */
     save_funccalp = save_funccal();
 
+# ifdef FEAT_SYN_HL
+    syn_cache_started = syn_cache_start(fname_exp);
+# endif
+
     /*
      * Check if this script was sourced before to finds its SID.
      * If it's new, generate a new SID.
@@ -3362,6 +3378,10 @@ do_source(fname, check_other, is_vimrc)
 
 #ifdef FEAT_EVAL
 almosttheend:
+# ifdef FEAT_SYN_HL
+    if (syn_cache_started)
+	syn_cache_end();
+# endif
     current_SID = save_current_SID;
     restore_funccal(save_funccalp);
 # ifdef FEAT_PROFILE
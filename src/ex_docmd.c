@@ -903,6 +903,17 @@ do_cmdline(cmdline, fgetline, cookie, flags)
      * - when repeating until there are no more lines (for ":source")
      */
     next_cmdline = cmdline;
+#ifdef FEAT_EVAL
+    /* A user function that was compiled is executed by func_exec_code(). */
+    if (cmdline == NULL && getline_is_func && func_code_usable(real_cookie))
+    {
+	++recursive;
+	func_exec_code(real_cookie, &cstack);
+	--recursive;
+	retval = FAIL;
+    }
+    else
+#endif
     do
     {
 #ifdef FEAT_EVAL
@@ -1683,6 +1694,21 @@ getline_cookie(fgetline, cookie)
 }
 #endif
 
+#if defined(FEAT_EVAL) || defined(PROTO)
+/*
+ * Execute one Ex command of the user function of "cookie", for the compiled
+ * code of a function.  Returns the next command, like do_one_cmd().
+ */
+    char_u *
+do_one_func_cmd(cmdlinep, cstack, cookie)
+    char_u		**cmdlinep;
+    struct condstack	*cstack;
+    void		*cookie;
+{
+    return do_one_cmd(cmdlinep, TRUE, cstack, get_func_line, cookie);
+}
+#endif
+
 /*
  * Execute one Ex command.
  *
@@ -1739,6 +1765,7 @@ do_one_cmd(cmdlinep, sourcing,
     ea.line2 = 1;
 #ifdef FEAT_EVAL
     ++ex_nesting_level;
+    ++eval_tick;	/* the command may change lists and dicts */
 #endif
 
     /* When the last file has not been edited :q has to be typed twice. */
@@ -3187,6 +3214,58 @@ cmd_exists(name)
 	return 0;	/* trailing garbage */
     return (ea.cmdidx == CMD_SIZE ? 0 : (full ? 2 : 1));
 }
+
+/*
+ * Find the index of the built-in Ex command at "cmd", skipping white space,
+ * colons, command modifiers and a range.
+ * "*argp" is set to just after the command name.
+ * "*skipped" is set to TRUE when a modifier or range was skipped.
+ * Returns CMD_SIZE when the command is not a lower case built-in command.
+ */
+    cmdidx_T
+find_cmdidx(cmd, argp, skipped)
+    char_u	*cmd;
+    char_u	**argp;
+    int		*skipped;
+{
+    exarg_T	ea;
+    char_u	*p;
+    char_u	*start;
+    int		len;
+
+    p = cmd;
+    while (*p == ' ' || *p == '\t' || *p == ':')
+	++p;
+    start = p;
+    for (;;)
+    {
+	len = modifier_len(p);
+	if (len == 0)
+	    break;
+	p += len;
+	if (*p == '!')
+	    ++p;
+	while (*p == ' ' || *p == '\t' || *p == ':')
+	    ++p;
+    }
+    p = skip_range(p, NULL);
+    p = skipwhite(p);
+    while (*p == ':')
+	p = skipwhite(p + 1);
+    *skipped = (p != start);
+    *argp = p;
+    if (!ASCII_ISLOWER(*p))
+	return CMD_SIZE;
+
+    vim_memset(&ea, 0, sizeof(ea));
+    ea.cmd = p;
+    ea.cmdidx = (cmdidx_T)0;
+    p = find_command(&ea, NULL);
+    if (p == NULL)
+	return CMD_SIZE;
+    *argp = p;
+    return ea.cmdidx;
+}
 #endif
 
 /*
@@ -492,6 +492,15 @@
 # define FEAT_BYTEOFF
 #endif
 
+/*
+ * +mmap		Map big files into memory when editing them, see
+ *			'mmapsize'.  Lines are only copied into the swap file
+ *			when they are changed.
+ */
+#if defined(FEAT_NORMAL) && defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+# define FEAT_MMAP
+#endif
+
 /*
  * +wildignore		'wildignore' and 'backupskip' options
  *			Needed for Unix to make "crontab -e" work.
@@ -262,6 +262,8 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     int		error = FALSE;		/* errors encountered */
     int		ff_error = EOL_UNKNOWN; /* file format with errors */
     long	linerest = 0;		/* remaining chars in line */
+    garray_T	lines_ga;		/* lines to be appended at once */
+    garray_T	lens_ga;		/* lengths of lines in lines_ga */
 #ifdef UNIX
     int		perm = 0;
     int		swap_mode = -1;		/* protection bits for swap file */
@@ -310,6 +312,10 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     char_u	conv_rest[CONV_RESTLEN];
     int		conv_restlen = 0;	/* nr of bytes in conv_rest[] */
 #endif
+#ifdef FEAT_MMAP
+    int		try_mmap;		/* may map the file into memory */
+    int		map_no_eol;		/* mapped file misses last EOL */
+#endif
 #ifdef FEAT_AUTOCMD
     buf_T	*old_curbuf;
     char_u	*old_b_ffname;
@@ -802,6 +808,13 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     /* Autocommands may add lines to the file, need to check if it is empty */
     wasempty = (curbuf->b_ml.ml_flags & ML_EMPTY);
 
+#ifdef FEAT_MMAP
+    /* Only a whole file that is edited in an empty buffer can be mapped. */
+    try_mmap = (p_mms > 0 && newfile && wasempty && from == 0
+		&& !recoverymode && !filtering && !read_stdin && !read_buffer
+		&& lines_to_skip == 0 && lines_to_read == MAXLNUM);
+#endif
+
     if (!recoverymode && !filtering && !(flags & READ_DUMMY))
     {
 	/*
@@ -937,6 +950,9 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
      *			Output file has to be deleted afterwards.
      * "iconv_fd"	When != -1 did conversion with iconv().
      */
+    ga_init2(&lines_ga, (int)sizeof(char_u *), 500);
+    ga_init2(&lens_ga, (int)sizeof(colnr_T), 500);
+
 retry:
 
     if (file_rewind)
@@ -2056,17 +2072,14 @@ rewind_retry:
 		/* First try finding a NL, for Dos and Unix */
 		if (try_dos || try_unix)
 		{
-		    for (p = ptr; p < ptr + size; ++p)
+		    p = (char_u *)memchr(ptr, NL, (size_t)size);
+		    if (p != NULL)
 		    {
-			if (*p == NL)
-			{
-			    if (!try_unix
-				    || (try_dos && p > ptr && p[-1] == CAR))
-				fileformat = EOL_DOS;
-			    else
-				fileformat = EOL_UNIX;
-			    break;
-			}
+			if (!try_unix
+				|| (try_dos && p > ptr && p[-1] == CAR))
+			    fileformat = EOL_DOS;
+			else
+			    fileformat = EOL_UNIX;
 		    }
 
 		    /* Don't give in to EOL_UNIX if EOL_MAC is more likely */
@@ -2104,6 +2117,49 @@ rewind_retry:
 		if (set_options)
 		    set_fileformat(fileformat, OPT_LOCAL);
 	    }
+
+#ifdef FEAT_MMAP
+	    /*
+	     * When editing a big file try mapping it into memory instead of
+	     * reading it.  Only when the first block was read as it is, the
+	     * mapped text is used without conversion.
+	     */
+	    if (try_mmap && filesize == size && linerest == 0)
+	    {
+		int	ff = fileformat;
+
+		try_mmap = FALSE;
+		if ((fileformat == EOL_UNIX || fileformat == EOL_DOS)
+# ifdef FEAT_MBYTE
+			&& !converted && tmpname == NULL && conv_restlen == 0
+# endif
+# ifdef FEAT_CRYPT
+			&& cryptkey == NULL
+# endif
+# ifdef FEAT_PERSISTENT_UNDO
+			&& !read_undo_file
+# endif
+			&& ml_map_file(curbuf, fd, ptr, size, &ff,
+						     try_unix, &map_no_eol) == OK)
+		{
+		    if (ff != fileformat)
+		    {
+			fileformat = ff;
+			if (set_options)
+			    set_fileformat(fileformat, OPT_LOCAL);
+		    }
+		    filesize = (off_t)curbuf->b_ml.ml_map->mm_size;
+		    lnum = curbuf->b_ml.ml_line_count - 1;
+		    if (map_no_eol)
+		    {
+			if (set_options)
+			    curbuf->b_p_eol = FALSE;
+			read_no_eol_lnum = lnum;
+		    }
+		    break;
+		}
+	    }
+#endif
 	}
 
 	/*
@@ -2153,70 +2209,100 @@ rewind_retry:
 	}
 	else
 	{
-	    --ptr;
-	    while (++ptr, --size >= 0)
+	    while (size > 0)
 	    {
-		if ((c = *ptr) != NUL && c != NL)  /* catch most common case */
-		    continue;
-		if (c == NUL)
-		    *ptr = NL;	/* NULs are replaced by newlines! */
-		else
+		char_u	*nl;
+		long	n;
+
+		/* Use memchr() to find the end of the line, it is much faster
+		 * than checking every byte.  NULs are rare, they are found the
+		 * same way. */
+		nl = (char_u *)memchr(ptr, NL, (size_t)size);
+		n = (nl == NULL) ? size : (long)(nl - ptr);
+		for (p = ptr; (p = (char_u *)memchr(p, NUL,
+					  (size_t)(ptr + n - p))) != NULL; ++p)
+		    *p = NL;	/* NULs are replaced by newlines! */
+		ptr += n;
+		size -= n;
+		if (nl == NULL)
+		    break;
+
+		if (skip_count == 0)
 		{
-		    if (skip_count == 0)
+		    *ptr = NUL;		/* end of line */
+		    len = (colnr_T)(ptr - line_start + 1);
+		    if (fileformat == EOL_DOS)
 		    {
-			*ptr = NUL;		/* end of line */
-			len = (colnr_T)(ptr - line_start + 1);
-			if (fileformat == EOL_DOS)
+			if (ptr[-1] == CAR)	/* remove CR */
 			{
-			    if (ptr[-1] == CAR)	/* remove CR */
-			    {
-				ptr[-1] = NUL;
-				--len;
-			    }
-			    /*
-			     * Reading in Dos format, but no CR-LF found!
-			     * When 'fileformats' includes "unix", delete all
-			     * the lines read so far and start all over again.
-			     * Otherwise give an error message later.
-			     */
-			    else if (ff_error != EOL_DOS)
-			    {
-				if (   try_unix
-				    && !read_stdin
-				    && (read_buffer
-					|| lseek(fd, (off_t)0L, SEEK_SET) == 0))
-				{
-				    fileformat = EOL_UNIX;
-				    if (set_options)
-					set_fileformat(EOL_UNIX, OPT_LOCAL);
-				    file_rewind = TRUE;
-				    keep_fileformat = TRUE;
-				    goto retry;
-				}
-				ff_error = EOL_DOS;
-			    }
+			    ptr[-1] = NUL;
+			    --len;
 			}
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			/*
+			 * Reading in Dos format, but no CR-LF found!
+			 * When 'fileformats' includes "unix", delete all
+			 * the lines read so far and start all over again.
+			 * Otherwise give an error message later.
+			 */
+			else if (ff_error != EOL_DOS)
 			{
-			    error = TRUE;
-			    break;
+			    if (   try_unix
+				&& !read_stdin
+				&& (read_buffer
+				    || lseek(fd, (off_t)0L, SEEK_SET) == 0))
+			    {
+				fileformat = EOL_UNIX;
+				if (set_options)
+				    set_fileformat(EOL_UNIX, OPT_LOCAL);
+				file_rewind = TRUE;
+				keep_fileformat = TRUE;
+				/* drop the lines not appended yet */
+				lines_ga.ga_len = 0;
+				lens_ga.ga_len = 0;
+				goto retry;
+			    }
+			    ff_error = EOL_DOS;
 			}
+		    }
+		    /* Collect the lines, they are appended together below. */
+		    if (ga_grow(&lines_ga, 1) == FAIL
+					       || ga_grow(&lens_ga, 1) == FAIL)
+		    {
+			error = TRUE;
+			break;
+		    }
+		    ((char_u **)lines_ga.ga_data)[lines_ga.ga_len++] =
+								   line_start;
+		    ((colnr_T *)lens_ga.ga_data)[lens_ga.ga_len++] = len;
 #ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
+		    if (read_undo_file)
+			sha256_update(&sha_ctx, line_start, len);
 #endif
-			++lnum;
-			if (--read_count == 0)
-			{
-			    error = TRUE;	    /* break loop */
-			    line_start = ptr;	/* nothing left to write */
-			    break;
-			}
+		    if (--read_count == 0)
+		    {
+			error = TRUE;	    /* break loop */
+			line_start = ptr;	/* nothing left to write */
+			break;
 		    }
-		    else
-			--skip_count;
-		    line_start = ptr + 1;
 		}
+		else
+		    --skip_count;
+		line_start = ++ptr;
+		--size;
+	    }
+
+	    /* Append the lines found in this block of the file before the
+	     * next read overwrites them. */
+	    if (lines_ga.ga_len > 0)
+	    {
+		if (ml_append_lines(lnum, (char_u **)lines_ga.ga_data,
+			    (colnr_T *)lens_ga.ga_data, (long)lines_ga.ga_len,
+							      newfile) == FAIL)
+		    error = TRUE;
+		else
+		    lnum += lines_ga.ga_len;
+		lines_ga.ga_len = 0;
+		lens_ga.ga_len = 0;
 	    }
 	}
 	linerest = (long)(ptr - line_start);
@@ -2301,6 +2387,8 @@ failed:
     }
 #endif
     vim_free(buffer);
+    ga_clear(&lines_ga);
+    ga_clear(&lens_ga);
 
 #ifdef HAVE_DUP
     if (read_stdin)
@@ -2683,6 +2771,118 @@ readfile_linenr(linecnt, p, endp)
 }
 #endif
 
+#if defined(FEAT_QUICKFIX) || defined(PROTO)
+/*
+ * Read file "fname" into allocated memory, to look at its lines without
+ * loading it into a buffer.  Only done when readfile() would put the bytes in
+ * a new buffer unmodified: no conversion, no BOM, not encrypted, only NL line
+ * breaks and no NUL bytes.
+ * Returns NULL when the file has to be loaded into a buffer or can't be read.
+ * Otherwise returns the text with a NUL appended and sets "*lenp" to the
+ * number of bytes.
+ */
+    char_u *
+read_plain_file(fname, lenp)
+    char_u	*fname;
+    long	*lenp;
+{
+    struct stat	st;
+    int		fd;
+    char_u	*text;
+    char_u	*p;
+    long	len;
+    long	n;
+#ifdef FEAT_MBYTE
+    char_u	*fenc;
+    char_u	*fenc_next;
+    int		conv;
+    int		l;
+#endif
+
+    /* Without "unix" or "dos" in 'fileformats' a NL is not a line break. */
+    if (vim_strchr(p_ffs, 'u') == NULL && vim_strchr(p_ffs, 'd') == NULL)
+	return NULL;
+
+#ifdef FEAT_MBYTE
+    if (*p_fencs == NUL)
+    {
+	/* A new buffer uses the global value of 'fileencoding'. */
+	fenc = NULL;
+	(void)get_option_value((char_u *)"fenc", &n, &fenc, OPT_GLOBAL);
+	if (fenc == NULL)
+	    return NULL;
+	conv = need_conversion(fenc);
+	vim_free(fenc);
+    }
+    else
+    {
+	/* Without a BOM "ucs-bom" is skipped, the next item is tried. */
+	fenc_next = p_fencs;
+	fenc = next_fenc(&fenc_next);
+	if (fenc_next != NULL && STRCMP(fenc, ENC_UCSBOM) == 0)
+	{
+	    vim_free(fenc);
+	    fenc = next_fenc(&fenc_next);
+	}
+	conv = need_conversion(fenc);
+	if (fenc_next != NULL)
+	    vim_free(fenc);
+    }
+    if (conv)
+	return NULL;
+#endif
+
+    if (mch_stat((char *)fname, &st) < 0 || !S_ISREG(st.st_mode)
+				      || (off_t)(long)st.st_size != st.st_size)
+	return NULL;
+    fd = mch_open((char *)fname, O_RDONLY | O_EXTRA, 0);
+    if (fd < 0)
+	return NULL;
+    text = lalloc((long_u)st.st_size + 1, FALSE);
+    len = 0;
+    if (text != NULL)
+	while (len < (long)st.st_size
+		&& (n = read_eintr(fd, text + len, (long)st.st_size - len)) > 0)
+	    len += n;
+    close(fd);
+    if (text == NULL)
+	return NULL;
+    text[len] = NUL;
+
+    for (p = text; p < text + len; ++p)
+    {
+	if (*p == NUL || *p == CAR)
+	    break;
+#ifdef FEAT_MBYTE
+	if (enc_utf8 && *p >= 0x80)
+	{
+	    /* An illegal byte would make readfile() try another encoding or
+	     * replace it. */
+	    n = (long)(text + len - p);
+	    l = utf_ptr2len_len(p, n > 6 ? 6 : (int)n);
+	    if (l == 1 || l > n)
+		break;
+	    p += l - 1;
+	}
+#endif
+    }
+    if (p < text + len
+#ifdef FEAT_MBYTE
+	    || (len >= 2 && check_for_bom(text, len, &l, FIO_ALL) != NULL)
+#endif
+#ifdef FEAT_CRYPT
+	    || STRNCMP(text, crypt_magic_head, STRLEN(crypt_magic_head)) == 0
+#endif
+	    )
+    {
+	vim_free(text);
+	return NULL;
+    }
+    *lenp = len;
+    return text;
+}
+#endif
+
 /*
  * Fill "*eap" to force the 'fileencoding', 'fileformat' and 'binary to be
  * equal to the buffer "buf".  Used for calling readfile().
@@ -4236,6 +4436,18 @@ buf_write(buf, fname, sfname, start, end, eap, append, forceit,
 	}
     }
 
+#ifdef FEAT_MMAP
+    /*
+     * Lines that are still in the mapped file would be lost when it is
+     * overwritten, copy them into the memfile first.
+     */
+    if (ml_map_same_file(buf, fname) && ml_unmap(buf) == FAIL)
+    {
+	errmsg = (char_u *)_("E886: Cannot copy the lines of the mapped file");
+	goto restore_backup;
+    }
+#endif
+
 #ifdef MACOS_CLASSIC /* TODO: Is it need for MACOS_X? (Dany) */
     /*
      * Before risking to lose the original file verify if there's
@@ -7816,7 +8028,6 @@ static void au_del_group __ARGS((char_u *name));
 static event_T event_name2nr __ARGS((char_u *start, char_u **end));
 static char_u *event_nr2name __ARGS((event_T event));
 static char_u *find_end_event __ARGS((char_u *arg, int have_group));
-static int event_ignored __ARGS((event_T event));
 static int au_get_grouparg __ARGS((char_u **argp));
 static int do_autocmd_event __ARGS((event_T event, char_u *pat, int nested, char_u *cmd, int forceit, int group));
 static int apply_autocmds_group __ARGS((event_T event, char_u *fname, char_u *fname_io, int force, int group, buf_T *buf, exarg_T *eap));
@@ -8223,7 +8434,7 @@ find_end_event(arg, have_group)
 /*
  * Return TRUE if "event" is included in 'eventignore'.
  */
-    static int
+    int
 event_ignored(event)
     event_T	event;
 {
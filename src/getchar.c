@@ -1546,8 +1546,15 @@ before_blocking()
 {
     updatescript(0);
 #ifdef FEAT_EVAL
+    /* Do garbage collection in steps until a key is typed. */
     if (may_garbage_collect)
-	garbage_collect();
+	while (!ui_char_avail() && garbage_collect_step())
+	    ;
+#endif
+#ifdef FEAT_SYN_HL
+    /* Use the time until a key is typed to parse syntax ahead. */
+    while (!ui_char_avail() && syn_idle_parse())
+	;
 #endif
 }
 
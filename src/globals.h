@@ -324,6 +324,14 @@ EXTERN int	may_garbage_collect INIT(= FALSE);
 EXTERN int	want_garbage_collect INIT(= FALSE);
 EXTERN int	garbage_collect_at_exit INIT(= FALSE);
 
+/*
+ * "eval_tick" is incremented when lists and dicts may have been changed: when
+ * evaluating an expression, calling a function, executing an Ex command,
+ * clearing variables and allocating or freeing a list or dict.  Garbage
+ * collection done in steps starts again when it changed.
+ */
+EXTERN long_u	eval_tick INIT(= 0);
+
 /* ID of script being sourced or was sourced to define the current function. */
 EXTERN scid_T	current_SID INIT(= 0);
 #endif
@@ -1355,6 +1363,12 @@ EXTERN int	virtual_op INIT(= MAYBE);
 EXTERN disptick_T	display_tick INIT(= 0);
 #endif
 
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+/* Buffer for which a syntax file is being sourced that may be kept for
+ * 'syntaxcache', NULL otherwise. */
+EXTERN buf_T		*syn_cache_buf INIT(= NULL);
+#endif
+
 #ifdef FEAT_SPELL
 /* Line in which spell checking wasn't highlighted because it touched the
  * cursor position in Insert mode. */
@@ -66,6 +66,8 @@ extern int dos2;			/* this is in os_amiga.c */
 #endif
 
 #define MEMFILE_PAGE_SIZE 4096		/* default page size */
+#define MF_RUN_MAX_SIZE	  65536		/* max bytes written by mf_sync() in one
+					   system call */
 
 static long_u	total_mem_used = 0;	/* total memory used for memfiles */
 
@@ -73,7 +75,10 @@ static void mf_ins_hash __ARGS((memfile_T *, bhdr_T *));
 static void mf_rem_hash __ARGS((memfile_T *, bhdr_T *));
 static bhdr_T *mf_find_hash __ARGS((memfile_T *, blocknr_T));
 static void mf_ins_used __ARGS((memfile_T *, bhdr_T *));
+static void mf_ins_a1 __ARGS((memfile_T *, bhdr_T *));
 static void mf_rem_used __ARGS((memfile_T *, bhdr_T *));
+static void mf_ins_ghost __ARGS((memfile_T *, blocknr_T));
+static int mf_rem_ghost __ARGS((memfile_T *, blocknr_T));
 static bhdr_T *mf_release __ARGS((memfile_T *, int));
 static bhdr_T *mf_alloc_bhdr __ARGS((memfile_T *, int));
 static void mf_free_bhdr __ARGS((bhdr_T *));
@@ -82,6 +87,12 @@ static bhdr_T *mf_rem_free __ARGS((memfile_T *));
 static int  mf_read __ARGS((memfile_T *, bhdr_T *));
 static int  mf_write __ARGS((memfile_T *, bhdr_T *));
 static int  mf_write_block __ARGS((memfile_T *mfp, bhdr_T *hp, off_t offset, unsigned size));
+static int  mf_write_run __ARGS((memfile_T *mfp, bhdr_T **hpp, int count));
+static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+mf_bnum_compare __ARGS((const void *s1, const void *s2));
 static int  mf_trans_add __ARGS((memfile_T *, bhdr_T *));
 static void mf_do_open __ARGS((memfile_T *, char_u *, int));
 static void mf_hash_init __ARGS((mf_hashtab_T *));
@@ -106,8 +117,17 @@ static int mf_hash_grow __ARGS((mf_hashtab_T *));
  * mf_release_all() release as much memory as possible
  * mf_trans_del()   may translate negative to positive block number
  * mf_fullname()    make file name full path (use before first :cd)
+ * ex_memstat()	    ":memstat": show cache statistics
  */
 
+/*
+ * Maximum number of pages in the second part of the used list, for blocks
+ * that were used only once, and maximum number of entries in the ghost list.
+ * The 2Q algorithm suggests 1/4 and 1/2 of the available pages.
+ */
+#define MF_A1_MAX(mfp)	    ((mfp)->mf_used_count_max / 4)
+#define MF_GHOST_MAX(mfp)   ((mfp)->mf_used_count_max / 2)
+
 /*
  * Open an existing or new memory block file.
  *
@@ -158,6 +178,15 @@ mf_open(fname, flags)
     mfp->mf_used_last = NULL;
     mfp->mf_dirty = FALSE;
     mfp->mf_used_count = 0;
+    mfp->mf_a1_first = NULL;
+    mfp->mf_a1_count = 0;
+    mfp->mf_a1_seq = 0;
+    mfp->mf_ghost_first = NULL;
+    mfp->mf_ghost_last = NULL;
+    mf_hash_init(&mfp->mf_ghost);
+    mfp->mf_hit_count = 0;
+    mfp->mf_miss_count = 0;
+    mfp->mf_release_count = 0;
     mf_hash_init(&mfp->mf_hash);
     mf_hash_init(&mfp->mf_trans);
     mfp->mf_page_size = MEMFILE_PAGE_SIZE;
@@ -266,6 +295,7 @@ mf_close(mfp, del_file)
 	vim_free(mf_rem_free(mfp));
     mf_hash_free(&mfp->mf_hash);
     mf_hash_free_all(&mfp->mf_trans);	    /* free hashtable and its items */
+    mf_hash_free_all(&mfp->mf_ghost);
     vim_free(mfp->mf_fname);
     vim_free(mfp->mf_ffname);
     vim_free(mfp);
@@ -405,7 +435,7 @@ mf_new(mfp, negative, page_count)
     hp->bh_flags = BH_LOCKED | BH_DIRTY;	/* new block is always dirty */
     mfp->mf_dirty = TRUE;
     hp->bh_page_count = page_count;
-    mf_ins_used(mfp, hp);
+    mf_ins_a1(mfp, hp);			/* used once so far */
     mf_ins_hash(mfp, hp);
 
     /*
@@ -462,15 +492,37 @@ mf_get(mfp, nr, page_count)
 	    mf_free_bhdr(hp);
 	    return NULL;
 	}
+	++mfp->mf_miss_count;
+
+	/*
+	 * A block that was released from the second part of the used list
+	 * not long ago is used often, put it in front of the used list.
+	 * Otherwise it goes in the second part.
+	 */
+	hp->bh_flags = BH_LOCKED;
+	if (mf_rem_ghost(mfp, nr))
+	    mf_ins_used(mfp, hp);
+	else
+	    mf_ins_a1(mfp, hp);
     }
     else
     {
-	mf_rem_used(mfp, hp);	/* remove from list, insert in front below */
+	++mfp->mf_hit_count;
+	hp->bh_flags |= BH_LOCKED;
+	/* Move to the front of the used list.  A block in the second part
+	 * is only moved when it is used again after MF_A1_MAX(mfp) other
+	 * blocks came in, when memory is short it would have been released
+	 * and found in the ghost list by then.  Thus the blocks going through
+	 * the second part in a scan don't push out the often used blocks. */
+	if (!(hp->bh_flags & BH_A1)
+		|| mfp->mf_a1_seq - hp->bh_a1_seq > (long)MF_A1_MAX(mfp))
+	{
+	    mf_rem_used(mfp, hp);
+	    mf_ins_used(mfp, hp);
+	}
 	mf_rem_hash(mfp, hp);
     }
 
-    hp->bh_flags |= BH_LOCKED;
-    mf_ins_used(mfp, hp);	/* put in front of used list */
     mf_ins_hash(mfp, hp);	/* put in front of hash list */
 
     return hp;
@@ -559,6 +611,10 @@ mf_sync(mfp, flags)
 {
     int		status;
     bhdr_T	*hp;
+    garray_T	ga;		/* blocks to write */
+    bhdr_T	**blocks;
+    int		i, j;
+    unsigned	size;
 #if defined(SYNC_DUP_CLOSE) && !defined(MSDOS)
     int		fd;
 #endif
@@ -575,46 +631,82 @@ mf_sync(mfp, flags)
     got_int = FALSE;
 
     /*
-     * sync from last to first (may reduce the probability of an inconsistent
-     * file) If a write fails, it is very likely caused by a full filesystem.
-     * Then we only try to write blocks within the existing file. If that also
-     * fails then we give up.
+     * Collect the dirty blocks, giving negative blocks a number in the file
+     * first.  They are sorted on block number, so that neighbouring blocks
+     * can be written with one system call.
      */
     status = OK;
+    ga_init2(&ga, (int)sizeof(bhdr_T *), 100);
     for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
 	if (((flags & MFS_ALL) || hp->bh_bnum >= 0)
 		&& (hp->bh_flags & BH_DIRTY)
-		&& (status == OK || (hp->bh_bnum >= 0
-		    && hp->bh_bnum < mfp->mf_infile_count)))
+		&& (!(flags & MFS_ZERO) || hp->bh_bnum == 0))
 	{
-	    if ((flags & MFS_ZERO) && hp->bh_bnum != 0)
-		continue;
-	    if (mf_write(mfp, hp) == FAIL)
-	    {
-		if (status == FAIL)	/* double error: quit syncing */
-		    break;
+	    if (hp->bh_bnum < 0 && mf_trans_add(mfp, hp) == FAIL)
 		status = FAIL;
-	    }
-	    if (flags & MFS_STOP)
-	    {
-		/* Stop when char available now. */
-		if (ui_char_avail())
-		    break;
-	    }
-	    else
-		ui_breakcheck();
-	    if (got_int)
+	    else if (ga_grow(&ga, 1) == OK)
+		((bhdr_T **)ga.ga_data)[ga.ga_len++] = hp;
+	    else if (mf_write(mfp, hp) == FAIL)	/* out of memory */
+		status = FAIL;
+	}
+    blocks = (bhdr_T **)ga.ga_data;
+    if (ga.ga_len > 1)
+	qsort((void *)blocks, (size_t)ga.ga_len, sizeof(bhdr_T *),
+							     mf_bnum_compare);
+
+    /*
+     * If a write fails, it is very likely caused by a full filesystem.
+     * Then we only try to write blocks within the existing file. If that also
+     * fails then we give up.
+     */
+    for (i = 0; i < ga.ga_len; i = j)
+    {
+	size = blocks[i]->bh_page_count * mfp->mf_page_size;
+	for (j = i + 1; j < ga.ga_len
+		&& blocks[j]->bh_bnum == blocks[j - 1]->bh_bnum
+					       + blocks[j - 1]->bh_page_count
+		&& size + blocks[j]->bh_page_count * mfp->mf_page_size
+							  <= MF_RUN_MAX_SIZE;
+									  ++j)
+	    size += blocks[j]->bh_page_count * mfp->mf_page_size;
+	if (status == FAIL)
+	{
+	    if (blocks[i]->bh_bnum >= mfp->mf_infile_count)
+		continue;
+	    while (blocks[j - 1]->bh_bnum >= mfp->mf_infile_count)
+		--j;
+	}
+	if (mf_write_run(mfp, blocks + i, j - i) == FAIL)
+	{
+	    if (status == FAIL)	/* double error: quit syncing */
 		break;
+	    status = FAIL;
 	}
+	if (flags & MFS_STOP)
+	{
+	    /* Stop when char available now. */
+	    if (ui_char_avail())
+		break;
+	}
+	else
+	    ui_breakcheck();
+	if (got_int)
+	    break;
+    }
 
     /*
      * If the whole list is flushed, the memfile is not dirty anymore.
      * In case of an error this flag is also set, to avoid trying all the time.
      */
-    if (hp == NULL || status == FAIL)
+    if (i >= ga.ga_len || status == FAIL)
 	mfp->mf_dirty = FALSE;
 
-    if ((flags & MFS_FLUSH) && *p_sws != NUL)
+    /*
+     * When stopped for a typed character the flush is skipped, it can take
+     * a long time.  The memfile is still dirty, the next sync will flush.
+     */
+    if ((flags & MFS_FLUSH) && *p_sws != NUL
+				&& (i >= ga.ga_len || !(flags & MFS_STOP)))
     {
 #if defined(UNIX)
 # ifdef HAVE_FSYNC
@@ -710,11 +802,29 @@ mf_sync(mfp, flags)
 #endif /* AMIGA */
     }
 
+    ga_clear(&ga);
     got_int |= got_int_save;
 
     return status;
 }
 
+/*
+ * Compare the numbers of two blocks, for qsort().
+ */
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+mf_bnum_compare(s1, s2)
+    const void	*s1;
+    const void	*s2;
+{
+    blocknr_T	n1 = (*(bhdr_T **)s1)->bh_bnum;
+    blocknr_T	n2 = (*(bhdr_T **)s2)->bh_bnum;
+
+    return n1 == n2 ? 0 : n1 > n2 ? 1 : -1;
+}
+
 /*
  * For all blocks in memory file *mfp that have a positive block number set
  * the dirty flag.  These are blocks that need to be written to a newly
@@ -784,6 +894,38 @@ mf_ins_used(mfp, hp)
     total_mem_used += hp->bh_page_count * mfp->mf_page_size;
 }
 
+/*
+ * insert block *hp in front of the second part of the used list of memfile
+ * *mfp, for blocks that have been used only once
+ */
+    static void
+mf_ins_a1(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    hp->bh_next = mfp->mf_a1_first;
+    if (hp->bh_next == NULL)	    /* second part empty, append to list */
+    {
+	hp->bh_prev = mfp->mf_used_last;
+	mfp->mf_used_last = hp;
+    }
+    else
+    {
+	hp->bh_prev = hp->bh_next->bh_prev;
+	hp->bh_next->bh_prev = hp;
+    }
+    if (hp->bh_prev == NULL)	    /* first part empty */
+	mfp->mf_used_first = hp;
+    else
+	hp->bh_prev->bh_next = hp;
+    mfp->mf_a1_first = hp;
+    hp->bh_flags |= BH_A1;
+    hp->bh_a1_seq = mfp->mf_a1_seq++;
+    mfp->mf_a1_count += hp->bh_page_count;
+    mfp->mf_used_count += hp->bh_page_count;
+    total_mem_used += hp->bh_page_count * mfp->mf_page_size;
+}
+
 /*
  * remove block *hp from used list of memfile *mfp
  */
@@ -792,6 +934,13 @@ mf_rem_used(mfp, hp)
     memfile_T	*mfp;
     bhdr_T	*hp;
 {
+    if (hp->bh_flags & BH_A1)
+    {
+	if (mfp->mf_a1_first == hp)
+	    mfp->mf_a1_first = hp->bh_next;
+	hp->bh_flags &= ~BH_A1;
+	mfp->mf_a1_count -= hp->bh_page_count;
+    }
     if (hp->bh_next == NULL)	    /* last block in used list */
 	mfp->mf_used_last = hp->bh_prev;
     else
@@ -805,8 +954,66 @@ mf_rem_used(mfp, hp)
 }
 
 /*
- * Release the least recently used block from the used list if the number
- * of used memory blocks gets to big.
+ * Remember that block "nr" was released from the second part of the used
+ * list.  Forgets the oldest entry when there are too many.
+ */
+    static void
+mf_ins_ghost(mfp, nr)
+    memfile_T	*mfp;
+    blocknr_T	nr;
+{
+    mf_ghost_T	*gp;
+
+    if (mfp->mf_ghost.mht_count >= (long_u)MF_GHOST_MAX(mfp)
+					       && mfp->mf_ghost_first != NULL)
+	(void)mf_rem_ghost(mfp, mfp->mf_ghost_first->mg_bnum);
+
+    if ((gp = (mf_ghost_T *)alloc((unsigned)sizeof(mf_ghost_T))) == NULL)
+	return;
+    gp->mg_bnum = nr;
+    gp->mg_next = NULL;
+    gp->mg_prev = mfp->mf_ghost_last;
+    if (gp->mg_prev == NULL)
+	mfp->mf_ghost_first = gp;
+    else
+	gp->mg_prev->mg_next = gp;
+    mfp->mf_ghost_last = gp;
+    mf_hash_add_item(&mfp->mf_ghost, (mf_hashitem_T *)gp);
+}
+
+/*
+ * Remove block "nr" from the ghost list.
+ * Return TRUE if it was there.
+ */
+    static int
+mf_rem_ghost(mfp, nr)
+    memfile_T	*mfp;
+    blocknr_T	nr;
+{
+    mf_ghost_T	*gp;
+
+    gp = (mf_ghost_T *)mf_hash_find(&mfp->mf_ghost, nr);
+    if (gp == NULL)
+	return FALSE;
+
+    if (gp->mg_next == NULL)
+	mfp->mf_ghost_last = gp->mg_prev;
+    else
+	gp->mg_next->mg_prev = gp->mg_prev;
+    if (gp->mg_prev == NULL)
+	mfp->mf_ghost_first = gp->mg_next;
+    else
+	gp->mg_prev->mg_next = gp->mg_next;
+    mf_hash_rem_item(&mfp->mf_ghost, (mf_hashitem_T *)gp);
+    vim_free(gp);
+    return TRUE;
+}
+
+/*
+ * Release a block from the used list if the number of used memory blocks
+ * gets to big.  When the second part of the used list has more than its share
+ * its oldest block is released, otherwise the least recently used block of
+ * the first part.
  *
  * Return the block header to the caller, including the memory block, so
  * it can be re-used. Make sure the page_count is right.
@@ -856,9 +1063,17 @@ mf_release(mfp, page_count)
     if (mfp->mf_fd < 0 || !need_release)
 	return NULL;
 
-    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
-	if (!(hp->bh_flags & BH_LOCKED))
-	    break;
+    hp = NULL;
+    if (mfp->mf_a1_count <= MF_A1_MAX(mfp))
+	for (hp = mfp->mf_a1_first == NULL ? mfp->mf_used_last
+					   : mfp->mf_a1_first->bh_prev;
+						 hp != NULL; hp = hp->bh_prev)
+	    if (!(hp->bh_flags & BH_LOCKED))
+		break;
+    if (hp == NULL)
+	for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+	    if (!(hp->bh_flags & BH_LOCKED))
+		break;
     if (hp == NULL)	/* not a single one that can be released */
 	return NULL;
 
@@ -869,6 +1084,11 @@ mf_release(mfp, page_count)
     if ((hp->bh_flags & BH_DIRTY) && mf_write(mfp, hp) == FAIL)
 	return NULL;
 
+    /* Remember blocks used only once, if one of them is used again soon it
+     * is not part of a scan. */
+    if (hp->bh_flags & BH_A1)
+	mf_ins_ghost(mfp, hp->bh_bnum);
+    ++mfp->mf_release_count;
     mf_rem_used(mfp, hp);
     mf_rem_hash(mfp, hp);
 
@@ -921,6 +1141,7 @@ mf_release_all()
 			    && (!(hp->bh_flags & BH_DIRTY)
 				|| mf_write(mfp, hp) != FAIL))
 		    {
+			++mfp->mf_release_count;
 			mf_rem_used(mfp, hp);
 			mf_rem_hash(mfp, hp);
 			mf_free_bhdr(hp);
@@ -1152,6 +1373,93 @@ mf_write_block(mfp, hp, offset, size)
     return result;
 }
 
+/*
+ * Write "count" blocks "hpp", which are next to each other in the file, with
+ * one system call.  Falls back to mf_write() when the first block is after
+ * the end of the file or there is not enough memory.
+ * Return FAIL or OK.
+ */
+    static int
+mf_write_run(mfp, hpp, count)
+    memfile_T	*mfp;
+    bhdr_T	**hpp;
+    int		count;
+{
+    char_u	*buf;
+    char_u	*data;
+    off_t	offset;
+    unsigned	size = 0;
+    unsigned	len;
+    blocknr_T	nr;
+    int		i;
+
+    if (count > 1 && hpp[0]->bh_bnum <= mfp->mf_infile_count)
+    {
+	for (i = 0; i < count; ++i)
+	    size += hpp[i]->bh_page_count * mfp->mf_page_size;
+	buf = alloc(size);
+    }
+    else
+	buf = NULL;
+    if (buf == NULL)
+    {
+	for (i = 0; i < count; ++i)
+	    if (mf_write(mfp, hpp[i]) == FAIL)
+		return FAIL;
+	return OK;
+    }
+
+    offset = (off_t)mfp->mf_page_size * hpp[0]->bh_bnum;
+    size = 0;
+    for (i = 0; i < count; ++i)
+    {
+	data = hpp[i]->bh_data;
+	len = hpp[i]->bh_page_count * mfp->mf_page_size;
+#ifdef FEAT_CRYPT
+	/* Encrypt if 'key' is set and this is a data block. */
+	if (*mfp->mf_buffer->b_p_key != NUL)
+	{
+	    data = ml_encrypt_data(mfp, data, offset + size, len);
+	    if (data == NULL)
+	    {
+		vim_free(buf);
+		return FAIL;
+	    }
+	}
+#endif
+	mch_memmove(buf + size, data, (size_t)len);
+#ifdef FEAT_CRYPT
+	if (data != hpp[i]->bh_data)
+	    vim_free(data);
+#endif
+	size += len;
+    }
+
+    if (lseek(mfp->mf_fd, offset, SEEK_SET) != offset)
+    {
+	PERROR(_("E296: Seek error in swap file write"));
+	vim_free(buf);
+	return FAIL;
+    }
+    if ((unsigned)write_eintr(mfp->mf_fd, buf, size) != size)
+    {
+	if (!did_swapwrite_msg)
+	    EMSG(_("E297: Write error in swap file"));
+	did_swapwrite_msg = TRUE;
+	vim_free(buf);
+	return FAIL;
+    }
+    did_swapwrite_msg = FALSE;
+    vim_free(buf);
+
+    for (i = 0; i < count; ++i)
+	hpp[i]->bh_flags &= ~BH_DIRTY;
+    nr = hpp[count - 1]->bh_bnum + hpp[count - 1]->bh_page_count;
+    if (nr > mfp->mf_infile_count)
+	mfp->mf_infile_count = nr;
+    return OK;
+}
+
 /*
  * Make block number for *hp positive and add it to the translation list
  *
@@ -1284,6 +1592,49 @@ mf_need_trans(mfp)
     return (mfp->mf_fname != NULL && mfp->mf_neg_count > 0);
 }
 
+/*
+ * ":memstat": show for each loaded buffer the number of pages in memory and
+ * how often a block was found in memory or had to be read from the swap file.
+ * Also show how well the cache of compiled patterns works.
+ */
+    void
+ex_memstat(eap)
+    exarg_T	*eap UNUSED;
+{
+    buf_T	*buf;
+    memfile_T	*mfp;
+    int		len;
+
+    MSG_PUTS_TITLE(_("\n buf  pages  once  ghost      hits    misses  released"));
+    for (buf = firstbuf; buf != NULL && !got_int; buf = buf->b_next)
+    {
+	mfp = buf->b_ml.ml_mfp;
+	if (mfp == NULL)
+	    continue;
+	msg_putchar('\n');
+	if (buf_spname(buf) != NULL)
+	    vim_strncpy(NameBuff, buf_spname(buf), MAXPATHL - 1);
+	else
+	    home_replace(buf, buf->b_fname, NameBuff, MAXPATHL, TRUE);
+	len = vim_snprintf((char *)IObuff, IOSIZE,
+		"%4d %6u %5u %6lu %9ld %9ld %9ld  ",
+		buf->b_fnum, mfp->mf_used_count, mfp->mf_a1_count,
+		(long_u)mfp->mf_ghost.mht_count, mfp->mf_hit_count,
+		mfp->mf_miss_count, mfp->mf_release_count);
+	vim_strncpy(IObuff + len, NameBuff, IOSIZE - len - 1);
+	msg_outtrans(IObuff);
+	out_flush();	    /* output one line at a time */
+	ui_breakcheck();
+    }
+    msg_putchar('\n');
+    vim_snprintf((char *)IObuff, IOSIZE,
+			    _("%ld Kbyte used for all buffers, 'maxmemtot' %ld"),
+				 (long)(total_mem_used >> 10), (long)p_mmt);
+    msg_puts(IObuff);
+
+    vim_regcache_msg();
+}
+
 /*
  * Open a swap file for a memfile.
  * The "fname" must be in allocated memory, and is consumed (also when an
@@ -26,6 +26,9 @@
 #define TEST_COUNT 50000
 
 static void test_mf_hash __ARGS((void));
+static void check_block __ARGS((memfile_T *mfp, blocknr_T nr));
+static void test_mf_2q __ARGS((void));
+static void test_mf_sync __ARGS((void));
 
 /*
  * Test mf_hash_*() functions.
@@ -137,9 +140,160 @@ test_mf_hash()
     mf_hash_free_all(&ht);
 }
 
+/*
+ * Get block "nr" and check that it contains its own number.
+ */
+    static void
+check_block(mfp, nr)
+    memfile_T	*mfp;
+    blocknr_T	nr;
+{
+    bhdr_T	*hp;
+
+    hp = mf_get(mfp, nr, 1);
+    assert(hp != NULL);
+    assert(*(blocknr_T *)hp->bh_data == nr);
+    mf_put(mfp, hp, FALSE, FALSE);
+}
+
+/*
+ * Test that blocks used often stay in memory when going through all blocks
+ * once.
+ */
+    static void
+test_mf_2q()
+{
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+    blocknr_T	i;
+    blocknr_T	hot_count;
+    blocknr_T	scan_count;
+    blocknr_T	other_count;
+    long	misses;
+    int		round;
+#ifdef FEAT_CRYPT
+    static buf_T buf;
+
+    buf.b_p_key = (char_u *)"";
+#endif
+
+    p_mm = 160;
+    p_mmt = 100000;
+    mch_remove((char_u *)"Xmftest");
+    mfp = mf_open(vim_strsave((char_u *)"Xmftest"), O_RDWR|O_CREAT|O_EXCL);
+    assert(mfp != NULL);
+#ifdef FEAT_CRYPT
+    mfp->mf_buffer = &buf;
+#endif
+    hot_count = mfp->mf_used_count_max / 2;
+    other_count = MF_A1_MAX(mfp) + 1;
+    scan_count = mfp->mf_used_count_max * 4;
+
+    /* create the blocks, each containing its number */
+    for (i = 0; i < hot_count + scan_count; i++)
+    {
+	hp = mf_new(mfp, FALSE, 1);
+	assert(hp != NULL);
+	assert(hp->bh_bnum == i);
+	*(blocknr_T *)hp->bh_data = i;
+	mf_put(mfp, hp, TRUE, FALSE);
+	assert(mfp->mf_used_count <= mfp->mf_used_count_max);
+    }
+
+    /* use the first blocks a few times, with other blocks in between */
+    for (round = 0; round < 3; round++)
+    {
+	for (i = 0; i < hot_count; i++)
+	    check_block(mfp, i);
+	for (i = 0; i < other_count; i++)
+	    check_block(mfp, hot_count + round * other_count + i);
+    }
+    for (i = 0; i < hot_count; i++)
+    {
+	hp = mf_find_hash(mfp, i);
+	assert(hp != NULL);
+	assert(!(hp->bh_flags & BH_A1));
+    }
+
+    /* go through the blocks not used yet, the first ones must stay */
+    for (i = hot_count + 3 * other_count; i < hot_count + scan_count; i++)
+	check_block(mfp, i);
+    assert(mfp->mf_used_count <= mfp->mf_used_count_max);
+    assert(mfp->mf_a1_count <= mfp->mf_used_count - hot_count);
+    misses = mfp->mf_miss_count;
+    for (i = 0; i < hot_count; i++)
+	check_block(mfp, i);
+    assert(mfp->mf_miss_count == misses);
+
+    mf_close(mfp, TRUE);
+}
+
+/*
+ * Test that mf_sync() writes all blocks to the right place, also when they
+ * are written together.
+ */
+    static void
+test_mf_sync()
+{
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+    blocknr_T	i;
+    blocknr_T	nr;
+    int		fd;
+    char_u	*page;
+#ifdef FEAT_CRYPT
+    static buf_T buf;
+
+    buf.b_p_key = (char_u *)"";
+#endif
+
+    p_mm = 100000;
+    p_mmt = 100000;
+    mch_remove((char_u *)"Xmftest");
+    mfp = mf_open(vim_strsave((char_u *)"Xmftest"), O_RDWR|O_CREAT|O_EXCL);
+    assert(mfp != NULL);
+#ifdef FEAT_CRYPT
+    mfp->mf_buffer = &buf;
+#endif
+
+    /* positive and negative blocks, some with two pages */
+    for (i = 0; i < 100; i++)
+    {
+	hp = mf_new(mfp, i % 3 == 0, i % 7 == 0 ? 2 : 1);
+	assert(hp != NULL);
+	*(blocknr_T *)hp->bh_data = hp->bh_bnum;
+	mf_put(mfp, hp, TRUE, FALSE);
+    }
+    assert(mf_sync(mfp, MFS_ALL) == OK);
+    assert(!mfp->mf_dirty);
+
+    /* every block is in the file, check its first page */
+    page = alloc(mfp->mf_page_size);
+    assert(page != NULL);
+    fd = mch_open("Xmftest", O_RDONLY | O_EXTRA, 0);
+    assert(fd >= 0);
+    for (hp = mfp->mf_used_first; hp != NULL; hp = hp->bh_next)
+    {
+	assert(hp->bh_bnum >= 0);
+	assert(!(hp->bh_flags & BH_DIRTY));
+	assert(lseek(fd, (off_t)mfp->mf_page_size * hp->bh_bnum, SEEK_SET)
+				    == (off_t)mfp->mf_page_size * hp->bh_bnum);
+	assert(read(fd, page, mfp->mf_page_size) == (int)mfp->mf_page_size);
+	nr = *(blocknr_T *)page;
+	assert(nr == *(blocknr_T *)hp->bh_data);
+	assert(mf_trans_del(mfp, nr) == hp->bh_bnum);
+    }
+    close(fd);
+    vim_free(page);
+
+    mf_close(mfp, TRUE);
+}
+
     int
 main()
 {
     test_mf_hash();
+    test_mf_2q();
+    test_mf_sync();
     return 0;
 }
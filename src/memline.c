@@ -52,6 +52,16 @@
 # include <proto/dos.h>	    /* for Open() and Close() */
 #endif
 
+#ifdef FEAT_MMAP
+# include <sys/mman.h>
+/* Nanoseconds of the modified time, to notice a change within a second. */
+# ifdef _STATBUF_ST_NSEC
+#  define ST_MTIME_NS(st) ((long)(st).st_mtim.tv_nsec)
+# else
+#  define ST_MTIME_NS(st) 0L
+# endif
+#endif
+
 typedef struct block0		ZERO_BL;    /* contents of the first block */
 typedef struct pointer_block	PTR_BL;	    /* contents of a pointer block */
 typedef struct data_block	DATA_BL;    /* contents of a data block */
@@ -200,6 +210,7 @@ struct block0
 #define B0_HAS_FENC	8
 
 #define STACK_INCR	5	/* nr of entries added to ml_stack at a time */
+#define LINE_SLACK_MIN	1000	/* changed lines this long get room to grow */
 
 /*
  * The line number where the first mark may be is remembered.
@@ -209,6 +220,17 @@ struct block0
  */
 static linenr_T	lowest_marked = 0;
 
+#ifdef FEAT_BYTEOFF
+/*
+ * Position of the last line updated by ml_updatechunk(), to avoid searching
+ * the chunk when adding lines one after another.
+ */
+static buf_T	*ml_upd_lastbuf = NULL;
+static linenr_T	ml_upd_lastline;
+static linenr_T	ml_upd_lastcurline;
+static int	ml_upd_lastcurix;
+#endif
+
 /*
  * arguments for ml_find_line()
  */
@@ -216,7 +238,8 @@ static linenr_T	lowest_marked = 0;
 #define ML_INSERT	0x12	    /* insert line */
 #define ML_FIND		0x13	    /* just find the line */
 #define ML_FLUSH	0x02	    /* flush locked block */
-#define ML_SIMPLE(x)	(x & 0x10)  /* DEL, INS or FIND */
+#define ML_PEEK		0x14	    /* find the line, don't copy mapped lines */
+#define ML_SIMPLE(x)	(x & 0x10)  /* DEL, INS, FIND or PEEK */
 
 /* argument for ml_upd_block0() */
 typedef enum {
@@ -238,6 +261,7 @@ static void add_b0_fenc __ARGS((ZERO_BL *b0p, buf_T *buf));
 static time_t swapfile_info __ARGS((char_u *));
 static int recov_file_names __ARGS((char_u **, char_u *, int prepend_dot));
 static int ml_append_int __ARGS((buf_T *, linenr_T, char_u *, colnr_T, int, int));
+static int ml_append_block __ARGS((buf_T *buf, linenr_T lnum, char_u **lines, colnr_T *lens, long count, int newfile));
 static int ml_delete_int __ARGS((buf_T *, linenr_T, int));
 static char_u *findswapname __ARGS((buf_T *, char_u **, char_u *));
 static void ml_flush_line __ARGS((buf_T *));
@@ -259,7 +283,23 @@ static char_u *make_percent_swname __ARGS((char_u *dir, char_u *name));
 static void ml_crypt_prepare __ARGS((memfile_T *mfp, off_t offset, int reading));
 #endif
 #ifdef FEAT_BYTEOFF
+static int ml_chunk_init __ARGS((buf_T *buf));
+static int ml_splitchunk __ARGS((buf_T *buf, int curix, linenr_T curline));
 static void ml_updatechunk __ARGS((buf_T *buf, long line, long len, int updtype));
+static void ml_updatechunk_lines __ARGS((buf_T *buf, long line, long count, long len));
+static void ml_chunktree_build __ARGS((buf_T *buf));
+static void ml_chunktree_add __ARGS((buf_T *buf, int idx, long lines, long size));
+static int ml_find_chunk __ARGS((buf_T *buf, linenr_T lnum, long offset, int ffdos, linenr_T *linep, long *sizep));
+#endif
+#ifdef FEAT_MMAP
+static int ml_map_decode __ARGS((mlmap_T *mm, long start, int count));
+static blocknr_T ml_map_copy __ARGS((buf_T *buf, long start, int count, int *page_countp));
+static void ml_map_release __ARGS((buf_T *buf));
+static int ml_map_check __ARGS((mlmap_T *mm));
+static void ml_map_damaged __ARGS((buf_T *buf));
+static char_u *ml_map_next __ARGS((mlmap_T *mm, char_u **pp, int *lenp));
+static void ml_map_line_copy __ARGS((char_u *d, char_u *s, int len));
+static bhdr_T *ml_find_marked __ARGS((buf_T *buf, linenr_T lnum, linenr_T *nextp));
 #endif
 
 /*
@@ -288,6 +328,9 @@ ml_open(buf)
 #ifdef FEAT_BYTEOFF
     buf->b_ml.ml_chunksize = NULL;
 #endif
+#ifdef FEAT_MMAP
+    buf->b_ml.ml_map = NULL;
+#endif
 
     if (cmdmod.noswapfile)
 	buf->b_p_swf = FALSE;
@@ -531,9 +574,14 @@ ml_set_crypt_key(buf, old_key, old_cm)
 		    }
 		    else if (idx < (int)pp->pb_count)	/* go a block deeper */
 		    {
-			if (pp->pb_pointer[idx].pe_bnum < 0)
+			if (pp->pb_pointer[idx].pe_bnum < 0
+# ifdef FEAT_MMAP
+				|| pp->pb_pointer[idx].pe_page_count == 0
+# endif
+				)
 			{
-			    /* Skip data block with negative block number. */
+			    /* Skip data block with negative block number and
+			     * lines that are still in the mapped file. */
 			    ++idx;    /* get same block again for next index */
 			    continue;
 			}
@@ -815,12 +863,23 @@ ml_close(buf, del_file)
     if (buf->b_ml.ml_mfp == NULL)		/* not open */
 	return;
     mf_close(buf->b_ml.ml_mfp, del_file);	/* close the .swp file */
+    vcol_cache_changed(buf, (linenr_T)0, 0, (linenr_T)0);
     if (buf->b_ml.ml_line_lnum != 0 && (buf->b_ml.ml_flags & ML_LINE_DIRTY))
 	vim_free(buf->b_ml.ml_line_ptr);
     vim_free(buf->b_ml.ml_stack);
 #ifdef FEAT_BYTEOFF
     vim_free(buf->b_ml.ml_chunksize);
     buf->b_ml.ml_chunksize = NULL;
+#endif
+#ifdef FEAT_MMAP
+    if (buf->b_ml.ml_map != NULL)
+    {
+	ml_map_release(buf);
+	vim_free(buf->b_ml.ml_map->mm_text);
+	vim_free(buf->b_ml.ml_map->mm_index);
+	vim_free(buf->b_ml.ml_map);
+	buf->b_ml.ml_map = NULL;
+    }
 #endif
     buf->b_ml.ml_mfp = NULL;
 
@@ -1173,6 +1232,9 @@ ml_recover()
     buf->b_ml.ml_line_lnum = 0;		/* no cached line */
     buf->b_ml.ml_locked = NULL;		/* no locked block */
     buf->b_ml.ml_flags = 0;
+#ifdef FEAT_MMAP
+    buf->b_ml.ml_map = NULL;
+#endif
 #ifdef FEAT_CRYPT
     buf->b_p_key = empty_option;
     buf->b_p_cm = empty_option;
@@ -1473,10 +1535,12 @@ ml_recover()
 		}
 		else if (idx < (int)pp->pb_count)	/* go a block deeper */
 		{
-		    if (pp->pb_pointer[idx].pe_bnum < 0)
+		    if (pp->pb_pointer[idx].pe_bnum < 0
+			    || pp->pb_pointer[idx].pe_page_count == 0)
 		    {
 			/*
-			 * Data block with negative block number.
+			 * Data block with negative block number, or lines that
+			 * were still in the mapped file (zero page count).
 			 * Try to read lines from the original file.
 			 * This is slow, but it works.
 			 */
@@ -2314,6 +2378,10 @@ ml_preserve(buf, message)
     got_int = FALSE;
 
     ml_flush_line(buf);				    /* flush buffered line */
+#ifdef FEAT_MMAP
+    /* lines that are still in the mapped file are not in the swap file */
+    ml_unmap(buf);
+#endif
     (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH); /* flush locked block */
     status = mf_sync(mfp, MFS_ALL | MFS_FLUSH);
 
@@ -2429,6 +2497,9 @@ ml_get_buf(buf, lnum, will_change)
     DATA_BL	*dp;
     char_u	*ptr;
     static int	recursive = 0;
+#ifdef FEAT_MMAP
+    mlmap_T	*mm;
+#endif
 
     if (lnum > buf->b_ml.ml_line_count)	/* invalid line number */
     {
@@ -2447,6 +2518,12 @@ errorret:
     if (lnum <= 0)			/* pretend line 0 is line 1 */
 	lnum = 1;
 
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+    /* A syntax file that looks at the text can't be cached. */
+    if (buf == syn_cache_buf)
+	syn_cache_cancel();
+#endif
+
     if (buf->b_ml.ml_mfp == NULL)	/* there are no lines */
 	return (char_u *)"";
 
@@ -2456,7 +2533,8 @@ errorret:
      * Don't use the last used line when 'swapfile' is reset, need to load all
      * blocks.
      */
-    if (buf->b_ml.ml_line_lnum != lnum || mf_dont_release)
+    if (buf->b_ml.ml_line_lnum != lnum || mf_dont_release
+	    || (will_change && (buf->b_ml.ml_flags & ML_LINE_MAPPED)))
     {
 	ml_flush_line(buf);
 
@@ -2465,7 +2543,39 @@ errorret:
 	 * This also fills the stack with the blocks from the root to the data
 	 * block and releases any locked block.
 	 */
-	if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+#ifdef FEAT_MMAP
+	hp = NULL;
+	mm = buf->b_ml.ml_map;
+	if (!will_change && mm != NULL && mm->mm_addr != NULL
+							    && !mm->mm_changed)
+	{
+	    /* A line that is still in the mapped file is used from there,
+	     * without copying its block into the memfile. */
+	    mm->mm_hit_low = 0;
+	    hp = ml_find_line(buf, lnum, ML_PEEK);
+	    if (hp == NULL && mm->mm_hit_low != 0)
+	    {
+		if (ml_map_decode(mm, mm->mm_hit_start, mm->mm_hit_count)
+									== OK)
+		{
+		    buf->b_ml.ml_line_ptr = mm->mm_text
+				      + mm->mm_index[lnum - mm->mm_hit_low];
+		    buf->b_ml.ml_line_lnum = lnum;
+		    buf->b_ml.ml_flags = (buf->b_ml.ml_flags & ~ML_LINE_DIRTY)
+							      | ML_LINE_MAPPED;
+		    return buf->b_ml.ml_line_ptr;
+		}
+		if (!mm->mm_changed)
+		    goto errorret;
+	    }
+	}
+	/* When the file was changed copy what is still in it right away. */
+	if (mm != NULL && mm->mm_changed && mm->mm_addr != NULL)
+	    (void)ml_unmap(buf);
+	if (hp == NULL)
+#endif
+	    hp = ml_find_line(buf, lnum, ML_FIND);
+	if (hp == NULL)
 	{
 	    if (recursive == 0)
 	    {
@@ -2483,7 +2593,7 @@ errorret:
 	ptr = (char_u *)dp + ((dp->db_index[lnum - buf->b_ml.ml_locked_low]) & DB_INDEX_MASK);
 	buf->b_ml.ml_line_ptr = ptr;
 	buf->b_ml.ml_line_lnum = lnum;
-	buf->b_ml.ml_flags &= ~ML_LINE_DIRTY;
+	buf->b_ml.ml_flags &= ~(ML_LINE_DIRTY | ML_LINE_MAPPED);
     }
     if (will_change)
 	buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
@@ -2551,6 +2661,178 @@ ml_append_buf(buf, lnum, line, len, newfile)
 }
 #endif
 
+/*
+ * Append "count" lines after "lnum", like calling ml_append() "count" times.
+ * The lines are packed into the data blocks directly, thus the text of the
+ * following lines in a block is moved only once and the pointer blocks and
+ * the byte offset chunks are updated once for each block.
+ * "lens" may be NULL, otherwise it has the length of each line, including
+ * the NUL, or 0.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_append_lines(lnum, lines, lens, count, newfile)
+    linenr_T	lnum;		/* append after this line (can be 0) */
+    char_u	**lines;	/* text of the new lines */
+    colnr_T	*lens;		/* lengths of new lines or NULL */
+    long	count;		/* number of lines in "lines" */
+    int		newfile;	/* flag, see ml_append() */
+{
+    long	done = 0;
+    int		n;
+
+    /* When starting up, we might still need to create the memfile */
+    if (curbuf->b_ml.ml_mfp == NULL && open_buffer(FALSE, NULL, 0) == FAIL)
+	return FAIL;
+
+    if (curbuf->b_ml.ml_line_lnum != 0)
+	ml_flush_line(curbuf);
+    while (done < count)
+    {
+	n = ml_append_block(curbuf, lnum + done, lines + done,
+			      lens == NULL ? NULL : lens + done, count - done,
+								     newfile);
+	if (n < 0)
+	    return FAIL;
+	if (n == 0)
+	{
+	    /* The block is full: let ml_append_int() split it or use the
+	     * next one. */
+	    if (ml_append_int(curbuf, lnum + done, lines[done],
+			    lens == NULL ? 0 : lens[done], newfile, FALSE) == FAIL)
+		return FAIL;
+	    n = 1;
+	}
+	done += n;
+    }
+    return OK;
+}
+
+/*
+ * Append as many of the "count" lines in "lines" after "lnum" as fit in the
+ * data block that contains "lnum".
+ * Returns the number of lines appended, zero when not even the first line
+ * fits and -1 for failure.
+ */
+    static int
+ml_append_block(buf, lnum, lines, lens, count, newfile)
+    buf_T	*buf;
+    linenr_T	lnum;		/* append after this line (can be 0) */
+    char_u	**lines;	/* text of the new lines */
+    colnr_T	*lens;		/* lengths of new lines or NULL */
+    long	count;		/* number of lines in "lines" */
+    int		newfile;	/* flag, see ml_append() */
+{
+    int		i;
+    int		n;
+    int		len;
+    int		total;		/* space needed for the text of the lines */
+    int		line_count;	/* number of indexes in current block */
+    int		offset;
+    int		db_idx;		/* index for lnum in data block */
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+
+					/* lnum out of range */
+    if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
+	return -1;
+
+    /*
+     * Find the data block containing the previous line.  The line counts are
+     * adjusted below, once we know how many lines fit in it.
+     */
+    if ((hp = ml_find_line(buf, lnum == 0 ? (linenr_T)1 : lnum,
+							     ML_FIND)) == NULL)
+	return -1;
+
+    if (lnum == 0)		/* got line one instead, correct db_idx */
+	db_idx = -1;		/* careful, it is negative! */
+    else
+	db_idx = lnum - buf->b_ml.ml_locked_low;
+    line_count = buf->b_ml.ml_locked_high - buf->b_ml.ml_locked_low + 1;
+    dp = (DATA_BL *)(hp->bh_data);
+
+    /* Count the lines that fit in the free space. */
+    total = 0;
+    for (n = 0; n < count; ++n)
+    {
+	len = (lens == NULL || lens[n] == 0)
+			     ? (int)STRLEN(lines[n]) + 1 : (int)lens[n];
+	if (total + len + (n + 1) * (int)INDEX_SIZE > (int)dp->db_free)
+	    break;
+	total += len;
+    }
+    if (n == 0)
+	return 0;
+
+    if (lowest_marked && lowest_marked > lnum)
+	lowest_marked = lnum + 1;
+
+    /* Same as what ml_find_line() does for ML_INSERT on the locked block. */
+    buf->b_ml.ml_locked_lineadd += n;
+    buf->b_ml.ml_locked_high += n;
+    buf->b_ml.ml_line_count += n;
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+    vcol_cache_lines(buf, lnum + 1, (long)n);
+
+    /*
+     * Offset is the start of the previous line.  Move the text of the lines
+     * that follow to the front and adjust their indexes.
+     */
+    if (db_idx < 0)
+	offset = dp->db_txt_end;
+    else
+	offset = ((dp->db_index[db_idx]) & DB_INDEX_MASK);
+    if (line_count > db_idx + 1)
+    {
+	mch_memmove((char *)dp + dp->db_txt_start - total,
+					       (char *)dp + dp->db_txt_start,
+				       (size_t)(offset - dp->db_txt_start));
+	for (i = line_count - 1; i > db_idx; --i)
+	    dp->db_index[i + n] = dp->db_index[i] - total;
+    }
+
+    /*
+     * Copy the text of the new lines into the block.
+     */
+    for (i = 0; i < n; ++i)
+    {
+	len = (lens == NULL || lens[i] == 0)
+			     ? (int)STRLEN(lines[i]) + 1 : (int)lens[i];
+	offset -= len;
+	dp->db_index[db_idx + 1 + i] = offset;
+	mch_memmove((char *)dp + offset, lines[i], (size_t)len);
+    }
+    dp->db_txt_start -= total;
+    dp->db_free -= total + n * INDEX_SIZE;
+    dp->db_line_count += n;
+
+    /*
+     * Mark the block dirty.
+     */
+    buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+    if (!newfile)
+	buf->b_ml.ml_flags |= ML_LOCKED_POS;
+
+#ifdef FEAT_BYTEOFF
+    /* The lines were inserted below 'lnum' */
+    ml_updatechunk_lines(buf, lnum + 1, (long)n, (long)total);
+#endif
+#ifdef FEAT_NETBEANS_INTG
+    if (netbeans_active())
+	for (i = 0; i < n; ++i)
+	{
+	    if (STRLEN(lines[i]) > 0)
+		netbeans_inserted(buf, lnum + 1 + i, (colnr_T)0, lines[i],
+						      (int)STRLEN(lines[i]));
+	    netbeans_inserted(buf, lnum + 1 + i, (colnr_T)STRLEN(lines[i]),
+							   (char_u *)"\n", 1);
+	}
+#endif
+    return n;
+}
+
     static int
 ml_append_int(buf, lnum, line, len, newfile, mark)
     buf_T	*buf;
@@ -2596,6 +2878,7 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
     if ((hp = ml_find_line(buf, lnum == 0 ? (linenr_T)1 : lnum,
 							  ML_INSERT)) == NULL)
 	return FAIL;
+    vcol_cache_lines(buf, lnum + 1, 1L);
 
     buf->b_ml.ml_flags &= ~ML_EMPTY;
 
@@ -3075,6 +3358,7 @@ ml_replace(lnum, line, copy)
 
     if (copy && (line = vim_strsave(line)) == NULL) /* allocate memory */
 	return FAIL;
+    vcol_cache_replace(lnum, line);
 #ifdef FEAT_NETBEANS_INTG
     if (netbeans_active())
     {
@@ -3088,8 +3372,77 @@ ml_replace(lnum, line, copy)
 	vim_free(curbuf->b_ml.ml_line_ptr);	    /* free it */
     curbuf->b_ml.ml_line_ptr = line;
     curbuf->b_ml.ml_line_lnum = lnum;
-    curbuf->b_ml.ml_flags = (curbuf->b_ml.ml_flags | ML_LINE_DIRTY) & ~ML_EMPTY;
+    curbuf->b_ml.ml_line_size = 0;
+    curbuf->b_ml.ml_flags = (curbuf->b_ml.ml_flags | ML_LINE_DIRTY)
+					       & ~(ML_EMPTY | ML_LINE_MAPPED);
+
+    return OK;
+}
+
+/*
+ * Replace "oldlen" bytes at column "col" of line "lnum" in the current buffer
+ * with the "newlen" bytes at "text".  "text" must not point into the line.
+ *
+ * The changed line is kept in allocated memory with some room to grow, so
+ * that when typing in a very long line only the text after the cursor is
+ * moved, instead of allocating and copying the whole line for every
+ * character.
+ *
+ * Check: The caller should call changed_bytes().
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_replace_bytes(lnum, col, oldlen, text, newlen)
+    linenr_T	lnum;
+    colnr_T	col;
+    int		oldlen;
+    char_u	*text;
+    int		newlen;
+{
+    char_u	*oldp;
+    char_u	*newp;
+    long	linelen;	/* length of old line including NUL */
+    long	size;
+
+    oldp = ml_get(lnum);
+    linelen = (long)STRLEN(oldp) + 1;
+
+    if (curbuf->b_ml.ml_line_lnum == lnum
+	    && (curbuf->b_ml.ml_flags & ML_LINE_DIRTY)
+	    && linelen + newlen - oldlen <= curbuf->b_ml.ml_line_size
+#ifdef FEAT_NETBEANS_INTG
+	    /* Let ml_replace() take care of notifying Netbeans. */
+	    && !netbeans_active()
+#endif
+	    )
+    {
+	/* Change the cached line in place. */
+	vcol_cache_changed(curbuf, lnum, col, lnum + 1);
+	mch_memmove(oldp + col + newlen, oldp + col + oldlen,
+					     (size_t)(linelen - col - oldlen));
+	mch_memmove(oldp + col, text, (size_t)newlen);
+	return OK;
+    }
 
+    size = linelen + newlen - oldlen;
+    if (size >= LINE_SLACK_MIN)
+	size += size / 4;
+    newp = alloc_check((unsigned)size);
+    if (newp == NULL)
+	return FAIL;
+    if (col > 0)
+	mch_memmove(newp, oldp, (size_t)col);
+    mch_memmove(newp + col, text, (size_t)newlen);
+    mch_memmove(newp + col + newlen, oldp + col + oldlen,
+					     (size_t)(linelen - col - oldlen));
+    if (ml_replace(lnum, newp, FALSE) == FAIL)
+    {
+	vim_free(newp);
+	return FAIL;
+    }
+    if (size > linelen + newlen - oldlen)
+	curbuf->b_ml.ml_line_size = size;
     return OK;
 }
 
@@ -3153,6 +3506,7 @@ ml_delete_int(buf, lnum, message)
 
 	return i;
     }
+    vcol_cache_lines(buf, lnum, -1L);
 
 /*
  * find the data block containing the line
@@ -3310,6 +3664,9 @@ ml_firstmarked()
     DATA_BL	*dp;
     linenr_T	lnum;
     int		i;
+#ifdef FEAT_MMAP
+    linenr_T	next;
+#endif
 
     if (curbuf->b_ml.ml_mfp == NULL)
 	return (linenr_T) 0;
@@ -3325,7 +3682,18 @@ ml_firstmarked()
 	 * This also fills the stack with the blocks from the root to the data
 	 * block This also releases any locked block.
 	 */
+#ifdef FEAT_MMAP
+	/* Lines that are still in the mapped file are never marked. */
+	hp = ml_find_marked(curbuf, lnum, &next);
+	if (next != 0)
+	{
+	    lnum = next;
+	    continue;
+	}
+	if (hp == NULL)
+#else
 	if ((hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL)
+#endif
 	    return (linenr_T)0;		    /* give error message? */
 
 	dp = (DATA_BL *)(hp->bh_data);
@@ -3344,6 +3712,32 @@ ml_firstmarked()
     return (linenr_T) 0;
 }
 
+#ifdef FEAT_MMAP
+/*
+ * Find the data block with line "lnum" for the marked lines functions.
+ * When the line is still in the mapped file return NULL and set "*nextp" to
+ * the line just after its group, otherwise "*nextp" is set to zero.
+ */
+    static bhdr_T *
+ml_find_marked(buf, lnum, nextp)
+    buf_T	*buf;
+    linenr_T	lnum;
+    linenr_T	*nextp;
+{
+    mlmap_T	*mm = buf->b_ml.ml_map;
+    bhdr_T	*hp;
+
+    *nextp = 0;
+    if (mm == NULL || mm->mm_addr == NULL)
+	return ml_find_line(buf, lnum, ML_FIND);
+    mm->mm_hit_low = 0;
+    hp = ml_find_line(buf, lnum, ML_PEEK);
+    if (hp == NULL && mm->mm_hit_low != 0)
+	*nextp = mm->mm_hit_low + mm->mm_hit_count;
+    return hp;
+}
+#endif
+
 /*
  * clear all DB_MARKED flags
  */
@@ -3354,6 +3748,9 @@ ml_clearmarked()
     DATA_BL	*dp;
     linenr_T	lnum;
     int		i;
+#ifdef FEAT_MMAP
+    linenr_T	next;
+#endif
 
     if (curbuf->b_ml.ml_mfp == NULL)	    /* nothing to do */
 	return;
@@ -3368,7 +3765,18 @@ ml_clearmarked()
 	 * This also fills the stack with the blocks from the root to the data
 	 * block and releases any locked block.
 	 */
+#ifdef FEAT_MMAP
+	/* Lines that are still in the mapped file are never marked. */
+	hp = ml_find_marked(curbuf, lnum, &next);
+	if (next != 0)
+	{
+	    lnum = next;
+	    continue;
+	}
+	if (hp == NULL)
+#else
 	if ((hp = ml_find_line(curbuf, lnum, ML_FIND)) == NULL)
+#endif
 	    return;		/* give error message? */
 
 	dp = (DATA_BL *)(hp->bh_data);
@@ -3622,7 +4030,7 @@ ml_find_line(buf, lnum, action)
     low = 1;
     high = buf->b_ml.ml_line_count;
 
-    if (action == ML_FIND)	/* first try stack entries */
+    if (action == ML_FIND || action == ML_PEEK)	/* first try stack entries */
     {
 	for (top = buf->b_ml.ml_stack_top - 1; top >= 0; --top)
 	{
@@ -3697,6 +4105,35 @@ ml_find_line(buf, lnum, action)
 		high = low - 1;
 		low -= t;
 
+#ifdef FEAT_MMAP
+		/*
+		 * A zero page count means the lines are still in the mapped
+		 * file, "bnum" is their offset.  Copy them into a new data
+		 * block, unless the caller only wants to look at them.
+		 */
+		if (page_count == 0)
+		{
+		    if (action == ML_PEEK)
+		    {
+			buf->b_ml.ml_map->mm_hit_start = (long)bnum;
+			buf->b_ml.ml_map->mm_hit_low = low;
+			buf->b_ml.ml_map->mm_hit_count = (int)t;
+			mf_put(mfp, hp, dirty, FALSE);
+			return NULL;
+		    }
+		    bnum = ml_map_copy(buf, (long)bnum, (int)t, &page_count);
+		    if (bnum == 0)
+		    {
+			/* the line counts at this level were not changed */
+			buf->b_ml.ml_stack_top = top;
+			goto error_block;
+		    }
+		    pp->pb_pointer[idx].pe_bnum = bnum;
+		    pp->pb_pointer[idx].pe_page_count = page_count;
+		    dirty = TRUE;
+		}
+#endif
+
 		/*
 		 * a negative block number may have been changed
 		 */
@@ -4930,34 +5367,13 @@ ml_crypt_prepare(mfp, offset, reading)
 #define MLCS_MINL 400   /* should be half of MLCS_MAXL */
 
 /*
- * Keep information for finding byte offset of a line, updtype may be one of:
- * ML_CHNK_ADDLINE: Add len to parent chunk, possibly splitting it
- *	   Careful: ML_CHNK_ADDLINE may cause ml_find_line() to be called.
- * ML_CHNK_DELLINE: Subtract len from parent chunk, possibly deleting it
- * ML_CHNK_UPDLINE: Add len to parent chunk, as a signed entity.
+ * Allocate the chunks for "buf" when not done yet.  The buffer has one empty
+ * line then.
  */
-    static void
-ml_updatechunk(buf, line, len, updtype)
+    static int
+ml_chunk_init(buf)
     buf_T	*buf;
-    linenr_T	line;
-    long	len;
-    int		updtype;
 {
-    static buf_T	*ml_upd_lastbuf = NULL;
-    static linenr_T	ml_upd_lastline;
-    static linenr_T	ml_upd_lastcurline;
-    static int		ml_upd_lastcurix;
-
-    linenr_T		curline = ml_upd_lastcurline;
-    int			curix = ml_upd_lastcurix;
-    long		size;
-    chunksize_T		*curchnk;
-    int			rest;
-    bhdr_T		*hp;
-    DATA_BL		*dp;
-
-    if (buf->b_ml.ml_usedchunks == -1 || len == 0)
-	return;
     if (buf->b_ml.ml_chunksize == NULL)
     {
 	buf->b_ml.ml_chunksize = (chunksize_T *)
@@ -4965,56 +5381,249 @@ ml_updatechunk(buf, line, len, updtype)
 	if (buf->b_ml.ml_chunksize == NULL)
 	{
 	    buf->b_ml.ml_usedchunks = -1;
-	    return;
+	    return FAIL;
 	}
 	buf->b_ml.ml_numchunks = 100;
 	buf->b_ml.ml_usedchunks = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize = 1;
+	buf->b_ml.ml_chunktree = FALSE;
     }
+    return OK;
+}
 
-    if (updtype == ML_CHNK_UPDLINE && buf->b_ml.ml_line_count == 1)
+/*
+ * Compute the Fenwick tree over the chunks of "buf", used to find the chunk
+ * for a line or byte offset in O(log n).  Adding and removing chunks shifts
+ * the entries, then the tree is built again when it is needed.
+ */
+    static void
+ml_chunktree_build(buf)
+    buf_T	*buf;
+{
+    chunksize_T	*cs = buf->b_ml.ml_chunksize;
+    int		n = buf->b_ml.ml_usedchunks;
+    int		i, j;
+
+    for (i = 0; i < n; ++i)
     {
-	/*
-	 * First line in empty buffer from ml_flush_line() -- reset
-	 */
-	buf->b_ml.ml_usedchunks = 1;
-	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
-	buf->b_ml.ml_chunksize[0].mlcs_totalsize =
-				  (long)STRLEN(buf->b_ml.ml_line_ptr) + 1;
-	return;
+	cs[i].mlcs_treelines = cs[i].mlcs_numlines;
+	cs[i].mlcs_treesize = cs[i].mlcs_totalsize;
     }
-
-    /*
-     * Find chunk that our line belongs to, curline will be at start of the
-     * chunk.
-     */
-    if (buf != ml_upd_lastbuf || line != ml_upd_lastline + 1
-	    || updtype != ML_CHNK_ADDLINE)
+    for (i = 1; i <= n; ++i)
     {
-	for (curline = 1, curix = 0;
-	     curix < buf->b_ml.ml_usedchunks - 1
-	     && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	     curix++)
+	j = i + (i & -i);
+	if (j <= n)
 	{
-	    curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+	    cs[j - 1].mlcs_treelines += cs[i - 1].mlcs_treelines;
+	    cs[j - 1].mlcs_treesize += cs[i - 1].mlcs_treesize;
 	}
     }
-    else if (line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines
-		 && curix < buf->b_ml.ml_usedchunks - 1)
+    buf->b_ml.ml_chunktree = TRUE;
+}
+
+/*
+ * Add "lines" and "size" to chunk "idx" in the Fenwick tree, if it is valid.
+ * The chunk itself must be updated by the caller.
+ */
+    static void
+ml_chunktree_add(buf, idx, lines, size)
+    buf_T	*buf;
+    int		idx;
+    long	lines;
+    long	size;
+{
+    chunksize_T	*cs = buf->b_ml.ml_chunksize;
+    int		n = buf->b_ml.ml_usedchunks;
+    int		i;
+
+    if (!buf->b_ml.ml_chunktree)
+	return;
+    for (i = idx + 1; i <= n; i += i & -i)
     {
-	/* Adjust cached curix & curline */
-	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	curix++;
+	cs[i - 1].mlcs_treelines += lines;
+	cs[i - 1].mlcs_treesize += size;
     }
-    curchnk = buf->b_ml.ml_chunksize + curix;
+}
 
-    if (updtype == ML_CHNK_DELLINE)
-	len = -len;
-    curchnk->mlcs_totalsize += len;
-    if (updtype == ML_CHNK_ADDLINE)
+/*
+ * Find the chunk that contains line "lnum", or byte "offset" when it is not
+ * zero, counting a CR for every line when "ffdos" is TRUE.  Beyond the end
+ * this is the last chunk.
+ * Sets "*linep" to the first line in the chunk and "*sizep", when not NULL,
+ * to the number of bytes before it, without the CRs.
+ * Returns the index of the chunk.
+ */
+    static int
+ml_find_chunk(buf, lnum, offset, ffdos, linep, sizep)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	offset;
+    int		ffdos;
+    linenr_T	*linep;
+    long	*sizep;
+{
+    chunksize_T	*cs = buf->b_ml.ml_chunksize;
+    int		n = buf->b_ml.ml_usedchunks;
+    int		idx = 0;	/* number of chunks before the found one */
+    int		step;
+    long	lines = 0;
+    long	size = 0;
+    long	l, sz;
+
+    if (!buf->b_ml.ml_chunktree)
+	ml_chunktree_build(buf);
+
+    for (step = 1; step * 2 <= n; step *= 2)
+	;
+    for ( ; step > 0; step /= 2)
     {
-	curchnk->mlcs_numlines++;
+	/* The last chunk never qualifies, as in a linear search. */
+	if (idx + step > n - 1)
+	    continue;
+	l = lines + cs[idx + step - 1].mlcs_treelines;
+	sz = size + cs[idx + step - 1].mlcs_treesize;
+	if ((lnum != 0 && lnum >= l + 1)
+				    || (offset != 0 && offset > sz + ffdos * l))
+	{
+	    idx += step;
+	    lines = l;
+	    size = sz;
+	}
+    }
+    *linep = lines + 1;
+    if (sizep != NULL)
+	*sizep = size;
+    return idx;
+}
+
+/*
+ * Split chunk "curix", which starts at line "curline", in two.  The first
+ * one gets MLCS_MINL lines.  There must be room for one more chunk.
+ * Careful: this calls ml_find_line().
+ * Returns FAIL when a line could not be found.
+ */
+    static int
+ml_splitchunk(buf, curix, curline)
+    buf_T	*buf;
+    int		curix;
+    linenr_T	curline;
+{
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    long	size;
+    int		rest;
+    int		count;	    /* number of entries in block */
+    int		idx;
+    int		text_end;
+    int		linecnt;
+
+    mch_memmove(buf->b_ml.ml_chunksize + curix + 1,
+		buf->b_ml.ml_chunksize + curix,
+		(buf->b_ml.ml_usedchunks - curix) *
+		sizeof(chunksize_T));
+    buf->b_ml.ml_chunktree = FALSE;
+    /* Compute length of first half of lines in the split chunk */
+    size = 0;
+    linecnt = 0;
+    while (curline < buf->b_ml.ml_line_count
+		&& linecnt < MLCS_MINL)
+    {
+	if ((hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
+	    return FAIL;
+	dp = (DATA_BL *)(hp->bh_data);
+	count = (long)(buf->b_ml.ml_locked_high) -
+		(long)(buf->b_ml.ml_locked_low) + 1;
+	idx = curline - buf->b_ml.ml_locked_low;
+	curline = buf->b_ml.ml_locked_high + 1;
+	if (idx == 0)/* first line in block, text at the end */
+	    text_end = dp->db_txt_end;
+	else
+	    text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
+	/* Compute index of last line to use in this MEMLINE */
+	rest = count - idx;
+	if (linecnt + rest > MLCS_MINL)
+	{
+	    idx += MLCS_MINL - linecnt - 1;
+	    linecnt = MLCS_MINL;
+	}
+	else
+	{
+	    idx = count - 1;
+	    linecnt += rest;
+	}
+	size += text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
+    }
+    buf->b_ml.ml_chunksize[curix].mlcs_numlines = linecnt;
+    buf->b_ml.ml_chunksize[curix + 1].mlcs_numlines -= linecnt;
+    buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
+    buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
+    buf->b_ml.ml_usedchunks++;
+    return OK;
+}
+
+/*
+ * Keep information for finding byte offset of a line, updtype may be one of:
+ * ML_CHNK_ADDLINE: Add len to parent chunk, possibly splitting it
+ *	   Careful: ML_CHNK_ADDLINE may cause ml_find_line() to be called.
+ * ML_CHNK_DELLINE: Subtract len from parent chunk, possibly deleting it
+ * ML_CHNK_UPDLINE: Add len to parent chunk, as a signed entity.
+ */
+    static void
+ml_updatechunk(buf, line, len, updtype)
+    buf_T	*buf;
+    linenr_T	line;
+    long	len;
+    int		updtype;
+{
+    linenr_T		curline = ml_upd_lastcurline;
+    int			curix = ml_upd_lastcurix;
+    chunksize_T		*curchnk;
+    int			rest;
+    bhdr_T		*hp;
+    DATA_BL		*dp;
+
+    if (buf->b_ml.ml_usedchunks == -1 || len == 0
+					       || ml_chunk_init(buf) == FAIL)
+	return;
+
+    if (updtype == ML_CHNK_UPDLINE && buf->b_ml.ml_line_count == 1)
+    {
+	/*
+	 * First line in empty buffer from ml_flush_line() -- reset
+	 */
+	buf->b_ml.ml_usedchunks = 1;
+	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
+	buf->b_ml.ml_chunksize[0].mlcs_totalsize =
+				  (long)STRLEN(buf->b_ml.ml_line_ptr) + 1;
+	buf->b_ml.ml_chunktree = FALSE;
+	return;
+    }
+
+    /*
+     * Find chunk that our line belongs to, curline will be at start of the
+     * chunk.
+     */
+    if (buf != ml_upd_lastbuf || line != ml_upd_lastline + 1
+	    || updtype != ML_CHNK_ADDLINE)
+	curix = ml_find_chunk(buf, (linenr_T)line, 0L, FALSE, &curline, NULL);
+    else if (line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines
+		 && curix < buf->b_ml.ml_usedchunks - 1)
+    {
+	/* Adjust cached curix & curline */
+	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+	curix++;
+    }
+    curchnk = buf->b_ml.ml_chunksize + curix;
+
+    if (updtype == ML_CHNK_DELLINE)
+	len = -len;
+    curchnk->mlcs_totalsize += len;
+    ml_chunktree_add(buf, curix, updtype == ML_CHNK_ADDLINE ? 1L
+			  : updtype == ML_CHNK_DELLINE ? -1L : 0L, len);
+    if (updtype == ML_CHNK_ADDLINE)
+    {
+	curchnk->mlcs_numlines++;
 
 	/* May resize here so we don't have to do it in both cases below */
 	if (buf->b_ml.ml_usedchunks + 1 >= buf->b_ml.ml_numchunks)
@@ -5033,54 +5642,8 @@ ml_updatechunk(buf, line, len, updtype)
 
 	if (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL)
 	{
-	    int	    count;	    /* number of entries in block */
-	    int	    idx;
-	    int	    text_end;
-	    int	    linecnt;
-
-	    mch_memmove(buf->b_ml.ml_chunksize + curix + 1,
-			buf->b_ml.ml_chunksize + curix,
-			(buf->b_ml.ml_usedchunks - curix) *
-			sizeof(chunksize_T));
-	    /* Compute length of first half of lines in the split chunk */
-	    size = 0;
-	    linecnt = 0;
-	    while (curline < buf->b_ml.ml_line_count
-			&& linecnt < MLCS_MINL)
-	    {
-		if ((hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
-		{
-		    buf->b_ml.ml_usedchunks = -1;
-		    return;
-		}
-		dp = (DATA_BL *)(hp->bh_data);
-		count = (long)(buf->b_ml.ml_locked_high) -
-			(long)(buf->b_ml.ml_locked_low) + 1;
-		idx = curline - buf->b_ml.ml_locked_low;
-		curline = buf->b_ml.ml_locked_high + 1;
-		if (idx == 0)/* first line in block, text at the end */
-		    text_end = dp->db_txt_end;
-		else
-		    text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
-		/* Compute index of last line to use in this MEMLINE */
-		rest = count - idx;
-		if (linecnt + rest > MLCS_MINL)
-		{
-		    idx += MLCS_MINL - linecnt - 1;
-		    linecnt = MLCS_MINL;
-		}
-		else
-		{
-		    idx = count - 1;
-		    linecnt += rest;
-		}
-		size += text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
-	    }
-	    buf->b_ml.ml_chunksize[curix].mlcs_numlines = linecnt;
-	    buf->b_ml.ml_chunksize[curix + 1].mlcs_numlines -= linecnt;
-	    buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
-	    buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
-	    buf->b_ml.ml_usedchunks++;
+	    if (ml_splitchunk(buf, curix, curline) == FAIL)
+		buf->b_ml.ml_usedchunks = -1;
 	    ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
 	    return;
 	}
@@ -5094,6 +5657,7 @@ ml_updatechunk(buf, line, len, updtype)
 	     */
 	    curchnk = buf->b_ml.ml_chunksize + curix + 1;
 	    buf->b_ml.ml_usedchunks++;
+	    buf->b_ml.ml_chunktree = FALSE;
 	    if (line == buf->b_ml.ml_line_count)
 	    {
 		curchnk->mlcs_numlines = 0;
@@ -5139,6 +5703,7 @@ ml_updatechunk(buf, line, len, updtype)
 	else if (curix == 0 && curchnk->mlcs_numlines <= 0)
 	{
 	    buf->b_ml.ml_usedchunks--;
+	    buf->b_ml.ml_chunktree = FALSE;
 	    mch_memmove(buf->b_ml.ml_chunksize, buf->b_ml.ml_chunksize + 1,
 			buf->b_ml.ml_usedchunks * sizeof(chunksize_T));
 	    return;
@@ -5154,6 +5719,7 @@ ml_updatechunk(buf, line, len, updtype)
 	curchnk[-1].mlcs_numlines += curchnk->mlcs_numlines;
 	curchnk[-1].mlcs_totalsize += curchnk->mlcs_totalsize;
 	buf->b_ml.ml_usedchunks--;
+	buf->b_ml.ml_chunktree = FALSE;
 	if (curix < buf->b_ml.ml_usedchunks)
 	{
 	    mch_memmove(buf->b_ml.ml_chunksize + curix,
@@ -5169,6 +5735,72 @@ ml_updatechunk(buf, line, len, updtype)
     ml_upd_lastcurix = curix;
 }
 
+/*
+ * Like ml_updatechunk() with ML_CHNK_ADDLINE for "count" lines at once.  The
+ * lines starting at "line" must already be in the buffer, "len" is their
+ * total size.
+ */
+    static void
+ml_updatechunk_lines(buf, line, count, len)
+    buf_T	*buf;
+    long	line;
+    long	count;
+    long	len;
+{
+    linenr_T	curline;
+    int		curix;
+
+    if (count == 1)
+    {
+	ml_updatechunk(buf, line, len, ML_CHNK_ADDLINE);
+	return;
+    }
+    if (buf->b_ml.ml_usedchunks == -1 || ml_chunk_init(buf) == FAIL)
+	return;
+    ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
+
+    curix = ml_find_chunk(buf, (linenr_T)line, 0L, FALSE, &curline, NULL);
+    buf->b_ml.ml_chunksize[curix].mlcs_numlines += count;
+    buf->b_ml.ml_chunksize[curix].mlcs_totalsize += len;
+    ml_chunktree_add(buf, curix, count, len);
+
+    /* Split off chunks of MLCS_MINL lines until the rest is small enough. */
+    while (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL)
+    {
+	if (buf->b_ml.ml_usedchunks + 1 >= buf->b_ml.ml_numchunks)
+	{
+	    buf->b_ml.ml_numchunks = buf->b_ml.ml_numchunks * 3 / 2;
+	    buf->b_ml.ml_chunksize = (chunksize_T *)
+		vim_realloc(buf->b_ml.ml_chunksize,
+			    sizeof(chunksize_T) * buf->b_ml.ml_numchunks);
+	    if (buf->b_ml.ml_chunksize == NULL)
+	    {
+		buf->b_ml.ml_usedchunks = -1;
+		return;
+	    }
+	}
+	if (ml_splitchunk(buf, curix, curline) == FAIL)
+	{
+	    buf->b_ml.ml_usedchunks = -1;
+	    return;
+	}
+	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+	++curix;
+    }
+}
+
+/*
+ * Offset of the text of line "i" in the data block "dp".  For a group of
+ * lines that is still in the mapped file the offsets in "mapidx" are turned
+ * around, so that they count down from the end like in a data block.
+ */
+#ifdef FEAT_MMAP
+# define LINE_OFF(i) (mapidx != NULL ? mapidx[count] - mapidx[(i) + 1] \
+				     : (int)((dp->db_index[i]) & DB_INDEX_MASK))
+#else
+# define LINE_OFF(i) ((int)((dp->db_index[i]) & DB_INDEX_MASK))
+#endif
+
 /*
  * Find offset for line or line with offset.
  * Find line with offset if "lnum" is 0; return remaining offset in offp
@@ -5182,10 +5814,9 @@ ml_find_line_or_offset(buf, lnum, offp)
     long	*offp;
 {
     linenr_T	curline;
-    int		curix;
     long	size;
     bhdr_T	*hp;
-    DATA_BL	*dp;
+    DATA_BL	*dp = NULL;
     int		count;		/* number of entries in block */
     int		idx;
     int		start_idx;
@@ -5194,6 +5825,11 @@ ml_find_line_or_offset(buf, lnum, offp)
     int		len;
     int		ffdos = (get_fileformat(buf) == EOL_DOS);
     int		extra = 0;
+    linenr_T	low, high;
+#ifdef FEAT_MMAP
+    mlmap_T	*mm;
+    int		*mapidx;
+#endif
 
     /* take care of cached line first */
     ml_flush_line(curbuf);
@@ -5210,38 +5846,69 @@ ml_find_line_or_offset(buf, lnum, offp)
     if (lnum == 0 && offset <= 0)
 	return 1;   /* Not a "find offset" and offset 0 _must_ be in line 1 */
     /*
-     * Find the last chunk before the one containing our line. Last chunk is
-     * special because it will never qualify
+     * Find the chunk containing our line.
      */
-    curline = 1;
-    curix = size = 0;
-    while (curix < buf->b_ml.ml_usedchunks - 1
-	    && ((lnum != 0
-	     && lnum >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
-		|| (offset != 0
-	       && offset > size + buf->b_ml.ml_chunksize[curix].mlcs_totalsize
-		      + ffdos * buf->b_ml.ml_chunksize[curix].mlcs_numlines)))
-    {
-	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	size += buf->b_ml.ml_chunksize[curix].mlcs_totalsize;
-	if (offset && ffdos)
-	    size += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	curix++;
-    }
+    (void)ml_find_chunk(buf, lnum, offset, ffdos, &curline, &size);
+    if (offset && ffdos)
+	size += curline - 1;
 
     while ((lnum != 0 && curline < lnum) || (offset != 0 && size < offset))
     {
-	if (curline > buf->b_ml.ml_line_count
-		|| (hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
+	if (curline > buf->b_ml.ml_line_count)
 	    return -1;
-	dp = (DATA_BL *)(hp->bh_data);
-	count = (long)(buf->b_ml.ml_locked_high) -
-		(long)(buf->b_ml.ml_locked_low) + 1;
-	start_idx = idx = curline - buf->b_ml.ml_locked_low;
+#ifdef FEAT_MMAP
+	/* Don't copy lines that are still in the mapped file, only their
+	 * length is needed. */
+	mapidx = NULL;
+	hp = NULL;
+	mm = buf->b_ml.ml_map;
+	if (mm != NULL && mm->mm_addr != NULL && !mm->mm_changed)
+	{
+	    mm->mm_hit_low = 0;
+	    hp = ml_find_line(buf, curline, ML_PEEK);
+	    if (hp == NULL && mm->mm_hit_low != 0)
+	    {
+		if (ml_map_decode(mm, mm->mm_hit_start, mm->mm_hit_count)
+									== OK)
+		    mapidx = mm->mm_index;
+		else if (!mm->mm_changed)
+		    return -1;
+	    }
+	}
+	/* When the file was changed copy what is still in it right away. */
+	if (mm != NULL && mm->mm_changed && mm->mm_addr != NULL)
+	    (void)ml_unmap(buf);
+	if (hp == NULL && mapidx == NULL)
+	    hp = ml_find_line(buf, curline, ML_FIND);
+	if (mapidx != NULL)
+	{
+	    low = mm->mm_hit_low;
+	    high = low + mm->mm_hit_count - 1;
+	}
+	else
+#else
+	hp = ml_find_line(buf, curline, ML_FIND);
+#endif
+	{
+	    if (hp == NULL)
+		return -1;
+	    dp = (DATA_BL *)(hp->bh_data);
+	    low = buf->b_ml.ml_locked_low;
+	    high = buf->b_ml.ml_locked_high;
+	}
+	count = (long)high - (long)low + 1;
+	start_idx = idx = curline - low;
 	if (idx == 0)/* first line in block, text at the end */
-	    text_end = dp->db_txt_end;
+	{
+#ifdef FEAT_MMAP
+	    if (mapidx != NULL)
+		text_end = mapidx[count];
+	    else
+#endif
+		text_end = dp->db_txt_end;
+	}
 	else
-	    text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
+	    text_end = LINE_OFF(idx - 1);
 	/* Compute index of last line to use in this MEMLINE */
 	if (lnum != 0)
 	{
@@ -5253,9 +5920,7 @@ ml_find_line_or_offset(buf, lnum, offp)
 	else
 	{
 	    extra = 0;
-	    while (offset >= size
-		       + text_end - (int)((dp->db_index[idx]) & DB_INDEX_MASK)
-								      + ffdos)
+	    while (offset >= size + text_end - LINE_OFF(idx) + ffdos)
 	    {
 		if (ffdos)
 		    size++;
@@ -5267,7 +5932,7 @@ ml_find_line_or_offset(buf, lnum, offp)
 		idx++;
 	    }
 	}
-	len = text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
+	len = text_end - LINE_OFF(idx);
 	size += len;
 	if (offset != 0 && size >= offset)
 	{
@@ -5277,13 +5942,13 @@ ml_find_line_or_offset(buf, lnum, offp)
 		*offp = offset - size + len;
 	    else
 		*offp = offset - size + len
-		     - (text_end - ((dp->db_index[idx - 1]) & DB_INDEX_MASK));
+				       - (text_end - LINE_OFF(idx - 1));
 	    curline += idx - start_idx + extra;
 	    if (curline > buf->b_ml.ml_line_count)
 		return -1;	/* exactly one byte beyond the end */
 	    return curline;
 	}
-	curline = buf->b_ml.ml_locked_high + 1;
+	curline = high + 1;
     }
 
     if (lnum != 0)
@@ -5339,3 +6004,624 @@ goto_byte(cnt)
 # endif
 }
 #endif
+
+#if defined(FEAT_MMAP) || defined(PROTO)
+/*
+ * Map the file "fd" into memory for the empty buffer "buf", instead of
+ * reading its lines.  "ptr[size]" is the start of the file as it was read,
+ * the mapping is only used when it's the same.
+ * "*ffp" is the fileformat, EOL_UNIX or EOL_DOS.  When not all lines end in
+ * CR-NL and "try_unix" is TRUE it's changed to EOL_UNIX.
+ * "*no_eolp" is set to TRUE when the last line doesn't end in a NL.
+ * The lines are put in groups that each fit in a data block, in the pointer
+ * blocks they are entries with a zero page count and the offset of the group
+ * in the file instead of the block number.  The text of a group is copied
+ * into a data block only when it is changed.
+ * Return FAIL when the file can't be mapped, nothing was changed then.
+ */
+    int
+ml_map_file(buf, fd, ptr, size, ffp, try_unix, no_eolp)
+    buf_T	*buf;
+    int		fd;
+    char_u	*ptr;
+    long	size;
+    int		*ffp;
+    int		try_unix;
+    int		*no_eolp;
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    struct stat	st;
+    mlmap_T	*mm = NULL;
+    char_u	*addr = NULL;
+    char_u	*end;
+    char_u	*s, *e, *p;
+    long	len;
+    long	room;
+    long	group_size = 0;
+    int		group_count = 0;
+    long	group_start = 0;
+    long	groups = 0;
+    linenr_T	lnum = 0;
+    int		ffdos = (*ffp == EOL_DOS);
+    int		no_eol = FALSE;
+    int		fd_dup;
+    garray_T	ga;
+    garray_T	ga_up;
+    PTR_EN	*pe;
+    bhdr_T	*hp;
+    PTR_BL	*pp;
+    int		max;
+    int		per;
+    int		i, j;
+#ifdef FEAT_BYTEOFF
+    garray_T	ga_chunk;
+    chunksize_T	*chunk = NULL;
+#endif
+
+    if (mfp == NULL || buf->b_ml.ml_map != NULL
+	    || !(buf->b_ml.ml_flags & ML_EMPTY)
+	    || buf->b_ml.ml_line_count != 1)
+	return FAIL;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+	    || st.st_size < (off_t)p_mms * 1024
+	    || st.st_size < (off_t)size
+	    || (off_t)(size_t)st.st_size != st.st_size
+	    || (off_t)(long)st.st_size != st.st_size)
+	return FAIL;
+    if ((mm = (mlmap_T *)alloc_clear((unsigned)sizeof(mlmap_T))) == NULL)
+	return FAIL;
+    /* Keep the file open to be able to check that it didn't change, "fd" is
+     * closed when done reading. */
+    if ((fd_dup = dup(fd)) < 0)
+    {
+	vim_free(mm);
+	return FAIL;
+    }
+# ifdef HAVE_FD_CLOEXEC
+    {
+	int fdflags = fcntl(fd_dup, F_GETFD);
+	if (fdflags >= 0 && (fdflags & FD_CLOEXEC) == 0)
+	    fcntl(fd_dup, F_SETFD, fdflags | FD_CLOEXEC);
+    }
+# endif
+    addr = (char_u *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+								 fd, (off_t)0);
+    if ((void *)addr == MAP_FAILED)
+    {
+	close(fd_dup);
+	vim_free(mm);
+	return FAIL;
+    }
+    end = addr + st.st_size;
+    ga_init2(&ga, (int)sizeof(PTR_EN), 100);
+    ga_init2(&ga_up, (int)sizeof(PTR_EN), 10);
+#ifdef FEAT_BYTEOFF
+    ga_init2(&ga_chunk, (int)sizeof(chunksize_T), 100);
+#endif
+
+    /* What was read must not have been changed, e.g. by removing a BOM. */
+    if (memcmp(addr, ptr, (size_t)size) != 0)
+	goto fail;
+
+    /*
+     * Find the lines and put them in groups.  This is the only time the
+     * whole file is accessed.
+     */
+    room = mfp->mf_page_size - HEADER_SIZE;
+retry:
+    for (s = addr; s < end; s = e + 1)
+    {
+	e = (char_u *)memchr(s, NL, (size_t)(end - s));
+	if (e == NULL)
+	{
+	    e = end;
+	    /* In Dos format a trailing CTRL-Z is ignored, unless 'binary'
+	     * set. */
+	    if (ffdos && !buf->b_p_bin && e == s + 1 && *s == Ctrl_Z)
+		break;
+	    no_eol = TRUE;
+	}
+	len = (long)(e - s);
+	if (ffdos && e < end)
+	{
+	    if (len > 0 && e[-1] == CAR)
+		--len;
+	    else if (try_unix)
+	    {
+		/* Not all lines end in CR-NL: start all over in Unix
+		 * format. */
+		ffdos = FALSE;
+		lnum = 0;
+		groups = 0;
+		group_count = 0;
+		group_size = 0;
+		ga.ga_len = 0;
+#ifdef FEAT_BYTEOFF
+		ga_chunk.ga_len = 0;
+#endif
+		goto retry;
+	    }
+	    else
+		goto fail;
+	}
+#ifdef FEAT_MBYTE
+	/* Lines with illegal bytes are handled when reading. */
+	if (enc_utf8 && !buf->b_p_bin)
+	    for (p = s; p < s + len; ++p)
+		if (*p >= 0x80)
+		{
+		    i = utf_ptr2len_len(p, (int)(s + len - p));
+		    if (i == 1 || i > s + len - p)
+			goto fail;
+		    p += i - 1;
+		}
+#endif
+
+	if (group_count > 0 && group_size + len + 1 + (long)INDEX_SIZE > room)
+	{
+	    if (ga_grow(&ga, 1) == FAIL)
+		goto fail;
+	    pe = (PTR_EN *)ga.ga_data + ga.ga_len++;
+	    pe->pe_bnum = (blocknr_T)group_start;
+	    pe->pe_line_count = group_count;
+	    pe->pe_old_lnum = lnum - group_count + 1;
+	    pe->pe_page_count = 0;
+	    ++groups;
+	    group_count = 0;
+	    group_size = 0;
+	}
+	if (group_count == 0)
+	    group_start = (long)(s - addr);
+	group_size += len + 1 + (long)INDEX_SIZE;
+	++group_count;
+	++lnum;
+
+#ifdef FEAT_BYTEOFF
+	if (ga_chunk.ga_len == 0 || chunk->mlcs_numlines >= MLCS_MINL)
+	{
+	    if (ga_grow(&ga_chunk, 1) == FAIL)
+		goto fail;
+	    chunk = (chunksize_T *)ga_chunk.ga_data + ga_chunk.ga_len++;
+	    chunk->mlcs_numlines = 0;
+	    chunk->mlcs_totalsize = 0;
+	}
+	else
+	    chunk = (chunksize_T *)ga_chunk.ga_data + ga_chunk.ga_len - 1;
+	++chunk->mlcs_numlines;
+	chunk->mlcs_totalsize += len + 1;
+#endif
+	if (e == end)
+	    break;
+	line_breakcheck();
+	if (got_int)
+	    goto fail;
+    }
+    if (lnum == 0 || ga_grow(&ga, 2) == FAIL)
+	goto fail;
+    pe = (PTR_EN *)ga.ga_data + ga.ga_len++;
+    pe->pe_bnum = (blocknr_T)group_start;
+    pe->pe_line_count = group_count;
+    pe->pe_old_lnum = lnum - group_count + 1;
+    pe->pe_page_count = 0;
+    ++groups;
+
+    /*
+     * The empty line of the buffer comes last, it's deleted by readfile().
+     */
+    ml_flush_line(buf);
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+    buf->b_ml.ml_stack_top = 0;
+    if ((hp = mf_get(mfp, (blocknr_T)1, 1)) == NULL)
+	goto fail;
+    pp = (PTR_BL *)(hp->bh_data);
+    if (pp->pb_id != PTR_ID || pp->pb_count != 1)
+    {
+	mf_put(mfp, hp, FALSE, FALSE);
+	goto fail;
+    }
+    pe = (PTR_EN *)ga.ga_data + ga.ga_len++;
+    *pe = pp->pb_pointer[0];
+    pe->pe_old_lnum = lnum + 1;
+
+    /*
+     * Put the entries in pointer blocks, one level at a time, until they
+     * fit in the root block.  The entries are spread evenly over the
+     * blocks.
+     */
+    max = pp->pb_count_max;
+    while (ga.ga_len > max)
+    {
+	ga_up.ga_len = 0;
+	i = (ga.ga_len + max - 1) / max;
+	per = (ga.ga_len + i - 1) / i;
+	for (i = 0; i < ga.ga_len; i += per)
+	{
+	    bhdr_T	*hp2;
+	    PTR_BL	*pp2;
+
+	    if (ga_grow(&ga_up, 1) == FAIL
+				       || (hp2 = ml_new_ptr(mfp)) == NULL)
+	    {
+		/* The blocks made so far are not used, they are freed when
+		 * the memfile is closed. */
+		mf_put(mfp, hp, FALSE, FALSE);
+		goto fail;
+	    }
+	    pp2 = (PTR_BL *)(hp2->bh_data);
+	    pe = (PTR_EN *)ga_up.ga_data + ga_up.ga_len++;
+	    pe->pe_bnum = hp2->bh_bnum;
+	    pe->pe_line_count = 0;
+	    pe->pe_old_lnum = ((PTR_EN *)ga.ga_data)[i].pe_old_lnum;
+	    pe->pe_page_count = 1;
+	    for (j = 0; j < per && i + j < ga.ga_len; ++j)
+	    {
+		pp2->pb_pointer[j] = ((PTR_EN *)ga.ga_data)[i + j];
+		pe->pe_line_count += pp2->pb_pointer[j].pe_line_count;
+	    }
+	    pp2->pb_count = j;
+	    mf_put(mfp, hp2, TRUE, FALSE);
+	}
+	ga_clear(&ga);
+	ga = ga_up;
+	ga_init2(&ga_up, (int)sizeof(PTR_EN), 10);
+    }
+    mch_memmove(pp->pb_pointer, ga.ga_data, ga.ga_len * sizeof(PTR_EN));
+    pp->pb_count = ga.ga_len;
+    mf_put(mfp, hp, TRUE, FALSE);
+    ga_clear(&ga);
+
+    mm->mm_addr = addr;
+    mm->mm_size = (size_t)st.st_size;
+    mm->mm_fd = fd_dup;
+    mm->mm_mtime = (long)st.st_mtime;
+    mm->mm_mtime_ns = ST_MTIME_NS(st);
+    mm->mm_avail = mm->mm_size;
+# ifdef UNIX
+    mm->mm_dev = st.st_dev;
+    mm->mm_ino = st.st_ino;
+# endif
+    mm->mm_ffdos = ffdos;
+    mm->mm_groups = groups;
+    mm->mm_text_start = -1;
+    buf->b_ml.ml_map = mm;
+    buf->b_ml.ml_line_count = lnum + 1;
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+
+#ifdef FEAT_BYTEOFF
+    /* The chunks are filled already, add the empty line to the last one. */
+    chunk = (chunksize_T *)ga_chunk.ga_data + ga_chunk.ga_len - 1;
+    ++chunk->mlcs_numlines;
+    ++chunk->mlcs_totalsize;
+    vim_free(buf->b_ml.ml_chunksize);
+    buf->b_ml.ml_chunksize = (chunksize_T *)ga_chunk.ga_data;
+    buf->b_ml.ml_numchunks = ga_chunk.ga_maxlen;
+    buf->b_ml.ml_usedchunks = ga_chunk.ga_len;
+    ml_upd_lastbuf = NULL;
+#endif
+
+    *ffp = ffdos ? EOL_DOS : EOL_UNIX;
+    *no_eolp = no_eol;
+    return OK;
+
+fail:
+    ga_clear(&ga);
+    ga_clear(&ga_up);
+#ifdef FEAT_BYTEOFF
+    ga_clear(&ga_chunk);
+#endif
+    munmap((void *)addr, (size_t)st.st_size);
+    close(fd_dup);
+    vim_free(mm);
+    return FAIL;
+}
+
+/*
+ * Copy all lines that are still in the mapped file of "buf" into the
+ * memfile, and unmap the file.  Needed before the file is overwritten and
+ * when it was changed by another program.
+ * Returns FAIL when some lines could not be copied, the file is still mapped
+ * then.
+ */
+    int
+ml_unmap(buf)
+    buf_T	*buf;
+{
+    mlmap_T	*mm = buf->b_ml.ml_map;
+    linenr_T	lnum;
+
+    if (mm == NULL || mm->mm_addr == NULL)
+	return OK;
+    ml_flush_line(buf);
+    for (lnum = 1; lnum <= buf->b_ml.ml_line_count && mm->mm_addr != NULL;
+					   lnum = buf->b_ml.ml_locked_high + 1)
+	if (ml_find_line(buf, lnum, ML_FIND) == NULL)
+	    return FAIL;
+    return OK;
+}
+
+/*
+ * Return TRUE if "fname" is the file that is mapped for "buf".
+ */
+    int
+ml_map_same_file(buf, fname)
+    buf_T	*buf;
+    char_u	*fname;
+{
+    mlmap_T	*mm = buf->b_ml.ml_map;
+# ifdef UNIX
+    struct stat	st;
+# endif
+
+    if (mm == NULL || mm->mm_addr == NULL)
+	return FALSE;
+# ifdef UNIX
+    if (mch_stat((char *)fname, &st) < 0)
+	return FALSE;
+    return (st.st_dev == mm->mm_dev && st.st_ino == mm->mm_ino);
+# else
+    /* can't tell, assume it is */
+    return TRUE;
+# endif
+}
+#endif
+
+#ifdef FEAT_MMAP
+/*
+ * Unmap the file of "buf".  The last decoded group in mm_text stays, the
+ * cached line may point into it.
+ */
+    static void
+ml_map_release(buf)
+    buf_T	*buf;
+{
+    mlmap_T	*mm = buf->b_ml.ml_map;
+
+    if (mm->mm_addr != NULL)
+    {
+	munmap((void *)mm->mm_addr, mm->mm_size);
+	mm->mm_addr = NULL;
+	close(mm->mm_fd);
+    }
+}
+
+/*
+ * Check that the file mapped for "mm" was not truncated or changed by
+ * another program, accessing the mapping beyond the end of the file could
+ * crash Vim.  When it was changed "mm_changed" is set and only the part that
+ * is still in the file is used, the caller must then copy the remaining
+ * lines with ml_unmap() as soon as possible.  When the file only grew, lines
+ * were probably appended, the mapped text is still there.
+ * Returns FAIL when the file is not mapped or was changed.
+ */
+    static int
+ml_map_check(mm)
+    mlmap_T	*mm;
+{
+    struct stat	st;
+
+    if (mm->mm_addr == NULL || mm->mm_changed)
+	return FAIL;
+    if (fstat(mm->mm_fd, &st) < 0)
+    {
+	mm->mm_avail = 0;
+	mm->mm_damaged = TRUE;
+    }
+    else if ((off_t)mm->mm_size == st.st_size
+	    && mm->mm_mtime == (long)st.st_mtime
+	    && mm->mm_mtime_ns == ST_MTIME_NS(st))
+	return OK;
+    else if ((off_t)mm->mm_size >= st.st_size)
+    {
+	if ((off_t)mm->mm_size > st.st_size)
+	    mm->mm_avail = (size_t)st.st_size;
+	mm->mm_damaged = TRUE;
+    }
+    mm->mm_changed = TRUE;
+    return FAIL;
+}
+
+/*
+ * Called when the mapped file of "buf" was changed by another program while
+ * lines were still in it, their text may be lost or different from what was
+ * read.  Mark the buffer as modified and require "!" to overwrite the file,
+ * like after a read error.
+ */
+    static void
+ml_map_damaged(buf)
+    buf_T	*buf;
+{
+    buf->b_flags |= BF_READERR;
+    buf->b_changed = TRUE;
+    ml_setflags(buf);
+#ifdef FEAT_WINDOWS
+    check_status(buf);
+    redraw_tabline = TRUE;
+#endif
+#ifdef FEAT_TITLE
+    need_maketitle = TRUE;
+#endif
+    EMSG2(_("E887: File was changed while mapped, text may be lost: %s"),
+								 buf->b_fname);
+}
+
+/*
+ * Get the line at "*pp" in the mapped file "mm".  Return a pointer to its
+ * text, set "*lenp" to its length without the line break and advance "*pp"
+ * to the next line.
+ */
+    static char_u *
+ml_map_next(mm, pp, lenp)
+    mlmap_T	*mm;
+    char_u	**pp;
+    int		*lenp;
+{
+    char_u	*s = *pp;
+    char_u	*end = mm->mm_addr + mm->mm_avail;
+    char_u	*e;
+
+    if (s >= end)
+    {
+	/* The file was truncated, the line is lost. */
+	*lenp = 0;
+	return (char_u *)"";
+    }
+    e = (char_u *)memchr(s, NL, (size_t)(end - s));
+    if (e == NULL)
+	e = *pp = end;
+    else
+    {
+	*pp = e + 1;
+	if (mm->mm_ffdos && e > s && e[-1] == CAR)
+	    --e;
+    }
+    *lenp = (int)(e - s);
+    return s;
+}
+
+/*
+ * Copy the "len" bytes of a line at "s" to "d" and NUL terminate it.  NULs
+ * are replaced by newlines, like when reading the file.
+ */
+    static void
+ml_map_line_copy(d, s, len)
+    char_u	*d;
+    char_u	*s;
+    int		len;
+{
+    char_u	*p;
+
+    mch_memmove(d, s, (size_t)len);
+    d[len] = NUL;
+    for (p = d; (p = (char_u *)memchr(p, NUL, (size_t)(d + len - p)))
+								!= NULL; ++p)
+	*p = NL;
+}
+
+/*
+ * Make the "count" lines of the group at offset "start" of the mapped file
+ * available in mm_text[], with mm_index[] the start of each line.
+ */
+    static int
+ml_map_decode(mm, start, count)
+    mlmap_T	*mm;
+    long	start;
+    int		count;
+{
+    char_u	*p;
+    char_u	*s;
+    int		len;
+    long	size = 0;
+    int		i;
+
+    if (mm->mm_text_start == start && mm->mm_text_count == count)
+	return OK;
+    if (ml_map_check(mm) == FAIL)
+	return FAIL;
+    mm->mm_text_start = -1;
+
+    if (count + 1 > mm->mm_index_size)
+    {
+	vim_free(mm->mm_index);
+	mm->mm_index = (int *)alloc((unsigned)((count + 1) * sizeof(int)));
+	if (mm->mm_index == NULL)
+	{
+	    mm->mm_index_size = 0;
+	    return FAIL;
+	}
+	mm->mm_index_size = count + 1;
+    }
+    p = mm->mm_addr + start;
+    for (i = 0; i < count; ++i)
+    {
+	(void)ml_map_next(mm, &p, &len);
+	mm->mm_index[i] = size;
+	size += len + 1;
+    }
+    mm->mm_index[count] = size;
+
+    if (size > mm->mm_text_size)
+    {
+	vim_free(mm->mm_text);
+	mm->mm_text = alloc((unsigned)size);
+	if (mm->mm_text == NULL)
+	{
+	    mm->mm_text_size = 0;
+	    return FAIL;
+	}
+	mm->mm_text_size = size;
+    }
+    p = mm->mm_addr + start;
+    for (i = 0; i < count; ++i)
+    {
+	s = ml_map_next(mm, &p, &len);
+	ml_map_line_copy(mm->mm_text + mm->mm_index[i], s, len);
+    }
+    mm->mm_text_start = start;
+    mm->mm_text_count = count;
+    return OK;
+}
+
+/*
+ * Copy the "count" lines of the group at offset "start" of the mapped file
+ * of "buf" into a new data block, with a negative block number like a block
+ * filled when reading a file.  When it's the last group the file is
+ * unmapped.
+ * Returns the block number and sets "*page_countp", returns zero for
+ * failure.
+ */
+    static blocknr_T
+ml_map_copy(buf, start, count, page_countp)
+    buf_T	*buf;
+    long	start;
+    int		count;
+    int		*page_countp;
+{
+    mlmap_T	*mm = buf->b_ml.ml_map;
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    blocknr_T	bnum;
+    char_u	*p;
+    char_u	*s;
+    int		len;
+    long	size = HEADER_SIZE;
+    int		page_count;
+    int		i;
+
+    if (mm == NULL || mm->mm_addr == NULL)
+	return 0;
+    /* When the file was changed only what is still in it is used. */
+    (void)ml_map_check(mm);
+    p = mm->mm_addr + start;
+    for (i = 0; i < count; ++i)
+    {
+	(void)ml_map_next(mm, &p, &len);
+	size += len + 1 + (long)INDEX_SIZE;
+    }
+    page_count = (size + mfp->mf_page_size - 1) / mfp->mf_page_size;
+    if ((hp = ml_new_data(mfp, TRUE, page_count)) == NULL)
+	return 0;
+    dp = (DATA_BL *)(hp->bh_data);
+    p = mm->mm_addr + start;
+    for (i = 0; i < count; ++i)
+    {
+	s = ml_map_next(mm, &p, &len);
+	dp->db_txt_start -= len + 1;
+	dp->db_index[i] = dp->db_txt_start;
+	ml_map_line_copy((char_u *)dp + dp->db_txt_start, s, len);
+    }
+    dp->db_free -= size - HEADER_SIZE;
+    dp->db_line_count = count;
+    bnum = hp->bh_bnum;
+    mf_put(mfp, hp, TRUE, FALSE);
+
+    if (--mm->mm_groups == 0)
+    {
+	ml_map_release(buf);
+	if (mm->mm_damaged)
+	    ml_map_damaged(buf);
+    }
+    *page_countp = page_count;
+    return bnum;
+}
+#endif
@@ -2152,16 +2152,24 @@ ins_char_bytes(buf, charlen)
     int		charlen;
 {
     int		c = buf[0];
+#else
+    char_u	buf[2];
+    int		charlen = 1;
 #endif
     int		newlen;		/* nr of bytes inserted */
     int		oldlen;		/* nr of bytes deleted (0 when not replacing) */
     char_u	*p;
     char_u	*newp;
     char_u	*oldp;
-    int		linelen;	/* length of old line including NUL */
     colnr_T	col;
     linenr_T	lnum = curwin->w_cursor.lnum;
     int		i;
+    int		r;
+
+#ifndef FEAT_MBYTE
+    buf[0] = c;
+    buf[1] = NUL;
+#endif
 
 #ifdef FEAT_VIRTUALEDIT
     /* Break tabs if needed. */
@@ -2171,7 +2179,6 @@ ins_char_bytes(buf, charlen)
 
     col = curwin->w_cursor.col;
     oldp = ml_get(lnum);
-    linelen = (int)STRLEN(oldp) + 1;
 
     /* The lengths default to the values for when not replacing. */
     oldlen = 0;
@@ -2189,9 +2196,6 @@ ins_char_bytes(buf, charlen)
 	    colnr_T	new_vcol = 0;   /* init for GCC */
 	    colnr_T	vcol;
 	    int		old_list;
-#ifndef FEAT_MBYTE
-	    char_u	buf[2];
-#endif
 
 	    /*
 	     * Disable 'list' temporarily, unless 'cpo' contains the 'L' flag.
@@ -2209,10 +2213,6 @@ ins_char_bytes(buf, charlen)
 	     * cells.  May result in adding spaces to fill a gap.
 	     */
 	    getvcol(curwin, &curwin->w_cursor, NULL, &vcol, NULL);
-#ifndef FEAT_MBYTE
-	    buf[0] = c;
-	    buf[1] = NUL;
-#endif
 	    new_vcol = vcol + chartabsize(buf, vcol);
 	    while (oldp[col + oldlen] != NUL && vcol < new_vcol)
 	    {
@@ -2261,34 +2261,25 @@ ins_char_bytes(buf, charlen)
 	}
     }
 
-    newp = alloc_check((unsigned)(linelen + newlen - oldlen));
-    if (newp == NULL)
-	return;
-
-    /* Copy bytes before the cursor. */
-    if (col > 0)
-	mch_memmove(newp, oldp, (size_t)col);
-
-    /* Copy bytes after the changed character(s). */
-    p = newp + col;
-    mch_memmove(p + newlen, oldp + col + oldlen,
-					    (size_t)(linelen - col - oldlen));
-
-    /* Insert or overwrite the new character. */
-#ifdef FEAT_MBYTE
-    mch_memmove(p, buf, charlen);
-    i = charlen;
-#else
-    *p = c;
-    i = 1;
-#endif
-
     /* Fill with spaces when necessary. */
-    while (i < newlen)
-	p[i++] = ' ';
+    newp = NULL;
+    p = buf;
+    if (newlen > charlen)
+    {
+	newp = alloc_check((unsigned)newlen);
+	if (newp == NULL)
+	    return;
+	mch_memmove(newp, buf, (size_t)charlen);
+	for (i = charlen; i < newlen; ++i)
+	    newp[i] = ' ';
+	p = newp;
+    }
 
-    /* Replace the line in the buffer. */
-    ml_replace(lnum, newp, FALSE);
+    /* Insert or overwrite the new character in the line. */
+    r = ml_replace_bytes(lnum, col, oldlen, p, newlen);
+    vim_free(newp);
+    if (r == FAIL)
+	return;
 
     /* mark the buffer as changed and prepare for displaying */
     changed_bytes(lnum, col);
@@ -2337,9 +2328,7 @@ ins_char_bytes(buf, charlen)
 ins_str(s)
     char_u	*s;
 {
-    char_u	*oldp, *newp;
     int		newlen = (int)STRLEN(s);
-    int		oldlen;
     colnr_T	col;
     linenr_T	lnum = curwin->w_cursor.lnum;
 
@@ -2349,17 +2338,8 @@ ins_str(s)
 #endif
 
     col = curwin->w_cursor.col;
-    oldp = ml_get(lnum);
-    oldlen = (int)STRLEN(oldp);
-
-    newp = alloc_check((unsigned)(oldlen + newlen + 1));
-    if (newp == NULL)
+    if (ml_replace_bytes(lnum, col, 0, s, newlen) == FAIL)
 	return;
-    if (col > 0)
-	mch_memmove(newp, oldp, (size_t)col);
-    mch_memmove(newp + col, s, (size_t)newlen);
-    mch_memmove(newp + col + newlen, oldp + col, (size_t)(oldlen - col + 1));
-    ml_replace(lnum, newp, FALSE);
     changed_bytes(lnum, col);
     curwin->w_cursor.col += newlen;
 }
@@ -2967,6 +2947,9 @@ changed_common(lnum, col, lnume, xtra)
     /* mark the buffer as modified */
     changed();
 
+    /* forget the virtual columns after the change */
+    vcol_cache_changed(curbuf, lnum, col, lnume + xtra);
+
     /* set the '. mark */
     if (!cmdmod.keepjumps)
     {
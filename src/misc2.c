@@ -954,6 +954,7 @@ lalloc(size, message)
 	try_again = mf_release_all(); /* release as many blocks as possible */
 #ifdef FEAT_EVAL
 	try_again |= garbage_collect(); /* cleanup recursive lists/dicts */
+	try_again |= eval_free_cache(); /* free kept lists/dicts */
 #endif
 
 	releasing = FALSE;
@@ -1191,6 +1192,9 @@ free_all_mem()
 
     /* highlight info */
     free_highlight();
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+    syn_cache_clear();
+#endif
 
     reset_last_sourcing();
 
@@ -1214,6 +1218,7 @@ free_all_mem()
 # endif
 
     free_termoptions();
+    out_buf_free();
 
     /* screenlines (can't display anything now!) */
     free_screenlines();
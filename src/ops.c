@@ -3844,6 +3844,18 @@ do_put(regname, dir, count, flags)
 		    i = 1;
 		}
 
+		if (!(flags & PUT_FIXINDENT))
+		{
+		    /* Append all lines at once, for MCHAR the last one was
+		     * inserted above already. */
+		    if (ml_append_lines(lnum, y_array + i, NULL,
+				     (long)(y_size - i - (y_type == MCHAR)),
+							      FALSE) == FAIL)
+			goto error;
+		    lnum += y_size - i;
+		    nr_lines += y_size - i;
+		    i = y_size;
+		}
 		for (; i < y_size; ++i)
 		{
 		    if ((y_type != MCHAR || i < y_size - 1)
@@ -1815,6 +1815,13 @@ static struct vimoption
 			    {(char_u *)0L, (char_u *)0L}
 #endif
 			    SCRIPTID_INIT},
+    {"mmapsize",    "mms",  P_NUM|P_VI_DEF,
+#ifdef FEAT_MMAP
+			    (char_u *)&p_mms, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
     {"modeline",    "ml",   P_BOOL|P_VIM,
 			    (char_u *)&p_ml, PV_ML,
 			    {(char_u *)FALSE, (char_u *)TRUE} SCRIPTID_INIT},
@@ -2093,6 +2100,9 @@ static struct vimoption
 			    (char_u *)NULL, PV_NONE,
 #endif
 			    {(char_u *)2000L, (char_u *)0L} SCRIPTID_INIT},
+    {"regexpcache", "rxc",  P_NUM|P_VI_DEF,
+			    (char_u *)&p_rxc, PV_NONE,
+			    {(char_u *)50L, (char_u *)0L} SCRIPTID_INIT},
     {"regexpengine", "re",  P_NUM|P_VI_DEF,
 			    (char_u *)&p_re, PV_NONE,
 			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
@@ -2492,6 +2502,13 @@ static struct vimoption
 			    {(char_u *)0L, (char_u *)0L}
 #endif
 			    SCRIPTID_INIT},
+    {"syntaxcache", "sxc",  P_BOOL|P_VI_DEF,
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+			    (char_u *)&p_sxc, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
     {"tabline",	    "tal",  P_STRING|P_VI_DEF|P_RALL,
 #ifdef FEAT_STL_OPT
 			    (char_u *)&p_tal, PV_NONE,
@@ -2637,6 +2654,9 @@ static struct vimoption
     {"ttimeoutlen", "ttm",  P_NUM|P_VI_DEF,
 			    (char_u *)&p_ttm, PV_NONE,
 			    {(char_u *)-1L, (char_u *)0L} SCRIPTID_INIT},
+    {"ttybufsize",  "tbz",  P_NUM|P_VI_DEF,
+			    (char_u *)&p_tbz, PV_NONE,
+			    {(char_u *)65536L, (char_u *)0L} SCRIPTID_INIT},
     {"ttybuiltin",  "tbi",  P_BOOL|P_VI_DEF,
 			    (char_u *)&p_tbi, PV_NONE,
 			    {(char_u *)TRUE, (char_u *)0L} SCRIPTID_INIT},
@@ -2890,6 +2910,7 @@ static struct vimoption
     p_term("t_AL", T_CAL)
     p_term("t_al", T_AL)
     p_term("t_bc", T_BC)
+    p_term("t_BU", T_BU)
     p_term("t_cd", T_CD)
     p_term("t_ce", T_CE)
     p_term("t_cl", T_CL)
@@ -2903,9 +2924,12 @@ static struct vimoption
     p_term("t_ut", T_UT)
     p_term("t_da", T_DA)
     p_term("t_db", T_DB)
+    p_term("t_DC", T_CDC)
     p_term("t_DL", T_CDL)
+    p_term("t_EU", T_EU)
     p_term("t_dl", T_DL)
     p_term("t_fs", T_FS)
+    p_term("t_IC", T_CIC)
     p_term("t_IE", T_CIE)
     p_term("t_IS", T_CIS)
     p_term("t_ke", T_KE)
@@ -4965,6 +4989,13 @@ did_set_option(opt_idx, opt_flags, new_value)
 
     options[opt_idx].flags |= P_WAS_SET;
 
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+    /* A syntax file that sets a local option can't be cached. */
+    if ((options[opt_idx].indir & (PV_BUF | PV_WIN))
+					      && !(opt_flags & OPT_GLOBAL))
+	syn_cache_cancel();
+#endif
+
     /* When an option is set in the sandbox, from a modeline or in secure mode
      * set the P_INSECURE flag.  Otherwise, if a new value is stored reset the
      * flag. */
@@ -5938,6 +5969,8 @@ did_set_string_option(opt_idx, varp, new_value_alloced, oldval, errbuf,
 	    if (varp == &p_enc)
 	    {
 		errmsg = mb_init();
+		/* compiled patterns depend on the encoding */
+		vim_regcache_trim(0L);
 # ifdef FEAT_TITLE
 		redraw_titles();
 # endif
@@ -7743,6 +7776,15 @@ set_bool_option(opt_idx, varp, value, opt_flags)
 	paste_option_changed();
     }
 
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+    /* when 'syntaxcache' is reset forget the cached syntax files */
+    else if ((int *)varp == &p_sxc)
+    {
+	if (!p_sxc)
+	    syn_cache_clear();
+    }
+#endif
+
     /* when 'insertmode' is set from an autocommand need to do work here */
     else if ((int *)varp == &p_im)
     {
@@ -8466,6 +8508,34 @@ set_num_option(opt_idx, varp, value, errbuf, errbuflen, opt_flags)
 	curbuf->b_p_ul = value;
     }
 
+    /* drop cached patterns that no longer fit in 'regexpcache' */
+    else if (pp == &p_rxc)
+    {
+	if (p_rxc < 0)
+	{
+	    errmsg = e_positive;
+	    p_rxc = 0;
+	}
+	vim_regcache_trim(p_rxc);
+    }
+
+    /* 'ttybufsize' must fit in an int */
+    else if (pp == &p_tbz)
+    {
+	if (p_tbz < 0)
+	{
+	    errmsg = e_positive;
+	    p_tbz = 0;
+	}
+#if VIM_SIZEOF_INT < 4
+	if (p_tbz > 30000L)
+	    p_tbz = 30000L;
+#else
+	if (p_tbz > 10000000L)
+	    p_tbz = 10000000L;
+#endif
+    }
+
 #ifdef FEAT_LINEBREAK
     /* 'numberwidth' must be positive */
     else if (pp == &curwin->w_p_nuw)
@@ -9052,6 +9122,11 @@ set_option_value(name, number, string, opt_flags)
 	    EMSG(_(e_sandbox));
 	    return NULL;
 	}
+#endif
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+	if ((options[opt_idx].indir & (PV_BUF | PV_WIN))
+						  && !(opt_flags & OPT_GLOBAL))
+	    syn_cache_cancel();
 #endif
 	if (flags & P_STRING)
 	    return set_string_option(opt_idx, string, opt_flags);
@@ -622,6 +622,9 @@ EXTERN long	p_mis;		/* 'menuitems' */
 #ifdef FEAT_SPELL
 EXTERN char_u	*p_msm;		/* 'mkspellmem' */
 #endif
+#ifdef FEAT_MMAP
+EXTERN long	p_mms;		/* 'mmapsize' */
+#endif
 EXTERN long	p_mls;		/* 'modelines' */
 EXTERN char_u	*p_mouse;	/* 'mouse' */
 #ifdef FEAT_GUI
@@ -653,6 +656,7 @@ EXTERN char_u	*p_cdpath;	/* 'cdpath' */
 EXTERN long	p_rdt;		/* 'redrawtime' */
 #endif
 EXTERN int	p_remap;	/* 'remap' */
+EXTERN long	p_rxc;		/* 'regexpcache' */
 EXTERN long	p_re;		/* 'regexpengine' */
 EXTERN long	p_report;	/* 'report' */
 #if defined(FEAT_WINDOWS) && defined(FEAT_QUICKFIX)
@@ -766,6 +770,9 @@ static char *(p_swb_values[]) = {"useopen", "usetab", "split", "newtab", NULL};
 #define SWB_USETAB		0x002
 #define SWB_SPLIT		0x004
 #define SWB_NEWTAB		0x008
+#if defined(FEAT_SYN_HL) && defined(FEAT_EVAL)
+EXTERN int	p_sxc;		/* 'syntaxcache' */
+#endif
 EXTERN int	p_tbs;		/* 'tagbsearch' */
 EXTERN long	p_tl;		/* 'taglength' */
 EXTERN int	p_tr;		/* 'tagrelative' */
@@ -817,6 +824,7 @@ static char *(p_tbis_values[]) = {"tiny", "small", "medium", "large", NULL};
 # define TBIS_MEDIUM		0x04
 # define TBIS_LARGE		0x08
 #endif
+EXTERN long	p_tbz;		/* 'ttybufsize' */
 EXTERN long	p_ttyscroll;	/* 'ttyscroll' */
 #if defined(FEAT_MOUSE) && (defined(UNIX) || defined(VMS))
 EXTERN char_u	*p_ttym;	/* 'ttymouse' */
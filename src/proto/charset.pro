@@ -32,6 +32,10 @@ int win_lbr_chartabsize __ARGS((win_T *wp, char_u *s, colnr_T col, int *headp));
 int in_win_border __ARGS((win_T *wp, colnr_T vcol));
 void getvcol __ARGS((win_T *wp, pos_T *pos, colnr_T *start, colnr_T *cursor, colnr_T *end));
 colnr_T getvcol_nolist __ARGS((pos_T *posp));
+colnr_T vcol_cache_find __ARGS((win_T *wp, linenr_T lnum, colnr_T vcol, colnr_T *startvcol));
+void vcol_cache_changed __ARGS((buf_T *buf, linenr_T lnum, colnr_T col, linenr_T lnume));
+void vcol_cache_lines __ARGS((buf_T *buf, linenr_T lnum, long xtra));
+void vcol_cache_replace __ARGS((linenr_T lnum, char_u *newline));
 void getvvcol __ARGS((win_T *wp, pos_T *pos, colnr_T *start, colnr_T *cursor, colnr_T *end));
 void getvcols __ARGS((win_T *wp, pos_T *pos1, pos_T *pos2, colnr_T *left, colnr_T *right));
 char_u *skipwhite __ARGS((char_u *q));
@@ -50,6 +50,7 @@ void list_unref __ARGS((list_T *l));
 void list_free __ARGS((list_T *l, int recurse));
 listitem_T *listitem_alloc __ARGS((void));
 void listitem_free __ARGS((listitem_T *item));
+int eval_free_cache __ARGS((void));
 void listitem_remove __ARGS((list_T *l, listitem_T *item));
 dictitem_T *dict_lookup __ARGS((hashitem_T *hi));
 listitem_T *list_find __ARGS((list_T *l, long n));
@@ -62,6 +63,7 @@ int list_insert_tv __ARGS((list_T *l, typval_T *tv, listitem_T *item));
 void vimlist_remove __ARGS((list_T *l, listitem_T *item, listitem_T *item2));
 void list_insert __ARGS((list_T *l, listitem_T *ni, listitem_T *item));
 int garbage_collect __ARGS((void));
+int garbage_collect_step __ARGS((void));
 void set_ref_in_ht __ARGS((hashtab_T *ht, int copyID));
 void set_ref_in_list __ARGS((list_T *l, int copyID));
 void set_ref_in_item __ARGS((typval_T *tv, int copyID));
@@ -87,6 +89,7 @@ void set_vim_var_nr __ARGS((int idx, long val));
 long get_vim_var_nr __ARGS((int idx));
 char_u *get_vim_var_str __ARGS((int idx));
 list_T *get_vim_var_list __ARGS((int idx));
+dict_T *get_globvar_dict __ARGS((void));
 void set_vim_var_char __ARGS((int c));
 void set_vcount __ARGS((long count, long count1, int set_prevcount));
 void set_vim_var_string __ARGS((int idx, char_u *val, int len));
@@ -127,6 +130,8 @@ void func_line_exec __ARGS((void *cookie));
 void func_line_end __ARGS((void *cookie));
 int func_has_ended __ARGS((void *cookie));
 int func_has_abort __ARGS((void *cookie));
+int func_code_usable __ARGS((void *cookie));
+void func_exec_code __ARGS((void *cookie, struct condstack *cstack));
 int read_viminfo_varlist __ARGS((vir_T *virp, int writing));
 void write_viminfo_varlist __ARGS((FILE *fp));
 int store_session_globals __ARGS((FILE *fd));
@@ -4,9 +4,11 @@ int do_cmdline_cmd __ARGS((char_u *cmd));
 int do_cmdline __ARGS((char_u *cmdline, char_u *(*fgetline)(int, void *, int), void *cookie, int flags));
 int getline_equal __ARGS((char_u *(*fgetline)(int, void *, int), void *cookie, char_u *(*func)(int, void *, int)));
 void *getline_cookie __ARGS((char_u *(*fgetline)(int, void *, int), void *cookie));
+char_u *do_one_func_cmd __ARGS((char_u **cmdlinep, struct condstack *cstack, void *cookie));
 int checkforcmd __ARGS((char_u **pp, char *cmd, int len));
 int modifier_len __ARGS((char_u *cmd));
 int cmd_exists __ARGS((char_u *name));
+cmdidx_T find_cmdidx __ARGS((char_u *cmd, char_u **argp, int *skipped));
 char_u *set_one_cmd_context __ARGS((expand_T *xp, char_u *buff));
 char_u *skip_range __ARGS((char_u *cmd, int *ctx));
 void ex_ni __ARGS((exarg_T *eap));
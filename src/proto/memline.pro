@@ -21,7 +21,9 @@ char_u *ml_get_buf __ARGS((buf_T *buf, linenr_T lnum, int will_change));
 int ml_line_alloced __ARGS((void));
 int ml_append __ARGS((linenr_T lnum, char_u *line, colnr_T len, int newfile));
 int ml_append_buf __ARGS((buf_T *buf, linenr_T lnum, char_u *line, colnr_T len, int newfile));
+int ml_append_lines __ARGS((linenr_T lnum, char_u **lines, colnr_T *lens, long count, int newfile));
 int ml_replace __ARGS((linenr_T lnum, char_u *line, int copy));
+int ml_replace_bytes __ARGS((linenr_T lnum, colnr_T col, int oldlen, char_u *text, int newlen));
 int ml_delete __ARGS((linenr_T lnum, int message));
 void ml_setmarked __ARGS((linenr_T lnum));
 linenr_T ml_firstmarked __ARGS((void));
@@ -34,4 +36,7 @@ char_u *ml_encrypt_data __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsi
 void ml_decrypt_data __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsigned size));
 long ml_find_line_or_offset __ARGS((buf_T *buf, linenr_T lnum, long *offp));
 void goto_byte __ARGS((long cnt));
+int ml_map_file __ARGS((buf_T *buf, int fd, char_u *ptr, long size, int *ffp, int try_unix, int *no_eolp));
+int ml_unmap __ARGS((buf_T *buf));
+int ml_map_same_file __ARGS((buf_T *buf, char_u *fname));
 /* vim: set ft=c : */
@@ -13,6 +13,7 @@ int conceal_cursor_line __ARGS((win_T *wp));
 void conceal_check_cursur_line __ARGS((void));
 void update_single_line __ARGS((win_T *wp, linenr_T lnum));
 void update_debug_sign __ARGS((buf_T *buf, linenr_T lnum));
+void win_row_cache_free __ARGS((win_T *wp));
 void updateWindow __ARGS((win_T *wp));
 void rl_mirror __ARGS((char_u *str));
 void status_redraw_all __ARGS((void));
@@ -53,4 +54,5 @@ void showruler __ARGS((int always));
 int number_width __ARGS((win_T *wp));
 int screen_screencol __ARGS((void));
 int screen_screenrow __ARGS((void));
+void ex_termstat __ARGS((exarg_T *eap));
 /* vim: set ft=c : */
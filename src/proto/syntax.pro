@@ -1,5 +1,6 @@
 /* syntax.c */
 void syntax_start __ARGS((win_T *wp, linenr_T lnum));
+int syn_idle_parse __ARGS((void));
 void syn_stack_free_all __ARGS((synblock_T *block));
 void syn_stack_apply_changes __ARGS((buf_T *buf));
 void syntax_end_parsing __ARGS((linenr_T lnum));
@@ -9,6 +10,13 @@ void syntax_clear __ARGS((synblock_T *block));
 void reset_synblock __ARGS((win_T *wp));
 void ex_syntax __ARGS((exarg_T *eap));
 void ex_ownsyntax __ARGS((exarg_T *eap));
+void syn_cache_var_used __ARGS((int scope, char_u *name));
+void syn_cache_option_used __ARGS((char_u *name, int opt_flags));
+void syn_cache_clear __ARGS((void));
+void syn_cache_cancel __ARGS((void));
+int syn_cache_load __ARGS((char_u *fname));
+int syn_cache_start __ARGS((char_u *fname));
+void syn_cache_end __ARGS((void));
 int syntax_present __ARGS((win_T *win));
 void reset_expand_highlight __ARGS((void));
 void set_context_in_echohl_cmd __ARGS((expand_T *xp, char_u *arg));
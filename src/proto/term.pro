@@ -9,6 +9,8 @@ int term_is_gui __ARGS((char_u *name));
 char_u *tltoa __ARGS((unsigned long i));
 void termcapinit __ARGS((char_u *name));
 void out_flush __ARGS((void));
+void out_buf_free __ARGS((void));
+void out_stats __ARGS((long_u *bytesp, long_u *writesp));
 void out_flush_check __ARGS((void));
 void out_trash __ARGS((void));
 void out_char __ARGS((unsigned c));
@@ -18,6 +20,10 @@ void term_windgoto __ARGS((int row, int col));
 void term_cursor_right __ARGS((int i));
 void term_append_lines __ARGS((int line_count));
 void term_delete_lines __ARGS((int line_count));
+void term_insert_chars __ARGS((int count));
+void term_delete_chars __ARGS((int count));
+int term_windgoto_len __ARGS((int row, int col));
+int term_arg_len __ARGS((char_u *s, int n));
 void term_set_winpos __ARGS((int x, int y));
 void term_set_winsize __ARGS((int width, int height));
 void term_fg_color __ARGS((int n));
@@ -131,6 +131,7 @@ static void	qf_fill_buffer __ARGS((qf_info_T *qi));
 #endif
 static char_u	*get_mef_name __ARGS((void));
 static void	restore_start_dir __ARGS((char_u *dirname_start));
+static int	vgr_match_plain __ARGS((qf_info_T *qi, qfline_T **prevp, char_u *fname, regmmatch_T *regmatch, int flags, long *tomatch));
 static buf_T	*load_dummy_buffer __ARGS((char_u *fname, char_u *dirname_start, char_u *resulting_dir));
 static void	wipe_dummy_buffer __ARGS((buf_T *buf, char_u *dirname_start));
 static void	unload_dummy_buffer __ARGS((buf_T *buf, char_u *dirname_start));
@@ -3150,6 +3151,7 @@ ex_vimgrep(eap)
     int		using_dummy;
     int		redraw_for_dummy = FALSE;
     int		found_match;
+    int		plain_ok;
     buf_T	*first_match_buf = NULL;
     time_t	seconds = 0;
     int		save_mls;
@@ -3229,6 +3231,22 @@ ex_vimgrep(eap)
     regmatch.rmm_ic = p_ic;
     regmatch.rmm_maxcol = 0;
 
+    /* When the pattern only looks at the text of one line, a file that is not
+     * loaded may be searched without loading it into a buffer.  Not when
+     * 'iskeyword' of the current buffer differs from what a new buffer gets,
+     * it would be used for "\<" and "\k". */
+    plain_ok = !re_multiline(regmatch.regprog)
+					    && !re_bufpos(regmatch.regprog);
+    if (plain_ok)
+    {
+	char_u	*isk = NULL;
+	long	n;
+
+	(void)get_option_value((char_u *)"isk", &n, &isk, OPT_GLOBAL);
+	plain_ok = (isk != NULL && STRCMP(isk, curbuf->b_p_isk) == 0);
+	vim_free(isk);
+    }
+
     p = skipwhite(p);
     if (*p == NUL)
     {
@@ -3297,6 +3315,16 @@ ex_vimgrep(eap)
 	}
 
 	buf = buflist_findname_exp(fnames[fi]);
+	if ((buf == NULL || buf->b_ml.ml_mfp == NULL) && plain_ok
+		&& vgr_match_plain(qi, &prevp, fname, &regmatch, flags,
+							      &tomatch) == OK)
+	{
+#ifdef FEAT_AUTOCMD
+	    cur_qf_start = qi->qf_lists[qi->qf_curlist].qf_start;
+#endif
+	    continue;
+	}
+
 	if (buf == NULL || buf->b_ml.ml_mfp == NULL)
 	{
 	    /* Remember that a buffer with this name already exists. */
@@ -3361,9 +3389,12 @@ ex_vimgrep(eap)
 	    for (lnum = 1; lnum <= buf->b_ml.ml_line_count && tomatch > 0;
 								       ++lnum)
 	    {
+		/* Skip to the next line with a match. */
+		if (vim_regexec_multi_lines(&regmatch, curwin, buf, &lnum,
+			      (colnr_T)0, buf->b_ml.ml_line_count, NULL) == 0)
+		    break;
 		col = 0;
-		while (vim_regexec_multi(&regmatch, curwin, buf, lnum,
-							       col, NULL) > 0)
+		do
 		{
 		    ;
 		    if (qf_add_entry(qi, &prevp,
@@ -3395,6 +3426,8 @@ ex_vimgrep(eap)
 		    if (col > (colnr_T)STRLEN(ml_get_buf(buf, lnum, FALSE)))
 			break;
 		}
+		while (vim_regexec_multi(&regmatch, curwin, buf, lnum,
+							       col, NULL) > 0);
 		line_breakcheck();
 		if (got_int)
 		    break;
@@ -3604,6 +3637,94 @@ restore_start_dir(dirname_start)
     }
 }
 
+/*
+ * Search file "fname" for ":vimgrep" without loading it into a buffer.  Only
+ * done when the file doesn't need to be converted and no autocommands would
+ * be triggered for loading it.
+ * Adds a quickfix entry for each match and decrements "*tomatch".
+ * Returns FAIL when the file has to be loaded into a buffer.
+ */
+    static int
+vgr_match_plain(qi, prevp, fname, regmatch, flags, tomatch)
+    qf_info_T	*qi;
+    qfline_T	**prevp;
+    char_u	*fname;
+    regmmatch_T	*regmatch;
+    int		flags;
+    long	*tomatch;
+{
+    regmatch_T	rm;
+    char_u	*text;
+    char_u	*line;
+    char_u	*p;
+    long	len;
+    long	lnum;
+    colnr_T	col;
+    colnr_T	endcol;
+    int		fnum = 0;
+#ifdef FEAT_AUTOCMD
+    static event_T events[] = {EVENT_BUFNEW, EVENT_BUFREADCMD,
+		       EVENT_BUFREADPRE, EVENT_BUFREADPOST, EVENT_BUFUNLOAD};
+    int		i;
+
+    for (i = 0; i < (int)(sizeof(events) / sizeof(events[0])); ++i)
+	if (!event_ignored(events[i]) && has_autocmd(events[i], fname, NULL))
+	    return FAIL;
+#endif
+
+    text = read_plain_file(fname, &len);
+    if (text == NULL)
+	return FAIL;
+
+    rm.regprog = regmatch->regprog;
+    rm.rm_ic = regmatch->rmm_ic;
+    line = text;
+    for (lnum = 1; *tomatch > 0; ++lnum)
+    {
+	p = vim_strbyte(line, NL);
+	if (p != NULL)
+	    *p = NUL;
+	col = 0;
+	while (vim_regexec(&rm, line, col))
+	{
+	    /* After the first match use its buffer number, looking up the
+	     * file name for every match is slow. */
+	    if (qf_add_entry(qi, prevp,
+			NULL,       /* dir */
+			fnum == 0 ? fname : NULL,
+			fnum,
+			line,
+			lnum,
+			(int)(rm.startp[0] - line) + 1,
+			FALSE,      /* vis_col */
+			NULL,	    /* search pattern */
+			0,	    /* nr */
+			0,	    /* type */
+			TRUE	    /* valid */
+			) == FAIL)
+	    {
+		got_int = TRUE;
+		break;
+	    }
+	    fnum = (*prevp)->qf_fnum;
+	    if (--*tomatch == 0 || (flags & VGR_GLOBAL) == 0)
+		break;
+	    endcol = (colnr_T)(rm.endp[0] - line);
+	    col = endcol + (col == endcol);
+	    if (col > (colnr_T)STRLEN(line))
+		break;
+	}
+	line_breakcheck();
+	/* A NL at the end of the file doesn't start another line. */
+	if (got_int || p == NULL || p + 1 == text + len)
+	    break;
+	line = p + 1;
+    }
+
+    vim_free(text);
+    return OK;
+}
+
 /*
  * Load file "fname" into a dummy buffer and return the buffer pointer,
  * placing the directory resulting from the buffer load into the
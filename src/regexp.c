@@ -403,6 +403,7 @@ re_multi_type(c)
 #define JUST_CALC_SIZE	((char_u *) -1)
 
 static char_u		*reg_prev_sub = NULL;
+static int		reg_used_prev_sub;  /* pattern used reg_prev_sub */
 
 /*
  * REGEXP_INRANGE contains all characters which are always special in a []
@@ -594,6 +595,8 @@ init_class_tab()
 #define RF_HASNL    4	/* can match a NL */
 #define RF_ICOMBINE 8	/* ignore combining characters */
 #define RF_LOOKBH   16	/* uses "\@<=" or "\@<!" */
+#define RF_BUFPOS   32	/* uses the cursor, Visual area, a mark, lnum,
+			   or start or end of the file */
 
 /*
  * Global work variables for vim_regcomp().
@@ -752,6 +755,18 @@ re_lookbehind(prog)
     return (prog->regflags & RF_LOOKBH);
 }
 
+/*
+ * Return TRUE if compiled regular expression "prog" depends on a position in
+ * the buffer: the cursor, the Visual area, a mark, a line number or the start
+ * or end of the file.
+ */
+    int
+re_bufpos(prog)
+    regprog_T *prog;
+{
+    return (prog->regflags & RF_BUFPOS);
+}
+
 /*
  * Check for an equivalence class name "[=a=]".  "pp" points to the '['.
  * Returns a character representing the class. Zero means that no item was
@@ -2077,6 +2092,7 @@ regatom(flagp)
 	/* NOTREACHED */
 
       case Magic('~'):		/* previous substitute pattern */
+	    reg_used_prev_sub = TRUE;
 	    if (reg_prev_sub != NULL)
 	    {
 		char_u	    *lp;
@@ -2194,18 +2210,22 @@ regatom(flagp)
 		 * pattern -- regardless of whether or not it makes sense. */
 		case '^':
 		    ret = regnode(RE_BOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '$':
 		    ret = regnode(RE_EOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '#':
 		    ret = regnode(CURSOR);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case 'V':
 		    ret = regnode(RE_VISUAL);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		/* \%[abc]: Emit as a list of branches, all ending at the last
@@ -2324,6 +2344,7 @@ regatom(flagp)
 				  /* "\%'m", "\%<'m" and "\%>'m": Mark */
 				  c = getchr();
 				  ret = regnode(RE_MARK);
+				  regflags |= RF_BUFPOS;
 				  if (ret == JUST_CALC_SIZE)
 				      regsize += 2;
 				  else
@@ -2336,7 +2357,10 @@ regatom(flagp)
 			      else if (c == 'l' || c == 'c' || c == 'v')
 			      {
 				  if (c == 'l')
+				  {
 				      ret = regnode(RE_LNUM);
+				      regflags |= RF_BUFPOS;
+				  }
 				  else if (c == 'c')
 				      ret = regnode(RE_COL);
 				  else
@@ -3677,6 +3701,7 @@ free_regexp_stuff()
     ga_clear(&backpos);
     vim_free(reg_tofree);
     vim_free(reg_prev_sub);
+    vim_regcache_trim(0L);
 }
 #endif
 
@@ -3780,6 +3805,47 @@ bt_regexec_multi(rmp, win, buf, lnum, col, tm)
     return r;
 }
 
+static long regexec_lines_loop __ARGS((regmmatch_T *rmp, win_T *win, buf_T *buf, linenr_T *lnump, colnr_T col, linenr_T lnum_end, proftime_T *tm));
+
+/*
+ * Implementation of vim_regexec_multi_lines() for an engine that can only
+ * match from one line: try each line in turn.
+ */
+    static long
+regexec_lines_loop(rmp, win, buf, lnump, col, lnum_end, tm)
+    regmmatch_T	*rmp;
+    win_T	*win;
+    buf_T	*buf;
+    linenr_T	*lnump;
+    colnr_T	col;
+    linenr_T	lnum_end;
+    proftime_T	*tm;
+{
+    long	r;
+    int		save_called_emsg = called_emsg;
+
+    called_emsg = FALSE;
+    for (;;)
+    {
+	r = rmp->regprog->engine->regexec_multi(rmp, win, buf, *lnump, col,
+									   tm);
+	/* Stop at a match, the last line and on an error. */
+	if (r > 0 || *lnump >= lnum_end || called_emsg)
+	    break;
+	line_breakcheck();
+	if (got_int)
+	    break;
+#ifdef FEAT_RELTIME
+	if (tm != NULL && profile_passed_limit(tm))
+	    break;
+#endif
+	++*lnump;
+	col = 0;
+    }
+    called_emsg |= save_called_emsg;
+    return r;
+}
+
 /*
  * Match a regexp against a string ("line" points to the string) or multiple
  * lines ("line" is NULL, use reg_getline()).
@@ -7960,7 +8026,8 @@ static regengine_T bt_regengine =
     bt_regcomp,
     bt_regfree,
     bt_regexec_nl,
-    bt_regexec_multi
+    bt_regexec_multi,
+    regexec_lines_loop
 #ifdef DEBUG
     ,(char_u *)""
 #endif
@@ -7974,7 +8041,8 @@ static regengine_T nfa_regengine =
     nfa_regcomp,
     nfa_regfree,
     nfa_regexec_nl,
-    nfa_regexec_multi
+    nfa_regexec_multi,
+    nfa_regexec_multi_lines
 #ifdef DEBUG
     ,(char_u *)""
 #endif
@@ -7994,11 +8062,207 @@ static char_u regname[][30] = {
 			    };
 #endif
 
+/*
+ * Cache of compiled programs, so that compiling the same pattern again, e.g.
+ * in a loop, is fast.  Entries are in a list with the most recently used one
+ * first.  At most 'regexpcache' entries are kept.
+ */
+typedef struct regcache_S regcache_T;
+
+struct regcache_S
+{
+    regcache_T	*rc_prev;	/* more recently used entry */
+    regcache_T	*rc_next;	/* less recently used entry */
+    long_u	rc_hash;	/* hash of rc_pat */
+    int		rc_flags;	/* "re_flags" for vim_regcomp() */
+    int		rc_state;	/* other state compiling depends on */
+#ifdef FEAT_SYN_HL
+    int		rc_had_eol;	/* vim_regcomp_had_eol() after compiling */
+#endif
+    regprog_T	*rc_prog;	/* holds one reference */
+    char_u	rc_pat[1];	/* the pattern, actually longer */
+};
+
+static regcache_T *regcache_first = NULL;
+static regcache_T *regcache_last = NULL;
+static int	regcache_count = 0;
+static long	regcache_hits = 0;
+static long	regcache_misses = 0;
+
+static long_u regcache_hash __ARGS((char_u *expr));
+static int regcache_state __ARGS((void));
+static void regcache_unlink __ARGS((regcache_T *rc));
+static void regcache_link __ARGS((regcache_T *rc));
+static regprog_T *regcache_find __ARGS((char_u *expr, long_u hash, int re_flags, int state));
+static void regcache_add __ARGS((char_u *expr, long_u hash, int re_flags, int state, regprog_T *prog));
+
+    static long_u
+regcache_hash(expr)
+    char_u	*expr;
+{
+    long_u	hash = 0;
+    char_u	*p;
+
+    for (p = expr; *p != NUL; ++p)
+	hash = hash * 101 + *p;
+    return hash;
+}
+
+/*
+ * Return the options and global state, other than "re_flags", that compiling
+ * a pattern depends on.  'encoding' is not included, the cache is cleared
+ * when it changes.
+ */
+    static int
+regcache_state()
+{
+    int		state;
+
+    get_cpo_flags();
+    state = (int)p_re;
+    if (reg_cpo_lit)
+	state |= 4;
+    if (reg_cpo_bsl)
+	state |= 8;
+#ifdef FEAT_SYN_HL
+    state |= reg_do_extmatch << 4;
+#endif
+    return state;
+}
+
+    static void
+regcache_unlink(rc)
+    regcache_T	*rc;
+{
+    if (rc->rc_prev == NULL)
+	regcache_first = rc->rc_next;
+    else
+	rc->rc_prev->rc_next = rc->rc_next;
+    if (rc->rc_next == NULL)
+	regcache_last = rc->rc_prev;
+    else
+	rc->rc_next->rc_prev = rc->rc_prev;
+    --regcache_count;
+}
+
+/*
+ * Put "rc" at the start of the list.
+ */
+    static void
+regcache_link(rc)
+    regcache_T	*rc;
+{
+    rc->rc_prev = NULL;
+    rc->rc_next = regcache_first;
+    if (regcache_first == NULL)
+	regcache_last = rc;
+    else
+	regcache_first->rc_prev = rc;
+    regcache_first = rc;
+    ++regcache_count;
+}
+
+/*
+ * Find pattern "expr" in the cache.  Returns a new reference to the program
+ * or NULL when not found.
+ */
+    static regprog_T *
+regcache_find(expr, hash, re_flags, state)
+    char_u	*expr;
+    long_u	hash;
+    int		re_flags;
+    int		state;
+{
+    regcache_T	*rc;
+
+    for (rc = regcache_first; rc != NULL; rc = rc->rc_next)
+	if (rc->rc_hash == hash && rc->rc_flags == re_flags
+		&& rc->rc_state == state && STRCMP(rc->rc_pat, expr) == 0)
+	{
+	    if (rc != regcache_first)
+	    {
+		regcache_unlink(rc);
+		regcache_link(rc);
+	    }
+#ifdef FEAT_SYN_HL
+	    had_eol = rc->rc_had_eol;
+#endif
+	    ++regcache_hits;
+	    return vim_regref(rc->rc_prog);
+	}
+    ++regcache_misses;
+    return NULL;
+}
+
+/*
+ * Add program "prog" compiled from "expr" to the cache, removing the least
+ * recently used entry when it is full.
+ */
+    static void
+regcache_add(expr, hash, re_flags, state, prog)
+    char_u	*expr;
+    long_u	hash;
+    int		re_flags;
+    int		state;
+    regprog_T	*prog;
+{
+    regcache_T	*rc;
+
+    rc = (regcache_T *)alloc((unsigned)(sizeof(regcache_T) + STRLEN(expr)));
+    if (rc == NULL)
+	return;
+    STRCPY(rc->rc_pat, expr);
+    rc->rc_hash = hash;
+    rc->rc_flags = re_flags;
+    rc->rc_state = state;
+#ifdef FEAT_SYN_HL
+    rc->rc_had_eol = had_eol;
+#endif
+    rc->rc_prog = vim_regref(prog);
+    regcache_link(rc);
+    vim_regcache_trim(p_rxc);
+}
+
+/*
+ * Remove the least recently used entries from the cache of compiled programs
+ * until at most "count" are left.  Use zero to clear the cache.
+ */
+    void
+vim_regcache_trim(count)
+    long	count;
+{
+    regcache_T	*rc;
+
+    while (regcache_count > count)
+    {
+	rc = regcache_last;
+	regcache_unlink(rc);
+	vim_regfree(rc->rc_prog);
+	vim_free(rc);
+    }
+}
+
+/*
+ * Show a line with the statistics of the cache of compiled programs.  Used
+ * by ":memstat".
+ */
+    void
+vim_regcache_msg()
+{
+    msg_putchar('\n');
+    vim_snprintf((char *)IObuff, IOSIZE,
+		_("%d patterns cached, 'regexpcache' %ld, %ld hits, %ld misses"),
+			 regcache_count, p_rxc, regcache_hits, regcache_misses);
+    msg_puts(IObuff);
+}
+
 /*
  * Compile a regular expression into internal code.
  * Returns the program in allocated memory.
  * Use vim_regfree() to free the memory.
  * Returns NULL for an error.
+ * The program may be taken from the cache, see 'regexpcache'.  It is then
+ * shared with other users, see vim_regref().
  */
     regprog_T *
 vim_regcomp(expr_arg, re_flags)
@@ -8007,6 +8271,21 @@ vim_regcomp(expr_arg, re_flags)
 {
     regprog_T   *prog = NULL;
     char_u	*expr = expr_arg;
+    long_u	hash = 0;
+    int		state = 0;
+    int		save_called_emsg;
+
+    if (p_rxc > 0)
+    {
+	hash = regcache_hash(expr_arg);
+	state = regcache_state();
+	prog = regcache_find(expr_arg, hash, re_flags, state);
+	if (prog != NULL)
+	    return prog;
+    }
+    save_called_emsg = called_emsg;
+    called_emsg = FALSE;
+    reg_used_prev_sub = FALSE;
 
     regexp_engine = p_re;
 
@@ -8070,17 +8349,44 @@ vim_regcomp(expr_arg, re_flags)
 	 */
     }
 
+    if (prog != NULL)
+    {
+	prog->re_refcount = 1;
+	/* Don't cache a program that gave an error message, the message
+	 * would not be given again.  A program that includes the previous
+	 * substitute string depends on it. */
+	if (p_rxc > 0 && !called_emsg && !reg_used_prev_sub)
+	    regcache_add(expr_arg, hash, re_flags, state, prog);
+    }
+    called_emsg |= save_called_emsg;
+    return prog;
+}
+
+/*
+ * Add a reference to compiled regexp program "prog", so that it can be used
+ * in one more place.  Each reference must be freed with vim_regfree().
+ * A program is not reentrant, it must not be used by one place while it is
+ * being executed for another.
+ * Returns "prog".
+ */
+    regprog_T *
+vim_regref(prog)
+    regprog_T   *prog;
+{
+    if (prog != NULL)
+	++prog->re_refcount;
     return prog;
 }
 
 /*
- * Free a compiled regexp program, returned by vim_regcomp().
+ * Free a compiled regexp program, returned by vim_regcomp(), or one
+ * reference to it.
  */
     void
 vim_regfree(prog)
     regprog_T   *prog;
 {
-    if (prog != NULL)
+    if (prog != NULL && --prog->re_refcount <= 0)
 	prog->engine->regfree(prog);
 }
 
@@ -8134,3 +8440,27 @@ vim_regexec_multi(rmp, win, buf, lnum, col, tm)
 {
     return rmp->regprog->engine->regexec_multi(rmp, win, buf, lnum, col, tm);
 }
+
+/*
+ * Like vim_regexec_multi(), but when there is no match starting in line
+ * "*lnump" go on with the following lines, up to and including "lnum_end".
+ * "col" is only used for the first line.
+ * When there is a match "*lnump" is set to the line it was found in, the
+ * result and "rmp" are as if vim_regexec_multi() was called for that line.
+ * When there is no match "*lnump" is set to the last line that was tried,
+ * searching stops early for CTRL-C, an error or when "tm" has passed.
+ * This is faster than calling vim_regexec_multi() for each line.
+ */
+    long
+vim_regexec_multi_lines(rmp, win, buf, lnump, col, lnum_end, tm)
+    regmmatch_T *rmp;
+    win_T       *win;           /* window in which to search or NULL */
+    buf_T       *buf;           /* buffer in which to search */
+    linenr_T    *lnump;         /* nr of first line to look for a match */
+    colnr_T     col;            /* column to start looking in first line */
+    linenr_T	lnum_end;	/* nr of last line to look for a match */
+    proftime_T	*tm;		/* timeout limit or NULL */
+{
+    return rmp->regprog->engine->regexec_lines(rmp, win, buf, lnump, col,
+								lnum_end, tm);
+}
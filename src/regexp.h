@@ -38,6 +38,7 @@ typedef struct regprog
 {
     regengine_T		*engine;
     unsigned		regflags;
+    int			re_refcount;	/* see vim_regref() */
 } regprog_T;
 
 /*
@@ -47,9 +48,10 @@ typedef struct regprog
  */
 typedef struct
 {
-    /* These two members implement regprog_T */
+    /* These three members implement regprog_T */
     regengine_T		*engine;
     unsigned		regflags;
+    int			re_refcount;
 
     int			regstart;
     char_u		reganch;
@@ -81,18 +83,24 @@ struct nfa_state
  */
 typedef struct
 {
-    /* These two members implement regprog_T */
+    /* These three members implement regprog_T */
     regengine_T		*engine;
     unsigned		regflags;
+    int			re_refcount;
 
     nfa_state_T		*start;		/* points into state[] */
 
     int			reganch;	/* pattern starts with ^ */
     int			regstart;	/* char at start of pattern */
     char_u		*match_text;	/* plain text to match with */
+    char_u		*regmust;	/* text every match contains or NULL */
+    int			regmlen;	/* length of regmust */
 
+    int			has_zstart;	/* pattern contains \zs */
     int			has_zend;	/* pattern contains \ze */
     int			has_backref;	/* pattern contains \1 .. \9 */
+    int			dfa_ok;		/* may use the lazy DFA */
+    struct nfa_dfa_S	*dfa;		/* lazy DFA, built when used */
 #ifdef FEAT_SYN_HL
     int			reghasz;
 #endif
@@ -151,6 +159,7 @@ struct regengine
     void	(*regfree)(regprog_T *);
     int		(*regexec_nl)(regmatch_T*, char_u*, colnr_T, int);
     long	(*regexec_multi)(regmmatch_T*, win_T*, buf_T*, linenr_T, colnr_T, proftime_T*);
+    long	(*regexec_lines)(regmmatch_T*, win_T*, buf_T*, linenr_T*, colnr_T, linenr_T, proftime_T*);
 #ifdef DEBUG
     char_u	*expr;
 #endif
@@ -243,6 +243,9 @@ static char_u e_nul_found[] = N_("E865: (NFA) Regexp end encountered prematurely
 static char_u e_misplaced[] = N_("E866: (NFA regexp) Misplaced %c");
 static char_u e_ill_char_class[] = N_("E877: (NFA regexp) Invalid character class: %ld");
 
+/* NFA regexp \zs operator encountered. */
+static int nfa_has_zstart;
+
 /* NFA regexp \ze operator encountered. */
 static int nfa_has_zend;
 
@@ -278,10 +281,85 @@ static int nfa_alt_listid;
 /* 0 for first call to nfa_regmatch(), 1 for recursive call. */
 static int nfa_ll_index = 0;
 
+/* When not zero, nfa_regmatch() also looks for a match that starts in the
+ * lines after the first one, up to this relative line number.  Set by
+ * nfa_regexec_multi_lines(). */
+static linenr_T nfa_stream_end = 0;
+static proftime_T *nfa_stream_tm = NULL;    /* timeout limit or NULL */
+
+/*
+ * What is known about the text matched by a part of the postfix form, used by
+ * nfa_get_regmust().  Only the first or last NFA_MUST_MAX characters are
+ * remembered.
+ */
+#define NFA_MUST_MAX 20
+
+typedef struct
+{
+    int		exact;		/* TRUE when always matching "left" */
+    int		leftlen;
+    int		left[NFA_MUST_MAX];	/* text a match starts with */
+    int		rightlen;
+    int		right[NFA_MUST_MAX];	/* text a match ends with */
+    int		inlen;
+    int		in[NFA_MUST_MAX];	/* text every match contains */
+} nfa_must_T;
+
+/* Lazy DFA, see nfa_dfa_match(). */
+#define DFA_MAX_STATES	64	/* start again when there are this many */
+#define DFA_MAX_FLUSH	20	/* stop using the DFA after this many flushes */
+
+/* Values for ds_flags. */
+#define DS_MATCH	1	/* contains NFA_MATCH */
+#define DS_UNKNOWN	2	/* contains a state the DFA can't handle */
+#define DS_DYNAMIC	4	/* contains a state that depends on options */
+#define DS_EOL		8	/* contains NFA_EOL or NFA_EOF */
+#define DS_EOL_DONE	16	/* DS_EOL_MATCH is valid */
+#define DS_EOL_MATCH	32	/* may match at the end of the line */
+
+/* nfa_dstate_T is a DFA state. */
+typedef struct
+{
+    int		ds_flags;	/* DS_ flags */
+    int		ds_hash;	/* hash of ds_set[] */
+    int		ds_len;		/* number of NFA states in ds_set[] */
+    int		*ds_set;	/* NFA state numbers, ascending */
+    short	*ds_next;	/* next DFA state for each character class,
+				   -1 when not known yet */
+} nfa_dstate_T;
+
+typedef struct nfa_dfa_S nfa_dfa_T;
+struct nfa_dfa_S
+{
+    int		dfa_key;	/* ireg_ic and encoding used, see DFA_KEY */
+    int		dfa_flushes;	/* number of times all states were freed */
+    int		dfa_nclass;	/* number of character classes */
+    char_u	dfa_class[256];	/* character class of characters below 256 */
+    nfa_dstate_T *dfa_states[DFA_MAX_STATES];
+    int		dfa_nstates;
+    int		dfa_start[2];	/* start state, [1] at the start of the line,
+				   -1 when not known yet */
+    int		*dfa_mark;	/* for each NFA state: dfa_markid when added */
+    int		dfa_markid;
+    int		*dfa_set;	/* NFA states collected for a new DFA state */
+    int		dfa_setlen;
+    int		dfa_flags;	/* DS_ flags for dfa_set[] */
+};
+
+#ifdef FEAT_MBYTE
+# define DFA_KEY (ireg_ic + (has_mbyte << 1) + (enc_utf8 << 2) \
+							      + (enc_dbcs << 3))
+#else
+# define DFA_KEY (ireg_ic)
+#endif
+
 static int nfa_regcomp_start __ARGS((char_u *expr, int re_flags));
 static int nfa_get_reganch __ARGS((nfa_state_T *start, int depth));
 static int nfa_get_regstart __ARGS((nfa_state_T *start, int depth));
 static char_u *nfa_get_match_text __ARGS((nfa_state_T *start));
+static void nfa_must_cat __ARGS((int *dst, int *dstlen, int *a, int alen, int *b, int blen, int keep_end));
+static void nfa_must_best __ARGS((nfa_must_T *m, int *text, int len));
+static char_u *nfa_get_regmust __ARGS((int *postfix, int *end, int regstart));
 static int realloc_post_list __ARGS((void));
 static int nfa_recognize_char_class __ARGS((char_u *start, char_u *end, int extra_newl));
 static int nfa_emit_equi_class __ARGS((int c));
@@ -313,8 +391,21 @@ static regprog_T *nfa_regcomp __ARGS((char_u *expr, int re_flags));
 static void nfa_regfree __ARGS((regprog_T *prog));
 static int  nfa_regexec_nl __ARGS((regmatch_T *rmp, char_u *line, colnr_T col, int line_lbr));
 static long nfa_regexec_multi __ARGS((regmmatch_T *rmp, win_T *win, buf_T *buf, linenr_T lnum, colnr_T col, proftime_T *tm));
+static long nfa_regexec_multi_lines __ARGS((regmmatch_T *rmp, win_T *win, buf_T *buf, linenr_T *lnump, colnr_T col, linenr_T lnum_end, proftime_T *tm));
 static int match_follows __ARGS((nfa_state_T *startstate, int depth));
 static int failure_chance __ARGS((nfa_state_T *state, int depth));
+static int nfa_dfa_consumes __ARGS((nfa_state_T *state));
+static int nfa_dfa_dynamic __ARGS((nfa_state_T *state));
+static int nfa_dfa_accept __ARGS((nfa_state_T *state, int curc, char_u *p));
+static void nfa_dfa_addstate __ARGS((nfa_dfa_T *dfa, nfa_regprog_T *prog, nfa_state_T *state, int at_bol));
+static void nfa_dfa_startset __ARGS((nfa_dfa_T *dfa));
+static void nfa_dfa_flush __ARGS((nfa_dfa_T *dfa));
+static int nfa_dfa_findstate __ARGS((nfa_dfa_T *dfa));
+static int nfa_dfa_step __ARGS((nfa_dfa_T *dfa, nfa_regprog_T *prog, nfa_dstate_T *ds, int curc, char_u *p));
+static int nfa_dfa_eol_match __ARGS((nfa_dfa_T *dfa, nfa_regprog_T *prog, nfa_dstate_T *ds));
+static void nfa_dfa_init_class __ARGS((nfa_dfa_T *dfa, nfa_regprog_T *prog));
+static int nfa_dfa_match __ARGS((nfa_regprog_T *prog, colnr_T col));
+static void nfa_dfa_free __ARGS((nfa_dfa_T *dfa));
 
 /* helper functions used when doing re2post() ... regatom() parsing */
 #define EMIT(c)	do {				\
@@ -352,6 +443,7 @@ nfa_regcomp_start(expr, re_flags)
 	return FAIL;
     post_ptr = post_start;
     post_end = post_start + nstate_max;
+    nfa_has_zstart = FALSE;
     nfa_has_zend = FALSE;
     nfa_has_backref = FALSE;
 
@@ -556,6 +648,281 @@ nfa_get_match_text(start)
     return ret;
 }
 
+/*
+ * Concatenate "a" and "b" into "dst".  When the result is too long keep the
+ * start, or the end when "keep_end" is TRUE.
+ */
+    static void
+nfa_must_cat(dst, dstlen, a, alen, b, blen, keep_end)
+    int		*dst;
+    int		*dstlen;
+    int		*a;
+    int		alen;
+    int		*b;
+    int		blen;
+    int		keep_end;
+{
+    int		buf[NFA_MUST_MAX * 2];
+    int		skip = 0;
+
+    if (alen > 0)
+	mch_memmove(buf, a, alen * sizeof(int));
+    if (blen > 0)
+	mch_memmove(buf + alen, b, blen * sizeof(int));
+    *dstlen = alen + blen;
+    if (*dstlen > NFA_MUST_MAX)
+    {
+	if (keep_end)
+	    skip = *dstlen - NFA_MUST_MAX;
+	*dstlen = NFA_MUST_MAX;
+    }
+    mch_memmove(dst, buf + skip, *dstlen * sizeof(int));
+}
+
+/*
+ * Use "text[len]" for "m->in" if it is longer than what is there.
+ */
+    static void
+nfa_must_best(m, text, len)
+    nfa_must_T	*m;
+    int		*text;
+    int		len;
+{
+    if (len > m->inlen)
+    {
+	mch_memmove(m->in, text, len * sizeof(int));
+	m->inlen = len;
+    }
+}
+
+/*
+ * Find the longest literal text that every match of the postfix form
+ * "postfix" to "end" contains.  Similar to "regmust" of the backtracking
+ * engine, but also looks inside alternatives and groups.
+ * Returns the text in allocated memory, NULL if there is nothing useful.
+ * When "regstart" is not NUL a single character is not useful.
+ */
+    static char_u *
+nfa_get_regmust(postfix, end, regstart)
+    int		*postfix;
+    int		*end;
+    int		regstart;
+{
+    nfa_must_T	*stack;
+    nfa_must_T	*a;
+    nfa_must_T	*b;
+    nfa_must_T	m;
+    int		sp = 0;
+    int		*p;
+    int		c;
+    int		n;
+    int		i;
+    char_u	*ret = NULL;
+    char_u	*s;
+
+    /* Text that must match may be in a following line, and the characters
+     * matched by "\n" are not in the line. */
+    for (p = postfix; p < end; ++p)
+	if (*p == NFA_NEWL)
+	    return NULL;
+
+    stack = (nfa_must_T *)lalloc((long_u)((end - postfix)
+						 * sizeof(nfa_must_T)), FALSE);
+    if (stack == NULL)
+	return NULL;
+
+    for (p = postfix; p < end; ++p)
+    {
+	c = *p;
+	vim_memset(&m, 0, sizeof(m));
+
+	if (c == NFA_CONCAT || c == NFA_OR)
+	{
+	    if (sp < 2)
+		goto theend;
+	    b = &stack[--sp];
+	    a = &stack[sp - 1];
+	    if (c == NFA_CONCAT)
+	    {
+		m.exact = a->exact && b->exact
+				     && a->leftlen + b->leftlen <= NFA_MUST_MAX;
+		if (a->exact)
+		    nfa_must_cat(m.left, &m.leftlen, a->left, a->leftlen,
+						   b->left, b->leftlen, FALSE);
+		else
+		    nfa_must_cat(m.left, &m.leftlen, a->left, a->leftlen,
+							       NULL, 0, FALSE);
+		if (b->exact)
+		    nfa_must_cat(m.right, &m.rightlen, a->right, a->rightlen,
+						 b->right, b->rightlen, TRUE);
+		else
+		    nfa_must_cat(m.right, &m.rightlen, NULL, 0,
+					       b->right, b->rightlen, TRUE);
+		nfa_must_cat(m.in, &m.inlen, a->right, a->rightlen,
+						   b->left, b->leftlen, FALSE);
+		nfa_must_best(&m, a->in, a->inlen);
+		nfa_must_best(&m, b->in, b->inlen);
+	    }
+	    else
+	    {
+		/* Only what both alternatives start or end with is certain. */
+		for (i = 0; i < a->leftlen && i < b->leftlen
+					       && a->left[i] == b->left[i]; ++i)
+		    m.left[i] = a->left[i];
+		m.leftlen = i;
+		for (i = 0; i < a->rightlen && i < b->rightlen
+			 && a->right[a->rightlen - i - 1]
+					  == b->right[b->rightlen - i - 1]; ++i)
+		    ;
+		m.rightlen = i;
+		mch_memmove(m.right, a->right + a->rightlen - i,
+							     i * sizeof(int));
+		m.exact = a->exact && b->exact && a->leftlen == b->leftlen
+						     && m.leftlen == a->leftlen;
+		if (a->inlen == b->inlen && memcmp(a->in, b->in,
+						 a->inlen * sizeof(int)) == 0)
+		    nfa_must_best(&m, a->in, a->inlen);
+	    }
+	    nfa_must_best(&m, m.left, m.leftlen);
+	    nfa_must_best(&m, m.right, m.rightlen);
+	    *a = m;
+	    continue;
+	}
+
+	if ((c >= NFA_MOPEN && c <= NFA_MOPEN9)
+#ifdef FEAT_SYN_HL
+		|| (c >= NFA_ZOPEN && c <= NFA_ZOPEN9)
+#endif
+		|| c == NFA_NOPEN)
+	    /* A group matches the same text as what it contains. */
+	    continue;
+
+	switch (c)
+	{
+	    case NFA_BOL:
+	    case NFA_EOL:
+	    case NFA_BOW:
+	    case NFA_EOW:
+	    case NFA_BOF:
+	    case NFA_EOF:
+	    case NFA_ZSTART:
+	    case NFA_ZEND:
+	    case NFA_CURSOR:
+	    case NFA_VISUAL:
+	    case NFA_EMPTY:
+		/* zero-width: matches the empty string */
+		m.exact = TRUE;
+		break;
+
+	    case NFA_LNUM:
+	    case NFA_LNUM_GT:
+	    case NFA_LNUM_LT:
+	    case NFA_VCOL:
+	    case NFA_VCOL_GT:
+	    case NFA_VCOL_LT:
+	    case NFA_COL:
+	    case NFA_COL_GT:
+	    case NFA_COL_LT:
+	    case NFA_MARK:
+	    case NFA_MARK_GT:
+	    case NFA_MARK_LT:
+		++p; /* skip the number or mark name */
+		m.exact = TRUE;
+		break;
+
+	    case NFA_PREV_ATOM_JUST_BEFORE:
+	    case NFA_PREV_ATOM_JUST_BEFORE_NEG:
+		++p; /* skip the count */
+		/* FALLTHROUGH */
+	    case NFA_PREV_ATOM_NO_WIDTH:
+	    case NFA_PREV_ATOM_NO_WIDTH_NEG:
+		/* The text of look-around is not part of the match. */
+		if (sp < 1)
+		    goto theend;
+		--sp;
+		m.exact = TRUE;
+		break;
+
+	    case NFA_STAR:
+	    case NFA_STAR_NONGREEDY:
+	    case NFA_QUEST:
+	    case NFA_QUEST_NONGREEDY:
+	    case NFA_END_COLL:
+	    case NFA_END_NEG_COLL:
+	    case NFA_PREV_ATOM_LIKE_PATTERN:
+#ifdef FEAT_MBYTE
+	    case NFA_COMPOSING:
+#endif
+		/* may match the empty string or any character */
+		if (sp < 1)
+		    goto theend;
+		--sp;
+		break;
+
+	    case NFA_RANGE:
+		if (sp < 2)
+		    goto theend;
+		sp -= 2;
+		break;
+
+	    case NFA_OPT_CHARS:
+		n = *++p;
+		if (sp < n)
+		    goto theend;
+		sp -= n;
+		break;
+
+	    default:
+		/* A literal character is compared with the text bytes, see
+		 * nfa_find_regmust().  In UTF-8 a character below 0x100 may
+		 * also match an illegal byte. */
+		if (c > 0 &&
+#ifdef FEAT_MBYTE
+			(has_mbyte ? (c < 0x80 || (enc_utf8 && c >= 0x100)) :
+#endif
+			 c < 0x100
+#ifdef FEAT_MBYTE
+			)
+#endif
+		   )
+		{
+		    m.exact = TRUE;
+		    m.left[0] = m.right[0] = m.in[0] = c;
+		    m.leftlen = m.rightlen = m.inlen = 1;
+		}
+		break;
+	}
+	stack[sp++] = m;
+    }
+
+    if (sp == 1 && stack[0].inlen > 0
+			       && (stack[0].inlen > 1 || regstart == NUL))
+    {
+	n = 0;
+	for (i = 0; i < stack[0].inlen; ++i)
+	    n += MB_CHAR2LEN(stack[0].in[i]);
+	ret = alloc(n + 1);
+	if (ret != NULL)
+	{
+	    s = ret;
+	    for (i = 0; i < stack[0].inlen; ++i)
+	    {
+#ifdef FEAT_MBYTE
+		if (has_mbyte)
+		    s += (*mb_char2bytes)(stack[0].in[i], s);
+		else
+#endif
+		    *s++ = stack[0].in[i];
+	    }
+	    *s = NUL;
+	}
+    }
+
+theend:
+    vim_free(stack);
+    return ret;
+}
+
 /*
  * Allocate more space for post_start.  Called when
  * running above the estimated number of states.
@@ -1288,6 +1655,7 @@ nfa_regatom()
 
 		/* Previous substitute pattern.
 		 * Generated as "\%(pattern\)". */
+		reg_used_prev_sub = TRUE;
 		if (reg_prev_sub == NULL)
 		{
 		    EMSG(_(e_nopresub));
@@ -1322,6 +1690,7 @@ nfa_regatom()
 	    {
 		case 's':
 		    EMIT(NFA_ZSTART);
+		    nfa_has_zstart = TRUE;
 		    break;
 		case 'e':
 		    EMIT(NFA_ZEND);
@@ -1404,18 +1773,22 @@ nfa_regatom()
 		 * pattern -- regardless of whether or not it makes sense. */
 		case '^':
 		    EMIT(NFA_BOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '$':
 		    EMIT(NFA_EOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '#':
 		    EMIT(NFA_CURSOR);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case 'V':
 		    EMIT(NFA_VISUAL);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '[':
@@ -1465,9 +1838,12 @@ nfa_regatom()
 			if (c == 'l' || c == 'c' || c == 'v')
 			{
 			    if (c == 'l')
+			    {
 				/* \%{n}l  \%{n}<l  \%{n}>l  */
 				EMIT(cmp == '<' ? NFA_LNUM_LT :
 				     cmp == '>' ? NFA_LNUM_GT : NFA_LNUM);
+				regflags |= RF_BUFPOS;
+			    }
 			    else if (c == 'c')
 				/* \%{n}c  \%{n}<c  \%{n}>c  */
 				EMIT(cmp == '<' ? NFA_COL_LT :
@@ -1485,6 +1861,7 @@ nfa_regatom()
 			    EMIT(cmp == '<' ? NFA_MARK_LT :
 				 cmp == '>' ? NFA_MARK_GT : NFA_MARK);
 			    EMIT(getchr());
+			    regflags |= RF_BUFPOS;
 			    break;
 			}
 		    }
@@ -2637,6 +3014,8 @@ nfa_dump(prog)
 					      prog->regstart, prog->regstart);
 	if (prog->match_text != NULL)
 	    fprintf(debugf, "match_text: \"%s\"\n", prog->match_text);
+	if (prog->regmust != NULL)
+	    fprintf(debugf, "regmust: \"%s\"\n", prog->regmust);
 
 	fclose(debugf);
     }
@@ -3691,6 +4070,10 @@ nfa_postprocess(prog)
 		++prog->state[i].c;
 	}
     }
+
+    /* The lazy DFA can't check a backreference, it would give up at the
+     * point where the NFA has to do most of the work. */
+    prog->dfa_ok = !prog->has_backref;
 }
 
 /****************************************************************
@@ -5113,6 +5496,10 @@ recursive_regmatch(state, pim, prog, submatch, m, listids)
 
 static int skip_to_start __ARGS((int c, colnr_T *colp));
 static long find_match_text __ARGS((colnr_T startcol, int regstart, char_u *match_text));
+static int nfa_find_regmust __ARGS((nfa_regprog_T *prog, colnr_T col));
+static int nfa_line_may_match __ARGS((nfa_regprog_T *prog, colnr_T col));
+static int nfa_stream_stop __ARGS((void));
+static int nfa_stream_next_line __ARGS((nfa_regprog_T *prog));
 
 /*
  * Estimate the chance of a match with "state" failing.
@@ -5366,6 +5753,96 @@ find_match_text(startcol, regstart, match_text)
     return 0L;
 }
 
+/*
+ * Check if "prog->regmust" appears in the line at or after "col".
+ * This is used very often, esp. for ":global", and a lot faster than running
+ * the DFA or the NFA on the line.
+ */
+    static int
+nfa_find_regmust(prog, col)
+    nfa_regprog_T	*prog;
+    colnr_T		col;
+{
+    char_u	*s = regline + col;
+    int		c;
+
+    /* The library function may be faster than anything we can do. */
+    if (!ireg_ic)
+	return strstr((char *)s, (char *)prog->regmust) != NULL;
+
+    c = PTR2CHAR(prog->regmust);
+    while ((s = cstrchr(s, c)) != NULL)
+    {
+	if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
+	    return TRUE;
+	mb_ptr_adv(s);
+    }
+    return FALSE;
+}
+
+/*
+ * Quick checks on the text in "regline" from "col": return FALSE if there
+ * can't be a match starting there.
+ */
+    static int
+nfa_line_may_match(prog, col)
+    nfa_regprog_T	*prog;
+    colnr_T		col;
+{
+    /* Skip a line that doesn't contain the text every match contains. */
+    if (prog->regmust != NULL
+#ifdef FEAT_MBYTE
+	    && !ireg_icombine
+#endif
+	    && !nfa_find_regmust(prog, col))
+	return FALSE;
+
+    /* Check with the DFA if there can be a match in this line. */
+    if (prog->dfa_ok && !nfa_dfa_match(prog, col))
+	return FALSE;
+    return TRUE;
+}
+
+/*
+ * Return TRUE when looking in the next line must stop: CTRL-C was typed or
+ * the time limit of nfa_regexec_multi_lines() has passed.
+ */
+    static int
+nfa_stream_stop()
+{
+    line_breakcheck();
+    if (got_int)
+	return TRUE;
+#ifdef FEAT_RELTIME
+    if (nfa_stream_tm != NULL && profile_passed_limit(nfa_stream_tm))
+	return TRUE;
+#endif
+    return FALSE;
+}
+
+/*
+ * Go to the next line where a match may start, up to "nfa_stream_end".
+ * Return FALSE when there is no such line or looking must stop.
+ */
+    static int
+nfa_stream_next_line(prog)
+    nfa_regprog_T	*prog;
+{
+    colnr_T	col;
+
+    for (;;)
+    {
+	reg_nextline();
+	col = 0;
+	if ((prog->regstart == NUL
+			       || skip_to_start(prog->regstart, &col) == OK)
+		&& nfa_line_may_match(prog, col))
+	    return TRUE;
+	if (reglnum >= nfa_stream_end || nfa_stream_stop())
+	    return FALSE;
+    }
+}
+
 /*
  * Main matching routine.
  *
@@ -5529,10 +6006,15 @@ nfa_regmatch(prog, start, submatch, m)
 	fprintf(debug, "\n-------------------\n");
 #endif
 	/*
-	 * If the state lists are empty we can stop.
+	 * If the state lists are empty we can stop.  Unless streaming, then go
+	 * on in the next line where a match may start.
 	 */
 	if (thislist->n == 0)
+	{
+	    if (nfa_match == FALSE && toplevel && reglnum < nfa_stream_end)
+		goto stream_nextline;
 	    break;
+	}
 
 	/* compute nextlist */
 	for (listidx = 0; listidx < thislist->n; ++listidx)
@@ -6600,10 +7082,10 @@ nfa_regmatch(prog, start, submatch, m)
 	 * Do not add the start state in recursive calls of nfa_regmatch(),
 	 * because recursive calls should only start in the first position.
 	 * Unless "nfa_endp" is not NULL, then we match the end position.
-	 * Also don't start a match past the first line. */
+	 * Also don't start a match past the first line, unless streaming. */
 	if (nfa_match == FALSE
 		&& ((toplevel
-			&& reglnum == 0
+			&& reglnum <= nfa_stream_end
 			&& clen != 0
 			&& (ireg_maxcol == 0
 			    || (colnr_T)(reginput - regline) < ireg_maxcol))
@@ -6634,7 +7116,14 @@ nfa_regmatch(prog, start, submatch, m)
 			/* Nextlist is empty, we can skip ahead to the
 			 * character that must appear at the start. */
 			if (skip_to_start(prog->regstart, &col) == FAIL)
-			    break;
+			{
+			    if (reglnum >= nfa_stream_end)
+				break;
+			    /* Skip to the end of the line, look in the next
+			     * line below. */
+			    col = (colnr_T)STRLEN(regline);
+			    add = FALSE;
+			}
 #ifdef ENABLE_LOG
 			fprintf(log_fd, "  Skipping ahead %d bytes to regstart\n",
 				col - ((colnr_T)(reginput - regline) + clen));
@@ -6660,8 +7149,11 @@ nfa_regmatch(prog, start, submatch, m)
 		if (add)
 		{
 		    if (REG_MULTI)
+		    {
+			m->norm.list.multi[0].start.lnum = reglnum;
 			m->norm.list.multi[0].start.col =
 					 (colnr_T)(reginput - regline) + clen;
+		    }
 		    else
 			m->norm.list.line[0].start = reginput + clen;
 		    addstate(nextlist, start->out, m, NULL, clen);
@@ -6670,6 +7162,23 @@ nfa_regmatch(prog, start, submatch, m)
 	    else
 		addstate(nextlist, start, m, NULL, clen);
 	}
+	else if (nfa_match == FALSE && toplevel && clen == 0
+						  && reglnum < nfa_stream_end)
+	{
+	    /* Streaming: at the end of the line, a match may also start in
+	     * the next line. */
+	    if (!go_to_nextline)
+		/* Without a line break nothing continues. */
+		nextlist->n = 0;
+	    if (nextlist->n == 0)
+		goto stream_nextline;
+	    if (nfa_stream_stop())
+		break;
+	    m->norm.list.multi[0].start.lnum = reglnum + 1;
+	    m->norm.list.multi[0].start.col = 0;
+	    addstate(nextlist, start->out, m, NULL, -1);
+	    go_to_nextline = TRUE;
+	}
 
 #ifdef ENABLE_LOG
 	fprintf(log_fd, ">>> Thislist had %d states available: ", thislist->n);
@@ -6692,6 +7201,16 @@ nextchar:
 	    reg_nextline();
 	else
 	    break;
+	continue;
+
+stream_nextline:
+	/* Streaming and no match is in progress: skip over lines where there
+	 * can't be a match and start again in the next one. */
+	if (nfa_stream_stop() || !nfa_stream_next_line(prog))
+	    break;
+	m->norm.list.multi[0].start.lnum = reglnum;
+	m->norm.list.multi[0].start.col = 0;
+	addstate(nextlist, start->out, m, NULL, 0);
     }
 
 #ifdef ENABLE_LOG
@@ -6713,41 +7232,679 @@ theend:
     return nfa_match;
 }
 
+/****************************************************************
+ * Lazy DFA.
+ *
+ * Running the NFA is slow, it keeps a list of threads with submatch
+ * information and handles each state for every character.  Before doing that
+ * a DFA is used to check whether there can be a match in the line at all.
+ * A DFA state stands for a set of NFA states.  DFA states are only created
+ * when needed and are kept with the program, so that the next line and the
+ * next call can use them.
+ *
+ * The DFA does not keep track of submatches.  A few things that the NFA
+ * checks are taken to always match, such as "\<" and look-around.  Therefore
+ * the DFA can only tell for sure that there is no match.  When it encounters
+ * something it can't handle, such as a backreference or a line break, it
+ * gives up and the NFA does the work.
+ ****************************************************************/
+
 /*
- * Try match of "prog" with at regline["col"].
- * Returns 0 for failure, number of lines contained in the match otherwise.
+ * Return TRUE if NFA state "state" consumes a character.
  */
-    static long
-nfa_regtry(prog, col)
-    nfa_regprog_T   *prog;
-    colnr_T	    col;
+    static int
+nfa_dfa_consumes(state)
+    nfa_state_T	*state;
 {
-    int		i;
-    regsubs_T	subs, m;
-    nfa_state_T	*start = prog->start;
-#ifdef ENABLE_LOG
-    FILE	*f;
-#endif
+    int c = state->c;
 
-    reginput = regline + col;
+    return c >= 0 || c == NFA_START_COLL || c == NFA_START_NEG_COLL
+				       || (c >= NFA_ANY && c <= NFA_NUPPER_IC);
+}
 
-#ifdef ENABLE_LOG
-    f = fopen(NFA_REGEXP_RUN_LOG, "a");
-    if (f != NULL)
+/*
+ * Return TRUE if the result of matching NFA state "state", which consumes a
+ * character, depends on options such as 'iskeyword'.
+ */
+    static int
+nfa_dfa_dynamic(state)
+    nfa_state_T	*state;
+{
+    nfa_state_T	*s;
+
+    switch (state->c)
     {
-	fprintf(f, "\n\n\t=======================================================\n");
-#ifdef DEBUG
-	fprintf(f, "\tRegexp is \"%s\"\n", nfa_regengine.expr);
-#endif
-	fprintf(f, "\tInput text is \"%s\" \n", reginput);
-	fprintf(f, "\t=======================================================\n\n");
-	nfa_print_state(f, start);
-	fprintf(f, "\n\n");
-	fclose(f);
+	case NFA_IDENT:
+	case NFA_SIDENT:
+	case NFA_KWORD:
+	case NFA_SKWORD:
+	case NFA_FNAME:
+	case NFA_SFNAME:
+	case NFA_PRINT:
+	case NFA_SPRINT:
+	    return TRUE;
+
+	case NFA_START_COLL:
+	case NFA_START_NEG_COLL:
+	    for (s = state->out; s->c != NFA_END_COLL; s = s->out)
+		if (s->c == NFA_CLASS_PRINT)
+		    return TRUE;
+	    break;
     }
-    else
-	EMSG(_("Could not open temporary log file for writing "));
-#endif
+    return FALSE;
+}
+
+/*
+ * Return TRUE if NFA state "state", which consumes a character, matches
+ * character "curc" at "p".  "p" is only used for a state for which
+ * nfa_dfa_dynamic() returns TRUE.
+ * This must do the same as nfa_regmatch(), but it may match more.
+ */
+    static int
+nfa_dfa_accept(state, curc, p)
+    nfa_state_T	*state;
+    int		curc;
+    char_u	*p;
+{
+    int		c = state->c;
+
+    switch (c)
+    {
+	case NFA_START_COLL:
+	case NFA_START_NEG_COLL:
+	  {
+	    nfa_state_T	*s = state->out;
+	    int		result_if_matched = (c == NFA_START_COLL);
+	    int		c1, c2;
+
+	    for ( ; s->c != NFA_END_COLL; s = s->out)
+	    {
+		if (s->c == NFA_RANGE_MIN)
+		{
+		    c1 = s->val;
+		    s = s->out;		/* advance to NFA_RANGE_MAX */
+		    c2 = s->val;
+		    if (curc >= c1 && curc <= c2)
+			return result_if_matched;
+		    if (ireg_ic)
+		    {
+			int curc_low = MB_TOLOWER(curc);
+
+			for ( ; c1 <= c2; ++c1)
+			    if (MB_TOLOWER(c1) == curc_low)
+				return result_if_matched;
+		    }
+		}
+		else if (s->c < 0 ? check_char_class(s->c, curc)
+				: (curc == s->c || (ireg_ic && MB_TOLOWER(curc)
+						     == MB_TOLOWER(s->c))))
+		    return result_if_matched;
+	    }
+	    return !result_if_matched;
+	  }
+
+	case NFA_ANY:	    return curc > 0;
+	case NFA_IDENT:	    return vim_isIDc(curc);
+	case NFA_SIDENT:    return !VIM_ISDIGIT(curc) && vim_isIDc(curc);
+	case NFA_KWORD:	    return vim_iswordp_buf(p, reg_buf);
+	case NFA_SKWORD:    return !VIM_ISDIGIT(curc)
+					       && vim_iswordp_buf(p, reg_buf);
+	case NFA_FNAME:	    return vim_isfilec(curc);
+	case NFA_SFNAME:    return !VIM_ISDIGIT(curc) && vim_isfilec(curc);
+	case NFA_PRINT:	    return vim_isprintc(curc);
+	case NFA_SPRINT:    return !VIM_ISDIGIT(curc) && vim_isprintc(curc);
+	case NFA_WHITE:	    return vim_iswhite(curc);
+	case NFA_NWHITE:    return curc != NUL && !vim_iswhite(curc);
+	case NFA_DIGIT:	    return ri_digit(curc) != 0;
+	case NFA_NDIGIT:    return curc != NUL && !ri_digit(curc);
+	case NFA_HEX:	    return ri_hex(curc) != 0;
+	case NFA_NHEX:	    return curc != NUL && !ri_hex(curc);
+	case NFA_OCTAL:	    return ri_octal(curc) != 0;
+	case NFA_NOCTAL:    return curc != NUL && !ri_octal(curc);
+	case NFA_WORD:	    return ri_word(curc) != 0;
+	case NFA_NWORD:	    return curc != NUL && !ri_word(curc);
+	case NFA_HEAD:	    return ri_head(curc) != 0;
+	case NFA_NHEAD:	    return curc != NUL && !ri_head(curc);
+	case NFA_ALPHA:	    return ri_alpha(curc) != 0;
+	case NFA_NALPHA:    return curc != NUL && !ri_alpha(curc);
+	case NFA_LOWER:	    return ri_lower(curc) != 0;
+	case NFA_NLOWER:    return curc != NUL && !ri_lower(curc);
+	case NFA_UPPER:	    return ri_upper(curc) != 0;
+	case NFA_NUPPER:    return curc != NUL && !ri_upper(curc);
+	case NFA_LOWER_IC:  return ri_lower(curc) || (ireg_ic && ri_upper(curc));
+	case NFA_NLOWER_IC: return curc != NUL
+			      && !(ri_lower(curc) || (ireg_ic && ri_upper(curc)));
+	case NFA_UPPER_IC:  return ri_upper(curc) || (ireg_ic && ri_lower(curc));
+	case NFA_NUPPER_IC: return curc != NUL
+			      && !(ri_upper(curc) || (ireg_ic && ri_lower(curc)));
+    }
+
+    /* regular character */
+    return c == curc || (ireg_ic && MB_TOLOWER(c) == MB_TOLOWER(curc));
+}
+
+/*
+ * Add NFA state "state" and the states reachable from it without consuming
+ * a character to dfa->dfa_set[].  Only states that consume a character or
+ * need to be checked later are added.
+ * "at_bol" is TRUE when "^" matches.
+ */
+    static void
+nfa_dfa_addstate(dfa, prog, state, at_bol)
+    nfa_dfa_T		*dfa;
+    nfa_regprog_T	*prog;
+    nfa_state_T		*state;
+    int			at_bol;
+{
+    int		nr = (int)(state - prog->state);
+
+    if (dfa->dfa_mark[nr] == dfa->dfa_markid)
+	return;
+    dfa->dfa_mark[nr] = dfa->dfa_markid;
+
+    switch (state->c)
+    {
+	case NFA_SPLIT:
+	    nfa_dfa_addstate(dfa, prog, state->out, at_bol);
+	    nfa_dfa_addstate(dfa, prog, state->out1, at_bol);
+	    return;
+
+	case NFA_BOL:
+	case NFA_BOF:
+	    if (at_bol)
+		nfa_dfa_addstate(dfa, prog, state->out, at_bol);
+	    return;
+
+	case NFA_EMPTY:
+	case NFA_NOPEN:
+	case NFA_NCLOSE:
+	case NFA_MOPEN:
+	case NFA_MOPEN1:
+	case NFA_MOPEN2:
+	case NFA_MOPEN3:
+	case NFA_MOPEN4:
+	case NFA_MOPEN5:
+	case NFA_MOPEN6:
+	case NFA_MOPEN7:
+	case NFA_MOPEN8:
+	case NFA_MOPEN9:
+	case NFA_MCLOSE:
+	case NFA_MCLOSE1:
+	case NFA_MCLOSE2:
+	case NFA_MCLOSE3:
+	case NFA_MCLOSE4:
+	case NFA_MCLOSE5:
+	case NFA_MCLOSE6:
+	case NFA_MCLOSE7:
+	case NFA_MCLOSE8:
+	case NFA_MCLOSE9:
+#ifdef FEAT_SYN_HL
+	case NFA_ZOPEN:
+	case NFA_ZOPEN1:
+	case NFA_ZOPEN2:
+	case NFA_ZOPEN3:
+	case NFA_ZOPEN4:
+	case NFA_ZOPEN5:
+	case NFA_ZOPEN6:
+	case NFA_ZOPEN7:
+	case NFA_ZOPEN8:
+	case NFA_ZOPEN9:
+	case NFA_ZCLOSE:
+	case NFA_ZCLOSE1:
+	case NFA_ZCLOSE2:
+	case NFA_ZCLOSE3:
+	case NFA_ZCLOSE4:
+	case NFA_ZCLOSE5:
+	case NFA_ZCLOSE6:
+	case NFA_ZCLOSE7:
+	case NFA_ZCLOSE8:
+	case NFA_ZCLOSE9:
+#endif
+	case NFA_ZSTART:
+	case NFA_ZEND:
+	    /* Only matter for submatches. */
+	case NFA_BOW:
+	case NFA_EOW:
+	case NFA_CURSOR:
+	case NFA_LNUM:
+	case NFA_LNUM_GT:
+	case NFA_LNUM_LT:
+	case NFA_COL:
+	case NFA_COL_GT:
+	case NFA_COL_LT:
+	case NFA_VCOL:
+	case NFA_VCOL_GT:
+	case NFA_VCOL_LT:
+	case NFA_MARK:
+	case NFA_MARK_GT:
+	case NFA_MARK_LT:
+	case NFA_VISUAL:
+	    /* Zero-width checks that are taken to always match. */
+	    nfa_dfa_addstate(dfa, prog, state->out, at_bol);
+	    return;
+
+	case NFA_START_INVISIBLE:
+	case NFA_START_INVISIBLE_FIRST:
+	case NFA_START_INVISIBLE_NEG:
+	case NFA_START_INVISIBLE_NEG_FIRST:
+	case NFA_START_INVISIBLE_BEFORE:
+	case NFA_START_INVISIBLE_BEFORE_FIRST:
+	case NFA_START_INVISIBLE_BEFORE_NEG:
+	case NFA_START_INVISIBLE_BEFORE_NEG_FIRST:
+	    /* Look-around is taken to always match, continue with what
+	     * follows the NFA_END_INVISIBLE. */
+	    nfa_dfa_addstate(dfa, prog, state->out1->out, at_bol);
+	    return;
+
+	case NFA_MATCH:
+	    dfa->dfa_flags |= DS_MATCH;
+	    break;
+
+	case NFA_EOL:
+	case NFA_EOF:
+	    dfa->dfa_flags |= DS_EOL;
+	    break;
+
+	default:
+	    if (!nfa_dfa_consumes(state) || (state->c >= NFA_FIRST_NL
+						&& state->c <= NFA_LAST_NL))
+		/* line break, backreference, composing character, etc. */
+		dfa->dfa_flags |= DS_UNKNOWN;
+	    else if (nfa_dfa_dynamic(state))
+		dfa->dfa_flags |= DS_DYNAMIC;
+	    break;
+    }
+    dfa->dfa_set[dfa->dfa_setlen++] = nr;
+}
+
+/*
+ * Start collecting NFA states in dfa->dfa_set[].
+ */
+    static void
+nfa_dfa_startset(dfa)
+    nfa_dfa_T	*dfa;
+{
+    dfa->dfa_setlen = 0;
+    dfa->dfa_flags = 0;
+    if (++dfa->dfa_markid <= 0)
+    {
+	/* wrapped around, need to clear the marks */
+	vim_memset(dfa->dfa_mark, 0, sizeof(int) * (size_t)nstate);
+	dfa->dfa_markid = 1;
+    }
+}
+
+/*
+ * Free all DFA states of "dfa".
+ */
+    static void
+nfa_dfa_flush(dfa)
+    nfa_dfa_T	*dfa;
+{
+    int		i;
+
+    for (i = 0; i < dfa->dfa_nstates; ++i)
+	vim_free(dfa->dfa_states[i]);
+    dfa->dfa_nstates = 0;
+    dfa->dfa_start[0] = -1;
+    dfa->dfa_start[1] = -1;
+}
+
+#ifdef __BORLANDC__
+static int _RTLENTRYF
+#else
+static int
+#endif
+nfa_dfa_compare __ARGS((const void *s1, const void *s2));
+
+#ifdef __BORLANDC__
+static int _RTLENTRYF
+#else
+static int
+#endif
+nfa_dfa_compare(s1, s2)
+    const void	*s1;
+    const void	*s2;
+{
+    return *(int *)s1 - *(int *)s2;
+}
+
+/*
+ * Find the DFA state for the NFA states in dfa->dfa_set[], create it when
+ * it does not exist yet.
+ * Returns the index in dfa->dfa_states[], -1 when out of memory.
+ */
+    static int
+nfa_dfa_findstate(dfa)
+    nfa_dfa_T	*dfa;
+{
+    nfa_dstate_T    *ds;
+    int		    hash = 0;
+    int		    i;
+
+    qsort((void *)dfa->dfa_set, (size_t)dfa->dfa_setlen, sizeof(int),
+							    nfa_dfa_compare);
+    for (i = 0; i < dfa->dfa_setlen; ++i)
+	hash = hash * 31 + dfa->dfa_set[i];
+
+    for (i = 0; i < dfa->dfa_nstates; ++i)
+    {
+	ds = dfa->dfa_states[i];
+	if (ds->ds_hash == hash && ds->ds_len == dfa->dfa_setlen
+		&& memcmp(ds->ds_set, dfa->dfa_set,
+				   sizeof(int) * (size_t)ds->ds_len) == 0)
+	    return i;
+    }
+
+    if (dfa->dfa_nstates == DFA_MAX_STATES)
+    {
+	/* Too many states, probably a pattern that leads to many
+	 * combinations.  Start again, give up when this happens often. */
+	nfa_dfa_flush(dfa);
+	if (++dfa->dfa_flushes > DFA_MAX_FLUSH)
+	    return -1;
+    }
+
+    ds = (nfa_dstate_T *)alloc((unsigned)(sizeof(nfa_dstate_T)
+				 + sizeof(short) * dfa->dfa_nclass
+				 + sizeof(int) * dfa->dfa_setlen));
+    if (ds == NULL)
+	return -1;
+    ds->ds_flags = dfa->dfa_flags;
+    ds->ds_hash = hash;
+    ds->ds_len = dfa->dfa_setlen;
+    ds->ds_set = (int *)(ds + 1);
+    mch_memmove(ds->ds_set, dfa->dfa_set, sizeof(int) * (size_t)ds->ds_len);
+    ds->ds_next = (short *)(ds->ds_set + ds->ds_len);
+    for (i = 0; i < dfa->dfa_nclass; ++i)
+	ds->ds_next[i] = -1;
+    dfa->dfa_states[dfa->dfa_nstates] = ds;
+    return dfa->dfa_nstates++;
+}
+
+/*
+ * Return the index of the DFA state that follows "ds" for character "curc"
+ * at "p".  Returns -1 when out of memory or the DFA is to be given up.
+ */
+    static int
+nfa_dfa_step(dfa, prog, ds, curc, p)
+    nfa_dfa_T		*dfa;
+    nfa_regprog_T	*prog;
+    nfa_dstate_T	*ds;
+    int			curc;
+    char_u		*p;
+{
+    nfa_state_T	*state;
+    int		i;
+
+    nfa_dfa_startset(dfa);
+    for (i = 0; i < ds->ds_len; ++i)
+    {
+	state = &prog->state[ds->ds_set[i]];
+	if (nfa_dfa_consumes(state) && nfa_dfa_accept(state, curc, p))
+	    nfa_dfa_addstate(dfa, prog,
+		    state->c == NFA_START_COLL || state->c == NFA_START_NEG_COLL
+					  ? state->out1->out : state->out,
+		    FALSE);
+    }
+
+    /* A match may start at every position. */
+    nfa_dfa_addstate(dfa, prog, prog->start, FALSE);
+
+    return nfa_dfa_findstate(dfa);
+}
+
+/*
+ * Return TRUE if DFA state "ds" may match at the end of the line.
+ */
+    static int
+nfa_dfa_eol_match(dfa, prog, ds)
+    nfa_dfa_T		*dfa;
+    nfa_regprog_T	*prog;
+    nfa_dstate_T	*ds;
+{
+    nfa_state_T	*state;
+    int		i;
+
+    if (!(ds->ds_flags & DS_EOL_DONE))
+    {
+	ds->ds_flags |= DS_EOL_DONE;
+	nfa_dfa_startset(dfa);
+	for (i = 0; i < ds->ds_len; ++i)
+	{
+	    state = &prog->state[ds->ds_set[i]];
+	    /* Assume "^" matches, the line may be empty. */
+	    if (state->c == NFA_EOL || state->c == NFA_EOF)
+		nfa_dfa_addstate(dfa, prog, state->out, TRUE);
+	}
+	/* An end-of-line state that was added also matches here, follow
+	 * those until no more states are added. */
+	for (i = 0; i < dfa->dfa_setlen; ++i)
+	{
+	    state = &prog->state[dfa->dfa_set[i]];
+	    if (state->c == NFA_EOL || state->c == NFA_EOF)
+		nfa_dfa_addstate(dfa, prog, state->out, TRUE);
+	}
+	if (dfa->dfa_flags & (DS_MATCH | DS_UNKNOWN))
+	    ds->ds_flags |= DS_EOL_MATCH;
+    }
+    return (ds->ds_flags & DS_EOL_MATCH) != 0;
+}
+
+/*
+ * Divide the characters below 256 into classes, so that all states of "prog"
+ * that consume a character accept either all or none of the characters in
+ * a class.  Skips states for which nfa_dfa_dynamic() is TRUE.
+ */
+    static void
+nfa_dfa_init_class(dfa, prog)
+    nfa_dfa_T		*dfa;
+    nfa_regprog_T	*prog;
+{
+    short	map[512];
+    int		nclass;
+    int		i;
+    int		c;
+    int		k;
+    nfa_state_T	*s;
+
+    /* Collect the states that are part of a collection, they are not used
+     * by themselves. */
+    nfa_dfa_startset(dfa);
+    for (i = 0; i < prog->nstate; ++i)
+	if (prog->state[i].c == NFA_START_COLL
+				     || prog->state[i].c == NFA_START_NEG_COLL)
+	    for (s = prog->state[i].out; s->c != NFA_END_COLL; s = s->out)
+		dfa->dfa_mark[s - prog->state] = dfa->dfa_markid;
+
+    vim_memset(dfa->dfa_class, 0, 256);
+    dfa->dfa_nclass = 1;
+    for (i = 0; i < prog->nstate; ++i)
+    {
+	s = &prog->state[i];
+	if (dfa->dfa_mark[i] == dfa->dfa_markid || !nfa_dfa_consumes(s)
+		|| (s->c >= NFA_FIRST_NL && s->c <= NFA_LAST_NL)
+		|| nfa_dfa_dynamic(s))
+	    continue;
+	for (k = 0; k < dfa->dfa_nclass * 2; ++k)
+	    map[k] = -1;
+	nclass = 0;
+	for (c = 1; c < 256; ++c)
+	{
+	    k = dfa->dfa_class[c] * 2 + (nfa_dfa_accept(s, c, NULL) ? 1 : 0);
+	    if (map[k] < 0)
+		map[k] = nclass++;
+	    dfa->dfa_class[c] = map[k];
+	}
+	dfa->dfa_nclass = nclass;
+    }
+}
+
+/*
+ * Check with the lazy DFA whether "prog" may match in the current line,
+ * starting at column "col".
+ * Returns FALSE when there is no match, TRUE when there may be one.
+ */
+    static int
+nfa_dfa_match(prog, col)
+    nfa_regprog_T   *prog;
+    colnr_T	    col;
+{
+    nfa_dfa_T	    *dfa = prog->dfa;
+    nfa_dstate_T    *ds;
+    char_u	    *p = regline + col;
+    int		    curc;
+    int		    clen = 1;
+    int		    idx;
+    int		    cls;
+
+    if (dfa == NULL)
+    {
+	dfa = (nfa_dfa_T *)alloc_clear((unsigned)sizeof(nfa_dfa_T));
+	if (dfa == NULL)
+	    return TRUE;
+	dfa->dfa_mark = (int *)alloc_clear((unsigned)(sizeof(int) * nstate));
+	dfa->dfa_set = (int *)alloc((unsigned)(sizeof(int) * nstate));
+	if (dfa->dfa_mark == NULL || dfa->dfa_set == NULL)
+	{
+	    nfa_dfa_free(dfa);
+	    return TRUE;
+	}
+	dfa->dfa_key = -1;
+	prog->dfa = dfa;
+    }
+    if (dfa->dfa_key != DFA_KEY)
+    {
+	/* First use, or 'ignorecase' or 'encoding' changed. */
+	nfa_dfa_flush(dfa);
+	nfa_dfa_init_class(dfa, prog);
+	dfa->dfa_key = DFA_KEY;
+    }
+
+    idx = dfa->dfa_start[col == 0];
+    if (idx < 0)
+    {
+	nfa_dfa_startset(dfa);
+	nfa_dfa_addstate(dfa, prog, prog->start, col == 0);
+	idx = nfa_dfa_findstate(dfa);
+	if (idx < 0)
+	    goto giveup;
+	if (dfa->dfa_states[idx]->ds_flags & (DS_MATCH | DS_UNKNOWN))
+	{
+	    /* Matches the empty string or starts with something the DFA
+	     * can't handle, it's no use. */
+	    prog->dfa_ok = FALSE;
+	    return TRUE;
+	}
+	dfa->dfa_start[col == 0] = idx;
+    }
+    ds = dfa->dfa_states[idx];
+
+    for (;;)
+    {
+	if (ds->ds_flags & (DS_MATCH | DS_UNKNOWN))
+	    return TRUE;
+
+	curc = *p;
+	if (curc == NUL)
+	    return nfa_dfa_eol_match(dfa, prog, ds);
+#ifdef FEAT_MBYTE
+	if (has_mbyte && curc >= 0x80)
+	{
+	    curc = (*mb_ptr2char)(p);
+	    clen = (*mb_ptr2len)(p);
+	    /* A composing character only matches with NFA_COMPOSING. */
+	    if (enc_utf8 && clen != utf_char2len(curc))
+		return TRUE;
+	}
+	else
+	    clen = 1;
+#endif
+
+	if (curc < 256 && !(ds->ds_flags & DS_DYNAMIC))
+	{
+	    cls = dfa->dfa_class[curc];
+	    idx = ds->ds_next[cls];
+	    if (idx < 0)
+	    {
+		int flushes = dfa->dfa_flushes;
+
+		idx = nfa_dfa_step(dfa, prog, ds, curc, p);
+		if (idx < 0)
+		    goto giveup;
+		/* "ds" was freed when the DFA was flushed */
+		if (dfa->dfa_flushes == flushes)
+		    ds->ds_next[cls] = idx;
+	    }
+	}
+	else
+	{
+	    idx = nfa_dfa_step(dfa, prog, ds, curc, p);
+	    if (idx < 0)
+		goto giveup;
+	}
+	ds = dfa->dfa_states[idx];
+	p += clen;
+    }
+
+giveup:
+    /* Out of memory or too many states: don't use the DFA again. */
+    prog->dfa_ok = FALSE;
+    nfa_dfa_flush(dfa);
+    return TRUE;
+}
+
+/*
+ * Free the lazy DFA "dfa".
+ */
+    static void
+nfa_dfa_free(dfa)
+    nfa_dfa_T	*dfa;
+{
+    if (dfa != NULL)
+    {
+	nfa_dfa_flush(dfa);
+	vim_free(dfa->dfa_mark);
+	vim_free(dfa->dfa_set);
+	vim_free(dfa);
+    }
+}
+
+/*
+ * Try match of "prog" with at regline["col"].
+ * Returns 0 for failure, number of lines contained in the match otherwise.
+ */
+    static long
+nfa_regtry(prog, col)
+    nfa_regprog_T   *prog;
+    colnr_T	    col;
+{
+    int		i;
+    regsubs_T	subs, m;
+    nfa_state_T	*start = prog->start;
+#ifdef ENABLE_LOG
+    FILE	*f;
+#endif
+
+    reginput = regline + col;
+
+#ifdef ENABLE_LOG
+    f = fopen(NFA_REGEXP_RUN_LOG, "a");
+    if (f != NULL)
+    {
+	fprintf(f, "\n\n\t=======================================================\n");
+#ifdef DEBUG
+	fprintf(f, "\tRegexp is \"%s\"\n", nfa_regengine.expr);
+#endif
+	fprintf(f, "\tInput text is \"%s\" \n", reginput);
+	fprintf(f, "\t=======================================================\n\n");
+	nfa_print_state(f, start);
+	fprintf(f, "\n\n");
+	fclose(f);
+    }
+    else
+	EMSG(_("Could not open temporary log file for writing "));
+#endif
 
     clear_sub(&subs.norm);
     clear_sub(&m.norm);
@@ -6852,6 +8009,7 @@ nfa_regexec_both(line, startcol)
     long	    retval = 0L;
     int		    i;
     colnr_T	    col = startcol;
+    int		    skip_line = FALSE;
 
     if (REG_MULTI)
     {
@@ -6898,8 +8056,14 @@ nfa_regexec_both(line, startcol)
     nfa_regengine.expr = prog->pattern;
 #endif
 
+    /* When streaming, a line without a match is skipped by starting at the
+     * end of it, nfa_regmatch() goes on with the next line. */
     if (prog->reganch && col > 0)
-	return 0L;
+    {
+	if (nfa_stream_end == 0)
+	    return 0L;
+	skip_line = TRUE;
+    }
 
     need_clear_subexpr = TRUE;
 #ifdef FEAT_SYN_HL
@@ -6913,28 +8077,47 @@ nfa_regexec_both(line, startcol)
 	nfa_has_zsubexpr = FALSE;
 #endif
 
-    if (prog->regstart != NUL)
+    nstate = prog->nstate;
+
+    if (!skip_line && prog->regstart != NUL)
     {
 	/* Skip ahead until a character we know the match must start with.
 	 * When there is none there is no match. */
 	if (skip_to_start(prog->regstart, &col) == FAIL)
-	    return 0L;
+	{
+	    if (nfa_stream_end == 0)
+		return 0L;
+	    skip_line = TRUE;
+	}
 
 	/* If match_text is set it contains the full text that must match.
 	 * Nothing else to try. Doesn't handle combining chars well. */
-	if (prog->match_text != NULL
+	else if (prog->match_text != NULL
 #ifdef FEAT_MBYTE
 		    && !ireg_icombine
 #endif
 		)
-	    return find_match_text(col, prog->regstart, prog->match_text);
+	{
+	    retval = find_match_text(col, prog->regstart, prog->match_text);
+	    if (retval != 0 || nfa_stream_end == 0)
+		return retval;
+	    skip_line = TRUE;
+	}
     }
 
-    /* If the start column is past the maximum column: no need to try. */
-    if (ireg_maxcol > 0 && col >= ireg_maxcol)
-	goto theend;
+    /* If the start column is past the maximum column: no need to try.
+     * Also skip a line where a quick check finds there is no match. */
+    if (!skip_line && ((ireg_maxcol > 0 && col >= ireg_maxcol)
+					   || !nfa_line_may_match(prog, col)))
+    {
+	if (nfa_stream_end == 0)
+	    goto theend;
+	skip_line = TRUE;
+    }
+
+    if (skip_line)
+	col = (colnr_T)STRLEN(regline);
 
-    nstate = prog->nstate;
     for (i = 0; i < nstate; ++i)
     {
 	prog->state[i].id = i;
@@ -6964,6 +8147,7 @@ nfa_regcomp(expr, re_flags)
     nfa_regprog_T	*prog = NULL;
     size_t		prog_size;
     int			*postfix;
+    int			*p;
 
     if (expr == NULL)
 	return NULL;
@@ -7026,18 +8210,32 @@ nfa_regcomp(expr, re_flags)
     if (prog->start == NULL)
 	goto fail;
 
+    /* A collection with "\_[" can also match a line break. */
+    for (p = postfix; p < post_ptr; ++p)
+	if (*p == NFA_NEWL)
+	{
+	    regflags |= RF_HASNL;
+	    break;
+	}
+
     prog->regflags = regflags;
     prog->engine = &nfa_regengine;
     prog->nstate = nstate;
+    prog->has_zstart = nfa_has_zstart;
     prog->has_zend = nfa_has_zend;
     prog->has_backref = nfa_has_backref;
     prog->nsubexp = regnpar;
+    prog->dfa = NULL;
 
     nfa_postprocess(prog);
 
     prog->reganch = nfa_get_reganch(prog->start, 0);
     prog->regstart = nfa_get_regstart(prog->start, 0);
     prog->match_text = nfa_get_match_text(prog->start);
+    prog->regmust = NULL;
+    if (prog->match_text == NULL)
+	prog->regmust = nfa_get_regmust(postfix, post_ptr, prog->regstart);
+    prog->regmlen = prog->regmust == NULL ? 0 : (int)STRLEN(prog->regmust);
 
 #ifdef ENABLE_LOG
     nfa_postfix_dump(expr, OK);
@@ -7080,6 +8278,8 @@ nfa_regfree(prog)
     if (prog != NULL)
     {
 	vim_free(((nfa_regprog_T *)prog)->match_text);
+	vim_free(((nfa_regprog_T *)prog)->regmust);
+	nfa_dfa_free(((nfa_regprog_T *)prog)->dfa);
 #ifdef DEBUG
 	vim_free(((nfa_regprog_T *)prog)->pattern);
 #endif
@@ -7167,6 +8367,77 @@ nfa_regexec_multi(rmp, win, buf, lnum, col, tm)
     return nfa_regexec_both(NULL, col);
 }
 
+/*
+ * Match a regexp against lines "*lnump" to "lnum_end", see
+ * vim_regexec_multi_lines().
+ * The NFA runs over the lines once.  At the end of a line the start state is
+ * added for the next line, thus a match may start in any of the lines.  When
+ * no match is in progress lines are skipped quickly when nfa_line_may_match()
+ * says there is no match.
+ */
+    static long
+nfa_regexec_multi_lines(rmp, win, buf, lnump, col, lnum_end, tm)
+    regmmatch_T	*rmp;
+    win_T	*win;		/* window in which to search or NULL */
+    buf_T	*buf;		/* buffer in which to search */
+    linenr_T	*lnump;		/* nr of first line to look for a match */
+    colnr_T	col;		/* column to start looking in first line */
+    linenr_T	lnum_end;	/* nr of last line to look for a match */
+    proftime_T	*tm;		/* timeout limit or NULL */
+{
+    nfa_regprog_T   *prog = (nfa_regprog_T *)rmp->regprog;
+    long	    r;
+    linenr_T	    off;
+    int		    i;
+
+    /* With "\zs" the start of the match doesn't tell in what line it was
+     * found. */
+    if (prog->has_zstart || prog->start->c != NFA_MOPEN
+						      || *lnump >= lnum_end)
+	return regexec_lines_loop(rmp, win, buf, lnump, col, lnum_end, tm);
+
+    reg_match = NULL;
+    reg_mmatch = rmp;
+    reg_buf = buf;
+    reg_win = win;
+    reg_firstlnum = *lnump;
+    reg_maxline = reg_buf->b_ml.ml_line_count - *lnump;
+    reg_line_lbr = FALSE;
+    ireg_ic = rmp->rmm_ic;
+#ifdef FEAT_MBYTE
+    ireg_icombine = FALSE;
+#endif
+    ireg_maxcol = rmp->rmm_maxcol;
+
+    nfa_stream_end = lnum_end - *lnump;
+    if (nfa_stream_end > reg_maxline)
+	nfa_stream_end = reg_maxline;
+    nfa_stream_tm = tm;
+
+    r = nfa_regexec_both(NULL, col);
+
+    if (r > 0)
+    {
+	/* Make the result relative to the line where the match starts. */
+	off = rmp->startpos[0].lnum;
+	for (i = 0; i < NSUBEXP; ++i)
+	{
+	    if (rmp->startpos[i].lnum >= 0)
+		rmp->startpos[i].lnum -= off;
+	    if (rmp->endpos[i].lnum >= 0)
+		rmp->endpos[i].lnum -= off;
+	}
+	r -= off;
+    }
+    else
+	off = reglnum < nfa_stream_end ? reglnum : nfa_stream_end;
+    *lnump += off;
+
+    nfa_stream_end = 0;
+    nfa_stream_tm = NULL;
+    return r;
+}
+
 #ifdef DEBUG
 # undef ENABLE_LOG
 #endif
@@ -117,6 +117,11 @@ static foldinfo_T win_foldinfo;	/* info for 'foldcolumn' */
 static schar_T	*current_ScreenLine;
 
 static void win_update __ARGS((win_T *wp));
+static int win_row_cache_usable __ARGS((win_T *wp, linenr_T lnum));
+static void win_row_cache_clear __ARGS((win_T *wp));
+static void win_row_cache_invalid __ARGS((win_T *wp, linenr_T top, linenr_T bot));
+static int win_row_cache_draw __ARGS((win_T *wp, linenr_T lnum, int row));
+static void win_row_cache_save __ARGS((win_T *wp, linenr_T lnum, int row, int rows));
 static void win_draw_end __ARGS((win_T *wp, int c1, int c2, int row, int endrow, hlf_T hl));
 #ifdef FEAT_FOLDING
 static void fold_line __ARGS((win_T *wp, long fold_count, foldinfo_T *foldinfo, linenr_T lnum, int row));
@@ -125,6 +130,9 @@ static void copy_text_attr __ARGS((int off, char_u *buf, int len, int attr));
 #endif
 static int win_line __ARGS((win_T *, linenr_T, int, int, int nochange));
 static int char_needs_redraw __ARGS((int off_from, int off_to, int cols));
+static int insdel_cell_differs __ARGS((int off_new, int off_old));
+static void screen_shift_chars __ARGS((int row, int col, int count, int ins));
+static void screen_ins_del_chars __ARGS((int row, int coloff, int endcol, int width));
 #ifdef FEAT_RIGHTLEFT
 static void screen_line __ARGS((int row, int coloff, int endcol, int clear_width, int rlflag));
 # define SCREEN_LINE(r, o, e, c, rl)    screen_line((r), (o), (e), (c), (rl))
@@ -177,6 +185,17 @@ static void win_redr_custom __ARGS((win_T *wp, int draw_ruler));
 static void win_redr_ruler __ARGS((win_T *wp, int always));
 #endif
 
+/*
+ * Counters for ":termstat".
+ */
+static long	redraw_count = 0;	/* redraws that produced output */
+static long_u	redraw_bytes_last = 0;	/* bytes sent for the last one */
+static long_u	redraw_bytes_max = 0;	/* most bytes sent for one redraw */
+static long_u	redraw_bytes_total = 0;	/* bytes sent for all redraws */
+static long	insdel_char_count = 0;	/* times T_CIC or T_CDC was used */
+static long	line_draw_count = 0;	/* lines drawn with win_line() */
+static long	row_cache_hits = 0;	/* lines drawn from w_row_cache */
+
 #if defined(FEAT_CLIPBOARD) || defined(FEAT_VERTSPLIT)
 /* Ugly global: overrule attribute used by screen_char() */
 static int screen_char_attr = 0;
@@ -472,6 +491,9 @@ update_screen(type)
 #if defined(FEAT_SEARCH_EXTRA) || defined(FEAT_CLIPBOARD)
     int		did_one;
 #endif
+    long_u	bytes_start;
+    long_u	bytes;
+    long_u	writes;
 
     /* Don't do anything if the screen structures are (not yet) valid. */
     if (!screen_valid(TRUE))
@@ -505,6 +527,7 @@ update_screen(type)
     }
 
     updating_screen = TRUE;
+    out_stats(&bytes_start, &writes);
 #ifdef FEAT_SYN_HL
     ++display_tick;	    /* let syntax code know we're in a next round of
 			     * display updating */
@@ -718,6 +741,16 @@ update_screen(type)
 	maybe_intro_message();
     did_intro = TRUE;
 
+    out_stats(&bytes, &writes);
+    if (bytes > bytes_start)
+    {
+	++redraw_count;
+	redraw_bytes_last = bytes - bytes_start;
+	redraw_bytes_total += redraw_bytes_last;
+	if (redraw_bytes_last > redraw_bytes_max)
+	    redraw_bytes_max = redraw_bytes_last;
+    }
+
 #ifdef FEAT_GUI
     /* Redraw the cursor and update the scrollbars when all screen updating is
      * done. */
@@ -1125,6 +1158,11 @@ win_update(wp)
 	    mod_bot = wp->w_redraw_bot + 1;
 	else
 	    mod_bot = 0;
+	/* The rows remembered for these lines are outdated, also when they
+	 * are not displayed now. */
+	if (mod_top != 0)
+	    win_row_cache_invalid(wp, mod_top,
+					 mod_bot == 0 ? mod_top : mod_bot - 1);
 	wp->w_redraw_top = 0;	/* reset for next time */
 	wp->w_redraw_bot = 0;
 	if (buf->b_mod_set)
@@ -1239,6 +1277,11 @@ win_update(wp)
 	    mod_bot = MAXLNUM;
     }
 
+    /* Rows remembered in w_row_cache can only be used when just the text
+     * and the part of it that is displayed may have changed. */
+    if (type != VALID && type != INVERTED && type != INVERTED_ALL)
+	win_row_cache_clear(wp);
+
     /*
      * When only displaying the lines at the top, set top_end.  Used when
      * window has scrolled down for msg_scrolled.
@@ -1302,7 +1345,15 @@ win_update(wp)
 	{
 	    /*
 	     * New topline is above old topline: May scroll down.
+	     * Scroll as long as one row remains, unless the terminal can't
+	     * scroll the window and it is redrawn from ScreenLines[] anyway.
 	     */
+	    int	    max_off = wp->w_height;
+
+#ifdef FEAT_VERTSPLIT
+	    if (W_WIDTH(wp) != Columns && *T_CSV == NUL)
+		max_off = wp->w_height - 2;
+#endif
 #ifdef FEAT_FOLDING
 	    if (hasAnyFolding(wp))
 	    {
@@ -1314,7 +1365,7 @@ win_update(wp)
 		for (ln = wp->w_topline; ln < wp->w_lines[0].wl_lnum; ++ln)
 		{
 		    ++j;
-		    if (j >= wp->w_height - 2)
+		    if (j >= max_off)
 			break;
 		    (void)hasFoldingWin(wp, ln, NULL, &ln, TRUE, NULL);
 		}
@@ -1322,7 +1373,7 @@ win_update(wp)
 	    else
 #endif
 		j = wp->w_lines[0].wl_lnum - wp->w_topline;
-	    if (j < wp->w_height - 2)		/* not too far off */
+	    if (j < max_off)			/* not too far off */
 	    {
 		i = plines_m_win(wp, wp->w_topline, wp->w_lines[0].wl_lnum - 1);
 #ifdef FEAT_DIFF
@@ -1331,7 +1382,7 @@ win_update(wp)
 		    i += diff_check_fill(wp, wp->w_lines[0].wl_lnum)
 							  - wp->w_old_topfill;
 #endif
-		if (i < wp->w_height - 2)	/* less than a screen off */
+		if (i < max_off)		/* less than a screen off */
 		{
 		    /*
 		     * Try to insert the correct number of lines.
@@ -1981,6 +2032,21 @@ win_update(wp)
 		 * will draw "@  " lines below. */
 		row = wp->w_height + 1;
 	    }
+	    else if ((mod_top == 0 || lnum < mod_top
+					|| (lnum > mod_top && lnum >= mod_bot))
+		    && win_row_cache_draw(wp, lnum, srow) == OK)
+	    {
+		/* Scrolled back into view, use the row that was drawn for
+		 * this line before. */
+		row = srow + 1;
+#ifdef FEAT_FOLDING
+		wp->w_lines[idx].wl_folded = FALSE;
+		wp->w_lines[idx].wl_lastlnum = lnum;
+#endif
+#ifdef FEAT_SYN_HL
+		did_update = DID_NONE;
+#endif
+	    }
 	    else
 	    {
 #ifdef FEAT_SEARCH_EXTRA
@@ -1997,6 +2063,8 @@ win_update(wp)
 		 * Display one line.
 		 */
 		row = win_line(wp, lnum, srow, wp->w_height, mod_top == 0);
+		++line_draw_count;
+		win_row_cache_save(wp, lnum, srow, row - srow);
 
 #ifdef FEAT_FOLDING
 		wp->w_lines[idx].wl_folded = FALSE;
@@ -2208,6 +2276,286 @@ draw_signcolumn(wp)
 }
 #endif
 
+/*
+ * Number of rows remembered for each window in w_row_cache.
+ */
+#define ROW_CACHE_SLOTS 128
+
+/*
+ * Return TRUE when the row drawn for line "lnum" in window "wp" only depends
+ * on the text, the options and the highlighting, not on where the cursor is
+ * or what is being done.  Then it can be remembered in w_row_cache.
+ */
+    static int
+win_row_cache_usable(wp, lnum)
+    win_T	*wp;
+    linenr_T	lnum;
+{
+    return (dollar_vcol < 0
+	    && !highlight_match
+	    && !(VIsual_active && wp->w_buffer == curwin->w_buffer)
+	    && !(lnum == wp->w_topline && wp->w_skipcol > 0)
+	    && !wp->w_p_rnu
+#ifdef FEAT_RIGHTLEFT
+	    && !wp->w_p_rl
+#endif
+#ifdef FEAT_SYN_HL
+	    && !wp->w_p_cul
+	    && !wp->w_p_cuc
+#endif
+#ifdef FEAT_SPELL
+	    && !wp->w_p_spell
+#endif
+#ifdef FEAT_CONCEAL
+	    && wp->w_p_cole == 0
+#endif
+#ifdef FEAT_DIFF
+	    && !wp->w_p_diff
+#endif
+#ifdef FEAT_FOLDING
+	    && wp->w_p_fdc == 0
+#endif
+#ifdef FEAT_SIGNS
+	    && !draw_signcolumn(wp)
+#endif
+#ifdef FEAT_MBYTE
+	    && enc_dbcs != DBCS_JPNU
+#endif
+	    );
+}
+
+/*
+ * Forget all rows remembered for window "wp".
+ */
+    static void
+win_row_cache_clear(wp)
+    win_T	*wp;
+{
+    rowcache_T	*rc = &wp->w_row_cache;
+    int		i;
+
+    for (i = 0; i < rc->rc_slots; ++i)
+	rc->rc_lnum[i] = 0;
+}
+
+/*
+ * Forget the rows remembered for lines "top" to "bot" of window "wp".
+ */
+    static void
+win_row_cache_invalid(wp, top, bot)
+    win_T	*wp;
+    linenr_T	top;
+    linenr_T	bot;
+{
+    rowcache_T	*rc = &wp->w_row_cache;
+    int		i;
+
+    for (i = 0; i < rc->rc_slots; ++i)
+	if (rc->rc_lnum[i] >= top && rc->rc_lnum[i] <= bot)
+	    rc->rc_lnum[i] = 0;
+}
+
+/*
+ * Free the rows remembered for window "wp".
+ */
+    void
+win_row_cache_free(wp)
+    win_T	*wp;
+{
+    rowcache_T	*rc = &wp->w_row_cache;
+
+    vim_free(rc->rc_lnum);
+    vim_free(rc->rc_tick);
+    vim_free(rc->rc_endcol);
+    vim_free(rc->rc_lines);
+    vim_free(rc->rc_attrs);
+    rc->rc_lnum = NULL;
+    rc->rc_tick = NULL;
+    rc->rc_endcol = NULL;
+    rc->rc_lines = NULL;
+    rc->rc_attrs = NULL;
+#ifdef FEAT_MBYTE
+    vim_free(rc->rc_lines_uc);
+    rc->rc_lines_uc = NULL;
+#endif
+    rc->rc_slots = 0;
+}
+
+/*
+ * Draw line "lnum" of window "wp" at window row "row", using the row that
+ * was remembered when it was drawn before.
+ * Returns FAIL when there is no such row for the text as it is now, then
+ * win_line() must be used.
+ */
+    static int
+win_row_cache_draw(wp, lnum, row)
+    win_T	*wp;
+    linenr_T	lnum;
+    int		row;
+{
+    rowcache_T	*rc = &wp->w_row_cache;
+    int		width = W_WIDTH(wp);
+    int		slot;
+    unsigned	off_from;
+    unsigned	off_to;
+#ifdef FEAT_MBYTE
+    int		col;
+#endif
+
+    if (rc->rc_slots == 0
+	    || rc->rc_width != width
+	    || rc->rc_leftcol != wp->w_leftcol
+#ifdef FEAT_MBYTE
+	    || (enc_utf8 && rc->rc_lines_uc == NULL)
+#endif
+	    || !win_row_cache_usable(wp, lnum))
+	return FAIL;
+    slot = (int)(lnum % rc->rc_slots);
+    if (rc->rc_lnum[slot] != lnum
+			 || rc->rc_tick[slot] != wp->w_buffer->b_changedtick)
+	return FAIL;
+
+    off_from = slot * width;
+    off_to = (unsigned)(current_ScreenLine - ScreenLines);
+    mch_memmove(ScreenLines + off_to, rc->rc_lines + off_from,
+					      (size_t)width * sizeof(schar_T));
+    mch_memmove(ScreenAttrs + off_to, rc->rc_attrs + off_from,
+					      (size_t)width * sizeof(sattr_T));
+#ifdef FEAT_MBYTE
+    if (enc_utf8)
+    {
+	mch_memmove(ScreenLinesUC + off_to, rc->rc_lines_uc + off_from,
+					     (size_t)width * sizeof(u8char_T));
+	for (col = 0; col < width; ++col)
+	    ScreenLinesC[0][off_to + col] = 0;
+    }
+#endif
+    SCREEN_LINE(W_WINROW(wp) + row, W_WINCOL(wp), rc->rc_endcol[slot],
+							   width, FALSE);
+    ++row_cache_hits;
+
+    /* Like win_line() does for the cursor line. */
+    if (wp == curwin && lnum == curwin->w_cursor.lnum)
+    {
+	curwin->w_cline_row = row;
+	curwin->w_cline_height = 1;
+#ifdef FEAT_FOLDING
+	curwin->w_cline_folded = FALSE;
+#endif
+	curwin->w_valid |= (VALID_CHEIGHT|VALID_CROW);
+    }
+    return OK;
+}
+
+/*
+ * Remember the row drawn by win_line() for line "lnum" of window "wp" at
+ * window row "row", when the line took "rows" rows.
+ */
+    static void
+win_row_cache_save(wp, lnum, row, rows)
+    win_T	*wp;
+    linenr_T	lnum;
+    int		row;
+    int		rows;
+{
+    rowcache_T	*rc = &wp->w_row_cache;
+    int		width = W_WIDTH(wp);
+    int		slot;
+    unsigned	off_from;
+    unsigned	off_to;
+    int		col;
+
+    /* A line that doesn't fit in one row is not remembered, forget what
+     * was remembered for it before. */
+    if (rc->rc_slots > 0)
+    {
+	slot = (int)(lnum % rc->rc_slots);
+	if (rc->rc_lnum[slot] == lnum)
+	    rc->rc_lnum[slot] = 0;
+    }
+    if (rows != 1 || width <= 0 || !win_row_cache_usable(wp, lnum))
+	return;
+
+    off_from = LineOffset[W_WINROW(wp) + row] + W_WINCOL(wp);
+#ifdef FEAT_MBYTE
+    /* Composing characters are not remembered. */
+    if (enc_utf8)
+	for (col = 0; col < width; ++col)
+	    if (ScreenLinesUC[off_from + col] != 0
+				      && ScreenLinesC[0][off_from + col] != 0)
+		return;
+#endif
+
+    if (rc->rc_slots == 0
+	    || rc->rc_width != width
+#ifdef FEAT_MBYTE
+	    || (enc_utf8 && rc->rc_lines_uc == NULL)
+#endif
+	    )
+    {
+	win_row_cache_free(wp);
+	rc->rc_lnum = (linenr_T *)lalloc_clear(
+			  (long_u)(ROW_CACHE_SLOTS * sizeof(linenr_T)), FALSE);
+	rc->rc_tick = (int *)lalloc(
+				(long_u)(ROW_CACHE_SLOTS * sizeof(int)), FALSE);
+	rc->rc_endcol = (int *)lalloc(
+				(long_u)(ROW_CACHE_SLOTS * sizeof(int)), FALSE);
+	rc->rc_lines = (schar_T *)lalloc(
+		    (long_u)(ROW_CACHE_SLOTS * width * sizeof(schar_T)), FALSE);
+	rc->rc_attrs = (sattr_T *)lalloc(
+		    (long_u)(ROW_CACHE_SLOTS * width * sizeof(sattr_T)), FALSE);
+#ifdef FEAT_MBYTE
+	if (enc_utf8)
+	    rc->rc_lines_uc = (u8char_T *)lalloc(
+		   (long_u)(ROW_CACHE_SLOTS * width * sizeof(u8char_T)), FALSE);
+#endif
+	if (rc->rc_lnum == NULL || rc->rc_tick == NULL
+		|| rc->rc_endcol == NULL || rc->rc_lines == NULL
+		|| rc->rc_attrs == NULL
+#ifdef FEAT_MBYTE
+		|| (enc_utf8 && rc->rc_lines_uc == NULL)
+#endif
+		)
+	{
+	    win_row_cache_free(wp);
+	    return;
+	}
+	rc->rc_slots = ROW_CACHE_SLOTS;
+	rc->rc_width = width;
+	rc->rc_leftcol = wp->w_leftcol;
+    }
+    else if (rc->rc_leftcol != wp->w_leftcol)
+    {
+	win_row_cache_clear(wp);
+	rc->rc_leftcol = wp->w_leftcol;
+    }
+
+    slot = (int)(lnum % rc->rc_slots);
+    off_to = slot * width;
+    mch_memmove(rc->rc_lines + off_to, ScreenLines + off_from,
+					      (size_t)width * sizeof(schar_T));
+    mch_memmove(rc->rc_attrs + off_to, ScreenAttrs + off_from,
+					      (size_t)width * sizeof(sattr_T));
+#ifdef FEAT_MBYTE
+    if (enc_utf8)
+	mch_memmove(rc->rc_lines_uc + off_to, ScreenLinesUC + off_from,
+					     (size_t)width * sizeof(u8char_T));
+#endif
+
+    /* Trailing blanks are cleared when drawing the row. */
+    for (col = width; col > 0; --col)
+	if (ScreenLines[off_from + col - 1] != ' '
+		|| ScreenAttrs[off_from + col - 1] != 0
+#ifdef FEAT_MBYTE
+		|| (enc_utf8 && ScreenLinesUC[off_from + col - 1] != 0)
+#endif
+		)
+	    break;
+    rc->rc_endcol[slot] = col;
+    rc->rc_tick[slot] = wp->w_buffer->b_changedtick;
+    rc->rc_lnum[slot] = lnum;
+}
+
 /*
  * Clear the rest of the window and mark the unused lines with "c1".  use "c2"
  * as the filler character.
@@ -3294,7 +3642,15 @@ win_line(wp, lnum, startrow, endrow, nochange)
     if (v > 0)
     {
 #ifdef FEAT_MBYTE
-	char_u	*prev_ptr = ptr;
+	char_u	*prev_ptr;
+#endif
+	colnr_T	startvcol;
+
+	/* In a long line start at a remembered virtual column. */
+	ptr += vcol_cache_find(wp, lnum, (colnr_T)v, &startvcol);
+	vcol = startvcol;
+#ifdef FEAT_MBYTE
+	prev_ptr = ptr;
 #endif
 	while (vcol < v && *ptr != NUL)
 	{
@@ -5507,6 +5863,253 @@ char_needs_redraw(off_from, off_to, cols)
     return FALSE;
 }
 
+/*
+ * Return TRUE if the new cell at "off_new" in current_ScreenLine differs from
+ * the cell on the screen at "off_old".  Either one can be -1 for a blank cell.
+ */
+    static int
+insdel_cell_differs(off_new, off_old)
+    int		off_new;
+    int		off_old;
+{
+    int		off;
+
+    if (off_new >= 0 && off_old >= 0)
+	return char_needs_redraw(off_new, off_old, 1);
+    off = off_new >= 0 ? off_new : off_old;
+    if (off < 0)
+	return FALSE;
+    return ScreenLines[off] != ' ' || ScreenAttrs[off] != 0
+#ifdef FEAT_MBYTE
+		|| (enc_utf8 && ScreenLinesUC[off] != 0)
+#endif
+		;
+}
+
+#define INSDEL_CHARS_MAX 32	/* max nr of chars to insert or delete */
+
+/*
+ * Output T_CIC or T_CDC for "count" characters at "col" in row "row" and
+ * shift ScreenLines[] up to the end of the screen line like the terminal
+ * does.  The cursor doesn't move.
+ */
+    static void
+screen_shift_chars(row, col, count, ins)
+    int		row;
+    int		col;
+    int		count;
+    int		ins;		/* TRUE: insert, FALSE: delete */
+{
+    unsigned	off = LineOffset[row] + col;
+    unsigned	from;
+    unsigned	to;
+    int		n = screen_Columns - col - count;
+#ifdef FEAT_MBYTE
+    int		i;
+#endif
+
+    windgoto(row, col);
+    screen_stop_highlight();
+    if (ins)
+	term_insert_chars(count);
+    else
+	term_delete_chars(count);
+    ++insdel_char_count;
+
+    if (ins)
+    {
+	from = off;
+	to = off + count;
+    }
+    else
+    {
+	from = off + count;
+	to = off;
+    }
+    mch_memmove(ScreenLines + to, ScreenLines + from, n * sizeof(schar_T));
+#ifdef FEAT_MBYTE
+    if (enc_utf8)
+    {
+	mch_memmove(ScreenLinesUC + to, ScreenLinesUC + from,
+							n * sizeof(u8char_T));
+	for (i = 0; i < Screen_mco; ++i)
+	    mch_memmove(ScreenLinesC[i] + to, ScreenLinesC[i] + from,
+							n * sizeof(u8char_T));
+    }
+#endif
+    mch_memmove(ScreenAttrs + to, ScreenAttrs + from, n * sizeof(sattr_T));
+    lineclear(ins ? off : off + n, count);
+}
+
+/*
+ * Called by screen_line() before it compares the new line with what is on
+ * the screen.  When the new text is the old text with a few characters
+ * inserted or deleted, e.g., when typing in the middle of a line, shift the
+ * text on the screen with T_CIC or T_CDC, so that only the inserted
+ * characters need to be sent instead of the whole rest of the line.
+ * When further on the text is back in its old position, e.g., because a Tab
+ * got narrower, shift back from there with the opposite code.
+ * The cost is counted in bytes: the length of the codes plus the number of
+ * cells that still differ afterwards.  ScreenLines[] is shifted the same way
+ * as the terminal does, screen_line() then redraws what still differs.
+ * Only to be used when row "row" of the window continues up to the right
+ * edge of the screen, since the terminal shifts the text up to there.
+ */
+    static void
+screen_ins_del_chars(row, coloff, endcol, width)
+    int		row;
+    int		coloff;
+    int		endcol;		/* end of the valid text */
+    int		width;		/* width of the window */
+{
+    int		off_from = (int)(current_ScreenLine - ScreenLines);
+    int		off_to = LineOffset[row] + coloff;
+    int		col;
+    int		len;
+    int		j;
+    int		k;
+    int		e;
+    int		ins;
+    int		esc;
+    int		shift_cost;
+    int		goto_len = 0;
+    int		cost;
+    int		best_cost = 0;
+    int		best_k = 0;
+    int		best_e = 0;
+    int		best_ins = FALSE;
+    int		*same_cost = NULL;	/* cells differing when not shifted */
+    int		*blank_cost = NULL;	/* cells differing from a blank */
+    int		n;
+
+    if (endcol > width
+	    || p_wiv
+#ifdef FEAT_GUI
+	    || gui.in_use
+#endif
+#ifdef FEAT_MBYTE
+	    || enc_dbcs != 0
+#endif
+	    || (!can_clear(T_CIC) && !can_clear(T_CDC)))
+	return;
+
+    /* Find the first cell that changed. */
+    for (col = 0; col < endcol; ++col)
+	if (insdel_cell_differs(off_from + col, off_to + col))
+	    break;
+    len = endcol - col;
+    if (len <= 0)
+	return;
+
+#ifdef FEAT_MBYTE
+    /* Don't try shifting double-wide characters. */
+    if (enc_utf8)
+	for (j = col; j < width; ++j)
+	    if (ScreenLines[off_to + j] == 0
+				|| (j < endcol && ScreenLines[off_from + j] == 0))
+		return;
+#endif
+
+    for (k = 1; k <= INSDEL_CHARS_MAX && k < len; ++k)
+	for (ins = 0; ins <= 1; ++ins)
+	{
+	    if (!can_clear(ins ? T_CIC : T_CDC))
+		continue;
+
+	    /* Quick check: after shifting the first changed cell must be
+	     * right, unless characters are inserted there. */
+	    if (ins ? insdel_cell_differs(off_from + col + k, off_to + col)
+		    : insdel_cell_differs(off_from + col, off_to + col + k))
+		continue;
+
+	    if (same_cost == NULL)
+	    {
+		/* Running totals of the cost for the cells from "col", so
+		 * that the cost for a range is a subtraction. */
+		same_cost = (int *)alloc((unsigned)((len + 1) * sizeof(int)));
+		blank_cost = (int *)alloc((unsigned)((len + 1) * sizeof(int)));
+		if (same_cost == NULL || blank_cost == NULL)
+		    goto theend;
+		same_cost[0] = 0;
+		blank_cost[0] = 0;
+		for (j = 0; j < len; ++j)
+		{
+		    same_cost[j + 1] = same_cost[j] + insdel_cell_differs(
+					 off_from + col + j, off_to + col + j);
+		    blank_cost[j + 1] = blank_cost[j]
+			    + insdel_cell_differs(off_from + col + j, -1);
+		}
+		best_cost = same_cost[len];
+		goto_len = term_windgoto_len(row, coloff + col);
+	    }
+
+	    /* Try shifting back at each position "e" after "col", or not at
+	     * all when "e" is "len". */
+	    esc = term_arg_len(ins ? T_CIC : T_CDC, k);
+	    shift_cost = esc;
+	    for (e = 0; e <= len && shift_cost < best_cost; ++e)
+	    {
+		if (e == len)
+		    cost = shift_cost;
+		else if (ins && e < k)
+		    cost = best_cost;	    /* can't shift back here */
+		else
+		{
+		    /* also need to move the cursor there and back */
+		    cost = shift_cost + term_arg_len(ins ? T_CDC : T_CIC, k)
+							       + 2 * goto_len;
+		    if (ins)
+		    {
+			/* cells from "width - k" were pushed out */
+			n = width - k - col;
+			if (n < e)
+			    n = e;
+			if (n > len)
+			    n = len;
+			cost += same_cost[n] - same_cost[e]
+						 + blank_cost[len] - blank_cost[n];
+		    }
+		    else
+		    {
+			/* "k" blank cells at "e" */
+			n = e + k < len ? e + k : len;
+			cost += blank_cost[n] - blank_cost[e]
+						   + same_cost[len] - same_cost[n];
+		    }
+		}
+		if (cost < best_cost)
+		{
+		    best_cost = cost;
+		    best_k = k;
+		    best_e = e;
+		    best_ins = ins;
+		}
+
+		/* Add the cost for cell "e" when shifted. */
+		if (e < len)
+		{
+		    j = col + e;
+		    if (ins)
+			n = e < k ? -1 : off_to + j - k;
+		    else
+			n = j + k < width ? off_to + j + k : -1;
+		    shift_cost += insdel_cell_differs(off_from + j, n);
+		}
+	    }
+	}
+
+    if (best_k > 0)
+    {
+	screen_shift_chars(row, col + coloff, best_k, best_ins);
+	if (best_e < len)
+	    screen_shift_chars(row, col + best_e + coloff, best_k, !best_ins);
+    }
+
+theend:
+    vim_free(same_cost);
+    vim_free(blank_cost);
+}
+
 /*
  * Move one "cooked" screen line to the screen, but only the characters that
  * have actually changed.  Handle insert/delete character.
@@ -5575,6 +6178,15 @@ screen_line(row, coloff, endcol, clear_width
     max_off_to = LineOffset[row] + screen_Columns;
 #endif
 
+    /* When the window reaches the right edge of the screen, text that
+     * shifted may be moved with insert/delete character codes. */
+    if (clear_width > 0 && coloff + clear_width == Columns
+#ifdef FEAT_RIGHTLEFT
+	    && !rlflag
+#endif
+	    )
+	screen_ins_del_chars(row, coloff, endcol, clear_width);
+
 #ifdef FEAT_RIGHTLEFT
     if (rlflag)
     {
@@ -8605,7 +9217,6 @@ windgoto(row, col)
     int		    goto_cost;
     int		    attr;
 
-#define GOTO_COST   7	/* assume a term_windgoto() takes about 7 chars */
 #define HIGHL_COST  5	/* assume unhighlight takes 5 chars */
 
 #define PLAN_LE	    1
@@ -8631,7 +9242,14 @@ windgoto(row, col)
 	    noinvcurs = HIGHL_COST;
 	else
 	    noinvcurs = 0;
-	goto_cost = GOTO_COST + noinvcurs;
+
+	/* The cost of the fallback: the actual length of the cursor-right or
+	 * cursor-motion code used below. */
+	if (row == screen_cur_row && col > screen_cur_col && *T_CRI != NUL)
+	    goto_cost = term_arg_len(T_CRI, col - screen_cur_col);
+	else
+	    goto_cost = term_windgoto_len(row, col);
+	goto_cost += noinvcurs;
 
 	/*
 	 * Plan how to do the positioning:
@@ -9026,8 +9644,10 @@ win_do_lines(wp, row, line_count, mayclear, del)
     if (!redrawing() || line_count <= 0)
 	return FAIL;
 
-    /* only a few lines left: redraw is faster */
+    /* only a few lines left: redraw is faster, unless the terminal can
+     * insert or delete them with one code */
     if (mayclear && Rows - line_count < 5
+	    && *(del ? T_CDL : T_CAL) == NUL
 #ifdef FEAT_VERTSPLIT
 	    && wp->w_width == Columns
 #endif
@@ -10441,3 +11061,39 @@ screen_screenrow()
 {
     return screen_cur_row;
 }
+
+/*
+ * ":termstat": show how many bytes were sent to the terminal, how many of them
+ * were for redrawing the screen and how often characters were shifted with
+ * insert/delete character codes.
+ */
+    void
+ex_termstat(eap)
+    exarg_T	*eap UNUSED;
+{
+    long_u	bytes;
+    long_u	writes;
+
+    out_stats(&bytes, &writes);
+    msg_putchar('\n');
+    vim_snprintf((char *)IObuff, IOSIZE,
+		     _("%lu bytes sent to the terminal in %lu writes"),
+							       bytes, writes);
+    msg_puts(IObuff);
+    msg_putchar('\n');
+    vim_snprintf((char *)IObuff, IOSIZE,
+		_("%ld redraws, bytes: last %lu, max %lu, average %lu"),
+		redraw_count, redraw_bytes_last, redraw_bytes_max,
+		redraw_count == 0 ? 0L : redraw_bytes_total / redraw_count);
+    msg_puts(IObuff);
+    msg_putchar('\n');
+    vim_snprintf((char *)IObuff, IOSIZE,
+		       _("%ld times text was shifted with 't_IC' or 't_DC'"),
+							   insdel_char_count);
+    msg_puts(IObuff);
+    msg_putchar('\n');
+    vim_snprintf((char *)IObuff, IOSIZE,
+		      _("%ld lines drawn, %ld lines copied from remembered rows"),
+					    line_draw_count, row_cache_hits);
+    msg_puts(IObuff);
+}
@@ -540,6 +540,7 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 {
     int		found;
     linenr_T	lnum;		/* no init to shut up Apollo cc */
+    linenr_T	last_lnum;
     regmmatch_T	regmatch;
     char_u	*ptr;
     colnr_T	matchcol;
@@ -634,9 +635,34 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 #endif
 
 		/*
-		 * Look for a match somewhere in line "lnum".
+		 * Look for a match somewhere in line "lnum".  When searching
+		 * forward, not in the first line, look in the following lines
+		 * too, "lnum" is set to where the match is found.
 		 */
-		nmatched = vim_regexec_multi(&regmatch, win, buf,
+		if (dir == FORWARD && !at_first_line)
+		{
+		    last_lnum = buf->b_ml.ml_line_count;
+		    if (stop_lnum != 0 && stop_lnum < last_lnum)
+			last_lnum = stop_lnum;
+		    if (loop && start_pos.lnum < last_lnum)
+			last_lnum = start_pos.lnum;
+#ifdef FEAT_SEARCH_EXTRA
+		    /* Check for a typed character below now and then. */
+		    if ((options & SEARCH_PEEK)
+			     && last_lnum > lnum + ((pos->lnum - lnum) & 0x3f))
+			last_lnum = lnum + ((pos->lnum - lnum) & 0x3f);
+#endif
+		    nmatched = vim_regexec_multi_lines(&regmatch, win, buf,
+						  &lnum, (colnr_T)0, last_lnum,
+#ifdef FEAT_RELTIME
+						      tm
+#else
+						      NULL
+#endif
+						      );
+		}
+		else
+		    nmatched = vim_regexec_multi(&regmatch, win, buf,
 						      lnum, (colnr_T)0,
 #ifdef FEAT_RELTIME
 						      tm
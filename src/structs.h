@@ -429,9 +429,17 @@ typedef struct mf_hashtab_S
  * The block may be linked in the used list OR in the free list.
  * The used blocks are also kept in hash lists.
  *
- * The used list is a doubly linked list, most recently used block first.
+ * The used list is a doubly linked list with two parts (2Q replacement):
+ *	First the blocks that were used again after having been released, most
+ *	recently used block first.  Then, starting at mf_a1_first, the blocks
+ *	that were read or created only once, newest first.  A scan through the
+ *	whole file only goes through the second part, thus the blocks in the
+ *	first part stay in memory.  A block is moved to the first part when it
+ *	is used again after many other blocks were put in the second part.
  *	The blocks in the used list have a block of memory allocated.
  *	mf_used_count is the number of pages in the used list.
+ * The ghost list remembers the numbers of blocks recently released from the
+ *	second part, when one of them is used again it goes in the first part.
  * The hash lists are used to quickly find a block in the used list.
  * The free list is a single linked list, not sorted.
  *	The blocks in the free list have no block of memory allocated and
@@ -447,10 +455,26 @@ struct block_hdr
     bhdr_T	*bh_prev;	    /* previous block_hdr in used list */
     char_u	*bh_data;	    /* pointer to memory (for used block) */
     int		bh_page_count;	    /* number of pages in this block */
+    long	bh_a1_seq;	    /* mf_a1_seq when put in second part */
 
 #define BH_DIRTY    1
 #define BH_LOCKED   2
-    char	bh_flags;	    /* BH_DIRTY or BH_LOCKED */
+#define BH_A1	    4		    /* in the second part of the used list */
+    char	bh_flags;	    /* BH_DIRTY, BH_LOCKED or BH_A1 */
+};
+
+/*
+ * Number of a block recently released from the second part of the used list.
+ */
+typedef struct mf_ghost_S mf_ghost_T;
+
+struct mf_ghost_S
+{
+    mf_hashitem_T mg_hashitem;		/* header for hash table and key */
+#define mg_bnum mg_hashitem.mhi_key	/* block number */
+
+    mf_ghost_T	*mg_next;		/* next newer entry in ghost list */
+    mf_ghost_T	*mg_prev;		/* next older entry in ghost list */
 };
 
 /*
@@ -563,6 +587,17 @@ struct memfile
     bhdr_T	*mf_used_last;		/* lru block_hdr in used list */
     unsigned	mf_used_count;		/* number of pages in used list */
     unsigned	mf_used_count_max;	/* maximum number of pages in memory */
+    bhdr_T	*mf_a1_first;		/* newest block_hdr in second part of
+					   used list, NULL if empty */
+    unsigned	mf_a1_count;		/* number of pages in second part */
+    long	mf_a1_seq;		/* nr of blocks put in second part */
+    mf_ghost_T	*mf_ghost_first;	/* oldest entry in ghost list */
+    mf_ghost_T	*mf_ghost_last;		/* newest entry in ghost list */
+    mf_hashtab_T mf_ghost;		/* ghost list entries by block nr */
+    long	mf_hit_count;		/* nr of mf_get() calls for a block in
+					   memory */
+    long	mf_miss_count;		/* nr of blocks read from the file */
+    long	mf_release_count;	/* nr of blocks released */
     mf_hashtab_T mf_hash;		/* hash lists */
     mf_hashtab_T mf_trans;		/* trans lists */
     blocknr_T	mf_blocknr_max;		/* highest positive block number + 1*/
@@ -604,6 +639,10 @@ typedef struct ml_chunksize
 {
     int		mlcs_numlines;
     long	mlcs_totalsize;
+    /* Fenwick tree over the chunks: entry "i" holds the sums for the
+     * (i + 1) & -(i + 1) chunks up to and including this one. */
+    long	mlcs_treelines;
+    long	mlcs_treesize;
 } chunksize_T;
 
  /* Flags when calling ml_updatechunk() */
@@ -613,6 +652,47 @@ typedef struct ml_chunksize
 #define ML_CHNK_UPDLINE 3
 #endif
 
+#ifdef FEAT_MMAP
+/*
+ * A file that is mapped into memory, lines that were not changed yet are
+ * obtained from it.  The groups of lines that are still in the mapped file
+ * are entries in the pointer blocks with a zero pe_page_count.  The lines of
+ * the group used last are kept in mm_text[], like in a data block.
+ */
+typedef struct ml_mapped
+{
+    char_u	*mm_addr;	/* start of the mapping, NULL when unmapped */
+    size_t	mm_size;	/* size of the mapping */
+    int		mm_fd;		/* file descriptor of the mapped file, to
+				   check that it didn't change */
+    long	mm_mtime;	/* last change time of the mapped file */
+    long	mm_mtime_ns;	/* nanoseconds of mm_mtime, when available */
+    size_t	mm_avail;	/* bytes of the mapping that can be used */
+    int		mm_changed;	/* the file was changed, only mm_avail bytes
+				   are still in it */
+    int		mm_damaged;	/* the text of lines still in the file may be
+				   lost or different */
+# ifdef UNIX
+    dev_t	mm_dev;		/* device of the mapped file */
+    ino_t	mm_ino;		/* inode of the mapped file */
+# endif
+    int		mm_ffdos;	/* lines end in CR-NL */
+    long	mm_groups;	/* number of groups still in the mapped file */
+
+    long	mm_hit_start;	/* set by ml_find_line(): file offset of the */
+    linenr_T	mm_hit_low;	/* group with the line, first line number */
+    int		mm_hit_count;	/* and number of lines in it */
+
+    long	mm_text_start;	/* file offset of the group in mm_text, -1 when
+				   mm_text is not valid */
+    int		mm_text_count;	/* number of lines in mm_text */
+    char_u	*mm_text;	/* NUL terminated lines of the group */
+    long	mm_text_size;	/* allocated size of mm_text */
+    int		*mm_index;	/* start of each line in mm_text, plus one */
+    int		mm_index_size;	/* allocated entries in mm_index */
+} mlmap_T;
+#endif
+
 /*
  * the memline structure holds all the information about a memline
  */
@@ -626,6 +706,7 @@ typedef struct memline
 #define ML_LINE_DIRTY	2	/* cached line was changed and allocated */
 #define ML_LOCKED_DIRTY	4	/* ml_locked was changed */
 #define ML_LOCKED_POS	8	/* ml_locked needs positive block number */
+#define ML_LINE_MAPPED	16	/* cached line is in mm_text of ml_map */
     int		ml_flags;
 
     infoptr_T	*ml_stack;	/* stack of pointer blocks (array of IPTRs) */
@@ -634,6 +715,8 @@ typedef struct memline
 
     linenr_T	ml_line_lnum;	/* line number of cached line, 0 if not valid */
     char_u	*ml_line_ptr;	/* pointer to cached line */
+    long	ml_line_size;	/* allocated size of ml_line_ptr when it has
+				   room to grow, zero otherwise */
 
     bhdr_T	*ml_locked;	/* block used by last ml_get */
     linenr_T	ml_locked_low;	/* first line in ml_locked */
@@ -643,6 +726,10 @@ typedef struct memline
     chunksize_T *ml_chunksize;
     int		ml_numchunks;
     int		ml_usedchunks;
+    int		ml_chunktree;	/* TRUE when mlcs_tree* are valid */
+#endif
+#ifdef FEAT_MMAP
+    mlmap_T	*ml_map;	/* mapped file, NULL when not used */
 #endif
 } memline_T;
 
@@ -847,6 +934,19 @@ struct keyentry
     char_u	keyword[1];	/* actually longer */
 };
 
+/*
+ * A keyword hashtab is compiled into a trie, so that keywords can be matched
+ * directly in the text.  The children of a node are stored next to each
+ * other, sorted on kn_byte.  Node zero is the root.
+ */
+typedef struct
+{
+    keyentry_T	*kn_entry;	/* keywords ending in this node or NULL */
+    int		kn_child;	/* index of the first child */
+    short	kn_nchild;	/* number of children */
+    char_u	kn_byte;	/* byte that leads to this node */
+} keynode_T;
+
 /*
  * Struct used to store one state of the state stack.
  */
@@ -1085,6 +1185,7 @@ typedef struct hashtable_S
     int		ht_locked;	/* counter for hash_lock() */
     int		ht_error;	/* when set growing failed, can't add more
 				   items before growing works */
+    long_u	ht_changed;	/* incremented when an item is removed */
     hashitem_T	*ht_array;	/* points to the array, allocated when it's
 				   not "ht_smallarray" */
     hashitem_T	ht_smallarray[HT_INIT_SIZE];   /* initial array */
@@ -1175,6 +1276,9 @@ struct listvar_S
     listwatch_T	*lv_watch;	/* first watcher, NULL if none */
     int		lv_idx;		/* cached index of an item */
     listitem_T	*lv_idx_item;	/* when not NULL item at index "lv_idx" */
+    listitem_T	**lv_items;	/* when not NULL array with all items */
+    int		lv_items_off;	/* index in "lv_items" of the first item */
+    int		lv_items_size;	/* allocated size of "lv_items" */
     int		lv_copyID;	/* ID used by deepcopy() */
     list_T	*lv_copylist;	/* copied list used by deepcopy() */
     char	lv_lock;	/* zero, VAR_LOCKED, VAR_FIXED */
@@ -1200,6 +1304,7 @@ typedef struct dictitem_S dictitem_T;
 #define DI_FLAGS_RO_SBX 2 /* "di_flags" value: read-only in the sandbox */
 #define DI_FLAGS_FIX	4 /* "di_flags" value: fixed variable, not allocated */
 #define DI_FLAGS_LOCK	8 /* "di_flags" value: locked variable */
+#define DI_FLAGS_NOFREE 16 /* "di_flags" value: not allocated, can be deleted */
 
 /*
  * Structure to hold info about a Dictionary.
@@ -1252,6 +1357,9 @@ typedef struct {
 #ifdef FEAT_SYN_HL
     hashtab_T	b_keywtab;		/* syntax keywords hash table */
     hashtab_T	b_keywtab_ic;		/* idem, ignore case */
+    garray_T	b_keywtrie;		/* b_keywtab compiled, see
+					   keytrie_build() */
+    garray_T	b_keywtrie_ic;		/* idem, ignore case */
     int		b_syn_error;		/* TRUE when error occurred in HL */
     int		b_syn_ic;		/* ignore case for :syn cmds */
     int		b_syn_spell;		/* SYNSPL_ values */
@@ -1301,6 +1409,8 @@ typedef struct {
     int		b_sst_freecount;
     linenr_T	b_sst_check_lnum;
     short_u	b_sst_lasttick;	/* last display tick */
+    linenr_T	b_sst_idle_lnum; /* parsed up to here by syn_idle_parse() */
+    int		b_sst_idle_tick; /* b_changedtick for b_sst_idle_lnum */
 #endif /* FEAT_SYN_HL */
 
 #ifdef FEAT_SPELL
@@ -1877,6 +1987,53 @@ typedef struct w_line
 #endif
 } wline_T;
 
+/*
+ * Virtual columns in a long line, remembered to avoid counting from the start
+ * of the line every time, see getvcol().  Entry "i" in vc_points[] is the
+ * first character at or after byte i * VCOL_STEP.  The entries are only valid
+ * for the settings they were computed with.
+ */
+typedef struct vcolpoint_S
+{
+    colnr_T	vp_col;		/* byte index of a character */
+    colnr_T	vp_vcol;	/* virtual column where it starts */
+} vcolpoint_T;
+
+typedef struct vcolcache_S
+{
+    int		vc_fnum;	/* buffer number, zero when not used */
+    linenr_T	vc_lnum;	/* line number in that buffer */
+    int		vc_ts;		/* 'tabstop' */
+    int		vc_width1;	/* width of first and further screen lines */
+    int		vc_width2;	/* for in_win_border(), zero if not used */
+    int		vc_chartab_tick; /* changes when chartab[] changes */
+    int		vc_ambw;	/* first char of 'ambiwidth' */
+    vcolpoint_T	*vc_points;	/* allocated array of points */
+    int		vc_count;	/* number of valid points */
+    int		vc_size;	/* allocated number of points */
+} vcolcache_T;
+
+/*
+ * Screen rows of buffer lines that fit in one row, as drawn by win_line(),
+ * remembered to avoid drawing them again when they scroll back into view,
+ * see win_update().  Line "lnum" can only be in slot "lnum % rc_slots".  A
+ * slot is only valid for the b_changedtick it was drawn with.
+ */
+typedef struct rowcache_S
+{
+    int		rc_slots;	/* number of slots, zero when not allocated */
+    int		rc_width;	/* width of a row */
+    colnr_T	rc_leftcol;	/* w_leftcol the rows were drawn with */
+    linenr_T	*rc_lnum;	/* line number per slot, zero when unused */
+    int		*rc_tick;	/* b_changedtick per slot */
+    int		*rc_endcol;	/* end of the text per slot */
+    schar_T	*rc_lines;	/* ScreenLines[] of all slots */
+    sattr_T	*rc_attrs;	/* ScreenAttrs[] of all slots */
+#ifdef FEAT_MBYTE
+    u8char_T	*rc_lines_uc;	/* ScreenLinesUC[] of all slots, or NULL */
+#endif
+} rowcache_T;
+
 /*
  * Windows are kept in a tree of frames.  Each frame has a column (FR_COL)
  * or row (FR_ROW) layout or is a leaf, which has a window.
@@ -2092,6 +2249,9 @@ struct window_S
     int		w_lines_valid;	    /* number of valid entries */
     wline_T	*w_lines;
 
+    vcolcache_T	w_vcol_cache;	    /* virtual columns in a long line */
+    rowcache_T	w_row_cache;	    /* rows drawn for lines, see screen.c */
+
 #ifdef FEAT_FOLDING
     garray_T	w_folds;	    /* array of nested folds */
     char	w_fold_manual;	    /* when TRUE: some folds are opened/closed
@@ -253,6 +253,69 @@ static char_u **syn_cmdlinep;
 static int current_syn_inc_tag = 0;
 static int running_syn_inc_tag = 0;
 
+#ifdef FEAT_EVAL
+/*
+ * When 'syntaxcache' is set, the syntax items that a syntax file defines when
+ * sourced for a buffer without syntax items are kept in syn_cache.  When the
+ * file is sourced again in that situation the items are copied from there,
+ * unless one of the files that were sourced has changed or a global or buffer
+ * variable or an option that was used has a different value.
+ */
+typedef struct
+{
+    char_u	*sd_fname;	/* full file name */
+    time_t	sd_mtime;	/* modification time */
+    off_t	sd_size;	/* file size */
+} syn_dep_T;
+
+typedef struct
+{
+    int		sv_scope;	/* 'g', 'b' or '&' for an option */
+    int		sv_flags;	/* option: OPT_GLOBAL, OPT_LOCAL or zero */
+    char_u	*sv_name;	/* name of the variable or option */
+    typval_T	sv_tv;		/* its value, VAR_UNKNOWN when not set */
+} syn_var_T;
+
+typedef struct syn_cache_S syn_cache_T;
+struct syn_cache_S
+{
+    syn_cache_T	*sc_next;
+    char_u	*sc_fname;	/* syntax file that was sourced */
+    garray_T	sc_deps;	/* syn_dep_T for it and files it sourced */
+    garray_T	sc_used;	/* syn_var_T for variables and options used */
+    garray_T	sc_hl;		/* ":highlight link" arguments */
+    synblock_T	sc_block;	/* resulting syntax items */
+    dict_T	*sc_vars;	/* buffer variables that were set */
+    dict_T	*sc_gvars_set;	/* global variables that were set */
+    int		sc_inc_tag;	/* running_syn_inc_tag at the end */
+};
+
+static syn_cache_T *syn_cache = NULL;
+
+/*
+ * A syntax file being sourced that may be added to syn_cache.  When it
+ * sources another syntax file it may be on top of another one.
+ */
+typedef struct syn_rec_S syn_rec_T;
+struct syn_rec_S
+{
+    syn_rec_T	*sr_prev;
+    char_u	*sr_fname;
+    garray_T	sr_deps;	/* syn_dep_T for files sourced so far */
+    garray_T	sr_used;	/* syn_var_T for variables and options used */
+    garray_T	sr_hl;		/* ":highlight link" arguments */
+    synblock_T	*sr_block;	/* the block the items are added to */
+    buf_T	*sr_buf;
+    dict_T	*sr_vars;	/* copy of the buffer variables at the start */
+    int		sr_ok;		/* FALSE when it can't be cached */
+};
+
+static syn_rec_T *syn_recording = NULL;
+
+#define SYN_TV_STR(tv) ((tv)->vval.v_string == NULL \
+				  ? (char_u *)"" : (tv)->vval.v_string)
+#endif
+
 /*
  * In a hashtable item "hi_key" points to "keyword" in a keyentry.
  * This avoids adding a pointer to the hashtable item.
@@ -428,6 +491,29 @@ static void syn_add_start_off __ARGS((lpos_T *result, regmmatch_T *regmatch, syn
 static char_u *syn_getcurline __ARGS((void));
 static int syn_regexec __ARGS((regmmatch_T *rmp, linenr_T lnum, colnr_T col, syn_time_T *st));
 static int check_keyword_id __ARGS((char_u *line, int startcol, int *endcol, long *flags, short **next_list, stateitem_T *cur_si, int *ccharp));
+static int keytrie_build __ARGS((hashtab_T *ht, garray_T *gap));
+static int keytrie_add_children __ARGS((garray_T *gap, int idx, char_u **keys, int lo, int hi, int depth));
+static keyentry_T *keytrie_find __ARGS((garray_T *gap, char_u *kwp, int ic, int *kwlenp));
+static void keytrie_clear __ARGS((synblock_T *block));
+#ifdef FEAT_EVAL
+static int syn_block_is_empty __ARGS((void));
+static int syn_cache_fname_ok __ARGS((char_u *fname));
+static dict_T *syn_cache_vars_set __ARGS((dict_T *before, dict_T *after));
+static int syn_cache_add_dep __ARGS((garray_T *gap, char_u *fname));
+static int syn_cache_deps_valid __ARGS((garray_T *gap));
+static void syn_cache_free_deps __ARGS((garray_T *gap));
+static int syn_cache_tv_same __ARGS((typval_T *tv1, typval_T *tv2));
+static int syn_cache_get_value __ARGS((syn_var_T *sv, buf_T *buf, typval_T *tv));
+static int syn_cache_add_used __ARGS((garray_T *gap, int scope, int flags, char_u *name));
+static void syn_cache_use __ARGS((int scope, int flags, char_u *name));
+static int syn_cache_used_valid __ARGS((garray_T *gap));
+static dict_T *syn_cache_gvars_set __ARGS((garray_T *gap));
+static void syn_cache_free_used __ARGS((garray_T *gap));
+static void syn_cache_add_hl __ARGS((char_u *line));
+static void syn_cache_free_entry __ARGS((syn_cache_T *sc));
+static int syn_copy_block __ARGS((synblock_T *from, synblock_T *to));
+static int syn_copy_keywtab __ARGS((hashtab_T *from, hashtab_T *to));
+#endif
 static void syn_cmd_case __ARGS((exarg_T *eap, int syncing));
 static void syn_cmd_spell __ARGS((exarg_T *eap, int syncing));
 static void syntax_sync_clear __ARGS((void));
@@ -660,6 +746,54 @@ syntax_start(wp, lnum)
     syn_start_line();
 }
 
+/*
+ * Parse the syntax of the current window ahead of the displayed lines, so
+ * that b_sst_array[] has states to start from when moving further down the
+ * file.  Parses SST_IDLE_LINES lines, then returns to check for typeahead.
+ * Called while waiting for the user to type something.
+ * Returns TRUE when there is more to parse.
+ */
+    int
+syn_idle_parse()
+{
+    synblock_T	*block = curwin->w_s;
+    linenr_T	lnum;
+    int		dist;
+
+    if (curwin->w_buffer != curbuf || !syntax_present(curwin)
+	    || block->b_syn_error || block->b_sst_array == NULL
+	    || block->b_sst_len <= Rows)
+	return FALSE;
+
+    if (block->b_sst_idle_tick != curbuf->b_changedtick)
+    {
+	/* Text changed, states below the window must be checked again. */
+	block->b_sst_idle_tick = curbuf->b_changedtick;
+	block->b_sst_idle_lnum = curwin->w_topline;
+    }
+    if (block->b_sst_idle_lnum >= curbuf->b_ml.ml_line_count)
+	return FALSE;
+
+    /* Only worth it when the stored states are close enough together for
+     * syntax_start() to use them instead of syncing, see "minlines". */
+    dist = curbuf->b_ml.ml_line_count / (block->b_sst_len - Rows) + 1;
+    if (block->b_syn_sync_minlines < dist)
+	return FALSE;
+
+    lnum = block->b_sst_idle_lnum + SST_IDLE_LINES;
+    if (lnum > curbuf->b_ml.ml_line_count)
+	lnum = curbuf->b_ml.ml_line_count;
+    syntax_start(curwin, lnum);
+    if (got_int)
+    {
+	/* syntax_start() stopped halfway, the current state is wrong. */
+	invalidate_current_state();
+	return FALSE;
+    }
+    block->b_sst_idle_lnum = lnum;
+    return TRUE;
+}
+
 /*
  * We cannot simply discard growarrays full of state_items or buf_states; we
  * have to manually release their extmatch pointers first.
@@ -1159,6 +1293,9 @@ syn_stack_free_all(block)
 
     syn_stack_free_block(block);
 
+    /* The states are gone, syn_idle_parse() must start again. */
+    block->b_sst_idle_lnum = 0;
+    block->b_sst_idle_tick = 0;
 
 #ifdef FEAT_FOLDING
     /* When using "syntax" fold method, must update all folds. */
@@ -3309,36 +3446,10 @@ check_keyword_id(line, startcol, endcolp, flagsp, next_listp, cur_si, ccharp)
     int		*ccharp UNUSED;	/* conceal substitution char */
 {
     keyentry_T	*kp;
-    char_u	*kwp;
     int		round;
     int		kwlen;
-    char_u	keyword[MAXKEYWLEN + 1]; /* assume max. keyword len is 80 */
     hashtab_T	*ht;
-    hashitem_T	*hi;
-
-    /* Find first character after the keyword.  First character was already
-     * checked. */
-    kwp = line + startcol;
-    kwlen = 0;
-    do
-    {
-#ifdef FEAT_MBYTE
-	if (has_mbyte)
-	    kwlen += (*mb_ptr2len)(kwp + kwlen);
-	else
-#endif
-	    ++kwlen;
-    }
-    while (vim_iswordp_buf(kwp + kwlen, syn_buf));
-
-    if (kwlen > MAXKEYWLEN)
-	return 0;
-
-    /*
-     * Must make a copy of the keyword, so we can add a NUL and make it
-     * lowercase.
-     */
-    vim_strncpy(keyword, kwp, kwlen);
+    garray_T	*gap;
 
     /*
      * Try twice:
@@ -3350,8 +3461,9 @@ check_keyword_id(line, startcol, endcolp, flagsp, next_listp, cur_si, ccharp)
 	ht = round == 1 ? &syn_block->b_keywtab : &syn_block->b_keywtab_ic;
 	if (ht->ht_used == 0)
 	    continue;
-	if (round == 2)	/* ignore case */
-	    (void)str_foldcase(kwp, kwlen, keyword, MAXKEYWLEN + 1);
+	gap = round == 1 ? &syn_block->b_keywtrie : &syn_block->b_keywtrie_ic;
+	if (gap->ga_len == 0 && keytrie_build(ht, gap) == FAIL)
+	    return 0;
 
 	/*
 	 * Find keywords that match.  There can be several with different
@@ -3360,30 +3472,226 @@ check_keyword_id(line, startcol, endcolp, flagsp, next_listp, cur_si, ccharp)
 	 *  Accept a not-contained keyword at toplevel.
 	 *  Accept a keyword at other levels only if it is in the contains list.
 	 */
-	hi = hash_find(ht, keyword);
-	if (!HASHITEM_EMPTY(hi))
-	    for (kp = HI2KE(hi); kp != NULL; kp = kp->ke_next)
+	for (kp = keytrie_find(gap, line + startcol, round == 2, &kwlen);
+						 kp != NULL; kp = kp->ke_next)
+	{
+	    if (current_next_list != 0
+		    ? in_id_list(NULL, current_next_list, &kp->k_syn, 0)
+		    : (cur_si == NULL
+			? !(kp->flags & HL_CONTAINED)
+			: in_id_list(cur_si, cur_si->si_cont_list,
+				  &kp->k_syn, kp->flags & HL_CONTAINED)))
 	    {
-		if (current_next_list != 0
-			? in_id_list(NULL, current_next_list, &kp->k_syn, 0)
-			: (cur_si == NULL
-			    ? !(kp->flags & HL_CONTAINED)
-			    : in_id_list(cur_si, cur_si->si_cont_list,
-				      &kp->k_syn, kp->flags & HL_CONTAINED)))
-		{
-		    *endcolp = startcol + kwlen;
-		    *flagsp = kp->flags;
-		    *next_listp = kp->next_list;
+		*endcolp = startcol + kwlen;
+		*flagsp = kp->flags;
+		*next_listp = kp->next_list;
 #ifdef FEAT_CONCEAL
-		    *ccharp = kp->k_char;
+		*ccharp = kp->k_char;
 #endif
-		    return kp->k_syn.id;
-		}
+		return kp->k_syn.id;
 	    }
+	}
     }
     return 0;
 }
 
+/*
+ * Compile the keywords in hashtab "ht" into a trie in "gap".
+ * Returns FAIL when out of memory.
+ */
+    static int
+keytrie_build(ht, gap)
+    hashtab_T	*ht;
+    garray_T	*gap;
+{
+    char_u	**keys;
+    hashitem_T	*hi;
+    int		todo;
+    int		n = 0;
+    int		retval = FAIL;
+
+    ga_init2(gap, (int)sizeof(keynode_T), 1000);
+    keys = (char_u **)alloc((unsigned)(ht->ht_used * sizeof(char_u *)));
+    if (keys == NULL)
+	return FAIL;
+    todo = (int)ht->ht_used;
+    for (hi = ht->ht_array; todo > 0; ++hi)
+	if (!HASHITEM_EMPTY(hi))
+	{
+	    --todo;
+	    keys[n++] = hi->hi_key;
+	}
+    /* Sorting puts keywords with the same start together and a keyword
+     * before the longer ones it is the start of. */
+    sort_strings(keys, n);
+
+    if (ga_grow(gap, 1) == OK)
+    {
+	vim_memset(gap->ga_data, 0, sizeof(keynode_T));
+	gap->ga_len = 1;
+	retval = keytrie_add_children(gap, 0, keys, 0, n, 0);
+    }
+    if (retval == FAIL)
+	ga_clear(gap);
+    vim_free(keys);
+    return retval;
+}
+
+/*
+ * Add the children of node "idx" in trie "gap", for the keywords
+ * keys[lo] to keys[hi - 1], which all start with the "depth" bytes that lead
+ * to this node.  Recursively adds their children.
+ * Returns FAIL when out of memory.
+ */
+    static int
+keytrie_add_children(gap, idx, keys, lo, hi, depth)
+    garray_T	*gap;
+    int		idx;
+    char_u	**keys;
+    int		lo;
+    int		hi;
+    int		depth;
+{
+    keynode_T	*np;
+    int		first;
+    int		n;
+    int		i, j;
+
+    if (lo < hi && keys[lo][depth] == NUL)
+    {
+	/* A keyword ends here, it is sorted before the longer ones. */
+	((keynode_T *)gap->ga_data)[idx].kn_entry = HIKEY2KE(keys[lo]);
+	++lo;
+    }
+
+    n = 0;
+    for (i = lo; i < hi; i = j)
+    {
+	for (j = i + 1; j < hi && keys[j][depth] == keys[i][depth]; ++j)
+	    ;
+	++n;
+    }
+    if (n == 0)
+	return OK;
+    if (ga_grow(gap, n) == FAIL)
+	return FAIL;
+    first = gap->ga_len;
+    gap->ga_len += n;
+    np = (keynode_T *)gap->ga_data + idx;
+    np->kn_child = first;
+    np->kn_nchild = n;
+
+    for (i = lo; i < hi; i = j)
+    {
+	for (j = i + 1; j < hi && keys[j][depth] == keys[i][depth]; ++j)
+	    ;
+	/* "gap->ga_data" may move when adding the children of a child. */
+	np = (keynode_T *)gap->ga_data + first;
+	np->kn_entry = NULL;
+	np->kn_child = 0;
+	np->kn_nchild = 0;
+	np->kn_byte = keys[i][depth];
+	if (keytrie_add_children(gap, first, keys, i, j, depth + 1) == FAIL)
+	    return FAIL;
+	++first;
+    }
+    return OK;
+}
+
+/*
+ * Find the keyword that starts at "kwp" and continues up to the first
+ * non-keyword character in trie "gap".  When "ic" is TRUE the text is
+ * case-folded, like the keywords in b_keywtab_ic.
+ * Returns the keyword entries and sets "*kwlenp" to the number of bytes at
+ * "kwp", or returns NULL when there is no such keyword.
+ */
+    static keyentry_T *
+keytrie_find(gap, kwp, ic, kwlenp)
+    garray_T	*gap;
+    char_u	*kwp;
+    int		ic;
+    int		*kwlenp;
+{
+    keynode_T	*nodes = (keynode_T *)gap->ga_data;
+    keynode_T	*np = nodes;
+    char_u	folded[MB_MAXBYTES + 1];
+    char_u	*p;
+    int		kwlen = 0;
+    int		len;
+    int		flen;
+    int		i;
+    int		lo, hi, m;
+
+    /* First character was already checked to be a keyword character. */
+    do
+    {
+	p = kwp + kwlen;
+#ifdef FEAT_MBYTE
+	/* An ASCII character followed by ASCII has no composing characters. */
+	if (has_mbyte && (p[0] >= 0x80 || p[1] >= 0x80))
+	    len = (*mb_ptr2len)(p);
+	else
+#endif
+	    len = 1;
+	kwlen += len;
+	if (kwlen > MAXKEYWLEN)
+	    return NULL;
+
+	flen = len;
+	if (ic)
+	{
+	    /* Fold the case like str_foldcase() does, ASCII quickly.  An
+	     * ASCII character may be followed by composing characters. */
+#ifdef FEAT_MBYTE
+	    if (enc_utf8 && len == 1)
+		folded[0] = TOLOWER_ASC(*p);
+	    else if (has_mbyte)
+	    {
+		(void)str_foldcase(p, len, folded, MB_MAXBYTES + 1);
+		flen = (int)STRLEN(folded);
+	    }
+	    else
+#endif
+		folded[0] = TOLOWER_LOC(*p);
+	    p = folded;
+	}
+
+	/* Follow the bytes of the character down the trie. */
+	for (i = 0; i < flen; ++i)
+	{
+	    lo = np->kn_child;
+	    hi = lo + np->kn_nchild;
+	    while (lo < hi)
+	    {
+		m = (lo + hi) / 2;
+		if (nodes[m].kn_byte < p[i])
+		    lo = m + 1;
+		else
+		    hi = m;
+	    }
+	    if (lo == np->kn_child + np->kn_nchild || nodes[lo].kn_byte != p[i])
+		return NULL;
+	    np = nodes + lo;
+	}
+    }
+    while (vim_iswordp_buf(kwp + kwlen, syn_buf));
+
+    *kwlenp = kwlen;
+    return np->kn_entry;
+}
+
+/*
+ * Free the keyword tries of "block", they are built again when needed.
+ * Must be called when the keywords change.
+ */
+    static void
+keytrie_clear(block)
+    synblock_T	*block;
+{
+    ga_clear(&block->b_keywtrie);
+    ga_clear(&block->b_keywtrie_ic);
+}
+
 /*
  * Handle ":syntax conceal" command.
  */
@@ -3477,6 +3785,7 @@ syntax_clear(block)
     /* free the keywords */
     clear_keywtab(&block->b_keywtab);
     clear_keywtab(&block->b_keywtab_ic);
+    keytrie_clear(block);
 
     /* free the syntax patterns */
     for (i = block->b_syn_patterns.ga_len; --i >= 0; )
@@ -3709,6 +4018,7 @@ syn_clear_one(id, syncing)
     {
 	(void)syn_clear_keyword(id, &curwin->w_s->b_keywtab);
 	(void)syn_clear_keyword(id, &curwin->w_s->b_keywtab_ic);
+	keytrie_clear(curwin->w_s);
     }
 
     /* clear the patterns for "id" */
@@ -4450,6 +4760,7 @@ add_keyword(name, id, flags, cont_in_list, next_list, conceal_char)
 	kp->ke_next = HI2KE(hi);
 	hi->hi_key = KE2HIKEY(kp);
     }
+    keytrie_clear(curwin->w_s);
 }
 
 /*
@@ -6325,6 +6636,840 @@ ex_ownsyntax(eap)
     }
 }
 
+#if defined(FEAT_EVAL) || defined(PROTO)
+/*
+ * Return TRUE if there are no syntax items for the current window and
+ * b:current_syntax is not set, as after ":syntax clear".
+ */
+    static int
+syn_block_is_empty()
+{
+    synblock_T	*block = curwin->w_s;
+
+    return !syntax_present(curwin)
+	&& block->b_syn_topgrp == 0
+	&& !block->b_syn_ic
+	&& block->b_syn_spell == SYNSPL_DEFAULT
+# ifdef FEAT_CONCEAL
+	&& !block->b_syn_conceal
+# endif
+	&& block->b_syn_sync_flags == 0
+	&& block->b_syn_linecont_pat == NULL
+	&& !block->b_syn_error
+	&& current_syn_inc_tag == 0
+	&& get_var_value((char_u *)"b:current_syntax") == NULL;
+}
+
+/*
+ * Return TRUE if "fname" is in a directory called "syntax".  Other scripts
+ * may do things that are not remembered, such as defining a mapping.
+ */
+    static int
+syn_cache_fname_ok(fname)
+    char_u	*fname;
+{
+    char_u	*tail = gettail(fname);
+    char_u	*p;
+
+    if (tail - fname < 7 || !vim_ispathsep(tail[-1]))
+	return FALSE;
+    p = tail - 7;
+    return fnamencmp(p, (char_u *)"syntax", 6) == 0
+			      && (p == fname || vim_ispathsep(p[-1]));
+}
+
+/*
+ * Add file "fname" with its current time and size to "gap".
+ * Returns FAIL when it can't be found or out of memory.
+ */
+    static int
+syn_cache_add_dep(gap, fname)
+    garray_T	*gap;
+    char_u	*fname;
+{
+    struct stat	st;
+    syn_dep_T	*dp;
+
+    if (mch_stat((char *)fname, &st) < 0 || ga_grow(gap, 1) == FAIL)
+	return FAIL;
+    dp = (syn_dep_T *)gap->ga_data + gap->ga_len;
+    dp->sd_fname = vim_strsave(fname);
+    if (dp->sd_fname == NULL)
+	return FAIL;
+    dp->sd_mtime = st.st_mtime;
+    dp->sd_size = st.st_size;
+    ++gap->ga_len;
+    return OK;
+}
+
+/*
+ * Return TRUE if none of the files in "gap" changed.
+ */
+    static int
+syn_cache_deps_valid(gap)
+    garray_T	*gap;
+{
+    struct stat	st;
+    syn_dep_T	*dp;
+    int		i;
+
+    for (i = 0; i < gap->ga_len; ++i)
+    {
+	dp = (syn_dep_T *)gap->ga_data + i;
+	if (mch_stat((char *)dp->sd_fname, &st) < 0
+		|| st.st_mtime != dp->sd_mtime || st.st_size != dp->sd_size)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+    static void
+syn_cache_free_deps(gap)
+    garray_T	*gap;
+{
+    int		i;
+
+    for (i = 0; i < gap->ga_len; ++i)
+	vim_free(((syn_dep_T *)gap->ga_data)[i].sd_fname);
+    ga_clear(gap);
+}
+
+/*
+ * Return TRUE if "tv1" and "tv2" have the same type and value.  Only works
+ * for a Number or String, other types must be the same item.
+ */
+    static int
+syn_cache_tv_same(tv1, tv2)
+    typval_T	*tv1;
+    typval_T	*tv2;
+{
+    if (tv1->v_type != tv2->v_type)
+	return FALSE;
+    if (tv1->v_type == VAR_UNKNOWN)
+	return TRUE;
+    if (tv1->v_type == VAR_NUMBER)
+	return tv1->vval.v_number == tv2->vval.v_number;
+    if (tv1->v_type == VAR_STRING)
+	return STRCMP(SYN_TV_STR(tv1), SYN_TV_STR(tv2)) == 0;
+    return tv1->vval.v_string == tv2->vval.v_string;
+}
+
+/*
+ * Get the current value of the variable or option "sv" into "tv".  Buffer
+ * variables are those of "buf".  "tv" is VAR_UNKNOWN when the variable does
+ * not exist.
+ * Returns FAIL when the value can't be remembered.
+ */
+    static int
+syn_cache_get_value(sv, buf, tv)
+    syn_var_T	*sv;
+    buf_T	*buf;
+    typval_T	*tv;
+{
+    dictitem_T	*di;
+    long	numval = 0;
+    char_u	*stringval = NULL;
+    int		opt_type;
+
+    tv->v_type = VAR_UNKNOWN;
+    tv->v_lock = 0;
+    if (sv->sv_scope == '&')
+    {
+	opt_type = get_option_value(sv->sv_name, &numval, &stringval,
+								 sv->sv_flags);
+	if (opt_type == 1 || opt_type == -1)
+	{
+	    tv->v_type = VAR_NUMBER;
+	    tv->vval.v_number = numval;
+	}
+	else if (opt_type == 0 || opt_type == -2)
+	{
+	    tv->v_type = VAR_STRING;
+	    tv->vval.v_string = stringval;
+	}
+	return OK;
+    }
+
+    di = dict_find(sv->sv_scope == 'g' ? get_globvar_dict() : buf->b_vars,
+							       sv->sv_name, -1);
+    if (di == NULL)
+	return OK;
+    if (di->di_tv.v_type != VAR_NUMBER && di->di_tv.v_type != VAR_STRING)
+	return FAIL;
+    copy_tv(&di->di_tv, tv);
+    return OK;
+}
+
+/*
+ * Add the variable or option "name" in "scope" with its current value to
+ * "gap", unless it is already there.
+ * Returns FAIL when the value can't be remembered or out of memory.
+ */
+    static int
+syn_cache_add_used(gap, scope, flags, name)
+    garray_T	*gap;
+    int		scope;
+    int		flags;
+    char_u	*name;
+{
+    syn_var_T	*sv;
+    int		i;
+
+    for (i = 0; i < gap->ga_len; ++i)
+    {
+	sv = (syn_var_T *)gap->ga_data + i;
+	if (sv->sv_scope == scope && sv->sv_flags == flags
+					       && STRCMP(sv->sv_name, name) == 0)
+	    return OK;
+    }
+
+    if (ga_grow(gap, 1) == FAIL)
+	return FAIL;
+    sv = (syn_var_T *)gap->ga_data + gap->ga_len;
+    sv->sv_scope = scope;
+    sv->sv_flags = flags;
+    sv->sv_name = vim_strsave(name);
+    if (sv->sv_name == NULL)
+	return FAIL;
+    if (syn_cache_get_value(sv, syn_cache_buf, &sv->sv_tv) == FAIL)
+    {
+	vim_free(sv->sv_name);
+	return FAIL;
+    }
+    ++gap->ga_len;
+    return OK;
+}
+
+/*
+ * Return TRUE if all the variables and options in "gap" still have the same
+ * value for the current buffer.
+ */
+    static int
+syn_cache_used_valid(gap)
+    garray_T	*gap;
+{
+    syn_var_T	*sv;
+    typval_T	tv;
+    int		same;
+    int		i;
+
+    for (i = 0; i < gap->ga_len; ++i)
+    {
+	sv = (syn_var_T *)gap->ga_data + i;
+	if (syn_cache_get_value(sv, curbuf, &tv) == FAIL)
+	    return FALSE;
+	same = syn_cache_tv_same(&sv->sv_tv, &tv);
+	clear_tv(&tv);
+	if (!same)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Return a dict with the global variables in "gap" that now have a different
+ * value, such as "g:vimsyn_embed" set by the syntax file.  Returns NULL when
+ * a variable was removed or can't be remembered, or when an option that was
+ * used now has another value.
+ */
+    static dict_T *
+syn_cache_gvars_set(gap)
+    garray_T	*gap;
+{
+    dict_T	*d;
+    syn_var_T	*sv;
+    dictitem_T	*ndi;
+    typval_T	tv;
+    int		i;
+
+    d = dict_alloc();
+    if (d == NULL)
+	return NULL;
+    ++d->dv_refcount;
+    for (i = 0; i < gap->ga_len; ++i)
+    {
+	sv = (syn_var_T *)gap->ga_data + i;
+	if (sv->sv_scope == 'b')
+	    continue;	/* the buffer variables are in sc_vars */
+	if (syn_cache_get_value(sv, curbuf, &tv) == FAIL)
+	    break;
+	if (syn_cache_tv_same(&sv->sv_tv, &tv))
+	{
+	    clear_tv(&tv);
+	    continue;	/* unchanged */
+	}
+	if (sv->sv_scope == '&' || tv.v_type == VAR_UNKNOWN
+				   || (ndi = dictitem_alloc(sv->sv_name)) == NULL)
+	{
+	    clear_tv(&tv);
+	    break;
+	}
+	ndi->di_tv = tv;
+	if (dict_add(d, ndi) == FAIL)
+	{
+	    dictitem_free(ndi);
+	    break;
+	}
+    }
+    if (i < gap->ga_len)
+    {
+	dict_unref(d);
+	return NULL;
+    }
+    return d;
+}
+
+    static void
+syn_cache_free_used(gap)
+    garray_T	*gap;
+{
+    int		i;
+
+    for (i = 0; i < gap->ga_len; ++i)
+    {
+	vim_free(((syn_var_T *)gap->ga_data)[i].sv_name);
+	clear_tv(&((syn_var_T *)gap->ga_data)[i].sv_tv);
+    }
+    ga_clear(gap);
+}
+
+/*
+ * Add the variable or option "name" in "scope" to the syntax files being
+ * sourced.
+ */
+    static void
+syn_cache_use(scope, flags, name)
+    int		scope;
+    int		flags;
+    char_u	*name;
+{
+    syn_rec_T	*sr;
+
+    for (sr = syn_recording; sr != NULL; sr = sr->sr_prev)
+	if (sr->sr_ok && syn_cache_add_used(&sr->sr_used, scope, flags, name)
+								      == FAIL)
+	    sr->sr_ok = FALSE;
+}
+
+/*
+ * Called when variable "name" is used while a syntax file is being sourced.
+ * "scope" is 'g' for a global variable and 'b' for a buffer variable.  The
+ * cached items are only used when it has the same value.
+ */
+    void
+syn_cache_var_used(scope, name)
+    int		scope;
+    char_u	*name;
+{
+    syn_cache_use(scope, 0, name);
+}
+
+/*
+ * Called when the value of option "name" is used while a syntax file is being
+ * sourced.  "opt_flags" is OPT_GLOBAL for "&g:", OPT_LOCAL for "&l:".  The
+ * cached items are only used when it has the same value.
+ */
+    void
+syn_cache_option_used(name, opt_flags)
+    char_u	*name;
+    int		opt_flags;
+{
+    syn_cache_use('&', opt_flags, name);
+}
+
+/*
+ * Remember the arguments of a ":highlight link" command, it is executed again
+ * when the syntax items are taken from the cache.
+ */
+    static void
+syn_cache_add_hl(line)
+    char_u	*line;
+{
+    syn_rec_T	*sr;
+    char_u	*p;
+
+    for (sr = syn_recording; sr != NULL; sr = sr->sr_prev)
+	if (sr->sr_ok)
+	{
+	    p = vim_strsave(line);
+	    if (p == NULL || ga_grow(&sr->sr_hl, 1) == FAIL)
+	    {
+		vim_free(p);
+		sr->sr_ok = FALSE;
+	    }
+	    else
+		((char_u **)sr->sr_hl.ga_data)[sr->sr_hl.ga_len++] = p;
+	}
+}
+
+    static void
+syn_cache_free_entry(sc)
+    syn_cache_T	*sc;
+{
+    int		save_inc_tag = running_syn_inc_tag;
+
+    syntax_clear(&sc->sc_block);
+    running_syn_inc_tag = save_inc_tag;
+    syn_cache_free_deps(&sc->sc_deps);
+    syn_cache_free_used(&sc->sc_used);
+    ga_clear_strings(&sc->sc_hl);
+    vim_free(sc->sc_fname);
+    if (sc->sc_vars != NULL)
+	dict_unref(sc->sc_vars);
+    if (sc->sc_gvars_set != NULL)
+	dict_unref(sc->sc_gvars_set);
+    vim_free(sc);
+}
+
+/*
+ * Free all cached syntax files.  Used when 'syntaxcache' is reset.
+ */
+    void
+syn_cache_clear()
+{
+    syn_cache_T	*sc;
+
+    while (syn_cache != NULL)
+    {
+	sc = syn_cache;
+	syn_cache = sc->sc_next;
+	syn_cache_free_entry(sc);
+    }
+}
+
+/*
+ * Called when a syntax file being sourced does something that would not be
+ * done when the syntax items are taken from the cache, such as setting a
+ * local option.  It won't be cached then.
+ */
+    void
+syn_cache_cancel()
+{
+    syn_rec_T	*sr;
+
+    for (sr = syn_recording; sr != NULL; sr = sr->sr_prev)
+	sr->sr_ok = FALSE;
+}
+
+/*
+ * Called by do_source() before sourcing file "fname".  When it is a syntax
+ * file that was cached, copy the syntax items into the current window.
+ * Returns TRUE when done, the file does not need to be sourced then.
+ */
+    int
+syn_cache_load(fname)
+    char_u	*fname;
+{
+    syn_cache_T	*sc;
+    syn_cache_T	**scp;
+    syn_rec_T	*sr;
+    syn_var_T	*sv;
+    int		i;
+
+    if (!p_sxc || syn_cache == NULL || !syn_cache_fname_ok(fname)
+						     || !syn_block_is_empty())
+	return FALSE;
+
+    /* There may be an entry for each value of the variables and options
+     * used. */
+    for (scp = &syn_cache; *scp != NULL; )
+    {
+	sc = *scp;
+	if (fnamecmp(sc->sc_fname, fname) == 0)
+	{
+	    if (!syn_cache_deps_valid(&sc->sc_deps))
+	    {
+		/* A file was changed, source it again. */
+		*scp = sc->sc_next;
+		syn_cache_free_entry(sc);
+		continue;
+	    }
+	    if (syn_cache_used_valid(&sc->sc_used))
+		break;
+	}
+	scp = &sc->sc_next;
+    }
+    sc = *scp;
+    if (sc == NULL)
+	return FALSE;
+
+    if (syn_copy_block(&sc->sc_block, curwin->w_s) == FAIL)
+    {
+	syntax_clear(curwin->w_s);
+	return FALSE;
+    }
+    if (running_syn_inc_tag < sc->sc_inc_tag)
+	running_syn_inc_tag = sc->sc_inc_tag;
+    dict_extend(curbuf->b_vars, sc->sc_vars, (char_u *)"force");
+    dict_extend(get_globvar_dict(), sc->sc_gvars_set, (char_u *)"force");
+
+    /* A syntax file sourcing this one depends on the same files, variables
+     * and options. */
+    for (sr = syn_recording; sr != NULL; sr = sr->sr_prev)
+	for (i = 0; i < sc->sc_deps.ga_len; ++i)
+	    if (syn_cache_add_dep(&sr->sr_deps,
+		       ((syn_dep_T *)sc->sc_deps.ga_data)[i].sd_fname) == FAIL)
+		sr->sr_ok = FALSE;
+    for (i = 0; i < sc->sc_used.ga_len; ++i)
+    {
+	sv = (syn_var_T *)sc->sc_used.ga_data + i;
+	syn_cache_use(sv->sv_scope, sv->sv_flags, sv->sv_name);
+    }
+
+    /* Links may have been cleared with ":highlight clear", do them again.
+     * This also adds them to a syntax file sourcing this one. */
+    for (i = 0; i < sc->sc_hl.ga_len; ++i)
+	do_highlight(((char_u **)sc->sc_hl.ga_data)[i], FALSE, FALSE);
+
+    if (p_verbose > 1)
+    {
+	verbose_enter();
+	smsg((char_u *)_("using cached syntax items for \"%s\""), fname);
+	verbose_leave();
+    }
+    redraw_curbuf_later(SOME_VALID);
+    syn_stack_free_all(curwin->w_s);
+    return TRUE;
+}
+
+/*
+ * Called by do_source() when starting to source file "fname".  Remembers it
+ * for the syntax files being sourced.  When 'syntaxcache' is set and there
+ * are no syntax items yet, start recording what it does.
+ * Returns TRUE when recording started, syn_cache_end() must be called then.
+ */
+    int
+syn_cache_start(fname)
+    char_u	*fname;
+{
+    syn_rec_T	*sr;
+
+    for (sr = syn_recording; sr != NULL; sr = sr->sr_prev)
+	if (syn_cache_add_dep(&sr->sr_deps, fname) == FAIL)
+	    sr->sr_ok = FALSE;
+
+    if (!p_sxc || !syn_cache_fname_ok(fname) || !syn_block_is_empty())
+	return FALSE;
+    sr = (syn_rec_T *)alloc_clear((unsigned)sizeof(syn_rec_T));
+    if (sr == NULL)
+	return FALSE;
+    sr->sr_fname = vim_strsave(fname);
+    ga_init2(&sr->sr_deps, (int)sizeof(syn_dep_T), 4);
+    ga_init2(&sr->sr_used, (int)sizeof(syn_var_T), 4);
+    ga_init2(&sr->sr_hl, (int)sizeof(char_u *), 4);
+    sr->sr_block = curwin->w_s;
+    sr->sr_buf = curbuf;
+    sr->sr_vars = dict_alloc();
+    if (sr->sr_vars != NULL)
+    {
+	++sr->sr_vars->dv_refcount;
+	dict_extend(sr->sr_vars, curbuf->b_vars, (char_u *)"force");
+    }
+    sr->sr_ok = sr->sr_fname != NULL && sr->sr_vars != NULL
+			       && syn_cache_add_dep(&sr->sr_deps, fname) == OK;
+    sr->sr_prev = syn_recording;
+    syn_recording = sr;
+    syn_cache_buf = curbuf;
+    return TRUE;
+}
+
+/*
+ * Called by do_source() after sourcing a file for which syn_cache_start()
+ * returned TRUE.  When the file defined syntax items and did nothing else
+ * that can't be repeated, add them to the cache.
+ */
+    void
+syn_cache_end()
+{
+    syn_rec_T	*sr = syn_recording;
+    syn_cache_T	*sc;
+    dict_T	*vars = NULL;
+    dict_T	*gvars = NULL;
+
+    if (sr == NULL)
+	return;
+    syn_recording = sr->sr_prev;
+    syn_cache_buf = syn_recording == NULL ? NULL : syn_recording->sr_buf;
+
+    if (sr->sr_ok && p_sxc && !did_emsg && !aborting()
+	    && curwin->w_s == sr->sr_block && curbuf == sr->sr_buf
+	    && !sr->sr_block->b_syn_error
+	    && sr->sr_block->b_syn_topgrp == 0 && current_syn_inc_tag == 0
+	    && syntax_present(curwin)
+	    && (gvars = syn_cache_gvars_set(&sr->sr_used)) != NULL
+	    && (vars = syn_cache_vars_set(sr->sr_vars, curbuf->b_vars))
+								      != NULL)
+    {
+	sc = (syn_cache_T *)alloc_clear((unsigned)sizeof(syn_cache_T));
+	if (sc != NULL)
+	{
+	    hash_init(&sc->sc_block.b_keywtab);
+	    hash_init(&sc->sc_block.b_keywtab_ic);
+	    sc->sc_vars = vars;
+	    vars = NULL;
+	    sc->sc_gvars_set = gvars;
+	    gvars = NULL;
+	    if (syn_copy_block(sr->sr_block, &sc->sc_block) == FAIL)
+		syn_cache_free_entry(sc);
+	    else
+	    {
+		sc->sc_fname = sr->sr_fname;
+		sr->sr_fname = NULL;
+		sc->sc_deps = sr->sr_deps;
+		ga_init(&sr->sr_deps);
+		sc->sc_used = sr->sr_used;
+		ga_init(&sr->sr_used);
+		sc->sc_hl = sr->sr_hl;
+		ga_init(&sr->sr_hl);
+		sc->sc_inc_tag = running_syn_inc_tag;
+		sc->sc_next = syn_cache;
+		syn_cache = sc;
+	    }
+	}
+    }
+    if (vars != NULL)
+	dict_unref(vars);
+    if (gvars != NULL)
+	dict_unref(gvars);
+    if (sr->sr_vars != NULL)
+	dict_unref(sr->sr_vars);
+    vim_free(sr->sr_fname);
+    syn_cache_free_deps(&sr->sr_deps);
+    syn_cache_free_used(&sr->sr_used);
+    ga_clear_strings(&sr->sr_hl);
+    vim_free(sr);
+}
+
+/*
+ * Return a dict with the variables in "after" that are not in "before" or
+ * have a different value, such as "b:current_syntax".  Only Numbers and
+ * Strings can be remembered.  Returns NULL when a variable was removed or
+ * can't be remembered.
+ */
+    static dict_T *
+syn_cache_vars_set(before, after)
+    dict_T	*before;
+    dict_T	*after;
+{
+    dict_T	*d;
+    dictitem_T	*di;
+    dictitem_T	*bdi;
+    hashitem_T	*hi;
+    int		todo;
+    int		ok = TRUE;
+
+    d = dict_alloc();
+    if (d == NULL)
+	return NULL;
+    ++d->dv_refcount;
+
+    todo = (int)before->dv_hashtab.ht_used;
+    for (hi = before->dv_hashtab.ht_array; todo > 0 && ok; ++hi)
+	if (!HASHITEM_EMPTY(hi))
+	{
+	    --todo;
+	    if (dict_find(after, hi->hi_key, -1) == NULL)
+		ok = FALSE;
+	}
+
+    todo = (int)after->dv_hashtab.ht_used;
+    for (hi = after->dv_hashtab.ht_array; todo > 0 && ok; ++hi)
+	if (!HASHITEM_EMPTY(hi))
+	{
+	    --todo;
+	    di = dict_lookup(hi);
+	    bdi = dict_find(before, hi->hi_key, -1);
+	    if (bdi != NULL && syn_cache_tv_same(&bdi->di_tv, &di->di_tv))
+		continue;	/* unchanged */
+	    if ((di->di_tv.v_type != VAR_NUMBER
+					    && di->di_tv.v_type != VAR_STRING)
+		    || (bdi = dictitem_alloc(hi->hi_key)) == NULL)
+		ok = FALSE;
+	    else
+	    {
+		copy_tv(&di->di_tv, &bdi->di_tv);
+		if (dict_add(d, bdi) == FAIL)
+		{
+		    dictitem_free(bdi);
+		    ok = FALSE;
+		}
+	    }
+	}
+
+    if (!ok)
+    {
+	dict_unref(d);
+	return NULL;
+    }
+    return d;
+}
+
+/*
+ * Copy the syntax items of "from" to "to", which must be empty.
+ * The compiled patterns are shared.
+ * Returns FAIL when out of memory.
+ */
+    static int
+syn_copy_block(from, to)
+    synblock_T	*from;
+    synblock_T	*to;
+{
+    synpat_T		*fp, *tp;
+    syn_cluster_T	*fcp, *tcp;
+    int			i;
+
+    to->b_syn_ic = from->b_syn_ic;
+    to->b_syn_spell = from->b_syn_spell;
+    to->b_syn_containedin = from->b_syn_containedin;
+    to->b_spell_cluster_id = from->b_spell_cluster_id;
+    to->b_nospell_cluster_id = from->b_nospell_cluster_id;
+    to->b_syn_sync_flags = from->b_syn_sync_flags;
+    to->b_syn_sync_id = from->b_syn_sync_id;
+    to->b_syn_sync_minlines = from->b_syn_sync_minlines;
+    to->b_syn_sync_maxlines = from->b_syn_sync_maxlines;
+    to->b_syn_sync_linebreaks = from->b_syn_sync_linebreaks;
+    to->b_syn_linecont_ic = from->b_syn_linecont_ic;
+# ifdef FEAT_CONCEAL
+    to->b_syn_conceal = from->b_syn_conceal;
+# endif
+# ifdef FEAT_FOLDING
+    to->b_syn_folditems = from->b_syn_folditems;
+# endif
+    if (from->b_syn_linecont_pat != NULL)
+    {
+	to->b_syn_linecont_pat = vim_strsave(from->b_syn_linecont_pat);
+	if (to->b_syn_linecont_pat == NULL)
+	    return FAIL;
+	to->b_syn_linecont_prog = vim_regref(from->b_syn_linecont_prog);
+    }
+
+    if (syn_copy_keywtab(&from->b_keywtab, &to->b_keywtab) == FAIL
+	    || syn_copy_keywtab(&from->b_keywtab_ic, &to->b_keywtab_ic)
+								      == FAIL)
+	return FAIL;
+
+    to->b_syn_patterns.ga_itemsize = sizeof(synpat_T);
+    to->b_syn_patterns.ga_growsize = 10;
+    if (ga_grow(&to->b_syn_patterns, from->b_syn_patterns.ga_len) == FAIL)
+	return FAIL;
+    for (i = 0; i < from->b_syn_patterns.ga_len; ++i)
+    {
+	fp = &SYN_ITEMS(from)[i];
+	tp = &SYN_ITEMS(to)[i];
+	*tp = *fp;
+	tp->sp_prog = vim_regref(fp->sp_prog);
+# ifdef FEAT_PROFILE
+	syn_clear_time(&tp->sp_time);
+# endif
+	tp->sp_line_id = 0;
+	tp->sp_startcol = 0;
+	/* The start patterns of a region share the lists, the skip and end
+	 * patterns have none, see syn_clear_pattern(). */
+	if (i > 0 && fp[-1].sp_type == SPTYPE_START)
+	{
+	    if (fp->sp_type == SPTYPE_START)
+	    {
+		tp->sp_cont_list = tp[-1].sp_cont_list;
+		tp->sp_next_list = tp[-1].sp_next_list;
+		tp->sp_syn.cont_in_list = tp[-1].sp_syn.cont_in_list;
+	    }
+	    else
+	    {
+		tp->sp_cont_list = NULL;
+		tp->sp_next_list = NULL;
+		tp->sp_syn.cont_in_list = NULL;
+	    }
+	}
+	else
+	{
+	    tp->sp_cont_list = copy_id_list(fp->sp_cont_list);
+	    tp->sp_next_list = copy_id_list(fp->sp_next_list);
+	    tp->sp_syn.cont_in_list = copy_id_list(fp->sp_syn.cont_in_list);
+	}
+	tp->sp_pattern = vim_strsave(fp->sp_pattern);
+	++to->b_syn_patterns.ga_len;
+	if (tp->sp_pattern == NULL)
+	    return FAIL;
+    }
+
+    to->b_syn_clusters.ga_itemsize = sizeof(syn_cluster_T);
+    to->b_syn_clusters.ga_growsize = 10;
+    if (ga_grow(&to->b_syn_clusters, from->b_syn_clusters.ga_len) == FAIL)
+	return FAIL;
+    for (i = 0; i < from->b_syn_clusters.ga_len; ++i)
+    {
+	fcp = &SYN_CLSTR(from)[i];
+	tcp = &SYN_CLSTR(to)[i];
+	tcp->scl_name = vim_strsave(fcp->scl_name);
+	tcp->scl_name_u = vim_strsave(fcp->scl_name_u);
+	tcp->scl_list = copy_id_list(fcp->scl_list);
+	++to->b_syn_clusters.ga_len;
+	if (tcp->scl_name == NULL || tcp->scl_name_u == NULL)
+	    return FAIL;
+    }
+    return OK;
+}
+
+/*
+ * Copy the keywords in hashtab "from" to the empty hashtab "to".
+ * Returns FAIL when out of memory.
+ */
+    static int
+syn_copy_keywtab(from, to)
+    hashtab_T	*from;
+    hashtab_T	*to;
+{
+    hashitem_T	*hi;
+    int		todo;
+    keyentry_T	*kp;
+    keyentry_T	*nkp;
+    keyentry_T	*first;
+    keyentry_T	**prevp;
+    int		failed = FALSE;
+
+    todo = (int)from->ht_used;
+    for (hi = from->ht_array; todo > 0; ++hi)
+    {
+	if (HASHITEM_EMPTY(hi))
+	    continue;
+	--todo;
+	first = NULL;
+	prevp = &first;
+	for (kp = HI2KE(hi); kp != NULL; kp = kp->ke_next)
+	{
+	    nkp = (keyentry_T *)alloc((int)(sizeof(keyentry_T)
+						      + STRLEN(kp->keyword)));
+	    if (nkp == NULL)
+	    {
+		failed = TRUE;
+		break;
+	    }
+	    *nkp = *kp;
+	    STRCPY(nkp->keyword, kp->keyword);
+	    nkp->k_syn.cont_in_list = copy_id_list(kp->k_syn.cont_in_list);
+	    nkp->next_list = copy_id_list(kp->next_list);
+	    nkp->ke_next = NULL;
+	    *prevp = nkp;
+	    prevp = &nkp->ke_next;
+	}
+	if (first != NULL && hash_add(to, KE2HIKEY(first)) == FAIL)
+	{
+	    for (kp = first; kp != NULL; kp = nkp)
+	    {
+		nkp = kp->ke_next;
+		vim_free(kp->next_list);
+		vim_free(kp->k_syn.cont_in_list);
+		vim_free(kp);
+	    }
+	    failed = TRUE;
+	}
+	if (failed)
+	    return FAIL;
+    }
+    return OK;
+}
+#endif
+
     int
 syntax_present(win)
     win_T	*win;
@@ -7127,6 +8272,9 @@ do_highlight(line, forceit, init)
     int		error = FALSE;
     int		color;
     int		is_normal_group = FALSE;	/* "Normal" group */
+#ifdef FEAT_EVAL
+    char_u	*line_start = line;
+#endif
 #ifdef FEAT_GUI_X11
     int		is_menu_group = FALSE;		/* "Menu" group */
     int		is_scrollbar_group = FALSE;	/* "Scrollbar" group */
@@ -7186,6 +8334,16 @@ do_highlight(line, forceit, init)
 	return;
     }
 
+#ifdef FEAT_EVAL
+    /* A syntax file that sets highlight attributes can't be cached, they
+     * would not be set again after ":highlight clear".  Links are done
+     * again. */
+    if (!dolink)
+	syn_cache_cancel();
+    else if (!init)
+	syn_cache_add_hl(line_start);
+#endif
+
     /*
      * Handle ":highlight link {from} {to}" command.
      */
@@ -403,6 +403,16 @@ static struct builtin_term builtin_termcaps[] =
     {(int)KS_CDL,	IF_EB("\033[%p1%dM", ESC_STR "[%p1%dM")},
 #  else
     {(int)KS_CDL,	IF_EB("\033[%dM", ESC_STR "[%dM")},
+#  endif
+#  ifdef TERMINFO
+    {(int)KS_CIC,	IF_EB("\033[%p1%d@", ESC_STR "[%p1%d@")},
+#  else
+    {(int)KS_CIC,	IF_EB("\033[%d@", ESC_STR "[%d@")},
+#  endif
+#  ifdef TERMINFO
+    {(int)KS_CDC,	IF_EB("\033[%p1%dP", ESC_STR "[%p1%dP")},
+#  else
+    {(int)KS_CDC,	IF_EB("\033[%dP", ESC_STR "[%dP")},
 #  endif
     {(int)KS_CL,	IF_EB("\033[H\033[2J", ESC_STR "[H" ESC_STR_nc "[2J")},
     {(int)KS_ME,	IF_EB("\033[0m", ESC_STR "[0m")},
@@ -754,6 +764,16 @@ static struct builtin_term builtin_termcaps[] =
     {(int)KS_CDL,	IF_EB("\033[%p1%dM", ESC_STR "[%p1%dM")},
 #  else
     {(int)KS_CDL,	IF_EB("\033[%dM", ESC_STR "[%dM")},
+#  endif
+#  ifdef TERMINFO
+    {(int)KS_CIC,	IF_EB("\033[%p1%d@", ESC_STR "[%p1%d@")},
+#  else
+    {(int)KS_CIC,	IF_EB("\033[%d@", ESC_STR "[%d@")},
+#  endif
+#  ifdef TERMINFO
+    {(int)KS_CDC,	IF_EB("\033[%p1%dP", ESC_STR "[%p1%dP")},
+#  else
+    {(int)KS_CDC,	IF_EB("\033[%dP", ESC_STR "[%dP")},
 #  endif
     {(int)KS_CL,	IF_EB("\033[H\033[2J", ESC_STR "[H" ESC_STR_nc "[2J")},
     {(int)KS_CD,	IF_EB("\033[J", ESC_STR "[J")},
@@ -912,6 +932,16 @@ static struct builtin_term builtin_termcaps[] =
 #  else
     {(int)KS_CDL,	IF_EB("\033[%dM", ESC_STR "[%dM")},
 #  endif
+#  ifdef TERMINFO
+    {(int)KS_CIC,	IF_EB("\033[%p1%d@", ESC_STR "[%p1%d@")},
+#  else
+    {(int)KS_CIC,	IF_EB("\033[%d@", ESC_STR "[%d@")},
+#  endif
+#  ifdef TERMINFO
+    {(int)KS_CDC,	IF_EB("\033[%p1%dP", ESC_STR "[%p1%dP")},
+#  else
+    {(int)KS_CDC,	IF_EB("\033[%dP", ESC_STR "[%dP")},
+#  endif
 #  ifdef TERMINFO
     {(int)KS_CS,	IF_EB("\033[%i%p1%d;%p2%dr",
 						  ESC_STR "[%i%p1%d;%p2%dr")},
@@ -960,6 +990,8 @@ static struct builtin_term builtin_termcaps[] =
     {(int)KS_CWS,	IF_EB("\033[8;%d;%dt", ESC_STR "[8;%d;%dt")},
     {(int)KS_CWP,	IF_EB("\033[3;%d;%dt", ESC_STR "[3;%d;%dt")},
 #  endif
+    {(int)KS_BU,	IF_EB("\033[?2026h", ESC_STR "[?2026h")},
+    {(int)KS_EU,	IF_EB("\033[?2026l", ESC_STR "[?2026l")},
     {(int)KS_CRV,	IF_EB("\033[>c", ESC_STR "[>c")},
     {(int)KS_U7,	IF_EB("\033[6n", ESC_STR "[6n")},
 
@@ -1181,6 +1213,16 @@ static struct builtin_term builtin_termcaps[] =
 #  else
     {(int)KS_CDL,	"[CDL%d]"},
 #  endif
+#  ifdef TERMINFO
+    {(int)KS_CIC,	"[CIC%p1%d]"},
+#  else
+    {(int)KS_CIC,	"[CIC%d]"},
+#  endif
+#  ifdef TERMINFO
+    {(int)KS_CDC,	"[CDC%p1%d]"},
+#  else
+    {(int)KS_CDC,	"[CDC%d]"},
+#  endif
 #  ifdef TERMINFO
     {(int)KS_CS,	"[%p1%dCS%p2%d]"},
 #  else
@@ -1610,6 +1652,7 @@ set_termname(term)
 			  } string_names[] =
 			    {	{KS_CE, "ce"}, {KS_AL, "al"}, {KS_CAL,"AL"},
 				{KS_DL, "dl"}, {KS_CDL,"DL"}, {KS_CS, "cs"},
+				{KS_CIC,"IC"}, {KS_CDC,"DC"},
 				{KS_CL, "cl"}, {KS_CD, "cd"},
 				{KS_VI, "vi"}, {KS_VE, "ve"}, {KS_MB, "mb"},
 				{KS_VS, "vs"}, {KS_ME, "me"}, {KS_MR, "mr"},
@@ -2507,6 +2550,8 @@ termcapinit(name)
 
 /*
  * the number of calls to ui_write is reduced by using the buffer "out_buf"
+ * It starts with OUT_SIZE bytes and grows up to 'ttybufsize', so that a whole
+ * screen update can be written at once.
  */
 #ifdef DOS16
 # define OUT_SIZE	255		/* only have 640K total... */
@@ -2517,27 +2562,125 @@ termcapinit(name)
 #  define OUT_SIZE	2047
 # endif
 #endif
+#define OUT_SYNC_MAX	20	/* room before and after the text for t_BU and
+				   t_EU */
+#define OUT_SYNC_MIN	256	/* don't use t_BU and t_EU for less text */
 	    /* Add one to allow mch_write() in os_win32.c to append a NUL */
-static char_u		out_buf[OUT_SIZE + 1];
+static char_u		out_buf_static[OUT_SYNC_MAX + OUT_SIZE + OUT_SYNC_MAX
+									 + 1];
+static char_u		*out_buf = out_buf_static + OUT_SYNC_MAX;
+static int		out_size = OUT_SIZE;	/* size of out_buf */
 static int		out_pos = 0;	/* number of chars in out_buf */
+static long_u		out_bytes = 0;	/* number of chars flushed */
+static long_u		out_writes = 0;	/* number of calls to ui_write() */
+
+static void out_buf_full __ARGS((void));
 
 /*
  * out_flush(): flush the output buffer
+ * When 't_BU' and 't_EU' are set and there is more than a bit of text, it is
+ * put in between them, so that the terminal shows it all at once.
  */
     void
 out_flush()
 {
     int	    len;
+    char_u  *p;
+    int	    bu_len;
+    int	    eu_len;
 
     if (out_pos != 0)
     {
 	/* set out_pos to 0 before ui_write, to avoid recursiveness */
 	len = out_pos;
 	out_pos = 0;
-	ui_write(out_buf, len);
+	p = out_buf;
+	if (len >= OUT_SYNC_MIN && termcap_active && !p_wd
+		&& T_BU != NULL && *T_BU != NUL && T_EU != NULL && *T_EU != NUL
+#ifdef FEAT_GUI
+		&& !gui.in_use
+#endif
+		)
+	{
+	    bu_len = (int)STRLEN(T_BU);
+	    eu_len = (int)STRLEN(T_EU);
+	    if (bu_len <= OUT_SYNC_MAX && eu_len <= OUT_SYNC_MAX)
+	    {
+		p -= bu_len;
+		mch_memmove(p, T_BU, (size_t)bu_len);
+		mch_memmove(out_buf + len, T_EU, (size_t)eu_len);
+		len += bu_len + eu_len;
+	    }
+	}
+	out_bytes += len;
+	++out_writes;
+	ui_write(p, len);
+
+	/* Go back to the small buffer when 'ttybufsize' was made smaller. */
+	if (out_size > OUT_SIZE && out_size > p_tbz && out_pos == 0)
+	    out_buf_free();
+    }
+}
+
+/*
+ * Called when "out_buf" is full: make it bigger, up to 'ttybufsize', or
+ * flush it.
+ */
+    static void
+out_buf_full()
+{
+    long	newsize;
+    char_u	*p;
+
+    newsize = (long)out_size * 2;
+    if (newsize > p_tbz)
+	newsize = p_tbz;
+    if (newsize > out_size)
+    {
+	/* Don't use alloc(), it may give a message. */
+	p = lalloc((long_u)(OUT_SYNC_MAX + newsize + OUT_SYNC_MAX + 1), FALSE);
+	if (p != NULL)
+	{
+	    mch_memmove(p + OUT_SYNC_MAX, out_buf, (size_t)out_pos);
+	    if (out_buf != out_buf_static + OUT_SYNC_MAX)
+		vim_free(out_buf - OUT_SYNC_MAX);
+	    out_buf = p + OUT_SYNC_MAX;
+	    out_size = (int)newsize;
+	    return;
+	}
+    }
+    out_flush();
+}
+
+/*
+ * Free the output buffer when it was made bigger.  Anything in it is
+ * written first.
+ */
+    void
+out_buf_free()
+{
+    if (out_buf != out_buf_static + OUT_SYNC_MAX)
+    {
+	out_flush();
+	vim_free(out_buf - OUT_SYNC_MAX);
+	out_buf = out_buf_static + OUT_SYNC_MAX;
+	out_size = OUT_SIZE;
     }
 }
 
+/*
+ * Get the number of bytes output so far, including what is still in the
+ * buffer, and the number of writes done to get them out.
+ */
+    void
+out_stats(bytesp, writesp)
+    long_u	*bytesp;
+    long_u	*writesp;
+{
+    *bytesp = out_bytes + out_pos;
+    *writesp = out_writes;
+}
+
 #if defined(FEAT_MBYTE) || defined(PROTO)
 /*
  * Sometimes a byte out of a multi-byte character is written with out_char().
@@ -2546,8 +2689,8 @@ out_flush()
     void
 out_flush_check()
 {
-    if (enc_dbcs != 0 && out_pos >= OUT_SIZE - MB_MAXBYTES)
-	out_flush();
+    if (enc_dbcs != 0 && out_pos >= out_size - MB_MAXBYTES)
+	out_buf_full();
 }
 #endif
 
@@ -2580,8 +2723,10 @@ out_char(c)
     out_buf[out_pos++] = c;
 
     /* For testing we flush each time. */
-    if (out_pos >= OUT_SIZE || p_wd)
+    if (p_wd)
 	out_flush();
+    else if (out_pos >= out_size)
+	out_buf_full();
 }
 
 static void out_char_nf __ARGS((unsigned));
@@ -2600,8 +2745,8 @@ out_char_nf(c)
 
     out_buf[out_pos++] = c;
 
-    if (out_pos >= OUT_SIZE)
-	out_flush();
+    if (out_pos >= out_size)
+	out_buf_full();
 }
 
 #if defined(FEAT_TITLE) || defined(FEAT_MOUSE_TTY) || defined(FEAT_GUI) \
@@ -2619,8 +2764,8 @@ out_char_nf(c)
 out_str_nf(s)
     char_u *s;
 {
-    if (out_pos > OUT_SIZE - 20)  /* avoid terminal strings being split up */
-	out_flush();
+    if (out_pos > out_size - 20)  /* avoid terminal strings being split up */
+	out_buf_full();
     while (*s)
 	out_char_nf(*s++);
 
@@ -2651,8 +2796,8 @@ out_str(s)
 	}
 #endif
 	/* avoid terminal strings being split up */
-	if (out_pos > OUT_SIZE - 20)
-	    out_flush();
+	if (out_pos > out_size - 20)
+	    out_buf_full();
 #ifdef HAVE_TGETENT
 	tputs((char *)s, 1, TPUTSFUNCAST out_char_nf);
 #else
@@ -2698,6 +2843,43 @@ term_delete_lines(line_count)
     OUT_STR(tgoto((char *)T_CDL, 0, line_count));
 }
 
+    void
+term_insert_chars(count)
+    int	    count;
+{
+    OUT_STR(tgoto((char *)T_CIC, 0, count));
+}
+
+    void
+term_delete_chars(count)
+    int	    count;
+{
+    OUT_STR(tgoto((char *)T_CDC, 0, count));
+}
+
+/*
+ * Return the number of bytes term_windgoto() sends for "row" and "col".
+ */
+    int
+term_windgoto_len(row, col)
+    int	    row;
+    int	    col;
+{
+    return (int)STRLEN(tgoto((char *)T_CM, col, row));
+}
+
+/*
+ * Return the number of bytes sent for termcap string "s" that takes one
+ * argument "n", such as T_CRI and T_CIC.
+ */
+    int
+term_arg_len(s, n)
+    char_u  *s;
+    int	    n;
+{
+    return (int)STRLEN(tgoto((char *)s, 0, n));
+}
+
 #if defined(HAVE_TGETENT) || defined(PROTO)
     void
 term_set_winpos(x, y)
@@ -31,6 +31,8 @@ enum SpecialKey
     KS_CAL,	/* add number of blank lines */
     KS_DL,	/* delete line */
     KS_CDL,	/* delete number of lines */
+    KS_CIC,	/* insert number of blank chars */
+    KS_CDC,	/* delete number of chars */
     KS_CS,	/* scroll region */
     KS_CL,	/* clear screen */
     KS_CD,	/* clear to end of display */
@@ -80,6 +82,8 @@ enum SpecialKey
     KS_CRV,	/* request version string */
     KS_CSI,	/* start insert mode (bar cursor) */
     KS_CEI,	/* end insert mode (block cursor) */
+    KS_BU,	/* begin synchronized update */
+    KS_EU,	/* end synchronized update */
 #ifdef FEAT_VERTSPLIT
     KS_CSV,	/* scroll region vertical */
 #endif
@@ -108,6 +112,8 @@ extern char_u *(term_strings[]);    /* current terminal strings */
 #define T_CAL	(term_str(KS_CAL))	/* add number of blank lines */
 #define T_DL	(term_str(KS_DL))	/* delete line */
 #define T_CDL	(term_str(KS_CDL))	/* delete number of lines */
+#define T_CIC	(term_str(KS_CIC))	/* insert number of blank chars */
+#define T_CDC	(term_str(KS_CDC))	/* delete number of chars */
 #define T_CS	(term_str(KS_CS))	/* scroll region */
 #define T_CSV	(term_str(KS_CSV))	/* scroll region vertical */
 #define T_CL	(term_str(KS_CL))	/* clear screen */
@@ -157,6 +163,8 @@ extern char_u *(term_strings[]);    /* current terminal strings */
 #define T_CWS	(term_str(KS_CWS))	/* window size */
 #define T_CSI	(term_str(KS_CSI))	/* start insert mode */
 #define T_CEI	(term_str(KS_CEI))	/* end insert mode */
+#define T_BU	(term_str(KS_BU))	/* begin synchronized update */
+#define T_EU	(term_str(KS_EU))	/* end synchronized update */
 #define T_CRV	(term_str(KS_CRV))	/* request version string */
 #define T_OP	(term_str(KS_OP))	/* original color pair */
 #define T_U7	(term_str(KS_U7))	/* request cursor position */
@@ -38,7 +38,16 @@ SCRIPTS = test1.out test3.out test4.out test5.out test6.out \
 		test104.out test105.out test106.out \
 		test_autoformat_join.out \
 		test_eval.out \
-		test_options.out
+		test_mmapsize.out \
+		test_options.out \
+		test_syn_keyword.out \
+		test_syn_cache.out \
+		test_vimgrep.out \
+		test_rxcache.out \
+		test_vm.out \
+		test_listidx.out \
+		test_json.out \
+		test_longline.out
 
 .SUFFIXES: .in .out
 
@@ -163,4 +172,13 @@ test105.out: test105.in
 test106.out: test106.in
 test_autoformat_join.out: test_autoformat_join.in
 test_eval.out: test_eval.in
+test_mmapsize.out: test_mmapsize.in
 test_options.out: test_options.in
+test_syn_keyword.out: test_syn_keyword.in
+test_syn_cache.out: test_syn_cache.in
+test_vimgrep.out: test_vimgrep.in
+test_rxcache.out: test_rxcache.in
+test_vm.out: test_vm.in
+test_listidx.out: test_listidx.in
+test_json.out: test_json.in
+test_longline.out: test_longline.in
@@ -57,7 +57,16 @@ SCRIPTS =	test3.out test4.out test5.out test6.out test7.out \
 		test105.out test106.out \
 		test_autoformat_join.out \
 		test_eval.out \
-		test_options.out
+		test_mmapsize.out \
+		test_options.out \
+		test_syn_keyword.out \
+		test_syn_cache.out \
+		test_vimgrep.out \
+		test_rxcache.out \
+		test_vm.out \
+		test_listidx.out \
+		test_json.out \
+		test_longline.out
 
 SCRIPTS32 =	test50.out test70.out
 
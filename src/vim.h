@@ -892,6 +892,7 @@ extern char *(*dyn_libintl_textdomain)(const char *domainname);
 # endif
 # define SST_FIX_STATES	 7	/* size of sst_stack[]. */
 # define SST_DIST	 16	/* normal distance between entries */
+# define SST_IDLE_LINES	 100	/* lines parsed at a time when idle */
 # define SST_INVALID	(synstate_T *)-1	/* invalid syn_state pointer */
 
 # define HL_CONTAINED	0x01	/* not used on toplevel */
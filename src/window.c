@@ -3308,6 +3308,7 @@ win_init_empty(wp)
     wp->w_topfill = 0;
 #endif
     wp->w_botline = 2;
+    wp->w_vcol_cache.vc_fnum = 0;
 #ifdef FEAT_FKMAP
     if (wp->w_p_rl)
 	wp->w_farsi = W_CONV + W_R_L;
@@ -4556,6 +4557,8 @@ win_free(wp, tp)
     if (prevwin == wp)
 	prevwin = NULL;
     win_free_lsize(wp);
+    vim_free(wp->w_vcol_cache.vc_points);
+    win_row_cache_free(wp);
 
     for (i = 0; i < wp->w_tagstacklen; ++i)
 	vim_free(wp->w_tagstack[i].tagname);